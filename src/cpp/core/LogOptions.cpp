@@ -35,6 +35,7 @@ namespace log {
 #define kLogFileIncludePid "log-file-include-pid"
 #define kRotate            "rotate"
 #define kMaxSizeMb         "max-size-mb"
+#define kWriteAsync        "write-async"
 #define kLogConfFile       "logging.conf"
 #define kLogConfEnvVar     "RS_LOG_CONF_FILE"
 
@@ -137,7 +138,8 @@ struct LoggerOptionsVisitor : boost::static_visitor<>
          kLogFileMode, defaultOptions.getFileMode(),
          kRotate, defaultOptions.doRotation(),
          kLogFileIncludePid, defaultOptions.includePid(),
-         kMaxSizeMb, defaultOptions.getMaxSizeMb());
+         kMaxSizeMb, defaultOptions.getMaxSizeMb(),
+         kWriteAsync, defaultOptions.writeAsync());
    }
 
    void operator()(const StdErrLogOptions& options)
@@ -307,7 +309,7 @@ LoggerOptions LogOptions::loggerOptions(const std::string& loggerName) const
          std::vector<ConfigProfile::Level> levels = getLevels(loggerName);
 
          std::string logDir, fileMode;
-         bool rotate, includePid;
+         bool rotate, includePid, writeAsync;
          double maxSizeMb;
 
          profile_.getParam(kLogDir, &logDir, levels);
@@ -315,8 +317,9 @@ LoggerOptions LogOptions::loggerOptions(const std::string& loggerName) const
          profile_.getParam(kMaxSizeMb, &maxSizeMb, levels);
          profile_.getParam(kLogFileIncludePid, &includePid, levels);
          profile_.getParam(kLogFileMode, &fileMode, levels);
+         profile_.getParam(kWriteAsync, &writeAsync, levels);
 
-         return FileLogOptions(FilePath(logDir), fileMode, maxSizeMb, rotate, includePid);
+         return FileLogOptions(FilePath(logDir), fileMode, maxSizeMb, rotate, includePid, writeAsync);
       }
 
       case LoggerType::kStdErr:
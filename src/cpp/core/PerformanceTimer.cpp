@@ -15,6 +15,8 @@
 
 #include <core/PerformanceTimer.hpp>
 
+#include <core/Trace.hpp>
+
 #include <iostream>
 #include <iomanip>
 
@@ -33,6 +35,12 @@ PerformanceTimer::PerformanceTimer(const std::string& step)
 {
    start(step);
 }
+
+PerformanceTimer::PerformanceTimer(trace::Histogram& step)
+   : startTime_(ptime(not_a_date_time))
+{
+   start(step);
+}
    
 PerformanceTimer::~PerformanceTimer() 
 {
@@ -50,6 +58,11 @@ PerformanceTimer::~PerformanceTimer()
 }
 
 void PerformanceTimer::start(const std::string& step)   
+{
+   start(trace::histogram("timer", step));
+}
+
+void PerformanceTimer::start(trace::Histogram& step)
 {
    BOOST_ASSERT(!running());
    
@@ -62,6 +75,11 @@ void PerformanceTimer::start(const std::string& step)
 }
          
 void PerformanceTimer::advance(const std::string& step)
+{
+   advance(trace::histogram("timer", step));
+}
+
+void PerformanceTimer::advance(trace::Histogram& step)
 {
    BOOST_ASSERT(running());
    
@@ -70,7 +88,8 @@ void PerformanceTimer::advance(const std::string& step)
    
    // record the start time and add a step
    startTime_ = now();
-   steps_.push_back(std::make_pair(step, time_duration()));
+   Step pending = { &step, time_duration() };
+   steps_.push_back(pending);
 }
    
 void PerformanceTimer::stop()   
@@ -92,7 +111,23 @@ bool PerformanceTimer::running() const
 void PerformanceTimer::recordPendingStep()
 {
    if (!steps_.empty())
-      steps_.back().second = now() - startTime_;
+   {
+      steps_.back().duration = now() - startTime_;
+
+      // also keep a latency histogram of each step (and a trace
+      // event when tracing)
+      trace::Histogram& histogram = *steps_.back().pHistogram;
+      int64_t microseconds = steps_.back().duration.total_microseconds();
+      histogram.record(microseconds);
+      if (trace::isTracingEnabled())
+      {
+         std::chrono::microseconds duration(microseconds);
+         trace::recordEvent(histogram.category().c_str(),
+                            histogram.name().c_str(),
+                            trace::Clock::now() - duration,
+                            duration);
+      }
+   }
 }
  
 boost::posix_time::ptime PerformanceTimer::now() const
@@ -116,9 +151,9 @@ std::ostream& operator << (std::ostream& os, const PerformanceTimer& t)
    for (PerformanceTimer::Steps::const_iterator 
          it = t.steps_.begin(); it != t.steps_.end(); ++it)
    {
-      double ms = it->second.total_microseconds() * 0.001;
+      double ms = it->duration.total_microseconds() * 0.001;
       os << std::setprecision(ms < 10 ? 1 : 0);      
-      os << " " << ms << " ms (" << it->first << ")" << std::endl;
+      os << " " << ms << " ms (" << it->pHistogram->name() << ")" << std::endl;
    }
    
    // restore old output flags
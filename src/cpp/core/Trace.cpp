@@ -16,13 +16,21 @@
 
 #include <core/Trace.hpp>
 
+#include <algorithm>
+#include <cmath>
 #include <map>
 
+#include <boost/shared_ptr.hpp>
 #include <boost/utility.hpp>
 
 #include <core/Thread.hpp>
+#include <core/http/Request.hpp>
+#include <core/http/Response.hpp>
+#include <core/system/Environment.hpp>
+#include <core/system/System.hpp>
 
 #include <iostream>
+#include <sstream>
 
 namespace rstudio {
 namespace core {
@@ -32,6 +40,196 @@ namespace {
 
 boost::mutex s_traceMutex ;
 
+// histogram bucket layout (see Histogram)
+const int64_t kLinearBuckets = 32;
+const int kLinearBits = 5;
+const int kSubBucketBits = 4;
+const int64_t kSubBuckets = 1 << kSubBucketBits;
+const int kMaxExponent = 40; // ~12 days in microseconds
+
+int highestBit(uint64_t value)
+{
+   int bit = 0;
+   while (value >>= 1)
+      ++bit;
+   return bit;
+}
+
+// histograms are never freed (hot paths keep references to them) so they're
+// intentionally leaked rather than destroyed during static destruction
+typedef std::map<std::pair<std::string, std::string>, Histogram*> HistogramMap;
+boost::mutex s_histogramsMutex;
+HistogramMap* s_pHistograms = new HistogramMap();
+
+std::atomic<bool> s_tracingEnabled(false);
+
+// number of events kept for each thread
+const std::size_t kEventsPerThread = 4096;
+
+// an event in a thread's ring buffer. the fields are atomic (though only
+// ever written by the owning thread) so the buffer can be read while it's
+// being written; readers use the count of claimed events to discard any
+// slots that may have been overwritten while they were reading
+struct EventSlot
+{
+   std::atomic<const char*> category;
+   std::atomic<const char*> name;
+   std::atomic<int64_t> start;
+   std::atomic<int64_t> duration;
+};
+
+struct Event
+{
+   const char* category;
+   const char* name;
+   int64_t start;
+   int64_t duration;
+   int threadId;
+};
+
+class ThreadEvents : boost::noncopyable
+{
+public:
+   explicit ThreadEvents(int threadId)
+      : slots_(kEventsPerThread),
+        written_(0),
+        claimed_(0),
+        cleared_(0),
+        threadId_(threadId),
+        active_(true)
+   {
+   }
+
+   void record(const char* category, const char* name, int64_t start, int64_t duration)
+   {
+      uint64_t index = written_.load(std::memory_order_relaxed);
+
+      // claim the slot before writing it (see read)
+      claimed_.store(index + 1, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_release);
+
+      EventSlot& slot = slots_[index % kEventsPerThread];
+      slot.category.store(category, std::memory_order_relaxed);
+      slot.name.store(name, std::memory_order_relaxed);
+      slot.start.store(start, std::memory_order_relaxed);
+      slot.duration.store(duration, std::memory_order_relaxed);
+      written_.store(index + 1, std::memory_order_release);
+   }
+
+   void read(std::vector<Event>* pEvents) const
+   {
+      uint64_t end = written_.load(std::memory_order_acquire);
+      uint64_t begin = end > kEventsPerThread ? end - kEventsPerThread : 0;
+      begin = std::min(std::max(begin, cleared_.load(std::memory_order_relaxed)), end);
+
+      std::vector<Event> events;
+      for (uint64_t i = begin; i < end; ++i)
+      {
+         const EventSlot& slot = slots_[i % kEventsPerThread];
+         Event event;
+         event.category = slot.category.load(std::memory_order_relaxed);
+         event.name = slot.name.load(std::memory_order_relaxed);
+         event.start = slot.start.load(std::memory_order_relaxed);
+         event.duration = slot.duration.load(std::memory_order_relaxed);
+         event.threadId = threadId_;
+         events.push_back(event);
+      }
+
+      // the writer may have lapped us while we were reading (if we read
+      // anything it wrote to a claimed slot we'll see the claim here)
+      std::atomic_thread_fence(std::memory_order_acquire);
+      uint64_t claimed = claimed_.load(std::memory_order_relaxed);
+      uint64_t firstValid = claimed > kEventsPerThread ? claimed - kEventsPerThread : 0;
+      std::size_t skip = static_cast<std::size_t>(std::min(
+               std::max(firstValid, begin) - begin, end - begin));
+      pEvents->insert(pEvents->end(), events.begin() + skip, events.end());
+   }
+
+   void clear()
+   {
+      cleared_.store(written_.load(std::memory_order_acquire), std::memory_order_relaxed);
+   }
+
+   void reset(int threadId)
+   {
+      written_.store(0, std::memory_order_relaxed);
+      claimed_.store(0, std::memory_order_relaxed);
+      cleared_.store(0, std::memory_order_relaxed);
+      threadId_ = threadId;
+      active_ = true;
+   }
+
+   std::vector<EventSlot> slots_;
+   std::atomic<uint64_t> written_;
+   std::atomic<uint64_t> claimed_;
+
+   // events written before this were cleared
+   std::atomic<uint64_t> cleared_;
+
+   int threadId_;
+   std::atomic<bool> active_;
+};
+
+// the event buffers of every thread which has recorded events. the buffers
+// of threads which have exited are kept (so their events can still be
+// read) unless there are more than kMaxThreadEvents buffers, in which case
+// they're reused by new threads
+const std::size_t kMaxThreadEvents = 64;
+typedef std::vector<boost::shared_ptr<ThreadEvents> > ThreadEventsList;
+boost::mutex s_eventsMutex;
+ThreadEventsList* s_pThreadEvents = new ThreadEventsList();
+int s_nextThreadId = 1;
+
+struct ThreadEventsOwner
+{
+   ~ThreadEventsOwner()
+   {
+      if (pEvents)
+         pEvents->active_ = false;
+   }
+
+   boost::shared_ptr<ThreadEvents> pEvents;
+};
+
+thread_local ThreadEventsOwner s_threadEventsOwner;
+
+ThreadEvents& threadEvents()
+{
+   if (!s_threadEventsOwner.pEvents)
+   {
+      LOCK_MUTEX(s_eventsMutex)
+      {
+         int threadId = s_nextThreadId++;
+         for (const boost::shared_ptr<ThreadEvents>& pEvents : *s_pThreadEvents)
+         {
+            if (s_pThreadEvents->size() < kMaxThreadEvents)
+               break;
+
+            if (!pEvents->active_)
+            {
+               pEvents->reset(threadId);
+               s_threadEventsOwner.pEvents = pEvents;
+               break;
+            }
+         }
+
+         if (!s_threadEventsOwner.pEvents)
+         {
+            s_threadEventsOwner.pEvents.reset(new ThreadEvents(threadId));
+            s_pThreadEvents->push_back(s_threadEventsOwner.pEvents);
+         }
+      }
+      END_LOCK_MUTEX
+   }
+
+   return *s_threadEventsOwner.pEvents;
+}
+
+int64_t toMicroseconds(Clock::duration duration)
+{
+   return std::chrono::duration_cast<std::chrono::microseconds>(duration).count();
+}
+
 } // anonymous namespace
 
 
@@ -44,6 +242,298 @@ void add(void* key, const std::string& functionName)
    END_LOCK_MUTEX
 }
 
+const std::size_t Histogram::kBucketCount =
+      kLinearBuckets + (kMaxExponent - kLinearBits + 1) * kSubBuckets;
+
+Histogram::Histogram(const std::string& category, const std::string& name)
+   : category_(category),
+     name_(name),
+     buckets_(kBucketCount),
+     count_(0),
+     total_(0),
+     max_(0)
+{
+}
+
+void Histogram::record(int64_t microseconds)
+{
+   microseconds = std::max<int64_t>(microseconds, 0);
+
+   buckets_[bucketIndex(microseconds)].fetch_add(1, std::memory_order_relaxed);
+   count_.fetch_add(1, std::memory_order_relaxed);
+   total_.fetch_add(static_cast<uint64_t>(microseconds), std::memory_order_relaxed);
+
+   int64_t max = max_.load(std::memory_order_relaxed);
+   while (microseconds > max &&
+          !max_.compare_exchange_weak(max, microseconds, std::memory_order_relaxed))
+   {
+   }
+}
+
+void Histogram::record(Clock::duration duration)
+{
+   record(toMicroseconds(duration));
+}
+
+uint64_t Histogram::count() const
+{
+   return count_.load(std::memory_order_relaxed);
+}
+
+int64_t Histogram::max() const
+{
+   return max_.load(std::memory_order_relaxed);
+}
+
+double Histogram::mean() const
+{
+   uint64_t count = this->count();
+   if (count == 0)
+      return 0;
+   return static_cast<double>(total_.load(std::memory_order_relaxed)) / count;
+}
+
+int64_t Histogram::percentile(double fraction) const
+{
+   // take a copy of the counts (the histogram may be being recorded to)
+   std::vector<uint64_t> counts(kBucketCount);
+   uint64_t total = 0;
+   for (std::size_t i = 0; i < kBucketCount; ++i)
+   {
+      counts[i] = buckets_[i].load(std::memory_order_relaxed);
+      total += counts[i];
+   }
+
+   if (total == 0)
+      return 0;
+
+   fraction = std::min(std::max(fraction, 0.0), 1.0);
+   uint64_t target = std::max<uint64_t>(
+            static_cast<uint64_t>(std::ceil(fraction * total)), 1);
+
+   uint64_t seen = 0;
+   for (std::size_t i = 0; i < kBucketCount; ++i)
+   {
+      seen += counts[i];
+      if (seen >= target)
+         return std::min(bucketUpperBound(i), max());
+   }
+
+   return max();
+}
+
+json::Object Histogram::toJson() const
+{
+   json::Object histogramJson;
+   histogramJson["category"] = category_;
+   histogramJson["name"] = name_;
+   histogramJson["count"] = count();
+   histogramJson["mean_us"] = mean();
+   histogramJson["max_us"] = max();
+   histogramJson["p50_us"] = percentile(0.5);
+   histogramJson["p90_us"] = percentile(0.9);
+   histogramJson["p99_us"] = percentile(0.99);
+   histogramJson["p999_us"] = percentile(0.999);
+   return histogramJson;
+}
+
+std::size_t Histogram::bucketIndex(int64_t microseconds)
+{
+   if (microseconds < kLinearBuckets)
+      return static_cast<std::size_t>(std::max<int64_t>(microseconds, 0));
+
+   int exponent = highestBit(static_cast<uint64_t>(microseconds));
+   if (exponent > kMaxExponent)
+      return kBucketCount - 1;
+
+   // the top bits of the value (below the highest) pick the sub-bucket
+   int64_t subBucket = (microseconds >> (exponent - kSubBucketBits)) - kSubBuckets;
+   return static_cast<std::size_t>(
+            kLinearBuckets + (exponent - kLinearBits) * kSubBuckets + subBucket);
+}
+
+int64_t Histogram::bucketUpperBound(std::size_t index)
+{
+   if (static_cast<int64_t>(index) < kLinearBuckets)
+      return static_cast<int64_t>(index);
+
+   int64_t offset = static_cast<int64_t>(index) - kLinearBuckets;
+   int exponent = static_cast<int>(offset / kSubBuckets) + kLinearBits;
+   int64_t subBucket = kSubBuckets + offset % kSubBuckets;
+   return ((subBucket + 1) << (exponent - kSubBucketBits)) - 1;
+}
+
+Histogram& histogram(const std::string& category, const std::string& name)
+{
+   LOCK_MUTEX(s_histogramsMutex)
+   {
+      Histogram*& pHistogram = (*s_pHistograms)[std::make_pair(category, name)];
+      if (pHistogram == nullptr)
+         pHistogram = new Histogram(category, name);
+      return *pHistogram;
+   }
+   END_LOCK_MUTEX
+
+   // keep compiler happy (LOCK_MUTEX catches exceptions)
+   static Histogram s_errorHistogram("error", "error");
+   return s_errorHistogram;
+}
+
+json::Array histogramsAsJson()
+{
+   std::vector<Histogram*> histograms;
+   LOCK_MUTEX(s_histogramsMutex)
+   {
+      for (const HistogramMap::value_type& entry : *s_pHistograms)
+         histograms.push_back(entry.second);
+   }
+   END_LOCK_MUTEX
+
+   json::Array histogramsJson;
+   for (const Histogram* pHistogram : histograms)
+      histogramsJson.push_back(pHistogram->toJson());
+   return histogramsJson;
+}
+
+void setTracingEnabled(bool enabled)
+{
+   s_tracingEnabled = enabled;
+}
+
+bool isTracingEnabled()
+{
+   return s_tracingEnabled.load(std::memory_order_relaxed);
+}
+
+void recordEvent(const char* category,
+                 const char* name,
+                 Clock::time_point start,
+                 Clock::duration duration)
+{
+   threadEvents().record(category,
+                         name,
+                         toMicroseconds(start.time_since_epoch()),
+                         toMicroseconds(duration));
+}
+
+void writeChromeTrace(std::ostream& os)
+{
+   std::vector<Event> events;
+   LOCK_MUTEX(s_eventsMutex)
+   {
+      for (const boost::shared_ptr<ThreadEvents>& pEvents : *s_pThreadEvents)
+         pEvents->read(&events);
+   }
+   END_LOCK_MUTEX
+
+   std::sort(events.begin(), events.end(), [](const Event& a, const Event& b)
+   {
+      return a.start < b.start;
+   });
+
+   int64_t pid = static_cast<int64_t>(core::system::currentProcessId());
+   json::Array eventsJson;
+   for (const Event& event : events)
+   {
+      json::Object eventJson;
+      eventJson["name"] = event.name;
+      eventJson["cat"] = event.category;
+      eventJson["ph"] = "X";
+      eventJson["ts"] = event.start;
+      eventJson["dur"] = event.duration;
+      eventJson["pid"] = pid;
+      eventJson["tid"] = event.threadId;
+      eventsJson.push_back(eventJson);
+   }
+
+   json::Object traceJson;
+   traceJson["traceEvents"] = eventsJson;
+   traceJson["displayTimeUnit"] = "ms";
+   traceJson.write(os);
+}
+
+void clearEvents()
+{
+   LOCK_MUTEX(s_eventsMutex)
+   {
+      for (const boost::shared_ptr<ThreadEvents>& pEvents : *s_pThreadEvents)
+         pEvents->clear();
+   }
+   END_LOCK_MUTEX
+}
+
+void handleStatsRequest(const http::Request& request, http::Response* pResponse)
+{
+   json::Object statsJson;
+   statsJson["tracing"] = isTracingEnabled();
+   statsJson["histograms"] = histogramsAsJson();
+
+   pResponse->setNoCacheHeaders();
+   pResponse->setContentType("application/json");
+   pResponse->setBody(statsJson.write());
+}
+
+void handleEventsRequest(const http::Request&, http::Response* pResponse)
+{
+   std::ostringstream os;
+   writeChromeTrace(os);
+
+   pResponse->setNoCacheHeaders();
+   pResponse->setContentType("application/json");
+   pResponse->setBody(os.str());
+}
+
+void initializeFromEnvironment()
+{
+   if (core::system::getenv("RSTUDIO_TRACE") == "1")
+      setTracingEnabled(true);
+}
+
+Span::Span(Histogram& histogram)
+   : histogram_(histogram),
+     start_(Clock::now()),
+     duration_(Clock::duration::zero()),
+     ended_(false)
+{
+}
+
+Span::Span(const std::string& category, const std::string& name)
+   : histogram_(histogram(category, name)),
+     start_(Clock::now()),
+     duration_(Clock::duration::zero()),
+     ended_(false)
+{
+}
+
+Span::~Span()
+{
+   try
+   {
+      end();
+   }
+   catch(...)
+   {
+   }
+}
+
+Clock::duration Span::end()
+{
+   if (ended_)
+      return duration_;
+   ended_ = true;
+
+   duration_ = Clock::now() - start_;
+   histogram_.record(duration_);
+   if (isTracingEnabled())
+   {
+      recordEvent(histogram_.category().c_str(),
+                  histogram_.name().c_str(),
+                  start_,
+                  duration_);
+   }
+   return duration_;
+}
+
 } // namespace trace
 } // namespace core
 } // namespace rstudio
@@ -0,0 +1,189 @@
+/*
+ * TraceTests.cpp
+ *
+ * Copyright (C) 2020 by RStudio, PBC
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include <tests/TestThat.hpp>
+
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include <core/Trace.hpp>
+#include <core/http/Request.hpp>
+#include <core/http/Response.hpp>
+
+namespace rstudio {
+namespace core {
+namespace trace {
+
+namespace {
+
+std::size_t countEvents(const std::string& trace, const std::string& name)
+{
+   std::size_t count = 0;
+   std::string quoted = "\"" + name + "\"";
+   for (std::size_t pos = trace.find(quoted);
+        pos != std::string::npos;
+        pos = trace.find(quoted, pos + 1))
+   {
+      ++count;
+   }
+   return count;
+}
+
+} // anonymous namespace
+
+test_context("Trace")
+{
+   test_that("Histogram buckets bound their values closely")
+   {
+      for (int64_t value = 0; value < (int64_t(1) << 40); value += 1 + value / 7)
+      {
+         std::size_t index = Histogram::bucketIndex(value);
+         expect_true(index < Histogram::kBucketCount);
+
+         int64_t upperBound = Histogram::bucketUpperBound(index);
+         expect_true(upperBound >= value);
+         expect_true(upperBound - value <= value / 16);
+
+         if (index > 0)
+            expect_true(Histogram::bucketUpperBound(index - 1) < value);
+      }
+
+      // values too large for the histogram go in the last bucket
+      expect_true(Histogram::bucketIndex(int64_t(1) << 50) == Histogram::kBucketCount - 1);
+   }
+
+   test_that("Histogram percentiles are accurate")
+   {
+      Histogram histogram("test", "percentiles");
+      for (int64_t i = 1; i <= 10000; i++)
+         histogram.record(i);
+
+      expect_true(histogram.count() == 10000);
+      expect_true(histogram.max() == 10000);
+      expect_true(histogram.mean() == 5000.5);
+
+      int64_t p50 = histogram.percentile(0.5);
+      expect_true(p50 >= 5000);
+      expect_true(p50 <= 5000 + 5000 / 16);
+
+      int64_t p99 = histogram.percentile(0.99);
+      expect_true(p99 >= 9900);
+      expect_true(p99 <= 10000);
+
+      expect_true(histogram.percentile(1) == 10000);
+   }
+
+   test_that("Spans record their duration when they end")
+   {
+      Histogram& spans = histogram("test", "spans");
+      {
+         Span span(spans);
+         std::this_thread::sleep_for(std::chrono::milliseconds(2));
+         span.end();
+
+         // ending again (or being destroyed) doesn't record it twice
+         span.end();
+      }
+
+      expect_true(spans.count() == 1);
+      expect_true(spans.max() >= 2000);
+      expect_true(&histogram("test", "spans") == &spans);
+   }
+
+   test_that("Trace events are only recorded while tracing is enabled")
+   {
+      clearEvents();
+      {
+         Span span("test", "untraced");
+      }
+
+      setTracingEnabled(true);
+      std::vector<std::thread> threads;
+      for (int i = 0; i < 4; i++)
+      {
+         threads.emplace_back([]()
+         {
+            for (int j = 0; j < 10; j++)
+               Span span("test", "traced");
+         });
+      }
+      for (std::thread& thread : threads)
+         thread.join();
+      setTracingEnabled(false);
+
+      std::ostringstream trace;
+      writeChromeTrace(trace);
+      expect_true(trace.str().find("\"traceEvents\"") != std::string::npos);
+      expect_true(countEvents(trace.str(), "traced") == 40);
+      expect_true(countEvents(trace.str(), "untraced") == 0);
+
+      clearEvents();
+      std::ostringstream cleared;
+      writeChromeTrace(cleared);
+      expect_true(countEvents(cleared.str(), "traced") == 0);
+   }
+
+   test_that("Histograms are served as json")
+   {
+      histogram("test", "served").record(100);
+
+      http::Request request;
+      http::Response response;
+      handleStatsRequest(request, &response);
+
+      json::Value statsJson;
+      expect_false(statsJson.parse(response.body()));
+      expect_true(statsJson.isObject());
+      expect_true(response.body().find("\"served\"") != std::string::npos);
+   }
+
+   test_that("Events are served without changing whether tracing is enabled")
+   {
+      setTracingEnabled(false);
+
+      http::Request request;
+      request.setUri("/trace/events?tracing=1");
+      http::Response response;
+      handleEventsRequest(request, &response);
+
+      json::Value traceJson;
+      expect_false(traceJson.parse(response.body()));
+      expect_true(traceJson.isObject());
+      expect_false(isTracingEnabled());
+   }
+
+   test_that("Only the most recent events of each thread are kept")
+   {
+      clearEvents();
+      setTracingEnabled(true);
+      std::thread thread([]()
+      {
+         for (int i = 0; i < 5000; i++)
+            Span span("test", "many");
+      });
+      thread.join();
+      setTracingEnabled(false);
+
+      std::ostringstream trace;
+      writeChromeTrace(trace);
+      expect_true(countEvents(trace.str(), "many") == 4096);
+      clearEvents();
+   }
+}
+
+} // namespace trace
+} // namespace core
+} // namespace rstudio
@@ -0,0 +1,308 @@
+/*
+ * LruCacheTests.cpp
+ *
+ * Copyright (C) 2020 by RStudio, PBC
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include <iostream>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include <core/collection/LruCache.hpp>
+
+#include <tests/TestThat.hpp>
+
+namespace rstudio {
+namespace core {
+namespace collection {
+namespace tests {
+
+namespace {
+
+std::size_t stringCost(const std::string&, const std::string& value)
+{
+   return value.size();
+}
+
+// The previous implementation (a single mutex around a map of shared_ptr
+// nodes), kept to benchmark against
+template <typename KeyType, typename ValueType>
+class ReferenceLruCache
+{
+public:
+   explicit ReferenceLruCache(unsigned int maxSize) : maxSize_(maxSize) {}
+
+   void insert(const KeyType& key, const ValueType& value)
+   {
+      LOCK_MUTEX(mutex_)
+      {
+         if (map_.count(key) > 0)
+         {
+            auto pNode = map_[key];
+            pNode->value = value;
+            removeNode(pNode);
+            addNode(pNode);
+         }
+         else
+         {
+            if (map_.size() >= maxSize_)
+            {
+               auto pNode = backNode_;
+               removeNode(pNode);
+               map_.erase(pNode->key);
+            }
+
+            auto pNode = boost::shared_ptr<Node>(new Node(key, value));
+            addNode(pNode);
+            map_[key] = pNode;
+         }
+      }
+      END_LOCK_MUTEX
+   }
+
+   bool get(const KeyType& key, ValueType* pValue)
+   {
+      LOCK_MUTEX(mutex_)
+      {
+         auto iter = map_.find(key);
+         if (iter == map_.end())
+            return false;
+
+         auto pNode = iter->second;
+         removeNode(pNode);
+         addNode(pNode);
+
+         *pValue = pNode->value;
+         return true;
+      }
+      END_LOCK_MUTEX
+
+      return false;
+   }
+
+private:
+   struct Node
+   {
+      Node(const KeyType& key, const ValueType& value) : key(key), value(value) {}
+
+      boost::shared_ptr<Node> pLeft;
+      boost::shared_ptr<Node> pRight;
+      KeyType key;
+      ValueType value;
+   };
+
+   void removeNode(const boost::shared_ptr<Node>& pNode)
+   {
+      if (pNode->pLeft)
+         pNode->pLeft->pRight = pNode->pRight;
+      else
+         frontNode_ = pNode->pRight;
+
+      if (pNode->pRight)
+         pNode->pRight->pLeft = pNode->pLeft;
+      else
+         backNode_ = pNode->pLeft;
+   }
+
+   void addNode(const boost::shared_ptr<Node>& pNode)
+   {
+      pNode->pRight = frontNode_;
+      pNode->pLeft.reset();
+
+      if (frontNode_)
+         frontNode_->pLeft = pNode;
+      frontNode_ = pNode;
+
+      if (!backNode_)
+         backNode_ = frontNode_;
+   }
+
+   unsigned int maxSize_;
+   std::map<KeyType, boost::shared_ptr<Node> > map_;
+   boost::shared_ptr<Node> frontNode_;
+   boost::shared_ptr<Node> backNode_;
+   boost::mutex mutex_;
+};
+
+// a mix of 90% reads and 10% writes from several threads over a key space
+// twice the size of the cache; returns the elapsed milliseconds
+template <typename CacheType>
+long exercise(CacheType& cache, int threads, int operations)
+{
+   boost::posix_time::ptime start = boost::posix_time::microsec_clock::universal_time();
+
+   std::vector<std::thread> workers;
+   for (int t = 0; t < threads; ++t)
+   {
+      workers.emplace_back([&cache, t, operations]()
+      {
+         uint32_t state = 2463534242u + t;
+         for (int i = 0; i < operations; ++i)
+         {
+            state ^= state << 13;
+            state ^= state >> 17;
+            state ^= state << 5;
+
+            int key = static_cast<int>(state % 20000);
+            int value;
+            if (state % 10 == 0 || !cache.get(key, &value))
+               cache.insert(key, key);
+         }
+      });
+   }
+   for (std::thread& worker : workers)
+      worker.join();
+
+   return static_cast<long>(
+            (boost::posix_time::microsec_clock::universal_time() - start).total_milliseconds());
+}
+
+} // anonymous namespace
+
+test_context("LruCacheTests")
+{
+   test_that("Sharded caches stay within their size")
+   {
+      LruCacheOptions options(1000);
+      options.shards = 8;
+      LruCache<int, int> cache(options);
+      for (int i = 0; i < 10000; ++i)
+         cache.insert(i, i);
+
+      expect_true(cache.size() <= 1000u);
+      expect_true(cache.size() > 900u);
+
+      int val;
+      expect_true(cache.get(9999, &val));
+      expect_true(val == 9999);
+      expect_false(cache.get(0, &val));
+   }
+
+   test_that("The byte budget evicts the least recently used entries")
+   {
+      LruCacheOptions options(100);
+      options.maxBytes = 10;
+      LruCache<std::string, std::string> cache(options, stringCost);
+
+      cache.insert("a", "1234");
+      cache.insert("b", "1234");
+
+      std::string val;
+      expect_true(cache.get("a", &val));
+
+      // "b" is least recently used so makes room for "c"
+      cache.insert("c", "1234");
+      expect_false(cache.get("b", &val));
+      expect_true(cache.get("a", &val));
+      expect_true(cache.get("c", &val));
+      expect_true(cache.stats().bytes == 8u);
+
+      // an entry over the budget by itself isn't kept
+      cache.insert("d", "12345678901");
+      expect_false(cache.get("d", &val));
+      expect_true(cache.stats().bytes <= 10u);
+   }
+
+   test_that("Entries expire after their time to live")
+   {
+      LruCacheOptions options(100);
+      options.ttl = boost::posix_time::milliseconds(20);
+      LruCache<int, int> cache(options);
+
+      cache.insert(1, 1);
+      int val;
+      expect_true(cache.get(1, &val));
+
+      std::this_thread::sleep_for(std::chrono::milliseconds(40));
+      expect_false(cache.get(1, &val));
+      expect_true(cache.size() == 0u);
+      expect_true(cache.stats().expirations == 1u);
+
+      // reinserting refreshes the entry
+      cache.insert(1, 2);
+      expect_true(cache.get(1, &val));
+      expect_true(val == 2);
+   }
+
+   test_that("Hits, misses and evictions are counted")
+   {
+      LruCache<int, int> cache(2);
+      int val;
+      cache.insert(1, 1);
+      cache.insert(2, 2);
+      cache.get(1, &val);
+      cache.get(3, &val);
+      cache.insert(3, 3);
+
+      LruCacheStats stats = cache.stats();
+      expect_true(stats.hits == 1u);
+      expect_true(stats.misses == 1u);
+      expect_true(stats.evictions == 1u);
+      expect_true(stats.entries == 2u);
+
+      cache.clear();
+      expect_true(cache.size() == 0u);
+      cache.insert(4, 4);
+      expect_true(cache.get(4, &val));
+   }
+
+   test_that("Concurrent use keeps the cache consistent")
+   {
+      LruCacheOptions options(5000);
+      options.shards = 4;
+      LruCache<int, int> cache(options);
+      exercise(cache, 4, 50000);
+
+      expect_true(cache.size() <= 5000u);
+      for (int key = 0; key < 20000; ++key)
+      {
+         int val;
+         if (cache.get(key, &val))
+            expect_true(val == key);
+      }
+   }
+}
+
+// run explicitly with: rstudio-core-tests "[benchmark]"
+TEST_CASE("LruCache benchmark", "[.][benchmark]")
+{
+   const int operations = 500000;
+
+   for (int threads : { 1, 8 })
+   {
+      ReferenceLruCache<int, int> reference(10000);
+      long referenceTime = exercise(reference, threads, operations);
+
+      LruCache<int, int> unsharded(10000);
+      long unshardedTime = exercise(unsharded, threads, operations);
+
+      LruCacheOptions options(10000);
+      options.shards = 16;
+      LruCache<int, int> sharded(options);
+      long shardedTime = exercise(sharded, threads, operations);
+
+      std::cout << threads << " thread(s) x " << operations << " operations: "
+                << "previous " << referenceTime << "ms, "
+                << "unsharded " << unshardedTime << "ms, "
+                << "16 shards " << shardedTime << "ms" << std::endl;
+   }
+}
+
+} // namespace tests
+} // namespace collection
+} // namespace core
+} // namespace rstudio
@@ -0,0 +1,345 @@
+/*
+ * TrigramIndex.cpp
+ *
+ * Copyright (C) 2020 by RStudio, PBC
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include <core/collection/TrigramIndex.hpp>
+
+#include <algorithm>
+
+namespace rstudio {
+namespace core {
+namespace collection {
+
+namespace {
+
+// postings are rebuilt only once the index is reasonably large; small
+// indexes are cheap to scan regardless
+const std::size_t kMinDeadPostingsForCompaction = 4096;
+
+inline unsigned char fold(char ch)
+{
+   unsigned char uch = static_cast<unsigned char>(ch);
+   return (uch >= 'A' && uch <= 'Z') ? static_cast<unsigned char>(uch + ('a' - 'A')) : uch;
+}
+
+std::string foldCase(const std::string& str)
+{
+   std::string folded(str.size(), '\0');
+   for (std::size_t i = 0; i < str.size(); ++i)
+      folded[i] = static_cast<char>(fold(str[i]));
+   return folded;
+}
+
+inline uint32_t trigramKey(const std::string& folded, std::size_t pos)
+{
+   return (static_cast<uint32_t>(static_cast<unsigned char>(folded[pos])) << 16) |
+          (static_cast<uint32_t>(static_cast<unsigned char>(folded[pos + 1])) << 8) |
+          (static_cast<uint32_t>(static_cast<unsigned char>(folded[pos + 2])));
+}
+
+// prefixes of length 1-3 share a map; the length is encoded in the top byte
+inline uint32_t prefixKey(const std::string& folded, std::size_t length)
+{
+   uint32_t key = static_cast<uint32_t>(length) << 24;
+   for (std::size_t i = 0; i < length; ++i)
+      key |= static_cast<uint32_t>(static_cast<unsigned char>(folded[i])) << (8 * (2 - i));
+   return key;
+}
+
+bool isSubsequence(const std::string& folded, const std::string& term)
+{
+   std::size_t termIdx = 0;
+   for (std::size_t i = 0; i < folded.size() && termIdx < term.size(); ++i)
+   {
+      if (folded[i] == term[termIdx])
+         ++termIdx;
+   }
+   return termIdx == term.size();
+}
+
+template <typename T>
+void sortUnique(std::vector<T>* pValues)
+{
+   std::sort(pValues->begin(), pValues->end());
+   pValues->erase(std::unique(pValues->begin(), pValues->end()), pValues->end());
+}
+
+} // anonymous namespace
+
+TrigramIndex::TrigramIndex()
+   : size_(0), livePostings_(0), deadPostings_(0)
+{
+}
+
+TrigramIndex::Id TrigramIndex::insert(const std::string& name)
+{
+   Id id;
+   if (!freeIds_.empty())
+   {
+      id = freeIds_.back();
+      freeIds_.pop_back();
+      names_[id] = name;
+      folded_[id] = foldCase(name);
+      live_[id] = true;
+   }
+   else
+   {
+      id = static_cast<Id>(names_.size());
+      names_.push_back(name);
+      folded_.push_back(foldCase(name));
+      live_.push_back(true);
+      postingCounts_.push_back(0);
+   }
+
+   post(id);
+   ++size_;
+   return id;
+}
+
+void TrigramIndex::post(Id id)
+{
+   const std::string& folded = folded_[id];
+
+   std::vector<unsigned char> chars(folded.begin(), folded.end());
+   sortUnique(&chars);
+   for (unsigned char ch : chars)
+      chars_[ch].push_back(id);
+
+   std::vector<uint32_t> trigrams;
+   for (std::size_t i = 0; i + 2 < folded.size(); ++i)
+      trigrams.push_back(trigramKey(folded, i));
+   sortUnique(&trigrams);
+   for (uint32_t key : trigrams)
+      trigrams_[key].push_back(id);
+
+   std::size_t prefixes = std::min<std::size_t>(3, folded.size());
+   for (std::size_t length = 1; length <= prefixes; ++length)
+      prefixes_[prefixKey(folded, length)].push_back(id);
+
+   exact_[names_[id]].push_back(id);
+
+   postingCounts_[id] = static_cast<uint32_t>(chars.size() + trigrams.size() + prefixes + 1);
+   livePostings_ += postingCounts_[id];
+}
+
+void TrigramIndex::remove(Id id)
+{
+   if (!contains(id))
+      return;
+
+   // the id stays in the postings until the next compaction
+   live_[id] = false;
+   --size_;
+   livePostings_ -= postingCounts_[id];
+   deadPostings_ += postingCounts_[id];
+
+   if (deadPostings_ > livePostings_ && deadPostings_ >= kMinDeadPostingsForCompaction)
+      compact();
+}
+
+void TrigramIndex::compact()
+{
+   for (Postings& postings : chars_)
+      postings.clear();
+   trigrams_.clear();
+   prefixes_.clear();
+   exact_.clear();
+   freeIds_.clear();
+   livePostings_ = 0;
+   deadPostings_ = 0;
+
+   for (Id id = 0; id < names_.size(); ++id)
+   {
+      if (live_[id])
+      {
+         post(id);
+      }
+      else
+      {
+         names_[id].clear();
+         folded_[id].clear();
+         freeIds_.push_back(id);
+      }
+   }
+
+   // hand out low ids first
+   std::reverse(freeIds_.begin(), freeIds_.end());
+}
+
+void TrigramIndex::clear()
+{
+   names_.clear();
+   folded_.clear();
+   live_.clear();
+   postingCounts_.clear();
+   freeIds_.clear();
+   size_ = 0;
+   livePostings_ = 0;
+   deadPostings_ = 0;
+
+   for (Postings& postings : chars_)
+      postings.clear();
+   trigrams_.clear();
+   prefixes_.clear();
+   exact_.clear();
+}
+
+bool TrigramIndex::contains(Id id) const
+{
+   return id < live_.size() && live_[id];
+}
+
+const std::string& TrigramIndex::name(Id id) const
+{
+   return names_[id];
+}
+
+const TrigramIndex::Postings* TrigramIndex::lookup(const PostingsMap& map,
+                                                   uint32_t key) const
+{
+   PostingsMap::const_iterator it = map.find(key);
+   return it != map.end() ? &it->second : nullptr;
+}
+
+const TrigramIndex::Postings* TrigramIndex::rarestCharPostings(
+      const std::string& folded) const
+{
+   const Postings* pBest = nullptr;
+   for (char ch : folded)
+   {
+      const Postings& postings = chars_[static_cast<unsigned char>(ch)];
+      if (postings.empty())
+         return nullptr;
+
+      if (pBest == nullptr || postings.size() < pBest->size())
+         pBest = &postings;
+   }
+   return pBest;
+}
+
+template <typename Predicate>
+void TrigramIndex::collect(const Postings& postings,
+                           Predicate predicate,
+                           std::vector<Id>* pIds) const
+{
+   // postings are in insertion order, which differs from id order once
+   // removed ids have been reused
+   std::size_t begin = pIds->size();
+   for (Id id : postings)
+   {
+      if (live_[id] && predicate(id))
+         pIds->push_back(id);
+   }
+
+   std::sort(pIds->begin() + begin, pIds->end());
+}
+
+void TrigramIndex::findExact(const std::string& name, std::vector<Id>* pIds) const
+{
+   boost::unordered_map<std::string, Postings>::const_iterator it = exact_.find(name);
+   if (it == exact_.end())
+      return;
+
+   collect(it->second,
+           [&](Id id) { return names_[id] == name; },
+           pIds);
+}
+
+void TrigramIndex::findPrefix(const std::string& term, std::vector<Id>* pIds) const
+{
+   if (term.empty())
+   {
+      findAll(pIds);
+      return;
+   }
+
+   std::string folded = foldCase(term);
+   const Postings* pPostings = lookup(prefixes_,
+                                      prefixKey(folded, std::min<std::size_t>(3, folded.size())));
+   if (pPostings == nullptr)
+      return;
+
+   collect(*pPostings,
+           [&](Id id) { return folded_[id].compare(0, folded.size(), folded) == 0; },
+           pIds);
+}
+
+void TrigramIndex::findSubstring(const std::string& term, std::vector<Id>* pIds) const
+{
+   if (term.empty())
+   {
+      findAll(pIds);
+      return;
+   }
+
+   // use the rarest trigram of the term (or the rarest character for
+   // terms too short to have trigrams)
+   std::string folded = foldCase(term);
+   const Postings* pBest = nullptr;
+   if (folded.size() < 3)
+   {
+      pBest = rarestCharPostings(folded);
+   }
+   else
+   {
+      for (std::size_t i = 0; i + 2 < folded.size(); ++i)
+      {
+         const Postings* pPostings = lookup(trigrams_, trigramKey(folded, i));
+         if (pPostings == nullptr)
+            return;
+
+         if (pBest == nullptr || pPostings->size() < pBest->size())
+            pBest = pPostings;
+      }
+   }
+
+   if (pBest == nullptr)
+      return;
+
+   collect(*pBest,
+           [&](Id id) { return folded_[id].find(folded) != std::string::npos; },
+           pIds);
+}
+
+void TrigramIndex::findSubsequence(const std::string& term, std::vector<Id>* pIds) const
+{
+   if (term.empty())
+   {
+      findAll(pIds);
+      return;
+   }
+
+   // use the rarest character of the term
+   std::string folded = foldCase(term);
+   const Postings* pBest = rarestCharPostings(folded);
+   if (pBest == nullptr)
+      return;
+
+   collect(*pBest,
+           [&](Id id) { return isSubsequence(folded_[id], folded); },
+           pIds);
+}
+
+void TrigramIndex::findAll(std::vector<Id>* pIds) const
+{
+   for (Id id = 0; id < live_.size(); ++id)
+   {
+      if (live_[id])
+         pIds->push_back(id);
+   }
+}
+
+} // namespace collection
+} // namespace core
+} // namespace rstudio
@@ -0,0 +1,219 @@
+/*
+ * TrigramIndexTests.cpp
+ *
+ * Copyright (C) 2020 by RStudio, PBC
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include <iostream>
+
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include <core/StringUtils.hpp>
+#include <core/collection/TrigramIndex.hpp>
+
+#include <tests/TestThat.hpp>
+
+namespace rstudio {
+namespace core {
+namespace collection {
+namespace tests {
+
+namespace {
+
+typedef TrigramIndex::Id Id;
+
+std::vector<std::string> names(const TrigramIndex& index,
+                               const std::vector<Id>& ids)
+{
+   std::vector<std::string> result;
+   for (Id id : ids)
+      result.push_back(index.name(id));
+   return result;
+}
+
+// names resembling the files of a large project tree
+std::vector<std::string> syntheticFileNames(std::size_t n)
+{
+   const char* stems[] = { "model", "utils", "plot", "data", "server", "ui",
+                           "helpers", "test", "reader", "writer", "parse",
+                           "config", "schema", "report", "summary", "fit" };
+   const char* exts[] = { ".R", ".Rmd", ".cpp", ".h", ".md", ".csv", ".json" };
+
+   std::vector<std::string> result;
+   result.reserve(n);
+   for (std::size_t i = 0; i < n; ++i)
+   {
+      std::string name = stems[i % 16];
+      name += "_";
+      name += stems[(i / 16) % 16];
+      name += std::to_string(i);
+      name += exts[(i / 7) % 7];
+      result.push_back(name);
+   }
+   return result;
+}
+
+} // anonymous namespace
+
+test_context("TrigramIndexTests")
+{
+   test_that("Subsequence matches are case insensitive")
+   {
+      TrigramIndex index;
+      index.insert("SessionCodeSearch.cpp");
+      index.insert("RSourceIndex.hpp");
+      index.insert("Makefile");
+
+      std::vector<Id> ids;
+      index.findSubsequence("scs", &ids);
+      expect_true(names(index, ids) == std::vector<std::string>({ "SessionCodeSearch.cpp" }));
+
+      ids.clear();
+      index.findSubsequence("EX", &ids);
+      expect_true(names(index, ids) == std::vector<std::string>({ "RSourceIndex.hpp" }));
+
+      ids.clear();
+      index.findSubsequence("xyz", &ids);
+      expect_true(ids.empty());
+   }
+
+   test_that("Prefix and substring matches are found")
+   {
+      TrigramIndex index;
+      index.insert("read_csv");
+      index.insert("readLines");
+      index.insert("spread");
+      index.insert("re");
+
+      std::vector<Id> ids;
+      index.findPrefix("READ", &ids);
+      expect_true(names(index, ids) == std::vector<std::string>({ "read_csv", "readLines" }));
+
+      ids.clear();
+      index.findPrefix("r", &ids);
+      expect_equal(ids.size(), 3u);
+
+      ids.clear();
+      index.findSubstring("read", &ids);
+      expect_true(names(index, ids) == std::vector<std::string>({ "read_csv", "readLines", "spread" }));
+
+      ids.clear();
+      index.findSubstring("ea", &ids);
+      expect_equal(ids.size(), 3u);
+   }
+
+   test_that("Exact matches are case sensitive")
+   {
+      TrigramIndex index;
+      Id lower = index.insert("foo");
+      index.insert("Foo");
+      Id again = index.insert("foo");
+
+      std::vector<Id> ids;
+      index.findExact("foo", &ids);
+      expect_true(ids == std::vector<Id>({ lower, again }));
+   }
+
+   test_that("Removed names are no longer found and ids are reused")
+   {
+      TrigramIndex index;
+      std::vector<std::string> all = syntheticFileNames(5000);
+      std::vector<Id> ids;
+      for (const std::string& name : all)
+         ids.push_back(index.insert(name));
+
+      // remove enough names to trigger compaction
+      for (std::size_t i = 0; i < 4000; ++i)
+         index.remove(ids[i]);
+      expect_equal(index.size(), 1000u);
+
+      std::vector<Id> found;
+      index.findSubstring(all[10], &found);
+      expect_true(found.empty());
+
+      found.clear();
+      index.findSubstring(all[4500], &found);
+      expect_true(names(index, found) == std::vector<std::string>({ all[4500] }));
+
+      Id reused = index.insert("brand_new.R");
+      expect_true(reused < 4000);
+
+      found.clear();
+      index.findPrefix("brand", &found);
+      expect_true(found == std::vector<Id>({ reused }));
+   }
+
+   test_that("Index results agree with a linear scan")
+   {
+      TrigramIndex index;
+      std::vector<std::string> all = syntheticFileNames(2000);
+      for (const std::string& name : all)
+         index.insert(name);
+
+      for (const char* term : { "mdl", "plot_", "UI", "9.r", "fit1" })
+      {
+         std::vector<Id> ids;
+         index.findSubsequence(term, &ids);
+
+         std::vector<std::string> expected;
+         for (const std::string& name : all)
+            if (string_utils::isSubsequence(name, term, true))
+               expected.push_back(name);
+
+         expect_true(names(index, ids) == expected);
+      }
+   }
+}
+
+// run explicitly with: rstudio-core-tests "[benchmark]"
+TEST_CASE("TrigramIndex benchmark over a 100k file tree", "[.][benchmark]")
+{
+   using namespace boost::posix_time;
+
+   std::vector<std::string> all = syntheticFileNames(100000);
+
+   ptime start = microsec_clock::universal_time();
+   TrigramIndex index;
+   for (const std::string& name : all)
+      index.insert(name);
+   time_duration buildTime = microsec_clock::universal_time() - start;
+
+   const char* terms[] = { "m", "mo", "mod", "mode", "model", "model_fit",
+                           "model_fit123", "srvr", "schema_ui9", "rprt.json" };
+
+   for (const char* term : terms)
+   {
+      start = microsec_clock::universal_time();
+      std::size_t scanned = 0;
+      for (const std::string& name : all)
+         if (string_utils::isSubsequence(name, term, true))
+            ++scanned;
+      time_duration scanTime = microsec_clock::universal_time() - start;
+
+      start = microsec_clock::universal_time();
+      std::vector<Id> ids;
+      index.findSubsequence(term, &ids);
+      time_duration indexTime = microsec_clock::universal_time() - start;
+
+      CHECK(ids.size() == scanned);
+      std::cout << "'" << term << "': " << ids.size() << " matches, "
+                << "linear scan " << scanTime.total_microseconds() << "us, "
+                << "index " << indexTime.total_microseconds() << "us" << std::endl;
+   }
+
+   std::cout << "index build: " << buildTime.total_milliseconds() << "ms" << std::endl;
+}
+
+} // namespace tests
+} // namespace collection
+} // namespace core
+} // namespace rstudio
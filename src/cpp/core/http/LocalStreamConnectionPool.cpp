@@ -0,0 +1,222 @@
+/*
+ * LocalStreamConnectionPool.cpp
+ *
+ * Copyright (C) 2020 by RStudio, PBC
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include <core/http/LocalStreamConnectionPool.hpp>
+
+#include <errno.h>
+#include <sys/socket.h>
+
+#include <core/Thread.hpp>
+#include <core/http/SocketUtils.hpp>
+
+namespace rstudio {
+namespace core {
+namespace http {
+
+namespace {
+
+boost::posix_time::ptime now()
+{
+   return boost::posix_time::microsec_clock::universal_time();
+}
+
+// an idle connection is usable only if the server has neither closed it
+// nor written anything to it since the last response
+bool isHealthy(LocalStreamConnectionPool::Socket& socket)
+{
+   if (!socket.is_open())
+      return false;
+
+   char ch;
+   ssize_t result = ::recv(socket.native_handle(), &ch, 1, MSG_PEEK | MSG_DONTWAIT);
+   if (result == 0)
+      return false; // eof
+   else if (result > 0)
+      return false; // unexpected data
+   else if (errno == EAGAIN)
+      return true; // nothing to read
+#if EWOULDBLOCK != EAGAIN
+   else if (errno == EWOULDBLOCK)
+      return true;
+#endif
+   else
+      return false;
+}
+
+} // anonymous namespace
+
+LocalStreamConnectionPool::LocalStreamConnectionPool(
+      std::size_t maxIdlePerStream,
+      const boost::posix_time::time_duration& idleTimeout)
+   : maxIdlePerStream_(maxIdlePerStream),
+     idleTimeout_(idleTimeout)
+{
+}
+
+boost::shared_ptr<LocalStreamConnectionPool::Socket> LocalStreamConnectionPool::checkout(
+      const FilePath& streamPath,
+      boost::asio::io_service& ioService)
+{
+   LOCK_MUTEX(mutex_)
+   {
+      auto it = idle_.find(streamPath.getAbsolutePath());
+      if (it != idle_.end())
+      {
+         // take the most recently used connection first; older ones are
+         // more likely to be evicted anyway
+         IdleConnections& connections = it->second;
+         while (!connections.empty())
+         {
+            IdleConnection connection = connections.back();
+            connections.pop_back();
+            --stats_.idle;
+
+            if (connection.pIoService != &ioService ||
+                !isHealthy(*connection.pSocket))
+            {
+               closeConnection(connection);
+               ++stats_.stale;
+               continue;
+            }
+
+            if (connections.empty())
+               idle_.erase(it);
+
+            ++stats_.hits;
+            return connection.pSocket;
+         }
+
+         idle_.erase(it);
+      }
+
+      ++stats_.misses;
+   }
+   END_LOCK_MUTEX
+
+   return boost::shared_ptr<Socket>();
+}
+
+void LocalStreamConnectionPool::checkin(const FilePath& streamPath,
+                                        boost::asio::io_service& ioService,
+                                        const boost::shared_ptr<Socket>& pSocket)
+{
+   LOCK_MUTEX(mutex_)
+   {
+      IdleConnections& connections = idle_[streamPath.getAbsolutePath()];
+      connections.push_back(IdleConnection(&ioService, pSocket));
+      ++stats_.idle;
+
+      // keep only the most recently used connections
+      while (connections.size() > maxIdlePerStream_)
+      {
+         closeConnection(connections.front());
+         connections.pop_front();
+         --stats_.idle;
+         ++stats_.evictions;
+      }
+   }
+   END_LOCK_MUTEX
+}
+
+void LocalStreamConnectionPool::recordStale()
+{
+   LOCK_MUTEX(mutex_)
+   {
+      ++stats_.stale;
+   }
+   END_LOCK_MUTEX
+}
+
+void LocalStreamConnectionPool::recordConnect(
+      const boost::posix_time::time_duration& elapsed)
+{
+   uint64_t micros = static_cast<uint64_t>(std::max<int64_t>(0, elapsed.total_microseconds()));
+
+   LOCK_MUTEX(mutex_)
+   {
+      ++stats_.connects;
+      stats_.totalConnectMicros += micros;
+      stats_.maxConnectMicros = std::max(stats_.maxConnectMicros, micros);
+   }
+   END_LOCK_MUTEX
+}
+
+void LocalStreamConnectionPool::evictIdle()
+{
+   boost::posix_time::ptime cutoff = now() - idleTimeout_;
+
+   LOCK_MUTEX(mutex_)
+   {
+      for (auto it = idle_.begin(); it != idle_.end(); )
+      {
+         // connections are ordered from least to most recently used
+         IdleConnections& connections = it->second;
+         while (!connections.empty() && connections.front().idleSince < cutoff)
+         {
+            closeConnection(connections.front());
+            connections.pop_front();
+            --stats_.idle;
+            ++stats_.evictions;
+         }
+
+         if (connections.empty())
+            it = idle_.erase(it);
+         else
+            ++it;
+      }
+   }
+   END_LOCK_MUTEX
+}
+
+void LocalStreamConnectionPool::evictStream(const FilePath& streamPath)
+{
+   LOCK_MUTEX(mutex_)
+   {
+      auto it = idle_.find(streamPath.getAbsolutePath());
+      if (it == idle_.end())
+         return;
+
+      for (const IdleConnection& connection : it->second)
+      {
+         closeConnection(connection);
+         --stats_.idle;
+         ++stats_.evictions;
+      }
+
+      idle_.erase(it);
+   }
+   END_LOCK_MUTEX
+}
+
+LocalStreamConnectionPool::Stats LocalStreamConnectionPool::stats()
+{
+   LOCK_MUTEX(mutex_)
+   {
+      return stats_;
+   }
+   END_LOCK_MUTEX
+
+   return Stats();
+}
+
+void LocalStreamConnectionPool::closeConnection(const IdleConnection& connection)
+{
+   // errors are expected here (the server may already have closed its end)
+   closeSocket(*connection.pSocket);
+}
+
+} // namespace http
+} // namespace core
+} // namespace rstudio
@@ -0,0 +1,153 @@
+/*
+ * LocalStreamConnectionPoolTests.cpp
+ *
+ * Copyright (C) 2020 by RStudio, PBC
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef _WIN32
+
+#include <boost/asio/local/connect_pair.hpp>
+
+#include <core/http/LocalStreamConnectionPool.hpp>
+
+#include <tests/TestThat.hpp>
+
+namespace rstudio {
+namespace core {
+namespace http {
+namespace tests {
+
+typedef LocalStreamConnectionPool::Socket Socket;
+
+namespace {
+
+void connectPair(boost::asio::io_service& ioService,
+                 boost::shared_ptr<Socket>* pClient,
+                 boost::shared_ptr<Socket>* pServer)
+{
+   pClient->reset(new Socket(ioService));
+   pServer->reset(new Socket(ioService));
+   boost::asio::local::connect_pair(**pClient, **pServer);
+}
+
+} // anonymous namespace
+
+test_context("LocalStreamConnectionPoolTests")
+{
+   boost::asio::io_service ioService;
+   FilePath streamPath("/tmp/rstudio-test-stream");
+
+   test_that("Checkout from an empty pool misses")
+   {
+      LocalStreamConnectionPool pool;
+      CHECK_FALSE(pool.checkout(streamPath, ioService));
+      CHECK(pool.stats().misses == 1);
+      CHECK(pool.stats().hits == 0);
+   }
+
+   test_that("Healthy connections are reused")
+   {
+      LocalStreamConnectionPool pool;
+      boost::shared_ptr<Socket> pClient, pServer;
+      connectPair(ioService, &pClient, &pServer);
+
+      pool.checkin(streamPath, ioService, pClient);
+      CHECK(pool.stats().idle == 1);
+
+      CHECK(pool.checkout(streamPath, ioService) == pClient);
+      CHECK(pool.stats().hits == 1);
+      CHECK(pool.stats().idle == 0);
+
+      // only one idle connection was available
+      CHECK_FALSE(pool.checkout(streamPath, ioService));
+   }
+
+   test_that("Connections closed by the server are discarded")
+   {
+      LocalStreamConnectionPool pool;
+      boost::shared_ptr<Socket> pClient, pServer;
+      connectPair(ioService, &pClient, &pServer);
+
+      pool.checkin(streamPath, ioService, pClient);
+      pServer->close();
+
+      CHECK_FALSE(pool.checkout(streamPath, ioService));
+      CHECK(pool.stats().stale == 1);
+      CHECK_FALSE(pClient->is_open());
+   }
+
+   test_that("Connections are not shared between streams")
+   {
+      LocalStreamConnectionPool pool;
+      boost::shared_ptr<Socket> pClient, pServer;
+      connectPair(ioService, &pClient, &pServer);
+
+      pool.checkin(streamPath, ioService, pClient);
+      CHECK_FALSE(pool.checkout(FilePath("/tmp/rstudio-other-stream"), ioService));
+      CHECK(pool.checkout(streamPath, ioService) == pClient);
+   }
+
+   test_that("Idle connections beyond the per-stream limit are evicted")
+   {
+      LocalStreamConnectionPool pool(2);
+      std::vector<boost::shared_ptr<Socket> > servers;
+      for (int i = 0; i < 3; ++i)
+      {
+         boost::shared_ptr<Socket> pClient, pServer;
+         connectPair(ioService, &pClient, &pServer);
+         servers.push_back(pServer);
+         pool.checkin(streamPath, ioService, pClient);
+      }
+
+      CHECK(pool.stats().idle == 2);
+      CHECK(pool.stats().evictions == 1);
+   }
+
+   test_that("Expired idle connections are evicted")
+   {
+      LocalStreamConnectionPool pool(4, boost::posix_time::seconds(0));
+      boost::shared_ptr<Socket> pClient, pServer;
+      connectPair(ioService, &pClient, &pServer);
+
+      pool.checkin(streamPath, ioService, pClient);
+      ::usleep(1000);
+      pool.evictIdle();
+
+      CHECK(pool.stats().idle == 0);
+      CHECK_FALSE(pClient->is_open());
+   }
+
+   test_that("Evicting a stream closes only its idle connections")
+   {
+      LocalStreamConnectionPool pool;
+      boost::shared_ptr<Socket> pClient, pServer, pOtherClient, pOtherServer;
+      connectPair(ioService, &pClient, &pServer);
+      connectPair(ioService, &pOtherClient, &pOtherServer);
+
+      FilePath otherStreamPath("/tmp/rstudio-other-stream");
+      pool.checkin(streamPath, ioService, pClient);
+      pool.checkin(otherStreamPath, ioService, pOtherClient);
+      pool.evictStream(streamPath);
+
+      CHECK(pool.stats().idle == 1);
+      CHECK(pool.stats().evictions == 1);
+      CHECK_FALSE(pClient->is_open());
+      CHECK(pool.checkout(otherStreamPath, ioService) == pOtherClient);
+   }
+}
+
+} // namespace tests
+} // namespace http
+} // namespace core
+} // namespace rstudio
+
+#endif // _WIN32
@@ -845,6 +845,20 @@ void Response::setStreamFile(const FilePath& filePath,
       setError(status::InternalServerError, error.getMessage());
 }
 
+void Response::setStreamResponse(const boost::shared_ptr<StreamResponse>& streamResponse)
+{
+   setHeader(kTransferEncoding, kChunkedTransferEncoding);
+
+   streamResponse_ = streamResponse;
+   Error error = streamResponse_->initialize();
+   if (error)
+   {
+      streamResponse_.reset();
+      removeHeader(kTransferEncoding);
+      setError(status::InternalServerError, error.getMessage());
+   }
+}
+
 } // namespacc http
 } // namespace core
 } // namespace rstudio
@@ -105,6 +105,11 @@ bool UriHandler::matches(const std::string& uri) const
    return boost::algorithm::starts_with(uri, prefix_);
 }
 
+const std::string& UriHandler::prefix() const
+{
+   return prefix_;
+}
+
 UriAsyncHandlerFunctionVariant UriHandler::function() const
 {
    return function_;
@@ -133,6 +138,12 @@ void UriHandlers::add(const UriHandler& handler)
 }
 
 boost::optional<UriAsyncHandlerFunctionVariant> UriHandlers::handlerFor(const std::string& uri) const
+{
+   return handlerFor(uri, nullptr);
+}
+
+boost::optional<UriAsyncHandlerFunctionVariant> UriHandlers::handlerFor(const std::string& uri,
+                                                                        std::string* pPrefix) const
 {
    std::vector<UriHandler>::const_iterator handler = std::find_if(
                               uriHandlers_.begin(), 
@@ -140,6 +151,8 @@ boost::optional<UriAsyncHandlerFunctionVariant> UriHandlers::handlerFor(const st
                               boost::bind(&UriHandler::matches, _1, uri));
    if ( handler != uriHandlers_.end() )
    {
+      if (pPrefix)
+         *pPrefix = handler->prefix();
       return handler->function();
    }
    else
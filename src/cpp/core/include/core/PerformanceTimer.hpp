@@ -23,6 +23,8 @@
 #include <boost/utility.hpp>
 #include <boost/date_time/posix_time/posix_time.hpp>
 
+#include <core/Trace.hpp>
+
 namespace rstudio {
 namespace core {
    
@@ -31,12 +33,18 @@ class PerformanceTimer : boost::noncopyable
 public:
    PerformanceTimer() ;
    explicit PerformanceTimer(const std::string& step);
+   explicit PerformanceTimer(trace::Histogram& step);
    virtual ~PerformanceTimer() ;
    // COPYING: boost::noncopyable
    
 public:
+   // each step's duration is also recorded in a "timer" histogram named
+   // for the step; callers timing the same step repeatedly can look that
+   // up once and pass it instead of the step's name
    void start(const std::string& step);
+   void start(trace::Histogram& step);
    void advance(const std::string& step);
+   void advance(trace::Histogram& step);
    void stop();
    bool running() const;
    
@@ -45,7 +53,11 @@ private:
    void recordPendingStep();
    
 private:
-   typedef std::pair<std::string,boost::posix_time::time_duration> Step;
+   struct Step
+   {
+      trace::Histogram* pHistogram;
+      boost::posix_time::time_duration duration;
+   };
    typedef std::vector<Step> Steps;
    
    boost::posix_time::ptime startTime_;
@@ -60,7 +72,10 @@ std::ostream& operator << (std::ostream& os, const PerformanceTimer& t) ;
 } // namespace core 
 } // namespace rstudio
 
-#define TIME_FUNCTION core::PerformanceTimer t(BOOST_CURRENT_FUNCTION);
+#define TIME_FUNCTION \
+   static core::trace::Histogram& s_timeFunctionHistogram = \
+         core::trace::histogram("timer", BOOST_CURRENT_FUNCTION); \
+   core::PerformanceTimer t(s_timeFunctionHistogram);
 
 #endif // CORE_PERFORMANCE_TIMER_HPP
 
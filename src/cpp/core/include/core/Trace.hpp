@@ -16,17 +16,132 @@
 #ifndef CORE_TRACE_HPP
 #define CORE_TRACE_HPP
 
+#include <atomic>
+#include <chrono>
+#include <cstdint>
 #include <iosfwd>
 #include <string>
+#include <vector>
 
 #include <boost/current_function.hpp>
+#include <boost/utility.hpp>
+
+#include <shared_core/json/Json.hpp>
 
 namespace rstudio {
 namespace core { 
+
+namespace http {
+class Request;
+class Response;
+} // namespace http
+
 namespace trace {
 
 void add(void* key, const std::string& functionName);
 
+typedef std::chrono::steady_clock Clock;
+
+// A latency histogram (in microseconds) with HDR-style buckets: values below
+// 32us each have their own bucket, and above that every power of two is split
+// into 16 linear sub-buckets, so any percentile is accurate to within ~6%.
+// Recording is lock-free and can be done from any thread.
+class Histogram : boost::noncopyable
+{
+public:
+   Histogram(const std::string& category, const std::string& name);
+
+   const std::string& category() const { return category_; }
+   const std::string& name() const { return name_; }
+
+   void record(int64_t microseconds);
+   void record(Clock::duration duration);
+
+   uint64_t count() const;
+   int64_t max() const;
+   double mean() const;
+
+   // the value (in microseconds) below which the given fraction
+   // of the recorded values fall
+   int64_t percentile(double fraction) const;
+
+   core::json::Object toJson() const;
+
+   // exposed for testing
+   static std::size_t bucketIndex(int64_t microseconds);
+   static int64_t bucketUpperBound(std::size_t index);
+
+   static const std::size_t kBucketCount;
+
+private:
+   std::string category_;
+   std::string name_;
+   std::vector<std::atomic<uint64_t> > buckets_;
+   std::atomic<uint64_t> count_;
+   std::atomic<uint64_t> total_;
+   std::atomic<int64_t> max_;
+};
+
+// returns the histogram for the given category and name (e.g. "rpc" and the
+// method name), creating it if necessary. histograms live for the lifetime
+// of the process so hot paths can look theirs up once and keep a reference
+Histogram& histogram(const std::string& category, const std::string& name);
+
+// all the histograms (as json, ordered by category and name)
+core::json::Array histogramsAsJson();
+
+// Trace events (in addition to histograms) are only recorded while
+// tracing is enabled. Each thread records events into its own fixed size
+// ring buffer (so only the most recent events of each thread are kept)
+// without taking any locks.
+void setTracingEnabled(bool enabled);
+bool isTracingEnabled();
+
+// record a completed trace event. the category and name aren't copied so
+// must live for the lifetime of the process (e.g. string literals or the
+// category and name of a histogram)
+void recordEvent(const char* category,
+                 const char* name,
+                 Clock::time_point start,
+                 Clock::duration duration);
+
+// write the recorded events in the Chrome trace event format (which can
+// be loaded by chrome://tracing or Perfetto)
+void writeChromeTrace(std::ostream& os);
+
+// discard the recorded events
+void clearEvents();
+
+// uri handlers serving the histograms (as json) and the recorded events (as
+// a chrome trace). they're read-only: tracing is only turned on by the
+// process's own configuration
+void handleStatsRequest(const http::Request& request, http::Response* pResponse);
+void handleEventsRequest(const http::Request& request, http::Response* pResponse);
+
+// enable tracing if requested by the RSTUDIO_TRACE environment variable
+void initializeFromEnvironment();
+
+// Times a span of work, recording its duration in a histogram (and as a
+// trace event when tracing is enabled) when it ends. The span ends when
+// end() is called or it is destroyed, so for asynchronous work it can be
+// kept alive (e.g. in a shared_ptr) until the work completes. end() returns
+// the span's duration (however many times it's called).
+class Span : boost::noncopyable
+{
+public:
+   explicit Span(Histogram& histogram);
+   Span(const std::string& category, const std::string& name);
+   ~Span();
+
+   Clock::duration end();
+
+private:
+   Histogram& histogram_;
+   Clock::time_point start_;
+   Clock::duration duration_;
+   bool ended_;
+};
+
 } // namespace trace
 } // namespace core 
 } // namespace rstudio
@@ -34,5 +149,4 @@ void add(void* key, const std::string& functionName);
 #define TRACE_CURRENT_METHOD \
    core::trace::add(this, BOOST_CURRENT_FUNCTION);
 
-#endif // CORE_PERFORMANCE_TIMER_HPP
-
+#endif // CORE_TRACE_HPP
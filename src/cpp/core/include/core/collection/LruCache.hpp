@@ -16,8 +16,16 @@
 #ifndef CORE_COLLECTION_LRU_CACHE_HPP
 #define CORE_COLLECTION_LRU_CACHE_HPP
 
-#include <map>
-#include <deque>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include <boost/date_time/posix_time/posix_time_duration.hpp>
+#include <boost/function.hpp>
+#include <boost/functional/hash.hpp>
+#include <boost/utility.hpp>
 
 #include <shared_core/Error.hpp>
 #include <core/Thread.hpp>
@@ -26,47 +34,129 @@ namespace rstudio {
 namespace core {
 namespace collection {
 
-template <typename KeyType, typename ValueType>
-class LruCache
+struct LruCacheOptions
+{
+   explicit LruCacheOptions(std::size_t maxEntries)
+      : maxEntries(maxEntries),
+        maxBytes(0),
+        shards(1)
+   {
+   }
+
+   // the maximum number of entries (storage for which is allocated when the
+   // cache is created)
+   std::size_t maxEntries;
+
+   // the maximum total cost of the entries (0 for no limit)
+   std::size_t maxBytes;
+
+   // how long entries live after they're inserted (not set for no limit)
+   boost::posix_time::time_duration ttl;
+
+   // the number of independently locked shards. entries are divided among
+   // the shards by the hash of their key, and each shard evicts its own
+   // least recently used entries, so with more than one shard eviction order
+   // is only approximately LRU (and the limits apply to each shard's share)
+   std::size_t shards;
+};
+
+struct LruCacheStats
+{
+   LruCacheStats()
+      : hits(0), misses(0), evictions(0), expirations(0), entries(0), bytes(0)
+   {
+   }
+
+   uint64_t hits;
+   uint64_t misses;
+   uint64_t evictions;
+   uint64_t expirations;
+   std::size_t entries;
+   std::size_t bytes;
+};
+
+// A thread safe least recently used cache. Each shard keeps its entries in
+// a pool of nodes allocated up front, chained into hash buckets and an LRU
+// list by index, so inserting and evicting entries doesn't allocate (beyond
+// what copying keys and values does). Keys and values must be default
+// constructible.
+template <typename KeyType,
+          typename ValueType,
+          typename HashType = boost::hash<KeyType> >
+class LruCache : boost::noncopyable
 {
 public:
-   LruCache(unsigned int maxSize) : maxSize_(maxSize) {}
+   // the cost (e.g. size in bytes) of an entry. without a cost function
+   // an entry costs the size of its key and value types
+   typedef boost::function<std::size_t(const KeyType&, const ValueType&)> CostFunction;
+
+   LruCache(unsigned int maxSize)
+      : LruCache(LruCacheOptions(maxSize))
+   {
+   }
+
+   LruCache(const LruCacheOptions& options,
+            const CostFunction& costFunction = CostFunction())
+      : costFunction_(costFunction),
+        shardCount_(std::max<std::size_t>(options.shards, 1)),
+        shards_(new Shard[shardCount_])
+   {
+      std::size_t maxEntries = (options.maxEntries + shardCount_ - 1) / shardCount_;
+      maxBytes_ = (options.maxBytes + shardCount_ - 1) / shardCount_;
+      hasTtl_ = !options.ttl.is_special() && options.ttl.total_microseconds() > 0;
+      if (hasTtl_)
+         ttl_ = std::chrono::microseconds(options.ttl.total_microseconds());
+
+      for (std::size_t i = 0; i < shardCount_; i++)
+         shards_[i].initialize(std::max<std::size_t>(maxEntries, 1));
+   }
+
    virtual ~LruCache() {}
 
    void insert(const KeyType& key,
                const ValueType& value)
    {
-      LOCK_MUTEX(mutex_)
+      std::size_t hash = hasher_(key);
+      std::size_t cost = costFunction_ ?
+               costFunction_(key, value) : sizeof(KeyType) + sizeof(ValueType);
+
+      Shard& shard = shardFor(hash);
+      LOCK_MUTEX(shard.mutex)
       {
-         if (map_.count(key) > 0)
+         uint32_t index = shard.find(key, hash);
+         if (index != kNone)
          {
-            // entry for this key already exists - we are updating the value instead of inserting it
-            // we need to remove it from the chain of nodes and then reinsert it to the front
-            // so that this entry's LRU "time" is effectively updated
-            auto pNode = map_[key];
-            pNode->value = value;
-            removeNode(pNode);
-            addNode(pNode);
+            // entry for this key already exists - update its value and move
+            // it to the front so that its LRU "time" is effectively updated
+            Node& node = shard.nodes[index];
+            shard.bytes -= node.cost;
+            node.value = value;
+            node.cost = cost;
+            shard.unlinkLru(index);
+            shard.linkLruFront(index);
          }
          else
          {
-            if (map_.size() >= maxSize_)
-            {
-               // the cache has reached maximum size
-               // remove the oldest item from the cache which is at the back of the node chain
-               auto pNode = backNode_;
-               removeNode(pNode);
-
-               // erase the node from the map
-               // when this block goes out of scope, there are no more references
-               // to the expired node pointer, so it is freed
-               map_.erase(pNode->key);
-            }
-
-            // create a new node and store it
-            auto pNode = boost::shared_ptr<Node>(new Node(key, value));
-            addNode(pNode);
-            map_[key] = pNode;
+            // the cache has reached maximum size - remove the oldest entry
+            if (shard.freeHead == kNone)
+               shard.evict(shard.lruTail);
+
+            index = shard.add(key, value, hash, cost);
+         }
+
+         Node& node = shard.nodes[index];
+         shard.bytes += cost;
+         if (hasTtl_)
+            node.expires = Clock::now() + ttl_;
+
+         if (maxBytes_ > 0)
+         {
+            // evict older entries until we're within budget (and this entry
+            // too if it's over budget by itself)
+            while (shard.bytes > maxBytes_ && shard.lruTail != index)
+               shard.evict(shard.lruTail);
+            if (shard.bytes > maxBytes_)
+               shard.evict(index);
          }
       }
       END_LOCK_MUTEX
@@ -75,19 +165,32 @@ public:
    bool get(const KeyType& key,
             ValueType* pValue)
    {
-      LOCK_MUTEX(mutex_)
+      std::size_t hash = hasher_(key);
+      Shard& shard = shardFor(hash);
+      LOCK_MUTEX(shard.mutex)
       {
-         typename CollectionType::iterator iter = map_.find(key);
-         if (iter == map_.end())
+         uint32_t index = shard.find(key, hash);
+         if (index == kNone)
+         {
+            shard.stats.misses++;
             return false;
+         }
 
-         auto pNode = iter->second;
+         Node& node = shard.nodes[index];
+         if (hasTtl_ && Clock::now() >= node.expires)
+         {
+            shard.remove(index);
+            shard.stats.expirations++;
+            shard.stats.misses++;
+            return false;
+         }
 
-         // remove and reinsert node to update its last access time
-         removeNode(pNode);
-         addNode(pNode);
+         // move to the front to update its last access time
+         shard.unlinkLru(index);
+         shard.linkLruFront(index);
+         shard.stats.hits++;
 
-         *pValue = pNode->value;
+         *pValue = node.value;
          return true;
       }
       END_LOCK_MUTEX
@@ -97,79 +200,228 @@ public:
 
    void remove(const KeyType& key)
    {
-      LOCK_MUTEX(mutex_)
+      std::size_t hash = hasher_(key);
+      Shard& shard = shardFor(hash);
+      LOCK_MUTEX(shard.mutex)
       {
-         typename CollectionType::iterator iter = map_.find(key);
-         if (iter == map_.end())
-            return;
-
-         auto pNode = iter->second;
-         removeNode(pNode);
-         map_.erase(key);
+         uint32_t index = shard.find(key, hash);
+         if (index != kNone)
+            shard.remove(index);
       }
       END_LOCK_MUTEX
    }
 
-   size_t size()
+   void clear()
    {
-      LOCK_MUTEX(mutex_)
+      for (std::size_t i = 0; i < shardCount_; i++)
       {
-         return map_.size();
+         Shard& shard = shards_[i];
+         LOCK_MUTEX(shard.mutex)
+         {
+            while (shard.lruHead != kNone)
+               shard.remove(shard.lruHead);
+         }
+         END_LOCK_MUTEX
       }
-      END_LOCK_MUTEX
+   }
 
-      return 0;
+   size_t size()
+   {
+      return stats().entries;
+   }
+
+   LruCacheStats stats()
+   {
+      LruCacheStats total;
+      for (std::size_t i = 0; i < shardCount_; i++)
+      {
+         Shard& shard = shards_[i];
+         LOCK_MUTEX(shard.mutex)
+         {
+            total.hits += shard.stats.hits;
+            total.misses += shard.stats.misses;
+            total.evictions += shard.stats.evictions;
+            total.expirations += shard.stats.expirations;
+            total.entries += shard.stats.entries;
+            total.bytes += shard.bytes;
+         }
+         END_LOCK_MUTEX
+      }
+      return total;
    }
 
 private:
+   typedef std::chrono::steady_clock Clock;
+
+   static const uint32_t kNone = UINT32_MAX;
+
    struct Node
    {
-      Node(const KeyType& key, const ValueType& value) :
-         key(key), value(value) {}
+      Node()
+         : hash(0), cost(0), lruPrev(kNone), lruNext(kNone), bucketNext(kNone)
+      {
+      }
 
-      boost::shared_ptr<Node> pLeft;
-      boost::shared_ptr<Node> pRight;
       KeyType key;
       ValueType value;
+      std::size_t hash;
+      std::size_t cost;
+      Clock::time_point expires;
+
+      // links in the LRU list (lruNext also links the free list)
+      uint32_t lruPrev;
+      uint32_t lruNext;
+
+      // link in the hash bucket's chain
+      uint32_t bucketNext;
    };
 
-   void removeNode(const boost::shared_ptr<Node>& pNode)
+   struct Shard
    {
-      if (pNode->pLeft)
-         pNode->pLeft->pRight = pNode->pRight;
-      else
-         frontNode_ = pNode->pRight;
-
-      if (pNode->pRight)
-         pNode->pRight->pLeft = pNode->pLeft;
-      else
-         backNode_ = pNode->pLeft;
-   }
+      void initialize(std::size_t maxEntries)
+      {
+         nodes.resize(maxEntries);
+         for (std::size_t i = 0; i < maxEntries; i++)
+            nodes[i].lruNext = i + 1 < maxEntries ? static_cast<uint32_t>(i + 1) : kNone;
+         freeHead = 0;
 
-   void addNode(const boost::shared_ptr<Node>& pNode)
-   {
-      pNode->pRight = frontNode_;
-      pNode->pLeft.reset();
+         // a power of two buckets, at least one per entry
+         std::size_t bucketCount = 1;
+         while (bucketCount < maxEntries)
+            bucketCount <<= 1;
+         buckets.assign(bucketCount, kNone);
+         bucketMask = bucketCount - 1;
+      }
 
-      if (frontNode_)
-         frontNode_->pLeft = pNode;
-      frontNode_ = pNode;
+      uint32_t find(const KeyType& key, std::size_t hash) const
+      {
+         for (uint32_t index = buckets[hash & bucketMask];
+              index != kNone;
+              index = nodes[index].bucketNext)
+         {
+            if (nodes[index].hash == hash && nodes[index].key == key)
+               return index;
+         }
+         return kNone;
+      }
 
-      if (!backNode_)
-         backNode_ = frontNode_;
-   }
+      uint32_t add(const KeyType& key,
+                   const ValueType& value,
+                   std::size_t hash,
+                   std::size_t cost)
+      {
+         uint32_t index = freeHead;
+         Node& node = nodes[index];
+         freeHead = node.lruNext;
+
+         node.key = key;
+         node.value = value;
+         node.hash = hash;
+         node.cost = cost;
+
+         uint32_t& bucket = buckets[hash & bucketMask];
+         node.bucketNext = bucket;
+         bucket = index;
+
+         linkLruFront(index);
+         stats.entries++;
+         return index;
+      }
+
+      void remove(uint32_t index)
+      {
+         Node& node = nodes[index];
+         unlinkLru(index);
 
-   unsigned int maxSize_;
+         uint32_t* pLink = &buckets[node.hash & bucketMask];
+         while (*pLink != index)
+            pLink = &nodes[*pLink].bucketNext;
+         *pLink = node.bucketNext;
 
-   typedef std::map<KeyType, boost::shared_ptr<Node>> CollectionType;
-   CollectionType map_;
+         bytes -= node.cost;
+         stats.entries--;
 
-   boost::shared_ptr<Node> frontNode_;
-   boost::shared_ptr<Node> backNode_;
+         // release whatever the key and value hold on to
+         node.key = KeyType();
+         node.value = ValueType();
+         node.cost = 0;
 
-   boost::mutex mutex_;
+         node.lruNext = freeHead;
+         freeHead = index;
+      }
+
+      void evict(uint32_t index)
+      {
+         remove(index);
+         stats.evictions++;
+      }
+
+      void unlinkLru(uint32_t index)
+      {
+         Node& node = nodes[index];
+         if (node.lruPrev != kNone)
+            nodes[node.lruPrev].lruNext = node.lruNext;
+         else
+            lruHead = node.lruNext;
+
+         if (node.lruNext != kNone)
+            nodes[node.lruNext].lruPrev = node.lruPrev;
+         else
+            lruTail = node.lruPrev;
+
+         node.lruPrev = node.lruNext = kNone;
+      }
+
+      void linkLruFront(uint32_t index)
+      {
+         Node& node = nodes[index];
+         node.lruPrev = kNone;
+         node.lruNext = lruHead;
+         if (lruHead != kNone)
+            nodes[lruHead].lruPrev = index;
+         lruHead = index;
+         if (lruTail == kNone)
+            lruTail = index;
+      }
+
+      boost::mutex mutex;
+      std::vector<Node> nodes;
+      std::vector<uint32_t> buckets;
+      std::size_t bucketMask = 0;
+      uint32_t lruHead = kNone;
+      uint32_t lruTail = kNone;
+      uint32_t freeHead = kNone;
+      std::size_t bytes = 0;
+      LruCacheStats stats;
+
+      // keeps neighbouring shards' locks and counters off each other's cache
+      // lines (padded rather than aligned, since new only honours extended
+      // alignment from C++17)
+      char padding[64];
+   };
+
+   Shard& shardFor(std::size_t hash)
+   {
+      if (shardCount_ == 1)
+         return shards_[0];
+
+      // use different bits of the hash than the buckets within the shard do
+      uint64_t mixed = static_cast<uint64_t>(hash) * 0x9E3779B97F4A7C15ULL;
+      return shards_[(mixed >> 32) % shardCount_];
+   }
+
+   HashType hasher_;
+   CostFunction costFunction_;
+   std::size_t maxBytes_;
+   bool hasTtl_;
+   Clock::duration ttl_;
+   std::size_t shardCount_;
+   std::unique_ptr<Shard[]> shards_;
 };
 
+template <typename KeyType, typename ValueType, typename HashType>
+const uint32_t LruCache<KeyType, ValueType, HashType>::kNone;
+
 } // namespace collection
 } // namespace core
 } // namespace rstudio
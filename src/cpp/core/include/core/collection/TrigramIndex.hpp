@@ -0,0 +1,111 @@
+/*
+ * TrigramIndex.hpp
+ *
+ * Copyright (C) 2020 by RStudio, PBC
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef CORE_COLLECTION_TRIGRAM_INDEX_HPP
+#define CORE_COLLECTION_TRIGRAM_INDEX_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+#include <string>
+#include <vector>
+
+#include <boost/array.hpp>
+#include <boost/unordered_map.hpp>
+#include <boost/utility.hpp>
+
+namespace rstudio {
+namespace core {
+namespace collection {
+
+// Inverted index of names supporting case-insensitive prefix, substring and
+// subsequence ("fuzzy") lookups without scanning every name. Each name is
+// posted under its characters, its trigrams and its leading 1-3 characters;
+// a query walks only the shortest posting list its term implies and verifies
+// the candidates found there.
+//
+// Names are identified by stable integer ids. Removal is lazy: removed ids
+// are skipped during lookups and the postings are rebuilt once they hold
+// more removed than live entries, after which removed ids are reused.
+class TrigramIndex : boost::noncopyable
+{
+public:
+   typedef uint32_t Id;
+
+   TrigramIndex();
+
+   Id insert(const std::string& name);
+   void remove(Id id);
+   void clear();
+
+   bool contains(Id id) const;
+   const std::string& name(Id id) const;
+   std::size_t size() const { return size_; }
+
+   // all of the functions below append ids in ascending order
+
+   // names equal to 'name' (case sensitive)
+   void findExact(const std::string& name, std::vector<Id>* pIds) const;
+
+   // names starting with 'term' (case insensitive)
+   void findPrefix(const std::string& term, std::vector<Id>* pIds) const;
+
+   // names containing 'term' (case insensitive)
+   void findSubstring(const std::string& term, std::vector<Id>* pIds) const;
+
+   // names containing the characters of 'term' in order (case insensitive)
+   void findSubsequence(const std::string& term, std::vector<Id>* pIds) const;
+
+   // every name in the index
+   void findAll(std::vector<Id>* pIds) const;
+
+private:
+   typedef std::vector<Id> Postings;
+   typedef boost::unordered_map<uint32_t, Postings> PostingsMap;
+
+   void post(Id id);
+   void compact();
+
+   // walk the given postings, appending the live ids which satisfy the
+   // verification predicate
+   template <typename Predicate>
+   void collect(const Postings& postings,
+                Predicate predicate,
+                std::vector<Id>* pIds) const;
+
+   const Postings* lookup(const PostingsMap& map, uint32_t key) const;
+   const Postings* rarestCharPostings(const std::string& folded) const;
+
+   std::vector<std::string> names_;
+   std::vector<std::string> folded_;
+   std::vector<bool> live_;
+   std::vector<uint32_t> postingCounts_;
+   std::vector<Id> freeIds_;
+   std::size_t size_;
+
+   std::size_t livePostings_;
+   std::size_t deadPostings_;
+
+   boost::array<Postings, 256> chars_;
+   PostingsMap trigrams_;
+   PostingsMap prefixes_;
+   boost::unordered_map<std::string, Postings> exact_;
+};
+
+} // namespace collection
+} // namespace core
+} // namespace rstudio
+
+#endif // CORE_COLLECTION_TRIGRAM_INDEX_HPP
@@ -99,7 +99,9 @@ public:
         connectionRetryContext_(ioService),
         logToStderr_(logToStderr),
         closed_(false),
-        requestWritten_(false)
+        requestWritten_(false),
+        requestBytesWritten_(0),
+        responseStarted_(false)
    {
    }
 
@@ -259,11 +261,15 @@ protected:
    void writeRequest()
    {
       // specify closing of the connection after the request unless this is
-      // an attempt to upgrade to websockets
+      // an attempt to upgrade to websockets or the subclass wants to reuse
+      // the connection for subsequent requests
       Header overrideHeader;
       if (!util::isWSUpgradeRequest(request_))
       {
-         overrideHeader = Header::connectionClose();
+         if (requestKeepAlive())
+            overrideHeader = Header("Connection", "keep-alive");
+         else
+            overrideHeader = Header::connectionClose();
       }
 
       // write
@@ -273,7 +279,8 @@ protected:
           boost::bind(
                &AsyncClient<SocketService>::handleWrite,
                AsyncClient<SocketService>::shared_from_this(),
-               boost::asio::placeholders::error)
+               boost::asio::placeholders::error,
+               boost::asio::placeholders::bytes_transferred)
       );
    }
 
@@ -288,6 +295,21 @@ protected:
       }
       END_LOCK_MUTEX
 
+      // a reused connection may have been closed by the server while it was
+      // idle -- if nothing has been read yet, transparently retry the request
+      // on a fresh connection (subclass determines whether that is possible).
+      // once any of the request has gone out the server may already have
+      // acted on it, so only requests which are safe to repeat are retried
+      if (!responseStarted_ &&
+          (requestBytesWritten_ == 0 || isIdempotentRequest()) &&
+          discardReusedConnection())
+      {
+         responseBuffer_.consume(responseBuffer_.size());
+         requestBytesWritten_ = 0;
+         connectAndWriteRequest();
+         return;
+      }
+
       // close the socket
       close();
 
@@ -431,19 +453,23 @@ private:
          connectHandler();
    }
 
-   void handleWrite(const boost::system::error_code& ec)
+   void handleWrite(const boost::system::error_code& ec,
+                    std::size_t bytesTransferred)
    {
       try
       {
+         requestBytesWritten_ += bytesTransferred;
+
          if (!ec)
          {
-            // invoke connect handler if we have one
+            // invoke connect handler if we have one (only once, even if the
+            // request was retried on another connection)
             ConnectHandler handler;
             LOCK_MUTEX(socketMutex_)
             {
-               requestWritten_ = true;
-               if (connectHandler_)
+               if (!requestWritten_ && connectHandler_)
                   handler = connectHandler_;
+               requestWritten_ = true;
             }
             END_LOCK_MUTEX
 
@@ -474,6 +500,8 @@ private:
       {
          if (!ec)
          {
+            responseStarted_ = true;
+
             // parase status line
             Error error = ResponseParser::parseStatusLine(&responseBuffer_,
                                                           &response_);
@@ -535,6 +563,35 @@ private:
       return false;
    }
 
+   // ask the server to keep the connection open after the response
+   // (subclasses which reuse connections should override)
+   virtual bool requestKeepAlive()
+   {
+      return false;
+   }
+
+   // called instead of close() when keepConnectionAlive() indicates that
+   // the connection remains usable after the response has been read
+   virtual void releaseConnection()
+   {
+   }
+
+   // methods which can be repeated without changing the result (RFC 7231)
+   bool isIdempotentRequest()
+   {
+      const std::string& method = request_.method();
+      return method == "GET" || method == "HEAD" || method == "OPTIONS" ||
+             method == "PUT" || method == "DELETE" || method == "TRACE";
+   }
+
+   // called when an error occurs before any response data was read; returns
+   // true if the failed connection was a reused one which has been discarded
+   // and the request should be retried on a new connection
+   virtual bool discardReusedConnection()
+   {
+      return false;
+   }
+
    void handleReadHeaders(const boost::system::error_code& ec)
    {
       try
@@ -725,6 +782,8 @@ private:
    {
       if (!keepConnectionAlive())
          close();
+      else
+         releaseConnection();
 
       if (responseHandler_ && (!chunkedEncoding_ || !chunkHandler_))
          responseHandler_(response_);
@@ -798,6 +857,8 @@ private:
    bool closed_;
 
    bool requestWritten_;
+   std::size_t requestBytesWritten_;
+   bool responseStarted_;
    ConnectHandler connectHandler_;
 };
    
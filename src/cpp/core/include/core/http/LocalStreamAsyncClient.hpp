@@ -29,6 +29,7 @@
 #include <core/system/PosixUser.hpp>
 
 #include <core/http/AsyncClient.hpp>
+#include <core/http/LocalStreamConnectionPool.hpp>
 #include <core/http/LocalStreamSocketUtils.hpp>
 
 namespace rstudio {
@@ -44,12 +45,16 @@ public:
                           bool logToStderr = false,
                           boost::optional<UidType> validateUid = boost::none,
                           const http::ConnectionRetryProfile& retryProfile =
-                                                http::ConnectionRetryProfile())
+                                                http::ConnectionRetryProfile(),
+                          const boost::shared_ptr<LocalStreamConnectionPool>& pPool =
+                                                boost::shared_ptr<LocalStreamConnectionPool>())
      : AsyncClient<boost::asio::local::stream_protocol::socket>(ioService,
                                                                 logToStderr),
-       socket_(ioService),
+       pSocket_(new boost::asio::local::stream_protocol::socket(ioService)),
        localStreamPath_(localStreamPath),
-       validateUid_(validateUid)
+       validateUid_(validateUid),
+       pPool_(pPool),
+       reusedConnection_(false)
    {
       setConnectionRetryProfile(retryProfile);
    }
@@ -58,13 +63,28 @@ protected:
 
    virtual boost::asio::local::stream_protocol::socket& socket()
    {
-      return socket_;
+      return *pSocket_;
    }
 
 private:
 
    virtual void connectAndWriteRequest()
    {
+      // reuse an idle connection if we have one (it was validated when it
+      // was first established)
+      if (pPool_)
+      {
+         boost::shared_ptr<boost::asio::local::stream_protocol::socket> pPooled =
+               pPool_->checkout(localStreamPath_, ioService());
+         if (pPooled)
+         {
+            pSocket_ = pPooled;
+            reusedConnection_ = true;
+            writeRequest();
+            return;
+         }
+      }
+
       // validate if requested
       if (validateUid_.is_initialized() && localStreamPath_.exists())
       {
@@ -98,6 +118,7 @@ private:
       stream_protocol::endpoint endpoint(localStreamPath_.getAbsolutePath());
 
       // connect
+      connectStartTime_ = boost::posix_time::microsec_clock::universal_time();
       socket().async_connect(
          endpoint,
          boost::bind(&LocalStreamAsyncClient::handleConnect,
@@ -110,17 +131,76 @@ private:
       return "localhost";
    }
 
+   virtual bool requestKeepAlive()
+   {
+      return pPool_ && request().method() != "HEAD";
+   }
+
+   // with keep-alive the server won't close the connection, so the response
+   // is complete once Content-Length bytes of body have been read
+   virtual bool stopReadingAndRespond()
+   {
+      return isReusableResponse() &&
+             response_.body().length() >= response_.contentLength();
+   }
+
+   virtual bool keepConnectionAlive()
+   {
+      return isReusableResponse() &&
+             response_.body().length() == response_.contentLength();
+   }
+
+   virtual void releaseConnection()
+   {
+      // hand the connection to the pool and leave ourselves with a fresh
+      // (unopened) socket so a later close() can't affect the pooled one
+      pPool_->checkin(localStreamPath_, ioService(), pSocket_);
+      pSocket_.reset(new boost::asio::local::stream_protocol::socket(ioService()));
+      reusedConnection_ = false;
+   }
+
+   virtual bool discardReusedConnection()
+   {
+      if (!reusedConnection_)
+         return false;
+
+      closeSocket(*pSocket_);
+      pSocket_.reset(new boost::asio::local::stream_protocol::socket(ioService()));
+      reusedConnection_ = false;
+      pPool_->recordStale();
+      return true;
+   }
+
+   bool isReusableResponse()
+   {
+      return pPool_ &&
+             !chunkedEncoding_ &&
+             boost::algorithm::iequals(response_.headerValue("Connection"), "keep-alive") &&
+             !response_.headerValue("Content-Length").empty();
+   }
+
    void handleConnect(const boost::system::error_code& ec)
    {
       try
       {
          if (!ec)
          {
+            if (pPool_)
+            {
+               pPool_->recordConnect(boost::posix_time::microsec_clock::universal_time() -
+                                     connectStartTime_);
+            }
+
             // the connection was successful call base to write the request
             writeRequest();
          }
          else
          {
+            // nothing is listening on the stream (e.g. the session exited)
+            // so any idle connections we're holding to it are dead too
+            if (pPool_)
+               pPool_->evictStream(localStreamPath_);
+
             handleConnectionError(Error(ec, ERROR_LOCATION));
          }
       }
@@ -137,9 +217,12 @@ private:
    }
 
 private:
-   boost::asio::local::stream_protocol::socket socket_;
+   boost::shared_ptr<boost::asio::local::stream_protocol::socket> pSocket_;
    core::FilePath localStreamPath_;
    boost::optional<UidType> validateUid_;
+   boost::shared_ptr<LocalStreamConnectionPool> pPool_;
+   bool reusedConnection_;
+   boost::posix_time::ptime connectStartTime_;
 };
    
    
@@ -0,0 +1,135 @@
+/*
+ * LocalStreamConnectionPool.hpp
+ *
+ * Copyright (C) 2020 by RStudio, PBC
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef CORE_HTTP_LOCAL_STREAM_CONNECTION_POOL_HPP
+#define CORE_HTTP_LOCAL_STREAM_CONNECTION_POOL_HPP
+
+#include <deque>
+#include <map>
+#include <string>
+
+#include <boost/shared_ptr.hpp>
+#include <boost/utility.hpp>
+#include <boost/asio/io_service.hpp>
+#include <boost/asio/local/stream_protocol.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <shared_core/FilePath.hpp>
+
+namespace rstudio {
+namespace core {
+namespace http {
+
+// pool of idle, kept-alive connections to local stream servers (keyed
+// by stream path). connections are checked out by LocalStreamAsyncClient
+// before it connects and are returned once a keep-alive response has
+// been fully read
+class LocalStreamConnectionPool : boost::noncopyable
+{
+public:
+   typedef boost::asio::local::stream_protocol::socket Socket;
+
+   struct Stats
+   {
+      Stats()
+         : hits(0), misses(0), stale(0), evictions(0), idle(0),
+           connects(0), totalConnectMicros(0), maxConnectMicros(0)
+      {
+      }
+
+      double hitRate() const
+      {
+         uint64_t total = hits + misses;
+         return total > 0 ? static_cast<double>(hits) / total : 0.0;
+      }
+
+      double averageConnectMicros() const
+      {
+         return connects > 0 ? static_cast<double>(totalConnectMicros) / connects : 0.0;
+      }
+
+      uint64_t hits;
+      uint64_t misses;
+      uint64_t stale;
+      uint64_t evictions;
+      uint64_t idle;
+      uint64_t connects;
+      uint64_t totalConnectMicros;
+      uint64_t maxConnectMicros;
+   };
+
+   explicit LocalStreamConnectionPool(
+         std::size_t maxIdlePerStream = 4,
+         const boost::posix_time::time_duration& idleTimeout =
+                                          boost::posix_time::seconds(60));
+
+   // take an idle connection to the stream which is still healthy (returns
+   // an empty pointer if none is available)
+   boost::shared_ptr<Socket> checkout(const FilePath& streamPath,
+                                      boost::asio::io_service& ioService);
+
+   // return a connection whose response was completely read
+   void checkin(const FilePath& streamPath,
+                boost::asio::io_service& ioService,
+                const boost::shared_ptr<Socket>& pSocket);
+
+   // note that a connection obtained from the pool turned out to be closed
+   void recordStale();
+
+   // note the time taken to establish a new connection
+   void recordConnect(const boost::posix_time::time_duration& elapsed);
+
+   // close connections that have been idle longer than the idle timeout
+   void evictIdle();
+
+   // close all idle connections to the stream (e.g. when the session exits)
+   void evictStream(const FilePath& streamPath);
+
+   Stats stats();
+
+private:
+   struct IdleConnection
+   {
+      IdleConnection(boost::asio::io_service* pIoService,
+                     const boost::shared_ptr<Socket>& pSocket)
+         : pIoService(pIoService),
+           pSocket(pSocket),
+           idleSince(boost::posix_time::microsec_clock::universal_time())
+      {
+      }
+
+      boost::asio::io_service* pIoService;
+      boost::shared_ptr<Socket> pSocket;
+      boost::posix_time::ptime idleSince;
+   };
+
+   typedef std::deque<IdleConnection> IdleConnections;
+
+   void closeConnection(const IdleConnection& connection);
+
+   std::size_t maxIdlePerStream_;
+   boost::posix_time::time_duration idleTimeout_;
+
+   boost::mutex mutex_;
+   std::map<std::string, IdleConnections> idle_;
+   Stats stats_;
+};
+
+} // namespace http
+} // namespace core
+} // namespace rstudio
+
+#endif // CORE_HTTP_LOCAL_STREAM_CONNECTION_POOL_HPP
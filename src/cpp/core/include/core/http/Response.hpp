@@ -115,6 +115,11 @@ public:
 
    virtual Error initialize() = 0;
    virtual std::shared_ptr<StreamBuffer> nextBuffer() = 0;
+
+   // the error (if any) which ended the stream (nextBuffer returned no
+   // buffer); the connection is then aborted rather than the response being
+   // completed, so that the client doesn't mistake it for the whole body
+   virtual Error streamError() const { return Success(); }
 };
 
 class Response : public Message
@@ -266,6 +271,9 @@ public:
                       const Request& request,
                       std::streamsize buffSize = 65536);
 
+   // streams the body as it's produced (with chunked encoding)
+   void setStreamResponse(const boost::shared_ptr<StreamResponse>& streamResponse);
+
    Error setBody(const FilePath& filePath, std::streamsize buffSize = 512)
    {
       NullOutputFilter nullFilter;
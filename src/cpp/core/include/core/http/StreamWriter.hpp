@@ -110,6 +110,14 @@ private:
       }
       else
       {
+         // the stream failed part way through (abort the response)
+         Error error = response->streamError();
+         if (error)
+         {
+            onError_(error);
+            return;
+         }
+
          // no more chunks to send - send final empty chunk
          writeFinalChunk();
       }
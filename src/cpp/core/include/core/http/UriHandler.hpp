@@ -62,6 +62,8 @@ public:
    // COPYING: via compiler
    
    bool matches(const std::string& uri) const;
+
+   const std::string& prefix() const;
    
    UriAsyncHandlerFunctionVariant function() const;
   
@@ -89,6 +91,10 @@ public:
    void add(const UriHandler& handler);
    
    boost::optional<UriAsyncHandlerFunctionVariant> handlerFor(const std::string& uri) const;
+
+   // also returns the prefix of the handler (e.g. to identify it in metrics)
+   boost::optional<UriAsyncHandlerFunctionVariant> handlerFor(const std::string& uri,
+                                                              std::string* pPrefix) const;
    
 private:
    std::vector<UriHandler> uriHandlers_;
@@ -17,6 +17,8 @@
 #ifndef CORE_R_UTIL_ACTIVE_SESSIONS_HPP
 #define CORE_R_UTIL_ACTIVE_SESSIONS_HPP
 
+#include <map>
+
 #include <boost/noncopyable.hpp>
 
 #include <shared_core/Error.hpp>
@@ -49,11 +51,6 @@ private:
       core::Error error = scratchPath_.ensureDirectory();
       if (error)
          LOG_ERROR(error);
-
-      propertiesPath_ = scratchPath_.completeChildPath("properites");
-      error = propertiesPath_.ensureDirectory();
-      if (error)
-         LOG_ERROR(error);
    }
 
 public:
@@ -221,9 +218,11 @@ public:
    {
       if (!empty())
       {
-         writeProperty("r-version", rVersion);
-         writeProperty("r-version-home", rVersionHome);
-         writeProperty("r-version-label", rVersionLabel);
+         std::map<std::string, std::string> properties;
+         properties["r-version"] = rVersion;
+         properties["r-version-home"] = rVersionHome;
+         properties["r-version-label"] = rVersionLabel;
+         writeProperties(properties);
       }
    }
 
@@ -247,16 +246,28 @@ public:
                      const std::string& rVersionHome,
                      const std::string& rVersionLabel = "")
    {
-      setLastUsed();
-      setRunning(true);
-      setRVersion(rVersion, rVersionHome, rVersionLabel);
+      if (!empty())
+      {
+         std::map<std::string, std::string> properties;
+         properties["last-used"] = timestampNow();
+         properties["running"] = safe_convert::numberToString(true);
+         properties["r-version"] = rVersion;
+         properties["r-version-home"] = rVersionHome;
+         properties["r-version-label"] = rVersionLabel;
+         writeProperties(properties);
+      }
    }
 
    void endSession()
    {
-      setLastUsed();
-      setRunning(false);
-      setExecuting(false);
+      if (!empty())
+      {
+         std::map<std::string, std::string> properties;
+         properties["last-used"] = timestampNow();
+         properties["running"] = safe_convert::numberToString(false);
+         properties["executing"] = safe_convert::numberToString(false);
+         writeProperties(properties);
+      }
    }
 
    uintmax_t suspendSize()
@@ -268,49 +279,11 @@ public:
       return suspendPath.getSizeRecursive();
    }
 
-   core::Error destroy()
-   {
-      if (!empty())
-         return scratchPath_.removeIfExists();
-      else
-         return Success();
-   }
+   // removes the session's properties and scratch path
+   core::Error destroy();
 
    bool validate(const FilePath& userHomePath,
-                 bool projectSharingEnabled) const
-   {
-      // ensure the scratch path and properties paths exist
-      if (!scratchPath_.exists() || !propertiesPath_.exists())
-         return false;
-
-      // ensure the properties are there
-      if (project().empty() || workingDir().empty() || (lastUsed() == 0))
-          return false;
-
-      // for projects validate that the base directory still exists
-      std::string theProject = project();
-      if (theProject != kProjectNone)
-      {
-         FilePath projectDir = FilePath::resolveAliasedPath(theProject,
-                                                            userHomePath);
-         if (!projectDir.exists())
-            return false;
-
-        // check for project file
-        FilePath projectPath = r_util::projectFromDirectory(projectDir);
-        if (!projectPath.exists())
-           return false;
-
-        // if we got this far the scope is valid, do one final check for
-        // trying to open a shared project if sharing is disabled
-        if (!projectSharingEnabled &&
-            r_util::isSharedPath(projectPath.getAbsolutePath(), userHomePath))
-           return false;
-      }
-
-      // validated!
-      return true;
-   }
+                 bool projectSharingEnabled) const;
 
 private:
 
@@ -318,9 +291,7 @@ private:
    {
       if (!empty())
       {
-         double now = date_time::millisecondsSinceEpoch();
-         std::string value = safe_convert::numberToString(now);
-         writeProperty(property, value);
+         writeProperty(property, timestampNow());
       }
    }
 
@@ -350,16 +321,33 @@ private:
       }
    }
 
+   static std::string timestampNow()
+   {
+      return safe_convert::numberToString(date_time::millisecondsSinceEpoch());
+   }
+
+   // properties are kept in a single metadata file shared by all of the
+   // user's sessions (see ActiveSessions); writing several properties at
+   // once updates them together, and writing unchanged properties doesn't
+   // update it at all. Properties which change with every command (whether
+   // the session is executing, and when it was last used) are kept in a
+   // file of their own instead.
    void writeProperty(const std::string& name, const std::string& value) const;
+   void writeProperties(const std::map<std::string, std::string>& properties) const;
    std::string readProperty(const std::string& name) const;
 
 private:
    std::string id_;
    FilePath scratchPath_;
-   FilePath propertiesPath_;
 };
 
 
+// The active sessions of a user. Each session has a scratch directory within
+// the storage path, and the properties of all of the sessions (other than
+// their volatile ones, see ActiveSession) are stored together in one
+// metadata file there (so sessions can be listed with a single read of it).
+// Updates to the metadata file are made under a file lock and replace the
+// file atomically.
 class ActiveSessions : boost::noncopyable
 {
 public:
@@ -0,0 +1,92 @@
+/*
+ * RExpressionChunks.hpp
+ *
+ * Copyright (C) 2020 by RStudio, PBC
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef CORE_R_UTIL_R_EXPRESSION_CHUNKS_HPP
+#define CORE_R_UTIL_R_EXPRESSION_CHUNKS_HPP
+
+#include <cstddef>
+
+#include <set>
+#include <string>
+#include <vector>
+
+#include <boost/function.hpp>
+
+namespace rstudio {
+namespace core {
+namespace r_util {
+
+// Partitions R code into chunks of complete top-level expressions, which
+// can be parsed and linted independently of one another. A chunk always
+// starts at the beginning of a line, and chunk boundaries are only placed
+// where the preceding expression is unambiguously complete (all brackets
+// closed, not ending in an operator or awaiting a body, and the next line
+// not continuing it with e.g. 'else'); anything doubtful is kept together.
+//
+// After an edit, update() re-lexes only from the chunk preceding the edit
+// up to the first chunk boundary within the unchanged remainder of the
+// code. Chunks whose text is unchanged record the index of the chunk they
+// correspond to in the previous partition, so that callers can reuse any
+// analysis associated with them.
+class RExpressionChunks
+{
+public:
+   static const std::size_t kNewChunk = static_cast<std::size_t>(-1);
+
+   struct Chunk
+   {
+      Chunk() : offset(0), length(0), row(0), previous(kNewChunk) {}
+
+      std::size_t offset;     // in characters
+      std::size_t length;
+      std::size_t row;        // of the chunk's first line
+      std::size_t previous;   // index in the previous partition (or kNewChunk)
+
+      // names of the functions defined and called within the chunk (with
+      // any backquotes removed); a chunk's analysis may depend on the
+      // definitions made by earlier chunks for the functions it calls
+      std::set<std::wstring> definitions;
+      std::set<std::wstring> calls;
+   };
+
+   RExpressionChunks();
+
+   void update(const std::wstring& code);
+   void clear();
+
+   const std::wstring& code() const { return code_; }
+   const std::vector<Chunk>& chunks() const { return chunks_; }
+   std::wstring chunkText(const Chunk& chunk) const;
+
+   // the number of characters re-lexed by the last update
+   std::size_t relexedLength() const { return relexedLength_; }
+
+private:
+   // lex from 'offset' (the start of a chunk) appending chunks until the end
+   // of the code, or until 'stop' returns true for a chunk boundary
+   void scan(std::size_t offset,
+             std::size_t row,
+             const boost::function<bool(std::size_t, std::size_t)>& stop);
+
+   std::wstring code_;
+   std::vector<Chunk> chunks_;
+   std::size_t relexedLength_;
+};
+
+} // namespace r_util
+} // namespace core
+} // namespace rstudio
+
+#endif // CORE_R_UTIL_R_EXPRESSION_CHUNKS_HPP
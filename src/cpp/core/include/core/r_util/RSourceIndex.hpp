@@ -195,6 +195,12 @@ public:
    RSourceIndex(const std::string& context,
                 const std::string& code);
 
+   // Restore a previously computed index (e.g. one persisted across
+   // sessions) without re-tokenizing the source code
+   RSourceIndex(const std::string& context,
+                const std::vector<RSourceItem>& items,
+                const std::vector<std::string>& inferredPkgNames);
+
    const std::string& context() const { return context_; }
 
    template <typename OutputIterator>
@@ -290,7 +296,7 @@ public:
       return allInferredPkgNames();
    }
 
-   const std::vector<std::string>& getInferredPackages()
+   const std::vector<std::string>& getInferredPackages() const
    {
       return inferredPkgNames_;
    }
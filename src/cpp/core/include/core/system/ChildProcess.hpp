@@ -215,6 +215,16 @@ public:
    // poll for input and exit status
    void poll();
 
+#ifndef _WIN32
+   // poll, only reading output and checking for exit if the process had
+   // activity (i.e. one of its activity descriptors was readable)
+   void poll(bool hadActivity);
+
+   // descriptors which become readable when the process writes output or
+   // exits (empty before the process is first polled and after it exits)
+   std::vector<int> getActivityFds() const;
+#endif
+
    // has it exited?
    virtual bool exited();
 
@@ -0,0 +1,71 @@
+/*
+ * PosixProcessSnapshot.hpp
+ *
+ * Copyright (C) 2020 by RStudio, PBC
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef CORE_SYSTEM_POSIX_PROCESS_SNAPSHOT_HPP
+#define CORE_SYSTEM_POSIX_PROCESS_SNAPSHOT_HPP
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <boost/date_time/posix_time/posix_time_duration.hpp>
+
+#include <core/system/System.hpp>
+
+namespace rstudio {
+namespace core {
+
+class Error;
+class FilePath;
+
+namespace system {
+
+// A snapshot of the process table read from procfs, indexed by parent
+// process id.
+class ProcessSnapshot
+{
+public:
+   // read the /proc/<pid>/stat files of every process
+   Error read(const FilePath& procFsPath);
+
+   // the child processes of pid
+   std::vector<SubprocInfo> children(PidType pid) const;
+
+   std::size_t size() const { return size_; }
+
+   // parse a /proc/<pid>/stat file (exposed for testing)
+   static bool parseStat(const std::string& contents,
+                         SubprocInfo* pInfo,
+                         PidType* pParentPid);
+
+private:
+   std::unordered_map<PidType, std::vector<SubprocInfo> > children_;
+   std::size_t size_ = 0;
+};
+
+// Return the child processes of pid from a snapshot of the process table
+// shared by every caller, so that however many processes are being polled
+// for subprocesses the process table is read no more often than maxAge.
+// (On systems without procfs, subprocesses are found as getSubprocesses
+// does.)
+std::vector<SubprocInfo> getSubprocessesFromSnapshot(
+                                 PidType pid,
+                                 boost::posix_time::time_duration maxAge);
+
+} // namespace system
+} // namespace core
+} // namespace rstudio
+
+#endif // CORE_SYSTEM_POSIX_PROCESS_SNAPSHOT_HPP
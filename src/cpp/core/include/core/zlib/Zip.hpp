@@ -0,0 +1,132 @@
+/*
+ * Zip.hpp
+ *
+ * Copyright (C) 2020 by RStudio, PBC
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef CORE_ZLIB_ZIP_HPP
+#define CORE_ZLIB_ZIP_HPP
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <boost/function.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/utility.hpp>
+
+#include <shared_core/Error.hpp>
+#include <shared_core/FilePath.hpp>
+
+namespace rstudio {
+namespace core {
+namespace zlib {
+
+// an entry in a zip archive (the names of directories end with '/')
+struct ZipEntry
+{
+   ZipEntry()
+      : versionMadeBy(0), flags(0), method(0), crc(0), compressedSize(0),
+        uncompressedSize(0), externalAttributes(0), offset(0)
+   {
+   }
+
+   bool isDirectory() const
+   {
+      return !name.empty() && name[name.size() - 1] == '/';
+   }
+
+   std::string name;
+   uint16_t versionMadeBy;
+   uint16_t flags;
+   uint16_t method;
+   uint32_t crc;
+   uint64_t compressedSize;
+   uint64_t uncompressedSize;
+   uint32_t externalAttributes;
+
+   // offset of the entry's local header within the archive
+   uint64_t offset;
+};
+
+// Writes a zip archive of files and directories (which are added along with
+// their contents) named relative to a parent directory. The archive is
+// produced incrementally so it can be streamed as it's written: entries are
+// deflated as they're read, their sizes and checksums follow their data, and
+// zip64 records are used for entries and archives larger than 4GB.
+class ZipWriter : boost::noncopyable
+{
+public:
+   ZipWriter(const FilePath& parentPath,
+             const std::vector<std::string>& files,
+             int compressionLevel = 6);
+   ~ZipWriter();
+
+   // appends the next part of the archive (about maxBytes of it) to pData;
+   // nothing is appended once the archive is complete
+   Error read(std::size_t maxBytes, std::string* pData);
+
+   bool finished() const;
+
+   // writes the whole archive to a file
+   Error writeToFile(const FilePath& zipFile);
+
+private:
+   struct Impl;
+   boost::scoped_ptr<Impl> pImpl_;
+};
+
+// Reads the entries of a zip archive (from its central directory) and
+// extracts them. Stored and deflated entries are supported.
+class ZipReader : boost::noncopyable
+{
+public:
+   // called with the number of bytes extracted since the last call; return
+   // false to cancel the extraction
+   typedef boost::function<bool(uint64_t)> ProgressFunction;
+
+   ZipReader();
+   ~ZipReader();
+
+   Error open(const FilePath& zipFile);
+
+   const std::vector<ZipEntry>& entries() const;
+
+   // the total size of the entries once extracted
+   uint64_t uncompressedSize() const;
+
+   // extracts an entry to a file (or for a directory, creates it); a target
+   // which is a symbolic link is an error
+   Error extract(const ZipEntry& entry,
+                 const FilePath& targetPath,
+                 const ProgressFunction& onProgress = ProgressFunction());
+
+private:
+   struct Impl;
+   boost::scoped_ptr<Impl> pImpl_;
+};
+
+// resolves the path an entry extracts to within a directory; names which
+// would resolve outside it (absolute paths, paths with '..' components or
+// paths through an existing symbolic link) are an error. entries naming the
+// directory itself (e.g. "./") resolve to an empty path and are skipped
+// (extracting nothing)
+Error zipEntryPath(const FilePath& destDir,
+                   const std::string& name,
+                   FilePath* pPath);
+
+} // namespace zlib
+} // namespace core
+} // namespace rstudio
+
+#endif // CORE_ZLIB_ZIP_HPP
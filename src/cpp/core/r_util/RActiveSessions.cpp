@@ -15,18 +15,36 @@
 
 #include <core/r_util/RActiveSessions.hpp>
 
+#ifndef _WIN32
+#include <sys/stat.h>
+#endif
+
+#include <algorithm>
+#include <set>
+
 #include <boost/bind.hpp>
 #include <boost/algorithm/string/predicate.hpp>
+#include <boost/algorithm/string/trim.hpp>
 
 #include <core/StringUtils.hpp>
+#include <core/FileLock.hpp>
 #include <core/FileSerializer.hpp>
+#include <core/Thread.hpp>
 
 #include <core/system/System.hpp>
 #include <core/system/FileMonitor.hpp>
 
 #include <core/r_util/RSessionContext.hpp>
 
+#include <shared_core/json/Json.hpp>
+
 #define kSessionDirPrefix "session-"
+#define kMetadataFile "active-sessions.json"
+#define kMetadataLockFile "active-sessions.lock"
+#define kMetadataFilePrefix "active-sessions"
+
+// records when the legacy properties last imported were modified
+#define kLegacyModifiedProperty "legacy-properties-modified"
 
 namespace rstudio {
 namespace core {
@@ -34,68 +52,662 @@ namespace r_util {
 
 namespace {
 
+typedef std::map<std::string, std::string> Properties;
+typedef std::map<std::string, Properties> SessionProperties;
 
-} // anonymous namespace
+// other processes only hold the metadata lock while they rewrite the file,
+// so wait up to 5 seconds for it
+const int kLockAttempts = 500;
+const boost::posix_time::time_duration kLockRetryInterval =
+      boost::posix_time::milliseconds(10);
 
+// the properties of sessions whose directories have been removed are
+// discarded once they haven't been used for this long (sessions are
+// written to the metadata file just before their directories are created)
+const double kOrphanedPropertiesAgeMs = 60 * 60 * 1000;
 
-void ActiveSession::writeProperty(const std::string& name,
-                                 const std::string& value) const
+FilePath metadataFilePath(const FilePath& storagePath)
+{
+   return storagePath.completeChildPath(kMetadataFile);
+}
+
+FilePath sessionScratchPath(const FilePath& storagePath, const std::string& id)
 {
-   FilePath propertyFile = propertiesPath_.completeChildPath(name);
-   Error error = core::writeStringToFile(propertyFile, value);
+   return storagePath.completeChildPath(kSessionDirPrefix + id);
+}
+
+// earlier versions stored each property in a file within this directory of
+// the session's scratch path (and, since they may share the storage with
+// this version, still read them from there)
+FilePath legacyPropertiesPath(const FilePath& scratchPath)
+{
+   return scratchPath.completeChildPath("properites");
+}
+
+// properties which change with every command a session runs are kept only
+// in the per-file layout, where writing one is a single small write, rather
+// than being rewritten into the metadata under its lock (the metadata only
+// records when a session was created, for discarding orphaned properties)
+const char* const kVolatileProperties[] = { "executing", "last-used" };
+
+bool isVolatileProperty(const std::string& name)
+{
+   for (const char* volatileProperty : kVolatileProperties)
+   {
+      if (name == volatileProperty)
+         return true;
+   }
+   return false;
+}
+
+std::string readPropertyFile(const FilePath& scratchPath, const std::string& name)
+{
+   FilePath propertyFile = legacyPropertiesPath(scratchPath).completeChildPath(name);
+   if (!propertyFile.exists())
+      return std::string();
+
+   std::string value;
+   Error error = readStringFromFile(propertyFile, &value);
    if (error)
+   {
       LOG_ERROR(error);
+      return std::string();
+   }
+   return boost::algorithm::trim_copy(value);
 }
 
-std::string ActiveSession::readProperty(const std::string& name) const
+// when a file was last modified, in nanoseconds since the epoch (or 0 if it
+// doesn't exist)
+int64_t modifiedNs(const FilePath& file)
+{
+#ifndef _WIN32
+   struct stat st;
+   if (::stat(file.getAbsolutePath().c_str(), &st) != 0)
+      return 0;
+#ifdef __APPLE__
+   return static_cast<int64_t>(st.st_mtimespec.tv_sec) * 1000000000 + st.st_mtimespec.tv_nsec;
+#else
+   return static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+#endif
+#else
+   if (!file.exists())
+      return 0;
+   return static_cast<int64_t>(file.getLastWriteTime()) * 1000000000;
+#endif
+}
+
+// a session's legacy property files, along with when they were modified
+// (there are none if the session was never written by an earlier version
+// or this one)
+std::vector<std::pair<FilePath, int64_t> > legacyPropertyFiles(const FilePath& scratchPath)
 {
-   using namespace rstudio::core;
-   FilePath readPath = propertiesPath_.completeChildPath(name);
-   if (readPath.exists())
+   std::vector<std::pair<FilePath, int64_t> > files;
+   std::vector<FilePath> children;
+   if (legacyPropertiesPath(scratchPath).getChildren(children))
+      return files;
+
+   for (const FilePath& child : children)
    {
-      std::string value;
-      Error error = core::readStringFromFile(readPath, &value);
+      // (volatile properties are read from their files directly)
+      if (!isVolatileProperty(child.getFilename()))
+         files.push_back(std::make_pair(child, modifiedNs(child)));
+   }
+   return files;
+}
+
+std::string propertyOf(const Properties& properties, const std::string& name)
+{
+   Properties::const_iterator it = properties.find(name);
+   if (it != properties.end())
+      return it->second;
+   else
+      return std::string();
+}
+
+bool boolPropertyOf(const Properties& properties, const std::string& name)
+{
+   std::string value = propertyOf(properties, name);
+   if (!value.empty())
+      return safe_convert::stringTo<bool>(value, false);
+   else
+      return false;
+}
+
+double timestampPropertyOf(const Properties& properties, const std::string& name)
+{
+   std::string value = propertyOf(properties, name);
+   if (!value.empty())
+      return safe_convert::stringTo<double>(value, 0);
+   else
+      return 0;
+}
+
+// whether any of a session's legacy property files have been modified (by
+// an earlier version) since they were last imported
+bool legacyPropertiesChanged(const FilePath& scratchPath, const Properties& properties)
+{
+   int64_t imported = safe_convert::stringTo<int64_t>(
+            propertyOf(properties, kLegacyModifiedProperty), 0);
+   for (const std::pair<FilePath, int64_t>& file : legacyPropertyFiles(scratchPath))
+   {
+      if (file.second > imported)
+         return true;
+   }
+   return false;
+}
+
+// identifies a version of the metadata file; the file is replaced (by
+// renaming a new file over it) whenever it's written, so on posix its inode
+// changes along with its modified time
+struct MetadataStamp
+{
+   MetadataStamp() : exists(false), modified(0), modifiedNs(0), size(0), id(0) {}
+
+   bool operator==(const MetadataStamp& other) const
+   {
+      return exists == other.exists &&
+             modified == other.modified &&
+             modifiedNs == other.modifiedNs &&
+             size == other.size &&
+             id == other.id;
+   }
+
+   bool exists;
+   std::time_t modified;
+   long modifiedNs;
+   uintmax_t size;
+   uintmax_t id;
+};
+
+MetadataStamp readStamp(const FilePath& metadataFile)
+{
+   MetadataStamp stamp;
+#ifndef _WIN32
+   struct stat st;
+   if (::stat(metadataFile.getAbsolutePath().c_str(), &st) == 0)
+   {
+      stamp.exists = true;
+      stamp.modified = st.st_mtime;
+#ifdef __APPLE__
+      stamp.modifiedNs = st.st_mtimespec.tv_nsec;
+#else
+      stamp.modifiedNs = st.st_mtim.tv_nsec;
+#endif
+      stamp.size = st.st_size;
+      stamp.id = st.st_ino;
+   }
+#else
+   if (metadataFile.exists())
+   {
+      stamp.exists = true;
+      stamp.modified = metadataFile.getLastWriteTime();
+      stamp.size = metadataFile.getSize();
+   }
+#endif
+   return stamp;
+}
+
+Error readMetadataFile(const FilePath& metadataFile, SessionProperties* pSessions)
+{
+   pSessions->clear();
+   if (!metadataFile.exists())
+      return Success();
+
+   std::string contents;
+   Error error = readStringFromFile(metadataFile, &contents);
+   if (error)
+      return error;
+
+   json::Value metadata;
+   error = metadata.parse(contents);
+   if (error)
+      return error;
+
+   if (!metadata.isObject())
+   {
+      error = systemError(boost::system::errc::protocol_error,
+                          "Invalid active session metadata",
+                          ERROR_LOCATION);
+      error.addProperty("path", metadataFile.getAbsolutePath());
+      return error;
+   }
+
+   // (iterators refer to the object they came from, so keep it)
+   json::Object metadataObject = metadata.getObject();
+   json::Object::Iterator sessionsIt = metadataObject.find("sessions");
+   if (sessionsIt == metadataObject.end() || !(*sessionsIt).getValue().isObject())
+      return Success();
+
+   json::Object sessions = (*sessionsIt).getValue().getObject();
+   for (const json::Object::Member& session : sessions)
+   {
+      if (!session.getValue().isObject())
+         continue;
+
+      Properties& properties = (*pSessions)[session.getName()];
+      for (const json::Object::Member& property : session.getValue().getObject())
+      {
+         if (property.getValue().isString())
+            properties[property.getName()] = property.getValue().getString();
+      }
+   }
+
+   return Success();
+}
+
+Error writeMetadataFile(const FilePath& metadataFile, const SessionProperties& sessions)
+{
+   json::Object sessionsJson;
+   for (const SessionProperties::value_type& session : sessions)
+   {
+      json::Object propertiesJson;
+      for (const Properties::value_type& property : session.second)
+         propertiesJson[property.first] = property.second;
+      sessionsJson[session.first] = propertiesJson;
+   }
+
+   json::Object metadata;
+   metadata["version"] = 1;
+   metadata["sessions"] = sessionsJson;
+
+   // write a new file and rename it over the old one (so readers, which
+   // don't take the lock, never see a partially written file)
+   FilePath tempFile = metadataFile.getParent().completeChildPath(
+                                       metadataFile.getFilename() + ".tmp");
+   Error error = writeStringToFile(tempFile, metadata.write());
+   if (error)
+      return error;
+
+   return tempFile.move(metadataFile);
+}
+
+// the most recently read version of each metadata file (keyed by path)
+struct CachedMetadata
+{
+   MetadataStamp stamp;
+   boost::shared_ptr<const SessionProperties> pSessions;
+};
+
+boost::mutex s_cacheMutex;
+std::map<std::string, CachedMetadata> s_metadataCache;
+
+// serializes updates within this process (file locks may not)
+boost::mutex s_updateMutex;
+
+void cacheMetadata(const FilePath& metadataFile,
+                   const MetadataStamp& stamp,
+                   const boost::shared_ptr<const SessionProperties>& pSessions)
+{
+   LOCK_MUTEX(s_cacheMutex)
+   {
+      CachedMetadata& cached = s_metadataCache[metadataFile.getAbsolutePath()];
+      cached.stamp = stamp;
+      cached.pSessions = pSessions;
+   }
+   END_LOCK_MUTEX
+}
+
+boost::shared_ptr<const SessionProperties> loadMetadata(const FilePath& storagePath)
+{
+   FilePath metadataFile = metadataFilePath(storagePath);
+   MetadataStamp stamp = readStamp(metadataFile);
+
+   LOCK_MUTEX(s_cacheMutex)
+   {
+      std::map<std::string, CachedMetadata>::const_iterator it =
+                              s_metadataCache.find(metadataFile.getAbsolutePath());
+      if (it != s_metadataCache.end() && it->second.stamp == stamp)
+         return it->second.pSessions;
+   }
+   END_LOCK_MUTEX
+
+   boost::shared_ptr<SessionProperties> pSessions(new SessionProperties());
+   Error error = readMetadataFile(metadataFile, pSessions.get());
+   if (error)
+      LOG_ERROR(error);
+   else
+      cacheMetadata(metadataFile, stamp, pSessions);
+
+   return pSessions;
+}
+
+Error acquireMetadataLock(FileLock& lock, const FilePath& lockFilePath)
+{
+   Error error;
+   for (int i = 0; i < kLockAttempts; i++)
+   {
+      error = lock.acquire(lockFilePath);
+      if (!error || !FileLock::isNoLockAvailable(error))
+         return error;
+
+      boost::this_thread::sleep(kLockRetryInterval);
+   }
+   return error;
+}
+
+// applies a change to the metadata file (reading the current version of it
+// while holding its lock, so concurrent changes aren't lost)
+Error updateMetadata(const FilePath& storagePath,
+                     const boost::function<void(SessionProperties*)>& update)
+{
+   FilePath metadataFile = metadataFilePath(storagePath);
+
+   LOCK_MUTEX(s_updateMutex)
+   {
+      boost::shared_ptr<FileLock> pLock = FileLock::createDefault();
+      Error error = acquireMetadataLock(
+               *pLock, storagePath.completeChildPath(kMetadataLockFile));
+      if (error)
+         return error;
+
+      boost::shared_ptr<SessionProperties> pSessions(new SessionProperties());
+      error = readMetadataFile(metadataFile, pSessions.get());
       if (error)
       {
+         // the file is unusable; it will be replaced
          LOG_ERROR(error);
-         return std::string();
       }
-      return boost::algorithm::trim_copy(value);
+
+      update(pSessions.get());
+
+      error = writeMetadataFile(metadataFile, *pSessions);
+      MetadataStamp stamp = readStamp(metadataFile);
+
+      Error releaseError = pLock->release();
+      if (releaseError)
+         LOG_ERROR(releaseError);
+
+      if (error)
+         return error;
+
+      cacheMetadata(metadataFile, stamp, pSessions);
+   }
+   END_LOCK_MUTEX
+
+   return Success();
+}
+
+// copies the legacy properties which have been modified since they were
+// last imported (all of them, for sessions not yet in the metadata) into
+// the metadata
+void importLegacyProperties(const FilePath& storagePath,
+                            const std::vector<std::string>& ids,
+                            SessionProperties* pSessions)
+{
+   for (const std::string& id : ids)
+   {
+      std::vector<std::pair<FilePath, int64_t> > propertyFiles =
+            legacyPropertyFiles(sessionScratchPath(storagePath, id));
+      if (propertyFiles.empty())
+         continue;
+
+      Properties& properties = (*pSessions)[id];
+      int64_t imported = safe_convert::stringTo<int64_t>(
+               propertyOf(properties, kLegacyModifiedProperty), 0);
+      int64_t modified = imported;
+      for (const std::pair<FilePath, int64_t>& propertyFile : propertyFiles)
+      {
+         if (propertyFile.second <= imported)
+            continue;
+
+         std::string value;
+         Error error = readStringFromFile(propertyFile.first, &value);
+         if (error)
+         {
+            LOG_ERROR(error);
+            continue;
+         }
+
+         properties[propertyFile.first.getFilename()] = boost::algorithm::trim_copy(value);
+         modified = std::max(modified, propertyFile.second);
+      }
+
+      properties[kLegacyModifiedProperty] = safe_convert::numberToString(modified);
    }
-   else
+}
+
+// keeps the properties earlier versions read up to date (they're written
+// before the metadata, which then records them as imported; the metadata
+// remains the source of truth for this version, except for properties an
+// earlier version writes later)
+void writeLegacyProperties(const FilePath& scratchPath, const Properties& properties)
+{
+   if (properties.empty())
+      return;
+
+   FilePath propertiesPath = legacyPropertiesPath(scratchPath);
+   Error error = propertiesPath.ensureDirectory();
+   if (error)
    {
-      return std::string();
+      LOG_ERROR(error);
+      return;
+   }
+
+   for (const Properties::value_type& property : properties)
+   {
+      error = writeStringToFile(propertiesPath.completeChildPath(property.first),
+                                property.second);
+      if (error)
+         LOG_ERROR(error);
    }
 }
 
+// copies the properties of sessions created (or since written) by earlier
+// versions into the metadata file (leaving them in place for those versions)
+Error migrateLegacyProperties(const FilePath& storagePath,
+                              const std::vector<std::string>& ids)
+{
+   return updateMetadata(storagePath,
+                         boost::bind(importLegacyProperties, storagePath, ids, _1));
+}
+
+Properties sessionProperties(const FilePath& storagePath, const std::string& id)
+{
+   boost::shared_ptr<const SessionProperties> pSessions = loadMetadata(storagePath);
+   FilePath scratchPath = sessionScratchPath(storagePath, id);
+   SessionProperties::const_iterator it = pSessions->find(id);
+   if (it != pSessions->end() && !legacyPropertiesChanged(scratchPath, it->second))
+      return it->second;
+
+   if (legacyPropertiesPath(scratchPath).exists())
+   {
+      Error error = migrateLegacyProperties(storagePath, std::vector<std::string>(1, id));
+      if (error)
+         LOG_ERROR(error);
+
+      pSessions = loadMetadata(storagePath);
+      it = pSessions->find(id);
+      if (it != pSessions->end())
+         return it->second;
+   }
+
+   return Properties();
+}
+
+// overlays a session's volatile properties on the rest of its properties
+void readVolatileProperties(const FilePath& scratchPath, Properties* pProperties)
+{
+   for (const char* name : kVolatileProperties)
+   {
+      std::string value = readPropertyFile(scratchPath, name);
+      if (!value.empty())
+         (*pProperties)[name] = value;
+   }
+}
+
+bool validateProperties(const Properties& properties,
+                        const FilePath& userHomePath,
+                        bool projectSharingEnabled)
+{
+   // ensure the properties are there
+   std::string project = propertyOf(properties, "project");
+   if (project.empty() ||
+       propertyOf(properties, "working-dir").empty() ||
+       timestampPropertyOf(properties, "last-used") == 0)
+   {
+      return false;
+   }
+
+   // for projects validate that the base directory still exists
+   if (project != kProjectNone)
+   {
+      FilePath projectDir = FilePath::resolveAliasedPath(project, userHomePath);
+      if (!projectDir.exists())
+         return false;
+
+      // check for project file
+      FilePath projectPath = r_util::projectFromDirectory(projectDir);
+      if (!projectPath.exists())
+         return false;
+
+      // if we got this far the scope is valid, do one final check for
+      // trying to open a shared project if sharing is disabled
+      if (!projectSharingEnabled &&
+          r_util::isSharedPath(projectPath.getAbsolutePath(), userHomePath))
+         return false;
+   }
+
+   // validated!
+   return true;
+}
+
+void setProperties(const FilePath& storagePath,
+                   const std::string& id,
+                   const Properties& properties,
+                   SessionProperties* pSessions)
+{
+   importLegacyProperties(storagePath, std::vector<std::string>(1, id), pSessions);
+
+   Properties& sessionProperties = (*pSessions)[id];
+   for (const Properties::value_type& property : properties)
+      sessionProperties[property.first] = property.second;
+}
+
+void eraseSessions(const std::vector<std::string>& ids, SessionProperties* pSessions)
+{
+   for (const std::string& id : ids)
+      pSessions->erase(id);
+}
+
+} // anonymous namespace
+
+
+void ActiveSession::writeProperty(const std::string& name,
+                                 const std::string& value) const
+{
+   std::map<std::string, std::string> properties;
+   properties[name] = value;
+   writeProperties(properties);
+}
+
+void ActiveSession::writeProperties(
+                     const std::map<std::string, std::string>& properties) const
+{
+   FilePath storagePath = scratchPath_.getParent();
+
+   Properties volatileProperties;
+   Properties otherProperties;
+   for (const Properties::value_type& property : properties)
+   {
+      if (isVolatileProperty(property.first))
+         volatileProperties.insert(property);
+      else
+         otherProperties.insert(property);
+   }
+   writeLegacyProperties(scratchPath_, volatileProperties);
+   if (otherProperties.empty())
+      return;
+
+   // the metadata is only updated if a property has changed
+   Properties current = sessionProperties(storagePath, id_);
+   Properties changedProperties;
+   for (const Properties::value_type& property : otherProperties)
+   {
+      Properties::const_iterator it = current.find(property.first);
+      if (it == current.end() || it->second != property.second)
+         changedProperties.insert(property);
+   }
+   if (changedProperties.empty())
+      return;
+
+   writeLegacyProperties(scratchPath_, changedProperties);
+   Error error = updateMetadata(storagePath,
+                                boost::bind(setProperties, storagePath, id_, changedProperties, _1));
+   if (error)
+      LOG_ERROR(error);
+}
+
+std::string ActiveSession::readProperty(const std::string& name) const
+{
+   Properties properties = sessionProperties(scratchPath_.getParent(), id_);
+   if (isVolatileProperty(name))
+      readVolatileProperties(scratchPath_, &properties);
+   return propertyOf(properties, name);
+}
+
+Error ActiveSession::destroy()
+{
+   if (empty())
+      return Success();
+
+   Error error = updateMetadata(scratchPath_.getParent(),
+                                boost::bind(eraseSessions,
+                                            std::vector<std::string>(1, id_),
+                                            _1));
+   if (error)
+      LOG_ERROR(error);
+
+   return scratchPath_.removeIfExists();
+}
+
+bool ActiveSession::validate(const FilePath& userHomePath,
+                             bool projectSharingEnabled) const
+{
+   // ensure the scratch path exists
+   if (!scratchPath_.exists())
+      return false;
+
+   Properties properties = sessionProperties(scratchPath_.getParent(), id_);
+   readVolatileProperties(scratchPath_, &properties);
+   return validateProperties(properties, userHomePath, projectSharingEnabled);
+}
+
 Error ActiveSessions::create(const std::string& project,
                              const std::string& workingDir,
                              bool initial,
                              std::string* pId) const
 {
    // generate a new id (loop until we find a unique one)
+   boost::shared_ptr<const SessionProperties> pSessions = loadMetadata(storagePath_);
    std::string id;
    FilePath dir;
    while (id.empty())
    {
       std::string candidateId = core::r_util::generateScopeId();
-      dir = storagePath_.completeChildPath(kSessionDirPrefix + candidateId);
-      if (!dir.exists())
+      dir = sessionScratchPath(storagePath_, candidateId);
+      if (!dir.exists() && !pSessions->count(candidateId))
          id = candidateId;
    }
 
+   // write initial settings (before creating the directory, so that the
+   // session is never listed without them)
+   Properties properties;
+   properties["project"] = project;
+   properties["working-dir"] = workingDir;
+   properties["initial"] = safe_convert::numberToString(initial);
+   properties["last-used"] = ActiveSession::timestampNow();
+   properties["running"] = safe_convert::numberToString(false);
+   Error error = updateMetadata(storagePath_,
+                                boost::bind(setProperties, storagePath_, id, properties, _1));
+   if (error)
+      return error;
+
    // create the directory
-   Error error = dir.ensureDirectory();
+   error = dir.ensureDirectory();
    if (error)
       return error;
 
-   // write initial settings
-   ActiveSession activeSession(id, dir);
-   activeSession.setProject(project);
-   activeSession.setWorkingDir(workingDir);
-   activeSession.setInitial(initial);
-   activeSession.setLastUsed();
-   activeSession.setRunning(false);
+   writeLegacyProperties(dir, properties);
 
    // return the id if requested
    if (pId != nullptr)
@@ -107,30 +719,46 @@ Error ActiveSessions::create(const std::string& project,
 
 namespace {
 
-bool compareActivityLevel(boost::shared_ptr<ActiveSession> a,
-                          boost::shared_ptr<ActiveSession> b)
+struct SessionActivity
+{
+   SessionActivity(const boost::shared_ptr<ActiveSession>& pSession,
+                   const Properties& properties)
+      : pSession(pSession),
+        executing(boolPropertyOf(properties, "executing")),
+        running(boolPropertyOf(properties, "running")),
+        lastUsed(timestampPropertyOf(properties, "last-used"))
+   {
+   }
+
+   boost::shared_ptr<ActiveSession> pSession;
+   bool executing;
+   bool running;
+   double lastUsed;
+};
+
+bool compareActivityLevel(const SessionActivity& a, const SessionActivity& b)
 {
-   if (a->executing() == b->executing())
+   if (a.executing == b.executing)
    {
-      if (a->running() == b->running())
+      if (a.running == b.running)
       {
-         if (a->lastUsed() == b->lastUsed())
+         if (a.lastUsed == b.lastUsed)
          {
-            return a->id() > b->id();
+            return a.pSession->id() > b.pSession->id();
          }
          else
          {
-            return a->lastUsed() > b->lastUsed();
+            return a.lastUsed > b.lastUsed;
          }
       }
       else
       {
-         return a->running();
+         return a.running;
       }
    }
    else
    {
-      return a->executing();
+      return a.executing;
    }
 }
 
@@ -151,36 +779,91 @@ std::vector<boost::shared_ptr<ActiveSession> > ActiveSessions::list(
       LOG_ERROR(error);
       return sessions;
    }
+
+   // read the properties of all of the sessions at once
+   boost::shared_ptr<const SessionProperties> pSessions = loadMetadata(storagePath_);
+
+   std::set<std::string> ids;
+   std::vector<std::string> legacyIds;
    std::string prefix = kSessionDirPrefix;
    for (const FilePath& child : children)
    {
-      if (boost::algorithm::starts_with(child.getFilename(), prefix))
+      if (boost::algorithm::starts_with(child.getFilename(), prefix) &&
+          child.isDirectory())
       {
          std::string id = child.getFilename().substr(prefix.length());
-         boost::shared_ptr<ActiveSession> pSession = get(id);
-         if (!pSession->empty())
-         {
-            if (pSession->validate(userHomePath, projectSharingEnabled))
-            {
-               sessions.push_back(pSession);
-            }
-            else
-            {
-               // remove sessions that don't have required properties
-               // (they may be here as a result of a race condition where
-               // they are removed but then suspended session data is
-               // written back into them)
-               Error error = pSession->destroy();
-               if (error)
-                  LOG_ERROR(error);
-            }
-         }
+         ids.insert(id);
+
+         SessionProperties::const_iterator it = pSessions->find(id);
+         bool changed = it != pSessions->end() ?
+                  legacyPropertiesChanged(child, it->second) :
+                  legacyPropertiesPath(child).exists();
+         if (changed)
+            legacyIds.push_back(id);
+      }
+   }
+
+   if (!legacyIds.empty())
+   {
+      error = migrateLegacyProperties(storagePath_, legacyIds);
+      if (error)
+         LOG_ERROR(error);
+      pSessions = loadMetadata(storagePath_);
+   }
+
+   std::vector<SessionActivity> activity;
+   for (const std::string& id : ids)
+   {
+      SessionProperties::const_iterator it = pSessions->find(id);
+      if (it == pSessions->end() &&
+          legacyPropertiesPath(sessionScratchPath(storagePath_, id)).exists())
+      {
+         // the properties couldn't be migrated; leave the session be until
+         // they can
+         continue;
       }
+      Properties properties = it != pSessions->end() ? it->second : Properties();
+      readVolatileProperties(sessionScratchPath(storagePath_, id), &properties);
 
+      boost::shared_ptr<ActiveSession> pSession = get(id);
+      if (validateProperties(properties, userHomePath, projectSharingEnabled))
+      {
+         activity.push_back(SessionActivity(pSession, properties));
+      }
+      else
+      {
+         // remove sessions that don't have required properties
+         // (they may be here as a result of a race condition where
+         // they are removed but then suspended session data is
+         // written back into them)
+         Error error = pSession->destroy();
+         if (error)
+            LOG_ERROR(error);
+      }
+   }
+
+   // discard the properties of sessions whose directories are gone
+   std::vector<std::string> orphanedIds;
+   double now = date_time::millisecondsSinceEpoch();
+   for (const SessionProperties::value_type& session : *pSessions)
+   {
+      if (!ids.count(session.first) &&
+          now - timestampPropertyOf(session.second, "last-used") > kOrphanedPropertiesAgeMs)
+      {
+         orphanedIds.push_back(session.first);
+      }
+   }
+   if (!orphanedIds.empty())
+   {
+      error = updateMetadata(storagePath_, boost::bind(eraseSessions, orphanedIds, _1));
+      if (error)
+         LOG_ERROR(error);
    }
 
    // sort by activity level (most active sessions first)
-   std::sort(sessions.begin(), sessions.end(), compareActivityLevel);
+   std::sort(activity.begin(), activity.end(), compareActivityLevel);
+   for (const SessionActivity& session : activity)
+      sessions.push_back(session.pSession);
 
    // return
    return sessions;
@@ -194,7 +877,7 @@ size_t ActiveSessions::count(const FilePath& userHomePath,
 
 boost::shared_ptr<ActiveSession> ActiveSessions::get(const std::string& id) const
 {
-   FilePath scratchPath = storagePath_.completeChildPath(kSessionDirPrefix + id);
+   FilePath scratchPath = sessionScratchPath(storagePath_, id);
    if (scratchPath.exists())
       return boost::shared_ptr<ActiveSession>(new ActiveSession(id,
                                                                 scratchPath));
@@ -248,6 +931,14 @@ GlobalActiveSessions::get(const std::string& id) const
 
 namespace {
 
+// the metadata file changes whenever a property does; only the session
+// directories coming and going change the count
+bool isSessionDirectory(const FileInfo& fileInfo)
+{
+   return !boost::algorithm::starts_with(
+            FilePath(fileInfo.absolutePath()).getFilename(), kMetadataFilePrefix);
+}
+
 void notifyCountChanged(boost::shared_ptr<ActiveSessions> pSessions,
                         const FilePath& userHomePath,
                         bool projectSharingEnabled,
@@ -283,7 +974,7 @@ void trackActiveSessionCount(const FilePath& rootStoragePath,
    core::system::file_monitor::registerMonitor(
                    pSessions->storagePath(),
                    false,
-                   boost::function<bool(const FileInfo&)>(),
+                   isSessionDirectory,
                    cb);
 }
 
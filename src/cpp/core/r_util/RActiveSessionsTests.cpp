@@ -0,0 +1,320 @@
+/*
+ * RActiveSessionsTests.cpp
+ *
+ * Copyright (C) 2020 by RStudio, PBC
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include <boost/thread.hpp>
+#include <boost/algorithm/string/replace.hpp>
+
+#include <core/FileLock.hpp>
+#include <core/FileSerializer.hpp>
+#include <core/r_util/RActiveSessions.hpp>
+
+#include <tests/TestThat.hpp>
+
+namespace rstudio {
+namespace core {
+namespace r_util {
+namespace tests {
+
+namespace {
+
+FilePath createTempDir()
+{
+   FilePath dir;
+   Error error = FilePath::tempFilePath(dir);
+   if (!error)
+      error = dir.ensureDirectory();
+   REQUIRE_FALSE(error);
+   return dir;
+}
+
+std::vector<std::string> idsOf(const std::vector<boost::shared_ptr<ActiveSession> >& sessions)
+{
+   std::vector<std::string> ids;
+   for (const boost::shared_ptr<ActiveSession>& pSession : sessions)
+      ids.push_back(pSession->id());
+   return ids;
+}
+
+} // anonymous namespace
+
+test_context("RActiveSessions")
+{
+   FileLock::initialize();
+
+   FilePath homePath = createTempDir();
+
+   test_that("Sessions are listed with their properties")
+   {
+      FilePath rootPath = createTempDir();
+      ActiveSessions activeSessions(rootPath);
+
+      std::string first, second, third;
+      REQUIRE_FALSE(activeSessions.create(kProjectNone, "~/first", &first));
+      REQUIRE_FALSE(activeSessions.create(kProjectNone, "~/second", &second));
+      REQUIRE_FALSE(activeSessions.create(kProjectNone, "~/third", false, &third));
+
+      activeSessions.get(second)->beginSession("4.0.2", "/opt/R/4.0.2", "R 4.0.2");
+      activeSessions.get(third)->setExecuting(true);
+
+      std::vector<boost::shared_ptr<ActiveSession> > sessions =
+            activeSessions.list(homePath, false);
+      REQUIRE(sessions.size() == 3);
+
+      // executing sessions first, then running ones
+      expect_true(sessions[0]->id() == third);
+      expect_true(sessions[1]->id() == second);
+      expect_true(sessions[2]->id() == first);
+
+      expect_true(sessions[0]->workingDir() == "~/third");
+      expect_false(sessions[0]->initial());
+      expect_true(sessions[1]->running());
+      expect_true(sessions[1]->rVersion() == "4.0.2");
+      expect_true(sessions[1]->rVersionHome() == "/opt/R/4.0.2");
+      expect_true(sessions[1]->rVersionLabel() == "R 4.0.2");
+      expect_true(sessions[2]->project() == kProjectNone);
+      expect_true(sessions[2]->initial());
+      expect_true(sessions[2]->lastUsed() > 0);
+
+      // the properties of all sessions are kept in one file, and copied to
+      // the files earlier versions read them from
+      FilePath metadataFile = activeSessions.storagePath().completeChildPath("active-sessions.json");
+      std::string metadata;
+      REQUIRE_FALSE(readStringFromFile(metadataFile, &metadata));
+      expect_true(metadata.find("/opt/R/4.0.2") != std::string::npos);
+
+      std::string legacyValue;
+      FilePath legacyPath = sessions[1]->scratchPath().completeChildPath("properites");
+      REQUIRE_FALSE(readStringFromFile(legacyPath.completeChildPath("r-version-home"), &legacyValue));
+      expect_true(legacyValue == "/opt/R/4.0.2");
+      REQUIRE_FALSE(readStringFromFile(legacyPath.completeChildPath("working-dir"), &legacyValue));
+      expect_true(legacyValue == "~/second");
+
+      sessions[1]->endSession();
+      expect_false(sessions[1]->running());
+      expect_false(sessions[1]->executing());
+
+      rootPath.removeIfExists();
+   }
+
+   test_that("Destroyed and incomplete sessions aren't listed")
+   {
+      FilePath rootPath = createTempDir();
+      ActiveSessions activeSessions(rootPath);
+
+      std::string kept, destroyed;
+      REQUIRE_FALSE(activeSessions.create(kProjectNone, "~", &kept));
+      REQUIRE_FALSE(activeSessions.create(kProjectNone, "~", &destroyed));
+      REQUIRE_FALSE(activeSessions.get(destroyed)->destroy());
+      expect_true(activeSessions.get(destroyed)->empty());
+
+      // a directory without properties (e.g. recreated by a suspend racing
+      // with the session's removal)
+      FilePath incompletePath = activeSessions.storagePath().completeChildPath("session-1234abcd");
+      REQUIRE_FALSE(incompletePath.completeChildPath("suspended-session-data").ensureDirectory());
+
+      std::vector<std::string> ids = idsOf(activeSessions.list(homePath, false));
+      expect_true(ids == std::vector<std::string>(1, kept));
+      expect_false(incompletePath.exists());
+
+      rootPath.removeIfExists();
+   }
+
+   test_that("Sessions stored one property per file are migrated")
+   {
+      FilePath rootPath = createTempDir();
+      ActiveSessions activeSessions(rootPath);
+
+      std::string current;
+      REQUIRE_FALSE(activeSessions.create(kProjectNone, "~", &current));
+
+      FilePath legacyPath = activeSessions.storagePath().completeChildPath("session-9f8e7d6c");
+      FilePath propertiesPath = legacyPath.completeChildPath("properites");
+      REQUIRE_FALSE(propertiesPath.ensureDirectory());
+      REQUIRE_FALSE(writeStringToFile(propertiesPath.completeChildPath("project"), kProjectNone));
+      REQUIRE_FALSE(writeStringToFile(propertiesPath.completeChildPath("working-dir"), "~/legacy\n"));
+      REQUIRE_FALSE(writeStringToFile(propertiesPath.completeChildPath("last-used"), "1600000000000"));
+      REQUIRE_FALSE(writeStringToFile(propertiesPath.completeChildPath("label"), "analysis"));
+
+      std::vector<boost::shared_ptr<ActiveSession> > sessions =
+            activeSessions.list(homePath, false);
+      REQUIRE(sessions.size() == 2);
+      expect_true(sessions[1]->id() == "9f8e7d6c");
+      expect_true(sessions[1]->workingDir() == "~/legacy");
+      expect_true(sessions[1]->label() == "analysis");
+      expect_true(sessions[1]->lastUsed() == 1600000000000.0);
+
+      // the legacy properties are left for earlier versions, and kept up to date
+      expect_true(propertiesPath.exists());
+      sessions[1]->setLabel("renamed");
+      expect_true(sessions[1]->label() == "renamed");
+      std::string legacyLabel;
+      REQUIRE_FALSE(readStringFromFile(propertiesPath.completeChildPath("label"), &legacyLabel));
+      expect_true(legacyLabel == "renamed");
+
+      // sessions read directly are migrated too
+      FilePath otherPath = activeSessions.storagePath().completeChildPath("session-0a1b2c3d/properites");
+      REQUIRE_FALSE(otherPath.ensureDirectory());
+      REQUIRE_FALSE(writeStringToFile(otherPath.completeChildPath("label"), "other"));
+      expect_true(activeSessions.get("0a1b2c3d")->label() == "other");
+      expect_true(otherPath.exists());
+
+      rootPath.removeIfExists();
+   }
+
+   test_that("Properties written by earlier versions after migration are read")
+   {
+      FilePath rootPath = createTempDir();
+      ActiveSessions activeSessions(rootPath);
+
+      FilePath legacyPath = activeSessions.storagePath().completeChildPath("session-5e6f7a8b");
+      FilePath propertiesPath = legacyPath.completeChildPath("properites");
+      REQUIRE_FALSE(propertiesPath.ensureDirectory());
+      REQUIRE_FALSE(writeStringToFile(propertiesPath.completeChildPath("project"), kProjectNone));
+      REQUIRE_FALSE(writeStringToFile(propertiesPath.completeChildPath("working-dir"), "~/legacy"));
+      REQUIRE_FALSE(writeStringToFile(propertiesPath.completeChildPath("last-used"), "1600000000000"));
+      REQUIRE_FALSE(writeStringToFile(propertiesPath.completeChildPath("label"), "analysis"));
+
+      std::vector<boost::shared_ptr<ActiveSession> > sessions =
+            activeSessions.list(homePath, false);
+      REQUIRE(sessions.size() == 1);
+      expect_true(sessions[0]->label() == "analysis");
+
+      // (file times are only so precise)
+      boost::this_thread::sleep(boost::posix_time::milliseconds(50));
+      REQUIRE_FALSE(writeStringToFile(propertiesPath.completeChildPath("label"), "renamed\n"));
+      expect_true(sessions[0]->label() == "renamed");
+      expect_true(sessions[0]->workingDir() == "~/legacy");
+
+      boost::this_thread::sleep(boost::posix_time::milliseconds(50));
+      REQUIRE_FALSE(writeStringToFile(propertiesPath.completeChildPath("working-dir"), "~/moved"));
+      sessions = activeSessions.list(homePath, false);
+      REQUIRE(sessions.size() == 1);
+      expect_true(sessions[0]->workingDir() == "~/moved");
+      expect_true(sessions[0]->label() == "renamed");
+
+      std::string metadata;
+      REQUIRE_FALSE(readStringFromFile(activeSessions.storagePath().completeChildPath("active-sessions.json"),
+                                       &metadata));
+      expect_true(metadata.find("~/moved") != std::string::npos);
+
+      // and changes made by this version are kept, not overwritten by the
+      // legacy files it writes
+      sessions[0]->setLabel("ours");
+      expect_true(sessions[0]->label() == "ours");
+      expect_true(activeSessions.list(homePath, false)[0]->label() == "ours");
+
+      rootPath.removeIfExists();
+   }
+
+   test_that("Volatile and unchanged properties don't rewrite the metadata")
+   {
+      FilePath rootPath = createTempDir();
+      ActiveSessions activeSessions(rootPath);
+
+      std::string id;
+      REQUIRE_FALSE(activeSessions.create(kProjectNone, "~", &id));
+      boost::shared_ptr<ActiveSession> pSession = activeSessions.get(id);
+      pSession->setLabel("analysis");
+
+      // mark the metadata file, so we can tell if it's rewritten
+      FilePath metadataFile = activeSessions.storagePath().completeChildPath("active-sessions.json");
+      std::string contents;
+      REQUIRE_FALSE(readStringFromFile(metadataFile, &contents));
+      REQUIRE_FALSE(writeStringToFile(metadataFile, contents + "\n"));
+
+      pSession->setLabel("analysis");
+      pSession->setExecuting(true);
+      pSession->setLastUsed();
+
+      std::string written;
+      REQUIRE_FALSE(readStringFromFile(metadataFile, &written));
+      expect_true(written == contents + "\n");
+
+      expect_true(pSession->executing());
+      expect_true(activeSessions.get(id)->executing());
+      std::vector<boost::shared_ptr<ActiveSession> > sessions =
+            activeSessions.list(homePath, false);
+      REQUIRE(sessions.size() == 1);
+      expect_true(sessions[0]->executing());
+
+      pSession->setExecuting(false);
+      expect_false(pSession->executing());
+
+      // changed properties are still written
+      pSession->setLabel("renamed");
+      REQUIRE_FALSE(readStringFromFile(metadataFile, &written));
+      expect_true(written.find("renamed") != std::string::npos);
+
+      rootPath.removeIfExists();
+   }
+
+   test_that("Changes made by other processes are read")
+   {
+      FilePath rootPath = createTempDir();
+      ActiveSessions activeSessions(rootPath);
+
+      std::string id;
+      REQUIRE_FALSE(activeSessions.create(kProjectNone, "~", &id));
+      boost::shared_ptr<ActiveSession> pSession = activeSessions.get(id);
+      pSession->setLabel("before");
+      expect_true(pSession->label() == "before");
+
+      FilePath metadataFile = activeSessions.storagePath().completeChildPath("active-sessions.json");
+      std::string contents;
+      REQUIRE_FALSE(readStringFromFile(metadataFile, &contents));
+      boost::algorithm::replace_first(contents, "\"before\"", "\"after!\"");
+
+      FilePath tempFile = metadataFile.getParent().completeChildPath("replacement");
+      REQUIRE_FALSE(writeStringToFile(tempFile, contents));
+      REQUIRE_FALSE(tempFile.move(metadataFile));
+      expect_true(pSession->label() == "after!");
+
+      rootPath.removeIfExists();
+   }
+
+   test_that("Concurrent updates aren't lost")
+   {
+      FilePath rootPath = createTempDir();
+      ActiveSessions activeSessions(rootPath);
+
+      std::vector<std::string> ids(8);
+      for (std::string& id : ids)
+         REQUIRE_FALSE(activeSessions.create(kProjectNone, "~", &id));
+
+      boost::thread_group threads;
+      for (const std::string& id : ids)
+      {
+         threads.create_thread([&activeSessions, id]()
+         {
+            boost::shared_ptr<ActiveSession> pSession = activeSessions.get(id);
+            for (int i = 0; i < 10; i++)
+               pSession->setLabel("label-" + id + "-" + std::to_string(i));
+         });
+      }
+      threads.join_all();
+
+      for (const std::string& id : ids)
+         expect_true(activeSessions.get(id)->label() == "label-" + id + "-9");
+
+      rootPath.removeIfExists();
+   }
+
+   homePath.removeIfExists();
+}
+
+} // namespace tests
+} // namespace r_util
+} // namespace core
+} // namespace rstudio
@@ -0,0 +1,434 @@
+/*
+ * RExpressionChunks.cpp
+ *
+ * Copyright (C) 2020 by RStudio, PBC
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include <core/r_util/RExpressionChunks.hpp>
+
+#include <algorithm>
+#include <utility>
+
+#include <boost/bind.hpp>
+
+#include <core/r_util/RTokenizer.hpp>
+
+namespace rstudio {
+namespace core {
+namespace r_util {
+
+namespace {
+
+bool isKeyword(const RToken& token, const wchar_t* keyword)
+{
+   return token.isType(RToken::ID) && token.contentEquals(keyword);
+}
+
+// keywords which must be followed by a parenthesized header and a body
+bool isHeaderKeyword(const RToken& token)
+{
+   return isKeyword(token, L"function") ||
+          isKeyword(token, L"if") ||
+          isKeyword(token, L"for") ||
+          isKeyword(token, L"while");
+}
+
+// keywords which must be followed directly by a body
+bool isBodyKeyword(const RToken& token)
+{
+   return isKeyword(token, L"repeat") ||
+          isKeyword(token, L"else");
+}
+
+bool isLeftAssign(const RToken& token)
+{
+   return token.isType(RToken::OPER) &&
+          (token.contentEquals(L"<-") ||
+           token.contentEquals(L"<<-") ||
+           token.contentEquals(L"="));
+}
+
+bool isOpeningBracket(RToken::TokenType type)
+{
+   return type == RToken::LPAREN || type == RToken::LBRACKET ||
+          type == RToken::LDBRACKET || type == RToken::LBRACE;
+}
+
+bool isClosingBracket(RToken::TokenType type)
+{
+   return type == RToken::RPAREN || type == RToken::RBRACKET ||
+          type == RToken::RDBRACKET || type == RToken::RBRACE;
+}
+
+RToken::TokenType complement(RToken::TokenType type)
+{
+   switch (type)
+   {
+   case RToken::RPAREN: return RToken::LPAREN;
+   case RToken::RBRACKET: return RToken::LBRACKET;
+   case RToken::RDBRACKET: return RToken::LDBRACKET;
+   case RToken::RBRACE: return RToken::LBRACE;
+   default: return type;
+   }
+}
+
+// whether an expression ending with this token may be complete
+bool canEndExpression(const RToken& token)
+{
+   switch (token.type())
+   {
+   case RToken::ID:
+      return !isHeaderKeyword(token) && !isBodyKeyword(token);
+   case RToken::NUMBER:
+   case RToken::STRING:
+   case RToken::RPAREN:
+   case RToken::RBRACKET:
+   case RToken::RDBRACKET:
+   case RToken::RBRACE:
+   case RToken::SEMI:
+      return true;
+   default:
+      return false;
+   }
+}
+
+// whether a line starting with this token might continue the expression
+// on the previous line
+bool mayContinueExpression(const RToken& token)
+{
+   switch (token.type())
+   {
+   case RToken::OPER:
+   case RToken::UOPER:
+   case RToken::COMMA:
+   case RToken::RPAREN:
+   case RToken::RBRACKET:
+   case RToken::RDBRACKET:
+   case RToken::RBRACE:
+   case RToken::ERR:
+      return true;
+   case RToken::ID:
+      return isKeyword(token, L"else");
+   default:
+      return false;
+   }
+}
+
+std::wstring functionName(const RToken& token)
+{
+   std::wstring name = token.content();
+   if (name.size() >= 2 &&
+       (name[0] == L'`' || name[0] == L'"' || name[0] == L'\''))
+   {
+      name = name.substr(1, name.size() - 2);
+   }
+   return name;
+}
+
+bool stopNever(std::size_t, std::size_t)
+{
+   return false;
+}
+
+bool stopAtPreviousBoundary(std::size_t offset,
+                            std::size_t row,
+                            std::size_t unchangedFrom,
+                            std::size_t newSize,
+                            std::size_t oldSize,
+                            const std::vector<RExpressionChunks::Chunk>& previous,
+                            std::size_t* pResumeIndex,
+                            std::size_t* pRow)
+{
+   // the code from here on must be unchanged
+   if (offset < unchangedFrom)
+      return false;
+
+   // and a chunk must have started here previously
+   std::size_t previousOffset = offset - newSize + oldSize;
+   auto it = std::lower_bound(
+            previous.begin(),
+            previous.end(),
+            previousOffset,
+            [](const RExpressionChunks::Chunk& chunk, std::size_t offset) {
+               return chunk.offset < offset;
+            });
+   if (it == previous.end() || it->offset != previousOffset)
+      return false;
+
+   *pResumeIndex = it - previous.begin();
+   *pRow = row;
+   return true;
+}
+
+} // anonymous namespace
+
+RExpressionChunks::RExpressionChunks()
+   : relexedLength_(0)
+{
+}
+
+void RExpressionChunks::clear()
+{
+   code_.clear();
+   chunks_.clear();
+   relexedLength_ = 0;
+}
+
+std::wstring RExpressionChunks::chunkText(const Chunk& chunk) const
+{
+   return code_.substr(chunk.offset, chunk.length);
+}
+
+void RExpressionChunks::update(const std::wstring& code)
+{
+   std::vector<Chunk> previous;
+   previous.swap(chunks_);
+   std::wstring previousCode;
+   previousCode.swap(code_);
+   code_ = code;
+
+   if (previous.empty())
+   {
+      scan(0, 0, stopNever);
+      relexedLength_ = code_.size();
+      return;
+   }
+
+   // find the extent of the change
+   std::size_t oldSize = previousCode.size();
+   std::size_t newSize = code_.size();
+   std::size_t minSize = std::min(oldSize, newSize);
+
+   std::size_t prefix = 0;
+   while (prefix < minSize && previousCode[prefix] == code_[prefix])
+      ++prefix;
+
+   std::size_t suffix = 0;
+   while (suffix < minSize - prefix &&
+          previousCode[oldSize - suffix - 1] == code_[newSize - suffix - 1])
+   {
+      ++suffix;
+   }
+
+   if (prefix == oldSize && prefix == newSize)
+   {
+      chunks_.swap(previous);
+      for (std::size_t i = 0; i < chunks_.size(); ++i)
+         chunks_[i].previous = i;
+      relexedLength_ = 0;
+      return;
+   }
+
+   // the boundary between the chunk containing the edit and the chunk
+   // before it depends on how the edited chunk begins, so re-lex from the
+   // start of the chunk before the edit
+   auto edited = std::upper_bound(
+            previous.begin(),
+            previous.end(),
+            prefix,
+            [](std::size_t offset, const Chunk& chunk) {
+               return offset < chunk.offset;
+            });
+   std::size_t restart = edited - previous.begin();
+   restart = restart >= 2 ? restart - 2 : 0;
+
+   for (std::size_t i = 0; i < restart; ++i)
+   {
+      chunks_.push_back(std::move(previous[i]));
+      chunks_.back().previous = i;
+   }
+
+   // re-lex until we reach a chunk boundary in the unchanged remainder
+   // which was also a boundary previously
+   std::size_t resumeIndex = kNewChunk;
+   std::size_t resumeRow = 0;
+   std::size_t firstNew = chunks_.size();
+   scan(previous[restart].offset,
+        previous[restart].row,
+        boost::bind(stopAtPreviousBoundary, _1, _2,
+                    newSize - suffix, newSize, oldSize,
+                    boost::cref(previous), &resumeIndex, &resumeRow));
+
+   std::size_t relexedEnd = newSize;
+
+   // re-lexed chunks lying entirely within the unchanged prefix or suffix
+   // may match a previous chunk exactly
+   for (std::size_t i = firstNew; i < chunks_.size(); ++i)
+   {
+      Chunk& chunk = chunks_[i];
+      std::size_t end = chunk.offset + chunk.length;
+
+      std::size_t previousOffset;
+      if (end <= prefix)
+         previousOffset = chunk.offset;
+      else if (chunk.offset >= newSize - suffix)
+         previousOffset = chunk.offset - newSize + oldSize;
+      else
+         continue;
+
+      auto it = std::lower_bound(
+               previous.begin(),
+               previous.end(),
+               previousOffset,
+               [](const Chunk& chunk, std::size_t offset) {
+                  return chunk.offset < offset;
+               });
+      if (it != previous.end() &&
+          it->offset == previousOffset &&
+          it->length == chunk.length)
+      {
+         chunk.previous = it - previous.begin();
+      }
+   }
+
+   // the remaining chunks are unchanged apart from their position
+   if (resumeIndex != kNewChunk)
+   {
+      relexedEnd = previous[resumeIndex].offset + newSize - oldSize;
+      for (std::size_t i = resumeIndex; i < previous.size(); ++i)
+      {
+         Chunk chunk = std::move(previous[i]);
+         chunk.offset = chunk.offset + newSize - oldSize;
+         chunk.row = chunk.row + resumeRow - previous[resumeIndex].row;
+         chunk.previous = i;
+         chunks_.push_back(std::move(chunk));
+      }
+   }
+
+   relexedLength_ = relexedEnd - previous[restart].offset;
+}
+
+void RExpressionChunks::scan(
+      std::size_t offset,
+      std::size_t row,
+      const boost::function<bool(std::size_t, std::size_t)>& stop)
+{
+   RTokenizer tokenizer(code_.substr(offset));
+
+   Chunk chunk;
+   chunk.offset = offset;
+   chunk.row = row;
+
+   // bracket types currently open; on a mismatched closing bracket we
+   // discard them all, so that a stray bracket doesn't prevent splitting
+   // the remainder of the code
+   std::vector<RToken::TokenType> brackets;
+
+   // the depth of the tokenizer's own square bracket stack, which determines
+   // how it tokenizes ']]'; we only split where it is empty so that lexing
+   // from a chunk boundary gives the same tokens as lexing from the start
+   std::size_t squareDepth = 0;
+
+   // whether we're awaiting the parenthesized header of a top-level
+   // 'function', 'if', 'for' or 'while'
+   bool awaitingHeader = false;
+
+   bool complete = false;
+   bool newline = false;
+   RToken previous, beforePrevious;
+
+   RToken token;
+   while ((token = tokenizer.nextToken()))
+   {
+      if (token.isType(RToken::WHITESPACE))
+      {
+         if (token.contentContains(L'\n'))
+            newline = true;
+         continue;
+      }
+
+      if (token.isType(RToken::COMMENT))
+         continue;
+
+      // start a new chunk at the beginning of this line if the previous
+      // line completed an expression
+      if (complete && newline && brackets.empty() && squareDepth == 0 &&
+          !mayContinueExpression(token))
+      {
+         std::size_t boundary = offset + token.offset() - token.column();
+         std::size_t boundaryRow = row + token.row();
+
+         chunk.length = boundary - chunk.offset;
+         chunks_.push_back(std::move(chunk));
+         if (stop(boundary, boundaryRow))
+            return;
+
+         chunk = Chunk();
+         chunk.offset = boundary;
+         chunk.row = boundaryRow;
+         awaitingHeader = false;
+         previous = beforePrevious = RToken();
+      }
+
+      // record function definitions and calls
+      if (token.isType(RToken::LPAREN) &&
+          (previous.isType(RToken::ID) || previous.isType(RToken::STRING)) &&
+          !isHeaderKeyword(previous))
+      {
+         chunk.calls.insert(functionName(previous));
+      }
+      else if (isKeyword(token, L"function") && isLeftAssign(previous) &&
+               (beforePrevious.isType(RToken::ID) || beforePrevious.isType(RToken::STRING)))
+      {
+         chunk.definitions.insert(functionName(beforePrevious));
+      }
+
+      // track brackets and completeness
+      RToken::TokenType type = token.type();
+      if (isOpeningBracket(type))
+      {
+         brackets.push_back(type);
+      }
+      else if (isClosingBracket(type))
+      {
+         if (brackets.empty() || brackets.back() != complement(type))
+            brackets.clear();
+         else
+            brackets.pop_back();
+      }
+
+      if (type == RToken::LBRACKET || type == RToken::LDBRACKET)
+         ++squareDepth;
+      else if ((type == RToken::RBRACKET || type == RToken::RDBRACKET) && squareDepth > 0)
+         --squareDepth;
+
+      if (brackets.empty())
+      {
+         if (isHeaderKeyword(token))
+         {
+            awaitingHeader = true;
+            complete = false;
+         }
+         else if (type == RToken::RPAREN && awaitingHeader)
+         {
+            // the header is closed; the body is still to come
+            awaitingHeader = false;
+            complete = false;
+         }
+         else
+         {
+            complete = canEndExpression(token);
+         }
+      }
+
+      newline = false;
+      beforePrevious = previous;
+      previous = token;
+   }
+
+   chunk.length = code_.size() - chunk.offset;
+   chunks_.push_back(std::move(chunk));
+}
+
+} // namespace r_util
+} // namespace core
+} // namespace rstudio
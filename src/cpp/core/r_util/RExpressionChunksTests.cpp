@@ -0,0 +1,234 @@
+/*
+ * RExpressionChunksTests.cpp
+ *
+ * Copyright (C) 2020 by RStudio, PBC
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include <core/r_util/RExpressionChunks.hpp>
+
+#include <random>
+
+#include <tests/TestThat.hpp>
+
+namespace rstudio {
+namespace core {
+namespace r_util {
+
+namespace {
+
+const wchar_t* const kLines[] = {
+   L"x <- 1",
+   L"f <- function(a, b = 2) {",
+   L"   a + b",
+   L"}",
+   L"if (x > 1) {",
+   L"} else {",
+   L"   print(\"else\")",
+   L"y <- x +",
+   L"   2",
+   L"z <- c(1,",
+   L"       2)",
+   L"# a comment",
+   L"",
+   L"g <- function(x)",
+   L"   x * 2",
+   L"repeat break",
+   L"s <- 'a string",
+   L"with a newline'",
+   L"lst[[\"name\"]] <- f(1)",
+   L"   ",
+   L"(x)",
+   L")",
+   L"for (i in 1:10) print(i)"
+};
+
+std::wstring randomLines(std::mt19937& rng, std::size_t count)
+{
+   std::size_t n = sizeof(kLines) / sizeof(kLines[0]);
+   std::uniform_int_distribution<std::size_t> index(0, n - 1);
+   std::wstring code;
+   for (std::size_t i = 0; i < count; ++i)
+   {
+      code += kLines[index(rng)];
+      code += L"\n";
+   }
+   return code;
+}
+
+std::wstring randomEdit(std::mt19937& rng, const std::wstring& code)
+{
+   std::uniform_int_distribution<std::size_t> position(0, code.size());
+   std::size_t begin = position(rng);
+   std::size_t end = std::min(code.size(), begin + position(rng) % 16);
+
+   std::wstring result = code.substr(0, begin);
+   if (rng() % 2)
+      result += randomLines(rng, rng() % 3);
+   else
+      result += std::wstring(1, L"{}()\"'\n x1+#"[rng() % 12]);
+   result += code.substr(end);
+   return result;
+}
+
+bool samePartition(const RExpressionChunks& lhs, const RExpressionChunks& rhs)
+{
+   if (lhs.chunks().size() != rhs.chunks().size())
+      return false;
+
+   for (std::size_t i = 0; i < lhs.chunks().size(); ++i)
+   {
+      const RExpressionChunks::Chunk& a = lhs.chunks()[i];
+      const RExpressionChunks::Chunk& b = rhs.chunks()[i];
+      if (a.offset != b.offset || a.length != b.length || a.row != b.row ||
+          a.definitions != b.definitions || a.calls != b.calls)
+      {
+         return false;
+      }
+   }
+
+   return true;
+}
+
+std::vector<std::wstring> chunkTexts(const std::wstring& code)
+{
+   RExpressionChunks chunks;
+   chunks.update(code);
+
+   std::vector<std::wstring> texts;
+   for (const RExpressionChunks::Chunk& chunk : chunks.chunks())
+      texts.push_back(chunks.chunkText(chunk));
+   return texts;
+}
+
+} // anonymous namespace
+
+test_context("RExpressionChunks")
+{
+   test_that("Code is split into complete top-level expressions")
+   {
+      std::vector<std::wstring> texts = chunkTexts(
+               L"x <- 1\n"
+               L"f <- function(a) {\n"
+               L"   a\n"
+               L"}\n"
+               L"y <- x +\n"
+               L"   2\n"
+               L"if (x) 1\n"
+               L"else 2\n"
+               L"g <- function(x)\n"
+               L"   x\n");
+
+      REQUIRE(texts.size() == 5);
+      expect_true(texts[0] == L"x <- 1\n");
+      expect_true(texts[1] == L"f <- function(a) {\n   a\n}\n");
+      expect_true(texts[2] == L"y <- x +\n   2\n");
+      expect_true(texts[3] == L"if (x) 1\nelse 2\n");
+      expect_true(texts[4] == L"g <- function(x)\n   x\n");
+   }
+
+   test_that("Code following unbalanced brackets is still split")
+   {
+      std::vector<std::wstring> texts = chunkTexts(
+               L"x <- 1\n"
+               L"y <- (2))\n"
+               L"z <- c(3]\n"
+               L"w <- 4\n");
+
+      REQUIRE(texts.size() == 4);
+      expect_true(texts[1] == L"y <- (2))\n");
+      expect_true(texts[2] == L"z <- c(3]\n");
+   }
+
+   test_that("Code within unclosed square brackets isn't split")
+   {
+      // the tokenizer's handling of ']]' depends on the open '['
+      std::vector<std::wstring> texts = chunkTexts(
+               L"x[1)\n"
+               L"y <- 2\n");
+
+      REQUIRE(texts.size() == 1);
+   }
+
+   test_that("Function definitions and calls are recorded")
+   {
+      RExpressionChunks chunks;
+      chunks.update(L"`my fun` <- function(x) helper(x)\nmy_fun2 = function() NULL\n");
+
+      REQUIRE(chunks.chunks().size() == 2);
+      const RExpressionChunks::Chunk& first = chunks.chunks()[0];
+      expect_true(first.definitions.count(L"my fun"));
+      expect_true(first.calls.count(L"helper"));
+      expect_false(first.calls.count(L"function"));
+      expect_true(chunks.chunks()[1].definitions.count(L"my_fun2"));
+   }
+
+   test_that("Only the edited part of a document is re-lexed")
+   {
+      std::wstring code;
+      for (int i = 0; i < 1000; ++i)
+         code += L"x <- f(1, 2)\n";
+
+      RExpressionChunks chunks;
+      chunks.update(code);
+      expect_true(chunks.chunks().size() == 1000);
+
+      code.insert(500 * 13 + 5, L"y + ");
+      chunks.update(code);
+      expect_true(chunks.chunks().size() == 1000);
+      expect_true(chunks.relexedLength() < 100);
+
+      std::size_t reused = 0;
+      for (const RExpressionChunks::Chunk& chunk : chunks.chunks())
+         if (chunk.previous != RExpressionChunks::kNewChunk)
+            ++reused;
+      expect_true(reused == 999);
+   }
+
+   test_that("Incremental updates agree with partitioning from scratch")
+   {
+      std::mt19937 rng(42);
+      for (int document = 0; document < 50; ++document)
+      {
+         std::wstring code = randomLines(rng, 40);
+         RExpressionChunks incremental;
+         incremental.update(code);
+
+         for (int edit = 0; edit < 40; ++edit)
+         {
+            std::wstring previousCode = code;
+            std::vector<RExpressionChunks::Chunk> previous = incremental.chunks();
+
+            code = randomEdit(rng, code);
+            incremental.update(code);
+
+            RExpressionChunks scratch;
+            scratch.update(code);
+            REQUIRE(samePartition(incremental, scratch));
+
+            // reused chunks must have the same text as before
+            for (const RExpressionChunks::Chunk& chunk : incremental.chunks())
+            {
+               if (chunk.previous == RExpressionChunks::kNewChunk)
+                  continue;
+
+               const RExpressionChunks::Chunk& old = previous[chunk.previous];
+               REQUIRE(previousCode.substr(old.offset, old.length) ==
+                       incremental.chunkText(chunk));
+            }
+         }
+      }
+   }
+}
+
+} // namespace r_util
+} // namespace core
+} // namespace rstudio
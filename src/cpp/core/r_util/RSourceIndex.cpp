@@ -469,6 +469,15 @@ RSourceIndex::RSourceIndex(const std::string& context, const std::string& code)
    
 }
 
+RSourceIndex::RSourceIndex(const std::string& context,
+                           const std::vector<RSourceItem>& items,
+                           const std::vector<std::string>& inferredPkgNames)
+   : context_(context), items_(items)
+{
+   for (const std::string& pkgName : inferredPkgNames)
+      addInferredPackage(pkgName);
+}
+
 } // namespace r_util
 } // namespace core 
 } // namespace rstudio
@@ -13,25 +13,11 @@
  *
  */
 
-// A very low level assertion (line 595 of cpp_regex_traits.hpp) is firing
-// on WindowsXP when we create a boost::wregex within R session. This code
-// is part of boost attempting to detect the sort syntax, and the assertion
-// is that there are no nulls in a buffer after a call to locale->transform.
-// Within the same method there are workarounds for both borland c++ and
-// dinkumware c++ std library to strip embedded nulls, so it seems as if
-// there is some variation in whether nulls come out of the call to transforn.
-// Note also that boost has a macro titled BOOST_REGEX_NO_WIN32 which we are
-// not using, which means that boost regex does call into native windows APIs
-// for locale oriented functions (thus explaining a difference in runtime
-// behavior across platforms). Tokenization appears to continue to work
-// correctly in the presence of the assertion (with the annoying side effect
-// of logging an assertion every time the product starts up)
-
 #include <core/r_util/RTokenizer.hpp>
 
-#include <boost/regex.hpp>
-
+#include <algorithm>
 #include <iostream>
+#include <locale>
 #include <sstream>
 
 #include <shared_core/Error.hpp>
@@ -45,37 +31,181 @@ namespace r_util {
 
 namespace {
 
-class TokenPatterns
+// Character classes used by the scanners below. Tokens are recognized by
+// hand-written scanners (rather than regular expressions) as tokenization
+// runs on every keystroke for diagnostics, indexing and completions. ASCII
+// characters are classified through a lookup table; anything else falls
+// back to the locale.
+enum CharClass
 {
-private:
-   friend TokenPatterns& tokenPatterns();
-   TokenPatterns()
-      : NUMBER(L"[0-9]*(\\.[0-9]*)?([eE][+-]?[0-9]*)?[Li]?"),
-        HEX_NUMBER(L"0x[0-9a-fA-F]*L?"),
-        USER_OPERATOR(L"%[^\\n%]*%"),
-        QUOTED_IDENTIFIER(L"`[^`]*`"),
-        UNTIL_END_QUOTE(L"[\\\\\'\"]"),
-        WHITESPACE(L"[\\s\x00A0\x3000]+"),
-        COMMENT(L"#[^\\n]*$")
+   kHexDigit   = 1 << 0,
+   kWhitespace = 1 << 1,
+   kIdentifier = 1 << 2
+};
+
+class CharClassTable
+{
+public:
+   CharClassTable()
    {
+      std::fill(table_, table_ + 128, 0);
+
+      for (wchar_t ch = L'0'; ch <= L'9'; ++ch)
+         table_[ch] |= kHexDigit;
+      for (wchar_t ch = L'a'; ch <= L'f'; ++ch)
+         table_[ch] |= kHexDigit;
+      for (wchar_t ch = L'A'; ch <= L'F'; ++ch)
+         table_[ch] |= kHexDigit;
+
+      for (wchar_t ch = 0; ch < 128; ++ch)
+         if (string_utils::isalnum(ch) || ch == L'.' || ch == L'_')
+            table_[ch] |= kIdentifier;
+
+      // consult the locale for ASCII whitespace too, so that we agree
+      // with the non-ASCII case
+      const std::ctype<wchar_t>& ctype = std::use_facet<std::ctype<wchar_t> >(std::locale());
+      for (wchar_t ch = 0; ch < 128; ++ch)
+         if (ctype.is(std::ctype_base::space, ch))
+            table_[ch] |= kWhitespace;
    }
 
-public:
-   const boost::wregex NUMBER;
-   const boost::wregex HEX_NUMBER;
-   const boost::wregex USER_OPERATOR;
-   const boost::wregex QUOTED_IDENTIFIER;
-   const boost::wregex UNTIL_END_QUOTE;
-   const boost::wregex WHITESPACE;
-   const boost::wregex COMMENT;
+   bool is(wchar_t ch, unsigned char charClass) const
+   {
+      return static_cast<unsigned int>(ch) < 128 && (table_[ch] & charClass);
+   }
+
+private:
+   unsigned char table_[128];
 };
 
-TokenPatterns& tokenPatterns()
+const CharClassTable& charClasses()
 {
-   static TokenPatterns instance;
+   static CharClassTable instance;
    return instance;
 }
 
+inline bool isDigit(wchar_t ch)
+{
+   return ch >= L'0' && ch <= L'9';
+}
+
+inline bool isHexDigit(wchar_t ch)
+{
+   return charClasses().is(ch, kHexDigit);
+}
+
+inline bool isIdentifierChar(wchar_t ch)
+{
+   if (static_cast<unsigned int>(ch) < 128)
+      return charClasses().is(ch, kIdentifier);
+
+   return string_utils::isalnum(ch);
+}
+
+inline bool isWhitespace(wchar_t ch)
+{
+   if (static_cast<unsigned int>(ch) < 128)
+      return charClasses().is(ch, kWhitespace);
+
+   if (ch == L'\x00A0' || ch == L'\x3000')
+      return true;
+
+   return std::use_facet<std::ctype<wchar_t> >(std::locale()).is(std::ctype_base::space, ch);
+}
+
+typedef std::wstring::const_iterator Iterator;
+
+// [\s\x00A0\x3000]+
+std::size_t whitespaceLength(Iterator begin, Iterator end)
+{
+   Iterator it = begin;
+   while (it != end && isWhitespace(*it))
+      ++it;
+   return it - begin;
+}
+
+// 0x[0-9a-fA-F]*L?
+std::size_t hexNumberLength(Iterator begin, Iterator end)
+{
+   if (end - begin < 2 || begin[0] != L'0' || begin[1] != L'x')
+      return 0;
+
+   Iterator it = begin + 2;
+   while (it != end && isHexDigit(*it))
+      ++it;
+   if (it != end && *it == L'L')
+      ++it;
+   return it - begin;
+}
+
+// [0-9]*(\.[0-9]*)?([eE][+-]?[0-9]*)?[Li]?
+std::size_t numberLength(Iterator begin, Iterator end)
+{
+   Iterator it = begin;
+   while (it != end && isDigit(*it))
+      ++it;
+
+   if (it != end && *it == L'.')
+   {
+      ++it;
+      while (it != end && isDigit(*it))
+         ++it;
+   }
+
+   if (it != end && (*it == L'e' || *it == L'E'))
+   {
+      ++it;
+      if (it != end && (*it == L'+' || *it == L'-'))
+         ++it;
+      while (it != end && isDigit(*it))
+         ++it;
+   }
+
+   if (it != end && (*it == L'L' || *it == L'i'))
+      ++it;
+
+   return it - begin;
+}
+
+// text delimited by 'delim' (e.g. %[^\n%]*% or `[^`]*`); returns 0 if
+// the closing delimiter isn't found
+std::size_t delimitedLength(Iterator begin,
+                            Iterator end,
+                            wchar_t delim,
+                            bool allowNewlines)
+{
+   for (Iterator it = begin + 1; it != end; ++it)
+   {
+      if (*it == delim)
+         return it - begin + 1;
+      else if (*it == L'\n' && !allowNewlines)
+         return 0;
+   }
+   return 0;
+}
+
+// #[^\n]*$ -- note that '$' won't match between '\r' and '\n', so a
+// trailing carriage return isn't part of the comment
+std::size_t commentLength(Iterator begin, Iterator end)
+{
+   Iterator it = std::find(begin, end, L'\n');
+   if (it != end && *(it - 1) == L'\r')
+      --it;
+   return it - begin;
+}
+
+// [\\'"]
+Iterator findStringDelimiter(Iterator begin, Iterator end)
+{
+   for (Iterator it = begin; it != end; ++it)
+   {
+      wchar_t ch = *it;
+      if (ch == L'\\' || ch == L'\'' || ch == L'"')
+         return it;
+   }
+   return end;
+}
+
 void updatePosition(std::wstring::const_iterator pos,
                     std::size_t length,
                     std::size_t* pRow,
@@ -235,7 +365,7 @@ RToken RTokenizer::nextToken()
 
 RToken RTokenizer::matchWhitespace()
 {
-   return consumeToken(RToken::WHITESPACE, tokenLength(tokenPatterns().WHITESPACE));
+   return consumeToken(RToken::WHITESPACE, whitespaceLength(pos_, data_.end()));
 }
 
 Error RTokenizer::matchRawStringLiteral(RToken* pToken)
@@ -352,7 +482,7 @@ RToken RTokenizer::matchStringLiteral()
 
    while (!eol())
    {
-      eatUntil(tokenPatterns().UNTIL_END_QUOTE);
+      pos_ = findStringDelimiter(pos_, data_.end());
 
       if (eol())
          break ;
@@ -396,9 +526,9 @@ RToken RTokenizer::matchStringLiteral()
 
 RToken RTokenizer::matchNumber()
 {
-   std::size_t length = tokenLength(tokenPatterns().HEX_NUMBER);
+   std::size_t length = hexNumberLength(pos_, data_.end());
    if (length == 0)
-      length = tokenLength(tokenPatterns().NUMBER);
+      length = numberLength(pos_, data_.end());
 
    return consumeToken(RToken::NUMBER, length);
 }
@@ -407,7 +537,7 @@ RToken RTokenizer::matchIdentifier()
 {
    std::wstring::const_iterator start = pos_ ;
    eat();
-   while (string_utils::isalnum(peek()) || peek() == L'.' || peek() == L'_')
+   while (isIdentifierChar(peek()))
       eat();
    
    std::size_t row = row_;
@@ -424,7 +554,7 @@ RToken RTokenizer::matchIdentifier()
 
 RToken RTokenizer::matchQuotedIdentifier()
 {
-   std::size_t length = tokenLength(tokenPatterns().QUOTED_IDENTIFIER);
+   std::size_t length = delimitedLength(pos_, data_.end(), L'`', true);
    if (length == 0)
       return consumeToken(RToken::ERR, 1);
    else
@@ -433,12 +563,12 @@ RToken RTokenizer::matchQuotedIdentifier()
 
 RToken RTokenizer::matchComment()
 {
-   return consumeToken(RToken::COMMENT, tokenLength(tokenPatterns().COMMENT));
+   return consumeToken(RToken::COMMENT, commentLength(pos_, data_.end()));
 }
 
 RToken RTokenizer::matchUserOperator()
 {
-   std::size_t length = tokenLength(tokenPatterns().USER_OPERATOR);
+   std::size_t length = delimitedLength(pos_, data_.end(), L'%', false);
    if (length == 0)
       return consumeToken(RToken::ERR, 1);
    else
@@ -530,33 +660,6 @@ wchar_t RTokenizer::eat()
    return result ;
 }
 
-std::size_t RTokenizer::tokenLength(const boost::wregex& regex)
-{
-   boost::wsmatch match;
-   std::wstring::const_iterator end = data_.end();
-   boost::match_flag_type flg = boost::match_default | boost::match_continuous;
-   if (regex_utils::search(pos_, end, match, regex, flg))
-      return match.length();
-   else
-      return 0;
-}
-
-void RTokenizer::eatUntil(const boost::wregex& regex)
-{
-   boost::wsmatch match;
-   std::wstring::const_iterator end = data_.end();
-   if (regex_utils::search(pos_, end, match, regex))
-   {
-      pos_ = match[0].first;
-   }
-   else
-   {
-      // eat all on failure to match
-      pos_ = data_.end();
-   }
-}
-
-
 RToken RTokenizer::consumeToken(RToken::TokenType tokenType,
                                 std::size_t length)
 {
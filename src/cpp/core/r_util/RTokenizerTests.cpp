@@ -18,6 +18,10 @@
 #include <core/r_util/RTokenizer.hpp>
 
 #include <iostream>
+#include <random>
+
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/regex.hpp>
 
 #include <tests/TestThat.hpp>
 
@@ -229,6 +233,167 @@ void testWhitespace()
 }
 
 
+// The regular expressions used by the original (regex based) tokenizer.
+// The scanners which replaced them are checked against these so that we
+// produce exactly the same tokens.
+class RegexReference
+{
+public:
+   RegexReference()
+      : NUMBER(L"[0-9]*(\\.[0-9]*)?([eE][+-]?[0-9]*)?[Li]?"),
+        HEX_NUMBER(L"0x[0-9a-fA-F]*L?"),
+        USER_OPERATOR(L"%[^\\n%]*%"),
+        QUOTED_IDENTIFIER(L"`[^`]*`"),
+        UNTIL_END_QUOTE(L"[\\\\\'\"]"),
+        WHITESPACE(L"[\\s\x00A0\x3000]+"),
+        COMMENT(L"#[^\\n]*$")
+   {
+   }
+
+   // returns the expected length of the token at 'pos', or -1 if the
+   // token isn't produced by one of the regular expressions
+   int expectedLength(const RToken& token,
+                      std::wstring::const_iterator pos,
+                      std::wstring::const_iterator end) const
+   {
+      wchar_t ch = *pos;
+      switch (token.type())
+      {
+      case RToken::WHITESPACE:
+         return length(WHITESPACE, pos, end);
+      case RToken::COMMENT:
+         return length(COMMENT, pos, end);
+      case RToken::UOPER:
+         return length(USER_OPERATOR, pos, end);
+      case RToken::NUMBER:
+      {
+         int length = this->length(HEX_NUMBER, pos, end);
+         return length > 0 ? length : this->length(NUMBER, pos, end);
+      }
+      case RToken::ID:
+         return ch == L'`' ? length(QUOTED_IDENTIFIER, pos, end) : -1;
+      case RToken::STRING:
+         return (ch == L'"' || ch == L'\'') ? stringLength(pos, end) : -1;
+      case RToken::ERR:
+         // unterminated user operators and quoted identifiers
+         if (ch == L'%' && length(USER_OPERATOR, pos, end) == 0)
+            return 1;
+         else if (ch == L'`' && length(QUOTED_IDENTIFIER, pos, end) == 0)
+            return 1;
+         return -1;
+      default:
+         return -1;
+      }
+   }
+
+private:
+   int length(const boost::wregex& regex,
+              std::wstring::const_iterator pos,
+              std::wstring::const_iterator end) const
+   {
+      boost::wsmatch match;
+      if (boost::regex_search(pos, end, match, regex, boost::match_default | boost::match_continuous))
+         return static_cast<int>(match.length());
+      return 0;
+   }
+
+   int stringLength(std::wstring::const_iterator pos,
+                    std::wstring::const_iterator end) const
+   {
+      std::wstring::const_iterator start = pos;
+      wchar_t quot = *pos++;
+      while (pos != end)
+      {
+         boost::wsmatch match;
+         if (boost::regex_search(pos, end, match, UNTIL_END_QUOTE))
+            pos = match[0].first;
+         else
+            pos = end;
+
+         if (pos == end)
+            break;
+
+         wchar_t c = *pos++;
+         if (c == quot)
+            break;
+
+         if (c == L'\\' && pos != end)
+            ++pos;
+      }
+      return static_cast<int>(pos - start);
+   }
+
+   const boost::wregex NUMBER;
+   const boost::wregex HEX_NUMBER;
+   const boost::wregex USER_OPERATOR;
+   const boost::wregex QUOTED_IDENTIFIER;
+   const boost::wregex UNTIL_END_QUOTE;
+   const boost::wregex WHITESPACE;
+   const boost::wregex COMMENT;
+};
+
+bool tokenizesLikeRegexReference(const std::wstring& code)
+{
+   static RegexReference reference;
+
+   RTokenizer tokenizer(code);
+   std::size_t offset = 0;
+   RToken token;
+   while ((token = tokenizer.nextToken()))
+   {
+      // tokens must be contiguous
+      if (token.offset() != offset)
+         return false;
+
+      int expected = reference.expectedLength(token, code.begin() + offset, code.end());
+      if (expected != -1 && static_cast<std::size_t>(expected) != token.length())
+      {
+         std::wcerr << L"Mismatched token '" << token.content() << L"' (expected length "
+                    << expected << L")" << std::endl;
+         return false;
+      }
+
+      offset += token.length();
+   }
+
+   return offset == code.size();
+}
+
+// random code made up of characters that are significant to the scanners
+std::wstring randomCode(std::mt19937& rng, std::size_t length)
+{
+   static const std::wstring alphabet =
+         L"0123456789abcdefxLiEe.+-_%`'\"\\#\n\r\t\v\f ()[]{}<>=!&|:;,*^~$@?"
+         L"\x00A0\x3000\x2028\x0085\x1680\x2003\x00E9\x4E2D";
+
+   std::uniform_int_distribution<std::size_t> index(0, alphabet.size() - 1);
+   std::wstring code;
+   for (std::size_t i = 0; i < length; ++i)
+      code.push_back(alphabet[index(rng)]);
+   return code;
+}
+
+// a reasonably realistic chunk of R code, repeated to the requested size
+std::wstring sampleCode(std::size_t minLength)
+{
+   static const std::wstring chunk =
+         L"# Fit a model to each group and summarise the results\n"
+         L"fit_models <- function(data, formula = y ~ x, ...) {\n"
+         L"   groups <- split(data, data$group)\n"
+         L"   results <- lapply(groups, function(df) {\n"
+         L"      model <- lm(formula, data = df, ...)\n"
+         L"      coef(model)[[\"x\"]] * 1.5e-3 + 0x1FL %% 7L\n"
+         L"   })\n"
+         L"   `names<-`(results, sprintf('group %s', names(groups)))\n"
+         L"}\n"
+         L"x <- c(1, 2.5, .5, 3i, 1e10); y <- x %in% c(1, 2) && TRUE\n";
+
+   std::wstring code;
+   while (code.size() < minLength)
+      code += chunk;
+   return code;
+}
+
 } // anonymous namespace
 
 
@@ -302,7 +467,50 @@ test_context("RTokenizer")
       expect_true(rTokens.at(2).isType(RToken::STRING));
       expect_true(rTokens.at(3).isType(RToken::RPAREN));
    }
-   
+
+   test_that("the tokenizer agrees with the original regular expressions")
+   {
+      expect_true(tokenizesLikeRegexReference(sampleCode(10000)));
+
+      std::deque<std::wstring> cases = {
+         L"#", L"#\r\n", L"# a\r\r\n1", L"#a\rb", L"#\r",
+         L"0x", L"0xL", L"0xfgL", L"1e", L"1e+", L"1.e-5Li", L".5i", L"1..2",
+         L"%", L"%%", L"%a\n%", L"%in%%", L"`", L"``", L"`a\nb`",
+         L"'", L"'\\", L"'\\'", L"\"a\\\"b\"", L"'a\"b'",
+         L" \v\f\x00A0\x3000\x2028\x1680x"
+      };
+      for (const std::wstring& code : cases)
+         expect_true(tokenizesLikeRegexReference(code));
+
+      std::mt19937 rng(42);
+      for (int i = 0; i < 2000; ++i)
+         expect_true(tokenizesLikeRegexReference(randomCode(rng, 64)));
+   }
+}
+
+// run explicitly with: rstudio-core-tests "[benchmark]"
+TEST_CASE("RTokenizer throughput", "[.][benchmark]")
+{
+   using namespace boost::posix_time;
+
+   std::wstring code = sampleCode(4 * 1024 * 1024);
+   std::size_t utf8Bytes = string_utils::wideToUtf8(code).size();
+
+   const int kIterations = 5;
+   ptime start = microsec_clock::universal_time();
+   std::size_t tokens = 0;
+   for (int i = 0; i < kIterations; ++i)
+   {
+      RTokens rTokens(code);
+      tokens += rTokens.size();
+   }
+   time_duration elapsed = microsec_clock::universal_time() - start;
+
+   double seconds = elapsed.total_microseconds() / 1.0e6;
+   double mbPerSecond = (utf8Bytes * kIterations) / (1024.0 * 1024.0) / seconds;
+   CHECK(tokens > 0);
+   std::cout << "tokenized " << utf8Bytes << " bytes x " << kIterations << " in "
+             << elapsed.total_milliseconds() << "ms (" << mbPerSecond << " MB/s)" << std::endl;
 }
 
 } // namespace r_util
@@ -46,6 +46,10 @@ ChildProcessSubprocPoll::ChildProcessSubprocPoll(
      hasSubprocess_(true),
      hasWhitelistSubprocess_(false),
      hasRecentOutput_(true),
+     subprocsChanged_(false),
+     cwdChanged_(false),
+     didCheckSubproc_(false),
+     didCheckCwd_(false),
      didThrottleSubprocCheck_(false),
      stopped_(false),
      resetRecentDelay_(resetRecentDelay),
@@ -63,6 +67,8 @@ bool ChildProcessSubprocPoll::poll(bool hadOutput)
       return false;
 
    boost::posix_time::ptime currentTime = now();
+   subprocsChanged_ = false;
+   cwdChanged_ = false;
 
    // Update state of "hasRecentOutput". We remember that we saw output for
    // up to "resetRecentDelay_" milliseconds.
@@ -115,6 +121,8 @@ bool ChildProcessSubprocPoll::pollSubproc(boost::posix_time::ptime currentTime)
 
    // Enough time has passed, update whether "pid" has subprocesses
    // and restart the timer.
+   bool hadSubprocess = hasSubprocess_;
+   bool hadWhitelistSubprocess = hasWhitelistSubprocess_;
    hasSubprocess_ = false;
    hasWhitelistSubprocess_ = false;
    std::vector<SubprocInfo> children = subProcCheck_(pid_);
@@ -136,6 +144,11 @@ bool ChildProcessSubprocPoll::pollSubproc(boost::posix_time::ptime currentTime)
       }
    }
 
+   subprocsChanged_ = !didCheckSubproc_ ||
+                      hasSubprocess_ != hadSubprocess ||
+                      hasWhitelistSubprocess_ != hadWhitelistSubprocess;
+   didCheckSubproc_ = true;
+
    checkSubProcAfter_ = currentTime + checkSubprocDelay_;
    didThrottleSubprocCheck_ = false;
    return true;
@@ -158,7 +171,10 @@ bool ChildProcessSubprocPoll::pollCwd(boost::posix_time::ptime currentTime)
       return false;
 
    // Enough time has passed, query current working directory and restart timer
-   cwd_ = cwdCheck_(pid_);
+   core::FilePath cwd = cwdCheck_(pid_);
+   cwdChanged_ = !didCheckCwd_ || cwd != cwd_;
+   didCheckCwd_ = true;
+   cwd_ = cwd;
    checkCwdAfter_ = currentTime + checkCwdDelay_;
    return true;
 }
@@ -188,6 +204,16 @@ core::FilePath ChildProcessSubprocPoll::getCwd() const
    return cwd_;
 }
 
+bool ChildProcessSubprocPoll::subprocsChanged() const
+{
+   return subprocsChanged_;
+}
+
+bool ChildProcessSubprocPoll::cwdChanged() const
+{
+   return cwdChanged_;
+}
+
 } // namespace system
 } // namespace core
 } // namespace rstudio
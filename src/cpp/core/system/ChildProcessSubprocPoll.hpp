@@ -36,6 +36,11 @@ namespace system {
 // more often than specified by "checkCwdDelay". Can be turned off completely
 // by passing a NULL "cwdCheck" function.
 //
+// subprocsChanged(), cwdChanged(): did the last call to poll() find that the
+// subprocess state or the current working directory changed? (The first check
+// of each always counts as a change.) Callers use these to report only what
+// changed.
+//
 // hasRecentOutput(): did the process recently report receiving output? Recent
 // is controlled by "resetRecentDelay", i.e. if we've seen output within the
 // last "resetRecentDelay" millisedconds.
@@ -74,6 +79,9 @@ public:
    bool hasRecentOutput() const;
    core::FilePath getCwd() const;
 
+   bool subprocsChanged() const;
+   bool cwdChanged() const;
+
   boost::posix_time::milliseconds getResetRecentDelay() const;
   boost::posix_time::milliseconds getCheckSubprocDelay() const;
   boost::posix_time::milliseconds getCwdDelay() const;
@@ -96,6 +104,12 @@ private:
    bool hasRecentOutput_;
    core::FilePath cwd_;
 
+   // did the most recent poll change the results?
+   bool subprocsChanged_;
+   bool cwdChanged_;
+   bool didCheckSubproc_;
+   bool didCheckCwd_;
+
    // misc. state
    bool didThrottleSubprocCheck_;
    bool stopped_;
@@ -225,6 +225,51 @@ test_context("ChildProcess polling support class")
       expect_true(test.poller_.hasRecentOutput());
       expect_true(test.poller_.getCwd().isEmpty());
    }
+
+   test_that("childproc changes are only reported when state changes")
+   {
+      PidType pid = 12345;
+      SubProcPollingFixture test(pid);
+
+      test.checkReturns_ = false;
+      test.poller_.poll(true);
+      expect_false(test.poller_.subprocsChanged());
+      blockingwait(kCheckSubprocDelayExpired);
+      expect_true(test.poller_.poll(true));
+      expect_true(test.poller_.subprocsChanged()); // first check always reported
+
+      blockingwait(kCheckSubprocDelayExpired);
+      expect_true(test.poller_.poll(true));
+      expect_false(test.poller_.subprocsChanged()); // same result as before
+
+      test.checkReturns_ = true;
+      blockingwait(kCheckSubprocDelayExpired);
+      expect_true(test.poller_.poll(true));
+      expect_true(test.poller_.subprocsChanged());
+      expect_true(test.poller_.hasNonWhitelistSubprocess());
+   }
+
+   test_that("cwd changes are only reported when cwd changes")
+   {
+      PidType pid = 12345;
+      CwdPollingFixture test(pid);
+
+      test.checkReturns_ = core::FilePath("/tmp");
+      test.poller_.poll(true);
+      blockingwait(kCheckCwdDelayExpired);
+      expect_true(test.poller_.poll(true));
+      expect_true(test.poller_.cwdChanged());
+
+      blockingwait(kCheckCwdDelayExpired);
+      expect_true(test.poller_.poll(true));
+      expect_false(test.poller_.cwdChanged());
+
+      test.checkReturns_ = core::FilePath("/");
+      blockingwait(kCheckCwdDelayExpired);
+      expect_true(test.poller_.poll(true));
+      expect_true(test.poller_.cwdChanged());
+      expect_true(test.poller_.getCwd() == test.checkReturns_);
+   }
 }
 
 } // namespace tests
@@ -31,6 +31,7 @@
 
 #include <sys/wait.h>
 #include <sys/types.h>
+#include <sys/syscall.h>
 
 #include <boost/asio.hpp>
 #include <boost/bind.hpp>
@@ -38,6 +39,7 @@
 #include <shared_core/Error.hpp>
 #include <core/Log.hpp>
 #include <core/system/PosixChildProcess.hpp>
+#include <core/system/PosixProcessSnapshot.hpp>
 #include <core/system/PosixSystem.hpp>
 #include <core/system/PosixUser.hpp>
 #include <core/system/ProcessArgs.hpp>
@@ -907,13 +909,39 @@ struct AsyncChildProcess::AsyncImpl
       : calledOnStarted_(false),
         finishedStdout_(false),
         finishedStderr_(false),
-        exited_(false)
+        exited_(false),
+        fdPid_(-1)
    {
    }
+
+   ~AsyncImpl()
+   {
+      try
+      {
+         closePidFd();
+      }
+      catch(...)
+      {
+      }
+   }
+
+   void closePidFd()
+   {
+      if (fdPid_ != -1)
+      {
+         ::close(fdPid_);
+         fdPid_ = -1;
+      }
+   }
+
    bool calledOnStarted_;
    bool finishedStdout_;
    bool finishedStderr_;
    bool exited_;
+
+   // descriptor which becomes readable when the process exits (where
+   // pidfd_open is supported)
+   int fdPid_;
    boost::scoped_ptr<ChildProcessSubprocPoll> pSubprocPoll_;
 };
 
@@ -999,11 +1027,40 @@ bool AsyncChildProcess::hasRecentOutput() const
       return true;
 }
 
+std::vector<int> AsyncChildProcess::getActivityFds() const
+{
+   std::vector<int> fds;
+   if (!pAsyncImpl_->calledOnStarted_ || pAsyncImpl_->exited_)
+      return fds;
+
+   if (!pAsyncImpl_->finishedStdout_ && pImpl_->fdStdout != -1)
+      fds.push_back(pImpl_->fdStdout);
+   if (!pAsyncImpl_->finishedStderr_ && pImpl_->fdStderr != -1)
+      fds.push_back(pImpl_->fdStderr);
+   if (pAsyncImpl_->fdPid_ != -1)
+      fds.push_back(pAsyncImpl_->fdPid_);
+   return fds;
+}
+
 void AsyncChildProcess::poll()
+{
+   poll(true);
+}
+
+void AsyncChildProcess::poll(bool hadActivity)
 {
    // call onStarted if we haven't yet
    if (!(pAsyncImpl_->calledOnStarted_))
    {
+      // we haven't been able to watch for activity yet
+      hadActivity = true;
+
+#if !defined(__APPLE__) && defined(SYS_pidfd_open)
+      // get a descriptor to watch for exit; without one (kernels before
+      // 5.3) we check for exit on every poll
+      pAsyncImpl_->fdPid_ = static_cast<int>(::syscall(SYS_pidfd_open, pImpl_->pid, 0));
+#endif
+
       // make sure the output pipes are setup for async reading
       setPipeNonBlocking(pImpl_->fdStdout);
 
@@ -1014,11 +1071,16 @@ void AsyncChildProcess::poll()
       else
          setPipeNonBlocking(pImpl_->fdStderr);         
 
-      // setup for subprocess polling
+      // setup for subprocess polling; subprocesses are looked up in a
+      // process table snapshot shared with all other child processes
+      boost::function<std::vector<SubprocInfo> (PidType)> subProcCheck;
+      if (options().reportHasSubprocs)
+         subProcCheck = boost::bind(getSubprocessesFromSnapshot, _1, kCheckSubprocDelay);
+
       pAsyncImpl_->pSubprocPoll_.reset(new ChildProcessSubprocPoll(
          pImpl_->pid,
          kResetRecentDelay, kCheckSubprocDelay, kCheckCwdDelay,
-         options().reportHasSubprocs ? core::system::getSubprocesses : nullptr,
+         subProcCheck,
          options().subprocWhitelist,
          options().trackCwd ? core::system::currentWorkingDir : nullptr));
 
@@ -1041,7 +1103,7 @@ void AsyncChildProcess::poll()
    bool hasRecentOutput = false;
 
    // check stdout and fire event if we got output
-   if (!pAsyncImpl_->finishedStdout_)
+   if (!pAsyncImpl_->finishedStdout_ && hadActivity)
    {
       bool eof;
       std::string out;
@@ -1064,7 +1126,7 @@ void AsyncChildProcess::poll()
    }
 
    // check stderr and fire event if we got output
-   if (!pAsyncImpl_->finishedStderr_)
+   if (!pAsyncImpl_->finishedStderr_ && hadActivity)
    {
       bool eof;
       std::string err;
@@ -1093,15 +1155,22 @@ void AsyncChildProcess::poll()
    // which occurs if the child was reaped by a global handler) in which
    // case we'll allow the exit sequence to proceed and simply pass -1 as
    // the exit status.
+   // (If we're watching for exit with a pidfd, we only need to check when
+   // there has been activity.)
    int status;
-   PidType result = posix::posixCall<PidType>(
-            boost::bind(::waitpid, pImpl_->pid, &status, WNOHANG));
+   PidType result = 0;
+   if (hadActivity || pAsyncImpl_->fdPid_ == -1)
+   {
+      result = posix::posixCall<PidType>(
+               boost::bind(::waitpid, pImpl_->pid, &status, WNOHANG));
+   }
 
    // either a normal exit or an error while waiting
    if (result != 0)
    {
       // close all of our pipes
       pImpl_->closeAll(ERROR_LOCATION);
+      pAsyncImpl_->closePidFd();
 
       // fire exit event
       if (callbacks_.onExit)
@@ -1131,12 +1200,12 @@ void AsyncChildProcess::poll()
    // Perform optional periodic operations
    if (pAsyncImpl_->pSubprocPoll_->poll(hasRecentOutput))
    {
-      if (callbacks_.onHasSubprocs)
+      if (callbacks_.onHasSubprocs && pAsyncImpl_->pSubprocPoll_->subprocsChanged())
       {
          callbacks_.onHasSubprocs(hasNonWhitelistSubprocess(),
                                   hasWhitelistSubprocess());
       }
-      if (callbacks_.reportCwd)
+      if (callbacks_.reportCwd && pAsyncImpl_->pSubprocPoll_->cwdChanged())
       {
          callbacks_.reportCwd(getCwd());
       }
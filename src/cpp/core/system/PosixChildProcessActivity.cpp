@@ -0,0 +1,160 @@
+/*
+ * PosixChildProcessActivity.cpp
+ *
+ * Copyright (C) 2020 by RStudio, PBC
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include "PosixChildProcessActivity.hpp"
+
+#include <algorithm>
+
+#include <errno.h>
+#include <unistd.h>
+
+#ifndef __APPLE__
+#include <sys/epoll.h>
+#endif
+
+#include <shared_core/Error.hpp>
+#include <core/Log.hpp>
+
+namespace rstudio {
+namespace core {
+namespace system {
+
+#ifndef __APPLE__
+
+ChildProcessActivity::ChildProcessActivity()
+   : epollFd_(::epoll_create1(EPOLL_CLOEXEC))
+{
+   if (epollFd_ == -1)
+      LOG_ERROR(systemError(errno, ERROR_LOCATION));
+}
+
+ChildProcessActivity::~ChildProcessActivity()
+{
+   try
+   {
+      if (epollFd_ != -1)
+         ::close(epollFd_);
+   }
+   catch(...)
+   {
+   }
+}
+
+void ChildProcessActivity::watch(AsyncChildProcess* pChild,
+                                 const std::vector<int>& fds)
+{
+   if (epollFd_ == -1)
+      return;
+
+   std::vector<int>& watched = childFds_[pChild];
+
+   // stop watching descriptors the child no longer has. the descriptor may
+   // already be closed (in which case it was removed from the set when it
+   // was closed) so failures here are expected. the descriptor number may
+   // also have been reused by another child, in which case it's left alone
+   for (int fd : watched)
+   {
+      if (std::find(fds.begin(), fds.end(), fd) != fds.end())
+         continue;
+
+      std::map<int, AsyncChildProcess*>::iterator it = fdChildren_.find(fd);
+      if (it != fdChildren_.end() && it->second == pChild)
+      {
+         ::epoll_ctl(epollFd_, EPOLL_CTL_DEL, fd, nullptr);
+         fdChildren_.erase(it);
+      }
+   }
+
+   // start watching new ones
+   for (int fd : fds)
+   {
+      if (std::find(watched.begin(), watched.end(), fd) != watched.end())
+         continue;
+
+      struct epoll_event event = {};
+      event.events = EPOLLIN;
+      event.data.fd = fd;
+      if (::epoll_ctl(epollFd_, EPOLL_CTL_ADD, fd, &event) == -1 &&
+          errno != EEXIST)
+      {
+         LOG_ERROR(systemError(errno, ERROR_LOCATION));
+         continue;
+      }
+      fdChildren_[fd] = pChild;
+   }
+
+   if (fds.empty())
+      childFds_.erase(pChild);
+   else
+      watched = fds;
+}
+
+Error ChildProcessActivity::wait(const boost::posix_time::time_duration& timeout,
+                                 std::set<AsyncChildProcess*>* pActive)
+{
+   if (epollFd_ == -1)
+      return systemError(boost::system::errc::bad_file_descriptor, ERROR_LOCATION);
+
+   int timeoutMs = static_cast<int>(std::max<int64_t>(timeout.total_milliseconds(), 0));
+
+   // room for every watched descriptor, so one call finds all the activity
+   std::vector<struct epoll_event> events(std::max<std::size_t>(fdChildren_.size(), 1));
+
+   int count;
+   do
+   {
+      count = ::epoll_wait(epollFd_, &events[0], static_cast<int>(events.size()), timeoutMs);
+   } while (count == -1 && errno == EINTR);
+
+   if (count == -1)
+      return systemError(errno, ERROR_LOCATION);
+
+   for (int i = 0; i < count; i++)
+   {
+      std::map<int, AsyncChildProcess*>::const_iterator it =
+            fdChildren_.find(events[i].data.fd);
+      if (it != fdChildren_.end())
+         pActive->insert(it->second);
+   }
+
+   return Success();
+}
+
+#else
+
+ChildProcessActivity::ChildProcessActivity()
+   : epollFd_(-1)
+{
+}
+
+ChildProcessActivity::~ChildProcessActivity()
+{
+}
+
+void ChildProcessActivity::watch(AsyncChildProcess*, const std::vector<int>&)
+{
+}
+
+Error ChildProcessActivity::wait(const boost::posix_time::time_duration&,
+                                 std::set<AsyncChildProcess*>*)
+{
+   return systemError(boost::system::errc::not_supported, ERROR_LOCATION);
+}
+
+#endif // !__APPLE__
+
+} // namespace system
+} // namespace core
+} // namespace rstudio
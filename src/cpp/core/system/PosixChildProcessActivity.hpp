@@ -0,0 +1,67 @@
+/*
+ * PosixChildProcessActivity.hpp
+ *
+ * Copyright (C) 2020 by RStudio, PBC
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef CORE_SYSTEM_POSIX_CHILD_PROCESS_ACTIVITY_HPP
+#define CORE_SYSTEM_POSIX_CHILD_PROCESS_ACTIVITY_HPP
+
+#include <map>
+#include <set>
+#include <vector>
+
+#include <boost/date_time/posix_time/posix_time_duration.hpp>
+#include <boost/utility.hpp>
+
+namespace rstudio {
+namespace core {
+
+class Error;
+
+namespace system {
+
+class AsyncChildProcess;
+
+// Watches the activity descriptors of a set of child processes (see
+// AsyncChildProcess::getActivityFds) in a single epoll set, so a supervisor
+// can find out which of its children have output or have exited without
+// reading from all of them. Only available on Linux; elsewhere
+// isAvailable() is false and every child should simply be polled.
+class ChildProcessActivity : boost::noncopyable
+{
+public:
+   ChildProcessActivity();
+   ~ChildProcessActivity();
+
+   bool isAvailable() const { return epollFd_ != -1; }
+
+   // watch the given descriptors of a child (replacing any it had before);
+   // passing no descriptors stops watching the child
+   void watch(AsyncChildProcess* pChild, const std::vector<int>& fds);
+
+   // wait up to timeout for activity, adding the children with any to
+   // pActive (a timeout of zero doesn't block)
+   Error wait(const boost::posix_time::time_duration& timeout,
+              std::set<AsyncChildProcess*>* pActive);
+
+private:
+   int epollFd_;
+   std::map<int, AsyncChildProcess*> fdChildren_;
+   std::map<AsyncChildProcess*, std::vector<int> > childFds_;
+};
+
+} // namespace system
+} // namespace core
+} // namespace rstudio
+
+#endif // CORE_SYSTEM_POSIX_CHILD_PROCESS_ACTIVITY_HPP
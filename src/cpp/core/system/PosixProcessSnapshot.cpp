@@ -0,0 +1,232 @@
+/*
+ * PosixProcessSnapshot.cpp
+ *
+ * Copyright (C) 2020 by RStudio, PBC
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include <core/system/PosixProcessSnapshot.hpp>
+
+#include <cctype>
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include <shared_core/Error.hpp>
+#include <shared_core/FilePath.hpp>
+#include <shared_core/SafeConvert.hpp>
+
+#include <core/BoostThread.hpp>
+#include <core/Log.hpp>
+#include <core/system/PosixSystem.hpp>
+
+namespace rstudio {
+namespace core {
+namespace system {
+
+namespace {
+
+bool isNumber(const char* pString)
+{
+   if (*pString == '\0')
+      return false;
+
+   for (; *pString != '\0'; ++pString)
+   {
+      if (!std::isdigit(static_cast<unsigned char>(*pString)))
+         return false;
+   }
+   return true;
+}
+
+// read the start of a file (which for a stat file is all we need)
+bool readFileStart(const std::string& path, std::string* pContents)
+{
+   int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+   if (fd == -1)
+      return false;
+
+   char buffer[1024];
+   ssize_t size;
+   do
+   {
+      size = ::read(fd, buffer, sizeof(buffer));
+   } while (size == -1 && errno == EINTR);
+   ::close(fd);
+
+   if (size <= 0)
+      return false;
+
+   pContents->assign(buffer, size);
+   return true;
+}
+
+} // anonymous namespace
+
+Error ProcessSnapshot::read(const FilePath& procFsPath)
+{
+   children_.clear();
+   size_ = 0;
+
+   std::string procFsDir = procFsPath.getAbsolutePath();
+   DIR* pDir = ::opendir(procFsDir.c_str());
+   if (pDir == nullptr)
+   {
+      Error error = systemError(errno, ERROR_LOCATION);
+      error.addProperty("path", procFsPath);
+      return error;
+   }
+
+   std::string contents;
+   while (struct dirent* pEntry = ::readdir(pDir))
+   {
+      // only interested in the numeric directories (pid)
+      if (!isNumber(pEntry->d_name))
+         continue;
+
+      // the process may have exited since we listed it
+      if (!readFileStart(procFsDir + "/" + pEntry->d_name + "/stat", &contents))
+         continue;
+
+      SubprocInfo info;
+      PidType parentPid;
+      if (parseStat(contents, &info, &parentPid))
+      {
+         children_[parentPid].push_back(info);
+         size_++;
+      }
+   }
+
+   ::closedir(pDir);
+   return Success();
+}
+
+std::vector<SubprocInfo> ProcessSnapshot::children(PidType pid) const
+{
+   std::unordered_map<PidType, std::vector<SubprocInfo> >::const_iterator it =
+         children_.find(pid);
+   if (it == children_.end())
+      return std::vector<SubprocInfo>();
+   return it->second;
+}
+
+bool ProcessSnapshot::parseStat(const std::string& contents,
+                                SubprocInfo* pInfo,
+                                PidType* pParentPid)
+{
+   // The parent pid is the fourth field (whitespace separated) in the
+   // single-line of the stat file. The first field is an int, second field
+   // is a string enclosed in parenthesis (...), the third is a single
+   // character, and the fourth is the parent pid (int). There are numerous
+   // fields after that, all ints of varying sizes.
+   //
+   // The trick is that the third field can contain arbitrary text,
+   // including whitespace and more parenthesis, inside its surrounding
+   // parenthesis. The safe way to parse this is to search the file
+   // in reverse for the closing parenthesis, then seek forward until we
+   // reach the first integer character.
+   //
+   // An example:
+   //    4075 (My )(great Program) S 4074 ....
+
+   size_t closingParen = contents.find_last_of(')');
+   if (closingParen == std::string::npos)
+   {
+      LOG_ERROR_MESSAGE("no closing parenthesis");
+      return false;
+   }
+
+   size_t i = contents.find_first_of("0123456789", closingParen);
+   if (i == std::string::npos)
+   {
+      LOG_ERROR_MESSAGE("no integer after closing parenthesis");
+      return false;
+   }
+
+   size_t j = contents.find_first_not_of("0123456789", i);
+   if (j == std::string::npos)
+   {
+      LOG_ERROR_MESSAGE("no non-int after first int");
+      return false;
+   }
+
+   *pParentPid = safe_convert::stringTo<PidType>(contents.substr(i, j - i), -1);
+   if (*pParentPid == -1)
+   {
+      LOG_ERROR_MESSAGE("unrecognized parent process id");
+      return false;
+   }
+
+   size_t openParen = contents.find_first_of('(');
+   if (openParen == std::string::npos)
+   {
+      LOG_ERROR_MESSAGE("no opening parenthesis");
+      return false;
+   }
+   if (openParen < 2) // at a minimum, "# (foo)"
+   {
+      LOG_ERROR_MESSAGE("no pid before exe name");
+      return false;
+   }
+   if (closingParen < openParen)
+   {
+      LOG_ERROR_MESSAGE("closing paren before open paren");
+      return false;
+   }
+
+   pInfo->exe = contents.substr(openParen + 1, closingParen - openParen - 1);
+   pInfo->pid = safe_convert::stringTo<PidType>(contents.substr(0, openParen - 1), -1);
+   if (pInfo->pid == -1)
+   {
+      LOG_ERROR_MESSAGE("unrecognized child process id");
+      return false;
+   }
+
+   return true;
+}
+
+std::vector<SubprocInfo> getSubprocessesFromSnapshot(
+                                 PidType pid,
+                                 boost::posix_time::time_duration maxAge)
+{
+#ifdef __APPLE__
+   return getSubprocessesMac(pid);
+#else
+   FilePath procFsPath("/proc");
+   if (!procFsPath.exists())
+      return getSubprocessesViaPgrep(pid);
+
+   static boost::mutex s_mutex;
+   static ProcessSnapshot s_snapshot;
+   static boost::posix_time::ptime s_readTime;
+
+   boost::lock_guard<boost::mutex> lock(s_mutex);
+
+   boost::posix_time::ptime now = boost::posix_time::microsec_clock::universal_time();
+   if (s_readTime.is_not_a_date_time() || now - s_readTime >= maxAge)
+   {
+      Error error = s_snapshot.read(procFsPath);
+      if (error)
+         LOG_ERROR(error);
+      s_readTime = now;
+   }
+
+   return s_snapshot.children(pid);
+#endif
+}
+
+} // namespace system
+} // namespace core
+} // namespace rstudio
@@ -14,6 +14,7 @@
  */
 
 #include <core/system/PosixSystem.hpp>
+#include <core/system/PosixProcessSnapshot.hpp>
 
 #include <stdio.h>
 
@@ -1063,127 +1064,23 @@ std::vector<SubprocInfo> getSubprocessesMac(PidType pid)
 
 std::vector<SubprocInfo> getSubprocessesViaProcFs(PidType pid)
 {
-   std::vector<SubprocInfo> subprocs;
-
    core::FilePath procFsPath("/proc");
    if (!procFsPath.exists())
    {
       return getSubprocessesViaPgrep(pid);
    }
 
-   // We iterate all /proc/###/stat files, where ### is a process id.
-   //
-   // The parent pid is the fourth field (whitespace separated) in the
-   // single-line of the stat file. The first field is an int, second field
-   // is a string enclosed in parenthesis (...), the third is a single
-   // character, and the fourth is the parent pid (int). There are numerous
-   // fields after that, all ints of varying sizes.
-   //
-   // The trick is that the third field can contain arbitrary text,
-   // including whitespace and more parenthesis, inside its surrounding
-   // parenthesis. The safe way to parse this is to search the file
-   // in reverse for the closing parenthesis, then seek forward until we
-   // reach the first integer character.
-   //
-   // An example:
-   //    4075 (My )(great Program) S 4074 ....
-
-   std::vector<FilePath> children;
-   Error error = procFsPath.getChildren(children);
+   // We read all /proc/###/stat files, where ### is a process id, and
+   // index them by parent pid
+   ProcessSnapshot snapshot;
+   Error error = snapshot.read(procFsPath);
    if (error)
    {
       LOG_ERROR(error);
-      return subprocs;
-   }
-
-   for (const FilePath& child : children)
-   {
-      // only interested in the numeric directories (pid)
-      std::string filename = child.getFilename();
-      bool isNumber = true;
-      for (std::string::const_iterator k = filename.begin(); k != filename.end(); ++k)
-      {
-         if (!isdigit(*k))
-         {
-            isNumber = false;
-            break;
-         }
-      }
-
-      if (!isNumber)
-         continue;
-
-      // load the stat file
-      std::string contents;
-      FilePath statFile(child.completePath("stat"));
-      Error error = rstudio::core::readStringFromFile(statFile, &contents);
-      if (error)
-      {
-         continue;
-      }
-
-      size_t closingParen = contents.find_last_of(')');
-      if (closingParen == std::string::npos)
-      {
-         LOG_ERROR_MESSAGE("no closing parenthesis");
-         continue;
-      }
-
-      size_t i = contents.find_first_of("0123456789", closingParen);
-      if (i == std::string::npos)
-      {
-         LOG_ERROR_MESSAGE("no integer after closing parenthesis");
-         continue;
-      }
-
-      size_t j = contents.find_first_not_of("0123456789", i);
-      if (j == std::string::npos)
-      {
-         LOG_ERROR_MESSAGE("no non-int after first int");
-         continue;
-      }
-
-      size_t ppidLen = j - i;
-      PidType ppid = safe_convert::stringTo<PidType>(contents.substr(i, ppidLen), -1);
-      if (ppid == -1)
-      {
-         LOG_ERROR_MESSAGE("unrecognized parent process id");
-         continue;
-      }
-      if (ppid != pid)
-      {
-         continue;
-      }
-
-      size_t openParen = contents.find_first_of('(');
-      if (openParen == std::string::npos)
-      {
-         LOG_ERROR_MESSAGE("no opening parenthesis");
-         continue;
-      }
-      if (openParen < 2) // at a minimum, "# (foo)"
-      {
-         LOG_ERROR_MESSAGE("no pid before exe name");
-         continue;
-      }
-      if (closingParen < openParen)
-      {
-         LOG_ERROR_MESSAGE("closing paren before open paren");
-         continue;
-      }
-
-      SubprocInfo info;
-      info.exe = contents.substr(openParen + 1, closingParen - openParen - 1);
-      info.pid = safe_convert::stringTo<PidType>(contents.substr(0, openParen - 1), -1);
-      if (info.pid == -1)
-      {
-         LOG_ERROR_MESSAGE("unrecognized child process id");
-         continue;
-      }
-      subprocs.push_back(info);
+      return std::vector<SubprocInfo>();
    }
 
-   return subprocs;
+   return snapshot.children(pid);
 }
 #endif // !__APPLE__
 
@@ -15,6 +15,7 @@
 
 #ifndef _WIN32
 
+#include <core/system/PosixProcessSnapshot.hpp>
 #include <core/system/PosixSystem.hpp>
 #include <signal.h>
 #include <sys/wait.h>
@@ -239,6 +240,57 @@ test_context("PosixSystemTests")
          ::waitpid(pid, nullptr, 0);
       }
    }
+
+   test_that("Process stat files are parsed correctly")
+   {
+      SubprocInfo info;
+      PidType parentPid;
+      expect_true(ProcessSnapshot::parseStat(
+                     "4075 (My )(great Program) S 4074 4075 4074 0 -1",
+                     &info, &parentPid));
+      expect_true(info.pid == 4075);
+      expect_true(info.exe == "My )(great Program");
+      expect_true(parentPid == 4074);
+
+      expect_false(ProcessSnapshot::parseStat("4075 S 4074", &info, &parentPid));
+   }
+
+   test_that("Subprocess detected correctly with process snapshot")
+   {
+      pid_t pid = fork();
+      expect_false(pid == -1);
+      std::string exe = "sleep";
+
+      if (pid == 0)
+      {
+         execlp(exe.c_str(), exe.c_str(), "10000", nullptr);
+         expect_true(false); // shouldn't get here!
+      }
+      else
+      {
+         ::sleep(1);
+         ProcessSnapshot snapshot;
+         expect_false(snapshot.read(FilePath("/proc")));
+         expect_true(snapshot.size() > 1);
+
+         bool found = false;
+         for (const SubprocInfo& info : snapshot.children(getpid()))
+         {
+            if (info.pid == pid && info.exe == exe)
+               found = true;
+         }
+         expect_true(found);
+         expect_true(snapshot.children(pid).empty());
+
+         // a fresh snapshot sees the subprocess too
+         std::vector<SubprocInfo> children =
+               getSubprocessesFromSnapshot(getpid(), boost::posix_time::seconds(0));
+         expect_true(children.size() >= 1);
+
+         ::kill(pid, SIGKILL);
+         ::waitpid(pid, nullptr, 0);
+      }
+   }
 #endif // !__APPLE__
 
    test_that("Empty list of subprocesses returned correctly with generic method")
@@ -16,6 +16,7 @@
 #include <core/system/Process.hpp>
 
 #include <iostream>
+#include <set>
 
 #include <boost/algorithm/cxx11/any_of.hpp>
 #include <boost/bind.hpp>
@@ -28,6 +29,10 @@
 #include <core/PerformanceTimer.hpp>
 #include <core/system/ChildProcess.hpp>
 
+#ifndef _WIN32
+#include "PosixChildProcessActivity.hpp"
+#endif
+
 namespace rstudio {
 namespace core {
 namespace system {
@@ -71,6 +76,12 @@ struct ProcessSupervisor::Impl
    Impl() : isPolling(false) {}
    bool isPolling;
    std::vector<boost::shared_ptr<AsyncChildProcess> > children;
+
+#ifndef _WIN32
+   // the output and exit descriptors of the children, so that only those
+   // with activity need to read output or check for exit
+   ChildProcessActivity activity;
+#endif
 };
 
 ProcessSupervisor::ProcessSupervisor()
@@ -324,9 +335,30 @@ bool ProcessSupervisor::poll()
    // the children vector and if this requried a realloc would invalidate
    // all of the iterators currently pointing into the container
    std::vector<boost::shared_ptr<AsyncChildProcess> > children = pImpl_->children;
-   std::for_each(children.begin(),
-                 children.end(),
-                 boost::bind(&AsyncChildProcess::poll, _1));
+#ifndef _WIN32
+   if (pImpl_->activity.isAvailable())
+   {
+      // find the children with activity (without waiting)
+      std::set<AsyncChildProcess*> active;
+      Error error = pImpl_->activity.wait(boost::posix_time::milliseconds(0), &active);
+      if (error)
+         LOG_ERROR(error);
+
+      // every child is still polled (so that e.g. onContinue is called),
+      // but only those with activity read output or check for exit
+      for (const boost::shared_ptr<AsyncChildProcess>& pChild : children)
+      {
+         pChild->poll(error || active.count(pChild.get()) > 0);
+         pImpl_->activity.watch(pChild.get(), pChild->getActivityFds());
+      }
+   }
+   else
+#endif
+   {
+      std::for_each(children.begin(),
+                    children.end(),
+                    boost::bind(&AsyncChildProcess::poll, _1));
+   }
 
    // remove any children who have exited from our list. note that it's safe
    // in this case to use pImpl_->children directly because the call to
@@ -363,8 +395,16 @@ bool ProcessSupervisor::wait(
 
    while (poll())
    {
-      // wait the specified polling interval
-      boost::this_thread::sleep(pollingInterval);
+      // wait the specified polling interval (or, where we can, until a
+      // child has activity if that comes sooner)
+#ifndef _WIN32
+      std::set<AsyncChildProcess*> active;
+      if (!pImpl_->activity.isAvailable() ||
+          pImpl_->activity.wait(pollingInterval, &active))
+#endif
+      {
+         boost::this_thread::sleep(pollingInterval);
+      }
 
       // check for timeout if appropriate
       if (!timeoutTime.is_not_a_date_time())
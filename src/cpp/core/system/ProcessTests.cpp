@@ -17,6 +17,9 @@
 
 #include <atomic>
 
+#include <sys/syscall.h>
+#include <unistd.h>
+
 #include <boost/bind.hpp>
 #include <boost/thread.hpp>
 
@@ -33,6 +36,22 @@ namespace core {
 namespace system {
 namespace tests {
 
+// whether processes' exits can be waited for with pidfd_open (the kernel
+// may not support it, or a seccomp filter may deny it)
+bool pidfdOpenSupported()
+{
+#if !defined(__APPLE__) && defined(SYS_pidfd_open)
+   int fd = static_cast<int>(::syscall(SYS_pidfd_open, ::getpid(), 0));
+   if (fd == -1)
+      return false;
+
+   ::close(fd);
+   return true;
+#else
+   return false;
+#endif
+}
+
 void checkExitCode(int exitCode, int* outExitCode)
 {
    *outExitCode = exitCode;
@@ -441,6 +460,55 @@ test_context("ProcessTests")
       // check to make sure all processes really exited
       CHECK(numExited == 10);
    }
+
+   test_that("ProcessSupervisor returns output and exit status")
+   {
+      ProcessSupervisor supervisor;
+
+      ProcessOptions options;
+      ProcessCallbacks callbacks;
+
+      int exitCode = -1;
+      std::string output;
+      std::string error;
+      callbacks.onExit = boost::bind(&checkExitCode, _1, &exitCode);
+      callbacks.onStdout = boost::bind(&appendOutput, _2, &output);
+      callbacks.onStderr = boost::bind(&appendOutput, _2, &error);
+
+      supervisor.runCommand("echo out; echo err 1>&2; sleep 1; echo more; exit 3",
+                            options,
+                            callbacks);
+
+      bool success = supervisor.wait(boost::posix_time::milliseconds(50),
+                                     boost::posix_time::seconds(10));
+
+      CHECK(success);
+      CHECK(exitCode == 3);
+      CHECK(output == "out\nmore\n");
+      CHECK(error == "err\n");
+   }
+
+   test_that("ProcessSupervisor waits for activity rather than the polling interval")
+   {
+      ProcessSupervisor supervisor;
+
+      // a process which closes its output well before it exits
+      int exitCode = -1;
+      ProcessCallbacks callbacks;
+      callbacks.onExit = boost::bind(&checkExitCode, _1, &exitCode);
+      supervisor.runCommand("exec 1>&- 2>&-; sleep 1", ProcessOptions(), callbacks);
+
+      boost::posix_time::ptime start = boost::posix_time::microsec_clock::universal_time();
+      bool success = supervisor.wait(boost::posix_time::seconds(30),
+                                     boost::posix_time::seconds(60));
+      boost::posix_time::time_duration elapsed =
+            boost::posix_time::microsec_clock::universal_time() - start;
+
+      CHECK(success);
+      CHECK(exitCode == 0);
+      if (pidfdOpenSupported())
+         CHECK(elapsed < boost::posix_time::seconds(10));
+   }
 }
 
 } // end namespace tests
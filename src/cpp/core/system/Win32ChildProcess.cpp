@@ -789,12 +789,12 @@ void AsyncChildProcess::poll()
    // Perform optional periodic operations
    if (pAsyncImpl_->pSubprocPoll_->poll(hasRecentOutput))
    {
-      if (callbacks_.onHasSubprocs)
+      if (callbacks_.onHasSubprocs && pAsyncImpl_->pSubprocPoll_->subprocsChanged())
       {
          callbacks_.onHasSubprocs(hasNonWhitelistSubprocess(),
                                   hasWhitelistSubprocess());
       }
-      if (callbacks_.reportCwd)
+      if (callbacks_.reportCwd && pAsyncImpl_->pSubprocPoll_->cwdChanged())
       {
          callbacks_.reportCwd(getCwd());
       }
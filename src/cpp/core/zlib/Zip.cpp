@@ -0,0 +1,1006 @@
+/*
+ * Zip.cpp
+ *
+ * Copyright (C) 2020 by RStudio, PBC
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include <core/zlib/Zip.hpp>
+
+#include <algorithm>
+#include <ctime>
+#include <iostream>
+#include <memory>
+#include <new>
+
+#ifndef _WIN32
+#include <sys/stat.h>
+#endif
+
+#include <boost/algorithm/string/replace.hpp>
+#include <boost/algorithm/string/split.hpp>
+#include <boost/date_time/c_local_time_adjustor.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include <core/Log.hpp>
+
+#include "zlib.h"
+
+namespace rstudio {
+namespace core {
+namespace zlib {
+
+namespace {
+
+// record signatures
+const uint32_t kLocalHeaderSignature = 0x04034b50;
+const uint32_t kDataDescriptorSignature = 0x08074b50;
+const uint32_t kCentralHeaderSignature = 0x02014b50;
+const uint32_t kEndOfCentralDirSignature = 0x06054b50;
+const uint32_t kZip64EndOfCentralDirSignature = 0x06064b50;
+const uint32_t kZip64LocatorSignature = 0x07064b50;
+
+// record sizes (excluding variable length fields)
+const std::size_t kLocalHeaderSize = 30;
+const std::size_t kCentralHeaderSize = 46;
+const std::size_t kEndOfCentralDirSize = 22;
+const std::size_t kZip64EndOfCentralDirSize = 56;
+const std::size_t kZip64LocatorSize = 20;
+
+const uint16_t kZip64ExtraField = 0x0001;
+
+// general purpose flags
+const uint16_t kFlagEncrypted = 0x0001;
+const uint16_t kFlagDataDescriptor = 0x0008;
+const uint16_t kFlagUtf8 = 0x0800;
+
+const uint16_t kMethodStored = 0;
+const uint16_t kMethodDeflated = 8;
+
+const uint16_t kVersionNeeded = 20;
+const uint16_t kVersionNeededZip64 = 45;
+#ifndef _WIN32
+const uint16_t kVersionMadeBy = (3 << 8) | kVersionNeededZip64; // unix
+#else
+const uint16_t kVersionMadeBy = kVersionNeededZip64; // ms-dos
+#endif
+
+const uint32_t kDosDirectoryAttribute = 0x10;
+
+const uint16_t kMax16 = 0xFFFF;
+const uint32_t kMax32 = 0xFFFFFFFF;
+
+// files at least this large are written with zip64 sizes (since deflating
+// them could make them larger than 4GB)
+const uint64_t kZip64Threshold = 0xFF000000;
+
+const std::size_t kBlockSize = 65536;
+
+void put16(std::string* pOut, uint16_t value)
+{
+   pOut->push_back(static_cast<char>(value & 0xFF));
+   pOut->push_back(static_cast<char>((value >> 8) & 0xFF));
+}
+
+void put32(std::string* pOut, uint32_t value)
+{
+   put16(pOut, static_cast<uint16_t>(value & 0xFFFF));
+   put16(pOut, static_cast<uint16_t>(value >> 16));
+}
+
+void put64(std::string* pOut, uint64_t value)
+{
+   put32(pOut, static_cast<uint32_t>(value & 0xFFFFFFFF));
+   put32(pOut, static_cast<uint32_t>(value >> 32));
+}
+
+uint16_t get16(const std::string& data, std::size_t pos)
+{
+   return static_cast<uint16_t>(static_cast<unsigned char>(data[pos]) |
+                                static_cast<unsigned char>(data[pos + 1]) << 8);
+}
+
+uint32_t get32(const std::string& data, std::size_t pos)
+{
+   return static_cast<uint32_t>(get16(data, pos)) |
+          static_cast<uint32_t>(get16(data, pos + 2)) << 16;
+}
+
+uint64_t get64(const std::string& data, std::size_t pos)
+{
+   return static_cast<uint64_t>(get32(data, pos)) |
+          static_cast<uint64_t>(get32(data, pos + 4)) << 32;
+}
+
+uint32_t crc(uint32_t crc, const char* data, std::size_t size)
+{
+   return static_cast<uint32_t>(
+            ::crc32(crc, reinterpret_cast<const Bytef*>(data), static_cast<uInt>(size)));
+}
+
+Error invalidArchiveError(const std::string& reason,
+                          const FilePath& zipFile,
+                          const ErrorLocation& location)
+{
+   Error error = systemError(boost::system::errc::illegal_byte_sequence,
+                             "Invalid zip archive: " + reason,
+                             location);
+   error.addProperty("path", zipFile);
+   return error;
+}
+
+Error zlibError(int res, const std::string& message, const ErrorLocation& location)
+{
+   return systemError(boost::system::errc::io_error,
+                      message + " (zlib error " + std::to_string(res) + ")",
+                      location);
+}
+
+void freeDeflateStream(z_stream* pStream)
+{
+   (void)deflateEnd(pStream);
+   delete pStream;
+}
+
+void freeInflateStream(z_stream* pStream)
+{
+   (void)inflateEnd(pStream);
+   delete pStream;
+}
+
+// a value-initialised stream (so with zlib's default allocators and no
+// input), or null if it couldn't be allocated
+std::unique_ptr<z_stream> newStream()
+{
+   return std::unique_ptr<z_stream>(new (std::nothrow) z_stream());
+}
+
+// ms-dos date and time in local time (as zip archives record them)
+void toDosDateTime(std::time_t time, uint16_t* pDate, uint16_t* pTime)
+{
+   using namespace boost::posix_time;
+   typedef boost::date_time::c_local_adjustor<ptime> local_adjustor;
+
+   ptime local = local_adjustor::utc_to_local(from_time_t(time));
+   int year = local.date().year();
+   if (year < 1980)
+   {
+      *pDate = (1 << 5) | 1; // 1980-01-01
+      *pTime = 0;
+      return;
+   }
+
+   time_duration timeOfDay = local.time_of_day();
+   *pDate = static_cast<uint16_t>(((year - 1980) << 9) |
+                                  (local.date().month() << 5) |
+                                  local.date().day());
+   *pTime = static_cast<uint16_t>((timeOfDay.hours() << 11) |
+                                  (timeOfDay.minutes() << 5) |
+                                  (timeOfDay.seconds() / 2));
+}
+
+uint32_t externalAttributes(const FilePath& path, bool isDirectory)
+{
+   uint32_t attributes = isDirectory ? kDosDirectoryAttribute : 0;
+#ifndef _WIN32
+   struct stat st;
+   if (::stat(path.getAbsolutePath().c_str(), &st) == 0)
+      attributes |= static_cast<uint32_t>(st.st_mode) << 16;
+#endif
+   return attributes;
+}
+
+// is the path itself a symbolic link? (unlike FilePath::isSymlink, true for
+// links whose target doesn't exist)
+bool isLink(const FilePath& path)
+{
+#ifndef _WIN32
+   struct stat st;
+   return ::lstat(path.getAbsolutePath().c_str(), &st) == 0 && S_ISLNK(st.st_mode);
+#else
+   return path.isSymlink();
+#endif
+}
+
+struct Record : public ZipEntry
+{
+   Record() : date(0), time(0), zip64(false) {}
+
+   uint16_t date;
+   uint16_t time;
+   bool zip64;
+};
+
+} // anonymous namespace
+
+struct ZipWriter::Impl
+{
+   Impl(const FilePath& parentPath, int compressionLevel)
+      : parentPath(parentPath),
+        compressionLevel(compressionLevel),
+        position(0),
+        remaining(0),
+        finished(false)
+   {
+   }
+
+   void put(const std::string& data)
+   {
+      buffer.append(data);
+      position += data.size();
+   }
+
+   Error beginEntry(const FilePath& path, const std::string& name);
+   Error continueEntry();
+   void writeLocalHeader(const Record& record);
+   void writeCentralDirectory();
+
+   FilePath parentPath;
+   int compressionLevel;
+
+   // the files and directories still to be written (as a stack)
+   std::vector<std::pair<FilePath, std::string> > pending;
+
+   // the entries written so far
+   std::vector<Record> records;
+
+   // output not yet read and the size of the archive so far
+   std::string buffer;
+   uint64_t position;
+
+   // the file being written
+   std::shared_ptr<std::istream> pInput;
+   boost::shared_ptr<z_stream> pStream;
+   Record current;
+   uint64_t remaining;
+   std::vector<char> inputBlock;
+   std::vector<char> outputBlock;
+
+   bool finished;
+};
+
+Error ZipWriter::Impl::beginEntry(const FilePath& path, const std::string& name)
+{
+   Record record;
+   record.name = name;
+   record.versionMadeBy = kVersionMadeBy;
+   record.flags = kFlagUtf8;
+   record.offset = position;
+   toDosDateTime(path.getLastWriteTime(), &record.date, &record.time);
+
+   if (path.isDirectory())
+   {
+      record.name += "/";
+      record.method = kMethodStored;
+      record.externalAttributes = externalAttributes(path, true);
+      writeLocalHeader(record);
+      records.push_back(record);
+
+      // queue the directory's contents (in order, but don't follow links to
+      // directories, which could be cyclic)
+      if (path.isSymlink())
+         return Success();
+
+      std::vector<FilePath> children;
+      Error error = path.getChildren(children);
+      if (error)
+      {
+         LOG_ERROR(error);
+         return Success();
+      }
+
+      std::sort(children.begin(), children.end());
+      for (auto it = children.rbegin(); it != children.rend(); ++it)
+         pending.push_back(std::make_pair(*it, record.name + it->getFilename()));
+
+      return Success();
+   }
+
+   // skip files we can't read (as zip does)
+   Error error = path.openForRead(pInput);
+   if (error)
+   {
+      LOG_ERROR(error);
+      return Success();
+   }
+
+   std::unique_ptr<z_stream> pNewStream = newStream();
+   if (!pNewStream)
+   {
+      pInput.reset();
+      return systemError(boost::system::errc::not_enough_memory, ERROR_LOCATION);
+   }
+
+   int res = deflateInit2(pNewStream.get(),
+                          compressionLevel,
+                          Z_DEFLATED,
+                          -MAX_WBITS, // raw deflate
+                          8,
+                          Z_DEFAULT_STRATEGY);
+   if (res != Z_OK)
+   {
+      pInput.reset();
+      return zlibError(res, "Unable to initialize compression", ERROR_LOCATION);
+   }
+   pStream.reset(pNewStream.release(), freeDeflateStream);
+
+   // the size is read up front (and the file read only that far) so that
+   // we know whether its sizes must be written in zip64 format
+   remaining = path.getSize();
+   record.flags |= kFlagDataDescriptor;
+   record.method = kMethodDeflated;
+   record.externalAttributes = externalAttributes(path, false);
+   record.zip64 = remaining >= kZip64Threshold;
+   writeLocalHeader(record);
+   current = record;
+
+   return Success();
+}
+
+Error ZipWriter::Impl::continueEntry()
+{
+   // read the next block of the file
+   std::size_t toRead = static_cast<std::size_t>(
+            std::min(remaining, static_cast<uint64_t>(kBlockSize)));
+   std::size_t read = 0;
+   if (toRead > 0)
+   {
+      pInput->read(&inputBlock[0], toRead);
+      read = static_cast<std::size_t>(pInput->gcount());
+   }
+
+   bool last = read < toRead || remaining == read;
+   remaining -= read;
+   current.crc = crc(current.crc, &inputBlock[0], read);
+   current.uncompressedSize += read;
+
+   // deflate it
+   pStream->next_in = reinterpret_cast<Bytef*>(&inputBlock[0]);
+   pStream->avail_in = static_cast<uInt>(read);
+   int flush = last ? Z_FINISH : Z_NO_FLUSH;
+   do
+   {
+      pStream->next_out = reinterpret_cast<Bytef*>(&outputBlock[0]);
+      pStream->avail_out = static_cast<uInt>(outputBlock.size());
+      int res = deflate(pStream.get(), flush);
+      if (res == Z_STREAM_ERROR)
+         return zlibError(res, "Unable to compress " + current.name, ERROR_LOCATION);
+
+      std::size_t produced = outputBlock.size() - pStream->avail_out;
+      put(std::string(&outputBlock[0], produced));
+      current.compressedSize += produced;
+   } while (pStream->avail_out == 0);
+
+   if (!last)
+      return Success();
+
+   // the sizes and checksum follow the data
+   std::string descriptor;
+   put32(&descriptor, kDataDescriptorSignature);
+   put32(&descriptor, current.crc);
+   if (current.zip64)
+   {
+      put64(&descriptor, current.compressedSize);
+      put64(&descriptor, current.uncompressedSize);
+   }
+   else
+   {
+      put32(&descriptor, static_cast<uint32_t>(current.compressedSize));
+      put32(&descriptor, static_cast<uint32_t>(current.uncompressedSize));
+   }
+   put(descriptor);
+
+   records.push_back(current);
+   pInput.reset();
+   pStream.reset();
+   return Success();
+}
+
+void ZipWriter::Impl::writeLocalHeader(const Record& record)
+{
+   std::string extra;
+   if (record.zip64)
+   {
+      put16(&extra, kZip64ExtraField);
+      put16(&extra, 16);
+      put64(&extra, 0);
+      put64(&extra, 0);
+   }
+
+   std::string header;
+   put32(&header, kLocalHeaderSignature);
+   put16(&header, record.zip64 ? kVersionNeededZip64 : kVersionNeeded);
+   put16(&header, record.flags);
+   put16(&header, record.method);
+   put16(&header, record.time);
+   put16(&header, record.date);
+   put32(&header, 0); // crc and sizes are zero (or in the data descriptor)
+   put32(&header, record.zip64 ? kMax32 : 0);
+   put32(&header, record.zip64 ? kMax32 : 0);
+   put16(&header, static_cast<uint16_t>(record.name.size()));
+   put16(&header, static_cast<uint16_t>(extra.size()));
+   header.append(record.name);
+   header.append(extra);
+   put(header);
+}
+
+void ZipWriter::Impl::writeCentralDirectory()
+{
+   uint64_t start = position;
+   for (const Record& record : records)
+   {
+      bool zip64Sizes = record.zip64;
+      bool zip64Offset = record.offset >= kMax32;
+
+      std::string extra;
+      if (zip64Sizes || zip64Offset)
+      {
+         put16(&extra, kZip64ExtraField);
+         put16(&extra, (zip64Sizes ? 16 : 0) + (zip64Offset ? 8 : 0));
+         if (zip64Sizes)
+         {
+            put64(&extra, record.uncompressedSize);
+            put64(&extra, record.compressedSize);
+         }
+         if (zip64Offset)
+            put64(&extra, record.offset);
+      }
+
+      std::string header;
+      put32(&header, kCentralHeaderSignature);
+      put16(&header, record.versionMadeBy);
+      put16(&header, extra.empty() ? kVersionNeeded : kVersionNeededZip64);
+      put16(&header, record.flags);
+      put16(&header, record.method);
+      put16(&header, record.time);
+      put16(&header, record.date);
+      put32(&header, record.crc);
+      put32(&header, zip64Sizes ? kMax32 : static_cast<uint32_t>(record.compressedSize));
+      put32(&header, zip64Sizes ? kMax32 : static_cast<uint32_t>(record.uncompressedSize));
+      put16(&header, static_cast<uint16_t>(record.name.size()));
+      put16(&header, static_cast<uint16_t>(extra.size()));
+      put16(&header, 0); // comment length
+      put16(&header, 0); // disk number
+      put16(&header, 0); // internal attributes
+      put32(&header, record.externalAttributes);
+      put32(&header, zip64Offset ? kMax32 : static_cast<uint32_t>(record.offset));
+      header.append(record.name);
+      header.append(extra);
+      put(header);
+   }
+
+   uint64_t size = position - start;
+   uint64_t count = records.size();
+   std::string end;
+   if (count >= kMax16 || size >= kMax32 || start >= kMax32)
+   {
+      uint64_t zip64End = position;
+      put32(&end, kZip64EndOfCentralDirSignature);
+      put64(&end, kZip64EndOfCentralDirSize - 12);
+      put16(&end, kVersionMadeBy);
+      put16(&end, kVersionNeededZip64);
+      put32(&end, 0); // disk number
+      put32(&end, 0); // disk with the central directory
+      put64(&end, count);
+      put64(&end, count);
+      put64(&end, size);
+      put64(&end, start);
+
+      put32(&end, kZip64LocatorSignature);
+      put32(&end, 0);
+      put64(&end, zip64End);
+      put32(&end, 1); // number of disks
+   }
+
+   put32(&end, kEndOfCentralDirSignature);
+   put16(&end, 0);
+   put16(&end, 0);
+   put16(&end, static_cast<uint16_t>(std::min(count, static_cast<uint64_t>(kMax16))));
+   put16(&end, static_cast<uint16_t>(std::min(count, static_cast<uint64_t>(kMax16))));
+   put32(&end, static_cast<uint32_t>(std::min(size, static_cast<uint64_t>(kMax32))));
+   put32(&end, static_cast<uint32_t>(std::min(start, static_cast<uint64_t>(kMax32))));
+   put16(&end, 0); // comment length
+   put(end);
+}
+
+ZipWriter::ZipWriter(const FilePath& parentPath,
+                     const std::vector<std::string>& files,
+                     int compressionLevel)
+   : pImpl_(new Impl(parentPath, compressionLevel))
+{
+   pImpl_->inputBlock.resize(kBlockSize);
+   pImpl_->outputBlock.resize(kBlockSize);
+
+   for (auto it = files.rbegin(); it != files.rend(); ++it)
+   {
+      std::string name = boost::algorithm::replace_all_copy(*it, "\\", "/");
+      while (!name.empty() && name[name.size() - 1] == '/')
+         name.erase(name.size() - 1);
+      pImpl_->pending.push_back(std::make_pair(parentPath.completePath(*it), name));
+   }
+}
+
+ZipWriter::~ZipWriter()
+{
+}
+
+Error ZipWriter::read(std::size_t maxBytes, std::string* pData)
+{
+   while (pImpl_->buffer.size() < maxBytes && !pImpl_->finished)
+   {
+      Error error;
+      if (pImpl_->pInput)
+      {
+         error = pImpl_->continueEntry();
+      }
+      else if (!pImpl_->pending.empty())
+      {
+         std::pair<FilePath, std::string> next = pImpl_->pending.back();
+         pImpl_->pending.pop_back();
+         error = pImpl_->beginEntry(next.first, next.second);
+      }
+      else
+      {
+         pImpl_->writeCentralDirectory();
+         pImpl_->finished = true;
+      }
+
+      if (error)
+         return error;
+   }
+
+   pData->append(pImpl_->buffer);
+   pImpl_->buffer.clear();
+   return Success();
+}
+
+bool ZipWriter::finished() const
+{
+   return pImpl_->finished && pImpl_->buffer.empty();
+}
+
+Error ZipWriter::writeToFile(const FilePath& zipFile)
+{
+   std::shared_ptr<std::ostream> pOutput;
+   Error error = zipFile.openForWrite(pOutput);
+   if (error)
+      return error;
+
+   std::string data;
+   while (!finished())
+   {
+      data.clear();
+      error = read(kBlockSize, &data);
+      if (error)
+         return error;
+
+      pOutput->write(data.data(), data.size());
+      if (pOutput->fail())
+         return systemError(boost::system::errc::io_error, ERROR_LOCATION);
+   }
+
+   pOutput->flush();
+   return Success();
+}
+
+struct ZipReader::Impl
+{
+   Impl() : size(0), uncompressedSize(0) {}
+
+   Error readAt(uint64_t offset, std::size_t length, std::string* pData)
+   {
+      if (offset + length > size)
+         return invalidArchiveError("unexpected end of file", zipFile, ERROR_LOCATION);
+
+      pData->resize(length);
+      pInput->clear();
+      pInput->seekg(static_cast<std::streamoff>(offset));
+      pInput->read(&(*pData)[0], length);
+      if (static_cast<std::size_t>(pInput->gcount()) != length)
+         return systemError(boost::system::errc::io_error, ERROR_LOCATION);
+
+      return Success();
+   }
+
+   Error readCentralDirectory();
+
+   FilePath zipFile;
+   std::shared_ptr<std::istream> pInput;
+   uint64_t size;
+   std::vector<ZipEntry> entries;
+   uint64_t uncompressedSize;
+};
+
+Error ZipReader::Impl::readCentralDirectory()
+{
+   // find the end of central directory record (which is followed by a
+   // comment of up to 64K)
+   if (size < kEndOfCentralDirSize)
+      return invalidArchiveError("too short", zipFile, ERROR_LOCATION);
+
+   std::size_t tailSize = static_cast<std::size_t>(
+            std::min(size, static_cast<uint64_t>(kEndOfCentralDirSize + kMax16)));
+   uint64_t tailOffset = size - tailSize;
+   std::string tail;
+   Error error = readAt(tailOffset, tailSize, &tail);
+   if (error)
+      return error;
+
+   std::size_t endPos = std::string::npos;
+   for (std::size_t pos = tailSize - kEndOfCentralDirSize; ; pos--)
+   {
+      if (get32(tail, pos) == kEndOfCentralDirSignature)
+      {
+         endPos = pos;
+         break;
+      }
+      if (pos == 0)
+         break;
+   }
+   if (endPos == std::string::npos)
+      return invalidArchiveError("no central directory", zipFile, ERROR_LOCATION);
+
+   uint64_t count = get16(tail, endPos + 10);
+   uint64_t directorySize = get32(tail, endPos + 12);
+   uint64_t directoryOffset = get32(tail, endPos + 16);
+
+   if (count == kMax16 || directorySize == kMax32 || directoryOffset == kMax32)
+   {
+      uint64_t endOffset = tailOffset + endPos;
+      if (endOffset < kZip64LocatorSize)
+         return invalidArchiveError("no zip64 locator", zipFile, ERROR_LOCATION);
+
+      std::string locator;
+      error = readAt(endOffset - kZip64LocatorSize, kZip64LocatorSize, &locator);
+      if (error)
+         return error;
+      if (get32(locator, 0) != kZip64LocatorSignature)
+         return invalidArchiveError("no zip64 locator", zipFile, ERROR_LOCATION);
+
+      std::string zip64End;
+      error = readAt(get64(locator, 8), kZip64EndOfCentralDirSize, &zip64End);
+      if (error)
+         return error;
+      if (get32(zip64End, 0) != kZip64EndOfCentralDirSignature)
+         return invalidArchiveError("no zip64 central directory", zipFile, ERROR_LOCATION);
+
+      count = get64(zip64End, 32);
+      directorySize = get64(zip64End, 40);
+      directoryOffset = get64(zip64End, 48);
+   }
+
+   if (directoryOffset > size || directorySize > size - directoryOffset)
+      return invalidArchiveError("central directory out of range", zipFile, ERROR_LOCATION);
+
+   std::string directory;
+   error = readAt(directoryOffset, static_cast<std::size_t>(directorySize), &directory);
+   if (error)
+      return error;
+
+   std::size_t pos = 0;
+   for (uint64_t i = 0; i < count; i++)
+   {
+      if (pos + kCentralHeaderSize > directory.size() ||
+          get32(directory, pos) != kCentralHeaderSignature)
+      {
+         return invalidArchiveError("bad central directory entry", zipFile, ERROR_LOCATION);
+      }
+
+      ZipEntry entry;
+      entry.versionMadeBy = get16(directory, pos + 4);
+      entry.flags = get16(directory, pos + 8);
+      entry.method = get16(directory, pos + 10);
+      entry.crc = get32(directory, pos + 16);
+      entry.compressedSize = get32(directory, pos + 20);
+      entry.uncompressedSize = get32(directory, pos + 24);
+      std::size_t nameLength = get16(directory, pos + 28);
+      std::size_t extraLength = get16(directory, pos + 30);
+      std::size_t commentLength = get16(directory, pos + 32);
+      entry.externalAttributes = get32(directory, pos + 38);
+      entry.offset = get32(directory, pos + 42);
+
+      std::size_t namePos = pos + kCentralHeaderSize;
+      std::size_t extraPos = namePos + nameLength;
+      pos = extraPos + extraLength + commentLength;
+      if (pos > directory.size())
+         return invalidArchiveError("bad central directory entry", zipFile, ERROR_LOCATION);
+
+      entry.name = directory.substr(namePos, nameLength);
+
+      // zip64 values are present for the fields which overflowed
+      for (std::size_t fieldPos = extraPos; fieldPos + 4 <= extraPos + extraLength; )
+      {
+         uint16_t id = get16(directory, fieldPos);
+         std::size_t fieldLength = get16(directory, fieldPos + 2);
+         std::size_t valuePos = fieldPos + 4;
+         std::size_t fieldEnd = valuePos + fieldLength;
+         if (fieldEnd > extraPos + extraLength)
+            break;
+
+         if (id == kZip64ExtraField)
+         {
+            if (entry.uncompressedSize == kMax32 && valuePos + 8 <= fieldEnd)
+            {
+               entry.uncompressedSize = get64(directory, valuePos);
+               valuePos += 8;
+            }
+            if (entry.compressedSize == kMax32 && valuePos + 8 <= fieldEnd)
+            {
+               entry.compressedSize = get64(directory, valuePos);
+               valuePos += 8;
+            }
+            if (entry.offset == kMax32 && valuePos + 8 <= fieldEnd)
+               entry.offset = get64(directory, valuePos);
+         }
+
+         fieldPos = fieldEnd;
+      }
+
+      uncompressedSize += entry.uncompressedSize;
+      entries.push_back(entry);
+   }
+
+   return Success();
+}
+
+ZipReader::ZipReader()
+   : pImpl_(new Impl())
+{
+}
+
+ZipReader::~ZipReader()
+{
+}
+
+Error ZipReader::open(const FilePath& zipFile)
+{
+   pImpl_.reset(new Impl());
+   pImpl_->zipFile = zipFile;
+
+   Error error = zipFile.openForRead(pImpl_->pInput);
+   if (error)
+      return error;
+
+   pImpl_->size = zipFile.getSize();
+   return pImpl_->readCentralDirectory();
+}
+
+const std::vector<ZipEntry>& ZipReader::entries() const
+{
+   return pImpl_->entries;
+}
+
+uint64_t ZipReader::uncompressedSize() const
+{
+   return pImpl_->uncompressedSize;
+}
+
+Error ZipReader::extract(const ZipEntry& entry,
+                         const FilePath& targetPath,
+                         const ProgressFunction& onProgress)
+{
+   // never write through a link (which could point anywhere)
+   if (isLink(targetPath))
+   {
+      Error error = systemError(boost::system::errc::permission_denied,
+                                "Zip entry would be extracted through a symbolic link",
+                                ERROR_LOCATION);
+      error.addProperty("path", targetPath);
+      return error;
+   }
+
+   if (entry.isDirectory())
+      return targetPath.ensureDirectory();
+
+   if (entry.flags & kFlagEncrypted)
+   {
+      return systemError(boost::system::errc::not_supported,
+                         "Encrypted zip entries are not supported: " + entry.name,
+                         ERROR_LOCATION);
+   }
+
+   if (entry.method != kMethodStored && entry.method != kMethodDeflated)
+   {
+      return systemError(boost::system::errc::not_supported,
+                         "Unsupported compression method for " + entry.name,
+                         ERROR_LOCATION);
+   }
+
+   // the entry's data follows its local header
+   std::string header;
+   Error error = pImpl_->readAt(entry.offset, kLocalHeaderSize, &header);
+   if (error)
+      return error;
+   if (get32(header, 0) != kLocalHeaderSignature)
+      return invalidArchiveError("bad local header", pImpl_->zipFile, ERROR_LOCATION);
+
+   uint64_t dataOffset = entry.offset + kLocalHeaderSize +
+                         get16(header, 26) + get16(header, 28);
+   if (dataOffset > pImpl_->size || entry.compressedSize > pImpl_->size - dataOffset)
+      return invalidArchiveError("entry out of range", pImpl_->zipFile, ERROR_LOCATION);
+
+   error = targetPath.getParent().ensureDirectory();
+   if (error)
+      return error;
+
+   std::shared_ptr<std::ostream> pOutput;
+   error = targetPath.openForWrite(pOutput);
+   if (error)
+      return error;
+
+   boost::shared_ptr<z_stream> pStream;
+   if (entry.method == kMethodDeflated)
+   {
+      std::unique_ptr<z_stream> pNewStream = newStream();
+      if (!pNewStream)
+         return systemError(boost::system::errc::not_enough_memory, ERROR_LOCATION);
+
+      int res = inflateInit2(pNewStream.get(), -MAX_WBITS);
+      if (res != Z_OK)
+         return zlibError(res, "Unable to initialize decompression", ERROR_LOCATION);
+      pStream.reset(pNewStream.release(), freeInflateStream);
+   }
+
+   std::vector<char> inputBlock(kBlockSize);
+   std::vector<char> outputBlock(kBlockSize);
+   uint64_t remaining = entry.compressedSize;
+   uint64_t written = 0;
+   uint32_t checksum = 0;
+   bool streamEnd = false;
+
+   auto write = [&](const char* data, std::size_t size) -> Error
+   {
+      // stop as soon as the entry holds more than it claims to (rather than
+      // filling the disk before the size is checked)
+      if (size > entry.uncompressedSize - written)
+         return invalidArchiveError("corrupt entry " + entry.name, pImpl_->zipFile, ERROR_LOCATION);
+
+      pOutput->write(data, size);
+      if (pOutput->fail())
+         return systemError(boost::system::errc::io_error, ERROR_LOCATION);
+
+      checksum = crc(checksum, data, size);
+      written += size;
+      if (onProgress && !onProgress(size))
+         return systemError(boost::system::errc::operation_canceled, ERROR_LOCATION);
+
+      return Success();
+   };
+
+   pImpl_->pInput->clear();
+   pImpl_->pInput->seekg(static_cast<std::streamoff>(dataOffset));
+   while (remaining > 0 && !streamEnd && !error)
+   {
+      std::size_t toRead = static_cast<std::size_t>(
+               std::min(remaining, static_cast<uint64_t>(kBlockSize)));
+      pImpl_->pInput->read(&inputBlock[0], toRead);
+      if (static_cast<std::size_t>(pImpl_->pInput->gcount()) != toRead)
+      {
+         error = systemError(boost::system::errc::io_error, ERROR_LOCATION);
+         break;
+      }
+      remaining -= toRead;
+
+      if (!pStream)
+      {
+         error = write(&inputBlock[0], toRead);
+         continue;
+      }
+
+      pStream->next_in = reinterpret_cast<Bytef*>(&inputBlock[0]);
+      pStream->avail_in = static_cast<uInt>(toRead);
+      do
+      {
+         pStream->next_out = reinterpret_cast<Bytef*>(&outputBlock[0]);
+         pStream->avail_out = static_cast<uInt>(outputBlock.size());
+         int res = inflate(pStream.get(), Z_NO_FLUSH);
+         if (res == Z_NEED_DICT || res == Z_DATA_ERROR || res == Z_MEM_ERROR ||
+             res == Z_STREAM_ERROR)
+         {
+            error = zlibError(res, "Unable to decompress " + entry.name, ERROR_LOCATION);
+            break;
+         }
+
+         streamEnd = res == Z_STREAM_END;
+         error = write(&outputBlock[0], outputBlock.size() - pStream->avail_out);
+      } while (!error && !streamEnd && pStream->avail_out == 0);
+   }
+
+   if (!error && pStream && !streamEnd)
+      error = invalidArchiveError("truncated entry " + entry.name, pImpl_->zipFile, ERROR_LOCATION);
+
+   if (!error && (checksum != entry.crc || written != entry.uncompressedSize))
+      error = invalidArchiveError("corrupt entry " + entry.name, pImpl_->zipFile, ERROR_LOCATION);
+
+   pOutput.reset();
+   if (error)
+   {
+      targetPath.removeIfExists();
+      return error;
+   }
+
+#ifndef _WIN32
+   // restore the permissions recorded by unix archivers
+   mode_t mode = static_cast<mode_t>((entry.externalAttributes >> 16) & 0777);
+   if ((entry.versionMadeBy >> 8) == 3 && mode != 0)
+      ::chmod(targetPath.getAbsolutePath().c_str(), mode);
+#endif
+
+   return Success();
+}
+
+Error zipEntryPath(const FilePath& destDir,
+                   const std::string& name,
+                   FilePath* pPath)
+{
+   // reject absolute paths (including drive letters) and '..' components
+   // rather than relying on how they'd resolve
+   std::vector<std::string> components;
+   boost::algorithm::split(components, name, [](char ch) { return ch == '/' || ch == '\\'; });
+
+   bool valid = !name.empty() && name[0] != '/' && name[0] != '\\' &&
+                !(name.size() > 1 && name[1] == ':');
+   std::vector<std::string> relativeComponents;
+   for (const std::string& component : components)
+   {
+      if (component == "..")
+         valid = false;
+      if (component.empty() || component == ".")
+         continue;
+
+      relativeComponents.push_back(component);
+   }
+
+   if (!valid)
+   {
+      Error error = systemError(boost::system::errc::permission_denied,
+                                "Zip entry is outside the destination directory",
+                                ERROR_LOCATION);
+      error.addProperty("entry", name);
+      return error;
+   }
+
+   // the destination itself (e.g. "./")
+   if (relativeComponents.empty())
+   {
+      *pPath = FilePath();
+      return Success();
+   }
+
+   // links within the destination could lead out of it
+   FilePath path = destDir;
+   for (const std::string& component : relativeComponents)
+   {
+      FilePath child;
+      Error error = path.completeChildPath(component, child);
+      if (error)
+         return error;
+      path = child;
+
+      if (isLink(path))
+      {
+         error = systemError(boost::system::errc::permission_denied,
+                             "Zip entry would be extracted through a symbolic link",
+                             ERROR_LOCATION);
+         error.addProperty("entry", name);
+         error.addProperty("path", path);
+         return error;
+      }
+   }
+
+   *pPath = path;
+   return Success();
+}
+
+} // namespace zlib
+} // namespace core
+} // namespace rstudio
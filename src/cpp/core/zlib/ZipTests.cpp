@@ -0,0 +1,353 @@
+/*
+ * ZipTests.cpp
+ *
+ * Copyright (C) 2020 by RStudio, PBC
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include <map>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+#include <core/FileSerializer.hpp>
+#include <core/zlib/Zip.hpp>
+
+#include <tests/TestThat.hpp>
+
+namespace rstudio {
+namespace core {
+namespace zlib {
+namespace tests {
+
+namespace {
+
+FilePath createTempDir()
+{
+   FilePath dir;
+   Error error = FilePath::tempFilePath(dir);
+   if (!error)
+      error = dir.ensureDirectory();
+   REQUIRE_FALSE(error);
+   return dir;
+}
+
+std::string binaryData(std::size_t size)
+{
+   std::string data(size, '\0');
+   uint32_t state = 2463534242u;
+   for (std::size_t i = 0; i < size; i++)
+   {
+      state ^= state << 13;
+      state ^= state >> 17;
+      state ^= state << 5;
+      data[i] = static_cast<char>(state & 0xFF);
+   }
+   return data;
+}
+
+// the contents of the files beneath a directory, by relative path (with
+// directories mapped to "/")
+std::map<std::string, std::string> contentsOf(const FilePath& dir)
+{
+   std::map<std::string, std::string> contents;
+   dir.getChildrenRecursive([&](int, const FilePath& path)
+   {
+      std::string value = "/";
+      if (!path.isDirectory())
+         readStringFromFile(path, &value);
+      contents[path.getRelativePath(dir)] = value;
+      return true;
+   });
+   return contents;
+}
+
+void writeFile(const FilePath& path, const std::string& contents)
+{
+   REQUIRE_FALSE(path.getParent().ensureDirectory());
+   REQUIRE_FALSE(writeStringToFile(path, contents));
+}
+
+Error extractAll(const FilePath& zipFile, const FilePath& destDir)
+{
+   ZipReader reader;
+   Error error = reader.open(zipFile);
+   if (error)
+      return error;
+
+   for (const ZipEntry& entry : reader.entries())
+   {
+      FilePath targetPath;
+      error = zipEntryPath(destDir, entry.name, &targetPath);
+      if (error)
+         return error;
+      if (targetPath.isEmpty())
+         continue;
+
+      error = reader.extract(entry, targetPath);
+      if (error)
+         return error;
+   }
+
+   return Success();
+}
+
+} // anonymous namespace
+
+test_context("Zip")
+{
+   FilePath sourceDir = createTempDir();
+   writeFile(sourceDir.completeChildPath("project/analysis.R"), "x <- rnorm(100)\nplot(x)\n");
+   writeFile(sourceDir.completeChildPath("project/data/values.bin"), binaryData(200000));
+   writeFile(sourceDir.completeChildPath("project/data/repeated.csv"),
+             std::string(300000, 'a') + "\n");
+   writeFile(sourceDir.completeChildPath("project/empty.txt"), "");
+   REQUIRE_FALSE(sourceDir.completeChildPath("project/output").ensureDirectory());
+   writeFile(sourceDir.completeChildPath("notes.md"), "# Notes\n");
+
+   std::vector<std::string> files;
+   files.push_back("project");
+   files.push_back("notes.md");
+
+   test_that("Archives round trip through the reader")
+   {
+      FilePath zipFile = sourceDir.getParent().completeChildPath(sourceDir.getFilename() + ".zip");
+      ZipWriter writer(sourceDir, files);
+      REQUIRE_FALSE(writer.writeToFile(zipFile));
+
+      ZipReader reader;
+      REQUIRE_FALSE(reader.open(zipFile));
+
+      std::vector<std::string> names;
+      for (const ZipEntry& entry : reader.entries())
+         names.push_back(entry.name);
+
+      std::vector<std::string> expected = {
+         "project/",
+         "project/analysis.R",
+         "project/data/",
+         "project/data/repeated.csv",
+         "project/data/values.bin",
+         "project/empty.txt",
+         "project/output/",
+         "notes.md"
+      };
+      expect_true(names == expected);
+      expect_true(reader.uncompressedSize() == 500000 + 1 + 24 + 8);
+
+      FilePath destDir = createTempDir();
+      REQUIRE_FALSE(extractAll(zipFile, destDir));
+
+      std::map<std::string, std::string> source = contentsOf(sourceDir);
+      std::map<std::string, std::string> extracted = contentsOf(destDir);
+      expect_true(source == extracted);
+
+      // the compressible data is deflated
+      expect_true(zipFile.getSize() < 250000);
+
+      zipFile.removeIfExists();
+      destDir.removeIfExists();
+   }
+
+   test_that("Streaming in small reads produces the same archive")
+   {
+      std::string whole;
+      ZipWriter writer(sourceDir, files);
+      REQUIRE_FALSE(writer.read(1 << 30, &whole));
+      expect_true(writer.finished());
+
+      std::string streamed;
+      ZipWriter streamingWriter(sourceDir, files);
+      int reads = 0;
+      while (!streamingWriter.finished())
+      {
+         std::string data;
+         REQUIRE_FALSE(streamingWriter.read(4096, &data));
+         expect_true(data.size() < 4096 + 65536 + 1024);
+         streamed += data;
+         reads++;
+      }
+
+      expect_true(streamed == whole);
+      expect_true(reads > 3);
+   }
+
+   test_that("Corrupt entries are detected")
+   {
+      FilePath zipFile = sourceDir.getParent().completeChildPath(sourceDir.getFilename() + "-corrupt.zip");
+      std::vector<std::string> binaryOnly = { "project/data/values.bin" };
+      ZipWriter writer(sourceDir, binaryOnly);
+      REQUIRE_FALSE(writer.writeToFile(zipFile));
+
+      std::string contents;
+      REQUIRE_FALSE(readStringFromFile(zipFile, &contents));
+      contents[1000] = static_cast<char>(contents[1000] ^ 0xFF);
+      REQUIRE_FALSE(writeStringToFile(zipFile, contents));
+
+      FilePath destDir = createTempDir();
+      expect_true(extractAll(zipFile, destDir));
+      expect_false(destDir.completeChildPath("project/data/values.bin").exists());
+
+      // and archives which aren't zip files at all
+      REQUIRE_FALSE(writeStringToFile(zipFile, "not a zip file"));
+      ZipReader reader;
+      expect_true(reader.open(zipFile));
+
+      zipFile.removeIfExists();
+      destDir.removeIfExists();
+   }
+
+   test_that("Entries which decompress beyond their recorded size aren't extracted")
+   {
+      FilePath zipFile = sourceDir.getParent().completeChildPath(sourceDir.getFilename() + "-bomb.zip");
+      std::vector<std::string> repeatedOnly = { "project/data/repeated.csv" };
+      ZipWriter writer(sourceDir, repeatedOnly);
+      REQUIRE_FALSE(writer.writeToFile(zipFile));
+
+      // claim the entry is much smaller than it is (in its central
+      // directory record, which is what the reader goes by)
+      std::string contents;
+      REQUIRE_FALSE(readStringFromFile(zipFile, &contents));
+      std::size_t record = contents.find(std::string("PK\x01\x02", 4));
+      REQUIRE(record != std::string::npos);
+      contents.replace(record + 24, 4, std::string("\xe8\x03\x00\x00", 4));
+      REQUIRE_FALSE(writeStringToFile(zipFile, contents));
+
+      ZipReader reader;
+      REQUIRE_FALSE(reader.open(zipFile));
+      REQUIRE(reader.entries().size() == 1);
+      expect_true(reader.entries()[0].uncompressedSize == 1000);
+
+      // extraction stops without writing more than was claimed
+      FilePath destDir = createTempDir();
+      FilePath target = destDir.completeChildPath("repeated.csv");
+      uint64_t extracted = 0;
+      expect_true(reader.extract(reader.entries()[0], target, [&](uint64_t bytes)
+      {
+         extracted += bytes;
+         return true;
+      }));
+      expect_true(extracted <= 1000);
+      expect_false(target.exists());
+
+      zipFile.removeIfExists();
+      destDir.removeIfExists();
+   }
+
+   test_that("Extraction reports progress and can be cancelled")
+   {
+      FilePath zipFile = sourceDir.getParent().completeChildPath(sourceDir.getFilename() + "-progress.zip");
+      ZipWriter writer(sourceDir, files);
+      REQUIRE_FALSE(writer.writeToFile(zipFile));
+
+      ZipReader reader;
+      REQUIRE_FALSE(reader.open(zipFile));
+      FilePath destDir = createTempDir();
+
+      const ZipEntry* pEntry = nullptr;
+      for (const ZipEntry& entry : reader.entries())
+      {
+         if (entry.name == "project/data/repeated.csv")
+            pEntry = &entry;
+      }
+      REQUIRE(pEntry != nullptr);
+
+      uint64_t extracted = 0;
+      FilePath target = destDir.completeChildPath("repeated.csv");
+      REQUIRE_FALSE(reader.extract(*pEntry, target, [&](uint64_t bytes)
+      {
+         extracted += bytes;
+         return true;
+      }));
+      expect_true(extracted == 300001);
+
+      Error error = reader.extract(*pEntry, target, [](uint64_t) { return false; });
+      expect_true(error.getCode() == boost::system::errc::operation_canceled);
+      expect_false(target.exists());
+
+      zipFile.removeIfExists();
+      destDir.removeIfExists();
+   }
+
+   test_that("Entry names can't escape the destination directory")
+   {
+      FilePath destDir("/tmp/uploads");
+      FilePath path;
+
+      expect_false(zipEntryPath(destDir, "project/analysis.R", &path));
+      expect_true(path == destDir.completePath("project/analysis.R"));
+      expect_false(zipEntryPath(destDir, "./project/", &path));
+      expect_true(path == destDir.completePath("project"));
+
+      // entries for the destination itself are skipped
+      expect_false(zipEntryPath(destDir, "./", &path));
+      expect_true(path.isEmpty());
+      expect_false(zipEntryPath(destDir, ".", &path));
+      expect_true(path.isEmpty());
+
+      expect_true(zipEntryPath(destDir, "../evil.sh", &path));
+      expect_true(zipEntryPath(destDir, "project/../../evil.sh", &path));
+      expect_true(zipEntryPath(destDir, "project\\..\\..\\evil.sh", &path));
+      expect_true(zipEntryPath(destDir, "/etc/passwd", &path));
+      expect_true(zipEntryPath(destDir, "C:\\Windows\\evil.dll", &path));
+      expect_true(zipEntryPath(destDir, "", &path));
+   }
+
+#ifndef _WIN32
+   test_that("Entries aren't extracted through links in the destination directory")
+   {
+      FilePath zipFile = sourceDir.getParent().completeChildPath(sourceDir.getFilename() + "-links.zip");
+      ZipWriter writer(sourceDir, files);
+      REQUIRE_FALSE(writer.writeToFile(zipFile));
+
+      FilePath destDir = createTempDir();
+      FilePath outsideDir = createTempDir();
+      REQUIRE(::symlink(outsideDir.getAbsolutePath().c_str(),
+                        destDir.completeChildPath("project").getAbsolutePath().c_str()) == 0);
+
+      FilePath path;
+      expect_true(zipEntryPath(destDir, "project/analysis.R", &path));
+      expect_true(extractAll(zipFile, destDir));
+      expect_true(contentsOf(outsideDir).empty());
+
+      // including links to files which don't exist (yet)
+      REQUIRE(::unlink(destDir.completeChildPath("project").getAbsolutePath().c_str()) == 0);
+      REQUIRE_FALSE(destDir.completeChildPath("project").ensureDirectory());
+      FilePath missing = outsideDir.completeChildPath("analysis.R");
+      FilePath link = destDir.completeChildPath("project/analysis.R");
+      REQUIRE(::symlink(missing.getAbsolutePath().c_str(), link.getAbsolutePath().c_str()) == 0);
+
+      expect_true(zipEntryPath(destDir, "project/analysis.R", &path));
+      ZipReader reader;
+      REQUIRE_FALSE(reader.open(zipFile));
+      for (const ZipEntry& entry : reader.entries())
+      {
+         if (entry.name == "project/analysis.R")
+            expect_true(reader.extract(entry, link));
+      }
+      expect_false(missing.exists());
+
+      zipFile.removeIfExists();
+      destDir.removeIfExists();
+      outsideDir.removeIfExists();
+   }
+#endif
+
+   sourceDir.removeIfExists();
+}
+
+} // namespace tests
+} // namespace zlib
+} // namespace core
+} // namespace rstudio
@@ -16,6 +16,7 @@
 #include <boost/asio/io_service.hpp>
 
 #include <monitor/MonitorClient.hpp>
+#include <monitor/metrics/MetricRegistry.hpp>
 
 #include <shared_core/ILogDestination.hpp>
 
@@ -68,6 +69,28 @@ std::shared_ptr<core::log::ILogDestination> Client::createLogDestination(
    return std::shared_ptr<core::log::ILogDestination>(new MonitorLogDestination(logLevel, programIdentity));
 }
 
+void Client::logMetric(const metrics::Metric& metric)
+{
+   std::string name = metric.data().name;
+   if (!metric.scope().empty())
+      name = metric.scope() + "_" + name;
+
+   double value = metric.data().value;
+   if (metric.type() == "counter")
+   {
+      if (value > 0)
+         metrics::counter(name, name).increment(static_cast<uint64_t>(value));
+   }
+   else if (metric.type() == "histogram")
+   {
+      metrics::histogram(name, name).observe(value);
+   }
+   else
+   {
+      metrics::gauge(name, name).set(value);
+   }
+}
+
 void initializeMonitorClient(const std::string& metricsSocket,
                              const std::string& auth,
                              bool useSharedSecret)
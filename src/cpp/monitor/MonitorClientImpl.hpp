@@ -50,6 +50,8 @@ public:
 
    void sendMultiMetrics(const std::vector<metrics::MultiMetric>& metrics);
 
+   void startMetricsEmitter(const boost::posix_time::time_duration& interval);
+
    void logEvent(const Event& event);
 
    void logConsoleAction(const audit::ConsoleAction& action);
@@ -92,6 +94,8 @@ public:
 
    void logConsoleAction(const audit::ConsoleAction& action);
 
+   void startMetricsEmitter(const boost::posix_time::time_duration& interval);
+
    boost::asio::io_service& ioService() const { return ioService_; }
 
 private:
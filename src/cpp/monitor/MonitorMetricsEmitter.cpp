@@ -0,0 +1,146 @@
+/*
+ * MonitorMetricsEmitter.cpp
+ *
+ * Copyright (C) 2020 by RStudio, PBC
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include <unistd.h>
+
+#include <boost/asio/deadline_timer.hpp>
+#include <boost/bind.hpp>
+
+#include <shared_core/Error.hpp>
+#include <shared_core/FilePath.hpp>
+
+#include <core/Log.hpp>
+#include <core/http/LocalStreamAsyncClient.hpp>
+
+#include <monitor/MonitorClient.hpp>
+#include <monitor/metrics/MetricRegistry.hpp>
+
+#include "MonitorClientImpl.hpp"
+
+using namespace rstudio::core;
+
+namespace rstudio {
+namespace monitor {
+
+namespace {
+
+// Sends a snapshot of this process's metrics to rserver every interval. The
+// metrics are cumulative, so a lost snapshot only delays the update.
+class MetricsEmitter : public boost::enable_shared_from_this<MetricsEmitter>
+{
+public:
+   MetricsEmitter(boost::asio::io_service& ioService,
+                  const std::string& metricsSocket,
+                  const std::string& auth,
+                  const boost::posix_time::time_duration& interval)
+      : ioService_(ioService),
+        metricsSocket_(metricsSocket),
+        auth_(auth),
+        interval_(interval),
+        timer_(ioService),
+        loggedError_(false)
+   {
+   }
+
+   void schedule()
+   {
+      timer_.expires_from_now(interval_);
+      timer_.async_wait(boost::bind(&MetricsEmitter::emit,
+                                    shared_from_this(),
+                                    boost::asio::placeholders::error));
+   }
+
+private:
+   void emit(const boost::system::error_code& ec)
+   {
+      if (ec == boost::asio::error::operation_aborted)
+         return;
+
+      json::Object bodyJson;
+      bodyJson["pid"] = static_cast<int>(::getpid());
+      bodyJson["metrics"] = metrics::snapshot().toJson();
+
+      boost::shared_ptr<http::LocalStreamAsyncClient> pClient(
+               new http::LocalStreamAsyncClient(ioService_, FilePath(metricsSocket_)));
+
+      http::Request& request = pClient->request();
+      request.setMethod("POST");
+      request.setUri(kMonitorMetricsUri);
+      request.setHeader("Accept", "*/*");
+      request.setHeader(kMonitorSharedSecretHeader, auth_);
+      request.setHeader("Connection", "close");
+      request.setContentType("application/json");
+      request.setBody(bodyJson.write());
+
+      pClient->execute(boost::bind(&MetricsEmitter::onResponse, shared_from_this(), _1),
+                       boost::bind(&MetricsEmitter::onError, shared_from_this(), _1));
+
+      schedule();
+   }
+
+   void onResponse(const http::Response& response)
+   {
+      if (response.statusCode() != http::status::Ok)
+      {
+         onError(systemError(boost::system::errc::protocol_error,
+                             "Unexpected response status " +
+                                std::to_string(response.statusCode()),
+                             ERROR_LOCATION));
+         return;
+      }
+
+      loggedError_ = false;
+   }
+
+   void onError(const Error& error)
+   {
+      // only log the first of a run of failures (e.g. while rserver restarts)
+      if (!loggedError_)
+      {
+         LOG_ERROR(error);
+         loggedError_ = true;
+      }
+   }
+
+   boost::asio::io_service& ioService_;
+   std::string metricsSocket_;
+   std::string auth_;
+   boost::posix_time::time_duration interval_;
+   boost::asio::deadline_timer timer_;
+   bool loggedError_;
+};
+
+} // anonymous namespace
+
+void SyncClient::startMetricsEmitter(const boost::posix_time::time_duration&)
+{
+   LOG_WARNING_MESSAGE("Metrics can only be sent by an asynchronous monitor client");
+}
+
+void AsyncClient::startMetricsEmitter(const boost::posix_time::time_duration& interval)
+{
+   if (metricsSocket().empty())
+   {
+      LOG_WARNING_MESSAGE("Metrics can only be sent over a local monitor socket");
+      return;
+   }
+
+   boost::shared_ptr<MetricsEmitter> pEmitter(
+            new MetricsEmitter(ioService(), metricsSocket(), auth(), interval));
+   pEmitter->schedule();
+}
+
+} // namespace monitor
+} // namespace rstudio
@@ -19,6 +19,7 @@
 #include <string>
 
 #include <boost/asio/io_service.hpp>
+#include <boost/date_time/posix_time/posix_time_duration.hpp>
 
 #include <core/system/System.hpp>
 
@@ -85,6 +86,15 @@ public:
    virtual void sendMultiMetrics(
                         const std::vector<metrics::MultiMetric>& metrics) = 0;
 
+   // record a sample of a metric in this process's pre-aggregated metrics
+   // (see metrics/MetricRegistry.hpp) according to its type ("counter",
+   // "gauge" or "histogram"). this looks the metric up by name, so hot
+   // paths should keep a reference to the metric from the registry instead
+   void logMetric(const metrics::Metric& metric);
+
+   // periodically send this process's metrics to rserver
+   virtual void startMetricsEmitter(const boost::posix_time::time_duration& interval) = 0;
+
    virtual void logEvent(const Event& event) = 0;
 
    virtual void logConsoleAction(const audit::ConsoleAction& action) = 0;
@@ -20,6 +20,12 @@
 #define kMonitorSocketPathEnvVar   "RS_MONITOR_SOCKET_PATH"
 #define kMonitorSharedSecretEnvVar "RS_MONITOR_SHARED_SECRET"
 #define kMonitorIntervalSeconds    "monitor-interval-seconds"
+#define kMonitorMetricsEnabled     "monitor-metrics-enabled"
+
+// metrics are sent to rserver (over the monitor socket) at this uri
+#define kMonitorMetricsUri             "/metrics"
+#define kMonitorSharedSecretHeader     "X-RS-Monitor-Secret"
+#define kMonitorMetricsIntervalSeconds 10
 
 #endif // MONITOR_CONSTANTS_HPP
 
@@ -0,0 +1,245 @@
+/*
+ * MetricRegistry.hpp
+ *
+ * Copyright (C) 2020 by RStudio, PBC
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef MONITOR_METRICS_METRIC_REGISTRY_HPP
+#define MONITOR_METRICS_METRIC_REGISTRY_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <iosfwd>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <boost/function.hpp>
+#include <boost/utility.hpp>
+
+#include <shared_core/json/Json.hpp>
+
+namespace rstudio {
+namespace core {
+   class Error;
+}
+}
+
+namespace rstudio {
+namespace monitor {
+namespace metrics {
+
+// Pre-aggregated metrics. Each process has a registry of counters, gauges
+// and histograms which are updated in place (without locks or allocation)
+// as samples are recorded, and only read when the registry is snapshotted
+// (e.g. to send it to rserver, or to write it in the Prometheus format).
+// Hot paths should look their metrics up once and keep a reference.
+
+typedef std::vector<std::pair<std::string, std::string> > Labels;
+
+namespace detail {
+
+std::size_t assignShard();
+
+// the counter shard used by the calling thread
+inline std::size_t threadShard()
+{
+   thread_local std::size_t shard = assignShard();
+   return shard;
+}
+
+} // namespace detail
+
+class AggregateMetric : boost::noncopyable
+{
+protected:
+   AggregateMetric(const std::string& name,
+                   const std::string& help,
+                   const Labels& labels)
+      : name_(name), help_(help), labels_(labels)
+   {
+   }
+
+public:
+   const std::string& name() const { return name_; }
+   const std::string& help() const { return help_; }
+   const Labels& labels() const { return labels_; }
+
+private:
+   std::string name_;
+   std::string help_;
+   Labels labels_;
+};
+
+// A monotonically increasing count. Increments are spread over several
+// cache lines (by thread) so that threads counting the same thing don't
+// contend with each other.
+class Counter : public AggregateMetric
+{
+public:
+   Counter(const std::string& name,
+           const std::string& help,
+           const Labels& labels = Labels());
+
+   void increment(uint64_t amount = 1)
+   {
+      shards_[detail::threadShard()].value.fetch_add(amount, std::memory_order_relaxed);
+   }
+
+   uint64_t value() const;
+
+   static const std::size_t kShardCount = 8;
+
+private:
+   struct alignas(64) Shard
+   {
+      std::atomic<uint64_t> value;
+   };
+
+   Shard shards_[kShardCount];
+};
+
+// A value which can go up and down (e.g. memory in use)
+class Gauge : public AggregateMetric
+{
+public:
+   Gauge(const std::string& name,
+         const std::string& help,
+         const Labels& labels = Labels());
+
+   void set(double value)
+   {
+      value_.store(value, std::memory_order_relaxed);
+   }
+
+   void add(double amount);
+
+   double value() const
+   {
+      return value_.load(std::memory_order_relaxed);
+   }
+
+private:
+   std::atomic<double> value_;
+};
+
+// The distribution of observed values over fixed buckets (each bucket is
+// identified by its upper bound; values above the last bound are counted in
+// an implicit +Inf bucket)
+class Histogram : public AggregateMetric
+{
+public:
+   Histogram(const std::string& name,
+             const std::string& help,
+             const std::vector<double>& bounds,
+             const Labels& labels = Labels());
+
+   void observe(double value);
+
+   const std::vector<double>& bounds() const { return bounds_; }
+
+   // the (non-cumulative) count of each bucket, followed by the +Inf bucket
+   std::vector<uint64_t> bucketCounts() const;
+
+   double sum() const { return sum_.load(std::memory_order_relaxed); }
+
+private:
+   std::vector<double> bounds_;
+   std::vector<std::atomic<uint64_t> > buckets_;
+   std::atomic<double> sum_;
+};
+
+// bounds (in seconds) suitable for request latencies
+const std::vector<double>& latencyBounds();
+
+// return the metric with the given name and labels from this process's
+// registry, creating it if necessary. metrics live for the lifetime of the
+// process
+Counter& counter(const std::string& name,
+                 const std::string& help,
+                 const Labels& labels = Labels());
+
+Gauge& gauge(const std::string& name,
+             const std::string& help,
+             const Labels& labels = Labels());
+
+Histogram& histogram(const std::string& name,
+                     const std::string& help,
+                     const std::vector<double>& bounds = latencyBounds(),
+                     const Labels& labels = Labels());
+
+// add a function to be called before the registry is snapshotted (e.g.
+// to sample gauges which are expensive to keep up to date)
+void addCollector(const boost::function<void()>& collector);
+
+// add gauges for this process's resident memory and cpu time, named with
+// the given prefix (e.g. "rsession")
+void addProcessCollector(const std::string& prefix);
+
+// The values of a set of metrics at a point in time, which can be sent to
+// another process (as json), merged with other snapshots, and written in
+// the Prometheus text exposition format.
+class Snapshot
+{
+public:
+   bool empty() const { return families_.empty(); }
+
+   // add the values of the metrics in another snapshot to ours (counters,
+   // histograms and optionally gauges with the same name and labels are
+   // summed, others are added)
+   void merge(const Snapshot& other, bool includeGauges = true);
+
+   core::json::Object toJson() const;
+   static core::Error fromJson(const core::json::Object& snapshotJson,
+                               Snapshot* pSnapshot);
+
+   void writePrometheus(std::ostream& os) const;
+
+private:
+   friend Snapshot snapshot();
+
+   struct Sample
+   {
+      Sample() : value(0), sum(0) {}
+
+      Labels labels;
+      double value;
+      std::vector<double> bounds;
+      std::vector<uint64_t> buckets;
+      double sum;
+   };
+
+   struct Family
+   {
+      std::string type;
+      std::string help;
+
+      // samples keyed by their formatted labels
+      std::map<std::string, Sample> samples;
+   };
+
+   void add(const std::string& type, const AggregateMetric& metric, const Sample& sample);
+   void mergeSample(const std::string& name, const Family& family,
+                    const std::string& key, const Sample& sample);
+
+   std::map<std::string, Family> families_;
+};
+
+// snapshot this process's registry (calling its collectors first)
+Snapshot snapshot();
+
+} // namespace metrics
+} // namespace monitor
+} // namespace rstudio
+
+#endif // MONITOR_METRICS_METRIC_REGISTRY_HPP
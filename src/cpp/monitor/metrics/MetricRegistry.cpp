@@ -0,0 +1,598 @@
+/*
+ * MetricRegistry.cpp
+ *
+ * Copyright (C) 2020 by RStudio, PBC
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include <monitor/metrics/MetricRegistry.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <ostream>
+#include <sstream>
+
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <boost/bind.hpp>
+
+#include <shared_core/Error.hpp>
+
+#include <core/BoostThread.hpp>
+#include <core/Log.hpp>
+#include <core/json/JsonRpc.hpp>
+
+using namespace rstudio::core;
+
+namespace rstudio {
+namespace monitor {
+namespace metrics {
+
+namespace {
+
+void addDouble(std::atomic<double>* pValue, double amount)
+{
+   double current = pValue->load(std::memory_order_relaxed);
+   while (!pValue->compare_exchange_weak(current,
+                                         current + amount,
+                                         std::memory_order_relaxed))
+   {
+   }
+}
+
+std::string escapeLabelValue(const std::string& value)
+{
+   std::string escaped;
+   escaped.reserve(value.size());
+   for (char ch : value)
+   {
+      if (ch == '\\' || ch == '"')
+         escaped.push_back('\\');
+      else if (ch == '\n')
+      {
+         escaped.append("\\n");
+         continue;
+      }
+      escaped.push_back(ch);
+   }
+   return escaped;
+}
+
+std::string escapeHelp(const std::string& help)
+{
+   std::string escaped;
+   escaped.reserve(help.size());
+   for (char ch : help)
+   {
+      if (ch == '\\')
+         escaped.append("\\\\");
+      else if (ch == '\n')
+         escaped.append("\\n");
+      else
+         escaped.push_back(ch);
+   }
+   return escaped;
+}
+
+// labels in the exposition format, e.g. {method="get_events"}
+std::string formatLabels(const Labels& labels)
+{
+   if (labels.empty())
+      return std::string();
+
+   std::string formatted = "{";
+   for (std::size_t i = 0; i < labels.size(); i++)
+   {
+      if (i > 0)
+         formatted.push_back(',');
+      formatted.append(labels[i].first);
+      formatted.append("=\"");
+      formatted.append(escapeLabelValue(labels[i].second));
+      formatted.push_back('"');
+   }
+   formatted.push_back('}');
+   return formatted;
+}
+
+std::string formatValue(double value)
+{
+   if (std::isinf(value))
+      return value > 0 ? "+Inf" : "-Inf";
+   if (std::isnan(value))
+      return "NaN";
+
+   // write whole numbers (e.g. counts) without an exponent
+   if (value == std::floor(value) && std::fabs(value) < 1e15)
+      return std::to_string(static_cast<int64_t>(value));
+
+   std::ostringstream os;
+   os << std::setprecision(12) << value;
+   return os.str();
+}
+
+bool isNumber(const json::Value& value)
+{
+   return value.getType() == json::Type::INTEGER ||
+          value.getType() == json::Type::REAL;
+}
+
+// The registry of this process's metrics (allocated on the heap and never
+// freed so that metrics can be recorded during static destruction)
+struct Registry
+{
+   boost::mutex mutex;
+   std::map<std::string, Counter*> counters;
+   std::map<std::string, Gauge*> gauges;
+   std::map<std::string, Histogram*> histograms;
+   std::vector<boost::function<void()> > collectors;
+};
+
+Registry& registry()
+{
+   static Registry* s_pRegistry = new Registry();
+   return *s_pRegistry;
+}
+
+// read the resident memory and cpu time of this process
+void collectProcessMetrics(Gauge* pResidentMemory, Gauge* pCpuSeconds)
+{
+   struct rusage usage;
+   if (::getrusage(RUSAGE_SELF, &usage) == 0)
+   {
+      double seconds =
+            usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1000000.0 +
+            usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1000000.0;
+      pCpuSeconds->set(seconds);
+   }
+
+#ifdef __APPLE__
+   // no procfs, so report the peak (which is in bytes on macOS)
+   pResidentMemory->set(static_cast<double>(usage.ru_maxrss));
+#else
+   // the second field of statm is the resident size in pages
+   std::ifstream statm("/proc/self/statm");
+   long size = 0, resident = 0;
+   if (statm >> size >> resident)
+      pResidentMemory->set(static_cast<double>(resident) * ::sysconf(_SC_PAGESIZE));
+#endif
+}
+
+} // anonymous namespace
+
+namespace detail {
+
+std::size_t assignShard()
+{
+   static std::atomic<std::size_t> s_nextShard(0);
+   return s_nextShard.fetch_add(1, std::memory_order_relaxed) % Counter::kShardCount;
+}
+
+} // namespace detail
+
+const std::size_t Counter::kShardCount;
+
+Counter::Counter(const std::string& name,
+                 const std::string& help,
+                 const Labels& labels)
+   : AggregateMetric(name, help, labels)
+{
+   for (Shard& shard : shards_)
+      shard.value.store(0, std::memory_order_relaxed);
+}
+
+uint64_t Counter::value() const
+{
+   uint64_t total = 0;
+   for (const Shard& shard : shards_)
+      total += shard.value.load(std::memory_order_relaxed);
+   return total;
+}
+
+Gauge::Gauge(const std::string& name,
+             const std::string& help,
+             const Labels& labels)
+   : AggregateMetric(name, help, labels),
+     value_(0)
+{
+}
+
+void Gauge::add(double amount)
+{
+   addDouble(&value_, amount);
+}
+
+Histogram::Histogram(const std::string& name,
+                     const std::string& help,
+                     const std::vector<double>& bounds,
+                     const Labels& labels)
+   : AggregateMetric(name, help, labels),
+     bounds_(bounds),
+     buckets_(bounds.size() + 1),
+     sum_(0)
+{
+   std::sort(bounds_.begin(), bounds_.end());
+   for (std::atomic<uint64_t>& bucket : buckets_)
+      bucket.store(0, std::memory_order_relaxed);
+}
+
+void Histogram::observe(double value)
+{
+   // a bucket counts the values less than or equal to its bound
+   std::size_t index = std::lower_bound(bounds_.begin(), bounds_.end(), value) - bounds_.begin();
+   buckets_[index].fetch_add(1, std::memory_order_relaxed);
+   addDouble(&sum_, value);
+}
+
+std::vector<uint64_t> Histogram::bucketCounts() const
+{
+   std::vector<uint64_t> counts;
+   counts.reserve(buckets_.size());
+   for (const std::atomic<uint64_t>& bucket : buckets_)
+      counts.push_back(bucket.load(std::memory_order_relaxed));
+   return counts;
+}
+
+const std::vector<double>& latencyBounds()
+{
+   static const std::vector<double> s_bounds = {
+      0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10
+   };
+   return s_bounds;
+}
+
+Counter& counter(const std::string& name,
+                 const std::string& help,
+                 const Labels& labels)
+{
+   Registry& reg = registry();
+   boost::lock_guard<boost::mutex> lock(reg.mutex);
+   Counter*& pCounter = reg.counters[name + formatLabels(labels)];
+   if (pCounter == nullptr)
+      pCounter = new Counter(name, help, labels);
+   return *pCounter;
+}
+
+Gauge& gauge(const std::string& name,
+             const std::string& help,
+             const Labels& labels)
+{
+   Registry& reg = registry();
+   boost::lock_guard<boost::mutex> lock(reg.mutex);
+   Gauge*& pGauge = reg.gauges[name + formatLabels(labels)];
+   if (pGauge == nullptr)
+      pGauge = new Gauge(name, help, labels);
+   return *pGauge;
+}
+
+Histogram& histogram(const std::string& name,
+                     const std::string& help,
+                     const std::vector<double>& bounds,
+                     const Labels& labels)
+{
+   Registry& reg = registry();
+   boost::lock_guard<boost::mutex> lock(reg.mutex);
+   Histogram*& pHistogram = reg.histograms[name + formatLabels(labels)];
+   if (pHistogram == nullptr)
+      pHistogram = new Histogram(name, help, bounds, labels);
+   return *pHistogram;
+}
+
+void addCollector(const boost::function<void()>& collector)
+{
+   Registry& reg = registry();
+   boost::lock_guard<boost::mutex> lock(reg.mutex);
+   reg.collectors.push_back(collector);
+}
+
+void addProcessCollector(const std::string& prefix)
+{
+   Gauge& residentMemory = gauge(prefix + "_process_resident_memory_bytes",
+                                 "Resident memory size in bytes.");
+   Gauge& cpuSeconds = gauge(prefix + "_process_cpu_seconds",
+                             "User and system CPU time spent in seconds.");
+   addCollector(boost::bind(collectProcessMetrics, &residentMemory, &cpuSeconds));
+}
+
+Snapshot snapshot()
+{
+   Registry& reg = registry();
+
+   // run the collectors (outside the lock, since they update metrics)
+   std::vector<boost::function<void()> > collectors;
+   {
+      boost::lock_guard<boost::mutex> lock(reg.mutex);
+      collectors = reg.collectors;
+   }
+   for (const boost::function<void()>& collector : collectors)
+      collector();
+
+   Snapshot snapshot;
+   boost::lock_guard<boost::mutex> lock(reg.mutex);
+
+   for (const auto& entry : reg.counters)
+   {
+      Snapshot::Sample sample;
+      sample.value = static_cast<double>(entry.second->value());
+      snapshot.add("counter", *entry.second, sample);
+   }
+
+   for (const auto& entry : reg.gauges)
+   {
+      Snapshot::Sample sample;
+      sample.value = entry.second->value();
+      snapshot.add("gauge", *entry.second, sample);
+   }
+
+   for (const auto& entry : reg.histograms)
+   {
+      Snapshot::Sample sample;
+      sample.bounds = entry.second->bounds();
+      sample.buckets = entry.second->bucketCounts();
+      sample.sum = entry.second->sum();
+      snapshot.add("histogram", *entry.second, sample);
+   }
+
+   return snapshot;
+}
+
+void Snapshot::add(const std::string& type,
+                   const AggregateMetric& metric,
+                   const Sample& sample)
+{
+   Family& family = families_[metric.name()];
+   family.type = type;
+   family.help = metric.help();
+
+   Sample& added = family.samples[formatLabels(metric.labels())];
+   added = sample;
+   added.labels = metric.labels();
+}
+
+void Snapshot::merge(const Snapshot& other, bool includeGauges)
+{
+   for (const auto& family : other.families_)
+   {
+      if (!includeGauges && family.second.type == "gauge")
+         continue;
+
+      for (const auto& sample : family.second.samples)
+         mergeSample(family.first, family.second, sample.first, sample.second);
+   }
+}
+
+void Snapshot::mergeSample(const std::string& name,
+                           const Family& family,
+                           const std::string& key,
+                           const Sample& sample)
+{
+   Family& merged = families_[name];
+   if (merged.type.empty())
+   {
+      merged.type = family.type;
+      merged.help = family.help;
+   }
+   else if (merged.type != family.type)
+   {
+      LOG_DEBUG_MESSAGE("Metric " + name + " has conflicting types " +
+                        merged.type + " and " + family.type);
+      return;
+   }
+
+   std::map<std::string, Sample>::iterator it = merged.samples.find(key);
+   if (it == merged.samples.end())
+   {
+      merged.samples[key] = sample;
+      return;
+   }
+
+   Sample& mergedSample = it->second;
+   if (family.type == "histogram")
+   {
+      // buckets can only be summed if they have the same bounds
+      if (mergedSample.bounds != sample.bounds ||
+          mergedSample.buckets.size() != sample.buckets.size())
+      {
+         LOG_DEBUG_MESSAGE("Metric " + name + " has conflicting bucket bounds");
+         return;
+      }
+
+      for (std::size_t i = 0; i < sample.buckets.size(); i++)
+         mergedSample.buckets[i] += sample.buckets[i];
+      mergedSample.sum += sample.sum;
+   }
+   else
+   {
+      mergedSample.value += sample.value;
+   }
+}
+
+json::Object Snapshot::toJson() const
+{
+   json::Array familiesJson;
+   for (const auto& family : families_)
+   {
+      json::Array samplesJson;
+      for (const auto& sample : family.second.samples)
+      {
+         json::Array labelsJson;
+         for (const auto& label : sample.second.labels)
+         {
+            json::Array labelJson;
+            labelJson.push_back(label.first);
+            labelJson.push_back(label.second);
+            labelsJson.push_back(labelJson);
+         }
+
+         json::Object sampleJson;
+         sampleJson["labels"] = labelsJson;
+         if (family.second.type == "histogram")
+         {
+            json::Array boundsJson, bucketsJson;
+            for (double bound : sample.second.bounds)
+               boundsJson.push_back(bound);
+            for (uint64_t count : sample.second.buckets)
+               bucketsJson.push_back(static_cast<double>(count));
+            sampleJson["bounds"] = boundsJson;
+            sampleJson["buckets"] = bucketsJson;
+            sampleJson["sum"] = sample.second.sum;
+         }
+         else
+         {
+            sampleJson["value"] = sample.second.value;
+         }
+         samplesJson.push_back(sampleJson);
+      }
+
+      json::Object familyJson;
+      familyJson["name"] = family.first;
+      familyJson["type"] = family.second.type;
+      familyJson["help"] = family.second.help;
+      familyJson["samples"] = samplesJson;
+      familiesJson.push_back(familyJson);
+   }
+
+   json::Object snapshotJson;
+   snapshotJson["families"] = familiesJson;
+   return snapshotJson;
+}
+
+Error Snapshot::fromJson(const json::Object& snapshotJson, Snapshot* pSnapshot)
+{
+   json::Array familiesJson;
+   Error error = json::readObject(snapshotJson, "families", familiesJson);
+   if (error)
+      return error;
+
+   Snapshot snapshot;
+   for (const json::Value& familyValue : familiesJson)
+   {
+      if (!familyValue.isObject())
+         return Error(json::errc::ParamTypeMismatch, ERROR_LOCATION);
+
+      std::string name;
+      Family family;
+      json::Array samplesJson;
+      error = json::readObject(familyValue.getObject(),
+                               "name", name,
+                               "type", family.type,
+                               "help", family.help,
+                               "samples", samplesJson);
+      if (error)
+         return error;
+
+      bool isHistogram = family.type == "histogram";
+      for (const json::Value& sampleValue : samplesJson)
+      {
+         if (!sampleValue.isObject())
+            return Error(json::errc::ParamTypeMismatch, ERROR_LOCATION);
+         const json::Object& sampleJson = sampleValue.getObject();
+
+         Sample sample;
+         json::Array labelsJson;
+         error = json::readObject(sampleJson, "labels", labelsJson);
+         if (error)
+            return error;
+         for (const json::Value& labelValue : labelsJson)
+         {
+            if (!labelValue.isArray() ||
+                labelValue.getArray().getSize() != 2 ||
+                !labelValue.getArray()[0].isString() ||
+                !labelValue.getArray()[1].isString())
+            {
+               return Error(json::errc::ParamTypeMismatch, ERROR_LOCATION);
+            }
+            sample.labels.push_back(std::make_pair(labelValue.getArray()[0].getString(),
+                                                   labelValue.getArray()[1].getString()));
+         }
+
+         if (isHistogram)
+         {
+            json::Array boundsJson, bucketsJson;
+            error = json::readObject(sampleJson,
+                                     "bounds", boundsJson,
+                                     "buckets", bucketsJson,
+                                     "sum", sample.sum);
+            if (error)
+               return error;
+
+            for (const json::Value& bound : boundsJson)
+            {
+               if (!isNumber(bound))
+                  return Error(json::errc::ParamTypeMismatch, ERROR_LOCATION);
+               sample.bounds.push_back(bound.getDouble());
+            }
+            for (const json::Value& count : bucketsJson)
+            {
+               if (!isNumber(count))
+                  return Error(json::errc::ParamTypeMismatch, ERROR_LOCATION);
+               sample.buckets.push_back(static_cast<uint64_t>(count.getDouble()));
+            }
+            if (sample.buckets.size() != sample.bounds.size() + 1)
+               return Error(json::errc::ParamInvalid, ERROR_LOCATION);
+         }
+         else
+         {
+            error = json::readObject(sampleJson, "value", sample.value);
+            if (error)
+               return error;
+         }
+
+         snapshot.mergeSample(name, family, formatLabels(sample.labels), sample);
+      }
+   }
+
+   *pSnapshot = snapshot;
+   return Success();
+}
+
+void Snapshot::writePrometheus(std::ostream& os) const
+{
+   for (const auto& family : families_)
+   {
+      const std::string& name = family.first;
+      os << "# HELP " << name << " " << escapeHelp(family.second.help) << "\n"
+         << "# TYPE " << name << " " << family.second.type << "\n";
+
+      for (const auto& sample : family.second.samples)
+      {
+         if (family.second.type != "histogram")
+         {
+            os << name << sample.first << " " << formatValue(sample.second.value) << "\n";
+            continue;
+         }
+
+         // buckets are written cumulatively, with their bound as the le label
+         uint64_t cumulative = 0;
+         for (std::size_t i = 0; i < sample.second.buckets.size(); i++)
+         {
+            cumulative += sample.second.buckets[i];
+
+            Labels labels = sample.second.labels;
+            labels.push_back(std::make_pair(
+                                "le",
+                                i < sample.second.bounds.size() ?
+                                   formatValue(sample.second.bounds[i]) : "+Inf"));
+            os << name << "_bucket" << formatLabels(labels) << " "
+               << formatValue(static_cast<double>(cumulative)) << "\n";
+         }
+         os << name << "_sum" << sample.first << " " << formatValue(sample.second.sum) << "\n"
+            << name << "_count" << sample.first << " "
+            << formatValue(static_cast<double>(cumulative)) << "\n";
+      }
+   }
+}
+
+} // namespace metrics
+} // namespace monitor
+} // namespace rstudio
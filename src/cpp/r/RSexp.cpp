@@ -371,7 +371,8 @@ void listEnvironment(SEXP env,
 
       if (varSEXP != R_UnboundValue) // should never be unbound
       {
-         pProtect->add(varSEXP);
+         if (pProtect)
+            pProtect->add(varSEXP);
          pVariables->push_back(std::make_pair(var, varSEXP));
       }
       else
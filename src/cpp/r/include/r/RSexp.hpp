@@ -60,6 +60,9 @@ SEXP forcePromise(SEXP objectSEXP);
    
 // variables within an environment
 typedef std::pair<std::string,SEXP> Variable ;
+
+// if pProtect is null the values are left unprotected; they remain reachable
+// through the environment only until it is next modified
 void listEnvironment(SEXP env, 
                      bool includeAll,
                      bool includeLastDotValue,
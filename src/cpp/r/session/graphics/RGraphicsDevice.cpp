@@ -78,6 +78,10 @@ double s_devicePixelRatio = 1.0;
    
 // provide GraphicsDeviceEvents for plot manager
 GraphicsDeviceEvents s_graphicsDeviceEvents;   
+
+// has the device been resized without the display list being replayed
+// onto it? (see syncDisplayList)
+bool s_displayListNeedsSync = false;
    
 using namespace handler;
 
@@ -89,6 +93,9 @@ void GD_NewPage(const pGEcontext gc, pDevDesc dev)
    // delegate
    handler::newPage(gc, dev);
 
+   // the new page is drawn at the current size
+   s_displayListNeedsSync = false;
+
    // fire event (pass previousPageSnapshot)
    SEXP previousPageSnapshot = s_pGEDevDesc->savedSnapshot;
    s_graphicsDeviceEvents.onNewPage(previousPageSnapshot);
@@ -365,6 +372,8 @@ void GD_Close(pDevDesc dev)
       s_pGEDevDesc = nullptr;
    }
 
+   s_displayListNeedsSync = false;
+
    s_graphicsDeviceEvents.onClosed();
 }
    
@@ -419,19 +428,30 @@ void resyncDisplayList()
    // now update the device structure
    handler::setSize(pDev);
 
-   // replay the display list onto the resized surface
-   {
-      SuppressDeviceEventsScope scope(plotManager());
-      Error error = r::exec::RFunction(".rs.GEplayDisplayList").call();
-      if (error)
-      {
-         std::string errMsg;
-         if (r::isCodeExecutionError(error, &errMsg))
-            Rprintf("%s\n", errMsg.c_str());
-         else
-            LOG_ERROR(error);
-      }
+   // replaying the display list onto the resized surface is deferred until
+   // something needs the device's graphics state, as the plot may well be
+   // displayed from an earlier render at this size
+   s_displayListNeedsSync = true;
+}
 
+// replay the display list onto the device if it has been resized since
+// the display list was last played
+void syncDisplayList()
+{
+   if (!s_displayListNeedsSync || s_pGEDevDesc == nullptr)
+      return;
+
+   s_displayListNeedsSync = false;
+
+   SuppressDeviceEventsScope scope(plotManager());
+   Error error = r::exec::RFunction(".rs.GEplayDisplayList").call();
+   if (error)
+   {
+      std::string errMsg;
+      if (r::isCodeExecutionError(error, &errMsg))
+         Rprintf("%s\n", errMsg.c_str());
+      else
+         LOG_ERROR(error);
    }
 }
 
@@ -626,12 +646,14 @@ double grconvertY(double y, const std::string& from, const std::string& to)
 
 void deviceToUser(double* x, double* y)
 {
+   syncDisplayList();
    *x = grconvertX(*x, "device", "user");
    *y = grconvertY(*y, "device", "user");
 }
 
 void deviceToNDC(double* x, double* y)
 {
+   syncDisplayList();
    *x = grconvertX(*x, "device", "ndc");
    *y = grconvertY(*y, "device", "ndc");
 }
@@ -643,6 +665,10 @@ Error saveSnapshot(const core::FilePath& snapshotFile,
    Error error = makeActive();
    if (error)
       return error ;
+
+   // the image is written from the display list as played at
+   // the current size
+   syncDisplayList();
    
    // save snaphot file
    error = r::exec::RFunction(".rs.saveGraphics",
@@ -662,13 +688,17 @@ Error restoreSnapshot(const core::FilePath& snapshotFile)
    if (error)
       return error ;
    
-   // restore
-   return r::exec::RFunction(".rs.restoreGraphics",
-                             string_utils::utf8ToSystem(snapshotFile.getAbsolutePath())).call();
+   // restore (this plays the restored display list at the current size)
+   error = r::exec::RFunction(".rs.restoreGraphics",
+                              string_utils::utf8ToSystem(snapshotFile.getAbsolutePath())).call();
+   if (!error)
+      s_displayListNeedsSync = false;
+   return error;
 }
     
 void copyToActiveDevice()
 {
+   syncDisplayList();
    int rsDeviceNumber = GEdeviceNumber(s_pGEDevDesc);
    r::exec::RFunction(".rs.GEcopyDisplayList", rsDeviceNumber).call();
 }
@@ -680,6 +710,9 @@ std::string imageFileExtension()
 
 void onBeforeExecute()
 {
+   // code about to be executed may draw on or query the device
+   syncDisplayList();
+
    if (s_pGEDevDesc != nullptr)
    {
       DeviceContext* pDC = (DeviceContext*)s_pGEDevDesc->dev->deviceSpecific;
@@ -41,6 +41,7 @@ Plot::Plot(const GraphicsDeviceFunctions& graphicsDevice,
    : graphicsDevice_(graphicsDevice), 
      baseDirPath_(baseDirPath),
      needsUpdate_(false),
+     contentChanged_(false),
      manipulator_(manipulatorSEXP)
 {
 }
@@ -54,6 +55,7 @@ Plot::Plot(const GraphicsDeviceFunctions& graphicsDevice,
      storageUuid_(storageUuid),
      renderedSize_(renderedSize),
      needsUpdate_(false),
+     contentChanged_(false),
      manipulator_()
 {
    // invalidate if the image file doesn't exist (allows the server
@@ -72,11 +74,27 @@ bool Plot::hasValidStorage() const
    return hasStorage() && snapshotFilePath().exists();
 }
 
+std::string Plot::contentId() const
+{
+   return contentChanged_ ? std::string() : contentId_;
+}
+
 void Plot::invalidate()
 {
    needsUpdate_ = true;
 }
 
+void Plot::invalidateContent()
+{
+   needsUpdate_ = true;
+   contentChanged_ = true;
+}
+
+bool Plot::isRendered() const
+{
+   return !needsUpdate_ && (renderedSize() == graphicsDevice_.displaySize());
+}
+
 bool Plot::hasManipulator() const
 {
    // check is a bit complicated because defer loading the manipulator
@@ -123,11 +141,8 @@ Error Plot::renderFromDisplay()
 {
    // we can use our cached representation if we don't need an update and our 
    // rendered size is the same as the current graphics device size
-   if ( !needsUpdate_ &&
-        (renderedSize() == graphicsDevice_.displaySize()) )
-   {
+   if (isRendered())
       return Success();
-   }
    
    // generate a new storage uuid
    std::string storageUuid = core::system::generateUuid();
@@ -148,13 +163,58 @@ Error Plot::renderFromDisplay()
    // delete existing files (if any)
    Error removeError = removeFiles();
         
-   // update state
+   // update state (the content is identified by the storage it
+   // was first rendered to)
    storageUuid_ = storageUuid;
    needsUpdate_ = false;
+   if (contentChanged_ || contentId_.empty())
+      contentId_ = storageUuid;
+   contentChanged_ = false;
    
    // return error status 
    return removeError;
 }
+
+Error Plot::renderFromImage(const FilePath& imagePath)
+{
+   if (isRendered())
+      return Success();
+
+   // generate a new storage uuid
+   std::string storageUuid = core::system::generateUuid();
+
+   // the image is a render of our content at the current display size, so
+   // take a copy of it. the snapshot doesn't depend on the display size so
+   // it's moved rather than saved again
+   Error error = imagePath.copy(imageFilePath(storageUuid));
+   if (error)
+      return Error(errc::PlotFileError, error, ERROR_LOCATION);
+
+   error = snapshotFilePath().move(snapshotFilePath(storageUuid));
+   if (error)
+   {
+      Error removeError = imageFilePath(storageUuid).removeIfExists();
+      if (removeError)
+         LOG_ERROR(removeError);
+      return Error(errc::PlotFileError, error, ERROR_LOCATION);
+   }
+
+   // save rendered size
+   renderedSize_ = graphicsDevice_.displaySize();
+
+   // save manipulator (if any)
+   saveManipulator(storageUuid);
+
+   // delete existing files (if any)
+   Error removeError = removeFiles();
+
+   // update state
+   storageUuid_ = storageUuid;
+   needsUpdate_ = false;
+
+   // return error status
+   return removeError;
+}
    
 Error Plot::renderFromDisplaySnapshot(SEXP snapshot)
 {
@@ -194,6 +254,7 @@ Error Plot::renderFromDisplaySnapshot(SEXP snapshot)
    // update state
    storageUuid_ = storageUuid;
    needsUpdate_ = true;
+   contentChanged_ = true;
    
    // return error status
    return removeError;
@@ -58,14 +58,27 @@ public:
    bool hasValidStorage() const;
    const DisplaySize& renderedSize() const { return renderedSize_; }
 
+   // identifies what the plot draws, independent of the size it was
+   // rendered at (empty if it has been drawn on since it was rendered)
+   std::string contentId() const;
+
+   // the content id the plot was last rendered with (kept when it has been
+   // drawn on since, so renders of its previous content can be found)
+   const std::string& renderedContentId() const { return contentId_; }
+
    bool hasManipulator() const;
    SEXP manipulatorSEXP() const;
    void manipulatorAsJson(core::json::Value* pValue) const;
    void saveManipulator() const;
    
    void invalidate();
+   void invalidateContent();
+
+   // is the rendered image up to date with the display?
+   bool isRendered() const;
    
    core::Error renderFromDisplay();
+   core::Error renderFromImage(const core::FilePath& imagePath);
    core::Error renderFromDisplaySnapshot(SEXP snapshot);
    std::string imageFilename() const;
    
@@ -93,6 +106,8 @@ private:
    std::string storageUuid_ ;
    DisplaySize renderedSize_ ;
    bool needsUpdate_;
+   std::string contentId_;
+   bool contentChanged_;
 
    // manipulator and protection scope for it
    mutable PlotManipulator manipulator_;
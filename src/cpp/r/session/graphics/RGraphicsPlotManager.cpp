@@ -27,6 +27,7 @@
 #include <shared_core/Error.hpp>
 #include <core/FileSerializer.hpp>
 #include <core/RegexUtils.hpp>
+#include <core/system/System.hpp>
 
 #include <r/RExec.hpp>
 #include <r/RUtil.hpp>
@@ -52,6 +53,13 @@ double pixelsToInches(int pixels)
    return (double)pixels / 96.0;
 }
 
+// maximum number of plot renders to keep
+const std::size_t kMaxPlotRenders = 50;
+
+// format of renders made by the graphics device (as opposed to those
+// made by savePlotAsImage)
+const char * const kDisplayRenderFormat = "display";
+
 } // anonymous namespace
 
 const char * const kPngFormat = "png";
@@ -79,6 +87,7 @@ PlotManager::PlotManager()
       lastChange_(boost::posix_time::not_a_date_time),
       suppressDeviceEvents_(false),
       activePlot_(-1),
+      renderCache_(kMaxPlotRenders),
       plotInfoRegex_("([A-Za-z0-9\\-]+):([0-9]+),([0-9]+)")
 {
    plots_.set_capacity(100);
@@ -101,6 +110,11 @@ Error PlotManager::initialize(const FilePath& graphicsPath,
 
    // save reference to plots state file
    plotsStateFile_ = graphicsPath_.completePath("INDEX");
+
+   // cached renders are only meaningful to this process so they're kept in
+   // the R temp dir rather than with the (persistent) plots
+   renderCache_.setCachePath(r::session::utils::tempDir().completePath(
+                                "rs-plot-renders-" + core::system::generateUuid()));
    
    // save reference to graphics device functions
    graphicsDevice_ = graphicsDevice;
@@ -182,6 +196,7 @@ Error PlotManager::removePlot(int index)
       return plotIndexError(index, ERROR_LOCATION);
    
    // remove the plot files 
+   removeRenders(*plots_[index]);
    Error removeError = plots_[index]->removeFiles();
    if (removeError)
       logAndReportError(removeError, ERROR_LOCATION);
@@ -272,6 +287,37 @@ Error PlotManager::savePlotAsImage(const FilePath& filePath,
                                    int widthPx,
                                    int heightPx,
                                    double pixelRatio)
+{
+   // use an earlier render of the same plot if we have one (e.g. zoom
+   // windows being resized back and forth)
+   std::string contentId = hasPlot() ? activePlot().contentId() : std::string();
+   if (!contentId.empty())
+   {
+      PlotRenderKey key(contentId, widthPx, heightPx, pixelRatio, format);
+      FilePath cachedPath = renderCache_.find(key);
+      if (!cachedPath.isEmpty())
+      {
+         Error error = cachedPath.copy(filePath, true);
+         if (!error)
+            return Success();
+         LOG_ERROR(error);
+      }
+   }
+
+   Error error = saveActivePlotAsImage(filePath, format, widthPx, heightPx, pixelRatio);
+   if (!error && !contentId.empty())
+   {
+      PlotRenderKey key(contentId, widthPx, heightPx, pixelRatio, format);
+      renderCache_.add(key, filePath);
+   }
+   return error;
+}
+
+Error PlotManager::saveActivePlotAsImage(const FilePath& filePath,
+                                         const std::string& format,
+                                         int widthPx,
+                                         int heightPx,
+                                         double pixelRatio)
 {
    if (format == kPngFormat ||
        format == kBmpFormat ||
@@ -465,7 +511,7 @@ void PlotManager::render(boost::function<void(DisplayState)> outputFunction)
    if (hasPlot()) // write image for active plot
    {
       // copy current contents of the display to the active plot files
-      Error error = activePlot().renderFromDisplay();
+      Error error = renderActivePlot();
       if (error)
       {
          // no such file error expected in the case of an invalid graphics
@@ -785,6 +831,7 @@ void PlotManager::onDeviceNewPage(SEXP previousPageSnapshot)
       // if we're full then remove the first plot's files before adding a new one
       if (plots_.full())
       {
+         removeRenders(*plots_.front());
          Error error = plots_.front()->removeFiles();
          if (error)
             LOG_ERROR(error);
@@ -815,7 +862,7 @@ void PlotManager::onDeviceResized()
    if (suppressDeviceEvents_)
       return;
    
-   invalidateActivePlot();
+   invalidateActivePlot(false);
 }
 
 void PlotManager::onDeviceClosed()
@@ -826,6 +873,7 @@ void PlotManager::onDeviceClosed()
    // clear plots
    activePlot_ = -1;
    plots_.clear();
+   renderCache_.clear();
    
    // trip changes flag to ensure repaint
    setDisplayHasChanges(true);
@@ -866,12 +914,70 @@ void PlotManager::setDisplayHasChanges(bool hasChanges)
 }
 
    
-void PlotManager::invalidateActivePlot()
+void PlotManager::invalidateActivePlot(bool contentChanged)
 {
    setDisplayHasChanges(true);
    
    if (hasPlot())
-      activePlot().invalidate();
+   {
+      if (contentChanged)
+         activePlot().invalidateContent();
+      else
+         activePlot().invalidate();
+   }
+}
+
+Error PlotManager::renderActivePlot()
+{
+   Plot& plot = activePlot();
+   if (plot.isRendered())
+      return Success();
+
+   // if only the size has changed we may have rendered the
+   // plot at this size before
+   std::string contentId = plot.contentId();
+   if (!contentId.empty())
+   {
+      FilePath cachedPath = renderCache_.find(displayRenderKey(contentId));
+      if (!cachedPath.isEmpty())
+      {
+         Error error = plot.renderFromImage(cachedPath);
+         if (!error)
+            return Success();
+         LOG_ERROR(error);
+      }
+   }
+
+   // render from the display and keep the render for later
+   std::string previousContentId = plot.renderedContentId();
+   Error error = plot.renderFromDisplay();
+   if (error)
+      return error;
+
+   // (renders of the content it had before are no longer needed)
+   if (!previousContentId.empty() && plot.contentId() != previousContentId)
+      renderCache_.remove(previousContentId);
+   renderCache_.add(displayRenderKey(plot.contentId()),
+                    imagePath(plot.imageFilename()));
+
+   return Success();
+}
+
+PlotRenderKey PlotManager::displayRenderKey(const std::string& contentId) const
+{
+   DisplaySize size = graphicsDevice_.displaySize();
+   return PlotRenderKey(contentId,
+                        size.width,
+                        size.height,
+                        r::session::graphics::device::devicePixelRatio(),
+                        kDisplayRenderFormat);
+}
+
+void PlotManager::removeRenders(const Plot& plot)
+{
+   std::string contentId = plot.renderedContentId();
+   if (!contentId.empty())
+      renderCache_.remove(contentId);
 }
    
 // render active plot to display (used in setActivePlot and onSessionResume)
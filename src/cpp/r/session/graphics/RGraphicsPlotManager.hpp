@@ -33,6 +33,7 @@
 
 #include "RGraphicsTypes.hpp"
 #include "RGraphicsPlot.hpp"
+#include "RGraphicsPlotRenderCache.hpp"
 
 namespace rstudio {
 namespace r {
@@ -146,8 +147,14 @@ private:
    // set change flag
    void setDisplayHasChanges(bool hasChanges);
 
-   // invalidate the active plot
-   void invalidateActivePlot();
+   // invalidate the active plot (content is unchanged if it was
+   // only resized)
+   void invalidateActivePlot(bool contentChanged = true);
+
+   // render active plot to its image file (from the render cache if possible)
+   core::Error renderActivePlot();
+   PlotRenderKey displayRenderKey(const std::string& contentId) const;
+   void removeRenders(const Plot& plot);
 
    // render active plot to display (used in setActivePlot and onSessionResume)
    void renderActivePlotToDisplay();
@@ -157,6 +164,12 @@ private:
                                                          deviceCreationFunction);
    core::Error savePlotAsFile(const std::string& fileDeviceCreationCode);
 
+   core::Error saveActivePlotAsImage(const core::FilePath& filePath,
+                                     const std::string& format,
+                                     int widthPx,
+                                     int heightPx,
+                                     double pixelRatio);
+
    core::Error savePlotAsBitmapFile(const core::FilePath& targetPath,
                                     const std::string& bitmapFileType,
                                     int width,
@@ -195,6 +208,9 @@ private:
    
    int activePlot_;
    boost::circular_buffer<PtrPlot> plots_ ;
+
+   // earlier renders of plots (at other sizes or for zoom windows)
+   PlotRenderCache renderCache_;
    
    boost::regex plotInfoRegex_;
 };
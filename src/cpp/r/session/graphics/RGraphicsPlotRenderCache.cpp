@@ -0,0 +1,154 @@
+/*
+ * RGraphicsPlotRenderCache.cpp
+ *
+ * Copyright (C) 2020 by RStudio, PBC
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include "RGraphicsPlotRenderCache.hpp"
+
+#include <shared_core/Error.hpp>
+#include <core/Log.hpp>
+
+#include <core/system/System.hpp>
+
+using namespace rstudio::core;
+
+namespace rstudio {
+namespace r {
+namespace session {
+namespace graphics {
+
+PlotRenderCache::PlotRenderCache(std::size_t maxRenders)
+   : maxRenders_(maxRenders)
+{
+}
+
+PlotRenderCache::~PlotRenderCache()
+{
+   try
+   {
+      clear();
+   }
+   catch(...)
+   {
+   }
+}
+
+void PlotRenderCache::setCachePath(const FilePath& cachePath)
+{
+   clear();
+   cachePath_ = cachePath;
+}
+
+FilePath PlotRenderCache::find(const PlotRenderKey& key)
+{
+   for (std::list<Render>::iterator it = renders_.begin();
+        it != renders_.end();
+        ++it)
+   {
+      if (it->key == key)
+      {
+         // the image may have been removed from underneath us
+         if (!it->imagePath.exists())
+         {
+            renders_.erase(it);
+            return FilePath();
+         }
+
+         // move to the front
+         renders_.splice(renders_.begin(), renders_, it);
+         return renders_.front().imagePath;
+      }
+   }
+
+   return FilePath();
+}
+
+void PlotRenderCache::add(const PlotRenderKey& key, const FilePath& imagePath)
+{
+   // nothing to add if rendering didn't produce an image
+   if (cachePath_.isEmpty() || maxRenders_ == 0 || !imagePath.exists())
+      return;
+
+   Error error = cachePath_.ensureDirectory();
+   if (error)
+   {
+      LOG_ERROR(error);
+      return;
+   }
+
+   // replace any existing render
+   for (std::list<Render>::iterator it = renders_.begin();
+        it != renders_.end();
+        ++it)
+   {
+      if (it->key == key)
+      {
+         removeImage(*it);
+         renders_.erase(it);
+         break;
+      }
+   }
+
+   FilePath cachedPath = cachePath_.completeChildPath(
+            core::system::generateUuid(false) + imagePath.getExtensionLowerCase());
+   error = imagePath.copy(cachedPath);
+   if (error)
+   {
+      LOG_ERROR(error);
+      return;
+   }
+   renders_.push_front(Render(key, cachedPath));
+
+   // evict the least recently used renders
+   while (renders_.size() > maxRenders_)
+   {
+      removeImage(renders_.back());
+      renders_.pop_back();
+   }
+}
+
+void PlotRenderCache::remove(const std::string& contentId)
+{
+   for (std::list<Render>::iterator it = renders_.begin();
+        it != renders_.end();)
+   {
+      if (it->key.contentId == contentId)
+      {
+         removeImage(*it);
+         it = renders_.erase(it);
+      }
+      else
+      {
+         ++it;
+      }
+   }
+}
+
+void PlotRenderCache::clear()
+{
+   for (const Render& render : renders_)
+      removeImage(render);
+   renders_.clear();
+}
+
+void PlotRenderCache::removeImage(const Render& render)
+{
+   Error error = render.imagePath.removeIfExists();
+   if (error)
+      LOG_ERROR(error);
+}
+
+} // namespace graphics
+} // namespace session
+} // namespace r
+} // namespace rstudio
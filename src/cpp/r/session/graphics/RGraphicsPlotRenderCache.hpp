@@ -0,0 +1,114 @@
+/*
+ * RGraphicsPlotRenderCache.hpp
+ *
+ * Copyright (C) 2020 by RStudio, PBC
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef R_SESSION_GRAPHICS_PLOT_RENDER_CACHE_HPP
+#define R_SESSION_GRAPHICS_PLOT_RENDER_CACHE_HPP
+
+#include <list>
+#include <string>
+
+#include <boost/utility.hpp>
+
+#include <shared_core/FilePath.hpp>
+
+namespace rstudio {
+namespace r {
+namespace session {
+namespace graphics {
+
+// identifies a render of a plot: the content it was rendered from (see
+// Plot::contentId) and the size, pixel ratio, and format it was rendered at
+struct PlotRenderKey
+{
+   PlotRenderKey(const std::string& contentId,
+                 int width,
+                 int height,
+                 double pixelRatio,
+                 const std::string& format)
+      : contentId(contentId), width(width), height(height),
+        pixelRatio(pixelRatio), format(format)
+   {
+   }
+
+   std::string contentId;
+   int width;
+   int height;
+   double pixelRatio;
+   std::string format;
+
+   bool operator==(const PlotRenderKey& other) const
+   {
+      return contentId == other.contentId &&
+             width == other.width &&
+             height == other.height &&
+             pixelRatio == other.pixelRatio &&
+             format == other.format;
+   }
+};
+
+// bounded (least recently used) cache of plot renders. rendering a plot
+// replays its display list on the R thread, so when the plots pane is
+// resized back to a size the plot was already rendered at, or a zoom window
+// asks for a render we already made, the image is taken from here instead
+class PlotRenderCache : boost::noncopyable
+{
+public:
+   explicit PlotRenderCache(std::size_t maxRenders);
+   ~PlotRenderCache();
+
+   // directory to keep the cached images in (created on demand)
+   void setCachePath(const core::FilePath& cachePath);
+
+   // returns the path of the cached image (or an empty path if
+   // there isn't one)
+   core::FilePath find(const PlotRenderKey& key);
+
+   // add a copy of a rendered image to the cache
+   void add(const PlotRenderKey& key, const core::FilePath& imagePath);
+
+   // remove all the renders of some plot content
+   void remove(const std::string& contentId);
+
+   void clear();
+
+   std::size_t size() const { return renders_.size(); }
+
+private:
+   struct Render
+   {
+      Render(const PlotRenderKey& key, const core::FilePath& imagePath)
+         : key(key), imagePath(imagePath)
+      {
+      }
+
+      PlotRenderKey key;
+      core::FilePath imagePath;
+   };
+
+   void removeImage(const Render& render);
+
+   std::size_t maxRenders_;
+   core::FilePath cachePath_;
+
+   // most recently used first
+   std::list<Render> renders_;
+};
+
+} // namespace graphics
+} // namespace session
+} // namespace r
+} // namespace rstudio
+
+#endif // R_SESSION_GRAPHICS_PLOT_RENDER_CACHE_HPP
@@ -22,6 +22,7 @@
 #include <core/Log.hpp>
 #include <core/ProgramStatus.hpp>
 #include <core/ProgramOptions.hpp>
+#include <core/Trace.hpp>
 
 #include <core/text/TemplateFilter.hpp>
 
@@ -54,6 +55,7 @@
 #include <server/ServerSessionManager.hpp>
 #include <server/ServerProcessSupervisor.hpp>
 #include <server/ServerPaths.hpp>
+#include <server/ServerMetrics.hpp>
 
 #include <shared_core/Error.hpp>
 #include <shared_core/system/User.hpp>
@@ -268,6 +270,18 @@ void httpServerAddHandlers()
    // establish meta
    uri_handlers::addBlocking("/meta", secureJsonRpcHandler(meta::handleMetaRequest));
 
+   // establish latency histogram and trace handlers for the server (those
+   // of the session are proxied below). the server is shared by all users,
+   // so only its administrator can turn tracing on
+   core::trace::initializeFromEnvironment();
+   if (server::options().serverTraceEnabled())
+      core::trace::setTracingEnabled(true);
+   uri_handlers::addBlocking("/trace/server/stats",
+                             secureHttpHandler(boost::bind(core::trace::handleStatsRequest, _2, _3)));
+   uri_handlers::addBlocking("/trace/server/events",
+                             secureHttpHandler(boost::bind(core::trace::handleEventsRequest, _2, _3)));
+   uri_handlers::add("/trace", secureAsyncHttpHandler(proxyContentRequest));
+
    // establish progress handler
    FilePath wwwPath(server::options().wwwLocalPath());
    FilePath progressPagePath = wwwPath.completePath("progress.htm");
@@ -662,6 +676,11 @@ int main(int argc, char * const argv[])
                                        server::options().monitorSharedSecret(),
                                        s_pHttpServer->ioService());
 
+      // initialize metrics (listens on the monitor socket when enabled)
+      error = metrics::initialize();
+      if (error)
+         return core::system::exitFailure(error, ERROR_LOCATION);
+
       if (!options.verifyInstallation())
       {
          // add a monitor log writer
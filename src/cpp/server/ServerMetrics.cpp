@@ -0,0 +1,246 @@
+/*
+ * ServerMetrics.cpp
+ *
+ * Copyright (C) 2020 by RStudio, PBC
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include <server/ServerMetrics.hpp>
+
+#include <map>
+#include <sstream>
+
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include <shared_core/Error.hpp>
+
+#include <core/BoostThread.hpp>
+#include <core/Log.hpp>
+#include <core/http/LocalStreamAsyncServer.hpp>
+#include <core/http/Request.hpp>
+#include <core/http/Response.hpp>
+#include <core/http/TcpIpAsyncServer.hpp>
+#include <core/json/JsonRpc.hpp>
+#include <core/system/PosixSystem.hpp>
+
+#include <shared_core/system/User.hpp>
+
+#include <monitor/MonitorConstants.hpp>
+#include <monitor/metrics/MetricRegistry.hpp>
+
+#include <server/ServerOptions.hpp>
+#include <server/ServerPaths.hpp>
+
+using namespace rstudio::core;
+
+namespace rstudio {
+namespace server {
+namespace metrics {
+
+namespace {
+
+struct SessionMetrics
+{
+   monitor::metrics::Snapshot snapshot;
+   boost::posix_time::ptime received;
+};
+
+// the most recent metrics of each session (keyed by user id and pid) and
+// the counters and histograms of sessions which are no longer reporting
+// (so that the summed counters never go backwards)
+boost::mutex s_mutex;
+std::map<std::string, SessionMetrics> s_sessionMetrics;
+monitor::metrics::Snapshot s_retiredMetrics;
+
+boost::shared_ptr<http::LocalStreamAsyncServer> s_pMetricsServer;
+boost::shared_ptr<http::TcpIpAsyncServer> s_pPrometheusServer;
+
+// retire the metrics of sessions which have missed a few updates (they've
+// exited or are no longer able to reach us). must be called with s_mutex held
+void retireStaleSessions()
+{
+   boost::posix_time::ptime now = boost::posix_time::microsec_clock::universal_time();
+   boost::posix_time::time_duration staleAfter =
+         boost::posix_time::seconds(kMonitorMetricsIntervalSeconds * 3);
+
+   for (auto it = s_sessionMetrics.begin(); it != s_sessionMetrics.end(); )
+   {
+      if (now - it->second.received > staleAfter)
+      {
+         s_retiredMetrics.merge(it->second.snapshot, false);
+         it = s_sessionMetrics.erase(it);
+      }
+      else
+      {
+         ++it;
+      }
+   }
+}
+
+// is the process a session belonging to the user who connected to us? (so
+// that knowing the shared secret isn't enough to report the metrics of, or
+// replace those reported by, another user's sessions)
+bool isPeerSession(const http::Request& request, int pid)
+{
+   if (request.remoteUid() < 0)
+      return false;
+
+#ifdef __APPLE__
+   return true;
+#else
+   core::system::ProcessInfo info;
+   Error error = core::system::processInfo(pid, &info);
+   if (error)
+      return false;
+
+   if (info.exe != "rsession")
+      return false;
+
+   core::system::User peer;
+   error = core::system::User::getUserFromIdentifier(request.remoteUid(), peer);
+   if (error)
+   {
+      LOG_ERROR(error);
+      return false;
+   }
+
+   return info.username == peer.getUsername();
+#endif
+}
+
+void handleSessionMetrics(const http::Request& request, http::Response* pResponse)
+{
+   if (request.headerValue(kMonitorSharedSecretHeader) != options().monitorSharedSecret())
+   {
+      pResponse->setStatusCode(http::status::Unauthorized);
+      return;
+   }
+
+   json::Value bodyJson;
+   if (bodyJson.parse(request.body()) || !bodyJson.isObject())
+   {
+      pResponse->setStatusCode(http::status::BadRequest);
+      return;
+   }
+
+   int pid;
+   json::Object metricsJson;
+   Error error = json::readObject(bodyJson.getObject(),
+                                  "pid", pid,
+                                  "metrics", metricsJson);
+   if (error)
+   {
+      LOG_ERROR(error);
+      pResponse->setStatusCode(http::status::BadRequest);
+      return;
+   }
+
+   if (!isPeerSession(request, pid))
+   {
+      LOG_WARNING_MESSAGE("Rejected metrics for process " + std::to_string(pid) +
+                          " sent by user id " + std::to_string(request.remoteUid()));
+      pResponse->setStatusCode(http::status::Forbidden);
+      return;
+   }
+
+   SessionMetrics sessionMetrics;
+   error = monitor::metrics::Snapshot::fromJson(metricsJson, &sessionMetrics.snapshot);
+   if (error)
+   {
+      LOG_ERROR(error);
+      pResponse->setStatusCode(http::status::BadRequest);
+      return;
+   }
+   sessionMetrics.received = boost::posix_time::microsec_clock::universal_time();
+
+   std::string key = std::to_string(request.remoteUid()) + ":" + std::to_string(pid);
+   LOCK_MUTEX(s_mutex)
+   {
+      s_sessionMetrics[key] = sessionMetrics;
+      retireStaleSessions();
+   }
+   END_LOCK_MUTEX
+
+   pResponse->setStatusCode(http::status::Ok);
+}
+
+void handleMetricsRequest(const http::Request& request, http::Response* pResponse)
+{
+   static monitor::metrics::Gauge& reportingSessions =
+         monitor::metrics::gauge("rserver_reporting_sessions",
+                                 "Number of sessions whose metrics are included.");
+
+   monitor::metrics::Snapshot metrics;
+   LOCK_MUTEX(s_mutex)
+   {
+      retireStaleSessions();
+      metrics = s_retiredMetrics;
+      for (const auto& session : s_sessionMetrics)
+         metrics.merge(session.second.snapshot);
+      reportingSessions.set(static_cast<double>(s_sessionMetrics.size()));
+   }
+   END_LOCK_MUTEX
+
+   metrics.merge(monitor::metrics::snapshot());
+
+   std::ostringstream os;
+   metrics.writePrometheus(os);
+
+   pResponse->setNoCacheHeaders();
+   pResponse->setContentType("text/plain; version=0.0.4");
+   pResponse->setBody(os.str());
+}
+
+} // anonymous namespace
+
+Error initialize()
+{
+   if (!options().monitorMetricsEnabled())
+      return Success();
+
+   monitor::metrics::addProcessCollector("rserver");
+
+   // sessions (which run as other users) send their metrics over the monitor
+   // socket, authenticating with the monitor shared secret (and only for
+   // sessions of the user connecting)
+   s_pMetricsServer.reset(new http::LocalStreamAsyncServer("Monitor",
+                                                           std::string(),
+                                                           FileMode::ALL_READ_WRITE));
+   s_pMetricsServer->addBlockingHandler(kMonitorMetricsUri, handleSessionMetrics);
+
+   Error error = s_pMetricsServer->init(monitorSocketPath());
+   if (error)
+      return error;
+
+   error = s_pMetricsServer->run();
+   if (error)
+      return error;
+
+   // the metrics aren't authenticated, so they're served on their own
+   // address (local only by default) rather than by the web interface
+   s_pPrometheusServer.reset(new http::TcpIpAsyncServer("Metrics"));
+   s_pPrometheusServer->addBlockingHandler(kMonitorMetricsUri, handleMetricsRequest);
+
+   error = s_pPrometheusServer->init(options().monitorMetricsAddress(),
+                                     options().monitorMetricsPort());
+   if (error)
+      return error;
+
+   error = s_pPrometheusServer->run();
+   if (error)
+      return error;
+
+   return Success();
+}
+
+} // namespace metrics
+} // namespace server
+} // namespace rstudio
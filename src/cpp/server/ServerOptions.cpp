@@ -231,7 +231,10 @@ ProgramStatus Options::read(int argc,
          "path to data directory where rstudio server will write run-time state")
       ("server-add-header",
        value<std::vector<std::string>>(&serverAddHeaders_)->default_value(std::vector<std::string>{})->multitoken(),
-         "adds a header to all responses from RStudio Server");
+         "adds a header to all responses from RStudio Server")
+      ("server-trace-enabled",
+         value<bool>(&serverTraceEnabled_)->default_value(false),
+         "record trace events (served at /trace/server/events)");
 
    // www - web server options
    options_description www("www") ;
@@ -378,7 +381,16 @@ ProgramStatus Options::read(int argc,
    monitor.add_options()
       (kMonitorIntervalSeconds,
        value<int>(&monitorIntervalSeconds_)->default_value(60),
-       "monitoring interval");
+       "monitoring interval")
+      (kMonitorMetricsEnabled,
+       value<bool>(&monitorMetricsEnabled_)->default_value(false),
+       "collect metrics from rserver and its sessions and serve them (in the Prometheus format) at /metrics on the monitor-metrics-address and port")
+      ("monitor-metrics-address",
+       value<std::string>(&monitorMetricsAddress_)->default_value("127.0.0.1"),
+       "address on which metrics are served (separately from the web interface)")
+      ("monitor-metrics-port",
+       value<std::string>(&monitorMetricsPort_)->default_value("8788"),
+       "port on which metrics are served");
 
    // define program options
    FilePath defaultConfigPath = core::system::xdg::systemConfigFile("rserver.conf");
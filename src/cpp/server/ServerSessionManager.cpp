@@ -177,6 +177,13 @@ core::system::ProcessConfig sessionProcessConfig(
    environment.push_back(std::make_pair(kMonitorSharedSecretEnvVar,
                                         options.monitorSharedSecret()));
 
+   // tell the session where to send its metrics (if we're collecting them)
+   if (options.monitorMetricsEnabled())
+   {
+      environment.push_back(std::make_pair(kMonitorSocketPathEnvVar,
+                                           monitorSocketPath().getAbsolutePath()));
+   }
+
    // stamp the version number of the rserver process that is launching this session
    // the session should log an error if its version does not match, as that is
    // likely an unsupported configuration
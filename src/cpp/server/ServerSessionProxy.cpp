@@ -35,8 +35,11 @@
 #include <core/BoostErrors.hpp>
 #include <core/Log.hpp>
 #include <core/Thread.hpp>
+#include <core/Trace.hpp>
 #include <core/WaitUtils.hpp>
 #include <core/RegexUtils.hpp>
+#include <core/PeriodicCommand.hpp>
+#include <shared_core/SafeConvert.hpp>
 
 #include <core/http/CSRFToken.hpp>
 #include <core/http/SocketUtils.hpp>
@@ -44,6 +47,7 @@
 #include <core/http/Request.hpp>
 #include <core/http/Response.hpp>
 #include <core/http/LocalStreamAsyncClient.hpp>
+#include <core/http/LocalStreamConnectionPool.hpp>
 #include <core/http/Util.hpp>
 #include <core/http/URL.hpp>
 #include <core/http/ChunkProxy.hpp>
@@ -60,6 +64,8 @@
 #include <server_core/sessions/SessionLocalStreams.hpp>
 #include <server_core/UrlPorts.hpp>
 
+#include <monitor/metrics/MetricRegistry.hpp>
+
 #include <session/SessionConstants.hpp>
 #include <session/SessionInvalidScope.hpp>
 
@@ -70,6 +76,7 @@
 #include <server/ServerErrorCategory.hpp>
 
 #include <server/ServerSessionManager.hpp>
+#include <server/ServerScheduler.hpp>
 
 #include <server/ServerConstants.hpp>
 
@@ -200,6 +207,8 @@ bool sessionContextForRequest(
 void handleProxyResponse(
       boost::shared_ptr<core::http::AsyncConnection> ptrConnection,
       const r_util::SessionContext& context,
+      boost::shared_ptr<core::trace::Span> pSpan,
+      monitor::metrics::Histogram* pLatency,
       const http::Response& response)
 {
    // if there was a launch pending then remove it
@@ -208,6 +217,61 @@ void handleProxyResponse(
    // ensure authorization cookies that were automatically refreshed as part of this
    // request are stamped on the response
    ptrConnection->writeResponse(response, true, getAuthCookies(ptrConnection->response()));
+   core::trace::Clock::duration duration = pSpan->end();
+   pLatency->observe(std::chrono::duration<double>(duration).count());
+}
+
+// the label latencies of proxied requests of a type are recorded under
+std::string requestTypeLabel(int requestType)
+{
+   switch (requestType)
+   {
+      case RequestType::Rpc:
+         return "rpc";
+      case RequestType::Content:
+         return "content";
+      case RequestType::Events:
+         return "events";
+      case RequestType::ClientInit:
+         return "client_init";
+      default:
+         return "other";
+   }
+}
+
+// latency histograms for proxied requests of a type: the trace histogram
+// and the labelled metric
+struct ProxyHistograms
+{
+   core::trace::Histogram* pTrace;
+   monitor::metrics::Histogram* pMetric;
+};
+
+const ProxyHistograms& proxyHistograms(int requestType)
+{
+   // looked up once for each type, sparing a registry lookup per request
+   static const std::vector<ProxyHistograms> s_histograms = []()
+   {
+      std::vector<ProxyHistograms> histograms;
+      for (int type = RequestType::Rpc; type <= RequestType::VSCode; type++)
+      {
+         std::string label = requestTypeLabel(type);
+         ProxyHistograms typeHistograms;
+         typeHistograms.pTrace = &core::trace::histogram("proxy", label);
+         typeHistograms.pMetric = &monitor::metrics::histogram(
+                  "rserver_proxy_request_duration_seconds",
+                  "Latency of requests proxied to sessions in seconds.",
+                  monitor::metrics::latencyBounds(),
+                  {{"type", label}});
+         histograms.push_back(typeHistograms);
+      }
+      return histograms;
+   }();
+
+   // (the last type is recorded as "other", like any unknown type)
+   if (requestType < 0 || requestType >= static_cast<int>(s_histograms.size()))
+      return s_histograms.back();
+   return s_histograms[requestType];
 }
 
 void rewriteLocalhostAddressHeader(const std::string& headerName,
@@ -596,28 +660,82 @@ void handleEventsError(
    ptrConnection->writeResponse();
 }
 
+// cached uids expire so that changes to the passwd database are picked
+// up without requiring a passwd lookup on every proxied request
+const boost::posix_time::time_duration kUserIdCacheTtl = boost::posix_time::minutes(5);
+
+struct CachedUserId
+{
+   UidType uid;
+   boost::posix_time::ptime expires;
+};
+
+boost::mutex s_userIdCacheMutex;
+std::map<std::string, CachedUserId> s_userIdCache;
+
 Error userIdForUsername(const std::string& username, UidType* pUID)
 {
-   static core::thread::ThreadsafeMap<std::string, UidType> cache;
+   boost::posix_time::ptime now = boost::posix_time::microsec_clock::universal_time();
 
-   if (cache.contains(username))
+   LOCK_MUTEX(s_userIdCacheMutex)
    {
-      *pUID = cache.get(username);
+      auto it = s_userIdCache.find(username);
+      if (it != s_userIdCache.end() && now < it->second.expires)
+      {
+         *pUID = it->second.uid;
+         return Success();
+      }
    }
-   else
-   {
-      core::system::User user;
-      Error error = core::system::User::getUserFromIdentifier(username, user);
-      if (error)
-         return error;
+   END_LOCK_MUTEX
+
+   core::system::User user;
+   Error error = core::system::User::getUserFromIdentifier(username, user);
+   if (error)
+      return error;
 
-      *pUID = user.getUserId();
-      cache.set(username, *pUID);
+   *pUID = user.getUserId();
+
+   LOCK_MUTEX(s_userIdCacheMutex)
+   {
+      CachedUserId cached;
+      cached.uid = *pUID;
+      cached.expires = now + kUserIdCacheTtl;
+      s_userIdCache[username] = cached;
    }
+   END_LOCK_MUTEX
 
    return Success();
 }
 
+// kept-alive connections to session streams (shared by all users; keyed
+// by stream path so each session gets its own set of idle connections)
+boost::shared_ptr<http::LocalStreamConnectionPool> sessionConnectionPool()
+{
+   static boost::shared_ptr<http::LocalStreamConnectionPool> instance(
+            new http::LocalStreamConnectionPool());
+   return instance;
+}
+
+bool evictIdleSessionConnections()
+{
+   sessionConnectionPool()->evictIdle();
+
+   http::LocalStreamConnectionPool::Stats stats = sessionConnectionPool()->stats();
+   LOG_DEBUG_MESSAGE("Session connection pool: " +
+                     safe_convert::numberToString(stats.hits) + " hits, " +
+                     safe_convert::numberToString(stats.misses) + " misses (" +
+                     safe_convert::numberToString(static_cast<int>(stats.hitRate() * 100)) + "% hit rate), " +
+                     safe_convert::numberToString(stats.stale) + " stale, " +
+                     safe_convert::numberToString(stats.evictions) + " evicted, " +
+                     safe_convert::numberToString(stats.idle) + " idle; " +
+                     safe_convert::numberToString(stats.connects) + " connects, " +
+                     safe_convert::numberToString(static_cast<uint64_t>(stats.averageConnectMicros())) +
+                     "us avg / " +
+                     safe_convert::numberToString(stats.maxConnectMicros) + "us max connect time");
+
+   return true;
+}
+
 
 
 void proxyRequest(
@@ -684,10 +802,16 @@ void proxyRequest(
 
    // create client
    // if the user is available on the system pass in the uid for validation to ensure
-   // that we only connect to the socket if it was created by the user
+   // that we only connect to the socket if it was created by the user. connections
+   // are pooled unless the caller wants to hold on to the client itself
+   boost::shared_ptr<http::LocalStreamConnectionPool> pPool;
+   if (!clientHandler)
+      pPool = sessionConnectionPool();
    boost::shared_ptr<http::IAsyncClient> pClient(new http::LocalStreamAsyncClient(
                                                     ptrConnection->ioService(),
-                                                    streamPath, false, validateUid));
+                                                    streamPath, false, validateUid,
+                                                    http::ConnectionRetryProfile(),
+                                                    pPool));
 
    // setup retry context
    if (!connectionRetryProfile.empty())
@@ -696,10 +820,14 @@ void proxyRequest(
    // assign request
    pClient->request().assign(*pRequest);
 
-   // proxy the request
+   // proxy the request (timing it until the response is written, or
+   // the client is done with it if there's an error)
+   boost::shared_ptr<core::trace::Span> pSpan =
+         boost::make_shared<core::trace::Span>(*proxyHistograms(requestType).pTrace);
    boost::shared_ptr<http::ChunkProxy> chunkProxy(new http::ChunkProxy(ptrConnection));
    chunkProxy->proxy(pClient);
-   pClient->execute(boost::bind(handleProxyResponse, ptrConnection, context, _1),
+   pClient->execute(boost::bind(handleProxyResponse, ptrConnection, context, pSpan,
+                                proxyHistograms(requestType).pMetric, _1),
                     errorHandler);
 
    if (clientHandler)
@@ -769,6 +897,12 @@ http::Headers getAuthCookies(const http::Response& response)
 
 Error initialize()
 { 
+   // periodically close session connections which have been idle too long
+   scheduler::addCommand(
+      boost::shared_ptr<ScheduledCommand>(new PeriodicCommand(
+         boost::posix_time::seconds(30), evictIdleSessionConnections, false))
+   );
+
    return server_core::sessions::local_streams::ensureStreamsDir();
 }
 
@@ -0,0 +1,40 @@
+/*
+ * ServerMetrics.hpp
+ *
+ * Copyright (C) 2020 by RStudio, PBC
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef SERVER_METRICS_HPP
+#define SERVER_METRICS_HPP
+
+namespace rstudio {
+namespace core {
+   class Error;
+}
+}
+
+namespace rstudio {
+namespace server {
+namespace metrics {
+
+// When metrics are enabled, listen on the monitor socket for the metrics
+// of sessions and serve them (summed over the sessions, along with
+// rserver's own metrics) in the Prometheus text format at /metrics on the
+// monitor-metrics-address and port (not on the web interface, so that
+// access to them can be restricted separately)
+core::Error initialize();
+
+} // namespace metrics
+} // namespace server
+} // namespace rstudio
+
+#endif // SERVER_METRICS_HPP
@@ -93,6 +93,8 @@ public:
       return serverAddHeaders_;
    }
 
+   bool serverTraceEnabled() const { return serverTraceEnabled_; }
+
    // www 
    std::string wwwAddress() const
    { 
@@ -291,6 +293,21 @@ public:
       return monitorIntervalSeconds_;
    }
 
+   bool monitorMetricsEnabled() const
+   {
+      return monitorMetricsEnabled_;
+   }
+
+   std::string monitorMetricsAddress() const
+   {
+      return monitorMetricsAddress_;
+   }
+
+   std::string monitorMetricsPort() const
+   {
+      return monitorMetricsPort_;
+   }
+
    std::string gwtPrefix() const;
 
    core::FilePath secureCookieKeyFile() const
@@ -354,6 +371,7 @@ private:
    bool serverOffline_;
    std::string serverDataDir_;
    std::vector<std::string> serverAddHeaders_;
+   bool serverTraceEnabled_;
    std::string wwwAddress_ ;
    std::string wwwPort_ ;
    std::string wwwUrlPathPrefix_ ;
@@ -390,6 +408,9 @@ private:
    int rsessionProxyMaxWaitSeconds_;
    std::string monitorSharedSecret_;
    int monitorIntervalSeconds_;
+   bool monitorMetricsEnabled_;
+   std::string monitorMetricsAddress_;
+   std::string monitorMetricsPort_;
    std::string secureCookieKeyFile_;
    std::string databaseConfigFile_;
    std::map<std::string,std::string> overlayOptions_;
@@ -0,0 +1,155 @@
+/*
+ * SessionClientEventBuffer.cpp
+ *
+ * Copyright (C) 2020 by RStudio, PBC
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include "SessionClientEventBuffer.hpp"
+
+#include <algorithm>
+
+#include <shared_core/json/Json.hpp>
+
+using namespace rstudio::core;
+
+namespace rstudio {
+namespace session {
+
+namespace {
+
+// events whose data is the complete current state of something (or which
+// just ask the client to refresh it), so that a later one supersedes an
+// earlier one
+bool isStateEvent(int type)
+{
+   return type == client_events::kEnvironmentRefresh ||
+          type == client_events::kPlotsStateChanged ||
+          type == client_events::kWorkingDirChanged ||
+          type == client_events::kPackageStateChanged ||
+          type == client_events::kJobRefresh ||
+          type == client_events::kConnectionListChanged ||
+          type == client_events::kActiveConnectionsChanged;
+}
+
+// the event which replaces two state events of the same type
+ClientEvent mergeStateEvents(const ClientEvent& previous, const ClientEvent& next)
+{
+   // the plots pane is activated when any of the plots states asked for it
+   if (next.type() == client_events::kPlotsStateChanged &&
+       previous.data().isObject() && next.data().isObject())
+   {
+      json::Object previousState = previous.data().getObject();
+      json::Object nextState = next.data().getObject();
+      json::Object::Iterator previousIt = previousState.find("activatePlots");
+      json::Object::Iterator nextIt = nextState.find("activatePlots");
+      if (previousIt != previousState.end() &&
+          (*previousIt).getValue().isBool() &&
+          (*previousIt).getValue().getBool() &&
+          nextIt != nextState.end() &&
+          (*nextIt).getValue().isBool() &&
+          !(*nextIt).getValue().getBool())
+      {
+         json::Value data = next.data();
+         data.getObject()["activatePlots"] = true;
+         return ClientEvent(next.type(), data);
+      }
+   }
+
+   return next;
+}
+
+} // anonymous namespace
+
+std::size_t ClientEventBuffer::add(const std::vector<ClientEvent>& events)
+{
+   std::size_t replaced = 0;
+   for (const ClientEvent& added : events)
+   {
+      ClientEvent event = added;
+      if (isStateEvent(event.type()))
+      {
+         // there's at most one event of each state type
+         std::deque<Entry>::iterator it =
+               std::find_if(entries_.begin(), entries_.end(), [&](const Entry& entry)
+         {
+            return entry.event.type() == event.type();
+         });
+
+         if (it != entries_.end())
+         {
+            event = mergeStateEvents(it->event, event);
+            bytes_ -= it->json.size();
+            entries_.erase(it);
+            replaced++;
+         }
+      }
+
+      Entry entry = { nextEventId_++, event, std::string() };
+
+      json::Object eventJson;
+      event.asJsonObject(entry.id, &eventJson);
+      entry.json = eventJson.write();
+
+      bytes_ += entry.json.size();
+      entries_.push_back(entry);
+   }
+
+   return replaced;
+}
+
+void ClientEventBuffer::acknowledge(int lastEventIdSeen)
+{
+   // events are in id order
+   while (!entries_.empty() && entries_.front().id <= lastEventIdSeen)
+   {
+      bytes_ -= entries_.front().json.size();
+      entries_.pop_front();
+   }
+
+   nextEventId_ = std::max(nextEventId_, lastEventIdSeen + 1);
+}
+
+void ClientEventBuffer::clear()
+{
+   entries_.clear();
+   bytes_ = 0;
+}
+
+std::string ClientEventBuffer::write(std::size_t maxBytes, std::size_t* pCount) const
+{
+   std::string json;
+   json.reserve(std::min(bytes_, maxBytes) + entries_.size() + 2);
+   json.push_back('[');
+
+   std::size_t count = 0;
+   for (const Entry& entry : entries_)
+   {
+      if (count > 0)
+      {
+         if (json.size() + entry.json.size() + 2 > maxBytes)
+            break;
+         json.push_back(',');
+      }
+
+      json.append(entry.json);
+      count++;
+   }
+
+   json.push_back(']');
+
+   if (pCount != nullptr)
+      *pCount = count;
+   return json;
+}
+
+} // namespace session
+} // namespace rstudio
@@ -0,0 +1,78 @@
+/*
+ * SessionClientEventBuffer.hpp
+ *
+ * Copyright (C) 2020 by RStudio, PBC
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef SESSION_SESSION_CLIENT_EVENT_BUFFER_HPP
+#define SESSION_SESSION_CLIENT_EVENT_BUFFER_HPP
+
+#include <deque>
+#include <string>
+#include <vector>
+
+#include <boost/utility.hpp>
+
+#include <session/SessionClientEvent.hpp>
+
+namespace rstudio {
+namespace session {
+
+// The events being delivered to the client. Events are numbered and
+// serialized once, as they're added, and kept until the client acknowledges
+// them (so they can be sent again if a response is lost). State events
+// (which describe the whole of some state, e.g. the plots pane) replace any
+// unacknowledged event of the same type, so only the latest is sent.
+// Not thread safe: the client event service synchronizes access.
+class ClientEventBuffer : boost::noncopyable
+{
+public:
+   ClientEventBuffer() : nextEventId_(0), bytes_(0) {}
+
+   // COPYING: boost::noncopyable
+
+   // add events; returns the number of earlier events they replaced
+   std::size_t add(const std::vector<ClientEvent>& events);
+
+   // remove the events the client has seen (further events are numbered
+   // after them, so that a client resuming after a suspend sees them)
+   void acknowledge(int lastEventIdSeen);
+
+   void clear();
+
+   bool empty() const { return entries_.empty(); }
+   std::size_t size() const { return entries_.size(); }
+
+   // the total size of the serialized events
+   std::size_t bytes() const { return bytes_; }
+
+   // writes the events (oldest first) as a json array of up to maxBytes,
+   // though always with at least one event if there are any
+   std::string write(std::size_t maxBytes, std::size_t* pCount) const;
+
+private:
+   struct Entry
+   {
+      int id;
+      ClientEvent event;
+      std::string json;
+   };
+
+   std::deque<Entry> entries_;
+   int nextEventId_;
+   std::size_t bytes_;
+};
+
+} // namespace session
+} // namespace rstudio
+
+#endif // SESSION_SESSION_CLIENT_EVENT_BUFFER_HPP
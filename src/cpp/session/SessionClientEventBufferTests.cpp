@@ -0,0 +1,151 @@
+/*
+ * SessionClientEventBufferTests.cpp
+ *
+ * Copyright (C) 2020 by RStudio, PBC
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include "SessionClientEventBuffer.hpp"
+
+#include <shared_core/json/Json.hpp>
+
+#define RSTUDIO_NO_TESTTHAT_ALIASES
+#include <tests/TestThat.hpp>
+
+namespace rstudio {
+namespace session {
+namespace tests {
+
+using namespace rstudio::core;
+
+namespace {
+
+// the events written by the buffer, as (id, type) pairs
+std::vector<std::pair<int, std::string> > eventsOf(const std::string& eventsJson)
+{
+   json::Value events;
+   REQUIRE_FALSE(events.parse(eventsJson));
+   REQUIRE(events.isArray());
+
+   std::vector<std::pair<int, std::string> > result;
+   for (const json::Value& event : events.getArray())
+   {
+      json::Object eventObject = event.getObject();
+      result.push_back(std::make_pair((*eventObject.find("id")).getValue().getInt(),
+                                      (*eventObject.find("type")).getValue().getString()));
+   }
+   return result;
+}
+
+ClientEvent plotsStateEvent(int plotIndex, bool activatePlots)
+{
+   json::Object state;
+   state["plotIndex"] = plotIndex;
+   state["activatePlots"] = activatePlots;
+   return ClientEvent(client_events::kPlotsStateChanged, state);
+}
+
+} // anonymous namespace
+
+TEST_CASE("SessionClientEventBuffer")
+{
+   ClientEventBuffer buffer;
+
+   SECTION("Events are numbered and kept until they're acknowledged")
+   {
+      std::vector<ClientEvent> events;
+      events.push_back(ClientEvent(client_events::kBusy, true));
+      events.push_back(ClientEvent(client_events::kConsolePrompt, "> "));
+      events.push_back(ClientEvent(client_events::kBusy, false));
+      CHECK(buffer.add(events) == 0);
+      CHECK(buffer.size() == 3);
+
+      std::size_t count = 0;
+      std::vector<std::pair<int, std::string> > written = eventsOf(buffer.write(1024, &count));
+      REQUIRE(written.size() == 3);
+      CHECK(count == 3);
+      CHECK(written[0] == std::make_pair(0, std::string("busy")));
+      CHECK(written[1] == std::make_pair(1, std::string("console_prompt")));
+      CHECK(written[2] == std::make_pair(2, std::string("busy")));
+
+      buffer.acknowledge(1);
+      written = eventsOf(buffer.write(1024, &count));
+      REQUIRE(written.size() == 1);
+      CHECK(written[0].first == 2);
+
+      // a client resuming after a suspend has seen later events
+      buffer.acknowledge(41);
+      CHECK(buffer.empty());
+      CHECK(buffer.bytes() == 0);
+      buffer.add({ ClientEvent(client_events::kConsolePrompt, "> ") });
+      CHECK(eventsOf(buffer.write(1024, &count))[0].first == 42);
+   }
+
+   SECTION("State events replace earlier events of the same type")
+   {
+      std::vector<ClientEvent> events;
+      events.push_back(ClientEvent(client_events::kEnvironmentRefresh));
+      events.push_back(plotsStateEvent(1, true));
+      events.push_back(ClientEvent(client_events::kConsolePrompt, "> "));
+      events.push_back(ClientEvent(client_events::kEnvironmentRefresh));
+      CHECK(buffer.add(events) == 1);
+
+      events.clear();
+      events.push_back(plotsStateEvent(2, false));
+      events.push_back(ClientEvent(client_events::kConsolePrompt, "> "));
+      CHECK(buffer.add(events) == 1);
+
+      std::size_t count = 0;
+      std::string eventsJson = buffer.write(1024 * 1024, &count);
+      std::vector<std::pair<int, std::string> > written = eventsOf(eventsJson);
+      REQUIRE(written.size() == 4);
+      CHECK(written[0] == std::make_pair(2, std::string("console_prompt")));
+      CHECK(written[1] == std::make_pair(3, std::string("environment_refresh")));
+      CHECK(written[2] == std::make_pair(4, std::string("plots_state_changed")));
+      CHECK(written[3] == std::make_pair(5, std::string("console_prompt")));
+      CHECK(buffer.bytes() + 5 == eventsJson.size());
+
+      // the latest plots state is sent, but still activates the plots pane
+      json::Value parsed;
+      REQUIRE_FALSE(parsed.parse(eventsJson));
+      json::Object plotsState = (*parsed.getArray()[2].getObject().find("data")).getValue().getObject();
+      CHECK((*plotsState.find("plotIndex")).getValue().getInt() == 2);
+      CHECK((*plotsState.find("activatePlots")).getValue().getBool());
+   }
+
+   SECTION("Responses are limited by size")
+   {
+      std::vector<ClientEvent> events;
+      for (int i = 0; i < 100; i++)
+         events.push_back(ClientEvent(client_events::kConsolePrompt, std::string(100, 'x')));
+      buffer.add(events);
+
+      std::size_t count = 0;
+      std::string eventsJson = buffer.write(1000, &count);
+      CHECK(eventsJson.size() <= 1000);
+      CHECK(count > 1);
+      CHECK(count < 10);
+      CHECK(eventsOf(eventsJson).size() == count);
+
+      // but always include an event
+      eventsJson = buffer.write(10, &count);
+      CHECK(count == 1);
+      CHECK(eventsOf(eventsJson).size() == 1);
+
+      buffer.clear();
+      CHECK(buffer.write(10, &count) == "[]");
+      CHECK(count == 0);
+   }
+}
+
+} // namespace tests
+} // namespace session
+} // namespace rstudio
@@ -22,16 +22,22 @@
 #include <shared_core/Error.hpp>
 #include <core/BoostErrors.hpp>
 #include <core/Thread.hpp>
+#include <core/Trace.hpp>
 #include <core/system/System.hpp>
 #include <core/Macros.hpp>
 
 
 #include <core/http/Request.hpp>
+#include <core/http/Response.hpp>
 
+#include <monitor/metrics/MetricRegistry.hpp>
+
+#include <session/SessionConstants.hpp>
 #include <session/SessionOptions.hpp>
 #include <session/SessionHttpConnectionListener.hpp>
 #include <session/SessionClientEventService.hpp>
 
+#include "SessionClientEventBuffer.hpp"
 #include "SessionClientEventQueue.hpp"
 
 using namespace rstudio::core;
@@ -43,11 +49,49 @@ namespace {
 
 const int kLastChanceWaitSeconds = 4;
 
-bool hasEventIdLessThanOrEqualTo(const json::Value& event, int targetId)
+// the most events (in bytes, before compression) to send in a response;
+// the client asks for the rest as soon as it has the response
+const std::size_t kMaxResponseBytes = 1024 * 1024;
+
+// responses smaller than this aren't worth compressing
+const std::size_t kMinCompressedResponseBytes = 1024;
+
+void recordDelivery(std::size_t events,
+                    std::size_t bytes,
+                    std::size_t sentBytes)
 {
-   const json::Object& eventJSON = event.getObject();
-   int eventId = (*eventJSON.find("id")).getValue().getInt();
-   return eventId <= targetId;
+   using namespace monitor::metrics;
+   static Counter& s_responses = counter(
+            "rsession_client_event_responses_total",
+            "Number of get_events responses sent.");
+   static Counter& s_events = counter(
+            "rsession_client_events_total",
+            "Number of client events sent (including events sent again).");
+   static Counter& s_bytes = counter(
+            "rsession_client_event_bytes_total",
+            "Size in bytes of the client events sent, before compression.");
+   static Counter& s_sentBytes = counter(
+            "rsession_client_event_sent_bytes_total",
+            "Size in bytes of the get_events responses sent.");
+   static Histogram& s_eventsPerResponse = histogram(
+            "rsession_client_events_per_response",
+            "Number of client events in each get_events response.",
+            { 0, 1, 2, 5, 10, 20, 50, 100, 200, 500, 1000 });
+
+   s_responses.increment();
+   s_events.increment(events);
+   s_bytes.increment(bytes);
+   s_sentBytes.increment(sentBytes);
+   s_eventsPerResponse.observe(static_cast<double>(events));
+}
+
+void recordReplacedEvents(std::size_t replaced)
+{
+   static monitor::metrics::Counter& s_replaced = monitor::metrics::counter(
+            "rsession_client_events_replaced_total",
+            "Number of state client events replaced by a later event of the same type.");
+   if (replaced > 0)
+      s_replaced.increment(replaced);
 }
          
 } // anonymous namespace
@@ -58,6 +102,15 @@ ClientEventService& clientEventService()
    return instance ;
 }
 
+ClientEventService::ClientEventService()
+   : pClientEvents_(new ClientEventBuffer())
+{
+}
+
+ClientEventService::~ClientEventService()
+{
+}
+
 Error ClientEventService::start(const std::string& clientId)
 {
    // set our clientid
@@ -117,7 +170,7 @@ void ClientEventService::setClientId(const std::string& clientId, bool clearEven
    {
       clientId_ = clientId.c_str(); // avoid ref count
       if (clearEvents)
-         clientEvents_.clear();
+         pClientEvents_->clear();
    }
    END_LOCK_MUTEX
 
@@ -141,13 +194,7 @@ void ClientEventService::erasePreviouslyDeliveredEvents(int lastClientEventIdSee
 {
    LOCK_MUTEX(mutex_)
    {
-      clientEvents_.erase(
-               std::remove_if(clientEvents_.begin(),
-                              clientEvents_.end(),
-                              boost::bind(hasEventIdLessThanOrEqualTo,
-                                          _1,
-                                          lastClientEventIdSeen)),
-               clientEvents_.end());
+      pClientEvents_->acknowledge(lastClientEventIdSeen);
    }
    END_LOCK_MUTEX
 }
@@ -156,7 +203,7 @@ bool ClientEventService::havePendingClientEvents()
 {
    LOCK_MUTEX(mutex_)
    {
-      return !clientEvents_.isEmpty();
+      return !pClientEvents_->empty();
    }
    END_LOCK_MUTEX
 
@@ -164,25 +211,72 @@ bool ClientEventService::havePendingClientEvents()
    return false;
 }
 
-void ClientEventService::addClientEvent(const json::Object& eventObject)
+std::size_t ClientEventService::pendingClientEventBytes()
 {
    LOCK_MUTEX(mutex_)
    {
-      clientEvents_.push_back(eventObject);
+      return pClientEvents_->bytes();
    }
    END_LOCK_MUTEX
+
+   // keep compiler happy
+   return 0;
 }
 
-void ClientEventService::setClientEventResult(
-                                       core::json::JsonRpcResponse* pResponse)
+void ClientEventService::addQueuedClientEvents()
 {
+   std::vector<ClientEvent> events;
+   clientEventQueue().remove(&events);
+   if (events.empty())
+      return;
+
    LOCK_MUTEX(mutex_)
    {
-      pResponse->setResult(clientEvents_);
+      recordReplacedEvents(pClientEvents_->add(events));
    }
    END_LOCK_MUTEX
 }
 
+void ClientEventService::sendClientEvents(
+                              boost::shared_ptr<HttpConnection> ptrConnection)
+{
+   std::size_t count = 0;
+   std::string events = "[]";
+   LOCK_MUTEX(mutex_)
+   {
+      events = pClientEvents_->write(kMaxResponseBytes, &count);
+   }
+   END_LOCK_MUTEX
+
+   // write the json-rpc response around the (already serialized) events
+   // (pass false for kEventsPending b/c responses from the event service
+   // shouldn't interact with automatic event service starting/re-starting)
+   std::string body;
+   body.reserve(events.size() + 32);
+   body.append("{\"").append(json::kRpcResult).append("\":");
+   body.append(events);
+   body.append(",\"" kEventsPending "\":\"false\"}");
+
+   http::Response response;
+   response.setNoCacheHeaders();
+   response.setContentType(json::kJsonContentType);
+   if (body.size() >= kMinCompressedResponseBytes &&
+       ptrConnection->request().acceptsEncoding(http::kGzipEncoding))
+   {
+      response.setContentEncoding(http::kGzipEncoding);
+   }
+
+   Error error = response.setBody(body, http::NullOutputFilter(), 64 * 1024);
+   if (error)
+   {
+      LOG_ERROR(error);
+      response.setError(http::status::InternalServerError, error.getMessage());
+   }
+
+   ptrConnection->sendResponse(response);
+   recordDelivery(count, events.size(), response.body().size());
+}
+
 
 void ClientEventService::run()
 {
@@ -204,9 +298,6 @@ void ClientEventService::run()
       // get alias to client event queue
       ClientEventQueue& clientEventQueue = session::clientEventQueue();
       
-      // initialize state
-      int nextEventId = 0;
-      
       // accept loop
       bool stopServer = false ;
       while (!stopServer || clientEventQueue.hasEvents())
@@ -275,15 +366,13 @@ void ClientEventService::run()
             continue;
          }
            
-         // remove all events already seen by the client from our internal list
+         // remove all events already seen by the client from our internal
+         // list (this also syncs the next event id to the client, required
+         // so that when we resume from a suspend we provide client event ids
+         // in line with the client's expectations -- if we started with zero
+         // then the client would never see any events!)
          erasePreviouslyDeliveredEvents(lastClientEventIdSeen);
 
-         // sync next event id to client (required so that when we resume
-         // from a suspend we provide client event ids in line with the 
-         // client's expectations -- if we started with zero then the client
-         // would never see any events!)
-         nextEventId = std::max(nextEventId, lastClientEventIdSeen + 1);
-
          // check for events (and wait a specified internal if there are none)
          try
          {
@@ -294,13 +383,17 @@ void ClientEventService::run()
                // ...got at least one event
                
                // wait for additional events that occur in rapid succession 
-               // but don't wait for more than the specified maximum seconds
+               // until there's a full response's worth of them, but don't
+               // wait for more than the specified maximum seconds
                boost::system_time maxBatchDelayTime = 
                               boost::get_system_time() + maxTotalBatchDelay;
                
-               while ( clientEventQueue.waitForEvent(batchDelay) &&
+               addQueuedClientEvents();
+               while ( pendingClientEventBytes() < kMaxResponseBytes &&
+                       clientEventQueue.waitForEvent(batchDelay) &&
                        (boost::get_system_time() < maxBatchDelayTime) )
                {
+                  addQueuedClientEvents();
                }
            }
          }
@@ -320,26 +413,12 @@ void ClientEventService::run()
          // events on the next iteration of the accept loop
          if (request.clientId == clientId())
          {
-            // deque the events
-            std::vector<ClientEvent> events;
-            clientEventQueue.remove(&events);
-            
-            // convert to json and add event id
-            for (std::vector<ClientEvent>::const_iterator 
-                 it = events.begin(); it != events.end(); ++it)
-            {
-               json::Object event ;
-               it->asJsonObject(nextEventId++, &event);
-               addClientEvent(event);
-            }
+            // time the delivery of the events (not including the wait for them)
+            core::trace::Span span("events", "get_events");
 
-            // send them (pass false for kEventsPending b/c responses from the
-            // event service shouldn't interact with automatic event service
-            // starting/re-starting)
-            json::JsonRpcResponse response;
-            setClientEventResult(&response);
-            response.setField(kEventsPending, "false");
-            ptrConnection->sendJsonRpcResponse(response);
+            // deque the events and send them
+            addQueuedClientEvents();
+            sendClientEvents(ptrConnection);
          }
          else
          {
@@ -0,0 +1,323 @@
+/*
+ * SessionConsoleProcessLog.cpp
+ *
+ * Copyright (C) 2020 by RStudio, PBC
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include "SessionConsoleProcessLog.hpp"
+
+#include <algorithm>
+#include <vector>
+
+#include <boost/algorithm/string/predicate.hpp>
+#include <boost/filesystem.hpp>
+
+#include <shared_core/SafeConvert.hpp>
+
+#include <core/FileSerializer.hpp>
+#include <core/Log.hpp>
+
+using namespace rstudio::core;
+
+namespace rstudio {
+namespace session {
+namespace console_process {
+namespace console_persist {
+
+// 8MB of output at most, in 64K segments
+const std::size_t kLogSegmentSize = 64 * 1024;
+const std::size_t kLogMaxSegments = 128;
+
+ConsoleProcessLog::ConsoleProcessLog(const FilePath& dir,
+                                     const std::string& handle,
+                                     std::size_t segmentSize,
+                                     std::size_t maxSegments)
+   : dir_(dir),
+     handle_(handle),
+     segmentSize_(segmentSize),
+     maxSegments_(maxSegments),
+     firstSegment_(0),
+     start_(0),
+     end_(0)
+{
+}
+
+Error ConsoleProcessLog::open()
+{
+   firstSegment_ = 0;
+   start_ = 0;
+   end_ = 0;
+   newlines_.clear();
+
+   // find the segments
+   std::vector<FilePath> children;
+   Error error = dir_.getChildren(children);
+   if (error)
+      return error;
+
+   std::string prefix = handle_ + ".";
+   std::vector<uint64_t> segments;
+   for (const FilePath& child : children)
+   {
+      std::string filename = child.getFilename();
+      if (!boost::algorithm::starts_with(filename, prefix))
+         continue;
+
+      std::string segment = filename.substr(prefix.size());
+      if (segment.empty() || segment.find_first_not_of("0123456789") != std::string::npos)
+         continue;
+
+      segments.push_back(safe_convert::stringTo<uint64_t>(segment, 0));
+   }
+
+   // read them to find the newlines
+   if (!segments.empty())
+   {
+      std::sort(segments.begin(), segments.end());
+      firstSegment_ = segments.front();
+      start_ = firstSegment_ * segmentSize_;
+      end_ = segments.back() * segmentSize_ + segmentPath(segments.back()).getSize();
+
+      // the log may start part way through its first segment
+      std::string start;
+      if (startPath().exists() && !readStringFromFile(startPath(), &start))
+      {
+         uint64_t offset = safe_convert::stringTo<uint64_t>(start, start_);
+         if (offset / segmentSize_ == firstSegment_ && offset <= end_)
+            start_ = offset;
+      }
+
+      std::string output;
+      error = read(0, size(), &output);
+      if (error)
+         return error;
+
+      for (std::size_t i = 0; i < output.size(); i++)
+      {
+         if (output[i] == '\n')
+            newlines_.push_back(start_ + i);
+      }
+   }
+
+   // convert a log saved by older versions
+   FilePath legacyPath = dir_.completePath(handle_);
+   if (legacyPath.exists())
+   {
+      std::string output;
+      error = readStringFromFile(legacyPath, &output);
+      if (error)
+         return error;
+
+      error = append(output);
+      if (error)
+         return error;
+
+      return legacyPath.remove();
+   }
+
+   return Success();
+}
+
+Error ConsoleProcessLog::append(const std::string& output)
+{
+   // fill the last segment before starting another
+   std::size_t pos = 0;
+   while (pos < output.size())
+   {
+      std::size_t length = std::min<std::size_t>(
+               output.size() - pos,
+               segmentSize_ - static_cast<std::size_t>(end_ % segmentSize_));
+
+      Error error = appendToFile(segmentPath(end_ / segmentSize_),
+                                 output.substr(pos, length));
+      if (error)
+         return error;
+
+      for (std::size_t i = 0; i < length; i++)
+      {
+         if (output[pos + i] == '\n')
+            newlines_.push_back(end_ + i);
+      }
+
+      end_ += length;
+      pos += length;
+   }
+
+   // drop the oldest segments once there are too many, starting the log at
+   // the end of the line they finish in (if that's in the next segment)
+   if (end_ > start_ && lastSegment() - firstSegment_ + 1 > maxSegments_)
+   {
+      uint64_t offset = (lastSegment() + 1 - maxSegments_) * segmentSize_;
+      std::deque<uint64_t>::iterator it =
+            std::lower_bound(newlines_.begin(), newlines_.end(), offset);
+      if (it != newlines_.end() && *it / segmentSize_ == offset / segmentSize_)
+         start_ = *it;
+      else
+         start_ = offset;
+
+      newlines_.erase(newlines_.begin(), it);
+      dropSegmentsBefore(start_);
+      saveStart();
+   }
+
+   return Success();
+}
+
+Error ConsoleProcessLog::read(std::size_t offset,
+                              std::size_t length,
+                              std::string* pOutput) const
+{
+   pOutput->clear();
+
+   uint64_t begin = start_ + std::min<uint64_t>(offset, size());
+   uint64_t end = begin + std::min<uint64_t>(length, end_ - begin);
+   pOutput->reserve(static_cast<std::size_t>(end - begin));
+
+   while (begin < end)
+   {
+      FilePath segmentFile = segmentPath(begin / segmentSize_);
+      std::size_t segmentOffset = static_cast<std::size_t>(begin % segmentSize_);
+      std::size_t segmentLength = std::min<std::size_t>(
+               static_cast<std::size_t>(end - begin),
+               segmentSize_ - segmentOffset);
+
+      std::shared_ptr<std::istream> pStream;
+      Error error = segmentFile.openForRead(pStream);
+      if (error)
+         return error;
+
+      std::size_t outputSize = pOutput->size();
+      pOutput->resize(outputSize + segmentLength);
+      pStream->seekg(static_cast<std::streamoff>(segmentOffset));
+      pStream->read(&(*pOutput)[outputSize], static_cast<std::streamsize>(segmentLength));
+      if (pStream->gcount() != static_cast<std::streamsize>(segmentLength))
+      {
+         error = systemError(boost::system::errc::io_error, ERROR_LOCATION);
+         error.addProperty("path", segmentFile);
+         return error;
+      }
+
+      begin += segmentLength;
+   }
+
+   return Success();
+}
+
+bool ConsoleProcessLog::trimLeadingLines(int maxLines)
+{
+   if (maxLines < 1 ||
+       size() <= static_cast<std::size_t>(maxLines) * 2 ||
+       newlines_.size() <= static_cast<std::size_t>(maxLines))
+   {
+      return false;
+   }
+
+   // start at the newline before the lines we're keeping
+   std::size_t dropped = newlines_.size() - maxLines - 1;
+   start_ = newlines_[dropped];
+   newlines_.erase(newlines_.begin(), newlines_.begin() + dropped);
+   dropSegmentsBefore(start_);
+   saveStart();
+   return true;
+}
+
+Error ConsoleProcessLog::removeLastLine()
+{
+   if (newlines_.empty())
+      return remove();
+
+   uint64_t end = newlines_.back() + 1;
+   if (end == end_)
+      return Success();
+
+   uint64_t segment = end / segmentSize_;
+   for (uint64_t last = lastSegment(); last > segment; last--)
+   {
+      Error error = segmentPath(last).removeIfExists();
+      if (error)
+         return error;
+   }
+
+   boost::system::error_code ec;
+   boost::filesystem::resize_file(segmentPath(segment).getAbsolutePath(),
+                                  end % segmentSize_,
+                                  ec);
+   if (ec)
+      return Error(ec, ERROR_LOCATION);
+
+   end_ = end;
+   return Success();
+}
+
+Error ConsoleProcessLog::remove()
+{
+   Error result;
+   for (uint64_t segment = firstSegment_; segment <= end_ / segmentSize_; segment++)
+   {
+      Error error = segmentPath(segment).removeIfExists();
+      if (error && !result)
+         result = error;
+   }
+
+   Error error = startPath().removeIfExists();
+   if (error && !result)
+      result = error;
+
+   firstSegment_ = 0;
+   start_ = 0;
+   end_ = 0;
+   newlines_.clear();
+
+   return result;
+}
+
+FilePath ConsoleProcessLog::segmentPath(uint64_t segment) const
+{
+   return dir_.completePath(handle_ + "." + std::to_string(segment));
+}
+
+FilePath ConsoleProcessLog::startPath() const
+{
+   return dir_.completePath(handle_ + ".start");
+}
+
+void ConsoleProcessLog::saveStart()
+{
+   Error error;
+   if (start_ == firstSegment_ * segmentSize_)
+      error = startPath().removeIfExists();
+   else
+      error = writeStringToFile(startPath(), std::to_string(start_));
+   if (error)
+      LOG_ERROR(error);
+}
+
+uint64_t ConsoleProcessLog::lastSegment() const
+{
+   return end_ == 0 ? 0 : (end_ - 1) / segmentSize_;
+}
+
+void ConsoleProcessLog::dropSegmentsBefore(uint64_t offset)
+{
+   while (firstSegment_ < offset / segmentSize_)
+   {
+      Error error = segmentPath(firstSegment_).removeIfExists();
+      if (error)
+         LOG_ERROR(error);
+      firstSegment_++;
+   }
+}
+
+} // namespace console_persist
+} // namespace console_process
+} // namespace session
+} // namespace rstudio
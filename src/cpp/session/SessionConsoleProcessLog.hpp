@@ -0,0 +1,112 @@
+/*
+ * SessionConsoleProcessLog.hpp
+ *
+ * Copyright (C) 2020 by RStudio, PBC
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef SESSION_CONSOLE_PROCESS_LOG_HPP
+#define SESSION_CONSOLE_PROCESS_LOG_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+
+#include <boost/utility.hpp>
+
+#include <shared_core/Error.hpp>
+#include <shared_core/FilePath.hpp>
+
+namespace rstudio {
+namespace session {
+namespace console_process {
+namespace console_persist {
+
+extern const std::size_t kLogSegmentSize;
+extern const std::size_t kLogMaxSegments;
+
+// The saved output of a terminal, stored as a ring of fixed size segment
+// files named <handle>.<n> (segment n holding bytes [n * segmentSize,
+// (n + 1) * segmentSize) of all the output ever written). Output is only
+// ever appended to the last segment, and trimming leading output just moves
+// the start of the log forward and removes the segments before it, so
+// nothing is ever copied. The offsets of the newlines in the log are kept
+// in memory, so counting and trimming lines doesn't need to read the log.
+//
+// Once the log spans maxSegments segments, the oldest segment is dropped
+// (along with the rest of the line it ends in). Where in its first segment
+// the log starts is saved in <handle>.start.
+class ConsoleProcessLog : boost::noncopyable
+{
+public:
+   ConsoleProcessLog(const core::FilePath& dir,
+                     const std::string& handle,
+                     std::size_t segmentSize = kLogSegmentSize,
+                     std::size_t maxSegments = kLogMaxSegments);
+
+   // read the existing segments of the log (if any); a log saved in a
+   // single file by older versions is converted to segments
+   core::Error open();
+
+   core::Error append(const std::string& output);
+
+   // the size of the log in bytes
+   std::size_t size() const { return static_cast<std::size_t>(end_ - start_); }
+
+   // the number of lines in the log (one more than the number of newlines)
+   std::size_t lineCount() const { return newlines_.size() + 1; }
+
+   // read up to length bytes of the log, starting at offset
+   core::Error read(std::size_t offset,
+                    std::size_t length,
+                    std::string* pOutput) const;
+
+   // drop leading lines so that maxLines remain, as with
+   // string_utils::trimLeadingLines; returns true if lines were dropped
+   bool trimLeadingLines(int maxLines);
+
+   // remove any output after the last newline, removing the entire log
+   // if there isn't one
+   core::Error removeLastLine();
+
+   // remove the entire log
+   core::Error remove();
+
+private:
+   core::FilePath segmentPath(uint64_t segment) const;
+   core::FilePath startPath() const;
+   void saveStart();
+   uint64_t lastSegment() const;
+   void dropSegmentsBefore(uint64_t offset);
+
+private:
+   core::FilePath dir_;
+   std::string handle_;
+   std::size_t segmentSize_;
+   std::size_t maxSegments_;
+
+   // the first segment, and the offsets of the first byte of the log and
+   // of the end of the log
+   uint64_t firstSegment_;
+   uint64_t start_;
+   uint64_t end_;
+
+   // the offsets of the newlines in the log
+   std::deque<uint64_t> newlines_;
+};
+
+} // namespace console_persist
+} // namespace console_process
+} // namespace session
+} // namespace rstudio
+
+#endif // SESSION_CONSOLE_PROCESS_LOG_HPP
@@ -0,0 +1,175 @@
+/*
+ * SessionConsoleProcessLogTests.cpp
+ *
+ * Copyright (C) 2020 by RStudio, PBC
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include "SessionConsoleProcessLog.hpp"
+
+#include <algorithm>
+
+#include <core/FileSerializer.hpp>
+#include <core/StringUtils.hpp>
+
+#define RSTUDIO_NO_TESTTHAT_ALIASES
+#include <tests/TestThat.hpp>
+
+namespace rstudio {
+namespace session {
+namespace console_process {
+namespace console_persist {
+namespace tests {
+
+using namespace rstudio::core;
+
+namespace {
+
+std::string contentsOf(const ConsoleProcessLog& log)
+{
+   std::string output;
+   REQUIRE_FALSE(log.read(0, log.size(), &output));
+   return output;
+}
+
+std::size_t segmentCount(const FilePath& dir)
+{
+   std::vector<FilePath> children;
+   REQUIRE_FALSE(dir.getChildren(children));
+   return std::count_if(children.begin(), children.end(), [](const FilePath& child)
+   {
+      return child.getExtension() != ".start";
+   });
+}
+
+} // anonymous namespace
+
+TEST_CASE("SessionConsoleProcessLog")
+{
+   FilePath dir;
+   REQUIRE_FALSE(FilePath::tempFilePath(dir));
+   REQUIRE_FALSE(dir.ensureDirectory());
+
+   // small segments, so output spans several
+   ConsoleProcessLog log(dir, "terminal", 8, 4);
+   REQUIRE_FALSE(log.open());
+   CHECK(log.size() == 0);
+   CHECK(log.lineCount() == 1);
+
+   REQUIRE_FALSE(log.append("one\ntwo\nthree\nfour"));
+
+   SECTION("Output is appended across segments")
+   {
+      CHECK(contentsOf(log) == "one\ntwo\nthree\nfour");
+      CHECK(log.lineCount() == 4);
+      CHECK(segmentCount(dir) == 3);
+
+      std::string output;
+      REQUIRE_FALSE(log.read(6, 5, &output));
+      CHECK(output == "o\nthr");
+      REQUIRE_FALSE(log.read(16, 100, &output));
+      CHECK(output == "ur");
+      REQUIRE_FALSE(log.read(100, 100, &output));
+      CHECK(output.empty());
+   }
+
+   SECTION("Logs are reopened")
+   {
+      ConsoleProcessLog reopened(dir, "terminal", 8, 4);
+      REQUIRE_FALSE(reopened.open());
+      CHECK(contentsOf(reopened) == "one\ntwo\nthree\nfour");
+      CHECK(reopened.lineCount() == 4);
+
+      REQUIRE_FALSE(reopened.append("\nfive"));
+      CHECK(contentsOf(reopened) == "one\ntwo\nthree\nfour\nfive");
+   }
+
+   SECTION("Trimming matches trimming strings")
+   {
+      REQUIRE_FALSE(log.append("\nfive\nsix"));
+
+      std::string expected = "one\ntwo\nthree\nfour\nfive\nsix";
+      CHECK(string_utils::trimLeadingLines(1, &expected));
+      CHECK(log.trimLeadingLines(1));
+      CHECK(contentsOf(log) == expected);
+      CHECK(log.lineCount() == 3);
+
+      // segments wholly before the log are removed
+      CHECK(segmentCount(dir) == 2);
+
+      CHECK_FALSE(log.trimLeadingLines(100));
+
+      // reopened logs start where they were trimmed
+      ConsoleProcessLog reopened(dir, "terminal", 8, 4);
+      REQUIRE_FALSE(reopened.open());
+      CHECK(contentsOf(reopened) == expected);
+      CHECK(reopened.lineCount() == 3);
+   }
+
+   SECTION("The last line can be removed")
+   {
+      REQUIRE_FALSE(log.removeLastLine());
+      CHECK(contentsOf(log) == "one\ntwo\nthree\n");
+      REQUIRE_FALSE(log.removeLastLine());
+      CHECK(contentsOf(log) == "one\ntwo\nthree\n");
+
+      REQUIRE_FALSE(log.append("4"));
+      CHECK(contentsOf(log) == "one\ntwo\nthree\n4");
+
+      ConsoleProcessLog partial(dir, "partial", 8, 4);
+      REQUIRE_FALSE(partial.open());
+      REQUIRE_FALSE(partial.append("no newline"));
+      REQUIRE_FALSE(partial.removeLastLine());
+      CHECK(partial.size() == 0);
+   }
+
+   SECTION("Old segments are dropped")
+   {
+      REQUIRE_FALSE(log.append("\nfive\nsix\nseven\neight"));
+      CHECK(segmentCount(dir) == 4);
+      CHECK(contentsOf(log) == "\nfour\nfive\nsix\nseven\neight");
+      CHECK(log.lineCount() == 6);
+
+      ConsoleProcessLog reopened(dir, "terminal", 8, 4);
+      REQUIRE_FALSE(reopened.open());
+      CHECK(contentsOf(reopened) == contentsOf(log));
+   }
+
+   SECTION("Logs can be removed")
+   {
+      CHECK(log.trimLeadingLines(1));
+      REQUIRE_FALSE(log.remove());
+      CHECK(log.size() == 0);
+      CHECK(segmentCount(dir) == 0);
+      CHECK_FALSE(dir.completePath("terminal.start").exists());
+
+      REQUIRE_FALSE(log.append("again"));
+      CHECK(contentsOf(log) == "again");
+   }
+
+   SECTION("Logs saved in a single file are converted")
+   {
+      REQUIRE_FALSE(writeStringToFile(dir.completePath("legacy"), "old\noutput"));
+
+      ConsoleProcessLog legacy(dir, "legacy", 8, 4);
+      REQUIRE_FALSE(legacy.open());
+      CHECK(contentsOf(legacy) == "old\noutput");
+      CHECK_FALSE(dir.completePath("legacy").exists());
+   }
+
+   dir.removeIfExists();
+}
+
+} // namespace tests
+} // namespace console_persist
+} // namespace console_process
+} // namespace session
+} // namespace rstudio
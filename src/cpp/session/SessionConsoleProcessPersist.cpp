@@ -15,14 +15,20 @@
 
 #include <session/SessionConsoleProcessPersist.hpp>
 
+#include <map>
+
 #include <gsl/gsl>
 
+#include <boost/shared_ptr.hpp>
+
 #include <core/FileSerializer.hpp>
 
 #include <session/SessionModuleContext.hpp>
 #include <session/SessionOptions.hpp>
 #include <session/projects/SessionProjects.hpp>
 
+#include "SessionConsoleProcessLog.hpp"
+
 using namespace rstudio::core;
 
 namespace rstudio {
@@ -63,6 +69,9 @@ FilePath s_consoleProcIndexPath;
 bool s_inited = false;
 const std::string s_envFileExt = ".env";
 
+// the saved buffers we've opened, by handle
+std::map<std::string, boost::shared_ptr<ConsoleProcessLog> > s_logs;
+
 void initialize()
 {
    if (s_inited) return;
@@ -102,8 +111,16 @@ const FilePath& getConsoleProcIndexPath()
    return s_consoleProcIndexPath;
 }
 
-Error getLogFilePath(const std::string& handle, FilePath* pFile)
+Error getLog(const std::string& handle, boost::shared_ptr<ConsoleProcessLog>* ppLog)
 {
+   std::map<std::string, boost::shared_ptr<ConsoleProcessLog> >::const_iterator it =
+         s_logs.find(handle);
+   if (it != s_logs.end())
+   {
+      *ppLog = it->second;
+      return Success();
+   }
+
    initialize();
    Error error = getConsoleProcPath().ensureDirectory();
    if (error)
@@ -111,7 +128,21 @@ Error getLogFilePath(const std::string& handle, FilePath* pFile)
       return error;
    }
 
-   *pFile = getConsoleProcPath().completePath(handle);
+   boost::shared_ptr<ConsoleProcessLog> pLog(
+            new ConsoleProcessLog(getConsoleProcPath(), handle));
+   error = pLog->open();
+   if (error)
+   {
+      // start the buffer over rather than lose everything written to it
+      // from here on
+      LOG_ERROR(error);
+      error = pLog->remove();
+      if (error)
+         LOG_ERROR(error);
+   }
+
+   s_logs[handle] = pLog;
+   *ppLog = pLog;
    return Success();
 }
 
@@ -163,63 +194,70 @@ void saveConsoleProcesses(const std::string& metadata)
 
 std::string getSavedBuffer(const std::string& handle, int maxLines)
 {
-   std::string content;
-   FilePath log;
+   bool moreAvailable;
+   return getSavedBufferChunk(handle, maxLines, 0, std::string::npos, &moreAvailable);
+}
+
+std::string getSavedBufferChunk(const std::string& handle,
+                                int maxLines,
+                                std::size_t offset,
+                                std::size_t length,
+                                bool* pMoreAvailable)
+{
+   *pMoreAvailable = false;
 
-   Error error = getLogFilePath(handle, &log);
+   boost::shared_ptr<ConsoleProcessLog> pLog;
+   Error error = getLog(handle, &pLog);
    if (error)
    {
       LOG_ERROR(error);
-      return content;
+      return std::string();
    }
 
-   if (!log.exists())
-   {
-      return "";
-   }
+   // Trim the buffer based on maxLines. Otherwise it can grow without
+   // bound until the terminal is closed or cleared.
+   if (maxLines > 0)
+      pLog->trimLeadingLines(maxLines);
 
-   error = core::readStringFromFile(log, &content);
+   std::string chunk;
+   error = pLog->read(offset, length, &chunk);
    if (error)
    {
       LOG_ERROR(error);
-      return content;
+      return std::string();
    }
 
-   if (maxLines < 1)
-      return content;
-
-   // Trim the buffer based on maxLines. Otherwise it can grow without
-   // bound until the terminal is closed or cleared.
-   std::string trimmedOutput = content;
-   if (string_utils::trimLeadingLines(maxLines, &trimmedOutput))
-   {
-      error = core::writeStringToFile(log, trimmedOutput);
-      if (error)
-      {
-          LOG_ERROR(error);
-          return content;
-      }
-   }
-   return trimmedOutput;
+   *pMoreAvailable = offset + chunk.length() < pLog->size();
+   return chunk;
 }
 
 int getSavedBufferLineCount(const std::string& handle, int maxLines)
 {
-   std::string buffer = getSavedBuffer(handle, maxLines);
-   return gsl::narrow_cast<int>(string_utils::countNewlines(buffer) + 1);
+   boost::shared_ptr<ConsoleProcessLog> pLog;
+   Error error = getLog(handle, &pLog);
+   if (error)
+   {
+      LOG_ERROR(error);
+      return 1;
+   }
+
+   if (maxLines > 0)
+      pLog->trimLeadingLines(maxLines);
+
+   return gsl::narrow_cast<int>(pLog->lineCount());
 }
 
 void appendToOutputBuffer(const std::string& handle, const std::string& buffer)
 {
-   FilePath log;
-   Error error = getLogFilePath(handle, &log);
+   boost::shared_ptr<ConsoleProcessLog> pLog;
+   Error error = getLog(handle, &pLog);
    if (error)
    {
       LOG_ERROR(error);
       return;
    }
 
-   error = rstudio::core::appendToFile(log, buffer);
+   error = pLog->append(buffer);
    if (error)
    {
       LOG_ERROR(error);
@@ -228,54 +266,19 @@ void appendToOutputBuffer(const std::string& handle, const std::string& buffer)
 
 void deleteLogFile(const std::string &handle, bool lastLineOnly)
 {
-   FilePath log;
-   Error error = getLogFilePath(handle, &log);
+   boost::shared_ptr<ConsoleProcessLog> pLog;
+   Error error = getLog(handle, &pLog);
    if (error)
    {
       LOG_ERROR(error);
       return;
    }
 
-   if (!log.exists())
-      return;
-
-   if (!lastLineOnly)
-   {
-      // blow away the file
-      error = log.removeIfExists();
-      if (error)
-      {
-         LOG_ERROR(error);
-         return;
-      }
-   }
-   else
+   // remove everything after the final newline, or the whole buffer
+   error = lastLineOnly ? pLog->removeLastLine() : pLog->remove();
+   if (error)
    {
-      // read the file, remove last line and rewrite buffer
-      std::string content;
-      error = core::readStringFromFile(log, &content);
-      if (error)
-      {
-         LOG_ERROR(error);
-         return;
-      }
-
-      size_t lastNewline = content.find_last_of('\n');
-
-      // no complete line in buffer, just blow it away
-      if (lastNewline == std::string::npos)
-      {
-         deleteLogFile(handle, false);
-         return;
-      }
-
-      // erase everything after the final newline
-      content.erase(++lastNewline);
-      error = core::writeStringToFile(log, content);
-      if (error)
-      {
-          LOG_ERROR(error);
-      }
+      LOG_ERROR(error);
    }
 }
 
@@ -307,6 +310,15 @@ void deleteOrphanedLogs(bool (*validHandle)(const std::string&))
             LOG_ERROR(error);
       }
    }
+
+   // forget the buffers we had open for them
+   for (auto it = s_logs.begin(); it != s_logs.end(); )
+   {
+      if (!validHandle(it->first))
+         it = s_logs.erase(it);
+      else
+         ++it;
+   }
 }
 
 void saveConsoleEnvironment(const std::string& handle, const core::system::Options& environment)
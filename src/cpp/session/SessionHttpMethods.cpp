@@ -27,6 +27,7 @@
 #include "session-config.h"
 
 #include <boost/algorithm/string.hpp>
+#include <boost/make_shared.hpp>
 
 #include <core/gwt/GwtLogHandler.hpp>
 #include <core/gwt/GwtFileHandler.hpp>
@@ -38,6 +39,8 @@
 
 #include <core/text/TemplateFilter.hpp>
 
+#include <core/Trace.hpp>
+
 #include <core/http/CSRFToken.hpp>
 
 #include <r/RExec.hpp>
@@ -45,6 +48,7 @@
 #include <r/session/REventLoop.hpp>
 
 #include <session/RVersionSettings.hpp>
+#include <session/SessionClientEventService.hpp>
 #include <session/SessionHttpConnection.hpp>
 #include <session/SessionHttpConnectionListener.hpp>
 #include <session/SessionModuleContext.hpp>
@@ -101,6 +105,7 @@ void processEvents()
 
 bool parseAndValidateJsonRpcConnection(
          boost::shared_ptr<HttpConnection> ptrConnection,
+         const std::string& activeClientId,
          json::JsonRpcRequest* pJsonRpcRequest)
 {
    // attempt to parse the request into a json-rpc request
@@ -121,7 +126,7 @@ bool parseAndValidateJsonRpcConnection(
    }
 
    // check for invalid client id
-   if (pJsonRpcRequest->clientId != persistentState().activeClientId())
+   if (pJsonRpcRequest->clientId != activeClientId)
    {
       Error error(json::errc::InvalidClientId, ERROR_LOCATION);
       ptrConnection->sendJsonRpcError(error);
@@ -151,11 +156,22 @@ bool parseAndValidateJsonRpcConnection(
    return true;
 }
 
+bool parseAndValidateJsonRpcConnection(
+         boost::shared_ptr<HttpConnection> ptrConnection,
+         json::JsonRpcRequest* pJsonRpcRequest)
+{
+   return parseAndValidateJsonRpcConnection(ptrConnection,
+                                            persistentState().activeClientId(),
+                                            pJsonRpcRequest);
+}
+
 void endHandleConnection(boost::shared_ptr<HttpConnection> ptrConnection,
                          http_methods::ConnectionType connectionType,
+                         boost::shared_ptr<core::trace::Span> pSpan,
                          core::http::Response* pResponse)
 {
    ptrConnection->sendResponse(*pResponse);
+   pSpan->end();
    if (!console_input::executing())
       module_context::events().onDetectChanges(module_context::ChangeSourceURI);
 }
@@ -382,6 +398,17 @@ module_context::WaitForMethodFunction registerWaitForMethod(
 
 namespace http_methods {
 
+bool parseAndValidateWorkerThreadJsonRpcConnection(
+         boost::shared_ptr<HttpConnection> ptrConnection,
+         core::json::JsonRpcRequest* pJsonRpcRequest)
+{
+   // the persistent state may only be read on the main thread so check the
+   // client id against the client event service's (synchronized) copy
+   return parseAndValidateJsonRpcConnection(ptrConnection,
+                                            clientEventService().clientId(),
+                                            pJsonRpcRequest);
+}
+
 // client version -- this is determined by the git revision hash. the client
 // and the server can diverge if a new version of the server was installed
 // underneath a previously rendered client. if versions diverge then a reload
@@ -572,16 +599,22 @@ void handleConnection(boost::shared_ptr<HttpConnection> ptrConnection,
    // check for a uri handler registered by a module
    const core::http::Request& request = ptrConnection->request();
    std::string uri = request.uri();
+   std::string uriPrefix;
    boost::optional<core::http::UriAsyncHandlerFunctionVariant> uriHandler =
-     uri_handlers::handlers().handlerFor(uri);
+     uri_handlers::handlers().handlerFor(uri, &uriPrefix);
 
    if (uriHandler) // uri handler
    {
+      // time the handler through to its (possibly asynchronous) completion
+      boost::shared_ptr<core::trace::Span> pSpan =
+            boost::make_shared<core::trace::Span>("uri", uriPrefix);
+
       core::http::visitHandler(uriHandler.get(),
                                request,
                                boost::bind(endHandleConnection,
                                            ptrConnection,
                                            connectionType,
+                                           pSpan,
                                            _1));
 
       // r code may execute - ensure session is initialized
@@ -826,6 +859,14 @@ void registerGwtHandlers()
          "/progress",
           boost::bind(text::handleTemplateRequest, progressPagePath, _1, _2));
 
+   // establish latency histogram and trace handlers (these are reachable
+   // through rserver, so tracing is only turned on by configuration)
+   trace::initializeFromEnvironment();
+   if (options.traceEnabled())
+      trace::setTracingEnabled(true);
+   module_context::registerUriHandler("/trace/stats", trace::handleStatsRequest);
+   module_context::registerUriHandler("/trace/events", trace::handleEventsRequest);
+
    // initialize gwt symbol maps
    gwt::initializeSymbolMaps(options.wwwSymbolMapsPath());
 
@@ -47,6 +47,9 @@ void waitForMethodInitFunction(const ClientEvent& initEvent);
 
 void handleConnection(boost::shared_ptr<HttpConnection> ptrConnection,
                       ConnectionType connectionType);
+bool parseAndValidateWorkerThreadJsonRpcConnection(
+         boost::shared_ptr<HttpConnection> ptrConnection,
+         core::json::JsonRpcRequest* pJsonRpcRequest);
 core::WaitResult startHttpConnectionListenerWithTimeout();
 void registerGwtHandlers();
 std::string clientVersion();
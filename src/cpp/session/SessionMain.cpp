@@ -87,6 +87,7 @@
 #include <r/RUtil.hpp>
 
 #include <monitor/MonitorClient.hpp>
+#include <monitor/metrics/MetricRegistry.hpp>
 
 #include <session/SessionConstants.hpp>
 #include <session/SessionOptions.hpp>
@@ -635,7 +636,7 @@ Error rInit(const rstudio::r::session::RInitInfo& rInitInfo)
    // run unit tests
    if (rsession::options().runTests())
    {
-      int result = tests::run();
+      int result = tests::run(rsession::options().runTestsSpec());
       exitEarly(result);
    }
    
@@ -1691,6 +1692,14 @@ void initMonitorClient()
       monitor::initializeMonitorClient(core::system::getenv(kMonitorSocketPathEnvVar),
                                        options().monitorSharedSecret(),
                                        s_monitorIoService);
+
+      // send metrics to rserver if it's collecting them
+      if (!core::system::getenv(kMonitorSocketPathEnvVar).empty())
+      {
+         monitor::metrics::addProcessCollector("rsession");
+         monitor::client().startMetricsEmitter(
+                  boost::posix_time::seconds(kMonitorMetricsIntervalSeconds));
+      }
    }
    else
    {
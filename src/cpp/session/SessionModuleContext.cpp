@@ -15,6 +15,7 @@
 
 #include "SessionModuleContextInternal.hpp"
 
+#include <atomic>
 #include <vector>
 
 #include <boost/assert.hpp>
@@ -2726,13 +2727,12 @@ void checkXcodeLicense()
 {
 #ifdef __APPLE__
    
-   // avoid repeatedly warning the user
-   static bool s_licenseChecked;
-   if (s_licenseChecked)
+   // avoid repeatedly warning the user (the vcs status of the files pane
+   // listing can check from an rpc worker thread)
+   static std::atomic<bool> s_licenseChecked(false);
+   if (s_licenseChecked.exchange(true))
       return;
    
-   s_licenseChecked = true;
-   
    core::system::ProcessResult result;
    Error error = core::system::runCommand(
             "/usr/bin/xcrun --find --show-sdk-path",
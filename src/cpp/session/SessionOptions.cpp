@@ -116,7 +116,10 @@ core::ProgramStatus Options::read(int argc, char * const argv[], std::ostream& o
    runTests.add_options()
          (kRunTestsSessionOption,
           value<bool>(&runTests_)->default_value(false)->implicit_value(true),
-          "run unit tests");
+          "run unit tests")
+         (kRunTestsSpecSessionOption,
+          value<std::string>(&runTestsSpec_)->default_value(""),
+          "tests to run (a catch test spec, e.g. \"[benchmark]\")");
 
    // run an R script
    options_description runScript("script");
@@ -222,6 +225,9 @@ core::ProgramStatus Options::read(int argc, char * const argv[], std::ostream& o
       ("session-quit-child-processes-on-exit",
        value<bool>(&quitChildProcessesOnExit_)->default_value(false),
        "quit child processes on session exit")
+      ("session-trace-enabled",
+       value<bool>(&traceEnabled_)->default_value(false),
+       "record trace events (served at /trace/events)")
       ("session-first-project-template-path",
        value<std::string>(&firstProjectTemplatePath_)->default_value(""),
        "first project template path")
@@ -13,16 +13,27 @@
  *
  */
 
+#include <atomic>
+#include <cstring>
+#include <set>
 #include <string>
 
+#include <boost/algorithm/string/predicate.hpp>
+#include <boost/make_shared.hpp>
+
 #include "SessionRpc.hpp"
+#include "SessionRpcWorkers.hpp"
 #include "SessionHttpMethods.hpp"
 #include "SessionClientEventQueue.hpp"
 
 #include <shared_core/json/Json.hpp>
 #include <core/json/JsonRpc.hpp>
+#include <core/BoostThread.hpp>
 #include <core/Exec.hpp>
 #include <core/Log.hpp>
+#include <core/Trace.hpp>
+
+#include <monitor/metrics/MetricRegistry.hpp>
 
 #include <r/RExec.hpp>
 #include <r/RSexp.hpp>
@@ -36,11 +47,78 @@ namespace rstudio {
 namespace session {
 namespace {
 
-// json rpc methods
+// json rpc methods (and the names of those executed on a worker thread).
+// methods are looked up from worker threads so access is synchronized
+boost::mutex s_methodsMutex;
 core::json::JsonRpcAsyncMethods* s_pJsonRpcMethods = nullptr;
+std::set<std::string>* s_pWorkerThreadMethods = nullptr;
+
+const char* const kRpcUriPrefix = "/rpc/";
+
+// threads which execute worker thread methods. methods are only sent to them
+// once the session's modules have finished initializing
+const std::size_t kWorkerThreads = 2;
+rpc::WorkerPool* s_pWorkerPool = nullptr;
+std::atomic<bool> s_workerThreadsEnabled(false);
+
+bool findRpcMethod(const std::string& name,
+                   std::pair<bool, json::JsonRpcAsyncFunction>* pMethod)
+{
+   LOCK_MUTEX(s_methodsMutex)
+   {
+      auto it = s_pJsonRpcMethods->find(name);
+      if (it == s_pJsonRpcMethods->end())
+         return false;
+
+      *pMethod = it->second;
+      return true;
+   }
+   END_LOCK_MUTEX
+
+   return false;
+}
+
+bool isWorkerThreadMethod(const std::string& name)
+{
+   LOCK_MUTEX(s_methodsMutex)
+   {
+      return s_pWorkerThreadMethods->count(name) > 0;
+   }
+   END_LOCK_MUTEX
+
+   return false;
+}
+
+void insertRpcMethod(const core::json::JsonRpcAsyncMethod& method,
+                     module_context::RpcThreading threading)
+{
+   LOCK_MUTEX(s_methodsMutex)
+   {
+      s_pJsonRpcMethods->insert(method);
+      if (threading == module_context::RpcWorkerThread)
+         s_pWorkerThreadMethods->insert(method.first);
+   }
+   END_LOCK_MUTEX
+}
+
+// end the span of an rpc, recording it in the session's metrics
+void endRpcSpan(boost::shared_ptr<core::trace::Span> pSpan, bool failed)
+{
+   static monitor::metrics::Histogram& s_rpcDuration = monitor::metrics::histogram(
+            "rsession_rpc_duration_seconds", "Time taken to handle RPCs in seconds.");
+   static monitor::metrics::Counter& s_rpcErrors = monitor::metrics::counter(
+            "rsession_rpc_errors_total", "Number of RPCs which returned an error.");
+
+   core::trace::Clock::duration duration = pSpan->end();
+   s_rpcDuration.observe(std::chrono::duration<double>(duration).count());
+   if (failed)
+      s_rpcErrors.increment();
+}
    
 void endHandleRpcRequestDirect(boost::shared_ptr<HttpConnection> ptrConnection,
                          boost::posix_time::ptime executeStartTime,
+                         boost::shared_ptr<core::trace::Span> pSpan,
+                         bool detectChanges,
                          const core::Error& executeError,
                          json::JsonRpcResponse* pJsonRpcResponse)
 {
@@ -48,11 +126,13 @@ void endHandleRpcRequestDirect(boost::shared_ptr<HttpConnection> ptrConnection,
    if (executeError)
    {
       ptrConnection->sendJsonRpcError(executeError);
+      if (pSpan)
+         endRpcSpan(pSpan, true);
    }
    else
    {
       // allow modules to detect changes after rpc calls
-      if (!pJsonRpcResponse->suppressDetectChanges())
+      if (detectChanges && !pJsonRpcResponse->suppressDetectChanges())
       {
          module_context::events().onDetectChanges(
                module_context::ChangeSourceRPC);
@@ -68,12 +148,14 @@ void endHandleRpcRequestDirect(boost::shared_ptr<HttpConnection> ptrConnection,
 
       // send the response
       ptrConnection->sendJsonRpcResponse(*pJsonRpcResponse);
+      if (pSpan)
+         endRpcSpan(pSpan, false);
 
       // run after response if we have one (then detect changes again)
       if (pJsonRpcResponse->hasAfterResponse())
       {
          pJsonRpcResponse->runAfterResponse();
-         if (!pJsonRpcResponse->suppressDetectChanges())
+         if (detectChanges && !pJsonRpcResponse->suppressDetectChanges())
          {
             module_context::events().onDetectChanges(
                   module_context::ChangeSourceRPC);
@@ -84,6 +166,7 @@ void endHandleRpcRequestDirect(boost::shared_ptr<HttpConnection> ptrConnection,
 
 void endHandleRpcRequestIndirect(
       const std::string& asyncHandle,
+      boost::shared_ptr<core::trace::Span> pSpan,
       const core::Error& executeError,
       json::JsonRpcResponse* pJsonRpcResponse)
 {
@@ -101,6 +184,7 @@ void endHandleRpcRequestIndirect(
    value["response"] = jsonRpcResponse.getRawResponse();
    ClientEvent evt(client_events::kAsyncCompletion, value);
    module_context::enqueClientEvent(evt);
+   endRpcSpan(pSpan, static_cast<bool>(executeError));
 }
 
 void saveJsonResponse(const core::Error& error, core::json::JsonRpcResponse *pSrc,
@@ -118,15 +202,14 @@ SEXP rs_invokeRpc(SEXP name, SEXP args)
    rpc::formatRpcRequest(name, args, &request);
 
    // check to see if the RPC exists
-   auto it = s_pJsonRpcMethods->find(request.method);
-   if (it == s_pJsonRpcMethods->end())
+   std::pair<bool, json::JsonRpcAsyncFunction> reg;
+   if (!findRpcMethod(request.method, &reg))
    {
       // specified method doesn't exist
       r::exec::error("Requested RPC method " + request.method + " does not exist.");
       return R_NilValue;    
    }
 
-   std::pair<bool, json::JsonRpcAsyncFunction> reg = it->second;
    json::JsonRpcAsyncFunction handlerFunction = reg.second;
 
    if (!reg.first)
@@ -167,6 +250,100 @@ SEXP rs_invokeRpc(SEXP name, SEXP args)
    return result;
 }
 
+void executeRpcRequest(const core::json::JsonRpcRequest& request,
+                       boost::shared_ptr<HttpConnection> ptrConnection,
+                       bool onMainThread)
+{
+   // record the time just prior to execution of the event
+   // (so we can determine if any events were added during execution)
+   using namespace boost::posix_time; 
+   ptime executeStartTime = microsec_clock::universal_time();
+   
+   // execute the method
+   std::pair<bool, json::JsonRpcAsyncFunction> reg;
+   if (findRpcMethod(request.method, &reg))
+   {
+      json::JsonRpcAsyncFunction handlerFunction = reg.second;
+
+      // time the method through to its (possibly asynchronous) completion
+      boost::shared_ptr<core::trace::Span> pSpan =
+            boost::make_shared<core::trace::Span>("rpc", request.method);
+
+      if (reg.first)
+      {
+         // direct return (modules only detect changes on the main thread)
+         handlerFunction(request,
+                         boost::bind(endHandleRpcRequestDirect,
+                                     ptrConnection,
+                                     executeStartTime,
+                                     pSpan,
+                                     onMainThread,
+                                     _1,
+                                     _2));
+      }
+      else
+      {
+         // indirect return (asyncHandle style)
+         std::string handle = core::system::generateUuid(true);
+         json::JsonRpcResponse response;
+         response.setAsyncHandle(handle);
+         response.setField(kEventsPending, "false");
+         ptrConnection->sendJsonRpcResponse(response);
+
+         handlerFunction(request,
+                         boost::bind(endHandleRpcRequestIndirect,
+                                     handle,
+                                     pSpan,
+                                     _1,
+                                     _2));
+      }
+   }
+   else
+   {
+      Error executeError = Error(json::errc::MethodNotFound, ERROR_LOCATION);
+      executeError.addProperty("method", request.method);
+
+      // we need to know about these because they represent unexpected
+      // application states
+      LOG_ERROR(executeError);
+
+      endHandleRpcRequestDirect(ptrConnection,
+                                executeStartTime,
+                                boost::shared_ptr<core::trace::Span>(),
+                                onMainThread,
+                                executeError,
+                                nullptr);
+   }
+}
+
+void executeWorkerThreadRpcRequest(boost::shared_ptr<HttpConnection> ptrConnection)
+{
+   try
+   {
+      json::JsonRpcRequest request;
+      if (!http_methods::parseAndValidateWorkerThreadJsonRpcConnection(ptrConnection,
+                                                                       &request))
+      {
+         return;
+      }
+
+      request.isBackgroundConnection = true;
+      executeRpcRequest(request, ptrConnection, false);
+   }
+   CATCH_UNEXPECTED_EXCEPTION
+}
+
+void enableWorkerThreads(bool)
+{
+   s_workerThreadsEnabled = true;
+}
+
+void stopWorkerThreads(bool)
+{
+   s_workerThreadsEnabled = false;
+   s_pWorkerPool->stop();
+}
+
 } // anonymous namespace
 
 
@@ -175,23 +352,37 @@ namespace module_context {
 Error registerAsyncRpcMethod(const std::string& name,
                              const core::json::JsonRpcAsyncFunction& function)
 {
-   s_pJsonRpcMethods->insert(
-         std::make_pair(name, std::make_pair(false, function)));
+   return registerAsyncRpcMethod(name, function, RpcMainThread);
+}
+
+Error registerAsyncRpcMethod(const std::string& name,
+                             const core::json::JsonRpcAsyncFunction& function,
+                             RpcThreading threading)
+{
+   insertRpcMethod(std::make_pair(name, std::make_pair(false, function)),
+                   threading);
    return Success();
 }
 
 Error registerRpcMethod(const std::string& name,
                         const core::json::JsonRpcFunction& function)
 {
-   s_pJsonRpcMethods->insert(
-         std::make_pair(name,
-                        std::make_pair(true, json::adaptToAsync(function))));
+   return registerRpcMethod(name, function, RpcMainThread);
+}
+
+Error registerRpcMethod(const std::string& name,
+                        const core::json::JsonRpcFunction& function,
+                        RpcThreading threading)
+{
+   insertRpcMethod(std::make_pair(name,
+                                  std::make_pair(true, json::adaptToAsync(function))),
+                   threading);
    return Success();
 }
 
 void registerRpcMethod(const core::json::JsonRpcAsyncMethod& method)
 {
-   s_pJsonRpcMethods->insert(method);
+   insertRpcMethod(method, RpcMainThread);
 }
 
 } // namespace module_context
@@ -256,55 +447,29 @@ void handleRpcRequest(const core::json::JsonRpcRequest& request,
                       boost::shared_ptr<HttpConnection> ptrConnection,
                       http_methods::ConnectionType connectionType)
 {
-   // record the time just prior to execution of the event
-   // (so we can determine if any events were added during execution)
-   using namespace boost::posix_time; 
-   ptime executeStartTime = microsec_clock::universal_time();
-   
-   // execute the method
-   auto it = s_pJsonRpcMethods->find(request.method);
-   if (it != s_pJsonRpcMethods->end())
-   {
-      std::pair<bool, json::JsonRpcAsyncFunction> reg = it->second;
-      json::JsonRpcAsyncFunction handlerFunction = reg.second;
+   executeRpcRequest(request, ptrConnection, true);
+}
 
-      if (reg.first)
-      {
-         // direct return
-         handlerFunction(request,
-                         boost::bind(endHandleRpcRequestDirect,
-                                     ptrConnection,
-                                     executeStartTime,
-                                     _1,
-                                     _2));
-      }
-      else
-      {
-         // indirect return (asyncHandle style)
-         std::string handle = core::system::generateUuid(true);
-         json::JsonRpcResponse response;
-         response.setAsyncHandle(handle);
-         response.setField(kEventsPending, "false");
-         ptrConnection->sendJsonRpcResponse(response);
+bool executeOnWorkerThread(boost::shared_ptr<HttpConnection> ptrConnection)
+{
+   if (!s_workerThreadsEnabled)
+      return false;
 
-         handlerFunction(request,
-                         boost::bind(endHandleRpcRequestIndirect,
-                                     handle,
-                                     _1,
-                                     _2));
-      }
-   }
-   else
-   {
-      Error executeError = Error(json::errc::MethodNotFound, ERROR_LOCATION);
-      executeError.addProperty("method", request.method);
+   const std::string& uri = ptrConnection->request().uri();
+   if (!boost::algorithm::starts_with(uri, kRpcUriPrefix))
+      return false;
 
-      // we need to know about these because they represent unexpected
-      // application states
-      LOG_ERROR(executeError);
+   if (!isWorkerThreadMethod(uri.substr(std::strlen(kRpcUriPrefix))))
+      return false;
 
-      endHandleRpcRequestDirect(ptrConnection, executeStartTime, executeError, nullptr);
-   }
+   s_pWorkerPool->post(boost::bind(executeWorkerThreadRpcRequest, ptrConnection));
+   return true;
+}
+
+void executeOnWorkerThread(const core::json::JsonRpcRequest& request,
+                           boost::shared_ptr<HttpConnection> ptrConnection)
+{
+   s_pWorkerPool->post(boost::bind(executeRpcRequest, request, ptrConnection, false));
 }
 
 Error initialize()
@@ -315,6 +480,13 @@ Error initialize()
    // this map pegging the processor at 100%; avoid this by allowing
    // the OS to clean up memory itself after the process is gone)
    s_pJsonRpcMethods = new core::json::JsonRpcAsyncMethods;
+   s_pWorkerThreadMethods = new std::set<std::string>;
+   s_pWorkerPool = new WorkerPool(kWorkerThreads);
+
+   // worker thread methods may rely on module state, so only execute them
+   // once every module has been initialized
+   module_context::events().onDeferredInit.connect(enableWorkerThreads);
+   module_context::events().onShutdown.connect(stopWorkerThreads);
 
    RS_REGISTER_CALL_METHOD(rs_invokeRpc);
 
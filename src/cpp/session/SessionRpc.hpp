@@ -37,6 +37,16 @@ void handleRpcRequest(const core::json::JsonRpcRequest& request,
                       boost::shared_ptr<HttpConnection> ptrConnection,
                       http_methods::ConnectionType connectionType);
 
+// execute the connection's rpc on a worker thread if its method was
+// registered as RpcWorkerThread (returns false if it should be handled on
+// the main thread). called from the connection listener's thread
+bool executeOnWorkerThread(boost::shared_ptr<HttpConnection> ptrConnection);
+
+// execute an already parsed and validated request on a worker thread
+// (whatever the threading its method was registered with)
+void executeOnWorkerThread(const core::json::JsonRpcRequest& request,
+                           boost::shared_ptr<HttpConnection> ptrConnection);
+
 core::Error initialize();
 
 } // namespace rpc
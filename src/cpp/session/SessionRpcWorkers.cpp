@@ -0,0 +1,89 @@
+/*
+ * SessionRpcWorkers.cpp
+ *
+ * Copyright (C) 2020 by RStudio, PBC
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include "SessionRpcWorkers.hpp"
+
+#include <boost/bind.hpp>
+
+#include <shared_core/Error.hpp>
+
+#include <core/BoostErrors.hpp>
+#include <core/Log.hpp>
+#include <core/system/System.hpp>
+
+using namespace rstudio::core;
+
+namespace rstudio {
+namespace session {
+namespace rpc {
+
+WorkerPool::WorkerPool(std::size_t threads)
+   : pWork_(new boost::asio::io_service::work(ioService_))
+{
+   try
+   {
+      // block all signals for launch of the threads (so that they are
+      // always delivered to the main thread)
+      core::system::SignalBlocker signalBlocker;
+      Error error = signalBlocker.blockAll();
+      if (error)
+         LOG_ERROR(error);
+
+      for (std::size_t i = 0; i < threads; i++)
+         threads_.create_thread(boost::bind(&WorkerPool::run, this));
+   }
+   catch (const boost::thread_resource_error& e)
+   {
+      LOG_ERROR(Error(boost::thread_error::ec_from_exception(e), ERROR_LOCATION));
+   }
+}
+
+WorkerPool::~WorkerPool()
+{
+   try
+   {
+      stop();
+      threads_.join_all();
+   }
+   CATCH_UNEXPECTED_EXCEPTION
+}
+
+void WorkerPool::post(const boost::function<void()>& work)
+{
+   ioService_.post(work);
+}
+
+void WorkerPool::stop()
+{
+   pWork_.reset();
+   ioService_.stop();
+}
+
+void WorkerPool::run()
+{
+   // keep running if a piece of work throws
+   while (!ioService_.stopped())
+   {
+      try
+      {
+         ioService_.run();
+      }
+      CATCH_UNEXPECTED_EXCEPTION
+   }
+}
+
+} // namespace rpc
+} // namespace session
+} // namespace rstudio
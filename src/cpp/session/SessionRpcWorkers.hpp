@@ -0,0 +1,57 @@
+/*
+ * SessionRpcWorkers.hpp
+ *
+ * Copyright (C) 2020 by RStudio, PBC
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef SESSION_RPC_WORKERS_HPP
+#define SESSION_RPC_WORKERS_HPP
+
+#include <boost/asio/io_service.hpp>
+#include <boost/function.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/utility.hpp>
+
+#include <core/BoostThread.hpp>
+
+namespace rstudio {
+namespace session {
+namespace rpc {
+
+// A pool of threads which execute the work posted to them in the order it
+// arrives. Used to execute rpc methods which don't touch R, so that they are
+// handled while the main thread is busy running R code.
+class WorkerPool : boost::noncopyable
+{
+public:
+   explicit WorkerPool(std::size_t threads);
+   ~WorkerPool();
+
+   // queue work for execution on one of the threads
+   void post(const boost::function<void()>& work);
+
+   // stop the threads (work which hasn't started is discarded)
+   void stop();
+
+private:
+   void run();
+
+   boost::asio::io_service ioService_;
+   boost::scoped_ptr<boost::asio::io_service::work> pWork_;
+   boost::thread_group threads_;
+};
+
+} // namespace rpc
+} // namespace session
+} // namespace rstudio
+
+#endif // SESSION_RPC_WORKERS_HPP
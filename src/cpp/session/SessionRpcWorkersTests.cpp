@@ -0,0 +1,251 @@
+/*
+ * SessionRpcWorkersTests.cpp
+ *
+ * Copyright (C) 2020 by RStudio, PBC
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include "SessionRpcWorkers.hpp"
+#include "SessionRpc.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include <boost/make_shared.hpp>
+
+#include <shared_core/Error.hpp>
+#include <shared_core/FilePath.hpp>
+#include <shared_core/json/Json.hpp>
+
+#include <core/FileSerializer.hpp>
+#include <core/Thread.hpp>
+#include <core/http/Request.hpp>
+#include <core/http/Response.hpp>
+#include <core/json/JsonRpc.hpp>
+
+#include <session/SessionHttpConnection.hpp>
+
+#define RSTUDIO_NO_TESTTHAT_ALIASES
+#include <tests/TestThat.hpp>
+
+namespace rstudio {
+namespace session {
+namespace rpc {
+namespace tests {
+
+using namespace rstudio::core;
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+bool waitFor(const std::atomic<int>& counter, int value)
+{
+   Clock::time_point deadline = Clock::now() + std::chrono::seconds(10);
+   while (counter < value && Clock::now() < deadline)
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+   return counter == value;
+}
+
+// a connection which records the time its response is sent
+class TimedConnection : public HttpConnection
+{
+public:
+   TimedConnection(const std::string& method,
+                   double* pLatency,
+                   std::atomic<int>* pCompleted)
+      : issued_(Clock::now()), pLatency_(pLatency), pCompleted_(pCompleted)
+   {
+      request_.setUri("/rpc/" + method);
+   }
+
+   const http::Request& request() override { return request_; }
+
+   void sendResponse(const http::Response&) override
+   {
+      *pLatency_ = std::chrono::duration<double, std::milli>(Clock::now() - issued_).count();
+      (*pCompleted_)++;
+   }
+
+   void close() override {}
+
+   std::string requestId() const override { return std::string(); }
+
+   void setUploadHandler(const http::UriAsyncUploadHandlerFunction&) override {}
+
+private:
+   http::Request request_;
+   Clock::time_point issued_;
+   double* pLatency_;
+   std::atomic<int>* pCompleted_;
+};
+
+// Issues list_files requests every 10ms from another thread while this
+// (the main) thread runs a busy loop for as long as they're being issued,
+// handling a queued connection every 50ms like the polled event handler
+// does while R is busy. The requests are executed by the real list_files
+// method, either from that queue or on the rpc worker threads; returns the
+// mean and maximum latency in milliseconds.
+void measureLatency(const FilePath& dir, bool onWorkerThread, double* pMean, double* pMax)
+{
+   const int kRequests = 100;
+
+   // a listing without monitoring (so that no file monitors are left
+   // registered by the benchmark)
+   json::JsonRpcRequest request;
+   request.method = "list_files";
+   request.params.push_back(dir.getAbsolutePath());
+   request.params.push_back(false);
+   request.params.push_back(false);
+   request.isBackgroundConnection = true;
+
+   typedef boost::shared_ptr<HttpConnection> Connection;
+   core::thread::ThreadsafeQueue<Connection> mainQueue;
+   std::vector<double> latencies(kRequests, -1);
+   std::atomic<int> completed(0);
+   std::atomic<bool> issuing(true);
+   std::thread client([&]()
+   {
+      for (int i = 0; i < kRequests; i++)
+      {
+         Connection ptrConnection =
+               boost::make_shared<TimedConnection>(request.method, &latencies[i], &completed);
+         if (onWorkerThread)
+            rpc::executeOnWorkerThread(request, ptrConnection);
+         else
+            mainQueue.enque(ptrConnection);
+
+         std::this_thread::sleep_for(std::chrono::milliseconds(10));
+      }
+      issuing = false;
+   });
+
+   Clock::time_point lastPolled = Clock::now();
+   volatile double sink = 0;
+   while (issuing)
+   {
+      for (int i = 0; i < 10000; i++)
+         sink += i * 0.5;
+
+      if (Clock::now() - lastPolled >= std::chrono::milliseconds(50))
+      {
+         Connection ptrConnection;
+         if (mainQueue.deque(&ptrConnection))
+            rpc::handleRpcRequest(request, ptrConnection, http_methods::BackgroundConnection);
+         lastPolled = Clock::now();
+      }
+   }
+   client.join();
+
+   // R finishes its computation; anything still queued is handled after
+   Connection ptrConnection;
+   while (mainQueue.deque(&ptrConnection))
+      rpc::handleRpcRequest(request, ptrConnection, http_methods::BackgroundConnection);
+   REQUIRE(waitFor(completed, kRequests));
+
+   double total = 0;
+   *pMax = 0;
+   for (double latency : latencies)
+   {
+      total += latency;
+      *pMax = std::max(*pMax, latency);
+   }
+   *pMean = total / kRequests;
+}
+
+} // anonymous namespace
+
+TEST_CASE("SessionRpcWorkers")
+{
+   SECTION("Work executes off the posting thread")
+   {
+      WorkerPool workers(2);
+      std::atomic<int> completed(0);
+      std::atomic<int> onPostingThread(0);
+      std::thread::id postingThread = std::this_thread::get_id();
+      for (int i = 0; i < 50; i++)
+      {
+         workers.post([&]()
+         {
+            if (std::this_thread::get_id() == postingThread)
+               onPostingThread++;
+            completed++;
+         });
+      }
+
+      CHECK(waitFor(completed, 50));
+      CHECK(onPostingThread == 0);
+   }
+
+   SECTION("Work which throws doesn't stop the workers")
+   {
+      WorkerPool workers(1);
+      std::atomic<int> completed(0);
+      workers.post([]() { throw std::runtime_error("failed"); });
+      workers.post([&]() { completed++; });
+
+      CHECK(waitFor(completed, 1));
+   }
+
+   SECTION("Stopped workers can be destroyed with work pending")
+   {
+      std::atomic<int> completed(0);
+      {
+         WorkerPool workers(1);
+         workers.post([&]()
+         {
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            completed++;
+         });
+         std::this_thread::sleep_for(std::chrono::milliseconds(10));
+         workers.stop();
+         workers.post([&]() { completed++; });
+      }
+
+      CHECK(completed == 1);
+   }
+}
+
+// run explicitly with: rsession --run-tests --run-tests-spec="[benchmark]"
+TEST_CASE("SessionRpcWorkers benchmark", "[.][benchmark]")
+{
+   FilePath dir;
+   REQUIRE_FALSE(FilePath::tempFilePath(dir));
+   REQUIRE_FALSE(dir.ensureDirectory());
+   for (int i = 0; i < 500; i++)
+   {
+      REQUIRE_FALSE(writeStringToFile(dir.completeChildPath("file" + std::to_string(i) + ".R"),
+                                      "x <- " + std::to_string(i) + "\n"));
+   }
+
+   double mainMean, mainMax;
+   measureLatency(dir, false, &mainMean, &mainMax);
+
+   double workerMean, workerMax;
+   measureLatency(dir, true, &workerMean, &workerMax);
+
+   std::cout << "list_files latency while R is busy (500 files): "
+             << "main thread mean " << mainMean << "ms, max " << mainMax << "ms; "
+             << "worker thread mean " << workerMean << "ms, max " << workerMax << "ms"
+             << std::endl;
+
+   CHECK(workerMean < mainMean);
+   dir.removeIfExists();
+}
+
+} // namespace tests
+} // namespace rpc
+} // namespace session
+} // namespace rstudio
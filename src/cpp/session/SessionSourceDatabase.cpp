@@ -45,6 +45,7 @@
 #include <session/SessionModuleContext.hpp>
 #include <session/projects/SessionProjects.hpp>
 
+#include "SessionSourceDatabaseJournal.hpp"
 #include "SessionSourceDatabaseSupervisor.hpp"
 
 #define kContentsSuffix "-contents"
@@ -71,6 +72,37 @@ namespace {
 // lookup)
 std::map<std::string, std::string> s_idToPath;
 
+// changes to documents are journaled, and written back to the documents'
+// own files once the journal grows beyond this size (and when the session
+// suspends or quits)
+const uint64_t kJournalCompactionSize = 2 * 1024 * 1024;
+bool s_journalCompactionPending = false;
+
+void compactJournal();
+
+SourceDatabaseJournal& journal()
+{
+   static SourceDatabaseJournal instance;
+   if (!instance.isOpen())
+   {
+      Error error = instance.open(
+               supervisor::sessionDirPath().completePath(kSourceDatabaseJournal));
+      if (error)
+         LOG_ERROR(error);
+   }
+   return instance;
+}
+
+void scheduleJournalCompaction()
+{
+   if (s_journalCompactionPending || journal().size() < kJournalCompactionSize)
+      return;
+
+   s_journalCompactionPending = true;
+   module_context::scheduleDelayedWork(boost::posix_time::seconds(5),
+                                       compactJournal);
+}
+
 struct PropertiesDatabase
 {
    FilePath path;
@@ -627,13 +659,20 @@ Error get(const std::string& id, boost::shared_ptr<SourceDocument> pDoc)
 Error get(const std::string& id, bool includeContents, boost::shared_ptr<SourceDocument> pDoc)
 {
    FilePath propertiesPath = source_database::path().completePath(id);
+   SourceDatabaseJournal& sdbJournal = journal();
    
-   // attempt to read file contents from sidecar file if available
+   // attempt to read file contents from the journal (if they've changed
+   // since they were last written) or the sidecar file if available
    std::string contents;
    if (includeContents)
    {
+      bool journaled = false;
+      Error error = sdbJournal.getContents(id, &journaled, &contents);
+      if (error)
+         LOG_ERROR(error);
+
       FilePath contentsPath(propertiesPath.getAbsolutePath() + kContentsSuffix);
-      if (contentsPath.exists())
+      if (!journaled && contentsPath.exists())
       {
          Error error = readStringFromFile(contentsPath,
                                           &contents,
@@ -645,17 +684,22 @@ Error get(const std::string& id, bool includeContents, boost::shared_ptr<SourceD
    
    if (propertiesPath.exists())
    {
-      // read the contents of the file
+      // read the properties from the journal if they've changed since they
+      // were last written, otherwise from the file
       std::string properties;
-      Error error = readStringFromFile(propertiesPath,
-                                       &properties,
-                                       options().sourceLineEnding());
-      if (error)
-         return error;
+      bool journaled = sdbJournal.getProperties(id, &properties);
+      if (!journaled)
+      {
+         Error error = readStringFromFile(propertiesPath,
+                                          &properties,
+                                          options().sourceLineEnding());
+         if (error)
+            return error;
+      }
    
       // parse the json
       json::Value value;
-      if (value.parse(properties))
+      if (value.parse(properties) || !value.isObject())
       {
          return systemError(boost::system::errc::invalid_argument,
                             ERROR_LOCATION);
@@ -666,9 +710,12 @@ Error get(const std::string& id, bool includeContents, boost::shared_ptr<SourceD
       
       // migration: if we have a 'contents' field, but no '-contents' side-car
       // file, perform a one-time generation of that sidecar file from contents
-      error = attemptContentsMigration(jsonDoc, propertiesPath);
-      if (error)
-         LOG_ERROR(error);
+      if (!journaled)
+      {
+         Error error = attemptContentsMigration(jsonDoc, propertiesPath);
+         if (error)
+            LOG_ERROR(error);
+      }
       
       if (includeContents && !contents.empty())
          jsonDoc["contents"] = contents;
@@ -700,6 +747,7 @@ bool isSourceDocument(const FilePath& filePath)
        filename == "lock_file" ||
        filename == "suspend_file" ||
        filename == "restart_file" ||
+       filename == kSourceDatabaseJournal ||
        boost::algorithm::ends_with(filename, kContentsSuffix))
    {
       return false;
@@ -776,7 +824,8 @@ bool isSafeSourceDocument(const FilePath& docDbPath,
 }
 
 
-Error list(std::vector<boost::shared_ptr<SourceDocument> >* pDocs)
+Error list(std::vector<boost::shared_ptr<SourceDocument> >* pDocs,
+           bool includeContents)
 {
    std::vector<FilePath> files ;
    Error error = source_database::path().getChildren(files);
@@ -789,7 +838,9 @@ Error list(std::vector<boost::shared_ptr<SourceDocument> >* pDocs)
       {
          // get the source doc
          boost::shared_ptr<SourceDocument> pDoc(new SourceDocument()) ;
-         Error error = source_database::get(filePath.getFilename(), pDoc);
+         Error error = source_database::get(filePath.getFilename(),
+                                            includeContents,
+                                            pDoc);
          if (!error)
          {
             // safety filter
@@ -824,11 +875,32 @@ Error list(std::vector<FilePath>* pPaths)
    
 Error put(boost::shared_ptr<SourceDocument> pDoc, bool writeContents)
 {   
-   // write to file
    FilePath filePath = source_database::path().completePath(pDoc->id());
-   Error error = pDoc->writeToFile(filePath, writeContents);
-   if (error)
-      return error ;
+   Error error;
+   if (filePath.exists())
+   {
+      // record the change in the journal rather than rewriting the document
+      json::Object jsonProperties;
+      pDoc->writeToJson(&jsonProperties, false);
+      error = journal().put(pDoc->id(),
+                            jsonProperties.write(),
+                            writeContents ? &pDoc->contents() : nullptr);
+      if (error)
+         return error;
+
+      scheduleJournalCompaction();
+   }
+   else
+   {
+      // new documents are written in full, so every document has a file
+      error = journal().remove(pDoc->id());
+      if (error)
+         LOG_ERROR(error);
+
+      error = pDoc->writeToFile(filePath, writeContents);
+      if (error)
+         return error;
+   }
 
    // write properties to durable storage (if there is a path)
    if (!pDoc->path().empty())
@@ -843,13 +915,21 @@ Error put(boost::shared_ptr<SourceDocument> pDoc, bool writeContents)
    
 Error remove(const std::string& id)
 {
+   Error error = journal().remove(id);
+   if (error)
+      LOG_ERROR(error);
+
    return source_database::path().completePath(id).removeIfExists();
 }
    
 Error removeAll()
 {
+   Error error = journal().clear();
+   if (error)
+      LOG_ERROR(error);
+
    std::vector<FilePath> files ;
-   Error error = source_database::path().getChildren(files);
+   error = source_database::path().getChildren(files);
    if (error)
       return error ;
    
@@ -943,8 +1023,41 @@ Error rename(const FilePath& from, const FilePath& to)
 
 namespace {
 
+// write the journaled changes to the documents' own files, so the journal
+// can be emptied
+void compactJournal()
+{
+   s_journalCompactionPending = false;
+
+   // documents which can't be written keep their changes in the journal
+   SourceDatabaseJournal& sdbJournal = journal();
+   std::vector<std::string> failed;
+   for (const std::string& id : sdbJournal.documents())
+   {
+      FilePath docPath = source_database::path().completePath(id);
+      if (!docPath.exists())
+         continue;
+
+      boost::shared_ptr<SourceDocument> pDoc(new SourceDocument());
+      Error error = source_database::get(id, pDoc);
+      if (!error)
+         error = pDoc->writeToFile(docPath, sdbJournal.hasContents(id));
+      if (error)
+      {
+         LOG_ERROR(error);
+         failed.push_back(id);
+      }
+   }
+
+   Error error = sdbJournal.retain(failed);
+   if (error)
+      LOG_ERROR(error);
+}
+
 void onQuit()
 {
+   compactJournal();
+
    Error error = supervisor::saveMostRecentDocuments();
    if (error)
       LOG_ERROR(error);
@@ -956,6 +1069,7 @@ void onQuit()
 
 void onSuspend(const r::session::RSuspendOptions& options, core::Settings*)
 {
+   compactJournal();
    supervisor::suspendSourceDatabase(options.status);
 }
 
@@ -0,0 +1,548 @@
+/*
+ * SessionSourceDatabaseJournal.cpp
+ *
+ * Copyright (C) 2020 by RStudio, PBC
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include "SessionSourceDatabaseJournal.hpp"
+
+#include <algorithm>
+#include <fstream>
+
+#include <boost/crc.hpp>
+#include <boost/filesystem.hpp>
+
+#include <core/Log.hpp>
+
+using namespace rstudio::core;
+
+namespace rstudio {
+namespace session {
+namespace source_database {
+
+namespace {
+
+// each record is a header (magic, payload size, payload checksum) followed
+// by the payload; integers are written little endian
+const uint32_t kRecordMagic = 0x4a424453; // "SDBJ"
+const std::size_t kHeaderSize = 12;
+
+enum RecordType
+{
+   RecordPut = 1,
+   RecordRemove = 2
+};
+
+enum ContentsKind
+{
+   ContentsNone = 0,
+   ContentsFull = 1,
+   ContentsEdit = 2
+};
+
+struct Record
+{
+   Record()
+      : type(0), contentsKind(ContentsNone), editOffset(0), editRemoved(0)
+   {
+   }
+
+   int type;
+   std::string id;
+   std::string properties;
+   int contentsKind;
+   uint32_t editOffset;
+   uint32_t editRemoved;
+   std::string text;
+};
+
+void writeUInt32(uint32_t value, std::string* pBuffer)
+{
+   for (int i = 0; i < 4; ++i)
+      pBuffer->push_back(static_cast<char>((value >> (8 * i)) & 0xFF));
+}
+
+void writeString(const std::string& value, std::string* pBuffer)
+{
+   writeUInt32(static_cast<uint32_t>(value.size()), pBuffer);
+   pBuffer->append(value);
+}
+
+bool readUInt32(const std::string& buffer, std::size_t* pPos, uint32_t* pValue)
+{
+   if (buffer.size() < *pPos + 4)
+      return false;
+
+   uint32_t value = 0;
+   for (int i = 0; i < 4; ++i)
+      value |= static_cast<uint32_t>(static_cast<unsigned char>(buffer[*pPos + i])) << (8 * i);
+   *pPos += 4;
+   *pValue = value;
+   return true;
+}
+
+bool readString(const std::string& buffer, std::size_t* pPos, std::string* pValue)
+{
+   uint32_t size;
+   if (!readUInt32(buffer, pPos, &size) || buffer.size() - *pPos < size)
+      return false;
+
+   pValue->assign(buffer, *pPos, size);
+   *pPos += size;
+   return true;
+}
+
+bool readByte(const std::string& buffer, std::size_t* pPos, int* pValue)
+{
+   if (buffer.size() < *pPos + 1)
+      return false;
+
+   *pValue = static_cast<unsigned char>(buffer[(*pPos)++]);
+   return true;
+}
+
+uint32_t checksum(const std::string& payload)
+{
+   boost::crc_32_type crc;
+   crc.process_bytes(payload.data(), payload.size());
+   return crc.checksum();
+}
+
+// reads the payload of the record at the stream's position, returning
+// false if there isn't a complete, intact record there
+bool readPayload(std::istream& stream, std::string* pPayload)
+{
+   std::string header(kHeaderSize, '\0');
+   if (!stream.read(&header[0], kHeaderSize))
+      return false;
+
+   std::size_t pos = 0;
+   uint32_t magic = 0, size = 0, crc = 0;
+   readUInt32(header, &pos, &magic);
+   readUInt32(header, &pos, &size);
+   readUInt32(header, &pos, &crc);
+   if (magic != kRecordMagic)
+      return false;
+
+   pPayload->resize(size);
+   if (size > 0 && !stream.read(&(*pPayload)[0], size))
+      return false;
+
+   return checksum(*pPayload) == crc;
+}
+
+bool parseRecord(const std::string& payload, Record* pRecord)
+{
+   std::size_t pos = 0;
+   if (!readByte(payload, &pos, &pRecord->type) ||
+       !readString(payload, &pos, &pRecord->id))
+   {
+      return false;
+   }
+
+   if (pRecord->type == RecordRemove)
+      return true;
+   if (pRecord->type != RecordPut)
+      return false;
+
+   if (!readString(payload, &pos, &pRecord->properties) ||
+       !readByte(payload, &pos, &pRecord->contentsKind))
+   {
+      return false;
+   }
+
+   switch (pRecord->contentsKind)
+   {
+   case ContentsNone:
+      return true;
+   case ContentsFull:
+      return readString(payload, &pos, &pRecord->text);
+   case ContentsEdit:
+      return readUInt32(payload, &pos, &pRecord->editOffset) &&
+             readUInt32(payload, &pos, &pRecord->editRemoved) &&
+             readString(payload, &pos, &pRecord->text);
+   default:
+      return false;
+   }
+}
+
+Error corruptJournalError(const FilePath& path, uint64_t offset, const ErrorLocation& location)
+{
+   Error error = systemError(boost::system::errc::io_error,
+                             "Source database journal record is unreadable",
+                             location);
+   error.addProperty("path", path);
+   error.addProperty("offset", std::to_string(offset));
+   return error;
+}
+
+} // anonymous namespace
+
+SourceDatabaseJournal::SourceDatabaseJournal()
+   : size_(0)
+{
+}
+
+Error SourceDatabaseJournal::open(const FilePath& path)
+{
+   path_ = path;
+   size_ = 0;
+   documents_.clear();
+
+   if (!path.exists())
+      return Success();
+
+   std::ifstream stream(path.getAbsolutePath().c_str(), std::ios::in | std::ios::binary);
+   if (!stream)
+   {
+      Error error = systemError(boost::system::errc::io_error, ERROR_LOCATION);
+      error.addProperty("path", path);
+      return error;
+   }
+
+   std::string payload;
+   Record record;
+   while (readPayload(stream, &payload))
+   {
+      record = Record();
+      if (!parseRecord(payload, &record))
+         break;
+
+      uint64_t offset = size_;
+      size_ += kHeaderSize + payload.size();
+
+      if (record.type == RecordRemove)
+      {
+         documents_.erase(record.id);
+         continue;
+      }
+
+      Document& document = documents_[record.id];
+      document.properties = record.properties;
+      if (record.contentsKind == ContentsFull)
+         document.contentsRecords.assign(1, offset);
+      else if (record.contentsKind == ContentsEdit)
+         document.contentsRecords.push_back(offset);
+   }
+   stream.close();
+
+   // drop a partly written record so later records follow the intact ones
+   uintmax_t fileSize = path.getSize();
+   if (fileSize > size_)
+   {
+      LOG_WARNING_MESSAGE("Discarding " + std::to_string(fileSize - size_) +
+                          " unreadable bytes from the end of " + path.getAbsolutePath());
+
+      boost::system::error_code ec;
+      boost::filesystem::resize_file(path.getAbsolutePath(), size_, ec);
+      if (ec)
+      {
+         Error error(ec, ERROR_LOCATION);
+         error.addProperty("path", path);
+         return error;
+      }
+   }
+
+   return Success();
+}
+
+std::vector<std::string> SourceDatabaseJournal::documents() const
+{
+   std::vector<std::string> ids;
+   for (const auto& document : documents_)
+      ids.push_back(document.first);
+   return ids;
+}
+
+bool SourceDatabaseJournal::getProperties(const std::string& id,
+                                          std::string* pProperties) const
+{
+   auto it = documents_.find(id);
+   if (it == documents_.end())
+      return false;
+
+   *pProperties = it->second.properties;
+   return true;
+}
+
+bool SourceDatabaseJournal::hasContents(const std::string& id) const
+{
+   auto it = documents_.find(id);
+   return it != documents_.end() &&
+          (it->second.contentsCached || !it->second.contentsRecords.empty());
+}
+
+Error SourceDatabaseJournal::getContents(const std::string& id,
+                                         bool* pFound,
+                                         std::string* pContents)
+{
+   *pFound = false;
+
+   auto it = documents_.find(id);
+   if (it == documents_.end())
+      return Success();
+
+   Document& document = it->second;
+   if (document.contentsCached)
+   {
+      *pFound = true;
+      *pContents = document.contents;
+      return Success();
+   }
+
+   if (document.contentsRecords.empty())
+      return Success();
+
+   // replay the document's latest full contents and the edits since
+   std::ifstream stream(path_.getAbsolutePath().c_str(), std::ios::in | std::ios::binary);
+   std::string contents;
+   std::string payload;
+   for (uint64_t offset : document.contentsRecords)
+   {
+      Record record;
+      stream.seekg(static_cast<std::streamoff>(offset));
+      if (!readPayload(stream, &payload) || !parseRecord(payload, &record))
+         return corruptJournalError(path_, offset, ERROR_LOCATION);
+
+      if (record.contentsKind == ContentsFull)
+      {
+         contents = record.text;
+      }
+      else if (record.contentsKind == ContentsEdit &&
+               record.editOffset <= contents.size() &&
+               record.editRemoved <= contents.size() - record.editOffset)
+      {
+         contents.replace(record.editOffset, record.editRemoved, record.text);
+      }
+      else
+      {
+         return corruptJournalError(path_, offset, ERROR_LOCATION);
+      }
+   }
+
+   document.contentsCached = true;
+   document.contents = contents;
+
+   *pFound = true;
+   *pContents = contents;
+   return Success();
+}
+
+Error SourceDatabaseJournal::put(const std::string& id,
+                                 const std::string& properties,
+                                 const std::string* pContents)
+{
+   Document& document = documents_[id];
+
+   std::string payload;
+   payload.push_back(static_cast<char>(RecordPut));
+   writeString(id, &payload);
+   writeString(properties, &payload);
+
+   // when we know the previous contents, record the span which changed
+   // (typically a keystroke or two) rather than the whole document
+   int contentsKind = ContentsNone;
+   if (pContents != nullptr)
+   {
+      const std::string& contents = *pContents;
+      const std::string& previous = document.contents;
+      if (!document.contentsCached)
+      {
+         contentsKind = ContentsFull;
+      }
+      else if (contents != previous)
+      {
+         std::size_t prefix = std::mismatch(
+                  previous.begin(),
+                  previous.begin() + std::min(previous.size(), contents.size()),
+                  contents.begin()).first - previous.begin();
+
+         std::size_t maxSuffix = std::min(previous.size(), contents.size()) - prefix;
+         std::size_t suffix = std::mismatch(
+                  previous.rbegin(),
+                  previous.rbegin() + maxSuffix,
+                  contents.rbegin()).first - previous.rbegin();
+
+         std::size_t removed = previous.size() - prefix - suffix;
+         std::size_t inserted = contents.size() - prefix - suffix;
+
+         // an edit replacing most of the document may as well replace all of it
+         contentsKind = inserted < contents.size() / 2 ? ContentsEdit : ContentsFull;
+         if (contentsKind == ContentsEdit)
+         {
+            payload.push_back(static_cast<char>(ContentsEdit));
+            writeUInt32(static_cast<uint32_t>(prefix), &payload);
+            writeUInt32(static_cast<uint32_t>(removed), &payload);
+            writeString(contents.substr(prefix, inserted), &payload);
+         }
+      }
+   }
+
+   if (contentsKind == ContentsFull)
+   {
+      payload.push_back(static_cast<char>(ContentsFull));
+      writeString(*pContents, &payload);
+   }
+   else if (contentsKind == ContentsNone)
+   {
+      payload.push_back(static_cast<char>(ContentsNone));
+   }
+
+   uint64_t offset;
+   Error error = append(payload, &offset);
+   if (error)
+      return error;
+
+   document.properties = properties;
+   if (contentsKind == ContentsFull)
+      document.contentsRecords.assign(1, offset);
+   else if (contentsKind == ContentsEdit)
+      document.contentsRecords.push_back(offset);
+
+   if (pContents != nullptr)
+   {
+      document.contentsCached = true;
+      document.contents = *pContents;
+   }
+
+   return Success();
+}
+
+Error SourceDatabaseJournal::remove(const std::string& id)
+{
+   if (documents_.find(id) == documents_.end())
+      return Success();
+
+   std::string payload;
+   payload.push_back(static_cast<char>(RecordRemove));
+   writeString(id, &payload);
+
+   uint64_t offset;
+   Error error = append(payload, &offset);
+   if (error)
+      return error;
+
+   documents_.erase(id);
+   return Success();
+}
+
+Error SourceDatabaseJournal::clear()
+{
+   documents_.clear();
+   size_ = 0;
+   return path_.removeIfExists();
+}
+
+Error SourceDatabaseJournal::retain(const std::vector<std::string>& ids)
+{
+   // read the documents' latest state before rewriting the journal
+   std::vector<std::string> retained;
+   std::vector<std::string> properties;
+   std::vector<std::pair<bool, std::string> > contents;
+   for (const std::string& id : ids)
+   {
+      auto it = documents_.find(id);
+      if (it == documents_.end())
+         continue;
+
+      bool found = false;
+      std::string documentContents;
+      Error error = getContents(id, &found, &documentContents);
+      if (error)
+         return error;
+
+      retained.push_back(id);
+      properties.push_back(it->second.properties);
+      contents.push_back(std::make_pair(found, documentContents));
+   }
+
+   if (retained.empty())
+      return clear();
+
+   // write them to a new journal which replaces this one
+   FilePath journalPath = path_;
+   FilePath newPath(journalPath.getAbsolutePath() + ".new");
+   Error error = newPath.removeIfExists();
+   if (error)
+      return error;
+
+   path_ = newPath;
+   size_ = 0;
+   documents_.clear();
+   for (std::size_t i = 0; i < retained.size() && !error; ++i)
+   {
+      error = put(retained[i],
+                  properties[i],
+                  contents[i].first ? &contents[i].second : nullptr);
+   }
+
+   if (!error)
+   {
+      boost::system::error_code ec;
+      boost::filesystem::rename(newPath.getAbsolutePath(), journalPath.getAbsolutePath(), ec);
+      if (ec)
+      {
+         error = Error(ec, ERROR_LOCATION);
+         error.addProperty("path", journalPath);
+      }
+   }
+
+   if (error)
+   {
+      // carry on with the journal as it was
+      newPath.removeIfExists();
+      Error openError = open(journalPath);
+      if (openError)
+         LOG_ERROR(openError);
+      return error;
+   }
+
+   path_ = journalPath;
+   return Success();
+}
+
+Error SourceDatabaseJournal::append(const std::string& payload, uint64_t* pOffset)
+{
+   std::string record;
+   record.reserve(kHeaderSize + payload.size());
+   writeUInt32(kRecordMagic, &record);
+   writeUInt32(static_cast<uint32_t>(payload.size()), &record);
+   writeUInt32(checksum(payload), &record);
+   record.append(payload);
+
+   // the journal is opened for each record so it follows the file if the
+   // source database is moved or removed
+   std::ofstream stream(path_.getAbsolutePath().c_str(),
+                        std::ios::out | std::ios::binary | std::ios::app);
+   stream.write(record.data(), record.size());
+   stream.flush();
+   if (!stream.good())
+   {
+      // don't leave part of a record for later records to follow
+      stream.close();
+      boost::system::error_code ec;
+      if (path_.exists())
+         boost::filesystem::resize_file(path_.getAbsolutePath(), size_, ec);
+
+      Error error = systemError(boost::system::errc::io_error, ERROR_LOCATION);
+      error.addProperty("path", path_);
+      return error;
+   }
+
+   *pOffset = size_;
+   size_ += record.size();
+   return Success();
+}
+
+} // namespace source_database
+} // namespace session
+} // namespace rstudio
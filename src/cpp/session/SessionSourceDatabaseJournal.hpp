@@ -0,0 +1,117 @@
+/*
+ * SessionSourceDatabaseJournal.hpp
+ *
+ * Copyright (C) 2020 by RStudio, PBC
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef SESSION_SOURCE_DATABASE_JOURNAL_HPP
+#define SESSION_SOURCE_DATABASE_JOURNAL_HPP
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <boost/noncopyable.hpp>
+
+#include <shared_core/Error.hpp>
+#include <shared_core/FilePath.hpp>
+
+#define kSourceDatabaseJournal "journal"
+
+namespace rstudio {
+namespace session {
+namespace source_database {
+
+// An append-only log of the changes made to documents in the source
+// database, so that saving a document writes what changed rather than the
+// whole document. Each save appends a checksummed record holding the
+// document's properties along with either its full contents or, when the
+// previous contents are known, the single edit which turns them into the
+// new contents. A record which is only partly written (e.g. if the session
+// crashed) is discarded, along with anything after it.
+//
+// Only the properties of each document are held in memory when a journal
+// is opened; contents are read back from the journal when first asked for.
+// Once the changes have been written elsewhere the journal can be cleared.
+class SourceDatabaseJournal : boost::noncopyable
+{
+public:
+   SourceDatabaseJournal();
+
+   // replay the journal at the given path (which needn't exist yet)
+   core::Error open(const core::FilePath& path);
+
+   bool isOpen() const { return !path_.isEmpty(); }
+
+   // the documents with changes in the journal
+   std::vector<std::string> documents() const;
+
+   // the latest properties (as JSON) of a document, if it has any changes
+   bool getProperties(const std::string& id, std::string* pProperties) const;
+
+   // whether the journal has contents for a document
+   bool hasContents(const std::string& id) const;
+
+   // the latest contents of a document; pFound is set to false if the
+   // journal has no contents for it
+   core::Error getContents(const std::string& id,
+                           bool* pFound,
+                           std::string* pContents);
+
+   // record a document's properties, and its contents if given
+   core::Error put(const std::string& id,
+                   const std::string& properties,
+                   const std::string* pContents);
+
+   // forget a document's changes
+   core::Error remove(const std::string& id);
+
+   // forget all changes, emptying the journal
+   core::Error clear();
+
+   // forget the changes to all but the given documents, rewriting the
+   // journal to hold just their latest properties and contents
+   core::Error retain(const std::vector<std::string>& ids);
+
+   // the size of the journal in bytes
+   uint64_t size() const { return size_; }
+
+private:
+   struct Document
+   {
+      Document() : contentsCached(false) {}
+
+      std::string properties;
+
+      // the records holding the document's latest full contents, followed
+      // by those holding edits since
+      std::vector<uint64_t> contentsRecords;
+
+      // the contents as of the last record, if we know them
+      bool contentsCached;
+      std::string contents;
+   };
+
+   core::Error append(const std::string& payload, uint64_t* pOffset);
+
+private:
+   core::FilePath path_;
+   uint64_t size_;
+   std::map<std::string, Document> documents_;
+};
+
+} // namespace source_database
+} // namespace session
+} // namespace rstudio
+
+#endif // SESSION_SOURCE_DATABASE_JOURNAL_HPP
@@ -0,0 +1,211 @@
+/*
+ * SessionSourceDatabaseJournalTests.cpp
+ *
+ * Copyright (C) 2020 by RStudio, PBC
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include "SessionSourceDatabaseJournal.hpp"
+
+#include <iostream>
+
+#include <boost/filesystem.hpp>
+
+#define RSTUDIO_NO_TESTTHAT_ALIASES
+#include <tests/TestThat.hpp>
+
+namespace rstudio {
+namespace session {
+namespace source_database {
+namespace tests {
+
+using namespace rstudio::core;
+
+namespace {
+
+const std::string kProperties("{\"path\":\"~/analysis.R\",\"dirty\":true}");
+
+std::string contentsOf(SourceDatabaseJournal& journal, const std::string& id)
+{
+   bool found = false;
+   std::string contents;
+   REQUIRE_FALSE(journal.getContents(id, &found, &contents));
+   REQUIRE(found);
+   return contents;
+}
+
+} // anonymous namespace
+
+TEST_CASE("SessionSourceDatabaseJournal")
+{
+   FilePath journalPath;
+   REQUIRE_FALSE(FilePath::tempFilePath(journalPath));
+
+   SourceDatabaseJournal journal;
+   REQUIRE_FALSE(journal.open(journalPath));
+   CHECK(journal.documents().empty());
+
+   std::string contents = "x <- 1\ny <- 2\n";
+   REQUIRE_FALSE(journal.put("A1", kProperties, &contents));
+
+   SECTION("Documents are replayed when reopened")
+   {
+      contents.insert(7, "z <- 3\n");
+      REQUIRE_FALSE(journal.put("A1", kProperties, &contents));
+      REQUIRE_FALSE(journal.put("B2", "{}", nullptr));
+
+      SourceDatabaseJournal replayed;
+      REQUIRE_FALSE(replayed.open(journalPath));
+      CHECK(replayed.size() == journal.size());
+      CHECK(replayed.documents() == std::vector<std::string>({ "A1", "B2" }));
+
+      std::string properties;
+      CHECK(replayed.getProperties("A1", &properties));
+      CHECK(properties == kProperties);
+      CHECK(replayed.hasContents("A1"));
+      CHECK_FALSE(replayed.hasContents("B2"));
+      CHECK(contentsOf(replayed, "A1") == "x <- 1\nz <- 3\ny <- 2\n");
+
+      bool found = true;
+      REQUIRE_FALSE(replayed.getContents("B2", &found, &properties));
+      CHECK_FALSE(found);
+   }
+
+   SECTION("Small changes are recorded as edits")
+   {
+      std::string large(64 * 1024, 'x');
+      REQUIRE_FALSE(journal.put("A1", kProperties, &large));
+      uint64_t size = journal.size();
+
+      large.insert(1024, "y");
+      large.erase(2048, 1);
+      REQUIRE_FALSE(journal.put("A1", kProperties, &large));
+      CHECK(journal.size() - size < 1024);
+
+      // properties alone leave the contents as they were
+      REQUIRE_FALSE(journal.put("A1", "{}", nullptr));
+      CHECK(contentsOf(journal, "A1") == large);
+
+      SourceDatabaseJournal replayed;
+      REQUIRE_FALSE(replayed.open(journalPath));
+      CHECK(contentsOf(replayed, "A1") == large);
+
+      // edits are applied to contents replayed from the journal
+      large.append("z");
+      REQUIRE_FALSE(replayed.put("A1", "{}", &large));
+      SourceDatabaseJournal again;
+      REQUIRE_FALSE(again.open(journalPath));
+      CHECK(contentsOf(again, "A1") == large);
+   }
+
+   SECTION("Partly written records are discarded")
+   {
+      uint64_t size = journal.size();
+      contents.append("w <- 4\n");
+      REQUIRE_FALSE(journal.put("A1", kProperties, &contents));
+
+      boost::filesystem::resize_file(journalPath.getAbsolutePath(),
+                                     journal.size() - 3);
+
+      SourceDatabaseJournal replayed;
+      REQUIRE_FALSE(replayed.open(journalPath));
+      CHECK(replayed.size() == size);
+      CHECK(journalPath.getSize() == size);
+      CHECK(contentsOf(replayed, "A1") == "x <- 1\ny <- 2\n");
+
+      // and new records follow the last complete one
+      REQUIRE_FALSE(replayed.put("A1", kProperties, &contents));
+      SourceDatabaseJournal again;
+      REQUIRE_FALSE(again.open(journalPath));
+      CHECK(contentsOf(again, "A1") == contents);
+   }
+
+   SECTION("Documents can be removed")
+   {
+      REQUIRE_FALSE(journal.put("B2", "{}", &contents));
+      REQUIRE_FALSE(journal.remove("A1"));
+      CHECK(journal.documents() == std::vector<std::string>({ "B2" }));
+
+      SourceDatabaseJournal replayed;
+      REQUIRE_FALSE(replayed.open(journalPath));
+      CHECK(replayed.documents() == std::vector<std::string>({ "B2" }));
+
+      REQUIRE_FALSE(replayed.clear());
+      CHECK(replayed.documents().empty());
+      CHECK(replayed.size() == 0);
+      CHECK_FALSE(journalPath.exists());
+   }
+
+   SECTION("Only some documents can be kept")
+   {
+      std::string edited = contents + "z <- 3\n";
+      REQUIRE_FALSE(journal.put("A1", kProperties, &edited));
+      REQUIRE_FALSE(journal.put("B2", "{}", &contents));
+      REQUIRE_FALSE(journal.put("C3", "{}", nullptr));
+      uint64_t size = journal.size();
+
+      REQUIRE_FALSE(journal.retain({ "A1", "C3", "D4" }));
+      CHECK(journal.documents() == std::vector<std::string>({ "A1", "C3" }));
+      CHECK(journal.size() < size);
+
+      SourceDatabaseJournal replayed;
+      REQUIRE_FALSE(replayed.open(journalPath));
+      CHECK(replayed.documents() == std::vector<std::string>({ "A1", "C3" }));
+      CHECK(replayed.size() == journal.size());
+      CHECK(contentsOf(replayed, "A1") == edited);
+      CHECK_FALSE(replayed.hasContents("C3"));
+
+      REQUIRE_FALSE(replayed.retain({}));
+      CHECK_FALSE(journalPath.exists());
+   }
+
+   journalPath.removeIfExists();
+}
+
+// run explicitly with: rsession --run-tests --run-tests-spec="[benchmark]"
+TEST_CASE("SessionSourceDatabaseJournal benchmark", "[.][benchmark]")
+{
+   FilePath journalPath;
+   REQUIRE_FALSE(FilePath::tempFilePath(journalPath));
+
+   SourceDatabaseJournal journal;
+   REQUIRE_FALSE(journal.open(journalPath));
+
+   // a 2MB document, saved after each of a run of keystrokes
+   std::string contents;
+   while (contents.size() < 2 * 1024 * 1024)
+      contents.append("result <- summarise(group_by(data, id), total = sum(value))\n");
+
+   REQUIRE_FALSE(journal.put("A1", kProperties, &contents));
+   uint64_t initialSize = journal.size();
+
+   const int kKeystrokes = 1000;
+   uint64_t rewriteBytes = 0;
+   for (int i = 0; i < kKeystrokes; i++)
+   {
+      contents.insert(contents.size() / 2 + i, "x");
+      REQUIRE_FALSE(journal.put("A1", kProperties, &contents));
+      rewriteBytes += contents.size() + kProperties.size();
+   }
+
+   uint64_t journalBytes = journal.size() - initialSize;
+   std::cout << "bytes written per save: "
+             << "rewrite " << rewriteBytes / kKeystrokes << ", "
+             << "journal " << journalBytes / kKeystrokes << std::endl;
+   CHECK(journalBytes * 100 < rewriteBytes);
+
+   journalPath.removeIfExists();
+}
+
+} // namespace tests
+} // namespace source_database
+} // namespace session
+} // namespace rstudio
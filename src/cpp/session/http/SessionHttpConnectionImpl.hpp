@@ -24,6 +24,7 @@
 #include <boost/asio/write.hpp>
 #include <boost/asio/placeholders.hpp>
 #include <boost/enable_shared_from_this.hpp>
+#include <boost/algorithm/string/predicate.hpp>
 
 #include <shared_core/Error.hpp>
 #include <core/Log.hpp>
@@ -59,9 +60,28 @@ public:
 
 public:
    HttpConnectionImpl(boost::asio::io_service& ioService,
+                      const HeadersParsedHandler& headersParsed,
+                      const Handler& handler,
+                      bool keepAliveEnabled = false)
+      : ioService_(ioService),
+        socket_(ioService),
+        headersParsedHandler_(headersParsed),
+        handler_(handler),
+        keepAliveEnabled_(keepAliveEnabled)
+   {
+   }
+
+   // construct a connection which takes over an already established socket
+   // (used to read the next request from a kept-alive connection)
+   HttpConnectionImpl(boost::asio::io_service& ioService,
+                      typename ProtocolType::socket&& socket,
                       const HeadersParsedHandler& headersParsed,
                       const Handler& handler)
-      : socket_(ioService), headersParsedHandler_(headersParsed), handler_(handler)
+      : ioService_(ioService),
+        socket_(std::move(socket)),
+        headersParsedHandler_(headersParsed),
+        handler_(handler),
+        keepAliveEnabled_(true)
    {
    }
 
@@ -103,9 +123,25 @@ public:
          }
 
          // write the non streaming response
+         bool keepAlive = shouldKeepAlive(response);
          boost::asio::write(socket_,
                             response.toBuffers(
-                                  core::http::Header::connectionClose()));
+                                  keepAlive ? core::http::Header("Connection", "keep-alive") :
+                                              core::http::Header::connectionClose()));
+
+         // hand the socket over to a new connection object which waits for the
+         // next request (this object's request remains valid for any callers
+         // still holding a reference to it)
+         if (keepAlive)
+         {
+            boost::shared_ptr<HttpConnectionImpl<ProtocolType> > pNext(
+                     new HttpConnectionImpl<ProtocolType>(ioService_,
+                                                         std::move(socket_),
+                                                         headersParsedHandler_,
+                                                         handler_));
+            pNext->startReading();
+            return;
+         }
       }
       catch(const boost::system::system_error& e)
       {
@@ -172,6 +208,32 @@ public:
 
 private:
 
+   // keep the connection open only when the client explicitly asked for it
+   // (rserver does this for its pooled session connections) and the response
+   // is fully delimited by its Content-Length
+   bool shouldKeepAlive(const core::http::Response& response)
+   {
+      if (!keepAliveEnabled_)
+         return false;
+
+      if (!boost::algorithm::iequals(request_.headerValue("Connection"), "keep-alive"))
+         return false;
+
+      if (boost::algorithm::iequals(response.headerValue("Connection"), "close"))
+         return false;
+
+      if (response.headerValue("Content-Length").empty())
+         return false;
+
+      // uploads install a form handler on the request parser; don't attempt
+      // to reuse those connections
+      if (boost::algorithm::starts_with(request_.headerValue("Content-Type"),
+                                        "multipart/form-data"))
+         return false;
+
+      return true;
+   }
+
    // async request reading interface
    void readSome()
    {
@@ -284,6 +346,7 @@ private:
    }
 
 private:
+   boost::asio::io_service& ioService_;
    typename ProtocolType::socket socket_;
    boost::array<char, 8192> buffer_ ;
    core::http::RequestParser requestParser_ ;
@@ -291,6 +354,7 @@ private:
    std::string requestId_;
    HeadersParsedHandler headersParsedHandler_;
    Handler handler_;
+   bool keepAliveEnabled_;
 };
 
 } // namespace session
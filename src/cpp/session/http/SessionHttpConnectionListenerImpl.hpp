@@ -180,6 +180,13 @@ protected:
       return true;
    }
 
+   // whether connections may be kept open across requests when the
+   // client asks for it
+   virtual bool keepAliveEnabled()
+   {
+      return false;
+   }
+
 private:
    // required subclass hooks
    virtual core::Error initializeAcceptor(
@@ -205,7 +212,8 @@ private:
             boost::bind(
                  &HttpConnectionListenerImpl<ProtocolType>::enqueConnection,
                  this,
-                 _1))
+                 _1),
+            keepAliveEnabled())
       );
 
       // wait for next connection
@@ -319,6 +327,11 @@ private:
       if (connection::checkForInterrupt(ptrHttpConnection))
          return;
 
+      // rpc methods which don't touch R are executed on a worker thread
+      // (so they are handled promptly even while R is busy)
+      if (connection::checkForWorkerThreadRpc(ptrHttpConnection))
+         return;
+
       // place the connection on the correct queue
       if (connection::isGetEvents(ptrHttpConnection))
          eventsConnectionQueue_.enqueConnection(ptrHttpConnection);
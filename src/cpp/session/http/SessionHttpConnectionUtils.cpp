@@ -39,6 +39,8 @@
 #include <session/SessionOptions.hpp>
 #include <session/projects/ProjectsSettings.hpp>
 
+#include "../SessionRpc.hpp"
+
 namespace rstudio {
 namespace session {
 
@@ -258,6 +260,11 @@ bool checkForInterrupt(boost::shared_ptr<HttpConnection> ptrConnection)
    return true;
 }
 
+bool checkForWorkerThreadRpc(boost::shared_ptr<HttpConnection> ptrConnection)
+{
+   return rpc::executeOnWorkerThread(ptrConnection);
+}
+
 bool authenticate(boost::shared_ptr<HttpConnection> ptrConnection,
                   const std::string& secret)
 {
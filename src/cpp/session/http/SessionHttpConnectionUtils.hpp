@@ -52,6 +52,8 @@ bool checkForSuspend(boost::shared_ptr<HttpConnection> ptrConnection);
 
 bool checkForInterrupt(boost::shared_ptr<HttpConnection> ptrConnection);
 
+bool checkForWorkerThreadRpc(boost::shared_ptr<HttpConnection> ptrConnection);
+
 bool authenticate(boost::shared_ptr<HttpConnection> ptrConnection,
                   const std::string& secret);
 
@@ -128,6 +128,12 @@ protected:
       return connection::authenticate(ptrConnection, secret_);
    }
 
+   // rserver keeps pooled connections to the session stream open
+   virtual bool keepAliveEnabled()
+   {
+      return true;
+   }
+
 private:
    Error writePidFile()
    {
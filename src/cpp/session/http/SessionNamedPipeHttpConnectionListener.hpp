@@ -400,6 +400,11 @@ private:
       if (connection::checkForInterrupt(ptrHttpConnection))
          return;
 
+      // rpc methods which don't touch R are executed on a worker thread
+      // (so they are handled promptly even while R is busy)
+      if (connection::checkForWorkerThreadRpc(ptrHttpConnection))
+         return;
+
       // place the connection on the correct queue
       if (connection::isGetEvents(ptrHttpConnection))
          eventsConnectionQueue_.enqueConnection(ptrHttpConnection);
@@ -18,6 +18,8 @@
 
 #include <string>
 
+#include <boost/scoped_ptr.hpp>
+#include <boost/shared_ptr.hpp>
 #include <boost/utility.hpp>
 
 #include <core/BoostThread.hpp>
@@ -34,6 +36,9 @@ namespace core {
 namespace rstudio {
 namespace session {
 
+class ClientEventBuffer;
+class HttpConnection;
+
 // singleton
 class ClientEventService;
 ClientEventService& clientEventService();
@@ -41,12 +46,14 @@ ClientEventService& clientEventService();
 class ClientEventService : boost::noncopyable
 {
 private:
-   ClientEventService() {}
+   ClientEventService();
    friend ClientEventService& clientEventService();
 
 public:
    // COPYING: boost::noncopyable
 
+   ~ClientEventService();
+
    core::Error start(const std::string& clientId);
    void stop();
    
@@ -59,8 +66,9 @@ private:
 
    void erasePreviouslyDeliveredEvents(int lastClientEventIdSeen);
    bool havePendingClientEvents();
-   void addClientEvent(const core::json::Object& eventObject);
-   void setClientEventResult(core::json::JsonRpcResponse* pResponse);
+   std::size_t pendingClientEventBytes();
+   void addQueuedClientEvents();
+   void sendClientEvents(boost::shared_ptr<HttpConnection> ptrConnection);
 
   
 private:
@@ -68,7 +76,7 @@ private:
    boost::thread serviceThread_ ;
 
    std::string clientId_ ;
-   core::json::Array clientEvents_ ;
+   boost::scoped_ptr<ClientEventBuffer> pClientEvents_ ;
 };
    
   
@@ -15,6 +15,7 @@
 #ifndef SESSION_CONSOLE_PROCESS_PERSIST_HPP
 #define SESSION_CONSOLE_PROCESS_PERSIST_HPP
 
+#include <cstddef>
 #include <string>
 
 #include <core/system/Types.hpp>
@@ -43,8 +44,17 @@ void saveConsoleProcesses(const std::string& metadata);
 // then returns the trimmed buffer.
 std::string getSavedBuffer(const std::string& handle, int maxLines);
 
+// Get up to length bytes of the saved buffer for the given ConsoleProcess,
+// starting at offset; sets pMoreAvailable if the buffer continues past them.
+// If maxLines > 0, trims the saved buffer first, as with getSavedBuffer.
+std::string getSavedBufferChunk(const std::string& handle,
+                                int maxLines,
+                                std::size_t offset,
+                                std::size_t length,
+                                bool* pMoreAvailable);
+
 // Return number of lines in the saved buffer for given ConsoleProcess;
-// buffer will be trimmed to max number of lines and rewritten.
+// buffer will be trimmed to max number of lines.
 int getSavedBufferLineCount(const std::string& handle, int maxLines);
 
 // Add to the saved buffer for the given ConsoleProcess
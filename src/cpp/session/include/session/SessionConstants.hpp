@@ -61,6 +61,7 @@
 #define kVerifyInstallationSessionOption  "verify-installation"
 
 #define kRunTestsSessionOption            "run-tests"
+#define kRunTestsSpecSessionOption        "run-tests-spec"
 #define kRunScriptSessionOption           "run-script"
 
 #define kLimitSessionOption               "session-limit"
@@ -217,11 +217,28 @@ core::Error registerPostbackHandler(
                               const PostbackHandlerFunction& handlerFunction,
                               std::string* pShellCommand); 
                         
+// the thread an rpc method executes on. most methods execute on the main
+// thread (so while R is busy they're only handled between R's event loop
+// ticks); methods which don't touch R, and which synchronize access to any
+// module state they share with the main thread, can instead execute on a
+// worker thread as soon as they arrive. worker thread methods don't trigger
+// onDetectChanges.
+enum RpcThreading
+{
+   RpcMainThread,
+   RpcWorkerThread
+};
+
 // register an async rpc method
 core::Error registerAsyncRpcMethod(
                               const std::string& name,
                               const core::json::JsonRpcAsyncFunction& function);
 
+core::Error registerAsyncRpcMethod(
+                              const std::string& name,
+                              const core::json::JsonRpcAsyncFunction& function,
+                              RpcThreading threading);
+
 // register an idle-only async rpc method
 core::Error registerIdleOnlyAsyncRpcMethod(
                               const std::string& name,
@@ -231,6 +248,10 @@ core::Error registerIdleOnlyAsyncRpcMethod(
 core::Error registerRpcMethod(const std::string& name,
                               const core::json::JsonRpcFunction& function);
 
+core::Error registerRpcMethod(const std::string& name,
+                              const core::json::JsonRpcFunction& function,
+                              RpcThreading threading);
+
 void registerRpcMethod(const core::json::JsonRpcAsyncMethod& method);
 
 core::Error executeAsync(const core::json::JsonRpcFunction& function,
@@ -66,6 +66,11 @@ public:
       return runTests_;
    }
 
+   std::string runTestsSpec() const
+   {
+      return runTestsSpec_;
+   }
+
    std::string runScript() const
    {
       return runScript_;
@@ -575,6 +580,11 @@ public:
       return quitChildProcessesOnExit_;
    }
 
+   bool traceEnabled() const
+   {
+      return traceEnabled_;
+   }
+
    std::string firstProjectTemplatePath() const
    {
       return firstProjectTemplatePath_;
@@ -654,6 +664,7 @@ private:
 private:
    // tests
    bool runTests_;
+   std::string runTestsSpec_;
    std::string runScript_;
    
    // verify
@@ -696,6 +707,7 @@ private:
    std::string defaultConsoleTerm_;
    bool defaultCliColorForce_;
    bool quitChildProcessesOnExit_;
+   bool traceEnabled_;
    std::string firstProjectTemplatePath_;
    std::string signingKey_;
    bool verifySignatures_;
@@ -16,6 +16,7 @@
 #ifndef SESSION_PROJECTS_PROJECTS_HPP
 #define SESSION_PROJECTS_PROJECTS_HPP
 
+#include <atomic>
 #include <vector>
 #include <map>
 
@@ -253,7 +254,8 @@ private:
    core::r_util::RPackageInfo packageInfo_;
    bool isNewProject_;
 
-   bool hasFileMonitor_;
+   // read by list_files on rpc worker threads
+   std::atomic<bool> hasFileMonitor_;
    std::vector<std::string> monitorSubscribers_;
    RSTUDIO_BOOST_SIGNAL<void(const tree<core::FileInfo>&)> onMonitoringEnabled_;
    RSTUDIO_BOOST_SIGNAL<void(const std::vector<core::system::FileChangeEvent>&)>
@@ -30,6 +30,7 @@
 #include <boost/regex.hpp>
 #include <boost/algorithm/string/predicate.hpp>
 #include <boost/algorithm/string/split.hpp>
+#include <boost/unordered_map.hpp>
 
 #include <shared_core/Error.hpp>
 #include <core/Exec.hpp>
@@ -37,6 +38,7 @@
 #include <core/FileSerializer.hpp>
 #include <shared_core/SafeConvert.hpp>
 #include <core/collection/Tree.hpp>
+#include <core/collection/TrigramIndex.hpp>
 
 #include <core/r_util/RSourceIndex.hpp>
 
@@ -134,6 +136,10 @@ bool isGlobalFunctionNamed(const r_util::RSourceItem& sourceItem,
           sourceItem.name() == name;
 }
 
+int scoreMatch(std::string const& suggestion,
+               std::string const& query,
+               bool isFile);
+
 // return if we are past max results
 template <typename T>
 bool enforceMaxResults(std::size_t maxResults,
@@ -155,6 +161,82 @@ bool enforceMaxResults(std::size_t maxResults,
 }
 
 
+// version of the on-disk source index snapshot (bump whenever the format
+// or the output of the source indexers changes)
+const int kSnapshotVersion = 1;
+
+json::Array sourceItemsToJson(const std::vector<r_util::RSourceItem>& items)
+{
+   json::Array itemsJson;
+   for (const r_util::RSourceItem& item : items)
+   {
+      json::Array signatureJson;
+      for (const r_util::RS4MethodParam& param : item.signature())
+      {
+         json::Array paramJson;
+         paramJson.push_back(param.name());
+         paramJson.push_back(param.type());
+         signatureJson.push_back(paramJson);
+      }
+
+      // items are written as arrays to keep the snapshot compact
+      json::Array itemJson;
+      itemJson.push_back(item.type());
+      itemJson.push_back(item.name());
+      itemJson.push_back(signatureJson);
+      itemJson.push_back(item.braceLevel());
+      itemJson.push_back(item.line());
+      itemJson.push_back(item.column());
+      itemsJson.push_back(itemJson);
+   }
+   return itemsJson;
+}
+
+bool sourceItemsFromJson(const json::Array& itemsJson,
+                         std::vector<r_util::RSourceItem>* pItems)
+{
+   for (const json::Value& itemValue : itemsJson)
+   {
+      if (!itemValue.isArray())
+         return false;
+
+      const json::Array& itemJson = itemValue.getArray();
+      if (itemJson.getSize() != 6 ||
+          !itemJson[0].isInt() || !itemJson[1].isString() ||
+          !itemJson[2].isArray() || !itemJson[3].isInt() ||
+          !itemJson[4].isInt() || !itemJson[5].isInt())
+      {
+         return false;
+      }
+
+      std::vector<r_util::RS4MethodParam> signature;
+      for (const json::Value& paramValue : itemJson[2].getArray())
+      {
+         if (!paramValue.isArray())
+            return false;
+
+         const json::Array& paramJson = paramValue.getArray();
+         if (paramJson.getSize() != 2 ||
+             !paramJson[0].isString() || !paramJson[1].isString())
+         {
+            return false;
+         }
+
+         signature.push_back(r_util::RS4MethodParam(paramJson[0].getString(),
+                                                    paramJson[1].getString()));
+      }
+
+      pItems->push_back(r_util::RSourceItem(itemJson[0].getInt(),
+                                            itemJson[1].getString(),
+                                            signature,
+                                            itemJson[3].getInt(),
+                                            itemJson[4].getInt(),
+                                            itemJson[5].getInt()));
+   }
+
+   return true;
+}
+
 // index entries we are managing
 struct Entry
 {
@@ -448,9 +530,14 @@ private:
 
 class SourceFileIndex : boost::noncopyable
 {
+   typedef core::collection::TrigramIndex TrigramIndex;
+
 public:
    SourceFileIndex()
-      : pEntries_(new EntryTree()), indexing_(false)
+      : pEntries_(new EntryTree()),
+        restoredCount_(0),
+        parsedCount_(0),
+        indexing_(false)
    {
    }
 
@@ -484,6 +571,14 @@ public:
          indexingQueue_.push(addEvent);
       }
 
+      // time how long it takes until all of the files are indexed
+      if (fullIndexStart_.is_not_a_date_time())
+      {
+         fullIndexStart_ = boost::posix_time::microsec_clock::universal_time();
+         restoredCount_ = 0;
+         parsedCount_ = 0;
+      }
+
       // schedule indexing if necessary. perform up to 200ms of work
       // immediately and then continue in periodic 20ms chunks until
       // we are completed.
@@ -523,30 +618,24 @@ public:
                            const std::set<std::string>& excludeContexts,
                            r_util::RSourceItem* pFunctionItem)
    {
-      std::vector<r_util::RSourceItem> sourceItems;
-      for (const Entry& entry : *pEntries_)
+      std::vector<TrigramIndex::Id> ids;
+      symbolNames_.findExact(functionName, &ids);
+      for (TrigramIndex::Id id : ids)
       {
-         // bail if there is no index
-         if (!entry.hasIndex())
-            continue;
+         const Symbol& symbol = symbols_[id];
 
          // bail if this is an exluded context
-         if (excludeContexts.find(entry.pIndex->context()) !=
+         if (excludeContexts.find(symbol.pIndex->context()) !=
              excludeContexts.end())
          {
             continue;
          }
 
-         // scan the next index
-         sourceItems.clear();
-         entry.pIndex->search(
-                  boost::bind(isGlobalFunctionNamed, _1, functionName),
-                  std::back_inserter(sourceItems));
-
          // return if we got a hit
-         if (sourceItems.size() > 0)
+         const r_util::RSourceItem& item = symbol.item();
+         if (isGlobalFunctionNamed(item, functionName))
          {
-            *pFunctionItem = sourceItems[0];
+            *pFunctionItem = item.withContext(symbol.pIndex->context());
             return true;
          }
       }
@@ -560,6 +649,40 @@ public:
                      bool prefixOnly,
                      const std::set<std::string>& excludeContexts,
                      std::vector<r_util::RSourceItem>* pItems)
+   {
+      // wildcard searches can't make use of the symbol index
+      if (term.find('*') != std::string::npos)
+      {
+         searchSourceLinear(term, maxResults, prefixOnly, excludeContexts, pItems);
+         return;
+      }
+
+      std::vector<TrigramIndex::Id> ids;
+      if (prefixOnly)
+         symbolNames_.findPrefix(term, &ids);
+      else
+         symbolNames_.findSubsequence(term, &ids);
+
+      // drop items from excluded contexts
+      ids.erase(std::remove_if(ids.begin(), ids.end(), [&](TrigramIndex::Id id) {
+         return excludeContexts.count(symbols_[id].pIndex->context()) > 0;
+      }), ids.end());
+
+      // keep the best scoring items if there are too many
+      selectTopMatches(symbolNames_, term, false, maxResults, &ids);
+
+      for (TrigramIndex::Id id : ids)
+      {
+         const Symbol& symbol = symbols_[id];
+         pItems->push_back(symbol.item().withContext(symbol.pIndex->context()));
+      }
+   }
+
+   void searchSourceLinear(const std::string& term,
+                           std::size_t maxResults,
+                           bool prefixOnly,
+                           const std::set<std::string>& excludeContexts,
+                           std::vector<r_util::RSourceItem>* pItems)
    {
       for (const Entry& entry : *pEntries_)
       {
@@ -604,6 +727,14 @@ public:
 
       // create wildcard pattern if the search has a '*'
       boost::regex pattern = regex_utils::regexIfWildcardPattern(term);
+
+      // search the file name index unless this is a wildcard search
+      if (pattern.empty())
+      {
+         searchFileNames(term, maxResults, prefixOnly, sourceFilesOnly, parentPath,
+                         pNames, pPaths, pMoreAvailable);
+         return;
+      }
       
       // get the start and end iterators -- default to all leaves
       EntryTree::leaf_iterator it = pEntries_->begin_leaf();
@@ -684,6 +815,48 @@ public:
       }
    }
    
+   template <typename T>
+   void searchFileNames(const std::string& term,
+                        std::size_t maxResults,
+                        bool prefixOnly,
+                        bool sourceFilesOnly,
+                        const FilePath& parentPath,
+                        T* pNames,
+                        T* pPaths,
+                        bool* pMoreAvailable)
+   {
+      // We allow the user to submit queries of the form e.g.
+      // <query>:<row><column>; make sure we only take items
+      // on the query up to ':'
+      std::string query = term;
+      if (!prefixOnly)
+         query = term.substr(0, term.find(":"));
+
+      std::vector<TrigramIndex::Id> ids;
+      if (prefixOnly)
+         fileNames_.findPrefix(query, &ids);
+      else
+         fileNames_.findSubsequence(query, &ids);
+
+      // restrict to files within the requested directory
+      std::string parentPrefix = parentPath.getAbsolutePath() + "/";
+      ids.erase(std::remove_if(ids.begin(), ids.end(), [&](TrigramIndex::Id id) {
+         const FileInfo& fileInfo = files_[id];
+         return !boost::algorithm::starts_with(fileInfo.absolutePath(), parentPrefix) ||
+                (sourceFilesOnly && !isSourceFile(fileInfo));
+      }), ids.end());
+
+      // keep the best scoring files if there are too many
+      *pMoreAvailable = selectTopMatches(fileNames_, query, true, maxResults, &ids);
+
+      for (TrigramIndex::Id id : ids)
+      {
+         FilePath filePath(files_[id].absolutePath());
+         pNames->push_back(filePath.getFilename());
+         pPaths->push_back(module_context::createAliasedPath(filePath));
+      }
+   }
+
    template <typename T>
    void searchFolders(const std::string& term,
                       const FilePath& parentPath,
@@ -791,11 +964,140 @@ public:
       }
    }
    
+   // Load the source indexes saved at the end of the previous session. Files
+   // whose size and modification time still match are restored from the
+   // snapshot rather than re-read and re-tokenized when they're indexed.
+   void loadSnapshot(const FilePath& snapshotPath)
+   {
+      using namespace safe_convert;
+
+      snapshot_.clear();
+      if (!snapshotPath.exists())
+         return;
+
+      boost::posix_time::ptime start = boost::posix_time::microsec_clock::universal_time();
+
+      std::string contents;
+      Error error = readStringFromFile(snapshotPath, &contents);
+      if (error)
+      {
+         LOG_ERROR(error);
+         return;
+      }
+
+      json::Value snapshotValue;
+      if (snapshotValue.parse(contents) || !snapshotValue.isObject())
+      {
+         LOG_ERROR_MESSAGE("Error parsing source index snapshot: " +
+                           snapshotPath.getAbsolutePath());
+         return;
+      }
+
+      int version;
+      std::string encoding;
+      json::Array filesJson;
+      error = json::readObject(snapshotValue.getObject(),
+                               "version", version,
+                               "encoding", encoding,
+                               "files", filesJson);
+      if (error)
+      {
+         LOG_ERROR(error);
+         return;
+      }
+
+      // discard snapshots written by other versions or with a different
+      // encoding (which may have changed the decoded source)
+      if (version != kSnapshotVersion ||
+          encoding != projects::projectContext().defaultEncoding())
+      {
+         return;
+      }
+
+      for (const json::Value& fileValue : filesJson)
+      {
+         if (!fileValue.isObject())
+            continue;
+
+         std::string path;
+         double size, lastWriteTime;
+         json::Array packagesJson, itemsJson;
+         Error error = json::readObject(fileValue.getObject(),
+                                        "path", path,
+                                        "size", size,
+                                        "last_write", lastWriteTime,
+                                        "packages", packagesJson,
+                                        "items", itemsJson);
+         if (error)
+         {
+            LOG_ERROR(error);
+            continue;
+         }
+
+         SnapshotEntry entry;
+         entry.size = numberTo<double, uintmax_t>(size, 0);
+         entry.lastWriteTime = numberTo<double, std::time_t>(lastWriteTime, 0);
+         if (!packagesJson.toVectorString(entry.packages) ||
+             !sourceItemsFromJson(itemsJson, &entry.items))
+         {
+            LOG_ERROR_MESSAGE("Invalid source index snapshot entry for " + path);
+            continue;
+         }
+
+         snapshot_[path] = entry;
+      }
+
+      LOG_DEBUG_MESSAGE(
+         "Loaded source index snapshot of " + std::to_string(snapshot_.size()) +
+         " files in " + std::to_string(
+            (boost::posix_time::microsec_clock::universal_time() - start).total_milliseconds()) +
+         "ms");
+   }
+
+   void saveSnapshot(const FilePath& snapshotPath) const
+   {
+      using namespace safe_convert;
+
+      json::Array filesJson;
+      for (const Entry& entry : *pEntries_)
+      {
+         if (!entry.hasIndex())
+            continue;
+
+         json::Object fileJson;
+         fileJson["path"] = entry.fileInfo.absolutePath();
+         fileJson["size"] = numberTo<uintmax_t, double>(entry.fileInfo.size(), 0);
+         fileJson["last_write"] = numberTo<std::time_t, double>(
+                                       entry.fileInfo.lastWriteTime(), 0);
+         fileJson["packages"] = json::toJsonArray(entry.pIndex->getInferredPackages());
+         fileJson["items"] = sourceItemsToJson(entry.pIndex->items());
+         filesJson.push_back(fileJson);
+      }
+
+      json::Object snapshotJson;
+      snapshotJson["version"] = kSnapshotVersion;
+      snapshotJson["encoding"] = projects::projectContext().defaultEncoding();
+      snapshotJson["files"] = filesJson;
+
+      Error error = writeStringToFile(snapshotPath, snapshotJson.write());
+      if (error)
+         LOG_ERROR(error);
+   }
+
    void clear()
    {
       indexing_ = false;
       indexingQueue_ = std::queue<core::system::FileChangeEvent>();
       pEntries_->clear();
+      snapshot_.clear();
+      fullIndexStart_ = boost::posix_time::ptime();
+
+      fileNames_.clear();
+      files_.clear();
+      fileIds_.clear();
+      symbolNames_.clear();
+      symbols_.clear();
+      fileSymbols_.clear();
    }
 
 private:
@@ -834,6 +1136,19 @@ private:
 
       // return status
       indexing_ = !indexingQueue_.empty();
+      if (!indexing_ && !fullIndexStart_.is_not_a_date_time())
+      {
+         boost::posix_time::time_duration elapsed =
+               boost::posix_time::microsec_clock::universal_time() - fullIndexStart_;
+         LOG_DEBUG_MESSAGE(
+            "Indexed project R sources in " + std::to_string(elapsed.total_milliseconds()) +
+            "ms (" + std::to_string(restoredCount_) + " restored from snapshot, " +
+            std::to_string(parsedCount_) + " parsed)");
+         fullIndexStart_ = boost::posix_time::ptime();
+
+         // anything left in the snapshot is for files which no longer exist
+         snapshot_.clear();
+      }
       return indexing_;
    }
 
@@ -851,33 +1166,52 @@ private:
 
       if (isIndexableSourceFile(fileInfo))
       {
-         std::string code;
-         Error error = module_context::readAndDecodeFile(
-                                 filePath,
-                                 projects::projectContext().defaultEncoding(),
-                                 true,
-                                 &code);
-         if (error)
+         // use the index from the previous session if the file is unchanged
+         std::string context = module_context::createAliasedPath(filePath);
+         pIndex = restoreFromSnapshot(fileInfo, context);
+         if (pIndex)
          {
-            // log if not path not found error (this can happen if the
-            // file was removed after entering the indexing queue)
-            if (!core::isPathNotFoundError(error))
+            ++restoredCount_;
+         }
+         else
+         {
+            std::string code;
+            Error error = module_context::readAndDecodeFile(
+                                    filePath,
+                                    projects::projectContext().defaultEncoding(),
+                                    true,
+                                    &code);
+            if (error)
             {
-               error.addProperty("src-file", filePath.getAbsolutePath());
-               LOG_ERROR(error);
+               // log if not path not found error (this can happen if the
+               // file was removed after entering the indexing queue)
+               if (!core::isPathNotFoundError(error))
+               {
+                  error.addProperty("src-file", filePath.getAbsolutePath());
+                  LOG_ERROR(error);
+               }
+               return;
             }
-            return;
-         }
 
-         // add index entry
-         std::string context = module_context::createAliasedPath(filePath);
-         pIndex.reset(new r_util::RSourceIndex(context, code));
+            // add index entry
+            pIndex.reset(new r_util::RSourceIndex(context, code));
+            ++parsedCount_;
+         }
       }
 
       // attempt to add the entry
       Entry entry(fileInfo, pIndex);
       pEntries_->insertEntry(entry);
 
+      // update the name indexes
+      if (!fileInfo.isDirectory())
+      {
+         addFileName(fileInfo);
+         removeSymbols(fileInfo.absolutePath());
+         if (pIndex)
+            addSymbols(fileInfo.absolutePath(), pIndex);
+      }
+
       // kick off an update
       r_packages::AsyncPackageInformationProcess::update();
    }
@@ -895,6 +1229,129 @@ private:
          DEBUG("Failed to remove index entry for file: '" << fileInfo.getAbsolutePath() << "'");
          print_tree(*pEntries_);
       }
+
+      // update the name indexes (removing a directory removes everything
+      // beneath it from the tree as well)
+      if (fileInfo.isDirectory())
+      {
+         std::string prefix = fileInfo.absolutePath() + "/";
+         std::vector<std::string> removed;
+         for (const auto& file : fileIds_)
+         {
+            if (boost::algorithm::starts_with(file.first, prefix))
+               removed.push_back(file.first);
+         }
+
+         for (const std::string& path : removed)
+            removeFileName(path);
+      }
+      else
+      {
+         removeFileName(fileInfo.absolutePath());
+      }
+   }
+
+   void addFileName(const FileInfo& fileInfo)
+   {
+      if (fileIds_.count(fileInfo.absolutePath()))
+         return;
+
+      FilePath filePath(fileInfo.absolutePath());
+      TrigramIndex::Id id = fileNames_.insert(filePath.getFilename());
+      if (id >= files_.size())
+         files_.resize(id + 1);
+      files_[id] = fileInfo;
+      fileIds_[fileInfo.absolutePath()] = id;
+   }
+
+   void removeFileName(const std::string& path)
+   {
+      auto it = fileIds_.find(path);
+      if (it != fileIds_.end())
+      {
+         fileNames_.remove(it->second);
+         files_[it->second] = FileInfo();
+         fileIds_.erase(it);
+      }
+
+      removeSymbols(path);
+   }
+
+   void addSymbols(const std::string& path,
+                   const boost::shared_ptr<r_util::RSourceIndex>& pIndex)
+   {
+      std::vector<TrigramIndex::Id>& ids = fileSymbols_[path];
+      const std::vector<r_util::RSourceItem>& items = pIndex->items();
+      for (std::size_t i = 0; i < items.size(); ++i)
+      {
+         TrigramIndex::Id id = symbolNames_.insert(items[i].name());
+         if (id >= symbols_.size())
+            symbols_.resize(id + 1);
+         symbols_[id] = Symbol(pIndex, i);
+         ids.push_back(id);
+      }
+   }
+
+   void removeSymbols(const std::string& path)
+   {
+      auto it = fileSymbols_.find(path);
+      if (it == fileSymbols_.end())
+         return;
+
+      for (TrigramIndex::Id id : it->second)
+      {
+         symbolNames_.remove(id);
+         symbols_[id] = Symbol();
+      }
+      fileSymbols_.erase(it);
+   }
+
+   // reduce the matches to the best scoring maxResults (ordered by score);
+   // returns whether any matches were dropped
+   static bool selectTopMatches(const TrigramIndex& index,
+                                const std::string& query,
+                                bool isFile,
+                                std::size_t maxResults,
+                                std::vector<TrigramIndex::Id>* pIds)
+   {
+      if (pIds->size() <= maxResults)
+         return false;
+
+      std::vector<std::pair<int, TrigramIndex::Id> > scored;
+      scored.reserve(pIds->size());
+      for (TrigramIndex::Id id : *pIds)
+         scored.push_back(std::make_pair(scoreMatch(index.name(id), query, isFile), id));
+
+      std::partial_sort(scored.begin(), scored.begin() + maxResults, scored.end());
+
+      pIds->clear();
+      for (std::size_t i = 0; i < maxResults; ++i)
+         pIds->push_back(scored[i].second);
+
+      return true;
+   }
+
+   boost::shared_ptr<r_util::RSourceIndex> restoreFromSnapshot(
+         const FileInfo& fileInfo,
+         const std::string& context)
+   {
+      boost::shared_ptr<r_util::RSourceIndex> pIndex;
+
+      // entries are only ever used once; later changes to the file
+      // always need to be re-indexed
+      auto it = snapshot_.find(fileInfo.absolutePath());
+      if (it == snapshot_.end())
+         return pIndex;
+
+      const SnapshotEntry& entry = it->second;
+      if (entry.size == fileInfo.size() &&
+          entry.lastWriteTime == fileInfo.lastWriteTime())
+      {
+         pIndex.reset(new r_util::RSourceIndex(context, entry.items, entry.packages));
+      }
+
+      snapshot_.erase(it);
+      return pIndex;
    }
 
    static bool isSourceFile(const FileInfo& fileInfo)
@@ -954,9 +1411,51 @@ private:
    }
    
 private:
+   // a source item within one of the indexed files
+   struct Symbol
+   {
+      Symbol() : itemIndex(0) {}
+      Symbol(const boost::shared_ptr<r_util::RSourceIndex>& pIndex, std::size_t itemIndex)
+         : pIndex(pIndex), itemIndex(itemIndex)
+      {
+      }
+
+      const r_util::RSourceItem& item() const { return pIndex->items()[itemIndex]; }
+
+      boost::shared_ptr<r_util::RSourceIndex> pIndex;
+      std::size_t itemIndex;
+   };
+
    // index entries
    boost::shared_ptr<EntryTree> pEntries_;
 
+   // source indexes saved by the previous session (by path)
+   struct SnapshotEntry
+   {
+      SnapshotEntry() : size(0), lastWriteTime(0) {}
+
+      uintmax_t size;
+      std::time_t lastWriteTime;
+      std::vector<std::string> packages;
+      std::vector<r_util::RSourceItem> items;
+   };
+   boost::unordered_map<std::string, SnapshotEntry> snapshot_;
+
+   // time-to-full-index bookkeeping
+   boost::posix_time::ptime fullIndexStart_;
+   std::size_t restoredCount_;
+   std::size_t parsedCount_;
+
+   // file names (by id) and the ids of indexed paths
+   TrigramIndex fileNames_;
+   std::vector<FileInfo> files_;
+   boost::unordered_map<std::string, TrigramIndex::Id> fileIds_;
+
+   // source item names (by id) and the ids of each file's items
+   TrigramIndex symbolNames_;
+   std::vector<Symbol> symbols_;
+   boost::unordered_map<std::string, std::vector<TrigramIndex::Id> > fileSymbols_;
+
    // indexing queue
    bool indexing_;
    std::queue<core::system::FileChangeEvent> indexingQueue_;
@@ -2311,8 +2810,15 @@ Error findFunctionInSearchPath(const json::JsonRpcRequest& request,
    return Success();
 }
 
+FilePath snapshotFilePath()
+{
+   return projects::projectContext().scratchPath().completeChildPath(
+                                                      "source-index-snapshot");
+}
+
 void onFileMonitorEnabled(const tree<core::FileInfo>& files)
 {
+   projectIndex().loadSnapshot(snapshotFilePath());
    projectIndex().enqueFiles(files.begin_leaf(), files.end_leaf());
 }
 
@@ -2324,6 +2830,12 @@ void onFilesChanged(const std::vector<core::system::FileChangeEvent>& events)
          boost::bind(&SourceFileIndex::enqueFileChange, &projectIndex(), _1));
 }
 
+void onShutdown(bool terminatedNormally)
+{
+   if (terminatedNormally && projects::projectContext().hasFileMonitor())
+      projectIndex().saveSnapshot(snapshotFilePath());
+}
+
 void onFileMonitorDisabled()
 {
    // clear the index so we don't ever get stale results
@@ -2466,6 +2978,7 @@ Error initialize()
    cb.onMonitoringDisabled = onFileMonitorDisabled;
    projects::projectContext().subscribeToFileMonitor("R source file indexing",
                                                      cb);
+   module_context::events().onShutdown.connect(onShutdown);
 
    // register .Call methods
    RS_REGISTER_CALL_METHOD(rs_viewFunction);
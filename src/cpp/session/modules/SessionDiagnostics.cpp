@@ -24,6 +24,7 @@
 #include "SessionAsyncPackageInformation.hpp"
 #include "SessionRParser.hpp"
 
+#include <map>
 #include <set>
 
 #include <core/Debug.hpp>
@@ -49,6 +50,7 @@
 #include <r/RRoutines.hpp>
 #include <r/RUtil.hpp>
 
+#include <core/r_util/RExpressionChunks.hpp>
 #include <core/r_util/RSourceIndex.hpp>
 #include <core/FileSerializer.hpp>
 #include <core/text/CsvParser.hpp>
@@ -630,14 +632,9 @@ void setFileLocalParseOptions(const std::wstring& rCode,
    applyOptions(options, pOptions);
 }
 
-} // end anonymous namespace
 
-ParseResults parse(const std::wstring& rCode,
-                   const FilePath& origin,
-                   const std::string& documentId = std::string(),
-                   bool isExplicit = false)
+ParseOptions parseOptionsFromPrefs(bool isExplicit)
 {
-   ParseResults results;
    ParseOptions options;
    
    options.setLintRFunctions(
@@ -658,6 +655,19 @@ ParseResults parse(const std::wstring& rCode,
    options.setRecordStyleLint(
             prefs::userPrefs().styleDiagnostics());
    
+   return options;
+}
+
+} // end anonymous namespace
+
+ParseResults parse(const std::wstring& rCode,
+                   const FilePath& origin,
+                   const std::string& documentId = std::string(),
+                   bool isExplicit = false)
+{
+   ParseResults results;
+   ParseOptions options = parseOptionsFromPrefs(isExplicit);
+   
    bool noLint = false;
    setFileLocalParseOptions(rCode, &options, &noLint);
    if (noLint)
@@ -767,6 +777,210 @@ module_context::SourceMarkerSet asSourceMarkerSet(
    return SourceMarkerSet("Diagnostics", markers);
 }
 
+// Lint for documents open in the editor is computed incrementally: the
+// document is split into chunks of complete top-level expressions, and only
+// chunks which are new or edited since the document was last linted are
+// parsed again. Since calls are checked against the functions defined
+// earlier in the document, each chunk is parsed after the earlier chunks
+// defining any functions it calls, and its lint is also recomputed if that
+// set of chunks changes.
+class IncrementalLinter : boost::noncopyable
+{
+public:
+   IncrementalLinter()
+      : nextId_(0)
+   {
+   }
+
+   LintItems lint(const std::wstring& rCode,
+                  const FilePath& origin,
+                  const ParseOptions& options)
+   {
+      std::string key = optionsKey(origin, options);
+      if (key != key_)
+      {
+         chunks_.clear();
+         lint_.clear();
+         key_ = key;
+      }
+
+      std::vector<ChunkLint> previous;
+      previous.swap(lint_);
+      chunks_.update(rCode);
+
+      const std::vector<RExpressionChunks::Chunk>& chunks = chunks_.chunks();
+      std::map<std::wstring, std::vector<std::size_t>> definitions;
+      LintItems lint;
+
+      for (std::size_t i = 0; i < chunks.size(); ++i)
+      {
+         const RExpressionChunks::Chunk& chunk = chunks[i];
+
+         std::set<std::size_t> prelude;
+         for (const std::wstring& name : chunk.calls)
+         {
+            auto it = definitions.find(name);
+            if (it != definitions.end())
+               prelude.insert(it->second.begin(), it->second.end());
+         }
+
+         std::vector<std::size_t> preludeIds;
+         for (std::size_t index : prelude)
+            preludeIds.push_back(lint_[index].id);
+
+         if (chunk.previous != RExpressionChunks::kNewChunk &&
+             previous[chunk.previous].prelude == preludeIds)
+         {
+            lint_.push_back(std::move(previous[chunk.previous]));
+         }
+         else
+         {
+            std::size_t id = chunk.previous != RExpressionChunks::kNewChunk ?
+                     previous[chunk.previous].id :
+                     nextId_++;
+            lint_.push_back(lintChunk(i, prelude, preludeIds, id, origin, options));
+         }
+
+         // a chunk which failed to parse doesn't make a usable prelude
+         if (!lint_.back().hasErrors)
+         {
+            for (const std::wstring& name : chunk.definitions)
+               definitions[name].push_back(i);
+         }
+
+         for (const LintItem& item : lint_.back().lint)
+         {
+            LintItem shifted(item);
+            shifted.startRow += gsl::narrow_cast<int>(chunk.row);
+            shifted.endRow += gsl::narrow_cast<int>(chunk.row);
+            lint.push_back(shifted);
+         }
+      }
+
+      return lint;
+   }
+
+private:
+   struct ChunkLint
+   {
+      std::size_t id;                    // kept while the chunk's text is unchanged
+      std::vector<std::size_t> prelude;  // ids of the chunks parsed before it
+      std::vector<LintItem> lint;        // rows relative to the chunk
+      bool hasErrors;
+   };
+
+   ChunkLint lintChunk(std::size_t index,
+                       const std::set<std::size_t>& prelude,
+                       const std::vector<std::size_t>& preludeIds,
+                       std::size_t id,
+                       const FilePath& origin,
+                       const ParseOptions& options)
+   {
+      const std::vector<RExpressionChunks::Chunk>& chunks = chunks_.chunks();
+
+      // chunks always span whole lines, so the prelude ends with a newline
+      std::wstring code;
+      std::size_t preludeRows = 0;
+      for (std::size_t i : prelude)
+      {
+         std::wstring text = chunks_.chunkText(chunks[i]);
+         preludeRows += std::count(text.begin(), text.end(), L'\n');
+         code += text;
+      }
+      code += chunks_.chunkText(chunks[index]);
+
+      ChunkLint result;
+      result.id = id;
+      result.prelude = preludeIds;
+      result.hasErrors = false;
+
+      ParseResults results = rparser::parse(origin, code, options);
+      for (const LintItem& item : results.lint())
+      {
+         if (item.startRow < static_cast<int>(preludeRows))
+            continue;
+
+         LintItem shifted(item);
+         shifted.startRow -= gsl::narrow_cast<int>(preludeRows);
+         shifted.endRow -= gsl::narrow_cast<int>(preludeRows);
+         result.lint.push_back(shifted);
+         result.hasErrors = result.hasErrors || item.type == LintTypeError;
+      }
+
+      return result;
+   }
+
+   static std::string optionsKey(const FilePath& origin, const ParseOptions& options)
+   {
+      std::string key = origin.getAbsolutePath();
+      key += options.lintRFunctions() ? "|1" : "|0";
+      key += options.checkArgumentsToRFunctionCalls() ? "1" : "0";
+      key += options.checkUnexpectedAssignmentInFunctionCall() ? "1" : "0";
+      key += options.recordStyleLint() ? "1" : "0";
+      for (const std::string& global : options.globals())
+         key += "|" + global;
+      return key;
+   }
+
+   RExpressionChunks chunks_;
+   std::vector<ChunkLint> lint_;
+   std::string key_;
+   std::size_t nextId_;
+};
+
+std::map<std::string, boost::shared_ptr<IncrementalLinter>>& incrementalLinters()
+{
+   static std::map<std::string, boost::shared_ptr<IncrementalLinter>> instance;
+   return instance;
+}
+
+LintItems lintDocument(const std::wstring& rCode,
+                       const FilePath& origin,
+                       const std::string& documentId,
+                       bool isExplicit)
+{
+   ParseOptions options = parseOptionsFromPrefs(isExplicit);
+   bool noLint = false;
+   setFileLocalParseOptions(rCode, &options, &noLint);
+   if (noLint)
+   {
+      incrementalLinters().erase(documentId);
+      return LintItems();
+   }
+
+   // explicit requests, and diagnostics which need the whole document,
+   // use a full parse
+   if (isExplicit ||
+       options.warnIfNoSuchVariableInScope() ||
+       options.warnIfVariableIsDefinedButNotUsed())
+   {
+      incrementalLinters().erase(documentId);
+      return diagnostics::parse(rCode, origin, documentId, isExplicit).lint();
+   }
+
+   boost::shared_ptr<IncrementalLinter>& pLinter = incrementalLinters()[documentId];
+   if (!pLinter)
+      pLinter.reset(new IncrementalLinter());
+   return pLinter->lint(rCode, origin, options);
+}
+
+void onDocRemoved(const std::string& id, const std::string& /* path */)
+{
+   incrementalLinters().erase(id);
+}
+
+void onRemoveAll()
+{
+   incrementalLinters().clear();
+}
+
+void onConsoleInput(const std::string& /* input */)
+{
+   // code run in the console may define or attach the functions whose
+   // calls we check, so cached lint can no longer be trusted
+   incrementalLinters().clear();
+}
+
 Error lintRSourceDocument(const json::JsonRpcRequest& request,
                           json::JsonRpcResponse* pResponse)
 {
@@ -813,18 +1027,18 @@ Error lintRSourceDocument(const json::JsonRpcRequest& request,
    if (error)
       return error;
    
-   ParseResults results = diagnostics::parse(
+   LintItems lint = lintDocument(
             string_utils::utf8ToWide(content),
             origin,
             documentId,
             isExplicit);
    
-   pResponse->setResult(lintAsJson(results.lint()));
+   pResponse->setResult(lintAsJson(lint));
    
    if (showMarkersTab)
    {
       using namespace module_context;
-      SourceMarkerSet markers = asSourceMarkerSet(results.lint(),
+      SourceMarkerSet markers = asSourceMarkerSet(lint,
                                                   core::FilePath(pDoc->path()));
       showSourceMarkers(markers, MarkerAutoSelectNone);
    }
@@ -1030,6 +1244,9 @@ core::Error initialize()
    using namespace module_context;
    
    events().afterSessionInitHook.connect(afterSessionInitHook);
+   events().onConsoleInput.connect(onConsoleInput);
+   source_database::events().onDocRemoved.connect(onDocRemoved);
+   source_database::events().onRemoveAll.connect(onRemoveAll);
    
    session::projects::FileMonitorCallbacks cb;
    cb.onFilesChanged = onFilesChanged;
@@ -16,6 +16,7 @@
 
 #include "SessionFiles.hpp"
 
+#include <atomic>
 #include <csignal>
 
 #include <vector>
@@ -34,6 +35,7 @@
 #include <core/FileInfo.hpp>
 #include <core/FileUtils.hpp>
 #include <core/Settings.hpp>
+#include <core/Thread.hpp>
 #include <core/Exec.hpp>
 #include <core/DateTime.hpp>
 
@@ -46,6 +48,7 @@
 #include <core/system/ShellUtils.hpp>
 #include <core/system/Process.hpp>
 #include <core/system/RecycleBin.hpp>
+#include <core/zlib/Zip.hpp>
 
 #include <r/RSexp.hpp>
 #include <r/RExec.hpp>
@@ -56,6 +59,7 @@
 #include <session/SessionModuleContext.hpp>
 #include <session/SessionOptions.hpp>
 #include <session/SessionSourceDatabase.hpp>
+#include <session/jobs/JobsApi.hpp>
 
 #include <session/projects/SessionProjects.hpp>
 
@@ -223,6 +227,10 @@ core::Error getFileContents(const json::JsonRpcRequest& request,
    return Success();
 }
    
+// executes on a worker thread (so that the files pane stays responsive while
+// R is busy) and so mustn't touch R. the state it shares with the main thread
+// (the listing monitor, the project's file monitor and the vcs status) is
+// synchronized
 Error listFiles(const json::JsonRpcRequest& request, json::JsonRpcResponse* pResponse)
 {
    // get args
@@ -571,15 +579,117 @@ Error writeTmpData(const FilePath& tmpFile,
    return Success();
 }
 
-Error completeUpload(const core::json::JsonRpcRequest& request,
-                     json::JsonRpcResponse* pResponse)
+// metadata which macOS adds to archives (not extracted)
+bool isMacOSXMetadata(const std::string& entryName)
 {
+   return boost::starts_with(entryName, "__MACOSX/");
+}
+
+// a zip upload being extracted in the background
+struct UnzipState : boost::noncopyable
+{
+   UnzipState() : extracted(0), total(0), finished(false) {}
+
+   std::atomic<uint64_t> extracted;
+   std::atomic<uint64_t> total;
+
+   boost::mutex mutex;
+   bool finished;
+   Error error;
+};
+
+// note: this function is invoked on a background thread, so no R methods
+// may be invoked within it
+void extractUploadedZip(boost::shared_ptr<UnzipState> pState,
+                        const FilePath& zipFile,
+                        const FilePath& destDir)
+{
+   zlib::ZipReader reader;
+   Error error = reader.open(zipFile);
+   if (!error)
+   {
+      pState->total = reader.uncompressedSize();
+      for (const zlib::ZipEntry& entry : reader.entries())
+      {
+         if (isMacOSXMetadata(entry.name))
+            continue;
+
+         FilePath targetPath;
+         error = zlib::zipEntryPath(destDir, entry.name, &targetPath);
+         if (error)
+            break;
+         if (targetPath.isEmpty())
+            continue;
+
+         error = reader.extract(entry, targetPath, [=](uint64_t bytes)
+         {
+            pState->extracted += bytes;
+            return true;
+         });
+         if (error)
+            break;
+      }
+   }
+
+   // remove the uploaded temp file
+   Error removeError = zipFile.removeIfExists();
+   if (removeError)
+      LOG_ERROR(removeError);
+
+   LOCK_MUTEX(pState->mutex)
+   {
+      pState->error = error;
+      pState->finished = true;
+   }
+   END_LOCK_MUTEX
+}
+
+// reports the progress of an extraction as a job (on the main thread) and
+// completes the rpc once it's done
+bool checkUnzipProgress(boost::shared_ptr<UnzipState> pState,
+                        boost::shared_ptr<jobs::Job> pJob,
+                        const json::JsonRpcFunctionContinuation& cont)
+{
+   bool finished = false;
+   Error error;
+   LOCK_MUTEX(pState->mutex)
+   {
+      finished = pState->finished;
+      error = pState->error;
+   }
+   END_LOCK_MUTEX
+
+   uint64_t total = pState->total;
+   if (total > 0)
+      jobs::setJobProgress(pJob, static_cast<int>(pState->extracted * 100 / total));
+
+   if (!finished)
+      return true;
+
+   jobs::setJobState(pJob, error ? jobs::JobFailed : jobs::JobSucceeded);
+
+   // check quota after uploads
+   quotas::checkQuotaStatus();
+
+   json::JsonRpcResponse response;
+   cont(error, &response);
+   return false;
+}
+
+void completeUpload(const core::json::JsonRpcRequest& request,
+                    const json::JsonRpcFunctionContinuation& cont)
+{
+   json::JsonRpcResponse response;
+
    // read params
    json::Object token;
    bool commit ;
    Error error = json::readParams(request.params, &token, &commit);
    if (error)
-      return error ;
+   {
+      cont(error, &response);
+      return;
+   }
    
    // parse fields out of token object
    std::string filename, uploadedTempFile, targetDirectory;
@@ -588,7 +698,10 @@ Error completeUpload(const core::json::JsonRpcRequest& request,
                             kUploadedTempFile, uploadedTempFile,
                             kUploadTargetDirectory, targetDirectory);
    if (error)
-      return error;
+   {
+      cont(error, &response);
+      return;
+   }
    
    // get path to temp file
    FilePath uploadedTempFilePath(uploadedTempFile);
@@ -600,31 +713,40 @@ Error completeUpload(const core::json::JsonRpcRequest& request,
 
       if (boost::ends_with(filename, "zip"))
       {
-         // expand the archive
-         r::exec::RFunction unzip("unzip");
-         unzip.addParam("zipfile", uploadedTempFilePath.getAbsolutePath());
-         unzip.addParam("exdir", targetDirectoryPath.getAbsolutePath());
-         Error unzipError = unzip.call();
-         if (unzipError)
+         // expand the archive in the background (large archives take a
+         // while), reporting its progress as a job
+         boost::shared_ptr<UnzipState> pState(new UnzipState());
+         boost::thread extractThread;
+         core::thread::safeLaunchThread(boost::bind(extractUploadedZip,
+                                                    pState,
+                                                    uploadedTempFilePath,
+                                                    targetDirectoryPath),
+                                        &extractThread);
+
+         if (!extractThread.joinable())
          {
-            error = uploadedTempFilePath.remove();
+            Error error = uploadedTempFilePath.removeIfExists();
             if (error)
                LOG_ERROR(error);
 
-            return unzipError;
+            cont(systemError(boost::system::errc::resource_unavailable_try_again,
+                             "Unable to start extracting " + filename,
+                             ERROR_LOCATION),
+                 &response);
+            return;
          }
-         
-         // remove the __MACOSX folder if it exists
-         const std::string kMacOSXFolder("__MACOSX");
-         FilePath macOSXPath = targetDirectoryPath.completePath(kMacOSXFolder);
-         Error removeError = macOSXPath.removeIfExists();
-         if (removeError)
-            LOG_ERROR(removeError);
-
-         // remove the uploaded temp file
-         error = uploadedTempFilePath.removeIfExists();
-         if (error)
-            LOG_ERROR(error);
+         extractThread.detach();
+
+         boost::shared_ptr<jobs::Job> pJob = jobs::addJob(
+                  "Extracting " + filename, "", "", 100, jobs::JobRunning,
+                  jobs::JobTypeSession, true, R_NilValue, false, {});
+
+         module_context::schedulePeriodicWork(
+                  boost::posix_time::milliseconds(100),
+                  boost::bind(checkUnzipProgress, pState, pJob, cont),
+                  false,
+                  false);
+         return;
       }
       else
       {
@@ -635,12 +757,15 @@ Error completeUpload(const core::json::JsonRpcRequest& request,
          // if the move cannot be completed
          Error copyError = uploadedTempFilePath.move(targetPath, FilePath::MoveCrossDevice, true);
          if (copyError)
-            return copyError;
+         {
+            cont(copyError, &response);
+            return;
+         }
       }
       
       // check quota after uploads
       quotas::checkQuotaStatus();
-      return Success();
+      cont(Success(), &response);
    }
    else
    {
@@ -649,7 +774,7 @@ Error completeUpload(const core::json::JsonRpcRequest& request,
       if (error)
          LOG_ERROR(error);
       
-      return Success();
+      cont(Success(), &response);
    }
 }
    
@@ -658,38 +783,27 @@ Error detectZipFileOverwrites(const FilePath& uploadedZipFile,
                               const FilePath& destDir,
                               json::Array* pOverwritesJson)
 {
-   // query for all of the paths in the zip file
-   core::system::ProcessResult result;
-   Error error = core::system::runCommand("unzip -Z1 " + uploadedZipFile.getAbsolutePath(),
-                                          core::system::ProcessOptions(),
-                                          &result);
+   // read all of the paths in the zip file
+   zlib::ZipReader reader;
+   Error error = reader.open(uploadedZipFile);
    if (error)
       return error;
 
-   if (result.exitStatus == 0)
+   // check for overwrites
+   for (const zlib::ZipEntry& entry : reader.entries())
    {
-      std::vector<std::string> zipFileListing;
-      boost::split(zipFileListing, result.stdOut, boost::is_any_of("\n"));
-
-      // check for overwrites
-      for (std::vector<std::string>::const_iterator
-           it = zipFileListing.begin();
-           it != zipFileListing.end();
-           ++it)
-      {
-         // don't count empty lines
-         if ((*it).empty()) continue;
+      if (isMacOSXMetadata(entry.name))
+         continue;
 
-         FilePath filePath = destDir.completePath(*it);
-         if (filePath.exists())
-            pOverwritesJson->push_back(module_context::createFileSystemItem(filePath));
-      }
-   }
-   else
-   {
-      return systemError(result.exitStatus,
-                         "Unexpected result for unzip command",
-                         ERROR_LOCATION);
+      // refuse archives with entries which would be extracted outside of
+      // the destination directory
+      FilePath filePath;
+      error = zlib::zipEntryPath(destDir, entry.name, &filePath);
+      if (error)
+         return error;
+
+      if (!filePath.isEmpty() && filePath.exists())
+         pOverwritesJson->push_back(module_context::createFileSystemItem(filePath));
    }
    
    return Success();
@@ -1082,10 +1196,9 @@ bool handleFileUploadRequestAsync(const http::Request& request,
    return true;
 }
    
-void setAttachmentResponse(const http::Request& request,
-                           const std::string& filename,
-                           const FilePath& attachmentPath,
-                           http::Response* pResponse)
+void setAttachmentHeaders(const http::Request& request,
+                          const std::string& filename,
+                          http::Response* pResponse)
 {
    if (request.headerValue("User-Agent").find("MSIE") == std::string::npos)
    {
@@ -1105,8 +1218,63 @@ void setAttachmentResponse(const http::Request& request,
    pResponse->setHeader("Content-Disposition",
                         "attachment; filename*=UTF-8''"
                            + http::util::urlEncode(filename, false));
+}
+
+void setAttachmentResponse(const http::Request& request,
+                           const std::string& filename,
+                           const FilePath& attachmentPath,
+                           http::Response* pResponse)
+{
+   setAttachmentHeaders(request, filename, pResponse);
    pResponse->setStreamFile(attachmentPath, request);
 }
+
+// streams a zip archive of files as it's written (note that buffers are
+// requested from the connection's thread rather than the main thread)
+class ZipStreamResponse : public http::StreamResponse
+{
+public:
+   ZipStreamResponse(const FilePath& parentPath,
+                     const std::vector<std::string>& files)
+      : writer_(parentPath, files)
+   {
+   }
+
+   Error initialize()
+   {
+      return Success();
+   }
+
+   std::shared_ptr<http::StreamBuffer> nextBuffer()
+   {
+      std::string data;
+      Error error = writer_.read(kBufferSize, &data);
+      if (error)
+      {
+         // the response is already underway, so end it without completing
+         // it (see streamError) rather than serving a truncated archive
+         error_ = error;
+         return std::shared_ptr<http::StreamBuffer>();
+      }
+
+      if (data.empty())
+         return std::shared_ptr<http::StreamBuffer>();
+
+      char* buffer = new char[data.size()];
+      std::copy(data.begin(), data.end(), buffer);
+      return std::make_shared<http::StreamBuffer>(buffer, data.size());
+   }
+
+   Error streamError() const
+   {
+      return error_;
+   }
+
+private:
+   static const std::size_t kBufferSize = 65536;
+   zlib::ZipWriter writer_;
+   Error error_;
+};
    
 void handleMultipleFileExportRequest(const http::Request& request, 
                                      http::Response* pResponse)
@@ -1156,21 +1324,10 @@ void handleMultipleFileExportRequest(const http::Request& request,
       files.push_back(file);
    }
    
-   // create the zip file
-   FilePath tempZipFilePath = module_context::tempFile("export", "zip");
-   Error error = r::exec::RFunction(".rs.createZipFile",
-                                    tempZipFilePath.getAbsolutePath(),
-                                    parentPath.getAbsolutePath(),
-                                    files).call();
-   if (error)
-   {
-      LOG_ERROR(error);
-      pResponse->setError(error);
-      return;
-   }
-   
-   // return attachment
-   setAttachmentResponse(request, name, tempZipFilePath, pResponse);
+   // stream the zip file as it's written
+   setAttachmentHeaders(request, name, pResponse);
+   pResponse->setContentType("application/zip");
+   pResponse->setStreamResponse(boost::make_shared<ZipStreamResponse>(parentPath, files));
 }
    
 void handleFileExportRequest(const http::Request& request, 
@@ -1314,7 +1471,7 @@ Error initialize()
       (bind(registerRpcMethod, "is_git_directory", isGitDirectory))
       (bind(registerRpcMethod, "is_package_directory", isPackageDirectory))
       (bind(registerRpcMethod, "get_file_contents", getFileContents))
-      (bind(registerRpcMethod, "list_files", listFiles))
+      (bind(registerRpcMethod, "list_files", listFiles, RpcWorkerThread))
       (bind(registerRpcMethod, "create_folder", createFolder))
       (bind(registerRpcMethod, "delete_files", deleteFiles))
       (bind(registerRpcMethod, "copy_file", copyFile))
@@ -1323,7 +1480,7 @@ Error initialize()
       (bind(registerUriHandler, "/files", handleFilesRequest))
       (bind(registerUploadHandler, "/upload", handleFileUploadRequestAsync))
       (bind(registerUriHandler, "/export", handleFileExportRequest))
-      (bind(registerRpcMethod, "complete_upload", completeUpload))
+      (bind(registerAsyncRpcMethod, "complete_upload", completeUpload))
       (bind(sourceModuleRFile, "SessionFiles.R"))
       (bind(quotas::initialize));
    return initBlock.execute();
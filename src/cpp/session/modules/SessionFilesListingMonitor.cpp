@@ -21,6 +21,7 @@
 
 #include <shared_core/Error.hpp>
 #include <core/Log.hpp>
+#include <core/Thread.hpp>
 #include <core/FileInfo.hpp>
 #include <shared_core/FilePath.hpp>
 
@@ -48,14 +49,25 @@ bool acceptAllFiles(const FileInfo&)
    return true;
 }
 
+FilesListingMonitor::FilesListingMonitor()
+   : includeHidden_(false)
+{
+}
+
 Error FilesListingMonitor::start(const FilePath& filePath, bool includeHidden, 
       json::Array* pJsonFiles)
 {
-   // always stop existing
-   stop();
+   LOCK_MUTEX(mutex_)
+   {
+      // always stop existing
+      stopWhileLocked();
 
-   // save include hidden setting
-   includeHidden_ = includeHidden;
+      // save the requested path (a registration for any other path has
+      // been superseded) and include hidden setting
+      requestedPath_ = filePath;
+      includeHidden_ = includeHidden;
+   }
+   END_LOCK_MUTEX
 
    // scan the directory (populates pJsonFiles out parameter)
    std::vector<FilePath> files;
@@ -95,6 +107,16 @@ Error FilesListingMonitor::start(const FilePath& filePath, bool includeHidden,
 }
 
 void FilesListingMonitor::stop()
+{
+   LOCK_MUTEX(mutex_)
+   {
+      requestedPath_ = FilePath();
+      stopWhileLocked();
+   }
+   END_LOCK_MUTEX
+}
+
+void FilesListingMonitor::stopWhileLocked()
 {
    // reset monitored path and unregister any existing handle
    currentPath_ = FilePath();
@@ -105,9 +127,15 @@ void FilesListingMonitor::stop()
    }
 }
 
-const FilePath& FilesListingMonitor::currentMonitoredPath() const
+FilePath FilesListingMonitor::currentMonitoredPath() const
 {
-   return currentPath_;
+   LOCK_MUTEX(mutex_)
+   {
+      return currentPath_;
+   }
+   END_LOCK_MUTEX
+
+   return FilePath();
 }
 
 namespace {
@@ -148,9 +176,22 @@ void FilesListingMonitor::onRegistered(core::system::file_monitor::Handle handle
                                        const std::vector<FileInfo>& prevFiles,
                                        const tree<core::FileInfo>& files)
 {
-   // set path and current handle
-   currentPath_ = filePath;
-   currentHandle_ = handle;
+   bool includeHidden = false;
+   LOCK_MUTEX(mutex_)
+   {
+      // a later listing (or stop) has superseded this registration
+      if (filePath != requestedPath_ || !currentHandle_.empty())
+      {
+         core::system::file_monitor::unregisterMonitor(handle);
+         return;
+      }
+
+      // set path and current handle
+      currentPath_ = filePath;
+      currentHandle_ = handle;
+      includeHidden = includeHidden_;
+   }
+   END_LOCK_MUTEX
 
    // normalize scanned file paths (see comment above for explanation)
    std::vector<FileInfo> currFiles;
@@ -162,7 +203,7 @@ void FilesListingMonitor::onRegistered(core::system::file_monitor::Handle handle
    // compare the previously returned listing with the initial scan to see if any
    // file changes occurred between listings
    std::vector<core::system::FileChangeEvent> events;
-   if (includeHidden_)
+   if (includeHidden)
    {
       core::system::collectFileChangeEvents(prevFiles.begin(), prevFiles.end(),
             currFiles.begin(), currFiles.end(), acceptAllFiles, &events);
@@ -186,11 +227,15 @@ void FilesListingMonitor::onUnregistered(core::system::file_monitor::Handle hand
    // comes in. however, it is possible that our monitor could be unregistered
    // as a result of an error which occurs during monitoring. in this case
    // we clear our state explicitly here as well
-   if (currentHandle_ == handle)
+   LOCK_MUTEX(mutex_)
    {
-      currentPath_ = FilePath();
-      currentHandle_ = core::system::file_monitor::Handle();
+      if (currentHandle_ == handle)
+      {
+         currentPath_ = FilePath();
+         currentHandle_ = core::system::file_monitor::Handle();
+      }
    }
+   END_LOCK_MUTEX
 }
 
 Error FilesListingMonitor::listFiles(const FilePath& rootPath,
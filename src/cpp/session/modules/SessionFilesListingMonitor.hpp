@@ -21,6 +21,7 @@
 
 #include <boost/utility.hpp>
 
+#include <core/BoostThread.hpp>
 #include <core/collection/Tree.hpp>
 
 #include <shared_core/json/Json.hpp>
@@ -47,9 +48,15 @@ namespace modules {
 
 namespace files {
 
+// Monitors the directory shown in the files pane. start and stop may be
+// called from worker threads (list_files executes on one) while the
+// monitor's callbacks are delivered on the main thread, so the monitor's
+// state is guarded by a mutex.
 class FilesListingMonitor : boost::noncopyable
 {
 public:
+   FilesListingMonitor();
+
    // kickoff monitoring
    core::Error start(const core::FilePath& filePath, 
          bool includeHidden, core::json::Array* pJsonFiles);
@@ -57,7 +64,7 @@ public:
    void stop();
 
    // what path are we currently monitoring?
-   const core::FilePath& currentMonitoredPath() const;
+   core::FilePath currentMonitoredPath() const;
 
    // convenience method which is also called by listFiles for requests that
    // don't specify monitoring (e.g. file dialog listing)
@@ -84,8 +91,12 @@ private:
                                 bool includeHidden, 
                                 core::json::Array* pJsonFiles);
 
+   void stopWhileLocked();
+
 private:
+   mutable boost::mutex mutex_;
    core::FilePath currentPath_;
+   core::FilePath requestedPath_;
    bool includeHidden_;
    core::system::file_monitor::Handle currentHandle_;
 };
@@ -14,6 +14,7 @@
  */
 
 #include "SessionFind.hpp"
+#include "SessionFindEngine.hpp"
 
 #include <algorithm>
 #include <gsl/gsl>
@@ -384,6 +385,55 @@ FindInFilesState& findResults()
    return *s_pFindResults;
 }
 
+void adjustForPreview(std::string* contents)
+{
+   if (contents->size() > 300)
+   {
+      *contents = contents->erase(300);
+      contents->append("...");
+   }
+}
+
+void adjustForPreview(std::string* contents, json::Array* pMatchOn, json::Array* pMatchOff)
+{
+   size_t maxPreviewLength = 300;
+   size_t firstMatchOn = pMatchOn->getValueAt(0).getInt();
+   if (contents->size() > maxPreviewLength)
+   {
+      if (firstMatchOn > maxPreviewLength)
+      {
+         *contents = contents->erase(0, firstMatchOn - 30);
+         contents->insert(0, "...");
+         int leadingCharactersErased = gsl::narrow_cast<int>(firstMatchOn - 33);
+         json::Array newMatchOnArray;
+         json::Array newMatchOffArray;
+         for (size_t i = 0; i < pMatchOn->getSize(); i++)
+         {
+            newMatchOnArray.push_back(pMatchOn->getValueAt(i).getInt() - leadingCharactersErased);
+            if (i >= pMatchOff->getSize())
+               LOG_WARNING_MESSAGE("pMatchOn and pMatchOff should be the same length");
+            else
+               newMatchOffArray.push_back(pMatchOff->getValueAt(i).getInt() - leadingCharactersErased);
+         }
+         *pMatchOn = newMatchOnArray;
+         *pMatchOff = newMatchOffArray;
+      }
+      if (contents->size() > maxPreviewLength)
+         adjustForPreview(contents);
+   }
+}
+
+bool shouldSkipFile(std::string file)
+{
+   return (file.find("/.Rproj.user/") != std::string::npos ||
+           file.find("/.git/") != std::string::npos ||
+           file.find("/.svn/") != std::string::npos ||
+           file.find("/packrat/lib/") != std::string::npos ||
+           file.find("/packrat/src/") != std::string::npos ||
+           file.find("/renv/library/") != std::string::npos ||
+           file.find("/.Rhistory") != std::string::npos);
+}
+
 class GrepOperation : public boost::enable_shared_from_this<GrepOperation>
 {
 public:
@@ -461,15 +511,6 @@ private:
 #endif
    }
 
-   void adjustForPreview(std::string* contents)
-   {
-      if (contents->size() > 300)
-      {
-         *contents = contents->erase(300);
-         contents->append("...");
-      }
-   }
-
 // permissions getter/setter (only applicable to Unix platforms)
 #ifndef _WIN32
    Error setPermissions(const std::string& filePath, boost::filesystem::perms permissions)
@@ -509,35 +550,6 @@ private:
    }
 #endif
 
-   void adjustForPreview(std::string* contents, json::Array* pMatchOn, json::Array* pMatchOff)
-   {
-      size_t maxPreviewLength = 300;
-      size_t firstMatchOn = pMatchOn->getValueAt(0).getInt();
-      if (contents->size() > maxPreviewLength)
-      {
-         if (firstMatchOn > maxPreviewLength)
-         {
-            *contents = contents->erase(0, firstMatchOn - 30);
-            contents->insert(0, "...");
-            int leadingCharactersErased = gsl::narrow_cast<int>(firstMatchOn - 33);
-            json::Array newMatchOnArray;
-            json::Array newMatchOffArray;
-            for (size_t i = 0; i < pMatchOn->getSize(); i++)
-            {
-               newMatchOnArray.push_back(pMatchOn->getValueAt(i).getInt() - leadingCharactersErased);
-               if (i >= pMatchOff->getSize())
-                  LOG_WARNING_MESSAGE("pMatchOn and pMatchOff should be the same length");
-               else
-                  newMatchOffArray.push_back(pMatchOff->getValueAt(i).getInt() - leadingCharactersErased);
-            }
-            *pMatchOn = newMatchOnArray;
-            *pMatchOff = newMatchOffArray;
-         }
-         if (contents->size() > maxPreviewLength)
-            adjustForPreview(contents);
-      }
-   }
-
    Error completeFileReplace(std::set<std::string>* pErrorMessage)
    {
       if (fileSuccess_)
@@ -910,17 +922,6 @@ private:
       return Success();
    }
 
-   bool shouldSkipFile(std::string file)
-   {
-      return (file.find("/.Rproj.user/") != std::string::npos ||
-              file.find("/.git/") != std::string::npos ||
-              file.find("/.svn/") != std::string::npos ||
-              file.find("/packrat/lib/") != std::string::npos ||
-              file.find("/packrat/src/") != std::string::npos ||
-              file.find("/renv/library/") != std::string::npos ||
-              file.find("/.Rhistory") != std::string::npos);
-   }
-
    void onStdout(const core::system::ProcessOperations& /*ops*/, const std::string& data)
    {
       json::Array files;
@@ -1149,6 +1150,388 @@ private:
    bool fileSuccess_;
 };
 
+// decodes the given encoded text, appending it to pDecoded, and returns
+// the number of characters appended
+int appendDecoded(const std::string& encoded,
+                  const std::string& encoding,
+                  bool& firstDecodeError,
+                  std::string* pDecoded)
+{
+   std::string decoded = Replacer::decode(encoded, encoding, firstDecodeError);
+   pDecoded->append(decoded);
+
+   std::size_t charSize;
+   Error error = string_utils::utf8Distance(decoded.begin(),
+                                            decoded.end(),
+                                            &charSize);
+   if (error)
+      charSize = decoded.size();
+   return gsl::narrow_cast<int>(charSize);
+}
+
+// trims and decodes a line found by a FindEngine, adding the (character)
+// offsets of the given byte ranges within the result to pOn and pOff
+std::string decodeLine(const std::string& line,
+                       const std::vector<std::pair<std::size_t, std::size_t>>& ranges,
+                       const std::string& encoding,
+                       bool& firstDecodeError,
+                       json::Array* pOn,
+                       json::Array* pOff)
+{
+   // trim the line, shifting the ranges to suit
+   std::string trimmed = boost::algorithm::trim_copy(line);
+   std::size_t offset = trimmed.empty() ? 0 : line.find(trimmed);
+
+   std::string decodedLine;
+   int nUtf8CharactersProcessed = 0;
+   std::size_t pos = 0;
+   for (const std::pair<std::size_t, std::size_t>& range : ranges)
+   {
+      std::size_t rangeBegin = std::min(
+               std::max(range.first, offset) - offset, trimmed.size());
+      std::size_t rangeEnd = std::min(
+               std::max(range.second, offset) - offset, trimmed.size());
+      if (rangeEnd <= rangeBegin)
+         continue;
+
+      nUtf8CharactersProcessed += appendDecoded(
+               trimmed.substr(pos, rangeBegin - pos), encoding, firstDecodeError, &decodedLine);
+      pOn->push_back(nUtf8CharactersProcessed);
+      nUtf8CharactersProcessed += appendDecoded(
+               trimmed.substr(rangeBegin, rangeEnd - rangeBegin), encoding, firstDecodeError,
+               &decodedLine);
+      pOff->push_back(nUtf8CharactersProcessed);
+      pos = rangeEnd;
+   }
+   appendDecoded(trimmed.substr(pos), encoding, firstDecodeError, &decodedLine);
+   return decodedLine;
+}
+
+// Collects the results of a find run in process by a FindEngine (rather
+// than by grep), polling for matches from the main thread
+class FindOperation : public boost::enable_shared_from_this<FindOperation>
+{
+public:
+   static boost::shared_ptr<FindOperation> create(
+         const std::string& encoding,
+         const boost::shared_ptr<FindEngine>& pEngine)
+   {
+      return boost::shared_ptr<FindOperation>(new FindOperation(encoding,
+                                                                pEngine));
+   }
+
+private:
+   FindOperation(const std::string& encoding,
+                 const boost::shared_ptr<FindEngine>& pEngine)
+      : firstDecodeError_(true), ended_(false), encoding_(encoding), pEngine_(pEngine)
+   {
+      handle_ = core::system::generateUuid(false);
+   }
+
+public:
+   std::string handle() const
+   {
+      return handle_;
+   }
+
+   void start()
+   {
+      pEngine_->start();
+      module_context::schedulePeriodicWork(
+               boost::posix_time::milliseconds(50),
+               boost::bind(&FindOperation::poll, shared_from_this()),
+               false,
+               false);
+   }
+
+private:
+   bool poll()
+   {
+      // stop searching if the find was stopped or superseded; we keep
+      // polling until the engine has wound down
+      bool active = findResults().isRunning() && findResults().handle() == handle();
+      if (!active)
+         pEngine_->cancel();
+
+      std::vector<FindMatch> matches;
+      bool more = pEngine_->takeMatches(&matches);
+      if (active && !matches.empty())
+         addResults(matches);
+
+      if (more)
+         return true;
+
+      endFind();
+      return false;
+   }
+
+   // ends the find (once, whether it ran to completion or was cut short
+   // by reaching the maximum number of results)
+   void endFind()
+   {
+      if (ended_)
+         return;
+
+      ended_ = true;
+      findResults().onFindEnd(handle());
+      module_context::enqueClientEvent(
+            ClientEvent(client_events::kFindOperationEnded, handle()));
+   }
+
+   void addResults(const std::vector<FindMatch>& matches)
+   {
+      json::Array files;
+      json::Array lineNums;
+      json::Array contents;
+      json::Array matchOns;
+      json::Array matchOffs;
+      json::Array replaceMatchOns;
+      json::Array replaceMatchOffs;
+      json::Array errors;
+
+      int recordsToProcess = MAX_COUNT + 1 - findResults().resultCount();
+      for (const FindMatch& match : matches)
+      {
+         if (recordsToProcess <= 0)
+            break;
+
+         std::string file = module_context::createAliasedPath(
+               FilePath(string_utils::systemToUtf8(match.file)));
+
+         json::Array matchOn, matchOff;
+         std::string decodedLine = decodeLine(match.contents, match.ranges, encoding_,
+                                              firstDecodeError_, &matchOn, &matchOff);
+
+         if (matchOn.isEmpty())
+            adjustForPreview(&decodedLine);
+         else
+            adjustForPreview(&decodedLine, &matchOn, &matchOff);
+
+         files.push_back(file);
+         lineNums.push_back(match.line);
+         contents.push_back(decodedLine);
+         matchOns.push_back(matchOn);
+         matchOffs.push_back(matchOff);
+         replaceMatchOns.push_back(json::Array());
+         replaceMatchOffs.push_back(json::Array());
+         errors.push_back(json::Array());
+         recordsToProcess--;
+      }
+
+      if (files.getSize() > 0)
+      {
+         json::Object result;
+         result["handle"] = handle();
+         json::Object results;
+         results["file"] = files;
+         results["line"] = lineNums;
+         results["lineValue"] = contents;
+         results["matchOn"] = matchOns;
+         results["matchOff"] = matchOffs;
+         results["replaceMatchOn"] = replaceMatchOns;
+         results["replaceMatchOff"] = replaceMatchOffs;
+         results["errors"] = errors;
+         result["results"] = results;
+
+         findResults().addResult(handle(),
+                                 files,
+                                 lineNums,
+                                 contents,
+                                 matchOns,
+                                 matchOffs,
+                                 replaceMatchOns,
+                                 replaceMatchOffs);
+
+         module_context::enqueClientEvent(
+                  ClientEvent(client_events::kFindResult, result));
+      }
+
+      if (recordsToProcess <= 0)
+      {
+         pEngine_->cancel();
+         endFind();
+      }
+   }
+
+   bool firstDecodeError_;
+   bool ended_;
+   std::string encoding_;
+   std::string handle_;
+   boost::shared_ptr<FindEngine> pEngine_;
+};
+
+// Collects the results of a replace run in process by a ReplaceEngine,
+// polling for replaced lines from the main thread
+class ReplaceOperation : public boost::enable_shared_from_this<ReplaceOperation>
+{
+public:
+   static boost::shared_ptr<ReplaceOperation> create(
+         const std::string& encoding,
+         const boost::shared_ptr<ReplaceEngine>& pEngine,
+         LocalProgress* pProgress)
+   {
+      return boost::shared_ptr<ReplaceOperation>(new ReplaceOperation(encoding,
+                                                                      pEngine,
+                                                                      pProgress));
+   }
+
+private:
+   ReplaceOperation(const std::string& encoding,
+                    const boost::shared_ptr<ReplaceEngine>& pEngine,
+                    LocalProgress* pProgress)
+      : firstDecodeError_(true),
+        encoding_(encoding),
+        pEngine_(pEngine),
+        pProgress_(pProgress),
+        reportedCount_(0)
+   {
+      handle_ = core::system::generateUuid(false);
+   }
+
+public:
+   std::string handle() const
+   {
+      return handle_;
+   }
+
+   void start()
+   {
+      pEngine_->start();
+      module_context::schedulePeriodicWork(
+               boost::posix_time::milliseconds(50),
+               boost::bind(&ReplaceOperation::poll, shared_from_this()),
+               false,
+               false);
+   }
+
+private:
+   bool poll()
+   {
+      bool active = findResults().isRunning() && findResults().handle() == handle();
+      if (!active)
+         pEngine_->cancel();
+
+      std::vector<ReplacedLine> lines;
+      bool more = pEngine_->takeLines(&lines);
+      if (active)
+      {
+         std::size_t replacedCount = pEngine_->replacedCount();
+         if (replacedCount > reportedCount_)
+         {
+            pProgress_->addUnits(gsl::narrow_cast<int>(replacedCount - reportedCount_));
+            reportedCount_ = replacedCount;
+         }
+
+         if (!lines.empty())
+            addResults(lines);
+      }
+
+      if (more)
+         return true;
+
+      findResults().onFindEnd(handle());
+      module_context::enqueClientEvent(
+            ClientEvent(client_events::kFindOperationEnded, handle()));
+      return false;
+   }
+
+   void addResults(const std::vector<ReplacedLine>& lines)
+   {
+      json::Array files;
+      json::Array lineNums;
+      json::Array contents;
+      json::Array matchOns;
+      json::Array matchOffs;
+      json::Array replaceMatchOns;
+      json::Array replaceMatchOffs;
+      json::Array errors;
+
+      // every match is replaced, but we only show as many as we would find
+      int recordsToProcess = MAX_COUNT + 1 - findResults().resultCount();
+      for (const ReplacedLine& line : lines)
+      {
+         if (recordsToProcess <= 0)
+            break;
+
+         std::string file = module_context::createAliasedPath(
+               FilePath(string_utils::systemToUtf8(line.match.file)));
+
+         json::Array matchOn, matchOff;
+         json::Array replaceMatchOn, replaceMatchOff;
+         json::Array lineErrors;
+         std::string decodedLine;
+         if (line.error.empty())
+         {
+            decodeLine(line.match.contents, line.match.ranges, encoding_,
+                       firstDecodeError_, &matchOn, &matchOff);
+            decodedLine = decodeLine(line.contents, line.ranges, encoding_,
+                                     firstDecodeError_, &replaceMatchOn, &replaceMatchOff);
+         }
+         else
+         {
+            decodedLine = decodeLine(line.match.contents, line.match.ranges, encoding_,
+                                     firstDecodeError_, &matchOn, &matchOff);
+            for (std::size_t i = 0; i < matchOn.getSize(); ++i)
+            {
+               replaceMatchOn.push_back(-1);
+               replaceMatchOff.push_back(-1);
+            }
+            lineErrors.push_back(line.error);
+         }
+
+         if (matchOn.isEmpty())
+            adjustForPreview(&decodedLine);
+         else
+            adjustForPreview(&decodedLine, &matchOn, &matchOff);
+
+         files.push_back(file);
+         lineNums.push_back(line.match.line);
+         contents.push_back(decodedLine);
+         matchOns.push_back(matchOn);
+         matchOffs.push_back(matchOff);
+         replaceMatchOns.push_back(replaceMatchOn);
+         replaceMatchOffs.push_back(replaceMatchOff);
+         errors.push_back(lineErrors);
+         recordsToProcess--;
+      }
+
+      if (files.getSize() > 0)
+      {
+         json::Object result;
+         result["handle"] = handle();
+         json::Object results;
+         results["file"] = files;
+         results["line"] = lineNums;
+         results["lineValue"] = contents;
+         results["matchOn"] = matchOns;
+         results["matchOff"] = matchOffs;
+         results["replaceMatchOn"] = replaceMatchOns;
+         results["replaceMatchOff"] = replaceMatchOffs;
+         results["errors"] = errors;
+         result["results"] = results;
+
+         findResults().addResult(handle(),
+                                 files,
+                                 lineNums,
+                                 contents,
+                                 matchOns,
+                                 matchOffs,
+                                 replaceMatchOns,
+                                 replaceMatchOffs);
+
+         module_context::enqueClientEvent(
+                  ClientEvent(client_events::kReplaceResult, result));
+      }
+   }
+
+   bool firstDecodeError_;
+   std::string encoding_;
+   std::string handle_;
+   boost::shared_ptr<ReplaceEngine> pEngine_;
+   LocalProgress* pProgress_;
+   std::size_t reportedCount_;
+};
+
 } // namespace
 
 class GrepOptions : public boost::noncopyable
@@ -1229,6 +1612,16 @@ public:
       return excludeArgs_;
    }
 
+   const std::vector<std::string>& includeGlobs() const
+   {
+      return includeGlobs_;
+   }
+
+   const std::vector<std::string>& excludeGlobs() const
+   {
+      return excludeGlobs_;
+   }
+
 private:
 
    bool asRegex_;
@@ -1241,11 +1634,13 @@ private:
 
    // derived from includeFilePatterns
    std::vector<std::string> includeArgs_;
+   std::vector<std::string> includeGlobs_;
    bool packageSourceFlag_;
    bool packageTestsFlag_;
 
    // derived from excludeFilePatterns
    std::vector<std::string> excludeArgs_;
+   std::vector<std::string> excludeGlobs_;
    bool gitFlag_;
 
    void processExcludeFilePatterns()
@@ -1261,7 +1656,10 @@ private:
             if (excludeText.compare("gitExclusions") == 0)
                gitFlag_ = true;
             else if (!excludeText.empty())
+            {
                excludeArgs_.push_back("--exclude=" + filePattern.getString());
+               excludeGlobs_.push_back(filePattern.getString());
+            }
          }
       }
    }
@@ -1282,7 +1680,10 @@ private:
             else if (includeText.compare("packageTests") == 0)
                packageTestsFlag_ = true;
             else if (!includeText.empty())
+            {
                includeArgs_.push_back("--include=" + filePattern.getString());
+               includeGlobs_.push_back(filePattern.getString());
+            }
          }
       }
    }
@@ -1307,22 +1708,20 @@ struct ReplaceOptions
    const std::string replacePattern;
 };
 
-void addDirectoriesToCommand(
-   bool packageSourceFlag, bool packageTestsFlag,
-   const FilePath& directoryPath, shell_utils::ShellCommand* pCmd)
+std::vector<FilePath> searchPaths(
+   bool packageSourceFlag, bool packageTestsFlag, const FilePath& directoryPath)
 {
-   // not sure if EscapeFilesOnly can be removed or is necessary for an edge case
-   *pCmd << shell_utils::EscapeFilesOnly << "--" << shell_utils::EscapeAll;
+   std::vector<FilePath> paths;
    if (!(packageSourceFlag || packageTestsFlag))
-      *pCmd << string_utils::utf8ToSystem(directoryPath.getAbsolutePath());
+      paths.push_back(FilePath(string_utils::utf8ToSystem(directoryPath.getAbsolutePath())));
    else if (packageSourceFlag)
    {
       FilePath rPath(string_utils::utf8ToSystem(directoryPath.getAbsolutePath() + "/R"));
       FilePath srcPath(string_utils::utf8ToSystem(directoryPath.getAbsolutePath() + "/src"));
       if (rPath.exists())
-         *pCmd << rPath; 
+         paths.push_back(rPath);
       if (srcPath.exists())
-         *pCmd << srcPath;
+         paths.push_back(srcPath);
       else if (!rPath.exists())
          LOG_WARNING_MESSAGE(
             "Package source directories not found in " + directoryPath.getAbsolutePath());
@@ -1331,10 +1730,45 @@ void addDirectoriesToCommand(
    {
       FilePath testsPath(string_utils::utf8ToSystem(directoryPath.getAbsolutePath() + "/tests"));
       if (testsPath.exists())
-         *pCmd << testsPath;
+         paths.push_back(testsPath);
       else
          LOG_WARNING_MESSAGE("Package test directory not found in " + directoryPath.getAbsolutePath());
    }
+   return paths;
+}
+
+void addDirectoriesToCommand(
+   bool packageSourceFlag, bool packageTestsFlag,
+   const FilePath& directoryPath, shell_utils::ShellCommand* pCmd)
+{
+   // not sure if EscapeFilesOnly can be removed or is necessary for an edge case
+   *pCmd << shell_utils::EscapeFilesOnly << "--" << shell_utils::EscapeAll;
+   for (const FilePath& path : searchPaths(packageSourceFlag, packageTestsFlag, directoryPath))
+      *pCmd << path;
+}
+
+// the encoding of the files searched
+std::string searchEncoding()
+{
+   return projects::projectContext().hasProject() ?
+          projects::projectContext().defaultEncoding() :
+          prefs::userPrefs().defaultEncoding();
+}
+
+std::string encodeString(const std::string& value, const std::string& encoding)
+{
+   std::string encodedString;
+   Error error = r::util::iconvstr(value,
+                                   "UTF-8",
+                                   encoding,
+                                   false,
+                                   &encodedString);
+   if (error)
+   {
+      LOG_ERROR(error);
+      encodedString = value;
+   }
+   return encodedString;
 }
 
 core::Error runGrepOperation(const GrepOptions& grepOptions, const ReplaceOptions& replaceOptions,
@@ -1360,20 +1794,8 @@ core::Error runGrepOperation(const GrepOptions& grepOptions, const ReplaceOption
    Error error = tempFile.openForWrite(pStream);
    if (error)
       return error;
-   std::string encoding = projects::projectContext().hasProject() ?
-                          projects::projectContext().defaultEncoding() :
-                          prefs::userPrefs().defaultEncoding();
-   std::string encodedString;
-   error = r::util::iconvstr(grepOptions.searchPattern(),
-                             "UTF-8",
-                             encoding,
-                             false,
-                             &encodedString);
-   if (error)
-   {
-      LOG_ERROR(error);
-      encodedString = grepOptions.searchPattern();
-   }
+   std::string encoding = searchEncoding();
+   std::string encodedString = encodeString(grepOptions.searchPattern(), encoding);
 
    *pStream << encodedString << std::endl;
    pStream.reset(); // release file handle
@@ -1477,6 +1899,105 @@ core::Error runGrepOperation(const GrepOptions& grepOptions, const ReplaceOption
    return Success();
 }
 
+FindEngineOptions findEngineOptions(const GrepOptions& grepOptions,
+                                    const std::string& encoding)
+{
+   FindEngineOptions options;
+   options.pattern = encodeString(grepOptions.searchPattern(), encoding);
+   options.asRegex = grepOptions.asRegex();
+   options.ignoreCase = grepOptions.ignoreCase();
+   options.includeGlobs = grepOptions.includeGlobs();
+   options.excludeGlobs = grepOptions.excludeGlobs();
+
+   FilePath dirPath = module_context::resolveAliasedPath(grepOptions.directory());
+   options.paths = searchPaths(
+      grepOptions.packageSourceFlag(), grepOptions.packageTestsFlag(), dirPath);
+
+   std::string websiteOutputDir = module_context::websiteOutputDir();
+   if (!websiteOutputDir.empty())
+      websiteOutputDir = "/" + websiteOutputDir + "/";
+   options.skipPath = [websiteOutputDir](const std::string& path)
+   {
+      return shouldSkipFile(path) ||
+             (!websiteOutputDir.empty() &&
+              path.find(websiteOutputDir) != std::string::npos);
+   };
+
+   return options;
+}
+
+// finds in process, without grep; searches which exclude the files git
+// ignores still need git grep
+core::Error runFindOperation(const GrepOptions& grepOptions,
+                             json::JsonRpcResponse* pResponse)
+{
+   std::string encoding = searchEncoding();
+   FindEngineOptions options = findEngineOptions(grepOptions, encoding);
+   options.maxResults = MAX_COUNT + 1;
+
+   boost::shared_ptr<FindEngine> pEngine;
+   Error error = FindEngine::create(options, &pEngine);
+   if (error)
+      return error;
+
+   boost::shared_ptr<FindOperation> ptrFindOp = FindOperation::create(encoding, pEngine);
+
+   // Clear existing results
+   findResults().clear();
+
+   findResults().onFindBegin(ptrFindOp->handle(),
+                             grepOptions.searchPattern(),
+                             grepOptions.directory(),
+                             grepOptions.asRegex(),
+                             grepOptions.ignoreCase(),
+                             grepOptions.gitFlag());
+   ptrFindOp->start();
+   pResponse->setResult(ptrFindOp->handle());
+
+   return Success();
+}
+
+// replaces in process; as with finding, searches which exclude the files
+// git ignores still need git grep
+core::Error runReplaceOperation(const GrepOptions& grepOptions,
+                                const ReplaceOptions& replaceOptions,
+                                bool allOrNothing,
+                                LocalProgress* pProgress,
+                                json::JsonRpcResponse* pResponse)
+{
+   std::string encoding = searchEncoding();
+   ReplaceEngineOptions options;
+   options.find = findEngineOptions(grepOptions, encoding);
+   options.replacement = encodeString(replaceOptions.replacePattern, encoding);
+   options.allOrNothing = allOrNothing;
+
+   boost::shared_ptr<ReplaceEngine> pEngine;
+   Error error = ReplaceEngine::create(options, &pEngine);
+   if (error)
+      return error;
+
+   boost::shared_ptr<ReplaceOperation> ptrReplaceOp =
+         ReplaceOperation::create(encoding, pEngine, pProgress);
+
+   // Clear existing results
+   findResults().clear();
+
+   findResults().onFindBegin(ptrReplaceOp->handle(),
+                             grepOptions.searchPattern(),
+                             grepOptions.directory(),
+                             grepOptions.asRegex(),
+                             grepOptions.ignoreCase(),
+                             grepOptions.gitFlag());
+   findResults().onReplaceBegin(ptrReplaceOp->handle(),
+                                replaceOptions.preview,
+                                replaceOptions.replacePattern,
+                                pProgress);
+   ptrReplaceOp->start();
+   pResponse->setResult(ptrReplaceOp->handle());
+
+   return Success();
+}
+
 core::Error beginFind(const json::JsonRpcRequest& request,
                       json::JsonRpcResponse* pResponse)
 {
@@ -1497,7 +2018,10 @@ core::Error beginFind(const json::JsonRpcRequest& request,
 
    GrepOptions grepOptions(searchString, directory, includeFilePatterns, excludeFilePatterns,
       asRegex, ignoreCase);
-   error = runGrepOperation(grepOptions, ReplaceOptions(), nullptr, pResponse);
+   if (grepOptions.gitFlag())
+      error = runGrepOperation(grepOptions, ReplaceOptions(), nullptr, pResponse);
+   else
+      error = runFindOperation(grepOptions, pResponse);
    return error;
 }
 
@@ -1575,6 +2099,15 @@ core::Error completeReplace(const json::JsonRpcRequest& request,
    if (error)
       return error;
 
+   // optionally, only change files if they can all be changed
+   bool allOrNothing = false;
+   if (request.params.getSize() > 9)
+   {
+      error = json::readParam(request.params, 9, &allOrNothing);
+      if (error)
+         return error;
+   }
+
    // 5 was chosen based on testing to find a value that was both responsive
    // and not overly frequent
    static const int kUpdatePercent = 5;
@@ -1583,8 +2116,12 @@ core::Error completeReplace(const json::JsonRpcRequest& request,
       asRegex, ignoreCase);
    ReplaceOptions replaceOptions(replacePattern);
 
-   error = runGrepOperation(
-      grepOptions, replaceOptions, pProgress, pResponse);
+   if (grepOptions.gitFlag())
+      error = runGrepOperation(
+         grepOptions, replaceOptions, pProgress, pResponse);
+   else
+      error = runReplaceOperation(
+         grepOptions, replaceOptions, allOrNothing, pProgress, pResponse);
    return error;
 }
 
@@ -0,0 +1,1207 @@
+/*
+ * SessionFindEngine.cpp
+ *
+ * Copyright (C) 2020 by RStudio, PBC
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include "SessionFindEngine.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+#include <boost/bind.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/iostreams/device/mapped_file.hpp>
+
+#ifndef _WIN32
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <core/Log.hpp>
+#include <core/system/FileScanner.hpp>
+
+using namespace rstudio::core;
+
+namespace rstudio {
+namespace session {
+namespace modules {
+namespace find {
+
+namespace {
+
+// how many lines we search between checks for cancellation
+const int kLinesPerCancellationCheck = 4096;
+
+// converts a file name glob (as accepted by grep's --include and --exclude)
+// to a regular expression
+boost::regex globToRegex(const std::string& glob)
+{
+   std::string regex;
+   bool inBrackets = false;
+   for (std::size_t i = 0; i < glob.size(); ++i)
+   {
+      char ch = glob[i];
+      if (inBrackets)
+      {
+         if (ch == ']')
+            inBrackets = false;
+         else if (ch == '\\')
+            regex.push_back('\\');
+         regex.push_back(ch);
+         continue;
+      }
+
+      switch (ch)
+      {
+      case '*':
+         regex.append("[^/]*");
+         break;
+      case '?':
+         regex.append("[^/]");
+         break;
+      case '[':
+         if (glob.find(']', i + 2) == std::string::npos)
+         {
+            regex.append("\\[");
+            break;
+         }
+         inBrackets = true;
+         regex.push_back('[');
+         if (i + 1 < glob.size() && glob[i + 1] == '!')
+         {
+            regex.push_back('^');
+            ++i;
+         }
+         break;
+      case '\\':
+         if (i + 1 < glob.size())
+            ch = glob[++i];
+         // fall through
+      default:
+         if (std::strchr(".^$|()[]{}*+?\\", ch))
+            regex.push_back('\\');
+         regex.push_back(ch);
+         break;
+      }
+   }
+
+   return boost::regex(regex);
+}
+
+// converts a basic regular expression, with the GNU extensions grep accepts
+// by default, to the equivalent perl regular expression (boost's basic
+// syntax has none of GNU's \| \+ \? \w \s \b \< \> etc.)
+std::string grepToRegex(const std::string& pattern)
+{
+   std::string regex;
+
+   // whether we're at the start of an expression, where '*' is literal and
+   // '^' is an anchor
+   bool atStart = true;
+   for (std::size_t i = 0; i < pattern.size(); ++i)
+   {
+      char ch = pattern[i];
+      bool start = atStart;
+      atStart = false;
+
+      switch (ch)
+      {
+      case '\\':
+         // a trailing backslash is left for the regex to reject
+         if (i + 1 == pattern.size())
+         {
+            regex.push_back(ch);
+            break;
+         }
+
+         ch = pattern[++i];
+         if (ch == '(' || ch == '|')
+         {
+            regex.push_back(ch);
+            atStart = true;
+         }
+         else if (std::strchr("){}+?", ch))
+         {
+            regex.push_back(ch);
+         }
+         else if (std::strchr("wWsSbB<>`'123456789", ch) ||
+                  std::strchr(".^$|()[]{}*+?\\", ch))
+         {
+            regex.push_back('\\');
+            regex.push_back(ch);
+         }
+         else
+         {
+            // other escaped characters stand for themselves
+            regex.push_back(ch);
+         }
+         break;
+
+      case '*':
+         if (start)
+            regex.push_back('\\');
+         regex.push_back(ch);
+         break;
+
+      case '^':
+         if (start)
+            atStart = true;
+         else
+            regex.push_back('\\');
+         regex.push_back(ch);
+         break;
+
+      case '$':
+         // only an anchor at the end of an expression
+         if (i + 1 != pattern.size() &&
+             pattern.compare(i + 1, 2, "\\)") != 0 &&
+             pattern.compare(i + 1, 2, "\\|") != 0)
+         {
+            regex.push_back('\\');
+         }
+         regex.push_back(ch);
+         break;
+
+      case '[':
+      {
+         // a bracket expression: a ']' first is literal, as are backslashes,
+         // and character classes ([:alpha:] etc.) are kept whole
+         std::size_t end = i + 1;
+         if (end < pattern.size() && pattern[end] == '^')
+            ++end;
+         if (end < pattern.size() && pattern[end] == ']')
+            ++end;
+         while (end < pattern.size() && pattern[end] != ']')
+         {
+            if (pattern[end] == '[' && end + 1 < pattern.size() &&
+                std::strchr(":=.", pattern[end + 1]))
+            {
+               std::size_t classEnd = pattern.find(std::string(1, pattern[end + 1]) + "]", end + 2);
+               if (classEnd != std::string::npos)
+               {
+                  end = classEnd + 2;
+                  continue;
+               }
+            }
+            ++end;
+         }
+
+         // an unterminated bracket is left for the regex to reject
+         if (end == pattern.size())
+         {
+            regex.push_back(ch);
+            break;
+         }
+
+         regex.push_back('[');
+         std::size_t pos = i + 1;
+         if (pattern[pos] == '^')
+            regex.push_back(pattern[pos++]);
+         if (pattern[pos] == ']')
+         {
+            regex.append("\\]");
+            ++pos;
+         }
+         for (; pos < end; ++pos)
+         {
+            if (pattern[pos] == '[' && std::strchr(":=.", pattern[pos + 1]))
+            {
+               std::size_t classEnd = pattern.find(std::string(1, pattern[pos + 1]) + "]", pos + 2);
+               if (classEnd != std::string::npos && classEnd < end)
+               {
+                  regex.append(pattern, pos, classEnd + 2 - pos);
+                  pos = classEnd + 1;
+                  continue;
+               }
+            }
+
+            if (pattern[pos] == '\\' || pattern[pos] == '[')
+               regex.push_back('\\');
+            regex.push_back(pattern[pos]);
+         }
+         regex.push_back(']');
+         i = end;
+         break;
+      }
+
+      default:
+         if (std::strchr("|(){}+?", ch))
+            regex.push_back('\\');
+         regex.push_back(ch);
+         break;
+      }
+   }
+
+   return regex;
+}
+
+// the regular expression for a search's pattern
+boost::regex patternRegex(const FindEngineOptions& options)
+{
+   boost::regex::flag_type flags = options.asRegex ?
+            boost::regex::perl :
+            boost::regex::literal;
+   if (options.ignoreCase)
+      flags |= boost::regex::icase;
+   return boost::regex(options.asRegex ? grepToRegex(options.pattern) : options.pattern,
+                       flags);
+}
+
+std::string fileName(const std::string& path)
+{
+   std::size_t separator = path.find_last_of("/\\");
+   return separator == std::string::npos ? path : path.substr(separator + 1);
+}
+
+// a hidden file alongside the given one, used while replacing it
+std::string siblingPath(const std::string& path, const std::string& suffix)
+{
+   std::size_t nameBegin = path.size() - fileName(path).size();
+   return path.substr(0, nameBegin) + "." + path.substr(nameBegin) + suffix;
+}
+
+Error fileError(const boost::system::error_code& ec,
+                const std::string& path,
+                const ErrorLocation& location)
+{
+   Error error(ec, location);
+   error.addProperty("path", path);
+   return error;
+}
+
+// a file can be replaced by renaming another over it only if that keeps
+// everything about it but its contents: hard links would be broken, and
+// the new file would be owned by us
+bool canReplaceByRename(const std::string& path)
+{
+#ifndef _WIN32
+   struct stat st;
+   if (::stat(path.c_str(), &st) != 0)
+      return false;
+   return S_ISREG(st.st_mode) && st.st_nlink == 1 && st.st_uid == ::geteuid();
+#else
+   return true;
+#endif
+}
+
+// writes contents to a file (truncating it if it exists, so it stays the
+// same file)
+Error writeContents(const std::string& path, const std::string& contents)
+{
+   std::ofstream stream(path.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+   stream.write(contents.data(), contents.size());
+   stream.close();
+   if (!stream.good())
+   {
+      return fileError(boost::system::errc::make_error_code(boost::system::errc::io_error),
+                       path,
+                       ERROR_LOCATION);
+   }
+   return Success();
+}
+
+Error readContents(const std::string& path, std::string* pContents)
+{
+   std::ifstream stream(path.c_str(), std::ios::in | std::ios::binary);
+   std::ostringstream buffer;
+   buffer << stream.rdbuf();
+   if (!stream.good())
+   {
+      return fileError(boost::system::errc::make_error_code(boost::system::errc::io_error),
+                       path,
+                       ERROR_LOCATION);
+   }
+   *pContents = buffer.str();
+   return Success();
+}
+
+// copies the contents of one file over those of another
+Error copyContents(const std::string& from, const std::string& to)
+{
+   std::string contents;
+   Error error = readContents(from, &contents);
+   if (error)
+      return error;
+   return writeContents(to, contents);
+}
+
+// a file in the temporary directory, for files which are rewritten in place
+std::string tempPath()
+{
+   boost::system::error_code ec;
+   boost::filesystem::path dir = boost::filesystem::temp_directory_path(ec);
+   if (ec)
+      dir = "/tmp";
+   return boost::filesystem::unique_path(dir / "rstudio-replace-%%%%-%%%%-%%%%-%%%%").string();
+}
+
+} // anonymous namespace
+
+Error FindEngine::create(const FindEngineOptions& options,
+                         boost::shared_ptr<FindEngine>* pEngine)
+{
+   boost::shared_ptr<FindEngine> pNewEngine(new FindEngine(options));
+
+   try
+   {
+      // plain text searches which are case sensitive don't need a regex
+      pNewEngine->literal_ = !options.asRegex && !options.ignoreCase &&
+                             !options.pattern.empty();
+      if (!pNewEngine->literal_)
+         pNewEngine->regex_ = patternRegex(options);
+
+      for (const std::string& glob : options.includeGlobs)
+         pNewEngine->includeRegexes_.push_back(globToRegex(glob));
+      for (const std::string& glob : options.excludeGlobs)
+         pNewEngine->excludeRegexes_.push_back(globToRegex(glob));
+   }
+   catch (const boost::regex_error& e)
+   {
+      Error error = systemError(boost::system::errc::invalid_argument,
+                                "Invalid search pattern: " + std::string(e.what()),
+                                ERROR_LOCATION);
+      error.addProperty("pattern", options.pattern);
+      return error;
+   }
+
+   *pEngine = pNewEngine;
+   return Success();
+}
+
+FindEngine::FindEngine(const FindEngineOptions& options)
+   : options_(options),
+     literal_(false),
+     cancelled_(false),
+     filesQueued_(0),
+     walking_(true),
+     searching_(0),
+     filesDone_(0),
+     matchCount_(0),
+     ended_(false)
+{
+}
+
+FindEngine::~FindEngine()
+{
+   cancel();
+   wait();
+}
+
+void FindEngine::start()
+{
+   std::size_t searchers = std::max(1u, boost::thread::hardware_concurrency());
+   searching_ = searchers;
+
+   try
+   {
+      threads_.create_thread(boost::bind(&FindEngine::walk, this));
+      for (std::size_t i = 0; i < searchers; ++i)
+         threads_.create_thread(boost::bind(&FindEngine::searchFiles, this));
+   }
+   catch (const boost::thread_resource_error& e)
+   {
+      // threads which did start will see the search end
+      LOG_ERROR(Error(e.code(), ERROR_LOCATION));
+      cancel();
+
+      boost::mutex::scoped_lock lock(matchesMutex_);
+      ended_ = true;
+   }
+}
+
+void FindEngine::cancel()
+{
+   cancelled_ = true;
+
+   boost::mutex::scoped_lock lock(queueMutex_);
+   queueChanged_.notify_all();
+}
+
+void FindEngine::wait()
+{
+   threads_.join_all();
+}
+
+bool FindEngine::takeMatches(std::vector<FindMatch>* pMatches)
+{
+   boost::mutex::scoped_lock lock(matchesMutex_);
+   bool taken = !matches_.empty();
+   std::move(matches_.begin(), matches_.end(), std::back_inserter(*pMatches));
+   matches_.clear();
+   return !ended_ || taken;
+}
+
+void FindEngine::walk()
+{
+   for (const FilePath& path : options_.paths)
+   {
+      if (cancelled_)
+         break;
+
+      if (!path.isDirectory())
+      {
+         if (path.exists())
+            onFileScanned(FileInfo(path));
+         continue;
+      }
+
+      // we don't keep the tree: files are queued as they're found, and
+      // the filter only lets directories through so they're recursed into
+      core::system::FileScannerOptions scannerOptions;
+      scannerOptions.recursive = true;
+      scannerOptions.filter = boost::bind(&FindEngine::onFileScanned, this, _1);
+
+      tree<FileInfo> tree;
+      Error error = core::system::scanFiles(FileInfo(path), scannerOptions, &tree);
+      if (error)
+         LOG_ERROR(error);
+   }
+
+   boost::mutex::scoped_lock lock(queueMutex_);
+   walking_ = false;
+   queueChanged_.notify_all();
+}
+
+bool FindEngine::onFileScanned(const FileInfo& fileInfo)
+{
+   if (cancelled_)
+      return false;
+
+   // as with grep -r, symbolic links found while recursing aren't followed
+   if (fileInfo.isSymlink())
+      return false;
+
+   const std::string& path = fileInfo.absolutePath();
+   if (fileInfo.isDirectory())
+      return !options_.skipPath || !options_.skipPath(path + "/");
+
+   if ((options_.skipPath && options_.skipPath(path)) ||
+       !includeFile(fileName(path)))
+   {
+      return false;
+   }
+
+   boost::mutex::scoped_lock lock(queueMutex_);
+   queue_.push_back(std::make_pair(filesQueued_++, path));
+   queueChanged_.notify_one();
+   return false;
+}
+
+bool FindEngine::includeFile(const std::string& name) const
+{
+   for (const boost::regex& regex : excludeRegexes_)
+      if (boost::regex_match(name, regex))
+         return false;
+
+   if (includeRegexes_.empty())
+      return true;
+
+   for (const boost::regex& regex : includeRegexes_)
+      if (boost::regex_match(name, regex))
+         return true;
+
+   return false;
+}
+
+void FindEngine::searchFiles()
+{
+   while (true)
+   {
+      std::pair<std::size_t, std::string> file;
+      {
+         boost::mutex::scoped_lock lock(queueMutex_);
+         while (queue_.empty() && walking_ && !cancelled_)
+            queueChanged_.wait(lock);
+
+         if (cancelled_ || queue_.empty())
+            break;
+
+         file = queue_.front();
+         queue_.pop_front();
+      }
+
+      // files without matches are added too, so later files' matches
+      // aren't kept waiting for them
+      std::vector<FindMatch> matches;
+      searchFile(file.second, &matches);
+      addMatches(file.first, &matches);
+   }
+
+   // the last searcher to finish ends the search
+   boost::mutex::scoped_lock lock(matchesMutex_);
+   if (--searching_ == 0)
+      ended_ = true;
+}
+
+void FindEngine::addMatches(std::size_t fileIndex, std::vector<FindMatch>* pMatches)
+{
+   boost::mutex::scoped_lock lock(matchesMutex_);
+   if (options_.maxResults > 0 && matchCount_ >= options_.maxResults)
+      return;
+
+   // matches are taken in the order the files were found, so that when
+   // there are more than we need the ones we keep don't depend on which
+   // searcher got to its file first
+   if (fileIndex != filesDone_)
+   {
+      searchedAhead_[fileIndex] = std::move(*pMatches);
+      return;
+   }
+
+   std::vector<FindMatch> matches = std::move(*pMatches);
+   while (true)
+   {
+      ++filesDone_;
+
+      // once we have as many matches as we need the search is done
+      std::size_t count = matches.size();
+      if (options_.maxResults > 0)
+         count = std::min(count, options_.maxResults - matchCount_);
+
+      std::move(matches.begin(),
+                matches.begin() + count,
+                std::back_inserter(matches_));
+      matchCount_ += count;
+
+      if (options_.maxResults > 0 && matchCount_ >= options_.maxResults)
+      {
+         cancelled_ = true;
+         searchedAhead_.clear();
+         break;
+      }
+
+      std::map<std::size_t, std::vector<FindMatch>>::iterator next =
+            searchedAhead_.find(filesDone_);
+      if (next == searchedAhead_.end())
+         break;
+
+      matches = std::move(next->second);
+      searchedAhead_.erase(next);
+   }
+}
+
+void FindEngine::searchFile(const std::string& file,
+                            std::vector<FindMatch>* pMatches) const
+{
+   // skip devices, pipes and the like
+   boost::system::error_code ec;
+   boost::filesystem::path path(file);
+   if (!boost::filesystem::is_regular_file(path, ec) ||
+       boost::filesystem::file_size(path, ec) == 0 ||
+       ec)
+   {
+      return;
+   }
+
+   boost::iostreams::mapped_file_source mappedFile;
+   try
+   {
+      mappedFile.open(file);
+   }
+   catch (const std::exception& e)
+   {
+      // the file may have been removed since we found it
+      LOG_DEBUG_MESSAGE("Can't search " + file + ": " + e.what());
+      return;
+   }
+
+   const char* pBegin = mappedFile.data();
+   const char* pEnd = pBegin + mappedFile.size();
+
+   if (std::memchr(pBegin, '\0', mappedFile.size()) != nullptr)
+      return;
+
+   searchBuffer(file, pBegin, pEnd, pMatches);
+}
+
+void FindEngine::searchBuffer(const std::string& file,
+                              const char* pBegin,
+                              const char* pEnd,
+                              std::vector<FindMatch>* pMatches) const
+{
+   if (literal_)
+      searchLiteral(file, pBegin, pEnd, pMatches);
+   else
+      searchRegex(file, pBegin, pEnd, pMatches);
+}
+
+void FindEngine::searchLiteral(const std::string& file,
+                               const char* pBegin,
+                               const char* pEnd,
+                               std::vector<FindMatch>* pMatches) const
+{
+   // search the whole buffer for the pattern, only looking for the lines
+   // around the occurrences we find
+   const std::string& pattern = options_.pattern;
+   const char* pCounted = pBegin;
+   int line = 1;
+   int occurrences = 0;
+
+   const char* pPos = pBegin;
+   while (pPos < pEnd)
+   {
+      if (++occurrences % kLinesPerCancellationCheck == 0 && cancelled_)
+         return;
+
+      const char* pFound = std::search(pPos, pEnd, pattern.begin(), pattern.end());
+      if (pFound == pEnd)
+         break;
+
+      // find the line containing it
+      const char* pLineBegin = pFound;
+      while (pLineBegin > pPos && pLineBegin[-1] != '\n')
+         --pLineBegin;
+      const char* pLineEnd = static_cast<const char*>(
+               std::memchr(pFound, '\n', pEnd - pFound));
+      if (pLineEnd == nullptr)
+         pLineEnd = pEnd;
+
+      line += static_cast<int>(std::count(pCounted, pLineBegin, '\n'));
+      pCounted = pLineBegin;
+
+      FindMatch match;
+      match.file = file;
+      match.line = line;
+      match.contents.assign(pLineBegin, pLineEnd);
+
+      // and the other occurrences on the line
+      const char* pLineEndSearch = pLineEnd;
+      while (pFound != pLineEndSearch)
+      {
+         std::size_t offset = pFound - pLineBegin;
+         match.ranges.push_back(std::make_pair(offset, offset + pattern.size()));
+         pFound = std::search(pFound + pattern.size(),
+                              pLineEndSearch,
+                              pattern.begin(),
+                              pattern.end());
+      }
+
+      pMatches->push_back(match);
+      pPos = pLineEnd + (pLineEnd < pEnd ? 1 : 0);
+   }
+}
+
+void FindEngine::searchRegex(const std::string& file,
+                             const char* pBegin,
+                             const char* pEnd,
+                             std::vector<FindMatch>* pMatches) const
+{
+   int line = 0;
+   const char* pLineBegin = pBegin;
+   while (pLineBegin < pEnd)
+   {
+      if (++line % kLinesPerCancellationCheck == 0 && cancelled_)
+         return;
+
+      const char* pLineEnd = static_cast<const char*>(
+               std::memchr(pLineBegin, '\n', pEnd - pLineBegin));
+      if (pLineEnd == nullptr)
+         pLineEnd = pEnd;
+
+      // find all of the (non-overlapping) matches on the line; like grep,
+      // a line matching only an empty string is included, but has nothing
+      // to highlight
+      boost::match_flag_type flags = boost::match_default | boost::match_not_dot_newline;
+      boost::cmatch regexMatch;
+      const char* pPos = pLineBegin;
+      bool matched = false;
+      FindMatch match;
+      while (pPos <= pLineEnd &&
+             boost::regex_search(pPos, pLineEnd, regexMatch, regex_, flags))
+      {
+         matched = true;
+
+         std::size_t matchBegin = regexMatch[0].first - pLineBegin;
+         std::size_t matchEnd = regexMatch[0].second - pLineBegin;
+         if (matchEnd > matchBegin)
+         {
+            match.ranges.push_back(std::make_pair(matchBegin, matchEnd));
+            pPos = regexMatch[0].second;
+         }
+         else
+         {
+            pPos = regexMatch[0].second + 1;
+         }
+
+         flags |= boost::match_prev_avail;
+      }
+
+      if (matched)
+      {
+         match.file = file;
+         match.line = line;
+         match.contents.assign(pLineBegin, pLineEnd);
+         pMatches->push_back(match);
+      }
+
+      pLineBegin = pLineEnd + 1;
+   }
+}
+
+Error ReplaceEngine::create(const ReplaceEngineOptions& options,
+                            boost::shared_ptr<ReplaceEngine>* pEngine)
+{
+   boost::shared_ptr<ReplaceEngine> pNewEngine(new ReplaceEngine(options));
+
+   // every match is replaced
+   pNewEngine->options_.find.maxResults = 0;
+   Error error = FindEngine::create(pNewEngine->options_.find,
+                                    &pNewEngine->pFindEngine_);
+   if (error)
+      return error;
+
+   // the pattern has already been checked by the find engine
+   if (options.find.asRegex)
+      pNewEngine->regex_ = patternRegex(options.find);
+
+   *pEngine = pNewEngine;
+   return Success();
+}
+
+ReplaceEngine::ReplaceEngine(const ReplaceEngineOptions& options)
+   : options_(options),
+     cancelled_(false),
+     replacedCount_(0),
+     ended_(false)
+{
+}
+
+ReplaceEngine::~ReplaceEngine()
+{
+   cancel();
+   wait();
+}
+
+void ReplaceEngine::start()
+{
+   try
+   {
+      thread_ = boost::thread(boost::bind(&ReplaceEngine::run, this));
+   }
+   catch (const boost::thread_resource_error& e)
+   {
+      LOG_ERROR(Error(e.code(), ERROR_LOCATION));
+
+      boost::mutex::scoped_lock lock(linesMutex_);
+      ended_ = true;
+   }
+}
+
+void ReplaceEngine::cancel()
+{
+   cancelled_ = true;
+   pFindEngine_->cancel();
+}
+
+void ReplaceEngine::wait()
+{
+   if (thread_.joinable())
+      thread_.join();
+}
+
+bool ReplaceEngine::takeLines(std::vector<ReplacedLine>* pLines)
+{
+   boost::mutex::scoped_lock lock(linesMutex_);
+   bool taken = !lines_.empty();
+   std::move(lines_.begin(), lines_.end(), std::back_inserter(*pLines));
+   lines_.clear();
+   return !ended_ || taken;
+}
+
+void ReplaceEngine::run()
+{
+   // find everything to replace, grouped by file
+   pFindEngine_->start();
+   pFindEngine_->wait();
+
+   std::vector<FindMatch> matches;
+   pFindEngine_->takeMatches(&matches);
+   for (FindMatch& match : matches)
+      files_[match.file].push_back(std::move(match));
+   for (FileMatches::value_type& file : files_)
+   {
+      std::sort(file.second.begin(), file.second.end(),
+                [](const FindMatch& a, const FindMatch& b) { return a.line < b.line; });
+   }
+   nextFile_ = files_.begin();
+
+   // rewrite the files in parallel
+   if (!cancelled_ && !files_.empty())
+   {
+      std::size_t writers = std::min<std::size_t>(
+               std::max(1u, boost::thread::hardware_concurrency()),
+               files_.size());
+
+      boost::thread_group threads;
+      try
+      {
+         for (std::size_t i = 0; i < writers; ++i)
+            threads.create_thread(boost::bind(&ReplaceEngine::rewriteFiles, this));
+      }
+      catch (const boost::thread_resource_error& e)
+      {
+         LOG_ERROR(Error(e.code(), ERROR_LOCATION));
+      }
+
+      // make do on this thread if need be
+      if (threads.size() == 0)
+         rewriteFiles();
+      threads.join_all();
+   }
+
+   if (options_.allOrNothing)
+   {
+      std::string error = stagingError_;
+      if (error.empty() && cancelled_)
+         error = "Replace was stopped";
+      if (error.empty() && !staged_.empty())
+      {
+         Error commitError = commit();
+         if (commitError)
+            error = commitError.asString();
+      }
+
+      if (!error.empty())
+      {
+         for (const StagedFile& staged : staged_)
+         {
+            boost::system::error_code ec;
+            boost::filesystem::remove(staged.tempFile, ec);
+         }
+         failLines("No files were changed: " + error, &stagedLines_);
+         replacedCount_ = 0;
+      }
+      addLines(&stagedLines_);
+   }
+
+   boost::mutex::scoped_lock lock(linesMutex_);
+   ended_ = true;
+}
+
+void ReplaceEngine::rewriteFiles()
+{
+   while (true)
+   {
+      FileMatches::const_iterator it;
+      {
+         boost::mutex::scoped_lock lock(filesMutex_);
+         if (cancelled_ || nextFile_ == files_.end())
+            return;
+         it = nextFile_++;
+      }
+
+      std::vector<ReplacedLine> lines;
+      StagedFile staged;
+      Error error = rewriteFile(it->first, it->second, &lines, &staged);
+      if (error)
+      {
+         failLines(error.asString(), &lines);
+         if (!options_.allOrNothing)
+         {
+            addLines(&lines);
+            continue;
+         }
+
+         // there's no point writing the other files
+         boost::mutex::scoped_lock lock(filesMutex_);
+         if (stagingError_.empty())
+            stagingError_ = error.asString();
+         cancelled_ = true;
+         std::move(lines.begin(), lines.end(), std::back_inserter(stagedLines_));
+         continue;
+      }
+
+      std::size_t count = 0;
+      for (const ReplacedLine& line : lines)
+         count += line.ranges.size();
+      replacedCount_ += count;
+
+      if (!options_.allOrNothing)
+      {
+         addLines(&lines);
+         continue;
+      }
+
+      boost::mutex::scoped_lock lock(filesMutex_);
+      staged_.push_back(staged);
+      std::move(lines.begin(), lines.end(), std::back_inserter(stagedLines_));
+   }
+}
+
+Error ReplaceEngine::rewriteFile(const std::string& file,
+                                 const std::vector<FindMatch>& matches,
+                                 std::vector<ReplacedLine>* pLines,
+                                 StagedFile* pStaged) const
+{
+   for (const FindMatch& match : matches)
+   {
+      ReplacedLine line;
+      line.match = match;
+      pLines->push_back(line);
+   }
+
+   std::string contents;
+   Error error = readContents(file, &contents);
+   if (error)
+      return error;
+
+   // copy the file, replacing the matches on the lines we found them on;
+   // as the file may have changed since we searched it, we check each of
+   // those lines is as we found it
+   std::string replaced;
+   replaced.reserve(contents.size());
+   std::size_t pos = 0;
+   int line = 1;
+   for (ReplacedLine& replacedLine : *pLines)
+   {
+      const FindMatch& match = replacedLine.match;
+      std::size_t lineBegin = pos;
+      while (line < match.line && lineBegin < contents.size())
+      {
+         std::size_t newline = contents.find('\n', lineBegin);
+         lineBegin = newline == std::string::npos ? contents.size() : newline + 1;
+         ++line;
+      }
+
+      std::size_t lineEnd = std::min(contents.find('\n', lineBegin), contents.size());
+      if (line != match.line ||
+          contents.compare(lineBegin, lineEnd - lineBegin, match.contents) != 0)
+      {
+         Error error = systemError(boost::system::errc::io_error,
+                                   "File changed since it was searched",
+                                   ERROR_LOCATION);
+         error.addProperty("path", file);
+         error.addProperty("line", match.line);
+         return error;
+      }
+
+      replaced.append(contents, pos, lineBegin - pos);
+      replaceLine(match, &replacedLine);
+      replaced.append(replacedLine.contents);
+      pos = lineEnd;
+   }
+   replaced.append(contents, pos, std::string::npos);
+
+   if (cancelled_ && !options_.allOrNothing)
+   {
+      return systemError(boost::system::errc::operation_canceled,
+                         "Replace was stopped",
+                         ERROR_LOCATION);
+   }
+
+   pStaged->file = file;
+
+   // write the new contents alongside the file, with the same permissions,
+   // so it can be renamed over the file
+   if (canReplaceByRename(file))
+   {
+      std::string tempFile = siblingPath(file, ".replace~");
+      std::ofstream stream(tempFile.c_str(),
+                           std::ios::out | std::ios::binary | std::ios::trunc);
+      if (stream.is_open())
+      {
+         stream.write(replaced.data(), replaced.size());
+         stream.close();
+
+         boost::system::error_code ec;
+         boost::filesystem::file_status status;
+         if (stream.good())
+            status = boost::filesystem::status(file, ec);
+         else
+            ec = boost::system::errc::make_error_code(boost::system::errc::io_error);
+         if (!ec)
+            boost::filesystem::permissions(tempFile, status.permissions(), ec);
+         if (!ec && !options_.allOrNothing)
+            boost::filesystem::rename(tempFile, file, ec);
+         if (ec)
+         {
+            boost::system::error_code removeEc;
+            boost::filesystem::remove(tempFile, removeEc);
+            return fileError(ec, file, ERROR_LOCATION);
+         }
+
+         pStaged->tempFile = tempFile;
+         pStaged->inPlace = false;
+         return Success();
+      }
+   }
+
+   // otherwise (or if we can't write to the file's directory) the file is
+   // rewritten in place; in all-or-nothing mode its new contents wait in
+   // the temporary directory
+   pStaged->inPlace = true;
+   if (!options_.allOrNothing)
+      return writeContents(file, replaced);
+
+   pStaged->tempFile = tempPath();
+   error = writeContents(pStaged->tempFile, replaced);
+   if (error)
+   {
+      boost::system::error_code ec;
+      boost::filesystem::remove(pStaged->tempFile, ec);
+   }
+   return error;
+}
+
+Error ReplaceEngine::commit()
+{
+   // keep a link to each original file until every file has been replaced,
+   // so if replacing one fails we can put the others back
+   std::vector<std::pair<StagedFile, std::string>> replaced;
+   Error error;
+   for (const StagedFile& staged : staged_)
+   {
+      const std::string& file = staged.file;
+      boost::system::error_code ec;
+      if (staged.inPlace)
+      {
+         // files rewritten in place are backed up by copying them; if that
+         // fails the file hasn't been touched, so there's nothing to restore
+         std::string backupFile = tempPath();
+         error = copyContents(file, backupFile);
+         if (error)
+         {
+            boost::filesystem::remove(backupFile, ec);
+            break;
+         }
+
+         // (if this fails the file may be partly written)
+         error = copyContents(staged.tempFile, file);
+         replaced.push_back(std::make_pair(staged, backupFile));
+         if (error)
+            break;
+
+         boost::filesystem::remove(staged.tempFile, ec);
+         continue;
+      }
+
+      std::string backupFile = siblingPath(file, ".replace-backup~");
+      boost::filesystem::remove(backupFile, ec);
+      boost::filesystem::create_hard_link(file, backupFile, ec);
+      if (ec)
+      {
+         ec.clear();
+         boost::filesystem::copy_file(file, backupFile, ec);
+      }
+      if (ec)
+      {
+         error = fileError(ec, backupFile, ERROR_LOCATION);
+         break;
+      }
+
+      boost::filesystem::rename(staged.tempFile, file, ec);
+      if (ec)
+      {
+         error = fileError(ec, file, ERROR_LOCATION);
+         boost::filesystem::remove(backupFile, ec);
+         break;
+      }
+
+      replaced.push_back(std::make_pair(staged, backupFile));
+   }
+
+   for (const std::pair<StagedFile, std::string>& file : replaced)
+   {
+      boost::system::error_code ec;
+      if (error)
+      {
+         if (file.first.inPlace)
+         {
+            Error restoreError = copyContents(file.second, file.first.file);
+            if (restoreError)
+               LOG_ERROR(restoreError);
+            else
+               boost::filesystem::remove(file.second, ec);
+         }
+         else
+         {
+            boost::filesystem::rename(file.second, file.first.file, ec);
+            if (ec)
+               LOG_ERROR(fileError(ec, file.first.file, ERROR_LOCATION));
+         }
+      }
+      else
+      {
+         boost::filesystem::remove(file.second, ec);
+      }
+   }
+
+   return error;
+}
+
+void ReplaceEngine::replaceLine(const FindMatch& match, ReplacedLine* pLine) const
+{
+   const std::string& line = match.contents;
+   pLine->match = match;
+   pLine->contents.clear();
+   pLine->ranges.clear();
+
+   std::size_t pos = 0;
+   for (const std::pair<std::size_t, std::size_t>& range : match.ranges)
+   {
+      pLine->contents.append(line, pos, range.first - pos);
+      std::size_t replacementBegin = pLine->contents.size();
+
+      boost::smatch regexMatch;
+      boost::match_flag_type flags = boost::match_continuous | boost::match_not_dot_newline;
+      if (range.first > 0)
+         flags |= boost::match_prev_avail;
+
+      if (!options_.find.asRegex)
+      {
+         pLine->contents.append(options_.replacement);
+      }
+      else if (boost::regex_search(line.begin() + range.first,
+                                   line.end(),
+                                   regexMatch,
+                                   regex_,
+                                   flags))
+      {
+         pLine->contents.append(regexMatch.format(options_.replacement,
+                                                  boost::format_sed));
+      }
+      else
+      {
+         pLine->contents.append(line, range.first, range.second - range.first);
+      }
+
+      pLine->ranges.push_back(std::make_pair(replacementBegin, pLine->contents.size()));
+      pos = range.second;
+   }
+   pLine->contents.append(line, pos, std::string::npos);
+}
+
+void ReplaceEngine::addLines(std::vector<ReplacedLine>* pLines)
+{
+   boost::mutex::scoped_lock lock(linesMutex_);
+   std::move(pLines->begin(), pLines->end(), std::back_inserter(lines_));
+   pLines->clear();
+}
+
+void ReplaceEngine::failLines(const std::string& error,
+                              std::vector<ReplacedLine>* pLines) const
+{
+   for (ReplacedLine& line : *pLines)
+   {
+      line.contents = line.match.contents;
+      line.ranges.clear();
+      line.error = error;
+   }
+}
+
+} // namespace find
+} // namespace modules
+} // namespace session
+} // namespace rstudio
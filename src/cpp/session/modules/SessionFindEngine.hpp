@@ -0,0 +1,297 @@
+/*
+ * SessionFindEngine.hpp
+ *
+ * Copyright (C) 2020 by RStudio, PBC
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef SESSION_FIND_ENGINE_HPP
+#define SESSION_FIND_ENGINE_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <deque>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <boost/function.hpp>
+#include <boost/regex.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/utility.hpp>
+
+#include <core/BoostThread.hpp>
+#include <core/FileInfo.hpp>
+
+#include <shared_core/Error.hpp>
+#include <shared_core/FilePath.hpp>
+
+namespace rstudio {
+namespace session {
+namespace modules {
+namespace find {
+
+struct FindEngineOptions
+{
+   FindEngineOptions()
+      : asRegex(false), ignoreCase(false), maxResults(0)
+   {
+   }
+
+   // the files and directories to search (directories recursively)
+   std::vector<core::FilePath> paths;
+
+   // the pattern to find, in the encoding of the files searched; regular
+   // expressions are basic regular expressions with GNU grep's extensions
+   // (\| \+ \? \w \s \b \< \> and so on)
+   std::string pattern;
+   bool asRegex;
+   bool ignoreCase;
+
+   // file name globs: when there are include globs only the files matching
+   // one of them are searched, and files matching an exclude glob never are
+   std::vector<std::string> includeGlobs;
+   std::vector<std::string> excludeGlobs;
+
+   // files and directories to skip entirely (optional); directory paths
+   // are passed with a trailing slash
+   boost::function<bool(const std::string&)> skipPath;
+
+   // stop after finding this many matching lines (0 for no limit); the
+   // lines found are the first in file and line order
+   std::size_t maxResults;
+};
+
+// a line containing matches; offsets are in bytes
+struct FindMatch
+{
+   std::string file;
+   int line;
+   std::string contents;
+   std::vector<std::pair<std::size_t, std::size_t>> ranges;
+};
+
+// Searches files for a pattern on background threads: one thread walks the
+// paths to search, queueing the files to search in, while a pool of threads
+// (one per core) searches the queued files. Matches are collected for the
+// caller to take as the search proceeds, in the order the files were found
+// (by name within each directory, depth first) whichever is searched first.
+// Files are memory mapped, and files containing NUL bytes are assumed to be
+// binary and skipped, as grep does with --binary-files=without-match.
+class FindEngine : boost::noncopyable
+{
+public:
+   // returns an error if the pattern isn't a valid regular expression
+   static core::Error create(const FindEngineOptions& options,
+                             boost::shared_ptr<FindEngine>* pEngine);
+
+   ~FindEngine();
+
+   void start();
+
+   // stop searching; matches found so far can still be taken
+   void cancel();
+
+   // moves the matches found since the last call into pMatches (in file
+   // and line order); returns false once the search has ended and there
+   // are no more matches to take
+   bool takeMatches(std::vector<FindMatch>* pMatches);
+
+   // wait for the search to end
+   void wait();
+
+   // search a buffer (exposed for testing)
+   void searchBuffer(const std::string& file,
+                     const char* pBegin,
+                     const char* pEnd,
+                     std::vector<FindMatch>* pMatches) const;
+
+private:
+   explicit FindEngine(const FindEngineOptions& options);
+
+   void walk();
+   bool onFileScanned(const core::FileInfo& fileInfo);
+   void searchFiles();
+   void searchFile(const std::string& file, std::vector<FindMatch>* pMatches) const;
+   bool includeFile(const std::string& name) const;
+   void searchLiteral(const std::string& file,
+                      const char* pBegin,
+                      const char* pEnd,
+                      std::vector<FindMatch>* pMatches) const;
+   void searchRegex(const std::string& file,
+                    const char* pBegin,
+                    const char* pEnd,
+                    std::vector<FindMatch>* pMatches) const;
+   void addMatches(std::size_t fileIndex, std::vector<FindMatch>* pMatches);
+
+private:
+   FindEngineOptions options_;
+   boost::regex regex_;
+   bool literal_;
+   std::vector<boost::regex> includeRegexes_;
+   std::vector<boost::regex> excludeRegexes_;
+
+   std::atomic<bool> cancelled_;
+
+   boost::thread_group threads_;
+
+   // files waiting to be searched, numbered in the order they were found
+   boost::mutex queueMutex_;
+   boost::condition_variable queueChanged_;
+   std::deque<std::pair<std::size_t, std::string>> queue_;
+   std::size_t filesQueued_;
+   bool walking_;
+   std::size_t searching_;
+
+   // matches waiting to be taken, and those found in files searched ahead
+   // of files found before them (by file number)
+   boost::mutex matchesMutex_;
+   std::vector<FindMatch> matches_;
+   std::map<std::size_t, std::vector<FindMatch>> searchedAhead_;
+   std::size_t filesDone_;
+   std::size_t matchCount_;
+   bool ended_;
+};
+
+struct ReplaceEngineOptions
+{
+   ReplaceEngineOptions()
+      : allOrNothing(false)
+   {
+   }
+
+   FindEngineOptions find;
+
+   // the replacement for each match, in the encoding of the files; for
+   // regular expression searches it's a sed-style format string which can
+   // refer to the groups matched (as \1 etc.)
+   std::string replacement;
+
+   // when set, files are only changed if every file can be rewritten
+   bool allOrNothing;
+};
+
+// a line in which matches were replaced
+struct ReplacedLine
+{
+   // the line as found
+   FindMatch match;
+
+   // the line after replacing matches, and the byte offsets of the
+   // replacements within it (empty if the file wasn't changed)
+   std::string contents;
+   std::vector<std::pair<std::size_t, std::size_t>> ranges;
+
+   // why the line's file wasn't changed, if it wasn't
+   std::string error;
+};
+
+// Replaces the matches found by a FindEngine on background threads: once
+// the search completes, the files with matches are rewritten in parallel
+// by a pool of threads. Each file is written to a temporary file alongside
+// it which is then renamed over it, so files are never partially written.
+// Files which renaming would change other than in content (those with
+// other hard links, or owned by someone else), or whose directories we
+// can't write to, are rewritten in place instead.
+// In all-or-nothing mode, nothing is replaced until every file has been
+// written, and if replacing any file fails the files already replaced are
+// restored.
+class ReplaceEngine : boost::noncopyable
+{
+public:
+   static core::Error create(const ReplaceEngineOptions& options,
+                             boost::shared_ptr<ReplaceEngine>* pEngine);
+
+   ~ReplaceEngine();
+
+   void start();
+
+   // stop replacing; files already replaced stay replaced, unless in
+   // all-or-nothing mode, where nothing is replaced unless the files
+   // were already being renamed
+   void cancel();
+
+   // moves the lines replaced since the last call into pLines; returns
+   // false once replacing has ended and there are no more lines to take
+   bool takeLines(std::vector<ReplacedLine>* pLines);
+
+   // the number of matches replaced so far
+   std::size_t replacedCount() const { return replacedCount_; }
+
+   // wait for replacing to end
+   void wait();
+
+   // replace the matches on a line found by the FindEngine (exposed for
+   // testing)
+   void replaceLine(const FindMatch& match, ReplacedLine* pLine) const;
+
+private:
+   typedef std::map<std::string, std::vector<FindMatch>> FileMatches;
+
+   // a file's new contents, written to a temporary file
+   struct StagedFile
+   {
+      StagedFile() : inPlace(false) {}
+
+      std::string file;
+      std::string tempFile;
+
+      // whether the file's contents are to be replaced in place rather
+      // than by renaming the temporary file over it
+      bool inPlace;
+   };
+
+   explicit ReplaceEngine(const ReplaceEngineOptions& options);
+
+   void run();
+   void rewriteFiles();
+   core::Error rewriteFile(const std::string& file,
+                           const std::vector<FindMatch>& matches,
+                           std::vector<ReplacedLine>* pLines,
+                           StagedFile* pStaged) const;
+   core::Error commit();
+   void addLines(std::vector<ReplacedLine>* pLines);
+   void failLines(const std::string& error, std::vector<ReplacedLine>* pLines) const;
+
+private:
+   ReplaceEngineOptions options_;
+   boost::shared_ptr<FindEngine> pFindEngine_;
+   boost::regex regex_;
+
+   std::atomic<bool> cancelled_;
+   std::atomic<std::size_t> replacedCount_;
+
+   boost::thread thread_;
+
+   // the files to rewrite, and the next to be rewritten
+   FileMatches files_;
+   FileMatches::const_iterator nextFile_;
+   boost::mutex filesMutex_;
+
+   // in all-or-nothing mode, the files written and waiting to be renamed,
+   // along with their lines
+   std::vector<StagedFile> staged_;
+   std::vector<ReplacedLine> stagedLines_;
+   std::string stagingError_;
+
+   // lines waiting to be taken
+   boost::mutex linesMutex_;
+   std::vector<ReplacedLine> lines_;
+   bool ended_;
+};
+
+} // namespace find
+} // namespace modules
+} // namespace session
+} // namespace rstudio
+
+#endif // SESSION_FIND_ENGINE_HPP
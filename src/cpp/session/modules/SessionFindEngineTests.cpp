@@ -0,0 +1,470 @@
+/*
+ * SessionFindEngineTests.cpp
+ *
+ * Copyright (C) 2020 by RStudio, PBC
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include "SessionFindEngine.hpp"
+
+#include <algorithm>
+#include <fstream>
+
+#include <boost/algorithm/string/replace.hpp>
+#include <boost/filesystem.hpp>
+
+#ifndef _WIN32
+#include <signal.h>
+#include <sys/resource.h>
+#endif
+
+#include <core/FileSerializer.hpp>
+
+#define RSTUDIO_NO_TESTTHAT_ALIASES
+#include <tests/TestThat.hpp>
+
+namespace rstudio {
+namespace session {
+namespace modules {
+namespace find {
+namespace tests {
+
+using namespace rstudio::core;
+
+namespace {
+
+const std::string kContents(
+         "library(dplyr)\n"
+         "mtcars %>% filter(mpg > 20) %>% select(mpg, cyl)\n"
+         "\n"
+         "Filter(function(x) x > 1, list(1, 2))");
+
+std::vector<FindMatch> searchContents(const FindEngineOptions& options)
+{
+   boost::shared_ptr<FindEngine> pEngine;
+   REQUIRE_FALSE(FindEngine::create(options, &pEngine));
+
+   std::vector<FindMatch> matches;
+   pEngine->searchBuffer("test.R",
+                         kContents.data(),
+                         kContents.data() + kContents.size(),
+                         &matches);
+   return matches;
+}
+
+std::vector<FindMatch> search(const FindEngineOptions& options)
+{
+   boost::shared_ptr<FindEngine> pEngine;
+   REQUIRE_FALSE(FindEngine::create(options, &pEngine));
+   pEngine->start();
+   pEngine->wait();
+
+   std::vector<FindMatch> matches;
+   CHECK(pEngine->takeMatches(&matches));
+   CHECK_FALSE(pEngine->takeMatches(&matches));
+
+   std::sort(matches.begin(), matches.end(),
+             [](const FindMatch& a, const FindMatch& b) {
+      return a.file < b.file || (a.file == b.file && a.line < b.line);
+   });
+   return matches;
+}
+
+std::vector<ReplacedLine> replace(const ReplaceEngineOptions& options)
+{
+   boost::shared_ptr<ReplaceEngine> pEngine;
+   REQUIRE_FALSE(ReplaceEngine::create(options, &pEngine));
+   pEngine->start();
+   pEngine->wait();
+
+   std::vector<ReplacedLine> lines;
+   CHECK(pEngine->takeLines(&lines));
+   CHECK_FALSE(pEngine->takeLines(&lines));
+   return lines;
+}
+
+bool hasRange(const std::pair<std::size_t, std::size_t>& range,
+              std::size_t begin,
+              std::size_t end)
+{
+   return range.first == begin && range.second == end;
+}
+
+} // anonymous namespace
+
+TEST_CASE("SessionFindEngine")
+{
+   FindEngineOptions options;
+
+   SECTION("Literal searches find every occurrence on a line")
+   {
+      options.pattern = "mpg";
+      std::vector<FindMatch> matches = searchContents(options);
+      REQUIRE(matches.size() == 1);
+      CHECK(matches[0].line == 2);
+      CHECK(matches[0].contents == "mtcars %>% filter(mpg > 20) %>% select(mpg, cyl)");
+      REQUIRE(matches[0].ranges.size() == 2);
+      CHECK(hasRange(matches[0].ranges[0], 18, 21));
+      CHECK(hasRange(matches[0].ranges[1], 39, 42));
+   }
+
+   SECTION("Literal searches can ignore case")
+   {
+      options.pattern = "filter(";
+      options.ignoreCase = true;
+      std::vector<FindMatch> matches = searchContents(options);
+      REQUIRE(matches.size() == 2);
+      CHECK(matches[0].line == 2);
+      CHECK(matches[1].line == 4);
+      CHECK(matches[1].contents == "Filter(function(x) x > 1, list(1, 2))");
+   }
+
+   SECTION("Regular expressions are basic regular expressions")
+   {
+      options.pattern = "[a-z]\\{4,\\}(";
+      options.asRegex = true;
+      std::vector<FindMatch> matches = searchContents(options);
+      REQUIRE(matches.size() == 3);
+      CHECK(matches[0].line == 1);
+      CHECK(hasRange(matches[0].ranges[0], 0, 8));
+      CHECK(matches[1].ranges.size() == 2);
+      CHECK(matches[2].line == 4);
+      CHECK(hasRange(matches[2].ranges[0], 1, 7));
+   }
+
+   SECTION("Regular expressions have GNU grep's extensions")
+   {
+      options.asRegex = true;
+
+      options.pattern = "filter\\|select";
+      std::vector<FindMatch> matches = searchContents(options);
+      REQUIRE(matches.size() == 1);
+      REQUIRE(matches[0].ranges.size() == 2);
+      CHECK(hasRange(matches[0].ranges[0], 11, 17));
+      CHECK(hasRange(matches[0].ranges[1], 32, 38));
+
+      options.pattern = "\\w\\+(";
+      matches = searchContents(options);
+      REQUIRE(matches.size() == 3);
+      CHECK(hasRange(matches[0].ranges[0], 0, 8));
+      CHECK(matches[2].ranges.size() == 3);
+
+      options.pattern = "lists\\?(";
+      matches = searchContents(options);
+      REQUIRE(matches.size() == 1);
+      CHECK(hasRange(matches[0].ranges[0], 26, 31));
+
+      options.pattern = "\\bx\\b";
+      matches = searchContents(options);
+      REQUIRE(matches.size() == 1);
+      REQUIRE(matches[0].ranges.size() == 2);
+      CHECK(hasRange(matches[0].ranges[0], 16, 17));
+      CHECK(hasRange(matches[0].ranges[1], 19, 20));
+
+      options.pattern = "\\<mpg\\>";
+      matches = searchContents(options);
+      REQUIRE(matches.size() == 1);
+      CHECK(matches[0].ranges.size() == 2);
+
+      options.pattern = "1,\\s2";
+      matches = searchContents(options);
+      REQUIRE(matches.size() == 1);
+      CHECK(hasRange(matches[0].ranges[0], 31, 35));
+
+      // unescaped, these are literal
+      options.pattern = "(x)\\|x +";
+      matches = searchContents(options);
+      REQUIRE(matches.size() == 1);
+      CHECK(hasRange(matches[0].ranges[0], 15, 18));
+
+      // as are backslashes in brackets, and a ']' first in them
+      options.pattern = "[]%\\]>";
+      matches = searchContents(options);
+      REQUIRE(matches.size() == 1);
+      REQUIRE(matches[0].ranges.size() == 2);
+      CHECK(hasRange(matches[0].ranges[0], 7, 9));
+   }
+
+   SECTION("Anchors match at the start and end of each line")
+   {
+      options.pattern = "^$";
+      options.asRegex = true;
+      std::vector<FindMatch> matches = searchContents(options);
+      REQUIRE(matches.size() == 1);
+      CHECK(matches[0].line == 3);
+      CHECK(matches[0].ranges.empty());
+
+      options.pattern = ")$";
+      matches = searchContents(options);
+      REQUIRE(matches.size() == 3);
+      CHECK(hasRange(matches[2].ranges[0], 36, 37));
+   }
+
+   SECTION("Invalid regular expressions are reported")
+   {
+      options.pattern = "\\(mpg";
+      options.asRegex = true;
+      boost::shared_ptr<FindEngine> pEngine;
+      CHECK(FindEngine::create(options, &pEngine));
+   }
+
+   SECTION("Directories are searched recursively")
+   {
+      FilePath root;
+      REQUIRE_FALSE(FilePath::tempFilePath(root));
+      REQUIRE_FALSE(root.ensureDirectory());
+      REQUIRE_FALSE(root.completeChildPath("R").ensureDirectory());
+      REQUIRE_FALSE(root.completeChildPath("skipped").ensureDirectory());
+
+      REQUIRE_FALSE(writeStringToFile(root.completeChildPath("R/a.R"), kContents));
+      REQUIRE_FALSE(writeStringToFile(root.completeChildPath("R/b.Rmd"), "mpg\nmpg\n"));
+      REQUIRE_FALSE(writeStringToFile(root.completeChildPath("c.txt"), "mpg"));
+      REQUIRE_FALSE(writeStringToFile(root.completeChildPath("skipped/d.R"), "mpg"));
+      {
+         std::ofstream stream(root.completeChildPath("e.rds").getAbsolutePath().c_str(),
+                              std::ios::binary);
+         stream.write("mpg\0mpg", 7);
+      }
+
+      options.paths.push_back(root);
+      options.pattern = "mpg";
+      options.skipPath = [](const std::string& path) {
+         return path.find("/skipped/") != std::string::npos;
+      };
+
+      std::vector<FindMatch> matches = search(options);
+      REQUIRE(matches.size() == 4);
+      CHECK(matches[0].file == root.completeChildPath("R/a.R").getAbsolutePath());
+      CHECK(matches[1].file == root.completeChildPath("R/b.Rmd").getAbsolutePath());
+      CHECK(matches[3].file == root.completeChildPath("c.txt").getAbsolutePath());
+
+      options.includeGlobs.push_back("*.R");
+      options.includeGlobs.push_back("*.Rmd");
+      options.excludeGlobs.push_back("b.*");
+      matches = search(options);
+      REQUIRE(matches.size() == 1);
+      CHECK(matches[0].file == root.completeChildPath("R/a.R").getAbsolutePath());
+
+      options.includeGlobs.clear();
+      options.excludeGlobs.clear();
+      // the matches kept are the first in file and line order
+      options.maxResults = 2;
+      matches = search(options);
+      REQUIRE(matches.size() == 2);
+      CHECK(matches[0].file == root.completeChildPath("R/a.R").getAbsolutePath());
+      CHECK(matches[1].file == root.completeChildPath("R/b.Rmd").getAbsolutePath());
+      CHECK(matches[1].line == 1);
+
+      root.removeIfExists();
+   }
+}
+
+TEST_CASE("SessionReplaceEngine")
+{
+   ReplaceEngineOptions options;
+
+   SECTION("Literal matches are replaced")
+   {
+      options.find.pattern = "mpg";
+      options.replacement = "hp";
+      boost::shared_ptr<ReplaceEngine> pEngine;
+      REQUIRE_FALSE(ReplaceEngine::create(options, &pEngine));
+
+      FindMatch match;
+      match.line = 1;
+      match.contents = "select(mpg, cyl, mpg)";
+      match.ranges = { { 7, 10 }, { 17, 20 } };
+
+      ReplacedLine line;
+      pEngine->replaceLine(match, &line);
+      CHECK(line.contents == "select(hp, cyl, hp)");
+      REQUIRE(line.ranges.size() == 2);
+      CHECK(hasRange(line.ranges[0], 7, 9));
+      CHECK(hasRange(line.ranges[1], 16, 18));
+   }
+
+   SECTION("Regular expression replacements can refer to groups")
+   {
+      options.find.pattern = "\\([a-z]*\\)(\\([a-z]*\\))";
+      options.find.asRegex = true;
+      options.replacement = "\\2 |> \\1()";
+      boost::shared_ptr<ReplaceEngine> pEngine;
+      REQUIRE_FALSE(ReplaceEngine::create(options, &pEngine));
+
+      FindMatch match;
+      match.line = 1;
+      match.contents = "x <- head(mtcars)";
+      match.ranges = { { 5, 17 } };
+
+      ReplacedLine line;
+      pEngine->replaceLine(match, &line);
+      CHECK(line.contents == "x <- mtcars |> head()");
+      CHECK(hasRange(line.ranges[0], 5, 21));
+   }
+
+   SECTION("Files are rewritten in place")
+   {
+      FilePath root;
+      REQUIRE_FALSE(FilePath::tempFilePath(root));
+      REQUIRE_FALSE(root.ensureDirectory());
+
+      FilePath fileA = root.completeChildPath("a.R");
+      FilePath fileB = root.completeChildPath("b.R");
+      FilePath fileC = root.completeChildPath("c.R");
+      REQUIRE_FALSE(writeStringToFile(fileA, kContents));
+      REQUIRE_FALSE(writeStringToFile(fileB, "mpg\r\nx\r\nmpg + mpg"));
+      REQUIRE_FALSE(writeStringToFile(fileC, "cyl"));
+
+      options.find.paths.push_back(root);
+      options.find.pattern = "mpg";
+      options.replacement = "disp";
+
+      SECTION("Independently")
+      {
+      }
+
+      SECTION("All or nothing")
+      {
+         options.allOrNothing = true;
+      }
+
+      std::vector<ReplacedLine> lines = replace(options);
+      CHECK(lines.size() == 3);
+      for (const ReplacedLine& line : lines)
+         CHECK(line.error.empty());
+
+      std::string contents;
+      REQUIRE_FALSE(readStringFromFile(fileB, &contents));
+      CHECK(contents == "disp\r\nx\r\ndisp + disp");
+      REQUIRE_FALSE(readStringFromFile(fileA, &contents));
+      CHECK(contents == boost::replace_all_copy(kContents, "mpg", "disp"));
+
+      std::vector<FilePath> children;
+      REQUIRE_FALSE(root.getChildren(children));
+      CHECK(children.size() == 3);
+
+      root.removeIfExists();
+   }
+
+   SECTION("Hard linked files keep their links")
+   {
+      FilePath root;
+      REQUIRE_FALSE(FilePath::tempFilePath(root));
+      REQUIRE_FALSE(root.ensureDirectory());
+      FilePath dir = root.completeChildPath("dir");
+      REQUIRE_FALSE(dir.ensureDirectory());
+
+      FilePath file = dir.completeChildPath("a.R");
+      FilePath link = root.completeChildPath("link.R");
+      REQUIRE_FALSE(writeStringToFile(file, "mpg\ncyl\n"));
+      boost::system::error_code ec;
+      boost::filesystem::create_hard_link(file.getAbsolutePath(), link.getAbsolutePath(), ec);
+      REQUIRE_FALSE(ec);
+
+      options.find.paths.push_back(dir);
+      options.find.pattern = "mpg";
+      options.replacement = "disp";
+
+      SECTION("Independently")
+      {
+      }
+
+      SECTION("All or nothing")
+      {
+         options.allOrNothing = true;
+      }
+
+      std::vector<ReplacedLine> lines = replace(options);
+      REQUIRE(lines.size() == 1);
+      CHECK(lines[0].error.empty());
+
+      std::string contents;
+      REQUIRE_FALSE(readStringFromFile(link, &contents));
+      CHECK(contents == "disp\ncyl\n");
+
+      std::vector<FilePath> children;
+      REQUIRE_FALSE(dir.getChildren(children));
+      CHECK(children.size() == 1);
+
+      root.removeIfExists();
+   }
+#ifndef _WIN32
+   SECTION("Files aren't touched when backing them up fails")
+   {
+      FilePath root;
+      REQUIRE_FALSE(FilePath::tempFilePath(root));
+      REQUIRE_FALSE(root.ensureDirectory());
+      FilePath dir = root.completeChildPath("dir");
+      REQUIRE_FALSE(dir.ensureDirectory());
+
+      // a hard linked file, so it's rewritten in place
+      std::string original;
+      for (int i = 0; i < 1024; i++)
+         original += "mpg\n";
+      FilePath file = dir.completeChildPath("a.R");
+      FilePath link = root.completeChildPath("link.R");
+      REQUIRE_FALSE(writeStringToFile(file, original));
+      boost::system::error_code ec;
+      boost::filesystem::create_hard_link(file.getAbsolutePath(), link.getAbsolutePath(), ec);
+      REQUIRE_FALSE(ec);
+
+      options.find.paths.push_back(dir);
+      options.find.pattern = "mpg";
+      options.replacement = "x";
+      options.allOrNothing = true;
+
+      // files can be written up to a size which fits the new contents but
+      // not a backup of the original, as if the disk filled up
+      struct rlimit limit;
+      REQUIRE(::getrlimit(RLIMIT_FSIZE, &limit) == 0);
+      struct rlimit lowered = limit;
+      lowered.rlim_cur = original.size() * 3 / 4;
+      void (*previousHandler)(int) = ::signal(SIGXFSZ, SIG_IGN);
+      REQUIRE(::setrlimit(RLIMIT_FSIZE, &lowered) == 0);
+
+      boost::shared_ptr<ReplaceEngine> pEngine;
+      Error error = ReplaceEngine::create(options, &pEngine);
+      std::vector<ReplacedLine> lines;
+      if (!error)
+      {
+         pEngine->start();
+         pEngine->wait();
+         pEngine->takeLines(&lines);
+      }
+
+      ::setrlimit(RLIMIT_FSIZE, &limit);
+      ::signal(SIGXFSZ, previousHandler);
+
+      REQUIRE_FALSE(error);
+      REQUIRE(lines.size() == 1024);
+      CHECK_FALSE(lines[0].error.empty());
+      CHECK(pEngine->replacedCount() == 0);
+
+      std::string contents;
+      REQUIRE_FALSE(readStringFromFile(file, &contents));
+      CHECK(contents == original);
+      REQUIRE_FALSE(readStringFromFile(link, &contents));
+      CHECK(contents == original);
+
+      std::vector<FilePath> children;
+      REQUIRE_FALSE(dir.getChildren(children));
+      CHECK(children.size() == 1);
+
+      root.removeIfExists();
+   }
+#endif
+}
+
+} // namespace tests
+} // namespace find
+} // namespace modules
+} // namespace session
+} // namespace rstudio
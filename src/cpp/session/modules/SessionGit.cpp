@@ -14,6 +14,8 @@
  */
 #include "SessionGit.hpp"
 
+#include <atomic>
+
 #include <gsl/gsl>
 
 #include <signal.h>
@@ -52,6 +54,7 @@
 #include <core/GitGraph.hpp>
 #include <core/Scope.hpp>
 #include <core/StringUtils.hpp>
+#include <core/Thread.hpp>
 
 
 #include <r/RExec.hpp>
@@ -67,6 +70,7 @@
 #include "SessionVCS.hpp"
 
 #include "vcs/SessionVCSCore.hpp"
+#include "vcs/SessionVCSStatusCache.hpp"
 #include "vcs/SessionVCSUtils.hpp"
 
 #include "session-config.h"
@@ -393,6 +397,53 @@ bool isUntracked(const source_control::StatusResult& statusResult,
    return statusResult.getStatus(filePath).status() == "??";
 }
 
+ShellArgs statusArgs(const FilePath& dir)
+{
+   return gitArgs() << "status" << "-z" << "--porcelain" << "--" << dir;
+}
+
+// parses the output of git status (see statusArgs)
+void parseStatus(const std::string& output,
+                 const FilePath& root,
+                 StatusResult* pStatusResult)
+{
+   std::vector<FileWithStatus> files;
+
+   // split and parse each piece of status output
+   std::vector<std::string> pieces = core::algorithm::split(output, "\0");
+
+   for (std::vector<std::string>::iterator it = pieces.begin();
+        it != pieces.end();
+        it++)
+   {
+      std::string line = *it;
+      if (line.length() < 4)
+         continue;
+      FileWithStatus file;
+
+      std::string status = line.substr(0, 2);
+      std::string filePath = line.substr(3);
+      file.status = status;
+      
+      // if this was a git rename or copy, we need to capture the rename target from the next
+      // field. note that Git flips the order of filenames when running with '-z'
+      if (status == "R " || status == "C ")
+         filePath = *(++it) + " -> " + filePath;
+
+      // remove trailing slashes
+      if (filePath.length() > 1 && filePath[filePath.length() - 1] == '/')
+         filePath = filePath.substr(0, filePath.size() - 1);
+
+      // file paths are returned as UTF-8 encoded paths,
+      // so no need to re-encode here
+      file.path = root.completeChildPath(filePath);
+
+      files.push_back(file);
+   }
+
+   *pStatusResult = StatusResult(files);
+}
+
 class Git : public boost::noncopyable
 {
 private:
@@ -515,55 +566,12 @@ public:
    core::Error status(const FilePath& dir,
                       StatusResult* pStatusResult)
    {
-      using namespace boost;
-
-      // objects to be populated from git's output
-      std::vector<FileWithStatus> files;
-      
-      // build shell arguments
-      ShellArgs arguments = gitArgs();
-      
-      arguments << "status" << "-z" << "--porcelain" << "--" << dir;
-      
       std::string output;
-      Error error = runGit(arguments, &output);
+      Error error = runGit(statusArgs(dir), &output);
       if (error)
          return error;
-      
-      // split and parse each piece of status output
-      std::vector<std::string> pieces = core::algorithm::split(output, "\0");
-
-      for (std::vector<std::string>::iterator it = pieces.begin();
-           it != pieces.end();
-           it++)
-      {
-         std::string line = *it;
-         if (line.length() < 4)
-            continue;
-         FileWithStatus file;
-
-         std::string status = line.substr(0, 2);
-         std::string filePath = line.substr(3);
-         file.status = status;
-         
-         // if this was a git rename or copy, we need to capture the rename target from the next
-         // field. note that Git flips the order of filenames when running with '-z'
-         if (status == "R " || status == "C ")
-            filePath = *(++it) + " -> " + filePath;
-
-         // remove trailing slashes
-         if (filePath.length() > 1 && filePath[filePath.length() - 1] == '/')
-            filePath = filePath.substr(0, filePath.size() - 1);
-
-         // file paths are returned as UTF-8 encoded paths,
-         // so no need to re-encode here
-         file.path = root_.completeChildPath(filePath);
-
-         files.push_back(file);
-      }
-
-      *pStatusResult = StatusResult(files);
 
+      parseStatus(output, root_, pStatusResult);
       return Success();
    }
 
@@ -1482,6 +1490,111 @@ public:
 
 Git s_git_;
 
+// status of the files in the repository (see initializeGit)
+boost::shared_ptr<source_control::StatusCache> s_pStatusCache;
+
+// the command the status cache runs (on its refresh thread) to list the
+// status of the repository. It's built on the main thread, since building
+// it reads the environment, git's path and the project, and replaced when
+// the path to git changes.
+struct StatusCommand
+{
+   FilePath root;
+   core::system::ProcessOptions options;
+#ifdef _WIN32
+   std::string program;
+   std::vector<std::string> args;
+#else
+   std::string command;
+#endif
+};
+
+boost::mutex s_statusCommandMutex;
+boost::shared_ptr<const StatusCommand> s_pStatusCommand;
+
+#ifdef __APPLE__
+// set when the status command fails as though the xcode license hasn't been
+// accepted (which is checked for the next time the status is asked for)
+std::atomic<bool> s_checkXcodeLicense(false);
+#endif
+
+void updateStatusCommand()
+{
+   if (s_git_.root().isEmpty())
+      return;
+
+   boost::shared_ptr<StatusCommand> pCommand(new StatusCommand());
+   pCommand->root = s_git_.root();
+   pCommand->options = procOptions();
+   pCommand->options.workingDir = s_git_.root();
+#ifdef _WIN32
+   pCommand->options.detachProcess = true;
+   pCommand->program = gitBin();
+   pCommand->args = statusArgs(s_git_.root()).args();
+#else
+   pCommand->command = (git() << statusArgs(s_git_.root()).args()).string();
+#endif
+
+   LOCK_MUTEX(s_statusCommandMutex)
+   {
+      s_pStatusCommand = pCommand;
+   }
+   END_LOCK_MUTEX
+}
+
+// runs on the status cache's refresh thread, so uses nothing but the status
+// command (unlike gitExec it doesn't wait for the index lock, which git
+// status doesn't need)
+Error rootStatus(StatusResult* pStatusResult)
+{
+   boost::shared_ptr<const StatusCommand> pCommand;
+   LOCK_MUTEX(s_statusCommandMutex)
+   {
+      pCommand = s_pStatusCommand;
+   }
+   END_LOCK_MUTEX
+
+   core::system::ProcessResult result;
+#ifdef _WIN32
+   Error error = runProgram(pCommand->program,
+                            pCommand->args,
+                            "",
+                            pCommand->options,
+                            &result);
+#else
+   Error error = runCommand(pCommand->command, "", pCommand->options, &result);
+#endif
+   if (error)
+      return error;
+
+#ifdef __APPLE__
+   if (result.exitStatus == 69)
+      s_checkXcodeLicense = true;
+#endif
+
+   if (result.exitStatus != EXIT_SUCCESS && !result.stdErr.empty())
+      LOG_DEBUG_MESSAGE(result.stdErr);
+
+   parseStatus(result.stdOut, pCommand->root, pStatusResult);
+   return Success();
+}
+
+// invalidates the status (as well as refreshing the client) once an
+// operation which changes it completes
+struct InvalidateOnExit : public RefreshOnExit
+{
+   ~InvalidateOnExit()
+   {
+      try
+      {
+         git::invalidateStatus();
+      }
+      catch(...)
+      {
+      }
+   }
+};
+
 FilePath resolveAliasedPath(const std::string& path)
 {
    if (boost::algorithm::starts_with(path, "~/"))
@@ -1609,11 +1722,22 @@ core::Error status(const FilePath& dir, StatusResult* pStatusResult)
    if (s_git_.root().isEmpty())
       return Success();
 
+#ifdef __APPLE__
+   if (s_checkXcodeLicense.exchange(false))
+      module_context::checkXcodeLicense();
+#endif
+
+   if (s_pStatusCache && dir.isWithin(s_git_.root()))
+      return s_pStatusCache->status(dir, pStatusResult);
+
    return s_git_.status(dir, pStatusResult);
 }
 
 Error fileStatus(const FilePath& filePath, VCSStatus* pStatus)
 {
+   if (s_pStatusCache && filePath.isWithin(s_git_.root()))
+      return s_pStatusCache->fileStatus(filePath, pStatus);
+
    StatusResult statusResult;
    Error error = git::status(filePath.getParent(), &statusResult);
    if (error)
@@ -1624,12 +1748,18 @@ Error fileStatus(const FilePath& filePath, VCSStatus* pStatus)
    return Success();
 }
 
+void invalidateStatus()
+{
+   if (s_pStatusCache)
+      s_pStatusCache->invalidate();
+}
+
 namespace {
 
 Error vcsAdd(const json::JsonRpcRequest& request,
              json::JsonRpcResponse* pResponse)
 {
-   RefreshOnExit refreshOnExit;
+   InvalidateOnExit invalidateOnExit;
 
    json::Array paths;
    Error error = json::readParam(request.params, 0, &paths);
@@ -1642,7 +1772,7 @@ Error vcsAdd(const json::JsonRpcRequest& request,
 Error vcsRemove(const json::JsonRpcRequest& request,
                 json::JsonRpcResponse* pResponse)
 {
-   RefreshOnExit refreshOnExit;
+   InvalidateOnExit invalidateOnExit;
 
    json::Array paths;
    Error error = json::readParam(request.params, 0, &paths);
@@ -1655,7 +1785,7 @@ Error vcsRemove(const json::JsonRpcRequest& request,
 Error vcsDiscard(const json::JsonRpcRequest& request,
                  json::JsonRpcResponse* pResponse)
 {
-   RefreshOnExit refreshOnExit;
+   InvalidateOnExit invalidateOnExit;
 
    json::Array paths;
    Error error = json::readParam(request.params, 0, &paths);
@@ -1668,7 +1798,7 @@ Error vcsDiscard(const json::JsonRpcRequest& request,
 Error vcsRevert(const json::JsonRpcRequest& request,
                 json::JsonRpcResponse* pResponse)
 {
-   RefreshOnExit refreshOnExit;
+   InvalidateOnExit invalidateOnExit;
 
    json::Array paths;
    Error error = json::readParam(request.params, 0, &paths);
@@ -1688,7 +1818,7 @@ Error vcsRevert(const json::JsonRpcRequest& request,
 Error vcsStage(const json::JsonRpcRequest& request,
                json::JsonRpcResponse* pResponse)
 {
-   RefreshOnExit refreshOnExit;
+   InvalidateOnExit invalidateOnExit;
 
    json::Array paths;
    Error error = json::readParam(request.params, 0, &paths);
@@ -1701,7 +1831,7 @@ Error vcsStage(const json::JsonRpcRequest& request,
 Error vcsUnstage(const json::JsonRpcRequest& request,
                  json::JsonRpcResponse* pResponse)
 {
-   RefreshOnExit refreshOnExit;
+   InvalidateOnExit invalidateOnExit;
 
    json::Array paths;
    Error error = json::readParam(request.params, 0, &paths);
@@ -1798,7 +1928,7 @@ Error vcsFullStatus(const json::JsonRpcRequest&,
                     json::JsonRpcResponse* pResponse)
 {
    StatusResult statusResult;
-   Error error = s_git_.status(s_git_.root(), &statusResult);
+   Error error = git::status(s_git_.root(), &statusResult);
    if (error)
       return error;
 
@@ -2001,7 +2131,7 @@ Error vcsDiffFile(const json::JsonRpcRequest& request,
 Error vcsApplyPatch(const json::JsonRpcRequest& request,
                     json::JsonRpcResponse* pResponse)
 {
-   RefreshOnExit refreshOnExit;
+   InvalidateOnExit invalidateOnExit;
 
    std::string patch;
    int mode;
@@ -2067,7 +2197,7 @@ Error vcsGetIgnores(const json::JsonRpcRequest& request,
 Error vcsSetIgnores(const json::JsonRpcRequest& request,
                     json::JsonRpcResponse* pResponse)
 {
-   RefreshOnExit refreshOnExit;
+   InvalidateOnExit invalidateOnExit;
 
    // get the params
    std::string path, ignores;
@@ -2953,6 +3083,38 @@ Error detectAndSaveGitExePath()
 
 #endif
 
+void onFileMonitorEnabled(const tree<core::FileInfo>& files)
+{
+   // changes are only all reported when the project contains the repository
+   if (s_pStatusCache &&
+       s_git_.root().isWithin(projects::projectContext().directory()))
+   {
+      s_pStatusCache->setMonitored(true);
+   }
+}
+
+void onFilesChanged(const std::vector<core::system::FileChangeEvent>& events)
+{
+   if (!s_pStatusCache)
+      return;
+
+   for (const core::system::FileChangeEvent& event : events)
+   {
+      FilePath filePath(event.fileInfo().absolutePath());
+      if (filePath.isWithin(s_git_.root()))
+      {
+         s_pStatusCache->invalidate();
+         break;
+      }
+   }
+}
+
+void onFileMonitorDisabled()
+{
+   if (s_pStatusCache)
+      s_pStatusCache->setMonitored(false);
+}
+
 void onShutdown(bool)
 {
    std::for_each(s_pidsToTerminate_.begin(), s_pidsToTerminate_.end(),
@@ -3176,6 +3338,8 @@ void onUserSettingsChanged(const std::string& layer, const std::string& pref)
       s_gitExePath = "";
 #endif
    }
+
+   updateStatusCommand();
 }
 
 Error statusToJson(const core::FilePath &path,
@@ -3297,6 +3461,18 @@ core::Error initializeGit(const core::FilePath& workingDir)
       Error error = augmentGitIgnore(gitIgnore);
       if (error)
          LOG_ERROR(error);
+
+      // the index and HEAD are written when files are staged, committed or
+      // checked out (including from the terminal)
+      std::vector<FilePath> stampFiles;
+      stampFiles.push_back(s_git_.root().completeChildPath(".git/index"));
+      stampFiles.push_back(s_git_.root().completeChildPath(".git/HEAD"));
+      updateStatusCommand();
+      s_pStatusCache.reset(new source_control::StatusCache(rootStatus, stampFiles));
+
+      // listings may have been answered with a stale status while it was
+      // refreshed; have the client ask again once it's changed
+      s_pStatusCache->setRefreshedHandler(boost::bind(&enqueueRefreshEvent));
    }
 
    return Success();
@@ -3373,6 +3549,13 @@ core::Error initialize()
    // add settings changed handler
    prefs::userPrefs().onChanged.connect(onUserSettingsChanged);
 
+   // invalidate the status when files in the project change
+   projects::FileMonitorCallbacks cb;
+   cb.onMonitoringEnabled = onFileMonitorEnabled;
+   cb.onFilesChanged = onFilesChanged;
+   cb.onMonitoringDisabled = onFileMonitorDisabled;
+   projects::projectContext().subscribeToFileMonitor("Git status", cb);
+
    // install rpc methods
    using boost::bind;
    using namespace module_context;
@@ -72,6 +72,10 @@ core::Error status(const core::FilePath& dir,
                    source_control::StatusResult* pStatusResult);
 core::Error fileStatus(const core::FilePath& filePath,
                        source_control::VCSStatus* pStatus);
+
+// files in the repository have changed; the next status query (or a
+// background refresh) runs git status again
+void invalidateStatus();
 core::Error statusToJson(const core::FilePath& path,
                          const source_control::VCSStatus& vcsStatus,
                          core::json::Object* pObject);
@@ -91,34 +91,6 @@ void attemptRhistoryMigration()
       LOG_ERROR(error);
 }
 
-// simple reader for parsing lines of history file
-ReadCollectionAction readHistoryEntry(const std::string& line,
-                                      HistoryEntry* pEntry,
-                                      int* pNextIndex)
-{
-   // if the line doesn't have a ':' then ignore it
-   if (line.find(':') == std::string::npos)
-      return ReadCollectionIgnoreLine;
-
-   pEntry->index = (*pNextIndex)++;
-   std::istringstream istr(line);
-   istr >> pEntry->timestamp ;
-   istr.ignore(1, ':');
-   std::getline(istr, pEntry->command);
-
-   // if we had a read failure log it and return ignore state
-   if (!istr.fail())
-   {
-      return ReadCollectionAddLine;
-   }
-   else
-   {
-      LOG_ERROR_MESSAGE("unexpected io error reading history line: " +
-                        line);
-      return ReadCollectionIgnoreLine;
-   }
-}
-
 } // anonymous namespace
 
 HistoryArchive& historyArchive()
@@ -129,15 +101,11 @@ HistoryArchive& historyArchive()
 
 Error HistoryArchive::add(const std::string& command)
 {
-   // reset the cache (since this write will invalidate the current one,
-   // no sense in keeping our cache around in memory)
-   entries_.clear();
-   entryCacheLastWriteTime_ = -1;
-
    // rotate if necessary
    rotateHistoryDatabase();
 
-   // write the entry to the file
+   // write the entry to the file (the cache picks it up from there the next
+   // time it's read, along with anything appended by other sessions)
    std::ostringstream ostrEntry ;
    double currentTime = core::date_time::millisecondsSinceEpoch();
    writeEntry(currentTime, command, &ostrEntry);
@@ -146,6 +114,33 @@ Error HistoryArchive::add(const std::string& command)
 }
 
 const std::vector<HistoryEntry>& HistoryArchive::entries() const
+{
+   update();
+   return index_.entries();
+}
+
+std::vector<HistoryEntry> HistoryArchive::search(
+                                 const std::vector<std::string>& terms,
+                                 std::size_t maxEntries) const
+{
+   update();
+   std::vector<HistoryEntry> matches;
+   index_.search(terms, maxEntries, &matches);
+   return matches;
+}
+
+std::vector<HistoryEntry> HistoryArchive::searchByPrefix(
+                                 const std::string& prefix,
+                                 std::size_t maxEntries,
+                                 bool uniqueOnly) const
+{
+   update();
+   std::vector<HistoryEntry> matches;
+   index_.searchByPrefix(prefix, maxEntries, uniqueOnly, &matches);
+   return matches;
+}
+
+void HistoryArchive::update() const
 {
    // calculate path to history db
    FilePath historyDBPath = historyDatabaseFilePath();
@@ -153,54 +148,45 @@ const std::vector<HistoryEntry>& HistoryArchive::entries() const
    // if the file doesn't exist then clear the collection
    if (!historyDBPath.exists())
    {
-      entries_.clear();
+      index_.clear();
+      readOffset_ = 0;
+      rotatedSize_ = 0;
+      rotatedLastWriteTime_ = -1;
+      return;
    }
 
-   // otherwise check for divergent lastWriteTime and read the file
-   // if our internal list isn't up to date
-   else if (historyDBPath.getLastWriteTime() != entryCacheLastWriteTime_)
+   // the history db is only ever appended to until it's rotated (by this or
+   // another session), so unless it has been we only need to read what was
+   // appended since we last read it
+   FilePath rotatedHistoryDBPath = historyDatabaseRotatedFilePath();
+   bool rotatedExists = rotatedHistoryDBPath.exists();
+   uintmax_t rotatedSize = rotatedExists ? rotatedHistoryDBPath.getSize() : 0;
+   std::time_t rotatedLastWriteTime =
+         rotatedExists ? rotatedHistoryDBPath.getLastWriteTime() : -1;
+
+   if (rotatedSize != rotatedSize_ ||
+       rotatedLastWriteTime != rotatedLastWriteTime_ ||
+       historyDBPath.getSize() < readOffset_)
    {
-      entries_.clear();
-
-      // establish a next index counter
-      int nextIndex = 0;
+      index_.clear();
+      readOffset_ = 0;
+      rotatedSize_ = rotatedSize;
+      rotatedLastWriteTime_ = rotatedLastWriteTime;
 
       // first read from rotated file if it exists
-      FilePath rotatedHistoryDBPath = historyDatabaseRotatedFilePath();
-      if (rotatedHistoryDBPath.exists())
+      if (rotatedExists)
       {
-         Error error = readCollectionFromFile<std::vector<HistoryEntry> >(
-                           rotatedHistoryDBPath,
-                           &entries_,
-                           boost::bind(readHistoryEntry, _1, _2, &nextIndex));
+         uint64_t rotatedOffset = 0;
+         Error error = index_.read(rotatedHistoryDBPath, false, &rotatedOffset);
          if (error)
             LOG_ERROR(error);
       }
-
-
-      // now read from main history db
-      std::vector<HistoryEntry> entries;
-      Error error = readCollectionFromFile<std::vector<HistoryEntry> >(
-                           historyDBPath,
-                           &entries,
-                           boost::bind(readHistoryEntry, _1, _2, &nextIndex));
-      if (error)
-      {
-         LOG_ERROR(error);
-      }
-      else
-      {
-         std::copy(entries.begin(),
-                   entries.end(),
-                   std::back_inserter(entries_));
-
-         entryCacheLastWriteTime_ = historyDBPath.getLastWriteTime();
-      }
-
    }
 
-   // return entries
-   return entries_;
+   // now read from main history db
+   Error error = index_.read(historyDBPath, true, &readOffset_);
+   if (error)
+      LOG_ERROR(error);
 }
 
 void HistoryArchive::migrateRhistoryIfNecessary()
@@ -16,11 +16,16 @@
 #ifndef SESSION_HISTORY_ARCHIVE_HPP
 #define SESSION_HISTORY_ARCHIVE_HPP
 
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
 #include <string>
 #include <vector>
 
 #include <boost/utility.hpp>
 
+#include "SessionHistoryIndex.hpp"
+
 namespace rstudio {
 namespace core {
    class Error;
@@ -33,25 +38,13 @@ namespace session {
 namespace modules { 
 namespace history {
    
-struct HistoryEntry
-{
-   HistoryEntry() : index(0), timestamp(0) {}
-   HistoryEntry(int index, double timestamp, const std::string& command)
-      : index(index), timestamp(timestamp), command(command)
-   {
-   }
-   int index;
-   double timestamp;
-   std::string command;
-};
-
 class HistoryArchive;
 HistoryArchive& historyArchive();
 
 class HistoryArchive : boost::noncopyable
 {
 private:
-   HistoryArchive() : entryCacheLastWriteTime_(-1) {}
+   HistoryArchive() : readOffset_(0), rotatedSize_(0), rotatedLastWriteTime_(-1) {}
    friend HistoryArchive& historyArchive();
 
 public:
@@ -61,9 +54,26 @@ public:
    core::Error add(const std::string& command);
    const std::vector<HistoryEntry>& entries() const;
 
+   // the most recent entries containing all of the terms
+   std::vector<HistoryEntry> search(const std::vector<std::string>& terms,
+                                    std::size_t maxEntries) const;
+
+   // the most recent entries starting with the prefix
+   std::vector<HistoryEntry> searchByPrefix(const std::string& prefix,
+                                            std::size_t maxEntries,
+                                            bool uniqueOnly) const;
+
+private:
+   void update() const;
+
 private:
-   mutable time_t entryCacheLastWriteTime_;
-   mutable std::vector<HistoryEntry> entries_;
+   mutable HistoryIndex index_;
+
+   // how much of the history database has been read, and the rotated
+   // database it was read along with
+   mutable uint64_t readOffset_;
+   mutable uintmax_t rotatedSize_;
+   mutable std::time_t rotatedLastWriteTime_;
 };
                        
 } // namespace history
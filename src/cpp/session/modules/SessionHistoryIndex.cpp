@@ -0,0 +1,280 @@
+/*
+ * SessionHistoryIndex.cpp
+ *
+ * Copyright (C) 2020 by RStudio, PBC
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include "SessionHistoryIndex.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <set>
+
+#include <boost/algorithm/string/predicate.hpp>
+#include <boost/iostreams/device/mapped_file.hpp>
+
+#include <shared_core/Error.hpp>
+#include <shared_core/FilePath.hpp>
+#include <core/Log.hpp>
+
+using namespace rstudio::core;
+
+namespace rstudio {
+namespace session {
+namespace modules {
+namespace history {
+
+namespace {
+
+uint32_t packBytes(const char* pBytes, std::size_t n)
+{
+   uint32_t key = 0;
+   for (std::size_t i = 0; i < n; i++)
+      key = (key << 8) | static_cast<unsigned char>(pBytes[i]);
+   return key;
+}
+
+uint32_t trigramKey(const char* pBytes)
+{
+   return packBytes(pBytes, 3);
+}
+
+// prefixes of different lengths are told apart by their length
+uint32_t prefixKey(const char* pBytes, std::size_t n)
+{
+   return (static_cast<uint32_t>(n) << 24) | packBytes(pBytes, n);
+}
+
+void addPosting(uint32_t key,
+                uint32_t index,
+                std::unordered_map<uint32_t, std::vector<uint32_t>>* pMap)
+{
+   // entries are added in order, so an entry already recorded for a key
+   // (e.g. a command containing the same sequence twice) is the last one
+   std::vector<uint32_t>& postings = (*pMap)[key];
+   if (postings.empty() || postings.back() != index)
+      postings.push_back(index);
+}
+
+bool containsAll(const std::string& command, const std::vector<std::string>& terms)
+{
+   for (const std::string& term : terms)
+   {
+      if (!boost::algorithm::contains(command, term))
+         return false;
+   }
+   return true;
+}
+
+} // anonymous namespace
+
+void HistoryIndex::clear()
+{
+   entries_.clear();
+   trigrams_.clear();
+   prefixes_.clear();
+}
+
+void HistoryIndex::add(double timestamp, const std::string& command)
+{
+   uint32_t index = static_cast<uint32_t>(entries_.size());
+   entries_.push_back(HistoryEntry(static_cast<int>(index), timestamp, command));
+
+   const char* pCommand = command.data();
+   for (std::size_t i = 0; i + 3 <= command.size(); i++)
+      addPosting(trigramKey(pCommand + i), index, &trigrams_);
+
+   for (std::size_t n = 1; n <= std::min<std::size_t>(3, command.size()); n++)
+      addPosting(prefixKey(pCommand, n), index, &prefixes_);
+}
+
+Error HistoryIndex::read(const FilePath& historyDBPath,
+                         bool appending,
+                         uint64_t* pOffset)
+{
+   uint64_t size = historyDBPath.getSize();
+   if (size <= *pOffset)
+      return Success();
+
+   // map from the page holding the offset through to the end of the file
+   boost::iostreams::mapped_file_source mappedFile;
+   uint64_t mapOffset = *pOffset - (*pOffset % mappedFile.alignment());
+   try
+   {
+      mappedFile.open(historyDBPath.getAbsolutePath(),
+                      static_cast<std::size_t>(size - mapOffset),
+                      static_cast<boost::iostreams::stream_offset>(mapOffset));
+   }
+   catch (const std::exception& e)
+   {
+      Error error = systemError(boost::system::errc::io_error,
+                                e.what(),
+                                ERROR_LOCATION);
+      error.addProperty("path", historyDBPath);
+      return error;
+   }
+
+   const char* pBegin = mappedFile.data() + (*pOffset - mapOffset);
+   const char* pEnd = mappedFile.data() + mappedFile.size();
+
+   const char* pLine = pBegin;
+   while (pLine < pEnd)
+   {
+      const char* pNewline = static_cast<const char*>(
+               std::memchr(pLine, '\n', pEnd - pLine));
+      if (pNewline == nullptr)
+      {
+         // the last line may still be being written
+         if (appending)
+            break;
+         pNewline = pEnd;
+      }
+
+      addLine(pLine, pNewline);
+      pLine = std::min(pNewline + 1, pEnd);
+   }
+
+   *pOffset += pLine - pBegin;
+   return Success();
+}
+
+void HistoryIndex::addLine(const char* pBegin, const char* pEnd)
+{
+   // strip the line terminator (the command's own whitespace is kept)
+   if (pEnd > pBegin && *(pEnd - 1) == '\r')
+      --pEnd;
+
+   // ignore blank lines, and lines without a ':'
+   std::string line(pBegin, pEnd);
+   if (line.empty() || line.find(':') == std::string::npos)
+      return;
+
+   // lines are of the form <timestamp>:<command>
+   const char* pTimestamp = line.c_str();
+   char* pTimestampEnd = nullptr;
+   double timestamp = std::strtod(pTimestamp, &pTimestampEnd);
+   if (pTimestampEnd == pTimestamp)
+   {
+      LOG_ERROR_MESSAGE("unexpected io error reading history line: " + line);
+      return;
+   }
+
+   std::size_t commandOffset = pTimestampEnd - pTimestamp;
+   if (commandOffset < line.size())
+      commandOffset++;
+
+   add(timestamp, line.substr(commandOffset));
+}
+
+const HistoryIndex::Postings* HistoryIndex::leastCommonTrigram(
+                                    const std::string& term,
+                                    const Postings* pCandidates,
+                                    bool* pNoMatches) const
+{
+   for (std::size_t i = 0; i + 3 <= term.size(); i++)
+   {
+      PostingsMap::const_iterator it = trigrams_.find(trigramKey(term.data() + i));
+      if (it == trigrams_.end())
+      {
+         *pNoMatches = true;
+         return nullptr;
+      }
+
+      if (pCandidates == nullptr || it->second.size() < pCandidates->size())
+         pCandidates = &it->second;
+   }
+   return pCandidates;
+}
+
+void HistoryIndex::search(const std::vector<std::string>& terms,
+                          std::size_t maxEntries,
+                          std::vector<HistoryEntry>* pMatches) const
+{
+   // find the fewest entries which could contain every term: the entries
+   // containing the least common 3 byte sequence of any of the terms
+   const Postings* pCandidates = nullptr;
+   bool noMatches = false;
+   for (const std::string& term : terms)
+   {
+      pCandidates = leastCommonTrigram(term, pCandidates, &noMatches);
+      if (noMatches)
+         return;
+   }
+
+   forEachCandidate(pCandidates, maxEntries, pMatches, [&](const HistoryEntry& entry) {
+      return containsAll(entry.command, terms);
+   });
+}
+
+void HistoryIndex::searchByPrefix(const std::string& prefix,
+                                  std::size_t maxEntries,
+                                  bool uniqueOnly,
+                                  std::vector<HistoryEntry>* pMatches) const
+{
+   // the entries starting with the first few bytes of the prefix, or
+   // containing a less common 3 byte sequence of it
+   const Postings* pCandidates = nullptr;
+   if (!prefix.empty())
+   {
+      PostingsMap::const_iterator it = prefixes_.find(
+               prefixKey(prefix.data(), std::min<std::size_t>(3, prefix.size())));
+      if (it == prefixes_.end())
+         return;
+
+      bool noMatches = false;
+      pCandidates = leastCommonTrigram(prefix, &it->second, &noMatches);
+      if (noMatches)
+         return;
+   }
+
+   std::set<std::string> matchedCommands;
+   forEachCandidate(pCandidates, maxEntries, pMatches, [&](const HistoryEntry& entry) {
+      return boost::algorithm::starts_with(entry.command, prefix) &&
+             (!uniqueOnly || matchedCommands.insert(entry.command).second);
+   });
+}
+
+void HistoryIndex::forEachCandidate(
+               const Postings* pCandidates,
+               std::size_t maxEntries,
+               std::vector<HistoryEntry>* pMatches,
+               const std::function<bool(const HistoryEntry&)>& matches) const
+{
+   // without candidates to look at (e.g. when there are no terms long enough
+   // to look up), look at every entry
+   if (pCandidates == nullptr)
+   {
+      for (std::vector<HistoryEntry>::const_reverse_iterator it = entries_.rbegin();
+           it != entries_.rend() && pMatches->size() < maxEntries;
+           ++it)
+      {
+         if (matches(*it))
+            pMatches->push_back(*it);
+      }
+      return;
+   }
+
+   for (Postings::const_reverse_iterator it = pCandidates->rbegin();
+        it != pCandidates->rend() && pMatches->size() < maxEntries;
+        ++it)
+   {
+      const HistoryEntry& entry = entries_[*it];
+      if (matches(entry))
+         pMatches->push_back(entry);
+   }
+}
+
+} // namespace history
+} // namespace modules
+} // namespace session
+} // namespace rstudio
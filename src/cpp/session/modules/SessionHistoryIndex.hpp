@@ -0,0 +1,121 @@
+/*
+ * SessionHistoryIndex.hpp
+ *
+ * Copyright (C) 2020 by RStudio, PBC
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef SESSION_HISTORY_INDEX_HPP
+#define SESSION_HISTORY_INDEX_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <boost/utility.hpp>
+
+namespace rstudio {
+namespace core {
+   class Error;
+   class FilePath;
+}
+}
+
+namespace rstudio {
+namespace session {
+namespace modules {
+namespace history {
+
+struct HistoryEntry
+{
+   HistoryEntry() : index(0), timestamp(0) {}
+   HistoryEntry(int index, double timestamp, const std::string& command)
+      : index(index), timestamp(timestamp), command(command)
+   {
+   }
+   int index;
+   double timestamp;
+   std::string command;
+};
+
+// The entries of the history database, along with indexes of the 3 byte
+// sequences each command contains and the first 1-3 bytes each starts
+// with, so searches only need to look at the entries which could match
+// rather than at every entry. Entries are read incrementally from memory
+// mapped history database files, so reading what's been appended to a
+// file since it was last read costs only as much as what was appended.
+class HistoryIndex : boost::noncopyable
+{
+public:
+   HistoryIndex() {}
+
+   void clear();
+
+   void add(double timestamp, const std::string& command);
+
+   const std::vector<HistoryEntry>& entries() const { return entries_; }
+
+   // add the entries from the lines of a history database file starting at
+   // *pOffset, advancing *pOffset past them; for files which may still be
+   // appended to, a final line without a newline is left for the next read
+   core::Error read(const core::FilePath& historyDBPath,
+                    bool appending,
+                    uint64_t* pOffset);
+
+   // the most recent entries (most recent first) containing all of the terms
+   void search(const std::vector<std::string>& terms,
+               std::size_t maxEntries,
+               std::vector<HistoryEntry>* pMatches) const;
+
+   // the most recent entries (most recent first) starting with the prefix
+   void searchByPrefix(const std::string& prefix,
+                       std::size_t maxEntries,
+                       bool uniqueOnly,
+                       std::vector<HistoryEntry>* pMatches) const;
+
+private:
+   typedef std::vector<uint32_t> Postings;
+   typedef std::unordered_map<uint32_t, Postings> PostingsMap;
+
+   void addLine(const char* pBegin, const char* pEnd);
+
+   // the postings for the least common 3 byte sequence in the term, if less
+   // common than the candidates given; pNoMatches is set if a sequence in
+   // the term appears in no entries
+   const Postings* leastCommonTrigram(const std::string& term,
+                                      const Postings* pCandidates,
+                                      bool* pNoMatches) const;
+
+   // add the candidates which match, most recent first (every entry is a
+   // candidate when pCandidates is null)
+   void forEachCandidate(const Postings* pCandidates,
+                         std::size_t maxEntries,
+                         std::vector<HistoryEntry>* pMatches,
+                         const std::function<bool(const HistoryEntry&)>& matches) const;
+
+private:
+   std::vector<HistoryEntry> entries_;
+
+   // the indexes of the entries containing each 3 byte sequence, and of
+   // those starting with each 1-3 byte prefix
+   PostingsMap trigrams_;
+   PostingsMap prefixes_;
+};
+
+} // namespace history
+} // namespace modules
+} // namespace session
+} // namespace rstudio
+
+#endif // SESSION_HISTORY_INDEX_HPP
@@ -0,0 +1,152 @@
+/*
+ * SessionHistoryIndexTests.cpp
+ *
+ * Copyright (C) 2020 by RStudio, PBC
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include "SessionHistoryIndex.hpp"
+
+#include <shared_core/Error.hpp>
+#include <shared_core/FilePath.hpp>
+#include <core/FileSerializer.hpp>
+
+#define RSTUDIO_NO_TESTTHAT_ALIASES
+#include <tests/TestThat.hpp>
+
+namespace rstudio {
+namespace session {
+namespace modules {
+namespace history {
+namespace tests {
+
+using namespace rstudio::core;
+
+namespace {
+
+std::vector<std::string> commandsOf(const std::vector<HistoryEntry>& entries)
+{
+   std::vector<std::string> commands;
+   for (const HistoryEntry& entry : entries)
+      commands.push_back(entry.command);
+   return commands;
+}
+
+} // anonymous namespace
+
+TEST_CASE("SessionHistoryIndex")
+{
+   HistoryIndex index;
+   index.add(1, "library(dplyr)");
+   index.add(2, "mtcars %>% filter(mpg > 20)");
+   index.add(3, "plot(mtcars$mpg)");
+   index.add(4, "library(ggplot2)");
+   index.add(5, "plot(mtcars$mpg)");
+   index.add(6, "x");
+
+   SECTION("Searches return the most recent entries with every term")
+   {
+      std::vector<HistoryEntry> matches;
+      index.search({ "mtcars", "mpg" }, 10, &matches);
+      CHECK(commandsOf(matches) == std::vector<std::string>({
+         "plot(mtcars$mpg)", "plot(mtcars$mpg)", "mtcars %>% filter(mpg > 20)" }));
+      CHECK(matches[0].index == 4);
+      CHECK(matches[0].timestamp == 5);
+
+      matches.clear();
+      index.search({ "library" }, 1, &matches);
+      CHECK(commandsOf(matches) == std::vector<std::string>({ "library(ggplot2)" }));
+
+      matches.clear();
+      index.search({ "mtcars", "ggplot" }, 10, &matches);
+      CHECK(matches.empty());
+   }
+
+   SECTION("Short terms are searched for too")
+   {
+      std::vector<HistoryEntry> matches;
+      index.search({ "x" }, 10, &matches);
+      CHECK(commandsOf(matches) == std::vector<std::string>({ "x" }));
+
+      matches.clear();
+      index.search({ ">", "filter" }, 10, &matches);
+      CHECK(matches.size() == 1);
+
+      matches.clear();
+      index.search({}, 10, &matches);
+      CHECK(matches.size() == 6);
+   }
+
+   SECTION("Prefix searches can return unique entries")
+   {
+      std::vector<HistoryEntry> matches;
+      index.searchByPrefix("plot(", 10, false, &matches);
+      CHECK(matches.size() == 2);
+
+      matches.clear();
+      index.searchByPrefix("plot(", 10, true, &matches);
+      CHECK(matches.size() == 1);
+
+      matches.clear();
+      index.searchByPrefix("l", 10, true, &matches);
+      CHECK(commandsOf(matches) == std::vector<std::string>({
+         "library(ggplot2)", "library(dplyr)" }));
+
+      matches.clear();
+      index.searchByPrefix("", 3, true, &matches);
+      CHECK(commandsOf(matches) == std::vector<std::string>({
+         "x", "plot(mtcars$mpg)", "library(ggplot2)" }));
+   }
+
+   SECTION("History databases are read incrementally")
+   {
+      FilePath historyDBPath;
+      REQUIRE_FALSE(FilePath::tempFilePath(historyDBPath));
+      REQUIRE_FALSE(writeStringToFile(historyDBPath,
+                                      "100:head(iris)\n"
+                                      "\n"
+                                      "not an entry\n"
+                                      "101:  summary(iris) \r\n"
+                                      "102:tail("));
+
+      HistoryIndex fileIndex;
+      uint64_t offset = 0;
+      REQUIRE_FALSE(fileIndex.read(historyDBPath, true, &offset));
+      CHECK(commandsOf(fileIndex.entries()) == std::vector<std::string>({
+         "head(iris)", "  summary(iris) " }));
+      CHECK(fileIndex.entries()[1].timestamp == 101);
+      CHECK(offset == historyDBPath.getSize() - 9);
+
+      REQUIRE_FALSE(appendToFile(historyDBPath, "iris)\n103:str(iris)\n"));
+      REQUIRE_FALSE(fileIndex.read(historyDBPath, true, &offset));
+      CHECK(offset == historyDBPath.getSize());
+      CHECK(fileIndex.entries().size() == 4);
+      CHECK(fileIndex.entries()[2].command == "tail(iris)");
+      CHECK(fileIndex.entries()[3].index == 3);
+
+      std::vector<HistoryEntry> matches;
+      fileIndex.search({ "iris" }, 10, &matches);
+      CHECK(matches.size() == 4);
+
+      // files which aren't being appended to are read through to the end
+      REQUIRE_FALSE(appendToFile(historyDBPath, "104:q()"));
+      REQUIRE_FALSE(fileIndex.read(historyDBPath, false, &offset));
+      CHECK(fileIndex.entries().back().command == "q()");
+
+      historyDBPath.removeIfExists();
+   }
+}
+
+} // namespace tests
+} // namespace history
+} // namespace modules
+} // namespace session
+} // namespace rstudio
@@ -28,6 +28,7 @@
 #include <core/BoostLamda.hpp>
 
 #include <core/FileSerializer.hpp>
+#include <core/Thread.hpp>
 #include <core/rapidxml/rapidxml.hpp>
 #include <core/system/Environment.hpp>
 #include <core/system/Process.hpp>
@@ -545,12 +546,15 @@ std::string nonPathSvnBinDir()
       return std::string();
 }
 
+void updateStatusCommand();
+
 void onUserSettingsChanged(const std::string& layer, const std::string& pref)
 {
    if (pref != kSvnExePath)
       return;
 
    initSvnBin();
+   updateStatusCommand();
 }
 
 std::string translateItemStatus(const std::string& status)
@@ -828,36 +832,25 @@ Error statusToJson(const core::FilePath &path,
    return Success();
 }
 
-Error status(const FilePath& filePath,
-             std::vector<source_control::FileWithStatus>* pFiles)
+ShellArgs statusArgs(const FilePath& filePath)
 {
-   using namespace source_control;
-
    ShellArgs args;
    args << "status" << globalArgs() << "--xml" << "--ignore-externals";
    if (!filePath.isEmpty())
       args << "--" << filePath;
+   return args;
+}
 
-   std::string stdOut, stdErr;
-   int exitCode;
-   Error error = runSvn(
-         args,
-         &stdOut,
-         &stdErr,
-         &exitCode);
-   if (error)
-      return error;
-
-   if (exitCode != EXIT_SUCCESS)
-   {
-      LOG_ERROR_MESSAGE(stdErr);
-      return Success();
-   }
+// parses the xml output of svn status (see statusArgs)
+Error parseStatus(const std::string& output,
+                  std::vector<source_control::FileWithStatus>* pFiles)
+{
+   using namespace source_control;
 
    std::vector<char> xmlData;
    using namespace rapidxml;
    xml_document<> doc;
-   error = parseXml(stdOut, &xmlData, &doc);
+   Error error = parseXml(output, &xmlData, &doc);
    if (error)
       return error;
 
@@ -931,6 +924,89 @@ Error status(const FilePath& filePath,
    return Success();
 }
 
+Error status(const FilePath& filePath,
+             std::vector<source_control::FileWithStatus>* pFiles)
+{
+   std::string stdOut, stdErr;
+   int exitCode;
+   Error error = runSvn(
+         statusArgs(filePath),
+         &stdOut,
+         &stdErr,
+         &exitCode);
+   if (error)
+      return error;
+
+   if (exitCode != EXIT_SUCCESS)
+   {
+      LOG_ERROR_MESSAGE(stdErr);
+      return Success();
+   }
+
+   return parseStatus(stdOut, pFiles);
+}
+
+// the svn executable and options with which file listings run svn status to
+// decorate their files. the files pane's listing executes on an rpc worker
+// thread, so these are built on the main thread (since building them reads
+// the environment, svn's path and the project) and replaced when the path
+// to svn changes.
+struct StatusCommand
+{
+   FilePath exePath;
+   core::system::ProcessOptions options;
+};
+
+boost::mutex s_statusCommandMutex;
+boost::shared_ptr<const StatusCommand> s_pStatusCommand;
+
+void updateStatusCommand()
+{
+   boost::shared_ptr<StatusCommand> pCommand(new StatusCommand());
+   pCommand->exePath = FilePath(s_svnExePath);
+   pCommand->options = procOptions();
+
+   LOCK_MUTEX(s_statusCommandMutex)
+   {
+      s_pStatusCommand = pCommand;
+   }
+   END_LOCK_MUTEX
+}
+
+// status of the files within a directory being listed (may be called from
+// any thread, so uses nothing but the status command)
+Error listingStatus(const FilePath& dir,
+                    std::vector<source_control::FileWithStatus>* pFiles)
+{
+   boost::shared_ptr<const StatusCommand> pCommand;
+   LOCK_MUTEX(s_statusCommandMutex)
+   {
+      pCommand = s_pStatusCommand;
+   }
+   END_LOCK_MUTEX
+
+   core::system::ProcessResult result;
+   Error error = core::system::runCommand(
+            ShellCommand(pCommand->exePath) << statusArgs(dir).args(),
+            pCommand->options,
+            &result);
+   if (error)
+      return error;
+
+#ifdef __APPLE__
+   if (result.exitStatus == 69)
+      module_context::checkXcodeLicense();
+#endif
+
+   if (result.exitStatus != EXIT_SUCCESS)
+   {
+      LOG_ERROR_MESSAGE(result.stdErr);
+      return Success();
+   }
+
+   return parseStatus(result.stdOut, pFiles);
+}
+
 Error status(const FilePath& filePath,
              json::Array* pResults)
 {
@@ -1756,7 +1832,7 @@ SvnFileDecorationContext::SvnFileDecorationContext(
    using namespace source_control;
 
    std::vector<FileWithStatus> results;
-   Error error = status(rootDir, &results);
+   Error error = listingStatus(rootDir, &results);
    if (error)
       return;
 
@@ -1885,6 +1961,8 @@ Error initializeSvn(const core::FilePath& workingDir)
    std::string repoURL = repositoryRoot(s_workingDir);
    s_isSvnSshRepository = boost::algorithm::starts_with(repoURL, "svn+ssh");
 
+   updateStatusCommand();
+
    prefs::userPrefs().onChanged.connect(onUserSettingsChanged);
 
    return Success();
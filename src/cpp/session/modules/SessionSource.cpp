@@ -195,7 +195,7 @@ void detectExtendedType(boost::shared_ptr<SourceDocument> pDoc)
 int numSourceDocuments()
 {
    std::vector<boost::shared_ptr<SourceDocument> > docs;
-   source_database::list(&docs);
+   source_database::list(&docs, false);
    return gsl::narrow_cast<int>(docs.size());
 }
 
@@ -1147,7 +1147,7 @@ Error setDocOrder(const json::JsonRpcRequest& request,
    Error error = json::readParams(request.params, &ids);
    if (error)
       return error;
-   source_database::list(&docs);
+   source_database::list(&docs, false);
 
    for (boost::shared_ptr<SourceDocument>& pDoc : docs)
    {
@@ -1159,7 +1159,7 @@ Error setDocOrder(const json::JsonRpcRequest& request,
              pDoc->relativeOrder() != gsl::narrow_cast<int>(i + 1))
          {
             pDoc->setRelativeOrder(i + 1);
-            source_database::put(pDoc);
+            source_database::put(pDoc, false);
          }
       }
    }
@@ -137,6 +137,10 @@ boost::shared_ptr<FileDecorationContext> fileDecorationContext(
       const core::FilePath& rootDir,
       bool implicit)
 {
+   // implicit decoration is for files which have changed
+   if (implicit && git::isWithinGitRoot(rootDir))
+      git::invalidateStatus();
+
    if (implicit && !prefs::userPrefs().vcsAutorefresh())
    {
       return boost::shared_ptr<FileDecorationContext>(
@@ -0,0 +1,674 @@
+/*
+ * DefinitionCache.cpp
+ *
+ * Copyright (C) 2020 by RStudio, PBC
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include "DefinitionCache.hpp"
+
+#include <cstring>
+
+#include <boost/system/error_code.hpp>
+
+#include <core/Log.hpp>
+
+using namespace rstudio::core;
+
+namespace rstudio {
+namespace session {
+namespace modules {
+namespace clang {
+
+namespace {
+
+// the cache file starts with a header identifying the format (records are
+// written in native byte order, so the header also records that); each
+// segment then consists of its header, its file and definition records,
+// its USR hash buckets and finally its string table
+const char kMagic[4] = { 'R', 'S', 'D', 'C' };
+const uint32_t kVersion = 1;
+const uint32_t kByteOrderMark = 0x01020304;
+const uint32_t kSegmentMagic = 0x53454746;
+
+// a file whose definitions were removed
+const uint32_t kFileRemoved = 1;
+
+// the most segments we'll append to before rewriting the cache
+const std::size_t kMaxSegments = 16;
+
+struct CacheHeader
+{
+   char magic[4];
+   uint32_t version;
+   uint32_t byteOrderMark;
+   uint32_t reserved;
+};
+
+struct SegmentHeader
+{
+   uint32_t magic;
+   uint32_t fileCount;
+   uint32_t definitionCount;
+   uint32_t bucketCount;
+   uint32_t stringsSize;
+   uint32_t reserved;
+   uint64_t size;
+};
+
+struct FileRecord
+{
+   uint32_t path;
+   uint32_t firstDefinition;
+   uint32_t definitionCount;
+   uint32_t flags;
+   int64_t lastWrite;
+};
+
+struct DefinitionRecord
+{
+   uint32_t usr;
+   uint32_t kind;
+   uint32_t parentName;
+   uint32_t name;
+   uint32_t file;
+   uint32_t line;
+   uint32_t column;
+   uint32_t owner;
+};
+
+static_assert(sizeof(CacheHeader) == 16, "unexpected padding in CacheHeader");
+static_assert(sizeof(SegmentHeader) == 32, "unexpected padding in SegmentHeader");
+static_assert(sizeof(FileRecord) == 24, "unexpected padding in FileRecord");
+static_assert(sizeof(DefinitionRecord) == 32, "unexpected padding in DefinitionRecord");
+
+// records in the mapped file aren't necessarily aligned, so they're copied
+// out rather than accessed in place
+template <typename T>
+T readRecord(const char* pData, std::size_t index = 0)
+{
+   T record;
+   std::memcpy(&record, pData + index * sizeof(T), sizeof(T));
+   return record;
+}
+
+// FNV-1a
+uint32_t hashUSR(const std::string& USR)
+{
+   uint32_t hash = 2166136261u;
+   for (char ch : USR)
+   {
+      hash ^= static_cast<unsigned char>(ch);
+      hash *= 16777619u;
+   }
+   return hash;
+}
+
+uint32_t bucketCountFor(std::size_t definitionCount)
+{
+   // keep the table at most half full
+   uint32_t count = 1;
+   while (count < definitionCount * 2)
+      count *= 2;
+   return count;
+}
+
+class StringTable
+{
+public:
+   uint32_t add(const std::string& value)
+   {
+      auto it = offsets_.find(value);
+      if (it != offsets_.end())
+         return it->second;
+
+      uint32_t offset = static_cast<uint32_t>(strings_.size());
+      strings_.append(value);
+      strings_.push_back('\0');
+      offsets_[value] = offset;
+      return offset;
+   }
+
+   const std::string& strings() const { return strings_; }
+
+private:
+   std::string strings_;
+   std::unordered_map<std::string, uint32_t> offsets_;
+};
+
+Error streamError(const FilePath& path, const ErrorLocation& location)
+{
+   Error error = systemError(boost::system::errc::io_error, location);
+   error.addProperty("path", path.getAbsolutePath());
+   return error;
+}
+
+} // anonymous namespace
+
+DefinitionCache::DefinitionCache()
+   : liveDefinitions_(0),
+     deadDefinitions_(0),
+     valid_(true)
+{
+}
+
+Error DefinitionCache::open(const FilePath& path)
+{
+   close();
+   path_ = path;
+   pending_.clear();
+   pendingUSRs_.clear();
+
+   if (!path.exists())
+      return Success();
+
+   // an empty file can't be mapped (and has nothing in it anyway)
+   if (path.getSize() == 0)
+   {
+      valid_ = false;
+      return Success();
+   }
+
+   try
+   {
+      file_.open(path.getAbsolutePath());
+   }
+   catch (const std::exception& e)
+   {
+      valid_ = false;
+      Error error = streamError(path, ERROR_LOCATION);
+      error.addProperty("what", e.what());
+      return error;
+   }
+
+   readSegments();
+   return Success();
+}
+
+void DefinitionCache::close()
+{
+   if (file_.is_open())
+      file_.close();
+
+   segments_.clear();
+   files_.clear();
+   liveDefinitions_ = 0;
+   deadDefinitions_ = 0;
+   valid_ = true;
+}
+
+void DefinitionCache::readSegments()
+{
+   const char* pData = file_.data();
+   std::size_t size = file_.size();
+
+   // caches written by other versions are discarded (and rewritten when
+   // we next save)
+   if (size < sizeof(CacheHeader))
+   {
+      valid_ = false;
+      return;
+   }
+
+   CacheHeader header = readRecord<CacheHeader>(pData);
+   if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 ||
+       header.version != kVersion ||
+       header.byteOrderMark != kByteOrderMark)
+   {
+      valid_ = false;
+      return;
+   }
+
+   // a segment which is incomplete (e.g. because we crashed while writing
+   // it) ends the cache; the segments before it are still usable
+   std::size_t offset = sizeof(CacheHeader);
+   while (offset < size)
+   {
+      if (size - offset < sizeof(SegmentHeader))
+      {
+         valid_ = false;
+         break;
+      }
+
+      SegmentHeader segmentHeader = readRecord<SegmentHeader>(pData + offset);
+      uint64_t expectedSize = sizeof(SegmentHeader) +
+            uint64_t(segmentHeader.fileCount) * sizeof(FileRecord) +
+            uint64_t(segmentHeader.definitionCount) * sizeof(DefinitionRecord) +
+            uint64_t(segmentHeader.bucketCount) * sizeof(uint32_t) +
+            segmentHeader.stringsSize;
+
+      if (segmentHeader.magic != kSegmentMagic ||
+          segmentHeader.size != expectedSize ||
+          segmentHeader.size > size - offset ||
+          segmentHeader.bucketCount == 0 ||
+          (segmentHeader.bucketCount & (segmentHeader.bucketCount - 1)) != 0)
+      {
+         valid_ = false;
+         break;
+      }
+
+      Segment segment;
+      segment.fileCount = segmentHeader.fileCount;
+      segment.definitionCount = segmentHeader.definitionCount;
+      segment.bucketCount = segmentHeader.bucketCount;
+      segment.stringsSize = segmentHeader.stringsSize;
+      segment.pFiles = pData + offset + sizeof(SegmentHeader);
+      segment.pDefinitions = segment.pFiles + segment.fileCount * sizeof(FileRecord);
+      segment.pBuckets = segment.pDefinitions + segment.definitionCount * sizeof(DefinitionRecord);
+      segment.pStrings = segment.pBuckets + segment.bucketCount * sizeof(uint32_t);
+      segment.live.assign(segment.fileCount, false);
+
+      std::size_t index = segments_.size();
+      segments_.push_back(segment);
+
+      // the entries in this segment supersede earlier ones for the same file
+      bool valid = true;
+      for (uint32_t i = 0; i < segment.fileCount; ++i)
+      {
+         FileRecord record = readRecord<FileRecord>(segment.pFiles, i);
+         std::string path = string(segment, record.path);
+         if (path.empty() ||
+             record.firstDefinition > segment.definitionCount ||
+             record.definitionCount > segment.definitionCount - record.firstDefinition)
+         {
+            valid = false;
+            break;
+         }
+
+         supersede(path);
+
+         if (record.flags & kFileRemoved)
+            continue;
+
+         FileEntry entry;
+         entry.segment = index;
+         entry.record = i;
+         entry.lastWrite = static_cast<std::time_t>(record.lastWrite);
+         files_[path] = entry;
+         segments_[index].live[i] = true;
+         liveDefinitions_ += record.definitionCount;
+      }
+
+      if (!valid)
+      {
+         valid_ = false;
+         break;
+      }
+
+      offset += segmentHeader.size;
+   }
+}
+
+void DefinitionCache::supersede(const std::string& file)
+{
+   auto it = files_.find(file);
+   if (it != files_.end())
+   {
+      Segment& segment = segments_[it->second.segment];
+      FileRecord record = readRecord<FileRecord>(segment.pFiles, it->second.record);
+      segment.live[it->second.record] = false;
+      liveDefinitions_ -= record.definitionCount;
+      deadDefinitions_ += record.definitionCount;
+      files_.erase(it);
+   }
+
+   auto pendingIt = pending_.find(file);
+   if (pendingIt != pending_.end())
+   {
+      for (const CppDefinition& definition : pendingIt->second.definitions)
+      {
+         auto usrIt = pendingUSRs_.find(definition.USR);
+         if (usrIt != pendingUSRs_.end() && usrIt->second == file)
+            pendingUSRs_.erase(usrIt);
+      }
+      pending_.erase(pendingIt);
+   }
+}
+
+std::string DefinitionCache::string(const Segment& segment, uint32_t offset) const
+{
+   if (offset >= segment.stringsSize)
+      return std::string();
+
+   const char* pBegin = segment.pStrings + offset;
+   const void* pEnd = std::memchr(pBegin, '\0', segment.stringsSize - offset);
+   if (pEnd == nullptr)
+      return std::string();
+
+   return std::string(pBegin, static_cast<const char*>(pEnd));
+}
+
+CppDefinition DefinitionCache::definition(const Segment& segment, uint32_t index) const
+{
+   DefinitionRecord record = readRecord<DefinitionRecord>(segment.pDefinitions, index);
+   return CppDefinition(string(segment, record.usr),
+                        static_cast<CppDefinitionKind>(record.kind),
+                        string(segment, record.parentName),
+                        string(segment, record.name),
+                        libclang::FileLocation(FilePath(string(segment, record.file)),
+                                               record.line,
+                                               record.column));
+}
+
+std::vector<std::string> DefinitionCache::files() const
+{
+   std::vector<std::string> files;
+   files.reserve(files_.size() + pending_.size());
+   for (const auto& entry : files_)
+      files.push_back(entry.first);
+   for (const auto& entry : pending_)
+      if (!entry.second.removed)
+         files.push_back(entry.first);
+   return files;
+}
+
+bool DefinitionCache::hasFile(const std::string& file, std::time_t* pLastWrite) const
+{
+   std::time_t lastWrite;
+
+   auto pendingIt = pending_.find(file);
+   auto it = files_.find(file);
+   if (pendingIt != pending_.end())
+   {
+      if (pendingIt->second.removed)
+         return false;
+      lastWrite = pendingIt->second.lastWrite;
+   }
+   else if (it != files_.end())
+   {
+      lastWrite = it->second.lastWrite;
+   }
+   else
+   {
+      return false;
+   }
+
+   if (pLastWrite)
+      *pLastWrite = lastWrite;
+   return true;
+}
+
+void DefinitionCache::updateFile(const std::string& file,
+                                 std::time_t lastWrite,
+                                 const std::vector<CppDefinition>& definitions)
+{
+   supersede(file);
+
+   PendingFile& pending = pending_[file];
+   pending.lastWrite = lastWrite;
+   pending.definitions = definitions;
+   for (const CppDefinition& definition : definitions)
+      pendingUSRs_[definition.USR] = file;
+}
+
+void DefinitionCache::removeFile(const std::string& file)
+{
+   if (!hasFile(file))
+      return;
+
+   supersede(file);
+   pending_[file].removed = true;
+}
+
+bool DefinitionCache::findUSR(const std::string& USR, CppDefinition* pDefinition) const
+{
+   // check files updated in this session first
+   auto usrIt = pendingUSRs_.find(USR);
+   if (usrIt != pendingUSRs_.end())
+   {
+      const PendingFile& pending = pending_.at(usrIt->second);
+      for (const CppDefinition& definition : pending.definitions)
+      {
+         if (definition.USR == USR)
+         {
+            *pDefinition = definition;
+            return true;
+         }
+      }
+   }
+
+   // then the most recent segments
+   uint32_t hash = hashUSR(USR);
+   for (auto it = segments_.rbegin(); it != segments_.rend(); ++it)
+   {
+      const Segment& segment = *it;
+      uint32_t mask = segment.bucketCount - 1;
+      for (uint32_t probe = 0, bucket = hash & mask;
+           probe < segment.bucketCount;
+           ++probe, bucket = (bucket + 1) & mask)
+      {
+         uint32_t entry = readRecord<uint32_t>(segment.pBuckets, bucket);
+         if (entry == 0 || entry > segment.definitionCount)
+            break;
+
+         DefinitionRecord record = readRecord<DefinitionRecord>(
+                  segment.pDefinitions, entry - 1);
+         if (record.owner < segment.fileCount &&
+             segment.live[record.owner] &&
+             string(segment, record.usr) == USR)
+         {
+            *pDefinition = definition(segment, entry - 1);
+            return true;
+         }
+      }
+   }
+
+   return false;
+}
+
+void DefinitionCache::searchDefinitions(
+      const boost::function<bool(const std::string&)>& matches,
+      const std::set<std::string>& excludeFiles,
+      std::vector<CppDefinition>* pDefinitions) const
+{
+   for (const auto& entry : pending_)
+   {
+      if (excludeFiles.count(entry.first))
+         continue;
+
+      for (const CppDefinition& definition : entry.second.definitions)
+         if (matches(definition.name))
+            pDefinitions->push_back(definition);
+   }
+
+   // definitions are only read in full when their name matches
+   for (const Segment& segment : segments_)
+   {
+      for (uint32_t i = 0; i < segment.fileCount; ++i)
+      {
+         if (!segment.live[i])
+            continue;
+
+         FileRecord file = readRecord<FileRecord>(segment.pFiles, i);
+         if (!excludeFiles.empty() && excludeFiles.count(string(segment, file.path)))
+            continue;
+
+         for (uint32_t j = file.firstDefinition;
+              j < file.firstDefinition + file.definitionCount;
+              ++j)
+         {
+            DefinitionRecord record = readRecord<DefinitionRecord>(segment.pDefinitions, j);
+            if (matches(string(segment, record.name)))
+               pDefinitions->push_back(definition(segment, j));
+         }
+      }
+   }
+}
+
+Error DefinitionCache::save()
+{
+   if (path_.isEmpty() || (!path_.exists() && pending_.empty()))
+      return Success();
+
+   if (!valid_ ||
+       !path_.exists() ||
+       segments_.size() >= kMaxSegments ||
+       deadDefinitions_ > liveDefinitions_)
+   {
+      return compact();
+   }
+
+   if (pending_.empty())
+      return Success();
+
+   // append the files changed in this session
+   PendingFiles pending;
+   pending.swap(pending_);
+   FilePath path = path_;
+   close();
+
+   Error error = writeSegment(pending, path, false);
+   if (error)
+      return error;
+
+   return open(path);
+}
+
+Error DefinitionCache::compact()
+{
+   // read all of the live definitions
+   PendingFiles files;
+   for (const auto& entry : files_)
+   {
+      const Segment& segment = segments_[entry.second.segment];
+      FileRecord record = readRecord<FileRecord>(segment.pFiles, entry.second.record);
+
+      PendingFile& file = files[entry.first];
+      file.lastWrite = entry.second.lastWrite;
+      file.definitions.reserve(record.definitionCount);
+      for (uint32_t i = record.firstDefinition;
+           i < record.firstDefinition + record.definitionCount;
+           ++i)
+      {
+         file.definitions.push_back(definition(segment, i));
+      }
+   }
+
+   for (const auto& entry : pending_)
+      if (!entry.second.removed)
+         files[entry.first] = entry.second;
+
+   // write them to a new file, then replace the cache with it
+   FilePath path = path_;
+   close();
+   pending_.clear();
+   pendingUSRs_.clear();
+
+   FilePath tempPath = path.getParent().completeChildPath(path.getFilename() + ".tmp");
+   Error error = writeSegment(files, tempPath, true);
+   if (error)
+      return error;
+
+   error = tempPath.move(path, FilePath::MoveDirect, true);
+   if (error)
+      return error;
+
+   return open(path);
+}
+
+Error DefinitionCache::writeSegment(const PendingFiles& files,
+                                    const FilePath& path,
+                                    bool newFile)
+{
+   StringTable strings;
+   std::vector<FileRecord> fileRecords;
+   std::vector<DefinitionRecord> definitionRecords;
+   std::vector<uint32_t> hashes;
+
+   for (const auto& entry : files)
+   {
+      const PendingFile& file = entry.second;
+
+      FileRecord fileRecord;
+      fileRecord.path = strings.add(entry.first);
+      fileRecord.firstDefinition = static_cast<uint32_t>(definitionRecords.size());
+      fileRecord.definitionCount = static_cast<uint32_t>(file.definitions.size());
+      fileRecord.flags = file.removed ? kFileRemoved : 0;
+      fileRecord.lastWrite = static_cast<int64_t>(file.lastWrite);
+
+      for (const CppDefinition& definition : file.definitions)
+      {
+         DefinitionRecord record;
+         record.usr = strings.add(definition.USR);
+         record.kind = static_cast<uint32_t>(definition.kind);
+         record.parentName = strings.add(definition.parentName);
+         record.name = strings.add(definition.name);
+         record.file = strings.add(definition.location.filePath.getAbsolutePath());
+         record.line = definition.location.line;
+         record.column = definition.location.column;
+         record.owner = static_cast<uint32_t>(fileRecords.size());
+         definitionRecords.push_back(record);
+         hashes.push_back(hashUSR(definition.USR));
+      }
+
+      fileRecords.push_back(fileRecord);
+   }
+
+   // build the USR index (open addressing; buckets hold definition
+   // indexes + 1, with 0 marking an empty bucket)
+   std::vector<uint32_t> buckets(bucketCountFor(definitionRecords.size()), 0);
+   uint32_t mask = static_cast<uint32_t>(buckets.size()) - 1;
+   for (std::size_t i = 0; i < hashes.size(); ++i)
+   {
+      uint32_t bucket = hashes[i] & mask;
+      while (buckets[bucket] != 0)
+         bucket = (bucket + 1) & mask;
+      buckets[bucket] = static_cast<uint32_t>(i + 1);
+   }
+
+   SegmentHeader segmentHeader;
+   segmentHeader.magic = kSegmentMagic;
+   segmentHeader.fileCount = static_cast<uint32_t>(fileRecords.size());
+   segmentHeader.definitionCount = static_cast<uint32_t>(definitionRecords.size());
+   segmentHeader.bucketCount = static_cast<uint32_t>(buckets.size());
+   segmentHeader.stringsSize = static_cast<uint32_t>(strings.strings().size());
+   segmentHeader.reserved = 0;
+   segmentHeader.size = sizeof(SegmentHeader) +
+         uint64_t(fileRecords.size()) * sizeof(FileRecord) +
+         uint64_t(definitionRecords.size()) * sizeof(DefinitionRecord) +
+         uint64_t(buckets.size()) * sizeof(uint32_t) +
+         strings.strings().size();
+
+   std::shared_ptr<std::ostream> pStream;
+   Error error = path.openForWrite(pStream, newFile);
+   if (error)
+      return error;
+
+   if (newFile)
+   {
+      CacheHeader header;
+      std::memcpy(header.magic, kMagic, sizeof(kMagic));
+      header.version = kVersion;
+      header.byteOrderMark = kByteOrderMark;
+      header.reserved = 0;
+      pStream->write(reinterpret_cast<const char*>(&header), sizeof(header));
+   }
+
+   pStream->write(reinterpret_cast<const char*>(&segmentHeader), sizeof(segmentHeader));
+   pStream->write(reinterpret_cast<const char*>(fileRecords.data()),
+                  fileRecords.size() * sizeof(FileRecord));
+   pStream->write(reinterpret_cast<const char*>(definitionRecords.data()),
+                  definitionRecords.size() * sizeof(DefinitionRecord));
+   pStream->write(reinterpret_cast<const char*>(buckets.data()),
+                  buckets.size() * sizeof(uint32_t));
+   pStream->write(strings.strings().data(), strings.strings().size());
+   pStream->flush();
+
+   if (!pStream->good())
+      return streamError(path, ERROR_LOCATION);
+
+   return Success();
+}
+
+} // namespace clang
+} // namespace modules
+} // namespace session
+} // namespace rstudio
@@ -0,0 +1,155 @@
+/*
+ * DefinitionCache.hpp
+ *
+ * Copyright (C) 2020 by RStudio, PBC
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef SESSION_MODULES_CLANG_DEFINITION_CACHE_HPP
+#define SESSION_MODULES_CLANG_DEFINITION_CACHE_HPP
+
+#include <cstdint>
+#include <ctime>
+#include <map>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <boost/function.hpp>
+#include <boost/iostreams/device/mapped_file.hpp>
+#include <boost/noncopyable.hpp>
+
+#include <shared_core/Error.hpp>
+#include <shared_core/FilePath.hpp>
+
+#include "DefinitionIndex.hpp"
+
+namespace rstudio {
+namespace session {
+namespace modules {
+namespace clang {
+
+// The definitions found in each indexed source file, persisted across
+// sessions in a binary file which is memory mapped and read lazily.
+//
+// The file is a sequence of segments, each holding the definitions of some
+// set of files along with a string table and a hash index of their USRs.
+// A file's entry in a later segment supersedes its entries in earlier ones,
+// so saving changes just appends a segment with the files updated (or
+// removed) since the cache was opened. Once enough of the cache is
+// superseded, saving rewrites it as a single segment instead.
+class DefinitionCache : boost::noncopyable
+{
+public:
+   DefinitionCache();
+
+   // map the cache file at the given path (which needn't exist yet)
+   core::Error open(const core::FilePath& path);
+
+   // the files with cached definitions
+   std::vector<std::string> files() const;
+
+   // whether the given file has cached definitions, and if so the last
+   // write time of the file when they were found
+   bool hasFile(const std::string& file, std::time_t* pLastWrite = nullptr) const;
+
+   // replace or remove the definitions of a file; changes are held in
+   // memory until saved
+   void updateFile(const std::string& file,
+                   std::time_t lastWrite,
+                   const std::vector<CppDefinition>& definitions);
+   void removeFile(const std::string& file);
+
+   // find a definition by USR
+   bool findUSR(const std::string& USR, CppDefinition* pDefinition) const;
+
+   // find the definitions whose names satisfy 'matches', skipping those
+   // of the files in 'excludeFiles'
+   void searchDefinitions(const boost::function<bool(const std::string&)>& matches,
+                          const std::set<std::string>& excludeFiles,
+                          std::vector<CppDefinition>* pDefinitions) const;
+
+   // write changes made since the cache was opened
+   core::Error save();
+
+   // the number of segments in the cache file (for diagnostics and tests)
+   std::size_t segmentCount() const { return segments_.size(); }
+
+private:
+   struct Segment
+   {
+      const char* pFiles;
+      const char* pDefinitions;
+      const char* pBuckets;
+      const char* pStrings;
+      uint32_t fileCount;
+      uint32_t definitionCount;
+      uint32_t bucketCount;
+      uint32_t stringsSize;
+
+      // whether each file's entry is its latest
+      std::vector<bool> live;
+   };
+
+   struct FileEntry
+   {
+      std::size_t segment;
+      uint32_t record;
+      std::time_t lastWrite;
+   };
+
+   struct PendingFile
+   {
+      PendingFile() : lastWrite(0), removed(false) {}
+
+      std::time_t lastWrite;
+      std::vector<CppDefinition> definitions;
+      bool removed;
+   };
+
+   typedef std::map<std::string, PendingFile> PendingFiles;
+
+   void close();
+   void readSegments();
+   void supersede(const std::string& file);
+   std::string string(const Segment& segment, uint32_t offset) const;
+   CppDefinition definition(const Segment& segment, uint32_t index) const;
+   core::Error compact();
+
+   static core::Error writeSegment(const PendingFiles& files,
+                                   const core::FilePath& path,
+                                   bool newFile);
+
+private:
+   core::FilePath path_;
+   boost::iostreams::mapped_file_source file_;
+   std::vector<Segment> segments_;
+
+   // the latest entry for each file in the mapped segments
+   std::unordered_map<std::string, FileEntry> files_;
+
+   // changes since the cache was opened, and the file defining each of
+   // the USRs they contain
+   PendingFiles pending_;
+   std::unordered_map<std::string, std::string> pendingUSRs_;
+
+   uint32_t liveDefinitions_;
+   uint32_t deadDefinitions_;
+   bool valid_;
+};
+
+} // namespace clang
+} // namespace modules
+} // namespace session
+} // namespace rstudio
+
+#endif // SESSION_MODULES_CLANG_DEFINITION_CACHE_HPP
@@ -0,0 +1,192 @@
+/*
+ * DefinitionCacheTests.cpp
+ *
+ * Copyright (C) 2020 by RStudio, PBC
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include "DefinitionCache.hpp"
+
+#include <fstream>
+
+#define RSTUDIO_NO_TESTTHAT_ALIASES
+#include <tests/TestThat.hpp>
+
+namespace rstudio {
+namespace session {
+namespace modules {
+namespace clang {
+namespace tests {
+
+using namespace rstudio::core;
+
+namespace {
+
+CppDefinition makeDefinition(const std::string& file,
+                             const std::string& name,
+                             unsigned line)
+{
+   return CppDefinition("c:@F@" + name,
+                        CppFunctionDefinition,
+                        std::string(),
+                        name,
+                        libclang::FileLocation(FilePath(file), line, 1));
+}
+
+bool matchesAny(const std::string&)
+{
+   return true;
+}
+
+std::vector<CppDefinition> allDefinitions(const DefinitionCache& cache)
+{
+   std::vector<CppDefinition> definitions;
+   cache.searchDefinitions(matchesAny, std::set<std::string>(), &definitions);
+   return definitions;
+}
+
+} // anonymous namespace
+
+TEST_CASE("DefinitionCache")
+{
+   FilePath cachePath;
+   REQUIRE_FALSE(FilePath::tempFilePath(cachePath));
+
+   const std::string fileA = "/pkg/src/a.cpp";
+   const std::string fileB = "/pkg/src/b.cpp";
+   const std::string fileC = "/pkg/inst/include/c.h";
+   const std::string fileD = "/pkg/inst/include/d.h";
+
+   {
+      DefinitionCache cache;
+      REQUIRE_FALSE(cache.open(cachePath));
+      cache.updateFile(fileA, 100, { makeDefinition(fileA, "alpha", 1),
+                                     makeDefinition(fileA, "another", 5) });
+      cache.updateFile(fileB, 200, { makeDefinition(fileB, "beta", 2) });
+
+      std::vector<CppDefinition> definitions;
+      for (unsigned i = 0; i < 10; ++i)
+         definitions.push_back(makeDefinition(fileD, "delta" + std::to_string(i), i));
+      cache.updateFile(fileD, 200, definitions);
+
+      REQUIRE_FALSE(cache.save());
+      CHECK(cache.segmentCount() == 1);
+   }
+
+   SECTION("Definitions are read back from the mapped file")
+   {
+      DefinitionCache cache;
+      REQUIRE_FALSE(cache.open(cachePath));
+
+      std::time_t lastWrite = 0;
+      CHECK(cache.hasFile(fileA, &lastWrite));
+      CHECK(lastWrite == 100);
+      CHECK_FALSE(cache.hasFile(fileC));
+
+      CppDefinition definition;
+      REQUIRE(cache.findUSR("c:@F@beta", &definition));
+      CHECK(definition.name == "beta");
+      CHECK(definition.kind == CppFunctionDefinition);
+      CHECK(definition.location.filePath.getAbsolutePath() == fileB);
+      CHECK(definition.location.line == 2);
+      CHECK_FALSE(cache.findUSR("c:@F@gamma", &definition));
+
+      std::vector<CppDefinition> definitions;
+      cache.searchDefinitions(
+               [](const std::string& name) { return name[0] == 'a'; },
+               std::set<std::string>(),
+               &definitions);
+      CHECK(definitions.size() == 2);
+
+      definitions.clear();
+      cache.searchDefinitions(matchesAny, { fileA, fileD }, &definitions);
+      REQUIRE(definitions.size() == 1);
+      CHECK(definitions[0].name == "beta");
+   }
+
+   SECTION("Changes are appended, and supersede earlier entries")
+   {
+      {
+         DefinitionCache cache;
+         REQUIRE_FALSE(cache.open(cachePath));
+         cache.updateFile(fileA, 150, { makeDefinition(fileA, "alpha", 10) });
+         cache.updateFile(fileC, 300, { makeDefinition(fileC, "gamma", 3) });
+         cache.updateFile(fileB, 250, { makeDefinition(fileB, "beta", 20),
+                                        makeDefinition(fileB, "beta2", 21) });
+         cache.removeFile(fileB);
+         REQUIRE_FALSE(cache.save());
+         CHECK(cache.segmentCount() == 2);
+      }
+
+      DefinitionCache cache;
+      REQUIRE_FALSE(cache.open(cachePath));
+      CHECK(cache.segmentCount() == 2);
+      CHECK_FALSE(cache.hasFile(fileB));
+
+      CppDefinition definition;
+      REQUIRE(cache.findUSR("c:@F@alpha", &definition));
+      CHECK(definition.location.line == 10);
+      CHECK_FALSE(cache.findUSR("c:@F@another", &definition));
+      CHECK_FALSE(cache.findUSR("c:@F@beta", &definition));
+      CHECK(cache.findUSR("c:@F@gamma", &definition));
+      CHECK(allDefinitions(cache).size() == 12);
+
+      // once most of the cache is superseded, saving rewrites it
+      cache.updateFile(fileC, 400, { makeDefinition(fileC, "gamma", 4) });
+      cache.updateFile(fileD, 400, std::vector<CppDefinition>());
+      REQUIRE_FALSE(cache.save());
+      CHECK(cache.segmentCount() == 1);
+      REQUIRE(cache.findUSR("c:@F@gamma", &definition));
+      CHECK(definition.location.line == 4);
+      CHECK(allDefinitions(cache).size() == 2);
+      CHECK(cache.hasFile(fileD));
+   }
+
+   SECTION("A partially written segment is ignored")
+   {
+      {
+         std::ofstream stream(cachePath.getAbsolutePath().c_str(),
+                              std::ios::binary | std::ios::app);
+         stream << "FGES\x01\x02";
+      }
+
+      DefinitionCache cache;
+      REQUIRE_FALSE(cache.open(cachePath));
+      CHECK(cache.segmentCount() == 1);
+      CHECK(allDefinitions(cache).size() == 13);
+
+      REQUIRE_FALSE(cache.save());
+      CHECK(cache.segmentCount() == 1);
+      CHECK(cachePath.getSize() > 0);
+      CHECK(allDefinitions(cache).size() == 13);
+   }
+
+   SECTION("Caches in other formats are discarded")
+   {
+      {
+         std::ofstream stream(cachePath.getAbsolutePath().c_str(),
+                              std::ios::binary | std::ios::trunc);
+         stream << "[{\"file\": \"/pkg/src/a.cpp\"}]";
+      }
+
+      DefinitionCache cache;
+      REQUIRE_FALSE(cache.open(cachePath));
+      CHECK(cache.files().empty());
+   }
+
+   cachePath.removeIfExists();
+}
+
+} // namespace tests
+} // namespace clang
+} // namespace modules
+} // namespace session
+} // namespace rstudio
@@ -15,13 +15,11 @@
 
 #include "DefinitionIndex.hpp"
 
-#include <deque>
 #include <gsl/gsl>
 
 #include <shared_core/FilePath.hpp>
 #include <core/DateTime.hpp>
 #include <core/PerformanceTimer.hpp>
-#include <core/FileSerializer.hpp>
 #include <core/libclang/LibClang.hpp>
 #include <core/system/ProcessArgs.hpp>
 #include <session/IncrementalFileChangeHandler.hpp>
@@ -29,6 +27,7 @@
 #include <session/SessionModuleContext.hpp>
 #include <session/projects/SessionProjects.hpp>
 
+#include "DefinitionCache.hpp"
 #include "RSourceIndex.hpp"
 #include "RCompilationDatabase.hpp"
 
@@ -45,22 +44,18 @@ namespace {
 // flag indicating whether we are initialized
 bool s_initialized = false;
 
-struct CppDefinitions
+// definitions of the files we've indexed (persisted across sessions)
+DefinitionCache& definitionCache()
 {
-   std::string file;
-   std::time_t fileLastWrite;
-   std::deque<CppDefinition> definitions;
-};
-
-// store definitions by file
-typedef std::map<std::string,CppDefinitions> DefinitionsByFile;
-DefinitionsByFile s_definitionsByFile;
+   static DefinitionCache instance;
+   return instance;
+}
 
-// visitor used to populate deque
+// visitor used to populate vector
 bool insertDefinition(const CppDefinition& definition,
-                      CppDefinitions* pDefinitions)
+                      std::vector<CppDefinition>* pDefinitions)
 {
-   pDefinitions->definitions.push_back(definition);
+   pDefinitions->push_back(definition);
    return true;
 }
 
@@ -183,18 +178,17 @@ void fileChangeHandler(const core::system::FileChangeEvent& event)
    // enough index of the file
    if (event.type() == core::system::FileChangeEvent::FileAdded)
    {
-      // if we have a definition
-      DefinitionsByFile::const_iterator it = s_definitionsByFile.find(file);
-      if (it != s_definitionsByFile.end())
+      // if the definition is fresh enough then bail
+      std::time_t lastWrite;
+      if (definitionCache().hasFile(file, &lastWrite) &&
+          lastWrite >= event.fileInfo().lastWriteTime())
       {
-         // if the definition is fresh enough then bail
-         if (it->second.fileLastWrite >= event.fileInfo().lastWriteTime())
-            return;
+         return;
       }
    }
 
    // always remove existing definitions
-   s_definitionsByFile.erase(file);
+   definitionCache().removeFile(file);
 
    // if this is an add or an update then re-index
    if (event.type() == core::system::FileChangeEvent::FileAdded ||
@@ -227,12 +221,9 @@ void fileChangeHandler(const core::system::FileChangeEvent& event)
 
 
          // create definitions and wire visitor to it
-         CppDefinitions definitions;
-         definitions.file = file;
-         definitions.fileLastWrite = event.fileInfo().lastWriteTime();
-         s_definitionsByFile[file] = definitions;
+         std::vector<CppDefinition> definitions;
          DefinitionVisitor visitor =
-            boost::bind(insertDefinition, _1, &s_definitionsByFile[file]);
+            boost::bind(insertDefinition, _1, &definitions);
 
          // visit the cursors
          libclang::clang().visitChildren(
@@ -243,6 +234,10 @@ void fileChangeHandler(const core::system::FileChangeEvent& event)
          // dispose translation unit and index
          libclang::clang().disposeTranslationUnit(tu);
          libclang::clang().disposeIndex(index);
+
+         definitionCache().updateFile(file,
+                                      event.fileInfo().lastWriteTime(),
+                                      definitions);
       }
    }
 }
@@ -359,14 +354,9 @@ FileLocation findDefinitionLocation(const FileLocation& location)
 
       // if we didn't find it there then look for it in our index
       // of all saved files
-      for (const DefinitionsByFile::value_type& defs : s_definitionsByFile)
-      {
-         for (const CppDefinition& def : defs.second.definitions)
-         {
-            if (def.USR == USR)
-               return def.location;
-         }
-      }
+      CppDefinition def;
+      if (definitionCache().findUSR(USR, &def))
+         return def.location;
    }
 
    // see if we can resolve the cursor to a definition (if we can't
@@ -390,12 +380,12 @@ namespace {
 
 bool matches(const std::string& term,
              const boost::regex& pattern,
-             const CppDefinition& definition)
+             const std::string& name)
 {
    if (!pattern.empty())
-      return regex_utils::textMatches(definition.name, pattern, false, false);
+      return regex_utils::textMatches(name, pattern, false, false);
    else
-      return string_utils::isSubsequence(definition.name, term, true);
+      return string_utils::isSubsequence(name, term, true);
 }
 
 bool insertMatching(const std::string& term,
@@ -403,156 +393,48 @@ bool insertMatching(const std::string& term,
                     const CppDefinition& definition,
                     std::vector<CppDefinition>* pDefinitions)
 {
-   if (matches(term, pattern, definition))
+   if (matches(term, pattern, definition.name))
       pDefinitions->push_back(definition);
    return true;
 }
 
 
-json::Object cppDefinitionToJson(const CppDefinition& definition)
-{
-   using namespace safe_convert;
-   json::Object definitionJson;
-   definitionJson["usr"] = definition.USR;
-   definitionJson["kind"] = numberTo<int>(definition.kind, 0);
-   definitionJson["parent_name"] = definition.parentName;
-   definitionJson["name"] = definition.name;
-   definitionJson["file"] = definition.location.filePath.getAbsolutePath();
-   definitionJson["line"] = numberTo<int>(definition.location.line, 1);
-   definitionJson["column"] = numberTo<int>(definition.location.column, 1);
-   return definitionJson;
-}
-
-CppDefinition cppDefinitionFromJson(const json::Object& object)
-{
-   // read json
-   int kind;
-   int line, column;
-   std::string file;
-   CppDefinition definition;
-   Error error = json::readObject(object,
-                                  "usr", definition.USR,
-                                  "kind", kind,
-                                  "parent_name", definition.parentName,
-                                  "name", definition.name,
-                                  "file", file,
-                                  "line", line,
-                                  "column", column);
-   if (error)
-   {
-      LOG_ERROR(error);
-      return CppDefinition();
-   }
-
-   // required data transforms
-   using namespace safe_convert;
-   definition.kind = static_cast<CppDefinitionKind>(kind);
-   definition.location.filePath = FilePath(file);
-   definition.location.line = numberTo<unsigned>(line, 1);
-   definition.location.column = numberTo<unsigned>(column, 1);
-
-   // return definition
-   return definition;
-}
-
 FilePath definitionIndexFilePath()
 {
-   return module_context::scopedScratchPath().completeChildPath("cpp-definition-cache");
+   return module_context::scopedScratchPath().completeChildPath("cpp-definition-index");
 }
 
 void loadDefinitionIndex()
 {
-   using namespace safe_convert;
-
-   FilePath indexFilePath = definitionIndexFilePath();
-   if (!indexFilePath.exists())
-      return;
-
-   std::string contents;
-   Error error = readStringFromFile(indexFilePath, &contents);
-   if (error)
+   // remove the cache written by earlier versions (as JSON)
+   FilePath legacyFilePath =
+      module_context::scopedScratchPath().completeChildPath("cpp-definition-cache");
+   if (legacyFilePath.exists())
    {
-      LOG_ERROR(error);
-      return;
+      Error error = legacyFilePath.remove();
+      if (error)
+         LOG_ERROR(error);
    }
 
-   json::Value indexValueJson;
-   if (indexValueJson.parse(contents) ||
-       !json::isType<json::Array>(indexValueJson))
+   DefinitionCache& cache = definitionCache();
+   Error error = cache.open(definitionIndexFilePath());
+   if (error)
    {
-      LOG_ERROR_MESSAGE("Error parsing definition index: " + contents);
+      LOG_ERROR(error);
       return;
    }
 
-   const json::Array& indexJson = indexValueJson.getArray();
-   for (const json::Value& definitionsJson : indexJson)
+   // forget files which no longer exist
+   for (const std::string& file : cache.files())
    {
-      if (!json::isType<json::Object>(definitionsJson))
-      {
-         LOG_ERROR_MESSAGE("Unexpected non-object type in definition index");
-         continue;
-      }
-
-      json::Array defsArrayJson;
-      double fileLastWrite;
-      CppDefinitions definitions;
-      Error error = json::readObject(definitionsJson.getObject(),
-                                     "file", definitions.file,
-                                     "file_last_write", fileLastWrite,
-                                     "definitions", defsArrayJson);
-      if (error)
-      {
-         LOG_ERROR(error);
-         continue;
-      }
-      definitions.fileLastWrite = numberTo<double, std::time_t>(fileLastWrite, 0);
-
-      // if the file doesn't exist then bail
-      if (!FilePath::exists(definitions.file))
-         continue;
-
-      for (const json::Value& defJson : defsArrayJson)
-      {
-         if (!json::isType<json::Object>(defJson))
-         {
-            LOG_ERROR_MESSAGE("Unexpected non-object type in definition index");
-            continue;
-         }
-
-         CppDefinition definition = cppDefinitionFromJson(defJson.getObject());
-         if (!definition.empty())
-            definitions.definitions.push_back(definition);
-      }
-
-      s_definitionsByFile[definitions.file] = definitions;
+      if (!FilePath::exists(file))
+         cache.removeFile(file);
    }
 }
 
-
 void saveDefinitionIndex()
 {
-   using namespace safe_convert;
-
-   json::Array indexJson;
-   for (const DefinitionsByFile::value_type& defs : s_definitionsByFile)
-   {
-      const CppDefinitions& definitions = defs.second;
-      json::Object definitionsJson;
-      definitionsJson["file"] = definitions.file;
-      definitionsJson["file_last_write"] = numberTo<std::time_t, double>(
-                                               definitions.fileLastWrite, 0);
-      json::Array defsArrayJson;
-      std::transform(definitions.definitions.begin(),
-                     definitions.definitions.end(),
-                     std::back_inserter(defsArrayJson),
-                     cppDefinitionToJson);
-      definitionsJson["definitions"] = defsArrayJson;
-
-      indexJson.push_back(definitionsJson);
-   }
-
-   ;
-   Error error = writeStringToFile(definitionIndexFilePath(), indexJson.writeFormatted());
+   Error error = definitionCache().save();
    if (error)
       LOG_ERROR(error);
 }
@@ -595,20 +477,14 @@ void searchDefinitions(const std::string& term,
 
    // now search the project index (excluding files we already searched
    // for within the in-memory index)
-   // if we didn't find it there then look for it in our index
-   // of all saved files
-   for (const DefinitionsByFile::value_type& defs : s_definitionsByFile)
-   {
-      // skip files we've already searched
-      if (units.find(defs.first) != units.end())
-         continue;
+   std::set<std::string> searchedFiles;
+   for (const TranslationUnits::value_type& unit : units)
+      searchedFiles.insert(unit.first);
 
-      for (const CppDefinition& def : defs.second.definitions)
-      {
-         if (matches(term, pattern, def))
-            pDefinitions->push_back(def);
-      }
-   }
+   definitionCache().searchDefinitions(
+            boost::bind(matches, term, pattern, _1),
+            searchedFiles,
+            pDefinitions);
 }
 
 Error initializeDefinitionIndex()
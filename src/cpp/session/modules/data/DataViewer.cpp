@@ -14,6 +14,7 @@
  */
 
 #include "DataViewer.hpp"
+#include "DataViewerIndex.hpp"
 
 #include <string>
 #include <vector>
@@ -127,6 +128,12 @@ namespace {
  *    This allows us to efficiently perform operations on very large datasets
  *    once they've been winnowed down to smaller objects using searches and
  *    filters.
+ *
+ *    Sorts and filters on numeric, integer, logical and factor columns don't
+ *    need a working copy: they're evaluated directly on the column vectors
+ *    (see DataViewerIndex.hpp), and we keep only the resulting row indexes
+ *    (a WorkingIndex) for the cache key. Each page of data is then sliced
+ *    from the original or cached object by those indexes.
  */    
 
 // indicates whether one filter string is a subset of another; e.g. if a column
@@ -196,6 +203,23 @@ bool isFilterSubset(const std::string& outer, const std::string& inner)
    return false;
 }
 
+// indicates whether every row matching the 'inner' filters also matches the
+// 'outer' filters (an empty filter matches all rows)
+bool isFilterSetSubset(const std::vector<std::string>& outer,
+                       const std::vector<std::string>& inner)
+{
+   for (std::size_t i = 0; i < outer.size(); ++i)
+   {
+      if (outer[i].empty())
+         continue;
+
+      if (i >= inner.size() || !isFilterSubset(outer[i], inner[i]))
+         return false;
+   }
+
+   return true;
+}
+
 typedef enum 
 {
   DIM_ROWS,
@@ -296,6 +320,37 @@ struct CachedFrame
 // The set of active frames. Used primarily to check each for changes.
 std::map<std::string, CachedFrame> s_cachedFrames;
 
+// The rows of a frame to display, in display order, for sorts and filters
+// we can evaluate natively.
+struct WorkingIndex
+{
+   WorkingIndex() : dataSEXP(nullptr), nrow(0), filtered(false) {}
+
+   // NB: There's no protection on this SEXP; used only to check that the
+   // index was built for the object being viewed.
+   SEXP dataSEXP;
+   int nrow;
+
+   std::vector<std::string> filters;
+   std::vector<int> orderCols;
+   std::vector<std::string> orderDirs;
+
+   // the rows matching the filters, in frame order (if there are filters)
+   bool filtered;
+   std::vector<int> filteredRows;
+
+   // the rows in display order (if sorted)
+   std::vector<int> sortedRows;
+
+   const std::vector<int>& rows() const
+   {
+      return orderCols.empty() ? filteredRows : sortedRows;
+   }
+};
+
+// The working indexes, by cache key.
+std::map<std::string, WorkingIndex> s_workingIndexes;
+
 std::string viewerCacheDir() 
 {
    return module_context::sessionScratchPath().completeChildPath(kViewerCacheDir)
@@ -464,6 +519,169 @@ json::Value getCols(SEXP dataSEXP)
    return result;
 }
 
+// provides a view of a column's data for native sorting and filtering, if
+// we know how R compares its values
+bool columnData(SEXP columnSEXP, int nrow, bool sorting, ColumnData* pColumn)
+{
+   if (columnSEXP == nullptr || Rf_length(columnSEXP) != nrow)
+      return false;
+
+   // other classes may define their own comparisons; dates and times sort
+   // as the numbers underlying them
+   bool plain = !Rf_isObject(columnSEXP);
+   bool temporal = Rf_inherits(columnSEXP, "Date") ||
+                   Rf_inherits(columnSEXP, "POSIXct") ||
+                   Rf_inherits(columnSEXP, "difftime");
+
+   switch (TYPEOF(columnSEXP))
+   {
+   case REALSXP:
+      if (!plain && !(sorting && temporal))
+         return false;
+      *pColumn = ColumnData::real(REAL(columnSEXP), nrow);
+      return true;
+
+   case INTSXP:
+      if (Rf_isFactor(columnSEXP))
+      {
+         *pColumn = ColumnData::integer(
+                  ColumnData::TypeFactor, INTEGER(columnSEXP), nrow);
+         return true;
+      }
+      if (!plain && !(sorting && temporal))
+         return false;
+      *pColumn = ColumnData::integer(
+               ColumnData::TypeInteger, INTEGER(columnSEXP), nrow);
+      return true;
+
+   case LGLSXP:
+      if (!plain)
+         return false;
+      *pColumn = ColumnData::integer(
+               ColumnData::TypeLogical, LOGICAL(columnSEXP), nrow);
+      return true;
+
+   default:
+      return false;
+   }
+}
+
+// returns the working index for the requested sorts and filters, building
+// it if necessary, or nullptr if they can't be evaluated natively (in which
+// case .rs.applyTransform must be used)
+const WorkingIndex* findWorkingIndex(SEXP dataSEXP,
+                                     int nrow,
+                                     const std::string& cacheKey,
+                                     const std::string& search,
+                                     const std::vector<std::string>& filters,
+                                     const std::vector<int>& orderCols,
+                                     const std::vector<std::string>& orderDirs)
+{
+   // global searches match the formatted values of every column, which only
+   // R can produce; data.tables need converting before they can be subset
+   if (!search.empty() ||
+       !Rf_inherits(dataSEXP, "data.frame") ||
+       Rf_inherits(dataSEXP, "data.table"))
+   {
+      s_workingIndexes.erase(cacheKey);
+      return nullptr;
+   }
+
+   int ncol = Rf_length(dataSEXP);
+
+   // as in .rs.applyTransform, the i'th filter applies to the i'th column
+   std::vector<RowFilter> rowFilters;
+   for (std::size_t i = 0; i < filters.size(); i++)
+   {
+      if (filters[i].empty())
+         continue;
+
+      ColumnData column;
+      RowFilter filter;
+      bool ignore = false;
+      if (static_cast<int>(i) >= ncol ||
+          !columnData(VECTOR_ELT(dataSEXP, i), nrow, false, &column) ||
+          !RowFilter::parse(filters[i], column, &filter, &ignore))
+      {
+         s_workingIndexes.erase(cacheKey);
+         return nullptr;
+      }
+
+      if (!ignore)
+         rowFilters.push_back(filter);
+   }
+
+   std::vector<SortKey> sortKeys;
+   for (std::size_t i = 0; i < orderCols.size(); i++)
+   {
+      ColumnData column;
+      if (orderCols[i] > ncol ||
+          !columnData(VECTOR_ELT(dataSEXP, orderCols[i] - 1), nrow, true, &column))
+      {
+         s_workingIndexes.erase(cacheKey);
+         return nullptr;
+      }
+
+      sortKeys.push_back(SortKey(column, orderDirs[i] == "asc"));
+   }
+
+   WorkingIndex& index = s_workingIndexes[cacheKey];
+   bool sameData = index.dataSEXP == dataSEXP && index.nrow == nrow;
+   if (sameData && index.filters == filters &&
+       index.orderCols == orderCols && index.orderDirs == orderDirs)
+   {
+      return &index;
+   }
+
+   // if we had a working copy for this frame, we no longer need it
+   if (index.dataSEXP == nullptr)
+      r::exec::RFunction(".rs.removeWorkingData", cacheKey).call();
+
+   if (!sameData || index.filters != filters)
+   {
+      if (rowFilters.empty())
+      {
+         index.filtered = false;
+         index.filteredRows.clear();
+      }
+      else
+      {
+         // narrow the rows we already have if the new filters are stricter
+         bool narrowing = sameData && index.filtered &&
+                          isFilterSetSubset(index.filters, filters);
+         index.filteredRows = filterRows(
+                  nrow,
+                  rowFilters,
+                  narrowing ? &index.filteredRows : nullptr);
+         index.filtered = true;
+      }
+   }
+
+   index.sortedRows.clear();
+   if (!sortKeys.empty())
+   {
+      if (index.filtered)
+      {
+         index.sortedRows = index.filteredRows;
+      }
+      else
+      {
+         index.sortedRows.resize(nrow);
+         for (int i = 0; i < nrow; i++)
+            index.sortedRows[i] = i;
+      }
+
+      sortRows(sortKeys, &index.sortedRows);
+   }
+
+   index.dataSEXP = dataSEXP;
+   index.nrow = nrow;
+   index.filters = filters;
+   index.orderCols = orderCols;
+   index.orderDirs = orderDirs;
+   return &index;
+}
+
 // given an object from which to return data, and a description of the data to
 // return via URL-encoded parameters supplied by the DataTables API, returns the
 // data requested by the parameters. 
@@ -548,6 +766,16 @@ json::Value getData(SEXP dataSEXP, const http::Fields& fields)
    bool needsTransform = ordercols.size() > 0 || hasFilter || !search.empty();
    bool hasTransform = false;
 
+   // sort and filter natively if we can
+   const WorkingIndex* pIndex = nullptr;
+   if (needsTransform)
+   {
+      pIndex = findWorkingIndex(dataSEXP, nrow, cacheKey, search, filters,
+                                ordercols, orderdirs);
+      if (pIndex)
+         needsTransform = false;
+   }
+
    // check to see if we have an ordered/filtered view we can build from
    std::map<std::string, CachedFrame>::iterator cachedFrame = 
       s_cachedFrames.find(cacheKey);
@@ -619,9 +847,12 @@ json::Value getData(SEXP dataSEXP, const http::Fields& fields)
    }
 
    // apply new row count if we've transformed the data (or need to)
-   filteredNRow = needsTransform || hasTransform ?
-      safeDim(dataSEXP, DIM_ROWS) : 
-      nrow;
+   if (pIndex)
+      filteredNRow = gsl::narrow_cast<int>(pIndex->rows().size());
+   else if (needsTransform || hasTransform)
+      filteredNRow = safeDim(dataSEXP, DIM_ROWS);
+   else
+      filteredNRow = nrow;
 
    // return the lesser of the rows available and rows requested
    length = std::min(length, filteredNRow - start);
@@ -629,6 +860,26 @@ json::Value getData(SEXP dataSEXP, const http::Fields& fields)
    // DataTables uses 0-based indexing, but R uses 1-based indexing
    start++;
 
+   // the first row of dataSEXP to format
+   int formatStart = start;
+
+   // with a working index, slice the requested rows out of the frame
+   if (pIndex && length > 0)
+   {
+      const std::vector<int>& rows = pIndex->rows();
+      SEXP rowsSEXP = Rf_allocVector(INTSXP, length);
+      protect.add(rowsSEXP);
+      for (int i = 0; i < length; i++)
+         INTEGER(rowsSEXP)[i] = rows[start - 1 + i] + 1;
+
+      error = r::exec::RFunction(".rs.sliceWorkingRows", dataSEXP, rowsSEXP)
+         .call(&dataSEXP, &protect);
+      if (error)
+         throw r::exec::RErrorException(error.getSummary());
+
+      formatStart = 1;
+   }
+
    // extract the portion of the column vector requested by the client
    int numFormattedColumns = ncol - columnOffset < maxColumns ? ncol - columnOffset : maxColumns;
    SEXP formattedDataSEXP = Rf_allocVector(VECSXP, numFormattedColumns);
@@ -647,7 +898,7 @@ json::Value getData(SEXP dataSEXP, const http::Fields& fields)
       SEXP formattedColumnSEXP;
       r::exec::RFunction formatFx(".rs.formatDataColumn");
       formatFx.addParam(columnSEXP);
-      formatFx.addParam(gsl::narrow_cast<int>(start));
+      formatFx.addParam(gsl::narrow_cast<int>(formatStart));
       formatFx.addParam(gsl::narrow_cast<int>(length));
       error = formatFx.call(&formattedColumnSEXP, &protect);
       if (error)
@@ -657,7 +908,7 @@ json::Value getData(SEXP dataSEXP, const http::Fields& fields)
 
    // format the row names
    SEXP rownamesSEXP;
-   r::exec::RFunction(".rs.formatRowNames", dataSEXP, start, length)
+   r::exec::RFunction(".rs.formatRowNames", dataSEXP, formatStart, length)
       .call(&rownamesSEXP, &protect);
    
    // create the result grid as JSON
@@ -842,6 +1093,7 @@ Error removeCacheKey(const std::string& cacheKey)
       s_cachedFrames.find(cacheKey);
    if (pos != s_cachedFrames.end())
       s_cachedFrames.erase(pos);
+   s_workingIndexes.erase(cacheKey);
    
    // remove cache env object and backing file
    return r::exec::RFunction(".rs.removeCachedData", cacheKey, 
@@ -903,6 +1155,7 @@ void onDetectChanges(module_context::ChangeSource source)
 
          // clear working data for the object
          r::exec::RFunction(".rs.removeWorkingData", i->first).call();
+         s_workingIndexes.erase(i->first);
 
          // replace cached copy (if we have something to replace it with)
          if (sexp != nullptr)
@@ -975,7 +1228,7 @@ void onDeferredInit(bool newSession)
 {
    // get all the cache keys in the source database
    std::vector<boost::shared_ptr<source_database::SourceDocument> > docs;
-   Error error = source_database::list(&docs);
+   Error error = source_database::list(&docs, false);
    if (error)
    {
       LOG_ERROR(error);
@@ -0,0 +1,379 @@
+/*
+ * DataViewerIndex.cpp
+ *
+ * Copyright (C) 2020 by RStudio, PBC
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include "DataViewerIndex.hpp"
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstdlib>
+
+#include <boost/algorithm/string/classification.hpp>
+#include <boost/algorithm/string/split.hpp>
+#include <boost/bind.hpp>
+#include <boost/function.hpp>
+#include <boost/thread.hpp>
+
+#include <core/StringUtils.hpp>
+
+#define kFilterSeparator '|'
+
+// the fewest rows worth handing to a thread of their own
+#define kMinRowsPerThread 65536
+
+namespace rstudio {
+namespace session {
+namespace modules {
+namespace data {
+namespace viewer {
+
+namespace {
+
+const int kNAInteger = INT_MIN;
+
+bool parseNumber(const std::string& text, double* pValue)
+{
+   std::string trimmed = core::string_utils::trimWhitespace(text);
+   if (trimmed.empty())
+      return false;
+
+   char* pEnd = nullptr;
+   double value = std::strtod(trimmed.c_str(), &pEnd);
+   if (pEnd != trimmed.c_str() + trimmed.size() || std::isnan(value))
+      return false;
+
+   *pValue = value;
+   return true;
+}
+
+// the number of blocks to split n rows into for processing in parallel
+std::size_t blockCount(std::size_t n)
+{
+   std::size_t threads = std::max(1u, boost::thread::hardware_concurrency());
+   return std::max<std::size_t>(1, std::min(threads, n / kMinRowsPerThread));
+}
+
+// splits [0, n) into blocks and runs 'work' on each (with the block's
+// index), one thread per block
+void forEachBlock(std::size_t n,
+                  std::size_t blocks,
+                  const boost::function<void(std::size_t, std::size_t, std::size_t)>& work)
+{
+   std::size_t blockSize = (n + blocks - 1) / std::max<std::size_t>(blocks, 1);
+
+   boost::thread_group threads;
+   for (std::size_t block = 1; block < blocks; ++block)
+   {
+      std::size_t begin = std::min(n, block * blockSize);
+      std::size_t end = std::min(n, begin + blockSize);
+
+      try
+      {
+         threads.create_thread(boost::bind(work, block, begin, end));
+      }
+      catch (const boost::thread_resource_error&)
+      {
+         work(block, begin, end);
+      }
+   }
+
+   // the calling thread takes the first block
+   work(0, 0, std::min(n, blockSize));
+   threads.join_all();
+}
+
+void filterBlock(std::size_t begin,
+                 std::size_t end,
+                 const std::vector<RowFilter>& filters,
+                 const std::vector<int>* pCandidates,
+                 std::vector<int>* pRows)
+{
+   // collect the candidates, then narrow them one filter (and so one
+   // column) at a time
+   if (pCandidates)
+   {
+      pRows->assign(pCandidates->begin() + begin, pCandidates->begin() + end);
+   }
+   else
+   {
+      pRows->resize(end - begin);
+      for (std::size_t i = begin; i < end; ++i)
+         (*pRows)[i - begin] = static_cast<int>(i);
+   }
+
+   for (const RowFilter& filter : filters)
+   {
+      pRows->erase(
+               std::remove_if(
+                  pRows->begin(),
+                  pRows->end(),
+                  [&](int row) { return !filter.matches(row); }),
+               pRows->end());
+   }
+}
+
+// compares the values of two rows in a column: negative, zero or positive;
+// missing values are greater than everything
+int compareValues(const ColumnData& column, int lhs, int rhs, bool ascending)
+{
+   bool lhsNA = column.isNA(lhs);
+   bool rhsNA = column.isNA(rhs);
+   if (lhsNA || rhsNA)
+      return lhsNA - rhsNA;
+
+   int result;
+   if (column.type == ColumnData::TypeReal)
+   {
+      double a = column.pReal[lhs];
+      double b = column.pReal[rhs];
+      result = a < b ? -1 : (b < a ? 1 : 0);
+   }
+   else
+   {
+      int a = column.pInteger[lhs];
+      int b = column.pInteger[rhs];
+      result = a < b ? -1 : (b < a ? 1 : 0);
+   }
+
+   return ascending ? result : -result;
+}
+
+class RowComparator
+{
+public:
+   explicit RowComparator(const std::vector<SortKey>& keys)
+      : keys_(keys)
+   {
+   }
+
+   bool operator()(int lhs, int rhs) const
+   {
+      for (const SortKey& key : keys_)
+      {
+         int result = compareValues(key.column, lhs, rhs, key.ascending);
+         if (result != 0)
+            return result < 0;
+      }
+      return lhs < rhs;
+   }
+
+private:
+   const std::vector<SortKey>& keys_;
+};
+
+} // anonymous namespace
+
+ColumnData ColumnData::real(const double* pData, std::size_t length)
+{
+   ColumnData column;
+   column.type = TypeReal;
+   column.pReal = pData;
+   column.length = length;
+   return column;
+}
+
+ColumnData ColumnData::integer(Type type, const int* pData, std::size_t length)
+{
+   ColumnData column;
+   column.type = type;
+   column.pInteger = pData;
+   column.length = length;
+   return column;
+}
+
+bool ColumnData::isNA(std::size_t row) const
+{
+   return type == TypeReal ?
+            std::isnan(pReal[row]) :
+            pInteger[row] == kNAInteger;
+}
+
+bool RowFilter::parse(const std::string& spec,
+                      const ColumnData& column,
+                      RowFilter* pFilter,
+                      bool* pIgnore)
+{
+   *pIgnore = false;
+
+   // filters without a type and value have no effect
+   std::size_t separator = spec.find(kFilterSeparator);
+   if (separator == std::string::npos || separator + 1 >= spec.size())
+   {
+      *pIgnore = true;
+      return true;
+   }
+
+   // leave empty values (and their NA comparisons) to R
+   if (spec[separator + 1] == kFilterSeparator)
+      return false;
+
+   std::string type = spec.substr(0, separator);
+   std::string value = spec.substr(separator + 1);
+   value = value.substr(0, value.find(kFilterSeparator));
+
+   pFilter->column_ = column;
+
+   if (type == "factor")
+   {
+      double code;
+      if (column.type != ColumnData::TypeFactor || !parseNumber(value, &code))
+         return false;
+
+      // a code which isn't an integer matches nothing
+      pFilter->kind_ = KindFactor;
+      pFilter->value_ = code == std::floor(code) && code > INT_MIN && code <= INT_MAX ?
+               static_cast<int>(code) :
+               kNAInteger;
+      return true;
+   }
+   else if (type == "numeric")
+   {
+      if (column.type != ColumnData::TypeReal &&
+          column.type != ColumnData::TypeInteger)
+      {
+         return false;
+      }
+
+      // a range ("2_32") or a single value; as with strsplit(), a trailing
+      // separator is ignored
+      std::vector<std::string> bounds;
+      boost::algorithm::split(bounds, value, boost::algorithm::is_any_of("_"));
+      if (!bounds.empty() && bounds.back().empty())
+         bounds.pop_back();
+
+      pFilter->kind_ = KindRange;
+      if (bounds.size() == 1)
+      {
+         if (!parseNumber(bounds[0], &pFilter->lower_))
+            return false;
+         pFilter->upper_ = pFilter->lower_;
+      }
+      else if (bounds.size() > 1)
+      {
+         if (!parseNumber(bounds[0], &pFilter->lower_) ||
+             !parseNumber(bounds[1], &pFilter->upper_))
+         {
+            return false;
+         }
+      }
+      else
+      {
+         return false;
+      }
+      return true;
+   }
+   else if (type == "boolean")
+   {
+      if (column.type != ColumnData::TypeLogical)
+         return false;
+
+      pFilter->kind_ = KindBoolean;
+      pFilter->value_ = value == "TRUE" ? 1 : 0;
+      return true;
+   }
+   else if (type == "character")
+   {
+      // requires R's regular expressions and string conversions
+      return false;
+   }
+
+   // unknown filter types have no effect
+   *pIgnore = true;
+   return true;
+}
+
+bool RowFilter::matches(std::size_t row) const
+{
+   switch (kind_)
+   {
+   case KindRange:
+   {
+      double value = column_.type == ColumnData::TypeReal ?
+               column_.pReal[row] :
+               (column_.pInteger[row] == kNAInteger ?
+                   NAN :
+                   static_cast<double>(column_.pInteger[row]));
+      return std::isfinite(value) && value >= lower_ && value <= upper_;
+   }
+   case KindFactor:
+   case KindBoolean:
+      return column_.pInteger[row] != kNAInteger &&
+             column_.pInteger[row] == value_;
+   }
+
+   return false;
+}
+
+std::vector<int> filterRows(std::size_t nrow,
+                            const std::vector<RowFilter>& filters,
+                            const std::vector<int>* pCandidates)
+{
+   std::size_t n = pCandidates ? pCandidates->size() : nrow;
+   std::size_t blocks = blockCount(n);
+
+   // filter blocks of rows in parallel, then join the results
+   std::vector<std::vector<int>> results(blocks);
+   forEachBlock(n, blocks, [&](std::size_t block, std::size_t begin, std::size_t end) {
+      filterBlock(begin, end, filters, pCandidates, &results[block]);
+   });
+
+   if (blocks == 1)
+      return std::move(results[0]);
+
+   std::size_t total = 0;
+   for (const std::vector<int>& result : results)
+      total += result.size();
+
+   std::vector<int> rows;
+   rows.reserve(total);
+   for (const std::vector<int>& result : results)
+      rows.insert(rows.end(), result.begin(), result.end());
+   return rows;
+}
+
+void sortRows(const std::vector<SortKey>& keys, std::vector<int>* pRows)
+{
+   std::vector<int>& rows = *pRows;
+   RowComparator compare(keys);
+
+   // sort blocks of rows in parallel
+   std::size_t n = rows.size();
+   std::size_t blocks = blockCount(n);
+   std::size_t blockSize = (n + blocks - 1) / std::max<std::size_t>(blocks, 1);
+   forEachBlock(n, blocks, [&](std::size_t, std::size_t begin, std::size_t end) {
+      std::sort(rows.begin() + begin, rows.begin() + end, compare);
+   });
+
+   // then merge neighboring blocks pairwise, also in parallel
+   for (std::size_t width = blockSize; width < n; width *= 2)
+   {
+      std::size_t merges = (n + 2 * width - 1) / (2 * width);
+      forEachBlock(merges, merges, [&](std::size_t merge, std::size_t, std::size_t) {
+         std::size_t begin = merge * 2 * width;
+         std::size_t middle = std::min(n, begin + width);
+         std::size_t end = std::min(n, begin + 2 * width);
+         std::inplace_merge(rows.begin() + begin,
+                            rows.begin() + middle,
+                            rows.begin() + end,
+                            compare);
+      });
+   }
+}
+
+} // namespace viewer
+} // namespace data
+} // namespace modules
+} // namespace session
+} // namespace rstudio
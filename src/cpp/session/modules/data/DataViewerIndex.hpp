@@ -0,0 +1,119 @@
+/*
+ * DataViewerIndex.hpp
+ *
+ * Copyright (C) 2020 by RStudio, PBC
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef SESSION_DATA_VIEWER_INDEX_HPP
+#define SESSION_DATA_VIEWER_INDEX_HPP
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace rstudio {
+namespace session {
+namespace modules {
+namespace data {
+namespace viewer {
+
+// Sorting and filtering of data viewer rows, evaluated directly on the
+// column vectors of a frame rather than by R. Rows are identified by their
+// 0-based index in the frame; sorting and filtering produce vectors of row
+// indexes, so no copy of the frame's data is ever made.
+//
+// These functions don't call into R, and may be evaluated on worker threads
+// (provided the frame isn't modified while they run).
+
+// A read-only view of a column's data. Missing values are represented as R
+// represents them: NaN for real columns, and INT_MIN (NA_INTEGER) otherwise.
+struct ColumnData
+{
+   enum Type
+   {
+      TypeReal,
+      TypeInteger,
+      TypeLogical,
+      TypeFactor
+   };
+
+   ColumnData() : type(TypeReal), pReal(nullptr), pInteger(nullptr), length(0) {}
+
+   static ColumnData real(const double* pData, std::size_t length);
+   static ColumnData integer(Type type, const int* pData, std::size_t length);
+
+   bool isNA(std::size_t row) const;
+
+   Type type;
+   const double* pReal;
+   const int* pInteger;
+   std::size_t length;
+};
+
+// A column filter, as sent by the client (e.g. "numeric|12_25"); see
+// .rs.applyTransform for the semantics we reproduce
+class RowFilter
+{
+public:
+   // returns false if the filter can't be evaluated natively for the column
+   // (in which case R must be used); filters which have no effect (such as
+   // those with no value) are parsed successfully but set 'pIgnore'
+   static bool parse(const std::string& spec,
+                     const ColumnData& column,
+                     RowFilter* pFilter,
+                     bool* pIgnore);
+
+   bool matches(std::size_t row) const;
+
+private:
+   enum Kind
+   {
+      KindRange,
+      KindFactor,
+      KindBoolean
+   };
+
+   Kind kind_;
+   ColumnData column_;
+   double lower_;
+   double upper_;
+   int value_;
+};
+
+struct SortKey
+{
+   SortKey(const ColumnData& column, bool ascending)
+      : column(column), ascending(ascending)
+   {
+   }
+
+   ColumnData column;
+   bool ascending;
+};
+
+// returns the rows (in ascending order) among 'candidates' matching every
+// filter; if 'candidates' is null, all 'nrow' rows are candidates
+std::vector<int> filterRows(std::size_t nrow,
+                            const std::vector<RowFilter>& filters,
+                            const std::vector<int>* pCandidates = nullptr);
+
+// sorts rows by the given keys as R's order() does: missing values last in
+// either direction, and ties kept in the order of the row indexes
+void sortRows(const std::vector<SortKey>& keys, std::vector<int>* pRows);
+
+} // namespace viewer
+} // namespace data
+} // namespace modules
+} // namespace session
+} // namespace rstudio
+
+#endif // SESSION_DATA_VIEWER_INDEX_HPP
@@ -0,0 +1,179 @@
+/*
+ * DataViewerIndexTests.cpp
+ *
+ * Copyright (C) 2020 by RStudio, PBC
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include "DataViewerIndex.hpp"
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <random>
+
+#define RSTUDIO_NO_TESTTHAT_ALIASES
+#include <tests/TestThat.hpp>
+
+namespace rstudio {
+namespace session {
+namespace modules {
+namespace data {
+namespace viewer {
+namespace tests {
+
+namespace {
+
+const int kNA = INT_MIN;
+
+RowFilter parseFilter(const std::string& spec, const ColumnData& column)
+{
+   RowFilter filter;
+   bool ignore = true;
+   REQUIRE(RowFilter::parse(spec, column, &filter, &ignore));
+   REQUIRE_FALSE(ignore);
+   return filter;
+}
+
+std::vector<int> allRows(std::size_t n)
+{
+   std::vector<int> rows(n);
+   for (std::size_t i = 0; i < n; ++i)
+      rows[i] = static_cast<int>(i);
+   return rows;
+}
+
+} // anonymous namespace
+
+TEST_CASE("DataViewerIndex")
+{
+   std::vector<double> reals = { 3.5, NAN, -1, 10, 3.5, INFINITY };
+   std::vector<int> integers = { 2, kNA, 7, 2, 0, 5 };
+   std::vector<int> logicals = { 1, 0, kNA, 1, 0, 1 };
+   std::vector<int> factors = { 2, 1, 2, kNA, 3, 1 };
+
+   ColumnData realColumn = ColumnData::real(reals.data(), reals.size());
+   ColumnData integerColumn = ColumnData::integer(
+            ColumnData::TypeInteger, integers.data(), integers.size());
+   ColumnData logicalColumn = ColumnData::integer(
+            ColumnData::TypeLogical, logicals.data(), logicals.size());
+   ColumnData factorColumn = ColumnData::integer(
+            ColumnData::TypeFactor, factors.data(), factors.size());
+
+   SECTION("Numeric filters match finite values in range")
+   {
+      std::vector<RowFilter> filters = { parseFilter("numeric|0_5", realColumn) };
+      CHECK(filterRows(reals.size(), filters) == std::vector<int>({ 0, 4 }));
+
+      filters = { parseFilter("numeric|3.5", realColumn) };
+      CHECK(filterRows(reals.size(), filters) == std::vector<int>({ 0, 4 }));
+
+      filters = { parseFilter("numeric|-100_1e308", realColumn) };
+      CHECK(filterRows(reals.size(), filters) == std::vector<int>({ 0, 2, 3, 4 }));
+
+      filters = { parseFilter("numeric|2_", integerColumn) };
+      CHECK(filterRows(integers.size(), filters) == std::vector<int>({ 0, 3 }));
+   }
+
+   SECTION("Factor and boolean filters ignore missing values")
+   {
+      std::vector<RowFilter> filters = { parseFilter("factor|2", factorColumn) };
+      CHECK(filterRows(factors.size(), filters) == std::vector<int>({ 0, 2 }));
+
+      filters = { parseFilter("boolean|TRUE", logicalColumn) };
+      CHECK(filterRows(logicals.size(), filters) == std::vector<int>({ 0, 3, 5 }));
+
+      filters = { parseFilter("boolean|FALSE", logicalColumn) };
+      CHECK(filterRows(logicals.size(), filters) == std::vector<int>({ 1, 4 }));
+   }
+
+   SECTION("Filters combine, and can narrow a previous result")
+   {
+      std::vector<RowFilter> filters = {
+         parseFilter("boolean|TRUE", logicalColumn),
+         parseFilter("numeric|1_5", integerColumn)
+      };
+      CHECK(filterRows(6, filters) == std::vector<int>({ 0, 3, 5 }));
+
+      std::vector<int> candidates = { 3, 5 };
+      CHECK(filterRows(6, filters, &candidates) == candidates);
+   }
+
+   SECTION("Filters we can't evaluate natively are rejected")
+   {
+      RowFilter filter;
+      bool ignore = false;
+      CHECK_FALSE(RowFilter::parse("character|abc", realColumn, &filter, &ignore));
+      CHECK_FALSE(RowFilter::parse("numeric|abc", realColumn, &filter, &ignore));
+      CHECK_FALSE(RowFilter::parse("factor|1", integerColumn, &filter, &ignore));
+      CHECK_FALSE(RowFilter::parse("boolean|TRUE", realColumn, &filter, &ignore));
+
+      CHECK(RowFilter::parse("numeric|", realColumn, &filter, &ignore));
+      CHECK(ignore);
+      CHECK(RowFilter::parse("unknown|1", realColumn, &filter, &ignore));
+      CHECK(ignore);
+   }
+
+   SECTION("Sorting puts missing values last in either direction")
+   {
+      std::vector<int> rows = allRows(reals.size());
+      sortRows({ SortKey(realColumn, true) }, &rows);
+      CHECK(rows == std::vector<int>({ 2, 0, 4, 3, 5, 1 }));
+
+      rows = allRows(reals.size());
+      sortRows({ SortKey(realColumn, false) }, &rows);
+      CHECK(rows == std::vector<int>({ 5, 3, 0, 4, 2, 1 }));
+
+      rows = allRows(factors.size());
+      sortRows({ SortKey(factorColumn, false), SortKey(integerColumn, true) }, &rows);
+      CHECK(rows == std::vector<int>({ 4, 0, 2, 5, 1, 3 }));
+   }
+
+   SECTION("Large frames are filtered and sorted in blocks")
+   {
+      const std::size_t n = 1000000;
+      std::mt19937 rng(42);
+      std::uniform_int_distribution<int> values(-50, 50);
+
+      std::vector<int> column(n);
+      for (std::size_t i = 0; i < n; ++i)
+         column[i] = i % 97 == 0 ? kNA : values(rng);
+      ColumnData data = ColumnData::integer(ColumnData::TypeInteger, column.data(), n);
+
+      std::vector<RowFilter> filters = { parseFilter("numeric|-10_20", data) };
+      std::vector<int> rows = filterRows(n, filters);
+
+      std::vector<int> expected;
+      for (std::size_t i = 0; i < n; ++i)
+         if (column[i] != kNA && column[i] >= -10 && column[i] <= 20)
+            expected.push_back(static_cast<int>(i));
+      REQUIRE(rows == expected);
+
+      std::vector<int> sorted = allRows(n);
+      sortRows({ SortKey(data, false) }, &sorted);
+
+      // stable_sort gives R's tie order for rows in ascending order
+      std::vector<int> reference = allRows(n);
+      std::stable_sort(reference.begin(), reference.end(), [&](int lhs, int rhs) {
+         if (column[lhs] == kNA || column[rhs] == kNA)
+            return column[rhs] == kNA && column[lhs] != kNA;
+         return column[lhs] > column[rhs];
+      });
+      CHECK(sorted == reference);
+   }
+}
+
+} // namespace tests
+} // namespace viewer
+} // namespace data
+} // namespace modules
+} // namespace session
+} // namespace rstudio
@@ -15,6 +15,9 @@
 
 #include "EnvironmentMonitor.hpp"
 
+#include <boost/bind.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
 #include <r/RSexp.hpp>
 #include <r/RInterface.hpp>
 #include <session/SessionModuleContext.hpp>
@@ -30,11 +33,9 @@ namespace modules {
 namespace environment {
 namespace {
 
-bool compareVarName(const r::sexp::Variable& var1,
-                    const r::sexp::Variable& var2)
-{
-   return var1.first < var2.first;
-}
+// how long we spend describing assigned objects when changes are found, and
+// in each idle period thereafter
+const int kAssignedEventBudgetMs = 100;
 
 void enqueRefreshEvent()
 {
@@ -42,43 +43,18 @@ void enqueRefreshEvent()
    module_context::enqueClientEvent(refreshEvent);
 }
 
-// if the given variable is an unevaluated promise, add it to the given
-// list of variables
-void addUnevaledPromise(std::vector<r::sexp::Variable>* pEnv,
-                        const r::sexp::Variable& var)
-{
-   if (isUnevaluatedPromise(var.second))
-   {
-      pEnv->push_back(var);
-   }
-}
-
-// If the given variable exists in the given list, remove it. Compares on name
-// only.
-void removeVarFromList(std::vector<r::sexp::Variable>* pEnv,
-                       const r::sexp::Variable& var)
-{
-   for (std::vector<r::sexp::Variable>::iterator iter = pEnv->begin();
-        iter != pEnv->end(); iter++)
-   {
-      if (iter->first == var.first)
-      {
-         pEnv->erase(iter);
-         break;
-      }
-   }
-}
-
 } // anonymous namespace
 
 EnvironmentMonitor::EnvironmentMonitor() :
+   generation_(0),
+   streaming_(false),
    initialized_(false),
    refreshOnInit_(false)
 {}
 
-void EnvironmentMonitor::enqueRemovedEvent(const r::sexp::Variable& variable)
+void EnvironmentMonitor::enqueRemovedEvent(const std::string& name)
 {
-   ClientEvent removedEvent(client_events::kEnvironmentRemoved, variable.first);
+   ClientEvent removedEvent(client_events::kEnvironmentRemoved, name);
    module_context::enqueClientEvent(removedEvent);
 }
 
@@ -92,6 +68,60 @@ void EnvironmentMonitor::enqueAssignedEvent(const r::sexp::Variable& variable)
    module_context::enqueClientEvent(assignedEvent);
 }
 
+void EnvironmentMonitor::enquePendingAssignedEvent()
+{
+   std::string name = *pendingAssigns_.begin();
+   pendingAssigns_.erase(pendingAssigns_.begin());
+
+   if (!hasEnvironment())
+      return;
+
+   // describe the object's current value; as when listing, don't fire
+   // active bindings
+   SEXP env = getMonitoredEnvironment();
+   SEXP valueSEXP = R_NilValue;
+   if (!r::sexp::isActiveBinding(name, env))
+      valueSEXP = r::sexp::findVar(name, env);
+
+   // if it has been removed in the meantime, the next check will say so
+   if (valueSEXP == R_UnboundValue)
+      return;
+
+   r::sexp::Protect rProtect(valueSEXP);
+   enqueAssignedEvent(std::make_pair(name, valueSEXP));
+}
+
+void EnvironmentMonitor::enquePendingAssignedEvents()
+{
+   using namespace boost::posix_time;
+
+   ptime deadline = microsec_clock::universal_time() +
+         milliseconds(kAssignedEventBudgetMs);
+   while (!pendingAssigns_.empty() &&
+          microsec_clock::universal_time() < deadline)
+   {
+      enquePendingAssignedEvent();
+   }
+
+   // send the rest when idle
+   if (!pendingAssigns_.empty() && !streaming_)
+   {
+      streaming_ = true;
+      module_context::scheduleIncrementalWork(
+               milliseconds(kAssignedEventBudgetMs),
+               boost::bind(&EnvironmentMonitor::streamPendingAssignedEvents, this));
+   }
+}
+
+bool EnvironmentMonitor::streamPendingAssignedEvents()
+{
+   if (!pendingAssigns_.empty())
+      enquePendingAssignedEvent();
+
+   streaming_ = !pendingAssigns_.empty();
+   return streaming_;
+}
+
 void EnvironmentMonitor::setMonitoredEnvironment(SEXP pEnvironment,
                                                  bool refresh)
 {
@@ -101,6 +131,10 @@ void EnvironmentMonitor::setMonitoredEnvironment(SEXP pEnvironment,
 
    environment_.set(pEnvironment);
 
+   // objects pending from the previous environment mustn't be looked up
+   // (and described to the client) in this one
+   pendingAssigns_.clear();
+
    // init the environment by doing an initial check for changes
    initialized_ = false;
    refreshOnInit_ = refresh;
@@ -123,122 +157,120 @@ void EnvironmentMonitor::listEnv(std::vector<r::sexp::Variable>* pEnv)
    if (!hasEnvironment())
       return;
 
-   r::sexp::Protect rProtect;
+   // the values are only compared by identity (and not retained beyond
+   // this check), so there's no need to protect them
    r::sexp::listEnvironment(getMonitoredEnvironment(),
                             false,
                             prefs::userPrefs().showLastDotValue(),
-                            &rProtect,
+                            nullptr,
                             pEnv);
 }
 
-void EnvironmentMonitor::checkForChanges()
+void EnvironmentMonitor::resetSnapshot(
+      const std::vector<r::sexp::Variable>& environment)
 {
-   // information about the current environment
-   std::vector<r::sexp::Variable> currentEnv ;
-   std::vector<r::sexp::Variable> currentPromises;
+   snapshot_.clear();
+   snapshot_.reserve(environment.size());
+   for (const r::sexp::Variable& variable : environment)
+   {
+      Binding binding;
+      binding.value = variable.second;
+      binding.unevaledPromise = isUnevaluatedPromise(variable.second);
+      binding.generation = generation_;
+      snapshot_[variable.first] = binding;
+   }
 
-   // list of assigns/removes (includes both value changes and promise
-   // evaluations)
-   std::vector<r::sexp::Variable> addedVars;
-   std::vector<r::sexp::Variable> removedVars;
+   // everything is described by the refresh (or was by the context depth
+   // event)
+   pendingAssigns_.clear();
+}
 
+void EnvironmentMonitor::checkForChanges()
+{
    // get the set of variables and promises in the current environment
+   std::vector<r::sexp::Variable> currentEnv;
    listEnv(&currentEnv);
 
-   // R returns an environment list sorted in dictionary order. Since the
-   // set difference algorithms below use simple string comparisons to
-   // establish order, we need to re-sort the list into canonical order
-   // to avoid the algorithms detecting superfluous insertions.
-   std::sort(currentEnv.begin(), currentEnv.end(), compareVarName);
-
-   std::for_each(currentEnv.begin(), currentEnv.end(),
-                 boost::bind(addUnevaledPromise, &currentPromises, _1));
+   ++generation_;
 
-   bool refreshEnqueued = false;
    if (!initialized_)
    {
       if (refreshOnInit_ ||
           getMonitoredEnvironment() == R_GlobalEnv)
       {
          enqueRefreshEvent();
-         refreshEnqueued = true;
       }
       initialized_ = true;
       refreshOnInit_ = false;
+      resetSnapshot(currentEnv);
+      return;
    }
-   else
+
+   // optimize for empty currentEnv (user reset workspace) or empty
+   // snapshot (startup) by just sending a single refresh event
+   // only do this for the global environment--while debugging local
+   // environments, the environment object list is sent down as part of
+   // the context depth event.
+   if ((currentEnv.empty() || snapshot_.empty()) &&
+       currentEnv.size() != snapshot_.size() &&
+       getMonitoredEnvironment() == R_GlobalEnv)
    {
-      if (currentEnv != lastEnv_)
+      enqueRefreshEvent();
+      resetSnapshot(currentEnv);
+      return;
+   }
+
+   // compare each binding with the snapshot; adds, assigns and promise
+   // evaluations are all processed as assigns
+   std::size_t previousSize = snapshot_.size();
+   std::size_t seen = 0;
+   for (const r::sexp::Variable& variable : currentEnv)
+   {
+      bool unevaledPromise = isUnevaluatedPromise(variable.second);
+
+      auto it = snapshot_.find(variable.first);
+      if (it == snapshot_.end())
       {
-         // optimize for empty currentEnv (user reset workspace) or empty
-         // lastEnv_ (startup) by just sending a single refresh event
-         // only do this for the global environment--while debugging local
-         // environments, the environment object list is sent down as part of
-         // the context depth event.
-         if ((currentEnv.empty() || lastEnv_.empty())
-             && getMonitoredEnvironment() == R_GlobalEnv)
-         {
-            enqueRefreshEvent();
-            refreshEnqueued = true;
-         }
-         else
-         {
-            std::set_difference(lastEnv_.begin(), lastEnv_.end(),
-                                currentEnv.begin(), currentEnv.end(),
-                                std::back_inserter(removedVars),
-                                compareVarName);
-
-            // fire removed event for deletes
-            std::for_each(removedVars.begin(),
-                          removedVars.end(),
-                          boost::bind(&EnvironmentMonitor::enqueRemovedEvent,
-                                      this, _1));
-
-            // remove deleted objects from the list of uneval'ed promises
-            // so we'll stop monitoring them for evaluation
-            std::for_each(removedVars.begin(),
-                          removedVars.end(),
-                          boost::bind(removeVarFromList, &unevaledPromises_, _1));
-
-            // find adds & assigns (all variable name/value combinations in the
-            // current environment but NOT in the previous environment)
-            std::set_difference(currentEnv.begin(), currentEnv.end(),
-                                lastEnv_.begin(), lastEnv_.end(),
-                                std::back_inserter(addedVars));
-
-            // remove assigned objects from the list of uneval'ed promises
-            // (otherwise, we double-assign in the case where a promise SEXP
-            // is simultaneously forced/evaluated and assigned a new value)
-            std::for_each(addedVars.begin(),
-                          addedVars.end(),
-                          boost::bind(removeVarFromList, &unevaledPromises_, _1));
+         Binding binding;
+         binding.value = variable.second;
+         binding.unevaledPromise = unevaledPromise;
+         binding.generation = generation_;
+         snapshot_[variable.first] = binding;
+         pendingAssigns_.insert(variable.first);
+         continue;
+      }
 
-         }
+      Binding& binding = it->second;
+      if (binding.value != variable.second ||
+          (binding.unevaledPromise && !unevaledPromise))
+      {
+         pendingAssigns_.insert(variable.first);
       }
-      // if a refresh is scheduled there's no need to emit add events one by one
-      if (!refreshEnqueued)
+
+      binding.value = variable.second;
+      binding.unevaledPromise = unevaledPromise;
+      binding.generation = generation_;
+      ++seen;
+   }
+
+   // if every previous binding was seen there's nothing to remove
+   if (seen < previousSize)
+   {
+      for (auto it = snapshot_.begin(); it != snapshot_.end(); )
       {
-         // have any promises been evaluated since we last checked?
-         if (currentPromises != unevaledPromises_)
+         if (it->second.generation == generation_)
          {
-            // for each promise that is in the set of promises we are monitoring
-            // for evaluation but not in the set of currently tracked promises,
-            // we assume this to be an eval--process as an assign
-            std::set_difference(unevaledPromises_.begin(), unevaledPromises_.end(),
-                                currentPromises.begin(), currentPromises.end(),
-                                std::back_inserter(addedVars));
+            ++it;
+            continue;
          }
 
-         // fire assigned event for adds, assigns, and promise evaluations
-         std::for_each(addedVars.begin(),
-                       addedVars.end(),
-                       boost::bind(&EnvironmentMonitor::enqueAssignedEvent,
-                                    this, _1));
+         enqueRemovedEvent(it->first);
+         pendingAssigns_.erase(it->first);
+         it = snapshot_.erase(it);
       }
    }
 
-   unevaledPromises_ = currentPromises;
-   lastEnv_ = currentEnv;
+   enquePendingAssignedEvents();
 }
 
 } // namespace environment
@@ -13,6 +13,10 @@
  *
  */
 
+#include <set>
+#include <string>
+#include <unordered_map>
+
 #include <r/RSexp.hpp>
 #include <r/RInterface.hpp>
 
@@ -26,6 +30,12 @@ namespace environment {
 
 // EnvironmentMonitor listens for changes to objects in the given environment
 // context, and emits object add/remove events.
+//
+// Changes are found by comparing each binding against a snapshot of the
+// value it had (and whether that value was an unevaluated promise) when we
+// last checked. Describing assigned objects can be expensive, so only as
+// many as fit in a time budget are described when changes are found; the
+// remainder are sent to the client as idle time allows.
 class EnvironmentMonitor : boost::noncopyable
 {
 public:
@@ -35,12 +45,29 @@ public:
    bool hasEnvironment();
    void checkForChanges();
 private:
+   struct Binding
+   {
+      SEXP value;
+      bool unevaledPromise;
+      unsigned int generation;
+   };
+
    void listEnv(std::vector<r::sexp::Variable>* pEnvironment);
-   void enqueRemovedEvent(const r::sexp::Variable& variable);
+   void resetSnapshot(const std::vector<r::sexp::Variable>& environment);
+   void enqueRemovedEvent(const std::string& name);
    void enqueAssignedEvent(const r::sexp::Variable& variable);
+   void enquePendingAssignedEvent();
+   void enquePendingAssignedEvents();
+   bool streamPendingAssignedEvents();
+
+   // the bindings as of the last check, by name
+   std::unordered_map<std::string, Binding> snapshot_;
+   unsigned int generation_;
+
+   // objects assigned but not yet described to the client
+   std::set<std::string> pendingAssigns_;
+   bool streaming_;
 
-   std::vector<r::sexp::Variable> lastEnv_;
-   std::vector<r::sexp::Variable> unevaledPromises_;
    r::sexp::PreservedSEXP environment_;
    bool initialized_;
    bool refreshOnInit_;
@@ -33,6 +33,46 @@ VCSStatus StatusResult::getStatus(const FilePath& fileOrDirectory) const
    return VCSStatus();
 }
 
+StatusResult StatusResult::filesWithin(const FilePath& directory) const
+{
+   std::vector<FileWithStatus> files;
+
+   // the directory and its ancestors
+   for (FilePath path = directory; !path.isEmpty(); path = path.getParent())
+   {
+      std::map<std::string, VCSStatus>::const_iterator found =
+            filesByPath_.find(path.getAbsolutePath());
+      if (found != filesByPath_.end())
+      {
+         FileWithStatus file;
+         file.path = path;
+         file.status = found->second;
+         files.push_back(file);
+      }
+
+      if (path.getParent() == path)
+         break;
+   }
+
+   // paths within the directory sort together, between "<dir>/" and "<dir>0"
+   // ('0' follows '/')
+   std::string prefix = directory.getAbsolutePath();
+   if (prefix.empty() || prefix[prefix.size() - 1] != '/')
+      prefix += '/';
+   std::string end = prefix.substr(0, prefix.size() - 1) + '0';
+   for (std::map<std::string, VCSStatus>::const_iterator it = filesByPath_.lower_bound(prefix);
+        it != filesByPath_.end() && it->first < end;
+        ++it)
+   {
+      FileWithStatus file;
+      file.path = FilePath(it->first);
+      file.status = it->second;
+      files.push_back(file);
+   }
+
+   return StatusResult(files);
+}
+
 } // namespace source_control
 } // namespace modules
 } // namespace session
@@ -73,6 +73,11 @@ public:
    VCSStatus getStatus(const core::FilePath& fileOrDirectory) const;
    std::vector<FileWithStatus> files() const { return files_; }
 
+   // the status of the files within a directory, along with that of the
+   // directory itself and its ancestors (so that e.g. an untracked parent
+   // directory is still visible)
+   StatusResult filesWithin(const core::FilePath& directory) const;
+
 private:
    std::vector<FileWithStatus> files_;
    std::map<std::string, VCSStatus> filesByPath_;
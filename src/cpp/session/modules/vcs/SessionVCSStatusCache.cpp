@@ -0,0 +1,361 @@
+/*
+ * SessionVCSStatusCache.cpp
+ *
+ * Copyright (C) 2020 by RStudio, PBC
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include "SessionVCSStatusCache.hpp"
+
+#ifndef _WIN32
+#include <sys/stat.h>
+#endif
+
+#include <boost/bind.hpp>
+#include <boost/scope_exit.hpp>
+
+#include <core/BoostErrors.hpp>
+#include <core/Log.hpp>
+#include <core/Thread.hpp>
+
+using namespace rstudio::core;
+
+namespace rstudio {
+namespace session {
+namespace modules {
+namespace source_control {
+
+namespace {
+
+boost::posix_time::ptime now()
+{
+   return boost::posix_time::microsec_clock::universal_time();
+}
+
+bool sameStatus(const StatusResult& a, const StatusResult& b)
+{
+   std::vector<FileWithStatus> aFiles = a.files();
+   std::vector<FileWithStatus> bFiles = b.files();
+   if (aFiles.size() != bFiles.size())
+      return false;
+
+   for (std::size_t i = 0; i < aFiles.size(); i++)
+   {
+      if (aFiles[i].path != bFiles[i].path ||
+          aFiles[i].status.status() != bFiles[i].status.status() ||
+          aFiles[i].status.changelist() != bFiles[i].status.changelist())
+      {
+         return false;
+      }
+   }
+
+   return true;
+}
+
+} // anonymous namespace
+
+StatusCache::StatusCache(const StatusFunction& statusFunction,
+                         const std::vector<FilePath>& stampFiles,
+                         const boost::posix_time::time_duration& maxUnmonitoredAge)
+   : statusFunction_(statusFunction),
+     stampFiles_(stampFiles),
+     maxUnmonitoredAge_(maxUnmonitoredAge),
+     statusGeneration_(0),
+     errorGeneration_(0),
+     generation_(1),
+     refreshing_(false),
+     servedStale_(false),
+     monitored_(false),
+     refreshCount_(0)
+{
+}
+
+Error StatusCache::status(boost::shared_ptr<const StatusResult>* ppStatus)
+{
+   try
+   {
+      boost::unique_lock<boost::mutex> lock(mutex_);
+
+      if (!pStatus_)
+      {
+         // there's no status yet: wait for one at least as new as this
+         // query (starting a refresh if one isn't already running for it)
+         uint64_t wanted = generation_;
+         while (statusGeneration_ < wanted && errorGeneration_ < wanted)
+         {
+            if (!refreshing_)
+               startRefreshWhileLocked();
+            refreshed_.wait(lock);
+         }
+
+         if (statusGeneration_ < wanted)
+            return error_;
+      }
+      else if (!isFreshWhileLocked())
+      {
+         // answer with the status we have, refreshing it in the background
+         // (the refreshed handler is called if it changes)
+         servedStale_ = true;
+         if (!refreshing_)
+            startRefreshWhileLocked();
+      }
+
+      *ppStatus = pStatus_;
+   }
+   catch (const boost::thread_resource_error& e)
+   {
+      return Error(boost::thread_error::ec_from_exception(e), ERROR_LOCATION);
+   }
+
+   return Success();
+}
+
+Error StatusCache::status(const FilePath& directory, StatusResult* pStatus)
+{
+   boost::shared_ptr<const StatusResult> pAllStatus;
+   Error error = status(&pAllStatus);
+   if (error)
+      return error;
+
+   *pStatus = pAllStatus->filesWithin(directory);
+   return Success();
+}
+
+Error StatusCache::fileStatus(const FilePath& filePath, VCSStatus* pStatus)
+{
+   boost::shared_ptr<const StatusResult> pAllStatus;
+   Error error = status(&pAllStatus);
+   if (error)
+      return error;
+
+   *pStatus = pAllStatus->getStatus(filePath);
+   return Success();
+}
+
+void StatusCache::invalidate()
+{
+   // the status is refreshed by the next query (so file changes nobody asks
+   // about don't run the status command)
+   LOCK_MUTEX(mutex_)
+   {
+      generation_++;
+   }
+   END_LOCK_MUTEX
+}
+
+void StatusCache::setMonitored(bool monitored)
+{
+   LOCK_MUTEX(mutex_)
+   {
+      // changes may have been missed while they weren't being reported
+      if (monitored && !monitored_)
+         generation_++;
+      monitored_ = monitored;
+   }
+   END_LOCK_MUTEX
+}
+
+void StatusCache::setRefreshedHandler(const RefreshedHandler& onRefreshed)
+{
+   LOCK_MUTEX(mutex_)
+   {
+      onRefreshed_ = onRefreshed;
+   }
+   END_LOCK_MUTEX
+}
+
+int StatusCache::refreshCount()
+{
+   LOCK_MUTEX(mutex_)
+   {
+      return refreshCount_;
+   }
+   END_LOCK_MUTEX
+
+   return 0;
+}
+
+std::vector<StatusCache::Stamp> StatusCache::readStamps() const
+{
+   std::vector<Stamp> stamps;
+   for (const FilePath& stampFile : stampFiles_)
+   {
+      // the vcs replaces these files (by renaming a lock file over them) when
+      // it writes them, so on posix the inode changes even if the modified
+      // time (which has a resolution of a second) doesn't
+      Stamp stamp;
+#ifndef _WIN32
+      struct stat st;
+      if (::stat(stampFile.getAbsolutePath().c_str(), &st) == 0)
+      {
+         stamp.exists = true;
+         stamp.modified = st.st_mtime;
+         stamp.size = st.st_size;
+         stamp.id = st.st_ino;
+      }
+#else
+      if (stampFile.exists())
+      {
+         stamp.exists = true;
+         stamp.modified = stampFile.getLastWriteTime();
+         stamp.size = stampFile.getSize();
+      }
+#endif
+      stamps.push_back(stamp);
+   }
+   return stamps;
+}
+
+bool StatusCache::isFreshWhileLocked()
+{
+   if (!pStatus_ || statusGeneration_ != generation_)
+      return false;
+
+   // the index or HEAD has changed (e.g. after a commit or checkout)
+   if (!(readStamps() == statusStamps_))
+   {
+      generation_++;
+      return false;
+   }
+
+   // without reported changes a status is only trusted for a little while
+   if (!monitored_ && now() - statusTime_ > maxUnmonitoredAge_)
+   {
+      generation_++;
+      return false;
+   }
+
+   return true;
+}
+
+void StatusCache::startRefreshWhileLocked()
+{
+   refreshing_ = true;
+
+   boost::thread refreshThread;
+   core::thread::safeLaunchThread(
+            boost::bind(&StatusCache::refresh, shared_from_this()),
+            &refreshThread);
+
+   if (refreshThread.joinable())
+   {
+      refreshThread.detach();
+   }
+   else
+   {
+      // couldn't launch the thread; fail the queries waiting for it
+      refreshing_ = false;
+      error_ = systemError(boost::system::errc::resource_unavailable_try_again,
+                           "Unable to start status refresh",
+                           ERROR_LOCATION);
+      errorGeneration_ = generation_;
+      refreshed_.notify_all();
+   }
+}
+
+void StatusCache::refresh()
+{
+   // called once the lock is released, if the status changed
+   RefreshedHandler onRefreshed;
+
+   try
+   {
+      boost::unique_lock<boost::mutex> lock(mutex_);
+
+      // note what the status will be current for before computing it (so
+      // that changes made while it's computed invalidate it)
+      uint64_t generation = generation_;
+
+      // however the refresh ends, release the queries waiting on it
+      bool completed = false;
+      BOOST_SCOPE_EXIT(this_, &lock, &generation, &completed)
+      {
+         if (!lock.owns_lock())
+            lock.lock();
+
+         if (!completed)
+         {
+            this_->error_ = systemError(boost::system::errc::state_not_recoverable,
+                                        "Status refresh failed",
+                                        ERROR_LOCATION);
+            this_->errorGeneration_ = generation;
+         }
+
+         this_->refreshing_ = false;
+         this_->refreshed_.notify_all();
+
+         // a stale status has been served, and the status was invalidated
+         // again while it was refreshed; refresh it again rather than
+         // waiting for the next query (which may only come once the
+         // refreshed handler runs)
+         if (completed && this_->statusGeneration_ == generation)
+         {
+            if (generation == this_->generation_)
+               this_->servedStale_ = false;
+            else if (this_->servedStale_)
+               this_->startRefreshWhileLocked();
+         }
+      }
+      BOOST_SCOPE_EXIT_END
+
+      std::vector<Stamp> stamps = readStamps();
+      boost::posix_time::ptime started = now();
+      refreshCount_++;
+
+      lock.unlock();
+      boost::shared_ptr<StatusResult> pStatus(new StatusResult());
+      Error error;
+      try
+      {
+         error = statusFunction_(pStatus.get());
+      }
+      catch (const std::exception& e)
+      {
+         error = systemError(boost::system::errc::state_not_recoverable,
+                             e.what(),
+                             ERROR_LOCATION);
+      }
+      lock.lock();
+
+      if (error)
+      {
+         error_ = error;
+         errorGeneration_ = generation;
+      }
+      else
+      {
+         if (pStatus_ && !sameStatus(*pStatus_, *pStatus))
+            onRefreshed = onRefreshed_;
+
+         pStatus_ = pStatus;
+         statusGeneration_ = generation;
+         statusStamps_ = stamps;
+         statusTime_ = started;
+      }
+
+      completed = true;
+   }
+   CATCH_UNEXPECTED_EXCEPTION
+
+   if (onRefreshed)
+   {
+      try
+      {
+         onRefreshed();
+      }
+      CATCH_UNEXPECTED_EXCEPTION
+   }
+}
+
+} // namespace source_control
+} // namespace modules
+} // namespace session
+} // namespace rstudio
@@ -0,0 +1,153 @@
+/*
+ * SessionVCSStatusCache.hpp
+ *
+ * Copyright (C) 2020 by RStudio, PBC
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef SESSION_VCS_STATUS_CACHE_HPP
+#define SESSION_VCS_STATUS_CACHE_HPP
+
+#include <string>
+#include <vector>
+
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/enable_shared_from_this.hpp>
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/utility.hpp>
+
+#include <shared_core/Error.hpp>
+#include <shared_core/FilePath.hpp>
+
+#include <core/BoostThread.hpp>
+
+#include "SessionVCSCore.hpp"
+
+namespace rstudio {
+namespace session {
+namespace modules {
+namespace source_control {
+
+// Caches the status of every file in a repository, so that file listings
+// and status queries are answered from memory rather than by running the
+// vcs's status command each time.
+//
+// The cache is invalidated by file change events within the repository
+// (see invalidate) and by changes to the stamp files (e.g. .git/index and
+// .git/HEAD, which change when the index is written or a different commit
+// is checked out). When changes in the working tree aren't being reported
+// (no file monitor covers the repository) a status is only trusted for
+// maxUnmonitoredAge.
+//
+// An invalidated status is refreshed, on a background thread, when it's next
+// queried. Queries which arrive while it's stale are answered with the status
+// already known rather than waiting for the refresh (only the first queries,
+// before there is any status, wait for one), and the refreshed handler is
+// called when a refresh changes the status, so that whatever displayed the
+// stale status can query it again. A burst of queries (or of file changes)
+// results in a single run of the status command.
+class StatusCache : boost::noncopyable,
+                    public boost::enable_shared_from_this<StatusCache>
+{
+public:
+   typedef boost::function<core::Error(StatusResult*)> StatusFunction;
+   typedef boost::function<void()> RefreshedHandler;
+
+   StatusCache(const StatusFunction& statusFunction,
+               const std::vector<core::FilePath>& stampFiles,
+               const boost::posix_time::time_duration& maxUnmonitoredAge =
+                  boost::posix_time::seconds(2));
+
+   // the status of every file in the repository
+   core::Error status(boost::shared_ptr<const StatusResult>* ppStatus);
+
+   // the status of the files within a directory (see StatusResult::filesWithin)
+   core::Error status(const core::FilePath& directory, StatusResult* pStatus);
+
+   // the status of a single file
+   core::Error fileStatus(const core::FilePath& filePath, VCSStatus* pStatus);
+
+   // files have changed: mark the status stale (it's refreshed when next
+   // queried)
+   void invalidate();
+
+   // set whether changes within the working tree are reported to invalidate
+   void setMonitored(bool monitored);
+
+   // set the handler called (on the refresh thread) when a refresh changes
+   // the status
+   void setRefreshedHandler(const RefreshedHandler& onRefreshed);
+
+   // the number of times the status command has been run
+   int refreshCount();
+
+private:
+   struct Stamp
+   {
+      Stamp() : exists(false), modified(0), size(0), id(0) {}
+
+      bool operator==(const Stamp& other) const
+      {
+         return exists == other.exists && modified == other.modified &&
+                size == other.size && id == other.id;
+      }
+
+      bool exists;
+      std::time_t modified;
+      uintmax_t size;
+      uintmax_t id;
+   };
+
+   std::vector<Stamp> readStamps() const;
+   bool isFreshWhileLocked();
+   void startRefreshWhileLocked();
+   void refresh();
+
+   StatusFunction statusFunction_;
+   std::vector<core::FilePath> stampFiles_;
+   boost::posix_time::time_duration maxUnmonitoredAge_;
+   RefreshedHandler onRefreshed_;
+
+   boost::mutex mutex_;
+   boost::condition_variable refreshed_;
+
+   // the status and the generation and stamps it was computed for
+   boost::shared_ptr<const StatusResult> pStatus_;
+   uint64_t statusGeneration_;
+   std::vector<Stamp> statusStamps_;
+   boost::posix_time::ptime statusTime_;
+
+   // a failed refresh (reported to the queries waiting for it, when there's
+   // no status yet)
+   core::Error error_;
+   uint64_t errorGeneration_;
+
+   // incremented each time the status is invalidated
+   uint64_t generation_;
+
+   bool refreshing_;
+
+   // whether a stale status has been served since the status was last
+   // current (if so, and it's stale again once refreshed, it's refreshed
+   // again)
+   bool servedStale_;
+
+   bool monitored_;
+   int refreshCount_;
+};
+
+} // namespace source_control
+} // namespace modules
+} // namespace session
+} // namespace rstudio
+
+#endif // SESSION_VCS_STATUS_CACHE_HPP
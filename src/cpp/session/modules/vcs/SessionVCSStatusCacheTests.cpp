@@ -0,0 +1,346 @@
+/*
+ * SessionVCSStatusCacheTests.cpp
+ *
+ * Copyright (C) 2020 by RStudio, PBC
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include "SessionVCSStatusCache.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include <boost/bind.hpp>
+#include <boost/scope_exit.hpp>
+
+#include <core/FileSerializer.hpp>
+
+#define RSTUDIO_NO_TESTTHAT_ALIASES
+#include <tests/TestThat.hpp>
+
+namespace rstudio {
+namespace session {
+namespace modules {
+namespace source_control {
+namespace tests {
+
+using namespace rstudio::core;
+
+namespace {
+
+// a stand in for the vcs's status command
+struct FakeRepository
+{
+   FakeRepository() : runs(0), started(0), finished(0), delayMs(0), throwUnexpected(false) {}
+
+   Error status(StatusResult* pResult)
+   {
+      runs++;
+      BOOST_SCOPE_EXIT(this_)
+      {
+         this_->finished++;
+      }
+      BOOST_SCOPE_EXIT_END
+
+      // the status is of the files when the command started
+      std::vector<std::pair<std::string, std::string> > startedChanges = changes;
+      Error startedError = error;
+      started++;
+      std::this_thread::sleep_for(std::chrono::milliseconds(delayMs));
+
+      if (throwUnexpected)
+         throw 1;
+
+      if (startedError)
+         return startedError;
+
+      std::vector<FileWithStatus> files;
+      for (const auto& change : startedChanges)
+      {
+         FileWithStatus file;
+         file.path = FilePath(change.first);
+         file.status = VCSStatus(change.second);
+         files.push_back(file);
+      }
+      *pResult = StatusResult(files);
+      return Success();
+   }
+
+   std::vector<std::pair<std::string, std::string> > changes;
+   std::atomic<int> runs;
+   std::atomic<int> started;
+   std::atomic<int> finished;
+   int delayMs;
+   bool throwUnexpected;
+   Error error;
+};
+
+boost::shared_ptr<StatusCache> createCache(
+      FakeRepository* pRepository,
+      std::atomic<int>* pRefreshed,
+      const std::vector<FilePath>& stampFiles = std::vector<FilePath>())
+{
+   boost::shared_ptr<StatusCache> pCache(
+            new StatusCache(boost::bind(&FakeRepository::status, pRepository, _1),
+                            stampFiles));
+   pCache->setMonitored(true);
+   pCache->setRefreshedHandler([pRefreshed]() { (*pRefreshed)++; });
+   return pCache;
+}
+
+// wait for the refreshed handler to have been called the given number of times
+bool waitForRefresh(const std::atomic<int>& refreshed, int count)
+{
+   for (int i = 0; i < 500 && refreshed < count; i++)
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+   return refreshed == count;
+}
+
+// wait for refreshes still running in the background
+void waitForIdle(const FakeRepository& repository)
+{
+   for (int i = 0; i < 500 && repository.finished < repository.runs; i++)
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+   std::this_thread::sleep_for(std::chrono::milliseconds(10));
+}
+
+std::string statusOf(const boost::shared_ptr<StatusCache>& pCache, const std::string& path)
+{
+   VCSStatus status;
+   Error error = pCache->fileStatus(FilePath(path), &status);
+   REQUIRE_FALSE(error);
+   return status.status();
+}
+
+} // anonymous namespace
+
+TEST_CASE("SessionVCSStatusCache")
+{
+   FakeRepository repository;
+   repository.changes.push_back(std::make_pair("/repo/R/analysis.R", " M"));
+   repository.changes.push_back(std::make_pair("/repo/R/plots.R", "A "));
+   repository.changes.push_back(std::make_pair("/repo/README.md", " M"));
+   repository.changes.push_back(std::make_pair("/repo/data", "??"));
+   std::atomic<int> refreshed(0);
+
+   SECTION("Queries are answered from memory once the status is known")
+   {
+      boost::shared_ptr<StatusCache> pCache = createCache(&repository, &refreshed);
+      CHECK(statusOf(pCache, "/repo/R/analysis.R") == " M");
+      CHECK(statusOf(pCache, "/repo/README.md") == " M");
+      CHECK(statusOf(pCache, "/repo/R/unchanged.R").empty());
+      CHECK(repository.runs == 1);
+   }
+
+   SECTION("Directory queries return the files within the directory and its ancestors")
+   {
+      boost::shared_ptr<StatusCache> pCache = createCache(&repository, &refreshed);
+
+      StatusResult status;
+      REQUIRE_FALSE(pCache->status(FilePath("/repo/R"), &status));
+      CHECK(status.files().size() == 2);
+      CHECK(status.getStatus(FilePath("/repo/R/plots.R")).status() == "A ");
+      CHECK(status.getStatus(FilePath("/repo/README.md")).status().empty());
+
+      REQUIRE_FALSE(pCache->status(FilePath("/repo/data/raw"), &status));
+      CHECK(status.files().size() == 1);
+      CHECK(status.getStatus(FilePath("/repo/data")).status() == "??");
+
+      // a sibling whose name starts with the directory's isn't within it
+      repository.changes.push_back(std::make_pair("/repo/Rmd/report.Rmd", "??"));
+      pCache->invalidate();
+      REQUIRE_FALSE(pCache->status(FilePath("/repo/R"), &status));
+      REQUIRE(waitForRefresh(refreshed, 1));
+      REQUIRE_FALSE(pCache->status(FilePath("/repo/R"), &status));
+      CHECK(status.files().size() == 2);
+   }
+
+   SECTION("Invalidating refreshes the status")
+   {
+      boost::shared_ptr<StatusCache> pCache = createCache(&repository, &refreshed);
+      CHECK(statusOf(pCache, "/repo/README.md") == " M");
+
+      repository.changes[2].second = "M ";
+      pCache->invalidate();
+      statusOf(pCache, "/repo/README.md");
+      REQUIRE(waitForRefresh(refreshed, 1));
+      CHECK(statusOf(pCache, "/repo/README.md") == "M ");
+      CHECK(repository.runs == 2);
+
+      // the refresh waits for the next query, so a burst of invalidations
+      // runs the status command once
+      repository.changes[2].second = "MM";
+      for (int i = 0; i < 10; i++)
+         pCache->invalidate();
+      std::this_thread::sleep_for(std::chrono::milliseconds(20));
+      CHECK(repository.runs == 2);
+
+      statusOf(pCache, "/repo/README.md");
+      REQUIRE(waitForRefresh(refreshed, 2));
+      CHECK(statusOf(pCache, "/repo/README.md") == "MM");
+      CHECK(repository.runs == 3);
+      CHECK(pCache->refreshCount() == 3);
+   }
+
+   SECTION("Changing a stamp file invalidates the status")
+   {
+      FilePath stampFile;
+      REQUIRE_FALSE(FilePath::tempFilePath(stampFile));
+      REQUIRE_FALSE(writeStringToFile(stampFile, "index"));
+
+      boost::shared_ptr<StatusCache> pCache = createCache(&repository, &refreshed, { stampFile });
+      CHECK(statusOf(pCache, "/repo/README.md") == " M");
+      CHECK(statusOf(pCache, "/repo/README.md") == " M");
+      CHECK(repository.runs == 1);
+
+      // replace the file the way git writes its index
+      FilePath lockFile = stampFile.getParent().completeChildPath(stampFile.getFilename() + ".lock");
+      REQUIRE_FALSE(writeStringToFile(lockFile, "index"));
+      REQUIRE_FALSE(lockFile.move(stampFile));
+
+      repository.changes[2].second = "M ";
+      statusOf(pCache, "/repo/README.md");
+      REQUIRE(waitForRefresh(refreshed, 1));
+      CHECK(statusOf(pCache, "/repo/README.md") == "M ");
+      CHECK(repository.runs == 2);
+
+      stampFile.removeIfExists();
+   }
+
+   SECTION("Without monitoring a status expires")
+   {
+      boost::shared_ptr<StatusCache> pCache(
+               new StatusCache(boost::bind(&FakeRepository::status, &repository, _1),
+                               std::vector<FilePath>(),
+                               boost::posix_time::milliseconds(20)));
+      pCache->setRefreshedHandler([&refreshed]() { refreshed++; });
+      statusOf(pCache, "/repo/README.md");
+      statusOf(pCache, "/repo/README.md");
+      CHECK(repository.runs == 1);
+
+      repository.changes[2].second = "M ";
+      std::this_thread::sleep_for(std::chrono::milliseconds(40));
+      statusOf(pCache, "/repo/README.md");
+      REQUIRE(waitForRefresh(refreshed, 1));
+      CHECK(repository.runs == 2);
+   }
+
+   SECTION("A stale status is served while it's refreshed")
+   {
+      boost::shared_ptr<StatusCache> pCache = createCache(&repository, &refreshed);
+      CHECK(statusOf(pCache, "/repo/README.md") == " M");
+
+      // queries don't wait for the refresh, and share it
+      repository.delayMs = 100;
+      repository.changes[2].second = "M ";
+      pCache->invalidate();
+      for (int i = 0; i < 10; i++)
+         CHECK(statusOf(pCache, "/repo/README.md") == " M");
+      CHECK(refreshed == 0);
+
+      REQUIRE(waitForRefresh(refreshed, 1));
+      CHECK(statusOf(pCache, "/repo/README.md") == "M ");
+      CHECK(repository.runs == 2);
+
+      // a refresh which doesn't change the status isn't reported
+      repository.delayMs = 0;
+      pCache->invalidate();
+      statusOf(pCache, "/repo/README.md");
+      waitForIdle(repository);
+      CHECK(repository.runs == 3);
+      CHECK(refreshed == 1);
+
+      // and a failed refresh leaves the last status
+      repository.error = systemError(boost::system::errc::io_error, ERROR_LOCATION);
+      pCache->invalidate();
+      CHECK(statusOf(pCache, "/repo/README.md") == "M ");
+      waitForIdle(repository);
+      CHECK(statusOf(pCache, "/repo/README.md") == "M ");
+      waitForIdle(repository);
+   }
+
+   SECTION("Changes made while a status is refreshed are refreshed too")
+   {
+      boost::shared_ptr<StatusCache> pCache = createCache(&repository, &refreshed);
+      statusOf(pCache, "/repo/README.md");
+
+      repository.delayMs = 50;
+      pCache->invalidate();
+      statusOf(pCache, "/repo/README.md");
+      for (int i = 0; i < 500 && repository.started < 2; i++)
+         std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+      // this change is made after the refresh started, and isn't queried
+      // again, but the stale status already served is refreshed anyway
+      repository.changes[2].second = "M ";
+      pCache->invalidate();
+      REQUIRE(waitForRefresh(refreshed, 1));
+      CHECK(repository.runs == 3);
+      CHECK(statusOf(pCache, "/repo/README.md") == "M ");
+   }
+
+   SECTION("Concurrent queries before the status is known share one refresh")
+   {
+      repository.delayMs = 50;
+      boost::shared_ptr<StatusCache> pCache = createCache(&repository, &refreshed);
+
+      std::vector<std::thread> queries;
+      std::atomic<int> answered(0);
+      for (int i = 0; i < 8; i++)
+      {
+         queries.emplace_back([&]()
+         {
+            if (statusOf(pCache, "/repo/R/plots.R") == "A ")
+               answered++;
+         });
+      }
+      for (std::thread& query : queries)
+         query.join();
+
+      CHECK(answered == 8);
+      CHECK(repository.runs == 1);
+   }
+
+   SECTION("Errors are returned to the queries waiting on the first refresh")
+   {
+      repository.error = systemError(boost::system::errc::io_error, ERROR_LOCATION);
+      boost::shared_ptr<StatusCache> pCache = createCache(&repository, &refreshed);
+
+      boost::shared_ptr<const StatusResult> pStatus;
+      CHECK(pCache->status(&pStatus));
+
+      repository.error = Success();
+      pCache->invalidate();
+      CHECK_FALSE(pCache->status(&pStatus));
+      CHECK(pStatus->getStatus(FilePath("/repo/R/plots.R")).status() == "A ");
+   }
+
+   SECTION("A refresh which fails unexpectedly doesn't leave queries waiting")
+   {
+      repository.throwUnexpected = true;
+      boost::shared_ptr<StatusCache> pCache = createCache(&repository, &refreshed);
+
+      boost::shared_ptr<const StatusResult> pStatus;
+      CHECK(pCache->status(&pStatus));
+
+      repository.throwUnexpected = false;
+      pCache->invalidate();
+      CHECK_FALSE(pCache->status(&pStatus));
+      CHECK(repository.runs == 2);
+   }
+}
+
+} // namespace tests
+} // namespace source_control
+} // namespace modules
+} // namespace session
+} // namespace rstudio
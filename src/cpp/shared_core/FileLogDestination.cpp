@@ -23,10 +23,19 @@
 
 #include <shared_core/FileLogDestination.hpp>
 
+#ifndef _WIN32
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
 #include <boost/thread.hpp>
 
+#include <atomic>
+#include <set>
+#include <sstream>
 #include <vector>
 
+#include <shared_core/DateTime.hpp>
 #include <shared_core/Error.hpp>
 #include <shared_core/Logger.hpp>
 
@@ -40,7 +49,8 @@ FileLogOptions::FileLogOptions(FilePath in_directory) :
    m_fileMode(s_defaultFileMode),
    m_maxSizeMb(s_defaultMaxSizeMb),
    m_doRotation(s_defaultDoRotation),
-   m_includePid(s_defaultIncludePid)
+   m_includePid(s_defaultIncludePid),
+   m_writeAsync(s_defaultWriteAsync)
 {
 }
 
@@ -49,12 +59,14 @@ FileLogOptions::FileLogOptions(
    std::string in_fileMode,
    double in_maxSizeMb,
    bool in_doRotation,
-   bool in_includePid) :
+   bool in_includePid,
+   bool in_writeAsync) :
       m_directory(std::move(in_directory)),
       m_fileMode(std::move(in_fileMode)),
       m_maxSizeMb(in_maxSizeMb),
       m_doRotation(in_doRotation),
-      m_includePid(in_includePid)
+      m_includePid(in_includePid),
+      m_writeAsync(in_writeAsync)
 {
 }
 
@@ -83,23 +95,357 @@ bool FileLogOptions::includePid() const
    return m_includePid;
 }
 
+bool FileLogOptions::writeAsync() const
+{
+   return m_writeAsync;
+}
+
+// MessageQueue ========================================================================================================
+namespace {
+
+// The maximum number of messages waiting to be written. Must be a power of two.
+constexpr std::size_t s_queueSize = 8192;
+
+// The number of queued messages at which the writer is woken, rather than waiting for the flush interval.
+constexpr std::size_t s_wakeWriterSize = 256;
+
+// The most output written to the file in one go.
+constexpr std::size_t s_maxBatchSize = 256 * 1024;
+
+// Queued logs are flushed once this much output has been written, or after the flush interval.
+constexpr std::size_t s_flushSize = 64 * 1024;
+constexpr int s_flushIntervalMs = 250;
+
+/**
+ * @brief A bounded queue of log messages which any number of threads may push to and pop from without locking
+ *        (after Dmitry Vyukov's bounded MPMC queue). Each cell carries a sequence number which says whether it is ready
+ *        to be written to or read from at the current position.
+ */
+class MessageQueue
+{
+public:
+   explicit MessageQueue(std::size_t in_size) :
+      m_cells(new Cell[in_size]),
+      m_mask(in_size - 1),
+      m_enqueuePos(0),
+      m_dequeuePos(0)
+   {
+      for (std::size_t i = 0; i < in_size; ++i)
+         m_cells[i].Sequence.store(i, std::memory_order_relaxed);
+   }
+
+   // Returns false if the queue is full.
+   bool push(const std::string& in_message)
+   {
+      Cell* cell;
+      std::size_t pos = m_enqueuePos.load(std::memory_order_relaxed);
+      while (true)
+      {
+         cell = &m_cells[pos & m_mask];
+         std::size_t seq = cell->Sequence.load(std::memory_order_acquire);
+         std::ptrdiff_t diff = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos);
+         if (diff == 0)
+         {
+            if (m_enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+               break;
+         }
+         else if (diff < 0)
+            return false;
+         else
+            pos = m_enqueuePos.load(std::memory_order_relaxed);
+      }
+
+      cell->Message = in_message;
+      cell->Sequence.store(pos + 1, std::memory_order_release);
+      return true;
+   }
+
+   // Returns false if the queue is empty.
+   bool pop(std::string& out_message)
+   {
+      Cell* cell;
+      std::size_t pos = m_dequeuePos.load(std::memory_order_relaxed);
+      while (true)
+      {
+         cell = &m_cells[pos & m_mask];
+         std::size_t seq = cell->Sequence.load(std::memory_order_acquire);
+         std::ptrdiff_t diff = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos + 1);
+         if (diff == 0)
+         {
+            if (m_dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+               break;
+         }
+         else if (diff < 0)
+            return false;
+         else
+            pos = m_dequeuePos.load(std::memory_order_relaxed);
+      }
+
+      out_message.swap(cell->Message);
+      cell->Message.clear();
+      cell->Sequence.store(pos + m_mask + 1, std::memory_order_release);
+      return true;
+   }
+
+   // Approximate, as other threads may be pushing or popping.
+   std::size_t size() const
+   {
+      std::size_t dequeuePos = m_dequeuePos.load(std::memory_order_relaxed);
+      std::size_t enqueuePos = m_enqueuePos.load(std::memory_order_relaxed);
+      return enqueuePos > dequeuePos ? enqueuePos - dequeuePos : 0;
+   }
+
+private:
+   struct Cell
+   {
+      std::atomic<std::size_t> Sequence;
+      std::string Message;
+   };
+
+   std::unique_ptr<Cell[]> m_cells;
+   const std::size_t m_mask;
+   std::atomic<std::size_t> m_enqueuePos;
+   std::atomic<std::size_t> m_dequeuePos;
+};
+
+// The ID of this process, cached as it's checked for every log queued. It's set when the first destination is created,
+// and updated in forked children.
+std::atomic<int> s_processId(0);
+
+int getProcessId()
+{
+   return s_processId;
+}
+
+} // anonymous namespace
+
 // FileLogDestination ==================================================================================================
 struct FileLogDestination::Impl
 {
    Impl(unsigned int in_id, const std::string& in_name, FileLogOptions in_options) :
       LogOptions(std::move(in_options)),
+      ProgramId(in_name),
       LogName(in_name + ".log"),
       RotatedLogName(in_name + ".old.log"),
-      Id(in_id)
+      Id(in_id),
+      WriterProcessId(0),
+      StopWriter(false),
+      FlushRequested(false),
+      DroppedCount(0),
+      UnreportedDroppedCount(0)
    {
       LogOptions.getDirectory().ensureDirectory();
+
+      addInstance(this);
+
+      if (LogOptions.writeAsync())
+      {
+         Queue.reset(new MessageQueue(s_queueSize));
+         WriterProcessId = getProcessId();
+         WriterThread = boost::thread(&Impl::writeQueuedLogs, this);
+      }
    };
 
    ~Impl()
    {
+      removeInstance(this);
+      stopWriter();
       closeLogFile();
    }
 
+   // Forking. Another thread may be writing to a destination when the process forks, so each destination's lock is
+   // held across the fork (leaving the child with the lock released and the log file in a consistent state). The
+   // writer thread doesn't exist in the child, so the child writes its logs itself.
+   static boost::mutex& instancesMutex()
+   {
+      static boost::mutex* instancesMutex = new boost::mutex();
+      return *instancesMutex;
+   }
+
+   static std::set<Impl*>& instances()
+   {
+      static std::set<Impl*>* instances = new std::set<Impl*>();
+      return *instances;
+   }
+
+   static void addInstance(Impl* in_impl)
+   {
+      static const bool s_initialized = []()
+      {
+#ifndef _WIN32
+         s_processId = ::getpid();
+         ::pthread_atfork(&Impl::beforeFork, &Impl::afterForkInParent, &Impl::afterForkInChild);
+#endif
+         return true;
+      }();
+      (void)s_initialized;
+
+      boost::lock_guard<boost::mutex> lock(instancesMutex());
+      instances().insert(in_impl);
+   }
+
+   static void removeInstance(Impl* in_impl)
+   {
+      boost::lock_guard<boost::mutex> lock(instancesMutex());
+      instances().erase(in_impl);
+   }
+
+   static void beforeFork()
+   {
+      instancesMutex().lock();
+      for (Impl* impl: instances())
+         impl->Mutex.lock();
+   }
+
+   static void afterForkInParent()
+   {
+      for (Impl* impl: instances())
+         impl->Mutex.unlock();
+      instancesMutex().unlock();
+   }
+
+   static void afterForkInChild()
+   {
+#ifndef _WIN32
+      s_processId = ::getpid();
+#endif
+      for (Impl* impl: instances())
+      {
+         impl->Mutex.unlock();
+
+         // Messages still queued are the parent's to write. The writer thread's handle refers to a thread which only
+         // exists in the parent, so it can be neither joined nor detached here; it's deliberately leaked.
+         if (impl->Queue)
+         {
+            impl->Queue.reset();
+            new boost::thread(boost::move(impl->WriterThread));
+         }
+      }
+      instancesMutex().unlock();
+   }
+
+   // Returns true if logs should be queued for the writer thread. (A forked child doesn't have the writer thread, so
+   // it writes logs itself.)
+   bool isWritingAsync() const
+   {
+      return Queue && WriterProcessId == getProcessId();
+   }
+
+   // Returns false if the message wasn't queued and should be written right away instead: errors are never dropped,
+   // even when the queue is full.
+   bool queueLog(LogLevel in_logLevel, const std::string& in_message)
+   {
+      if (!Queue->push(in_message))
+      {
+         if (in_logLevel <= LogLevel::ERR)
+            return false;
+
+         ++DroppedCount;
+         ++UnreportedDroppedCount;
+         return true;
+      }
+
+      // Errors are written (and flushed) right away, in case they're followed by a crash.
+      if (in_logLevel == LogLevel::ERR)
+      {
+         FlushRequested = true;
+         WriterCondition.notify_one();
+      }
+      else if (Queue->size() >= s_wakeWriterSize)
+      {
+         WriterCondition.notify_one();
+      }
+
+      return true;
+   }
+
+   void stopWriter()
+   {
+      if (!Queue || !WriterThread.joinable())
+         return;
+
+      // The writer writes everything still queued before it stops.
+      {
+         boost::lock_guard<boost::mutex> lock(WriterMutex);
+         StopWriter = true;
+      }
+      WriterCondition.notify_one();
+
+      try
+      {
+         WriterThread.join();
+      }
+      catch (...)
+      {
+      }
+   }
+
+   void writeQueuedLogs()
+   {
+      using namespace boost::posix_time;
+
+      std::string batch, message;
+      std::size_t unflushed = 0;
+      ptime lastFlush = microsec_clock::universal_time();
+
+      while (true)
+      {
+         bool stopping = StopWriter;
+
+         batch.clear();
+         while (batch.size() < s_maxBatchSize && Queue->pop(message))
+            batch.append(message);
+
+         // Note any messages we've had to drop, once there's room in the log for them.
+         uint64_t dropped = UnreportedDroppedCount.exchange(0);
+         if (dropped > 0)
+            batch.append(formatDroppedMessage(dropped));
+
+         bool flush = FlushRequested.exchange(false) || stopping;
+         if (!batch.empty() || unflushed > 0)
+         {
+            boost::unique_lock<boost::mutex> lock(Mutex);
+
+            if (!batch.empty() && (LogOutputStream || openLogFile()))
+            {
+               rotateLogFile();
+               (*LogOutputStream) << batch;
+               unflushed += batch.size();
+            }
+
+            ptime now = microsec_clock::universal_time();
+            if (LogOutputStream &&
+                (flush || unflushed >= s_flushSize || now - lastFlush >= milliseconds(s_flushIntervalMs)))
+            {
+               LogOutputStream->flush();
+               unflushed = 0;
+               lastFlush = now;
+            }
+         }
+
+         // Keep writing while there's a backlog.
+         if (batch.size() >= s_maxBatchSize)
+            continue;
+
+         if (stopping)
+            break;
+
+         // Wait for more logs, or until it's time to flush.
+         boost::unique_lock<boost::mutex> lock(WriterMutex);
+         if (!StopWriter && !FlushRequested && Queue->size() < s_wakeWriterSize)
+            WriterCondition.timed_wait(lock, milliseconds(s_flushIntervalMs));
+      }
+   }
+
+   std::string formatDroppedMessage(uint64_t in_count) const
+   {
+      std::ostringstream oss;
+      oss << system::date_time::format(boost::posix_time::microsec_clock::universal_time(), "%d %b %Y %H:%M:%S")
+          << " [" << ProgramId << "] WARNING " << in_count
+          << " log messages were dropped because they were logged faster than they could be written" << std::endl;
+      return oss.str();
+   }
+
    void closeLogFile()
    {
       if (LogOutputStream)
@@ -164,11 +510,23 @@ struct FileLogDestination::Impl
 
    FileLogOptions LogOptions;
    FilePath LogFile;
+   std::string ProgramId;
    std::string LogName;
    std::string RotatedLogName;
    boost::mutex Mutex;
    unsigned int Id;
    std::shared_ptr<std::ostream> LogOutputStream;
+
+   // Asynchronous writing.
+   std::unique_ptr<MessageQueue> Queue;
+   int WriterProcessId;
+   boost::thread WriterThread;
+   boost::mutex WriterMutex;
+   boost::condition_variable WriterCondition;
+   std::atomic<bool> StopWriter;
+   std::atomic<bool> FlushRequested;
+   std::atomic<uint64_t> DroppedCount;
+   std::atomic<uint64_t> UnreportedDroppedCount;
 };
 
 FileLogDestination::FileLogDestination(
@@ -183,6 +541,7 @@ FileLogDestination::FileLogDestination(
 
 FileLogDestination::~FileLogDestination()
 {
+   m_impl->stopWriter();
    if (m_impl->LogOutputStream.get())
       m_impl->LogOutputStream->flush();
 }
@@ -198,6 +557,10 @@ void FileLogDestination::writeLog(LogLevel in_logLevel, const std::string& in_me
    if (in_logLevel > m_logLevel)
       return;
 
+   // Leave the write to the writer thread if writing asynchronously (unless it's an error which can't be queued).
+   if (m_impl->isWritingAsync() && m_impl->queueLog(in_logLevel, in_message))
+      return;
+
    // Lock the mutex before attempting to write.
    boost::unique_lock<boost::mutex> lock(m_impl->Mutex);
 
@@ -211,6 +574,16 @@ void FileLogDestination::writeLog(LogLevel in_logLevel, const std::string& in_me
    m_impl->LogOutputStream->flush();
 }
 
+std::size_t FileLogDestination::getQueuedMessageCount() const
+{
+   return m_impl->Queue ? m_impl->Queue->size() : 0;
+}
+
+uint64_t FileLogDestination::getDroppedMessageCount() const
+{
+   return m_impl->DroppedCount;
+}
+
 } // namespace log
 } // namespace core
 } // namespace rstudio
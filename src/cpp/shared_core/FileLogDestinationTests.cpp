@@ -0,0 +1,188 @@
+/*
+ * FileLogDestinationTests.cpp
+ *
+ * Copyright (C) 2020 by RStudio, PBC
+ *
+ * Unless you have received this program directly from RStudio pursuant to the terms of a commercial license agreement
+ * with RStudio, then this program is licensed to you under the following terms:
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#include <tests/TestThat.hpp>
+
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#include <shared_core/FileLogDestination.hpp>
+#include <shared_core/Logger.hpp>
+
+namespace rstudio {
+namespace core {
+namespace log {
+
+namespace {
+
+FilePath createLogDir()
+{
+   FilePath logDir;
+   REQUIRE_FALSE(FilePath::tempFilePath(logDir));
+   REQUIRE_FALSE(logDir.ensureDirectory());
+   return logDir;
+}
+
+std::string readLog(const FilePath& in_logDir, const std::string& in_programId)
+{
+   std::ifstream stream(in_logDir.completeChildPath(in_programId + ".log").getAbsolutePath());
+   std::stringstream contents;
+   contents << stream.rdbuf();
+   return contents.str();
+}
+
+std::string message(int in_thread, int in_index)
+{
+   return "thread " + std::to_string(in_thread) + " message " + std::to_string(in_index) + "\n";
+}
+
+void writeLogs(FileLogDestination& io_destination, int in_threads, int in_messages)
+{
+   std::vector<std::thread> threads;
+   for (int t = 0; t < in_threads; ++t)
+   {
+      threads.emplace_back([&io_destination, t, in_messages]()
+      {
+         for (int i = 0; i < in_messages; ++i)
+            io_destination.writeLog(LogLevel::INFO, message(t, i));
+      });
+   }
+
+   for (std::thread& thread : threads)
+      thread.join();
+}
+
+FileLogOptions asyncOptions(const FilePath& in_logDir)
+{
+   return FileLogOptions(in_logDir, "666", 100, false, false, true);
+}
+
+} // anonymous namespace
+
+TEST_CASE("File log destination")
+{
+   FilePath logDir = createLogDir();
+
+   SECTION("Logs are written immediately by default")
+   {
+      FileLogDestination destination(101, LogLevel::INFO, "sync", logDir);
+      destination.writeLog(LogLevel::INFO, "first\n");
+      destination.writeLog(LogLevel::DEBUG, "too detailed\n");
+
+      CHECK(readLog(logDir, "sync") == "first\n");
+      CHECK(destination.getQueuedMessageCount() == 0);
+      CHECK(destination.getDroppedMessageCount() == 0);
+   }
+
+   SECTION("Asynchronous logs are all written by the time the destination is destroyed")
+   {
+      {
+         FileLogDestination destination(102, LogLevel::INFO, "async", asyncOptions(logDir));
+         writeLogs(destination, 4, 1000);
+      }
+
+      std::string log = readLog(logDir, "async");
+
+      // Every message is written whole, and each thread's messages are in order.
+      std::istringstream lines(log);
+      std::vector<int> next(4, 0);
+      std::string line;
+      int count = 0;
+      while (std::getline(lines, line))
+      {
+         int thread = line[7] - '0';
+         REQUIRE(thread >= 0);
+         REQUIRE(thread < 4);
+         CHECK(line + "\n" == message(thread, next[thread]++));
+         ++count;
+      }
+      CHECK(count == 4000);
+   }
+
+   SECTION("Asynchronous errors are written promptly")
+   {
+      FileLogDestination destination(103, LogLevel::INFO, "errors", asyncOptions(logDir));
+      destination.writeLog(LogLevel::ERR, "an error\n");
+
+      for (int i = 0; i < 100 && readLog(logDir, "errors").empty(); ++i)
+         std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+      CHECK(readLog(logDir, "errors") == "an error\n");
+   }
+
+#ifndef _WIN32
+   SECTION("Forked children write their own logs")
+   {
+      FileLogDestination destination(104, LogLevel::INFO, "forked", asyncOptions(logDir));
+
+      // Fork while another thread is logging.
+      std::thread writer([&destination]()
+      {
+         for (int i = 0; i < 10000; ++i)
+            destination.writeLog(LogLevel::INFO, message(0, i));
+      });
+
+      pid_t pid = ::fork();
+      if (pid == 0)
+      {
+         destination.writeLog(LogLevel::INFO, "child\n");
+         ::_exit(0);
+      }
+      writer.join();
+      REQUIRE(pid > 0);
+
+      int status = 0;
+      pid_t result = 0;
+      for (int i = 0; i < 500 && result == 0; ++i)
+      {
+         result = ::waitpid(pid, &status, WNOHANG);
+         if (result == 0)
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+      }
+      if (result == 0)
+      {
+         ::kill(pid, SIGKILL);
+         ::waitpid(pid, &status, 0);
+      }
+
+      REQUIRE(result == pid);
+      CHECK(WIFEXITED(status));
+      CHECK(readLog(logDir, "forked").find("child\n") != std::string::npos);
+   }
+#endif
+
+   logDir.removeIfExists();
+}
+
+} // namespace log
+} // namespace core
+} // namespace rstudio
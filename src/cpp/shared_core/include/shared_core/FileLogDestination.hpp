@@ -26,6 +26,7 @@
 
 #include "ILogDestination.hpp"
 
+#include <cstdint>
 #include <string>
 
 #include "PImpl.hpp"
@@ -58,13 +59,16 @@ public:
     * @param in_maxSizeMb      The maximum size of log files, in MB, before they are rotated and/or overwritten.
     * @param in_doRotation     Whether to rotate log files or not.
     * @param in_includePid     Whether to include the PID of the process in the logs.
+    * @param in_writeAsync      Whether to queue logs to be written to the file by a background thread, rather than
+    *                           writing them immediately.
     */
    FileLogOptions(
       FilePath in_directory,
       std::string in_fileMode,
       double in_maxSizeMb,
       bool in_doRotation,
-      bool in_includePid);
+      bool in_includePid,
+      bool in_writeAsync = s_defaultWriteAsync);
 
    /**
     * @brief Gets the directory where log files should be written.
@@ -101,12 +105,20 @@ public:
     */
    bool includePid() const;
 
+   /**
+    * @brief Returns whether or not logs should be written to the file by a background thread.
+    *
+    * @return True if logs should be written asynchronously; false otherwise.
+    */
+   bool writeAsync() const;
+
 private:
    // Default values.
    static constexpr const char* s_defaultFileMode = "666";
    static constexpr int s_defaultMaxSizeMb = 2;
    static constexpr bool s_defaultDoRotation = true;
    static constexpr bool s_defaultIncludePid = false;
+   static constexpr bool s_defaultWriteAsync = false;
 
    // The directory where log files should be written.
    FilePath m_directory;
@@ -122,10 +134,19 @@ private:
 
    // Whether to include the PID in logs.
    bool m_includePid;
+
+   // Whether to write logs from a background thread.
+   bool m_writeAsync;
 };
 
 /**
  * @brief Class which allows sending log messages to a file.
+ *
+ * By default each message is written and flushed to the file as it is logged. If the options specify asynchronous
+ * writes, messages are instead placed on a bounded lock-free queue and written in batches by a background thread,
+ * which flushes the file once enough output has been written or some time has passed (or immediately after an error
+ * is logged). If the queue is full, messages are dropped rather than blocking the logging thread, and the number of
+ * messages dropped is written to the log once there is room again.
  */
 class FileLogDestination : public ILogDestination
 {
@@ -168,6 +189,22 @@ public:
     */
    void writeLog(LogLevel in_logLevel, const std::string& in_message) override;
 
+   /**
+    * @brief Gets the number of messages waiting to be written to the log file (always 0 unless writing
+    *        asynchronously).
+    *
+    * @return The number of queued messages.
+    */
+   std::size_t getQueuedMessageCount() const;
+
+   /**
+    * @brief Gets the number of messages which have been dropped because the queue was full (always 0 unless writing
+    *        asynchronously).
+    *
+    * @return The total number of dropped messages.
+    */
+   uint64_t getDroppedMessageCount() const;
+
 private:
    PRIVATE_IMPL_SHARED(m_impl);
 };
@@ -19,6 +19,8 @@
 #ifndef TESTS_TESTRUNNER_HPP
 #define TESTS_TESTRUNNER_HPP
 
+#include <string>
+
 #ifdef RSTUDIO_UNIT_TESTS_ENABLED
 
 # define CATCH_CONFIG_RUNNER
@@ -41,6 +43,18 @@ int run()
    return Catch::Session().run(argc, const_cast<char**>(argv));
 }
 
+// run the tests matching a test spec (e.g. "[benchmark]"); runs the default
+// set of tests if the spec is empty
+int run(const std::string& testSpec)
+{
+   if (testSpec.empty())
+      return run();
+
+   int argc = 2;
+   const char* argv[2] = { "catch-unit-tests", testSpec.c_str() };
+   return Catch::Session().run(argc, const_cast<char**>(argv));
+}
+
 #else // not RSTUDIO_UNIT_TESTS_ENABLED
 
 int run()
@@ -48,6 +62,11 @@ int run()
    return -1;
 }
 
+int run(const std::string&)
+{
+   return -1;
+}
+
 #endif // end RSTUDIO_UNIT_TESTS_ENABLED
 
 } // namespace tests